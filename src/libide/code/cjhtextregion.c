@@ -1309,3 +1309,128 @@ _cjh_text_region_foreach_in_range (CjhTextRegion            *region,
       leaf = leaf->leaf.next;
     }
 }
+
+typedef struct
+{
+  gpointer data;
+  gsize    begin;
+  gsize    span_offset;
+  gsize    span_length;
+  gsize    before_offset;
+  gsize    before_length;
+  guint    in_span : 1;
+  guint    has_span : 1;
+  guint    has_before : 1;
+} FindNearest;
+
+static gboolean
+find_nearest_finish_span (FindNearest *state)
+{
+  state->in_span = FALSE;
+
+  /* Spans ending before @begin are only interesting if nothing
+   * closer comes after them.
+   */
+  if (state->span_offset + state->span_length <= state->begin)
+    {
+      state->before_offset = state->span_offset;
+      state->before_length = state->span_length;
+      state->has_before = TRUE;
+      return FALSE;
+    }
+
+  state->has_span = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+find_nearest_cb (gsize                   offset,
+                 const CjhTextRegionRun *run,
+                 gpointer                user_data)
+{
+  FindNearest *state = user_data;
+
+  if (run->data == state->data)
+    {
+      if (!state->in_span)
+        {
+          state->in_span = TRUE;
+          state->span_offset = offset;
+          state->span_length = 0;
+        }
+
+      state->span_length += run->length;
+
+      return FALSE;
+    }
+
+  if (state->in_span)
+    return find_nearest_finish_span (state);
+
+  return FALSE;
+}
+
+/*
+ * _cjh_text_region_find_nearest:
+ * @region: a #CjhTextRegion
+ * @data: the run data to look for
+ * @begin: the beginning of the range of interest
+ * @end: the end of the range of interest
+ * @offset: (out): location for the offset of the span
+ * @length: (out): location for the length of the span
+ *
+ * Locates the span of adjacent runs containing @data which is closest
+ * to the range described by @begin and @end.
+ *
+ * A span overlapping the range is preferred and is clipped so that it
+ * starts no earlier than @begin. Otherwise the closest span following
+ * or preceding the range is used, whichever is nearer.
+ *
+ * Using a range of 0,0 results in the first matching span.
+ *
+ * Returns: %TRUE if a span was found; otherwise %FALSE
+ */
+gboolean
+_cjh_text_region_find_nearest (CjhTextRegion *region,
+                               gpointer       data,
+                               gsize          begin,
+                               gsize          end,
+                               gsize         *offset,
+                               gsize         *length)
+{
+  FindNearest state = {0};
+
+  g_return_val_if_fail (region != NULL, FALSE);
+  g_return_val_if_fail (offset != NULL, FALSE);
+  g_return_val_if_fail (length != NULL, FALSE);
+
+  end = MAX (begin, end);
+
+  state.data = data;
+  state.begin = begin;
+
+  _cjh_text_region_foreach (region, find_nearest_cb, &state);
+
+  if (state.in_span)
+    find_nearest_finish_span (&state);
+
+  if (state.has_span &&
+      (state.span_offset < end ||
+       !state.has_before ||
+       state.span_offset - end <= begin - (state.before_offset + state.before_length)))
+    {
+      *offset = MAX (state.span_offset, begin);
+      *length = state.span_offset + state.span_length - *offset;
+      return TRUE;
+    }
+
+  if (state.has_before)
+    {
+      *offset = state.before_offset;
+      *length = state.before_length;
+      return TRUE;
+    }
+
+  return FALSE;
+}
@@ -114,6 +114,12 @@ void           _cjh_text_region_foreach_in_range (CjhTextRegion            *regi
                                                   gsize                     end,
                                                   CjhTextRegionForeachFunc  func,
                                                   gpointer                  user_data);
+gboolean       _cjh_text_region_find_nearest     (CjhTextRegion            *region,
+                                                  gpointer                  data,
+                                                  gsize                     begin,
+                                                  gsize                     end,
+                                                  gsize                    *offset,
+                                                  gsize                    *length);
 void           _cjh_text_region_free             (CjhTextRegion            *region);
 
 G_END_DECLS
@@ -37,11 +37,14 @@
 #include "ide-location.h"
 #include "ide-range.h"
 
+#define DEFAULT_LARGE_FILE_SIZE (5L * 1024L * 1024L)
+
 struct _IdeBufferManager
 {
   IdeObject   parent_instance;
   GHashTable *loading_tasks;
   gssize      max_file_size;
+  gint64      large_file_size;
 };
 
 typedef struct
@@ -72,6 +75,14 @@ typedef struct
   gpointer user_data;
 } Foreach;
 
+typedef struct
+{
+  IdeTask *task;
+  IdeNotification *notif;
+  IdeObjectBox *box;
+  IdeBuffer *buffer;
+} QueryFile;
+
 static void list_model_iface_init (GListModelInterface *iface);
 
 G_DEFINE_FINAL_TYPE_WITH_CODE (IdeBufferManager, ide_buffer_manager, IDE_TYPE_OBJECT,
@@ -80,6 +91,7 @@ G_DEFINE_FINAL_TYPE_WITH_CODE (IdeBufferManager, ide_buffer_manager, IDE_TYPE_OB
 enum {
   PROP_0,
   PROP_MAX_FILE_SIZE,
+  PROP_LARGE_FILE_SIZE,
   N_PROPS
 };
 
@@ -108,6 +120,16 @@ edit_state_free (EditState *state)
     }
 }
 
+static void
+query_file_free (QueryFile *state)
+{
+  g_clear_object (&state->task);
+  g_clear_object (&state->notif);
+  g_clear_object (&state->box);
+  g_clear_object (&state->buffer);
+  g_slice_free (QueryFile, state);
+}
+
 static void
 save_all_free (SaveAll *state)
 {
@@ -116,27 +138,52 @@ save_all_free (SaveAll *state)
   g_slice_free (SaveAll, state);
 }
 
+/*
+ * Creates a buffer and adds it to the manager so that it can be found
+ * with ide_buffer_manager_find_buffer(). Addins are not loaded until
+ * _ide_buffer_attach() is called with the returned box.
+ */
+static IdeObjectBox *
+ide_buffer_manager_add_buffer (IdeBufferManager *self,
+                               GFile            *file,
+                               gboolean          enable_addins,
+                               gboolean          is_temporary,
+                               gboolean          large_file)
+{
+  g_autoptr(IdeBuffer) buffer = NULL;
+  g_autoptr(IdeObjectBox) box = NULL;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER_MANAGER (self));
+
+  buffer = _ide_buffer_new (self, file, enable_addins, is_temporary, large_file);
+  box = ide_object_box_new (G_OBJECT (buffer));
+
+  ide_object_append (IDE_OBJECT (self), IDE_OBJECT (box));
+
+  return g_steal_pointer (&box);
+}
+
 static IdeBuffer *
 ide_buffer_manager_create_buffer (IdeBufferManager *self,
                                   GFile            *file,
                                   gboolean          enable_addins,
-                                  gboolean          is_temporary)
+                                  gboolean          is_temporary,
+                                  gboolean          large_file)
 {
-  g_autoptr(IdeBuffer) buffer = NULL;
   g_autoptr(IdeObjectBox) box = NULL;
+  IdeBuffer *buffer;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (IDE_IS_BUFFER_MANAGER (self));
 
-  buffer = _ide_buffer_new (self, file, enable_addins, is_temporary);
-  box = ide_object_box_new (G_OBJECT (buffer));
-
-  ide_object_append (IDE_OBJECT (self), IDE_OBJECT (box));
+  box = ide_buffer_manager_add_buffer (self, file, enable_addins, is_temporary, large_file);
+  buffer = ide_object_box_ref_object (box);
   _ide_buffer_attach (buffer, IDE_OBJECT (box));
 
-  IDE_RETURN (g_steal_pointer (&buffer));
+  IDE_RETURN (buffer);
 }
 
 static void
@@ -217,6 +264,10 @@ ide_buffer_manager_get_property (GObject    *object,
       g_value_set_int64 (value, ide_buffer_manager_get_max_file_size (self));
       break;
 
+    case PROP_LARGE_FILE_SIZE:
+      g_value_set_int64 (value, ide_buffer_manager_get_large_file_size (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -236,6 +287,10 @@ ide_buffer_manager_set_property (GObject      *object,
       ide_buffer_manager_set_max_file_size (self, g_value_get_int64 (value));
       break;
 
+    case PROP_LARGE_FILE_SIZE:
+      ide_buffer_manager_set_large_file_size (self, g_value_get_int64 (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -271,6 +326,24 @@ ide_buffer_manager_class_init (IdeBufferManagerClass *klass)
                         10L * 1024L * 1024L,
                         (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * IdeBufferManager:large-file-size:
+   *
+   * The "large-file-size" property is the file size in bytes at which
+   * files are opened in large-file mode.
+   *
+   * Large files are inserted into the buffer progressively and do not
+   * load buffer addins or highlighting. Set to -1 to disable.
+   *
+   * Since: 47
+   */
+  properties [PROP_LARGE_FILE_SIZE] =
+    g_param_spec_int64 ("large-file-size", NULL, NULL,
+                        -1,
+                        G_MAXINT64,
+                        DEFAULT_LARGE_FILE_SIZE,
+                        (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 
   /**
@@ -371,6 +444,7 @@ ide_buffer_manager_init (IdeBufferManager *self)
                                                (GEqualFunc)g_file_equal,
                                                g_object_unref,
                                                g_object_unref);
+  self->large_file_size = DEFAULT_LARGE_FILE_SIZE;
 
   IDE_EXIT;
 }
@@ -533,6 +607,51 @@ ide_buffer_manager_set_max_file_size (IdeBufferManager *self,
     }
 }
 
+/**
+ * ide_buffer_manager_get_large_file_size:
+ * @self: an #IdeBufferManager
+ *
+ * Gets the file size at which files are opened in large-file mode.
+ *
+ * Returns: the size in bytes or -1 if large-file mode is disabled
+ *
+ * Since: 47
+ */
+gint64
+ide_buffer_manager_get_large_file_size (IdeBufferManager *self)
+{
+  g_return_val_if_fail (IDE_IS_MAIN_THREAD (), -1);
+  g_return_val_if_fail (IDE_IS_BUFFER_MANAGER (self), -1);
+
+  return self->large_file_size;
+}
+
+/**
+ * ide_buffer_manager_set_large_file_size:
+ * @self: an #IdeBufferManager
+ * @large_file_size: the size in bytes or -1 to disable
+ *
+ * Sets the file size at which files are opened in large-file mode.
+ *
+ * This only affects buffers created after the change.
+ *
+ * Since: 47
+ */
+void
+ide_buffer_manager_set_large_file_size (IdeBufferManager *self,
+                                        gint64            large_file_size)
+{
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (IDE_IS_BUFFER_MANAGER (self));
+  g_return_if_fail (large_file_size >= -1);
+
+  if (self->large_file_size != large_file_size)
+    {
+      self->large_file_size = large_file_size;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_LARGE_FILE_SIZE]);
+    }
+}
+
 static void
 ide_buffer_manager_load_file_cb (GObject      *object,
                                  GAsyncResult *result,
@@ -566,6 +685,82 @@ ide_buffer_manager_load_file_cb (GObject      *object,
   IDE_EXIT;
 }
 
+static void
+ide_buffer_manager_load_buffer (IdeBufferManager *self,
+                                IdeBuffer        *buffer,
+                                IdeNotification  *notif,
+                                IdeTask          *task)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER_MANAGER (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (!notif || IDE_IS_NOTIFICATION (notif));
+  g_assert (IDE_IS_TASK (task));
+
+  /* Notify any listeners of new buffers */
+  g_signal_emit (self, signals [LOAD_BUFFER], 0, buffer);
+
+  /* Now we can load the buffer asynchronously */
+  _ide_buffer_load_file_async (buffer,
+                               notif,
+                               ide_task_get_cancellable (task),
+                               ide_buffer_manager_load_file_cb,
+                               g_object_ref (task));
+}
+
+static void
+ide_buffer_manager_query_file_cb (GObject      *object,
+                                  GAsyncResult *result,
+                                  gpointer      user_data)
+{
+  GFile *file = (GFile *)object;
+  g_autoptr(GFileInfo) info = NULL;
+  QueryFile *state = user_data;
+  IdeBufferManager *self;
+  gboolean large_file = FALSE;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (G_IS_FILE (file));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (state != NULL);
+  g_assert (IDE_IS_TASK (state->task));
+
+  self = ide_task_get_source_object (state->task);
+
+  g_assert (IDE_IS_BUFFER_MANAGER (self));
+
+  /* Errors are left for the buffer to report while loading */
+  if ((info = g_file_query_info_finish (file, result, NULL)) &&
+      g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+    large_file = self->large_file_size >= 0 &&
+                 g_file_info_get_size (info) >= self->large_file_size;
+
+  if (self->loading_tasks == NULL || ide_object_in_destruction (IDE_OBJECT (self)))
+    {
+      ide_object_destroy (IDE_OBJECT (state->box));
+      ide_task_return_new_error (state->task,
+                                 G_IO_ERROR,
+                                 G_IO_ERROR_CANCELLED,
+                                 "The buffer manager was destroyed");
+      query_file_free (state);
+      IDE_EXIT;
+    }
+
+  if (large_file)
+    g_debug ("Opening \"%s\" in large-file mode", g_file_peek_path (file));
+
+  /* Now that the mode is known, addins can be loaded */
+  _ide_buffer_set_large_file (state->buffer, large_file);
+  _ide_buffer_attach (state->buffer, IDE_OBJECT (state->box));
+  ide_buffer_manager_load_buffer (self, state->buffer, state->notif, state->task);
+
+  query_file_free (state);
+
+  IDE_EXIT;
+}
+
 /**
  * ide_buffer_manager_load_file_async:
  * @self: an #IdeBufferManager
@@ -593,6 +788,9 @@ ide_buffer_manager_load_file_cb (GObject      *object,
  *
  * If @notif is non-NULL, it will be updated with status information while
  * loading the document.
+ *
+ * Files larger than #IdeBufferManager:large-file-size are opened in
+ * large-file mode. See ide_buffer_is_large_file().
  */
 void
 ide_buffer_manager_load_file_async (IdeBufferManager     *self,
@@ -630,32 +828,63 @@ ide_buffer_manager_load_file_async (IdeBufferManager     *self,
     {
       IdeTask *existing_task;
 
-      /* If the buffer does not need to be reloaded, just return the
-       * buffer to the user now.
+      /* If the buffer is still loading (or still having its size
+       * queried), we can just chain onto that loading operation and
+       * complete this task when that task finishes.
        */
-      if (!(flags & IDE_BUFFER_OPEN_FLAGS_FORCE_RELOAD))
+      if ((existing_task = g_hash_table_lookup (self->loading_tasks, file)))
         {
-          ide_task_return_object (task, g_object_ref (existing));
+          ide_task_chain (existing_task, task);
           IDE_EXIT;
         }
 
-      /* If the buffer is still loading, we can just chain onto that
-       * loading operation and complete this task when that task finishes.
+      /* If the buffer does not need to be reloaded, just return the
+       * buffer to the user now.
        */
-      if ((existing_task = g_hash_table_lookup (self->loading_tasks, file)))
+      if (!(flags & IDE_BUFFER_OPEN_FLAGS_FORCE_RELOAD))
         {
-          ide_task_chain (existing_task, task);
+          ide_task_return_object (task, g_object_ref (existing));
           IDE_EXIT;
         }
 
       buffer = g_object_ref (existing);
     }
-  else
+  else if (temp_file != NULL)
     {
       /* Create the buffer and track it so we can find it later */
       buffer = ide_buffer_manager_create_buffer (self, file,
                                                  (flags & IDE_BUFFER_OPEN_FLAGS_DISABLE_ADDINS) == 0,
-                                                 temp_file != NULL);
+                                                 TRUE,
+                                                 FALSE);
+    }
+  else
+    {
+      QueryFile *state;
+
+      g_hash_table_insert (self->loading_tasks, g_file_dup (file), g_object_ref (task));
+
+      /* Register the buffer right away so that other requests for the
+       * file find it while we query the size. Addins are loaded once we
+       * know whether it is a large file.
+       */
+      state = g_slice_new0 (QueryFile);
+      state->task = g_steal_pointer (&task);
+      state->notif = notif ? g_object_ref (notif) : NULL;
+      state->box = ide_buffer_manager_add_buffer (self, file,
+                                                  (flags & IDE_BUFFER_OPEN_FLAGS_DISABLE_ADDINS) == 0,
+                                                  FALSE,
+                                                  FALSE);
+      state->buffer = ide_object_box_ref_object (state->box);
+
+      g_file_query_info_async (file,
+                               G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                               G_FILE_QUERY_INFO_NONE,
+                               G_PRIORITY_DEFAULT,
+                               cancellable,
+                               ide_buffer_manager_query_file_cb,
+                               state);
+
+      IDE_EXIT;
     }
 
   /* Save this task for later in case we get in a second request to open
@@ -663,17 +892,10 @@ ide_buffer_manager_load_file_async (IdeBufferManager     *self,
    */
   g_hash_table_insert (self->loading_tasks, g_file_dup (file), g_object_ref (task));
 
-  /* Notify any listeners of new buffers */
   g_assert (buffer != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
-  g_signal_emit (self, signals [LOAD_BUFFER], 0, buffer);
 
-  /* Now we can load the buffer asynchronously */
-  _ide_buffer_load_file_async (buffer,
-                               notif,
-                               cancellable,
-                               ide_buffer_manager_load_file_cb,
-                               g_steal_pointer (&task));
+  ide_buffer_manager_load_buffer (self, buffer, notif, task);
 
   IDE_EXIT;
 }
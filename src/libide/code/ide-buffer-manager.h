@@ -110,6 +110,11 @@ gssize            ide_buffer_manager_get_max_file_size  (IdeBufferManager      *
 IDE_AVAILABLE_IN_ALL
 void              ide_buffer_manager_set_max_file_size  (IdeBufferManager      *self,
                                                          gssize                 max_file_size);
+IDE_AVAILABLE_IN_47
+gint64            ide_buffer_manager_get_large_file_size (IdeBufferManager      *self);
+IDE_AVAILABLE_IN_47
+void              ide_buffer_manager_set_large_file_size (IdeBufferManager      *self,
+                                                          gint64                 large_file_size);
 IDE_AVAILABLE_IN_ALL
 void              ide_buffer_manager_apply_edits_async  (IdeBufferManager      *self,
                                                          GPtrArray             *edits,
@@ -39,7 +39,8 @@ IdeExtensionSetAdapter *_ide_buffer_get_addins               (IdeBuffer
 IdeBuffer              *_ide_buffer_new                      (IdeBufferManager     *self,
                                                               GFile                *file,
                                                               gboolean              enable_addins,
-                                                              gboolean              is_temporary);
+                                                              gboolean              is_temporary,
+                                                              gboolean              large_file);
 void                    _ide_buffer_attach                   (IdeBuffer            *self,
                                                               IdeObject            *parent);
 gboolean                _ide_buffer_is_file                  (IdeBuffer            *self,
@@ -53,10 +54,15 @@ gboolean                _ide_buffer_load_file_finish         (IdeBuffer
                                                               GAsyncResult         *result,
                                                               GError              **error);
 void                    _ide_buffer_line_flags_changed       (IdeBuffer            *self);
+gboolean                _ide_buffer_sniff_text               (const char           *contents,
+                                                              gsize                 length,
+                                                              GtkSourceNewlineType *newline_type);
 void                    _ide_buffer_set_changed_on_volume    (IdeBuffer            *self,
                                                               gboolean              changed_on_volume);
 void                    _ide_buffer_set_read_only            (IdeBuffer            *self,
                                                               gboolean              read_only);
+void                    _ide_buffer_set_large_file           (IdeBuffer            *self,
+                                                              gboolean              large_file);
 IdeHighlightEngine     *_ide_buffer_get_highlight_engine     (IdeBuffer            *self);
 void                    _ide_buffer_set_failure              (IdeBuffer            *self,
                                                               const GError         *error);
@@ -0,0 +1,46 @@
+/* ide-buffer-snapshot-private.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "ide-buffer-snapshot.h"
+
+G_BEGIN_DECLS
+
+typedef struct _IdePieceTable IdePieceTable;
+
+IdePieceTable     *_ide_piece_table_new              (void);
+void               _ide_piece_table_free             (IdePieceTable *self);
+void               _ide_piece_table_insert           (IdePieceTable *self,
+                                                      gsize          char_offset,
+                                                      const char    *text,
+                                                      gsize          len);
+void               _ide_piece_table_delete           (IdePieceTable *self,
+                                                      gsize          char_offset,
+                                                      gsize          n_chars);
+IdeBufferSnapshot *_ide_piece_table_snapshot         (IdePieceTable *self,
+                                                      guint          sequence,
+                                                      gboolean       trailing_newline);
+IdeBufferSnapshot *_ide_buffer_snapshot_new_for_text (const char    *text,
+                                                      gsize          len,
+                                                      guint          sequence,
+                                                      gboolean       trailing_newline);
+
+G_END_DECLS
@@ -0,0 +1,749 @@
+/* ide-buffer-snapshot.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-buffer-snapshot"
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ide-buffer-snapshot.h"
+#include "ide-buffer-snapshot-private.h"
+
+/*
+ * IdeBuffer keeps a piece table alongside the GtkTextBuffer which is
+ * updated from the insert-text and delete-range vfuncs. Inserted text is
+ * appended to fixed-size, reference counted chunks which are never modified
+ * once written, so a snapshot only needs to copy the (small) array of pieces
+ * and take a reference on the chunks. That makes snapshots cheap to create
+ * on the main thread and safe to read from any thread afterwards.
+ *
+ * Pieces are kept under PIECE_MAX bytes so that converting a character
+ * offset to a byte offset never scans more than a single piece.
+ */
+
+#define CHUNK_SIZE       (64 * 1024)
+#define PIECE_MAX        CHUNK_SIZE
+#define COMPACT_N_PIECES 4096
+
+typedef struct
+{
+  gsize len;
+  gsize capacity;
+  char  data[];
+} Chunk;
+
+typedef struct
+{
+  Chunk *chunk;
+  guint  offset;
+  guint  length;
+  guint  n_chars;
+  guint  n_lines;
+} Piece;
+
+struct _IdePieceTable
+{
+  GArray    *pieces;
+  GPtrArray *chunks;
+  Chunk     *current;
+  gsize      allocated;
+  gsize      length;
+  gsize      n_chars;
+  guint      n_lines;
+};
+
+struct _IdeBufferSnapshot
+{
+  GMutex     mutex;
+  Piece     *pieces;
+  GPtrArray *chunks;
+  GBytes    *content;
+  gsize      length;
+  guint      n_pieces;
+  guint      n_lines;
+  guint      sequence;
+  guint      trailing_newline : 1;
+};
+
+G_DEFINE_BOXED_TYPE (IdeBufferSnapshot, ide_buffer_snapshot,
+                     ide_buffer_snapshot_ref, ide_buffer_snapshot_unref)
+
+static inline const char *
+piece_data (const Piece *piece)
+{
+  return piece->chunk->data + piece->offset;
+}
+
+static inline gsize
+piece_char_to_byte (const Piece *piece,
+                    guint        char_offset)
+{
+  const char *data;
+
+  g_assert (char_offset <= piece->n_chars);
+
+  /* Fast path for pieces that are entirely ASCII */
+  if (piece->n_chars == piece->length)
+    return char_offset;
+
+  data = piece_data (piece);
+
+  return g_utf8_offset_to_pointer (data, char_offset) - data;
+}
+
+static guint
+count_lines (const char *data,
+             gsize       len)
+{
+  const char *end = data + len;
+  guint n_lines = 0;
+
+  while (data < end && (data = memchr (data, '\n', end - data)))
+    {
+      n_lines++;
+      data++;
+    }
+
+  return n_lines;
+}
+
+static Chunk *
+chunk_new (gsize capacity)
+{
+  Chunk *chunk;
+
+  chunk = g_atomic_rc_box_alloc (sizeof (Chunk) + capacity);
+  chunk->len = 0;
+  chunk->capacity = capacity;
+
+  return chunk;
+}
+
+IdePieceTable *
+_ide_piece_table_new (void)
+{
+  IdePieceTable *self;
+
+  self = g_slice_new0 (IdePieceTable);
+  self->pieces = g_array_new (FALSE, FALSE, sizeof (Piece));
+  self->chunks = g_ptr_array_new_with_free_func (g_atomic_rc_box_release);
+
+  return self;
+}
+
+void
+_ide_piece_table_free (IdePieceTable *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->pieces, g_array_unref);
+      g_clear_pointer (&self->chunks, g_ptr_array_unref);
+      self->current = NULL;
+      g_slice_free (IdePieceTable, self);
+    }
+}
+
+static guint
+_ide_piece_table_find (IdePieceTable *self,
+                       gsize          char_offset,
+                       guint         *piece_offset)
+{
+  g_assert (self != NULL);
+  g_assert (piece_offset != NULL);
+
+  for (guint i = 0; i < self->pieces->len; i++)
+    {
+      const Piece *piece = &g_array_index (self->pieces, Piece, i);
+
+      if (char_offset < piece->n_chars)
+        {
+          *piece_offset = char_offset;
+          return i;
+        }
+
+      char_offset -= piece->n_chars;
+    }
+
+  *piece_offset = 0;
+
+  return self->pieces->len;
+}
+
+static guint
+_ide_piece_table_append (IdePieceTable *self,
+                         const char    *text,
+                         gsize          len)
+{
+  guint offset;
+
+  g_assert (self != NULL);
+  g_assert (len <= PIECE_MAX);
+
+  if (self->current == NULL ||
+      self->current->capacity - self->current->len < len)
+    {
+      self->current = chunk_new (CHUNK_SIZE);
+      self->allocated += CHUNK_SIZE;
+      g_ptr_array_add (self->chunks, self->current);
+    }
+
+  offset = self->current->len;
+  memcpy (self->current->data + offset, text, len);
+  self->current->len += len;
+
+  return offset;
+}
+
+static void
+_ide_piece_table_compact (IdePieceTable *self)
+{
+  GPtrArray *chunks;
+  GArray *pieces;
+  Chunk *chunk;
+  gsize pos = 0;
+
+  g_assert (self != NULL);
+
+  chunk = chunk_new (MAX (1, self->length));
+
+  for (guint i = 0; i < self->pieces->len; i++)
+    {
+      const Piece *piece = &g_array_index (self->pieces, Piece, i);
+
+      memcpy (chunk->data + chunk->len, piece_data (piece), piece->length);
+      chunk->len += piece->length;
+    }
+
+  g_assert (chunk->len == self->length);
+
+  pieces = g_array_sized_new (FALSE, FALSE, sizeof (Piece), (self->length / PIECE_MAX) + 1);
+
+  while (pos < chunk->len)
+    {
+      Piece piece;
+      gsize len = MIN (PIECE_MAX, chunk->len - pos);
+
+      /* Never split a UTF-8 sequence between two pieces */
+      if (pos + len < chunk->len)
+        {
+          while (len > 0 && (chunk->data[pos + len] & 0xC0) == 0x80)
+            len--;
+        }
+
+      g_assert (len > 0);
+
+      piece.chunk = chunk;
+      piece.offset = pos;
+      piece.length = len;
+      piece.n_chars = g_utf8_strlen (chunk->data + pos, len);
+      piece.n_lines = count_lines (chunk->data + pos, len);
+
+      g_array_append_val (pieces, piece);
+
+      pos += len;
+    }
+
+  chunks = g_ptr_array_new_with_free_func (g_atomic_rc_box_release);
+  g_ptr_array_add (chunks, chunk);
+
+  g_clear_pointer (&self->pieces, g_array_unref);
+  g_clear_pointer (&self->chunks, g_ptr_array_unref);
+
+  self->pieces = pieces;
+  self->chunks = chunks;
+  self->allocated = chunk->capacity;
+
+  /* The compacted chunk is full, next insertion gets a new one */
+  self->current = NULL;
+}
+
+static void
+_ide_piece_table_maybe_compact (IdePieceTable *self)
+{
+  g_assert (self != NULL);
+
+  /* Compact when lookups get too long or when too much of the chunk
+   * space is only referenced by text which has since been deleted.
+   */
+  if (self->pieces->len > COMPACT_N_PIECES + (self->length / PIECE_MAX) ||
+      self->allocated > (self->length * 2) + (CHUNK_SIZE * 16))
+    _ide_piece_table_compact (self);
+}
+
+static void
+_ide_piece_table_insert_piece (IdePieceTable *self,
+                               gsize          char_offset,
+                               const char    *text,
+                               gsize          len,
+                               guint          n_chars)
+{
+  Piece piece;
+  guint piece_offset;
+  guint index;
+
+  g_assert (self != NULL);
+  g_assert (len > 0);
+  g_assert (len <= PIECE_MAX);
+
+  piece.offset = _ide_piece_table_append (self, text, len);
+  piece.chunk = self->current;
+  piece.length = len;
+  piece.n_chars = n_chars;
+  piece.n_lines = count_lines (text, len);
+
+  self->length += piece.length;
+  self->n_chars += piece.n_chars;
+  self->n_lines += piece.n_lines;
+
+  index = _ide_piece_table_find (self, char_offset, &piece_offset);
+
+  if (piece_offset == 0)
+    {
+      /* Typing generally appends to the previous insertion, so try to
+       * extend that piece instead of adding a new one.
+       */
+      if (index > 0)
+        {
+          Piece *prev = &g_array_index (self->pieces, Piece, index - 1);
+
+          if (prev->chunk == piece.chunk &&
+              prev->offset + prev->length == piece.offset &&
+              prev->length + piece.length <= PIECE_MAX)
+            {
+              prev->length += piece.length;
+              prev->n_chars += piece.n_chars;
+              prev->n_lines += piece.n_lines;
+              return;
+            }
+        }
+
+      g_array_insert_val (self->pieces, index, piece);
+    }
+  else
+    {
+      Piece *left = &g_array_index (self->pieces, Piece, index);
+      Piece right;
+      gsize split;
+
+      split = piece_char_to_byte (left, piece_offset);
+
+      right.chunk = left->chunk;
+      right.offset = left->offset + split;
+      right.length = left->length - split;
+      right.n_chars = left->n_chars - piece_offset;
+      right.n_lines = count_lines (piece_data (&right), right.length);
+
+      left->length = split;
+      left->n_chars = piece_offset;
+      left->n_lines -= right.n_lines;
+
+      g_array_insert_val (self->pieces, index + 1, piece);
+      g_array_insert_val (self->pieces, index + 2, right);
+    }
+}
+
+void
+_ide_piece_table_insert (IdePieceTable *self,
+                         gsize          char_offset,
+                         const char    *text,
+                         gsize          len)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (text != NULL || len == 0);
+  g_return_if_fail (char_offset <= self->n_chars);
+
+  while (len > 0)
+    {
+      gsize piece_len = len;
+      guint n_chars;
+
+      if (piece_len > PIECE_MAX)
+        {
+          piece_len = PIECE_MAX;
+          while (piece_len > 0 && (text[piece_len] & 0xC0) == 0x80)
+            piece_len--;
+        }
+
+      n_chars = g_utf8_strlen (text, piece_len);
+
+      _ide_piece_table_insert_piece (self, char_offset, text, piece_len, n_chars);
+
+      char_offset += n_chars;
+      text += piece_len;
+      len -= piece_len;
+    }
+
+  _ide_piece_table_maybe_compact (self);
+}
+
+void
+_ide_piece_table_delete (IdePieceTable *self,
+                         gsize          char_offset,
+                         gsize          n_chars)
+{
+  guint piece_offset;
+  guint index;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (char_offset + n_chars <= self->n_chars);
+
+  if (n_chars == 0)
+    return;
+
+  index = _ide_piece_table_find (self, char_offset, &piece_offset);
+
+  while (n_chars > 0 && index < self->pieces->len)
+    {
+      Piece *piece = &g_array_index (self->pieces, Piece, index);
+      guint count = MIN (n_chars, piece->n_chars - piece_offset);
+      gsize begin = piece_char_to_byte (piece, piece_offset);
+      gsize end = piece_char_to_byte (piece, piece_offset + count);
+      guint n_lines = count_lines (piece_data (piece) + begin, end - begin);
+
+      self->length -= end - begin;
+      self->n_chars -= count;
+      self->n_lines -= n_lines;
+      n_chars -= count;
+
+      if (begin == 0 && end == piece->length)
+        {
+          g_array_remove_index (self->pieces, index);
+        }
+      else if (begin == 0)
+        {
+          piece->offset += end;
+          piece->length -= end;
+          piece->n_chars -= count;
+          piece->n_lines -= n_lines;
+          index++;
+        }
+      else if (end == piece->length)
+        {
+          piece->length = begin;
+          piece->n_chars -= count;
+          piece->n_lines -= n_lines;
+          index++;
+        }
+      else
+        {
+          Piece right;
+
+          right.chunk = piece->chunk;
+          right.offset = piece->offset + end;
+          right.length = piece->length - end;
+          right.n_chars = piece->n_chars - piece_offset - count;
+          right.n_lines = count_lines (piece_data (&right), right.length);
+
+          piece->n_lines -= n_lines + right.n_lines;
+          piece->length = begin;
+          piece->n_chars = piece_offset;
+
+          g_array_insert_val (self->pieces, index + 1, right);
+          index += 2;
+        }
+
+      piece_offset = 0;
+    }
+
+  _ide_piece_table_maybe_compact (self);
+}
+
+IdeBufferSnapshot *
+_ide_piece_table_snapshot (IdePieceTable *self,
+                           guint          sequence,
+                           gboolean       trailing_newline)
+{
+  IdeBufferSnapshot *snapshot;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  snapshot = g_atomic_rc_box_new0 (IdeBufferSnapshot);
+  g_mutex_init (&snapshot->mutex);
+  snapshot->pieces = g_memdup2 (self->pieces->data, sizeof (Piece) * self->pieces->len);
+  snapshot->n_pieces = self->pieces->len;
+  snapshot->chunks = g_ptr_array_new_full (self->chunks->len, g_atomic_rc_box_release);
+  snapshot->length = self->length;
+  snapshot->n_lines = self->n_lines;
+  snapshot->sequence = sequence;
+  snapshot->trailing_newline = !!trailing_newline;
+
+  for (guint i = 0; i < self->chunks->len; i++)
+    g_ptr_array_add (snapshot->chunks,
+                     g_atomic_rc_box_acquire (g_ptr_array_index (self->chunks, i)));
+
+  return snapshot;
+}
+
+IdeBufferSnapshot *
+_ide_buffer_snapshot_new_for_text (const char *text,
+                                   gsize       len,
+                                   guint       sequence,
+                                   gboolean    trailing_newline)
+{
+  IdePieceTable *table;
+  IdeBufferSnapshot *ret;
+
+  table = _ide_piece_table_new ();
+  _ide_piece_table_insert (table, 0, text, len);
+  ret = _ide_piece_table_snapshot (table, sequence, trailing_newline);
+  _ide_piece_table_free (table);
+
+  return ret;
+}
+
+static void
+ide_buffer_snapshot_finalize (IdeBufferSnapshot *self)
+{
+  g_clear_pointer (&self->pieces, g_free);
+  g_clear_pointer (&self->chunks, g_ptr_array_unref);
+  g_clear_pointer (&self->content, g_bytes_unref);
+  g_mutex_clear (&self->mutex);
+}
+
+/**
+ * ide_buffer_snapshot_ref:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Increments the reference count of @self.
+ *
+ * Returns: (transfer full): @self
+ *
+ * Since: 47
+ */
+IdeBufferSnapshot *
+ide_buffer_snapshot_ref (IdeBufferSnapshot *self)
+{
+  return g_atomic_rc_box_acquire (self);
+}
+
+/**
+ * ide_buffer_snapshot_unref:
+ * @self: (transfer full): an #IdeBufferSnapshot
+ *
+ * Decrements the reference count of @self.
+ *
+ * Since: 47
+ */
+void
+ide_buffer_snapshot_unref (IdeBufferSnapshot *self)
+{
+  g_atomic_rc_box_release_full (self, (GDestroyNotify)ide_buffer_snapshot_finalize);
+}
+
+/**
+ * ide_buffer_snapshot_get_sequence:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the #IdeBuffer:change-count of the buffer at the time the
+ * snapshot was created.
+ *
+ * Returns: the change sequence of the snapshot
+ *
+ * Since: 47
+ */
+guint
+ide_buffer_snapshot_get_sequence (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->sequence;
+}
+
+/**
+ * ide_buffer_snapshot_get_length:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the length of the snapshot in bytes, including the implicit
+ * trailing newline if the buffer had one.
+ *
+ * Returns: the length in bytes
+ *
+ * Since: 47
+ */
+gsize
+ide_buffer_snapshot_get_length (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->length + self->trailing_newline;
+}
+
+/**
+ * ide_buffer_snapshot_get_n_lines:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the number of lines in the snapshot, matching
+ * gtk_text_buffer_get_line_count() at the time it was created.
+ *
+ * Returns: the number of lines
+ *
+ * Since: 47
+ */
+guint
+ide_buffer_snapshot_get_n_lines (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->n_lines + 1;
+}
+
+/**
+ * ide_buffer_snapshot_dup_content:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the contents of the snapshot as #GBytes.
+ *
+ * The contents are only serialized the first time this is called and
+ * the result is shared with later callers. This may be called from any
+ * thread, which allows deferring the copy to a worker.
+ *
+ * Like ide_buffer_dup_content(), the data is followed by a trailing
+ * `\0` which is not included in the length of the bytes.
+ *
+ * Returns: (transfer full): a #GBytes
+ *
+ * Since: 47
+ */
+GBytes *
+ide_buffer_snapshot_dup_content (IdeBufferSnapshot *self)
+{
+  GBytes *ret;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->content == NULL)
+    {
+      gsize len = self->length + self->trailing_newline;
+      char *data = g_malloc (len + 1);
+      char *pos = data;
+
+      for (guint i = 0; i < self->n_pieces; i++)
+        {
+          const Piece *piece = &self->pieces[i];
+
+          memcpy (pos, piece_data (piece), piece->length);
+          pos += piece->length;
+        }
+
+      if (self->trailing_newline)
+        *pos++ = '\n';
+      *pos = 0;
+
+      self->content = g_bytes_new_take (data, len);
+    }
+
+  ret = g_bytes_ref (self->content);
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * ide_buffer_snapshot_dup_lines:
+ * @self: an #IdeBufferSnapshot
+ * @begin_line: the first line, starting from 0
+ * @end_line: the last line to include
+ * @length: (out) (optional): location for the length in bytes
+ *
+ * Copies the text of lines @begin_line through @end_line (inclusive)
+ * without serializing the rest of the snapshot. Each line includes its
+ * trailing newline, if any.
+ *
+ * Lines past the end of the snapshot are ignored.
+ *
+ * Returns: (transfer full): a newly allocated string
+ *
+ * Since: 47
+ */
+char *
+ide_buffer_snapshot_dup_lines (IdeBufferSnapshot *self,
+                               guint              begin_line,
+                               guint              end_line,
+                               gsize             *length)
+{
+  GString *str;
+  gboolean in_range;
+  guint line = 0;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (begin_line <= end_line, NULL);
+
+  str = g_string_new (NULL);
+  in_range = begin_line == 0;
+
+  for (i = 0; i < self->n_pieces && line <= end_line; i++)
+    {
+      const Piece *piece = &self->pieces[i];
+      const char *iter = piece_data (piece);
+      const char *end = iter + piece->length;
+
+      if (!in_range)
+        {
+          /* Skip pieces without looking at their contents */
+          if (line + piece->n_lines < begin_line)
+            {
+              line += piece->n_lines;
+              continue;
+            }
+
+          while (line < begin_line)
+            {
+              iter = memchr (iter, '\n', end - iter);
+              g_assert (iter != NULL);
+              iter++;
+              line++;
+            }
+
+          in_range = TRUE;
+        }
+
+      while (iter < end && line <= end_line)
+        {
+          const char *nl = memchr (iter, '\n', end - iter);
+
+          if (nl == NULL)
+            {
+              g_string_append_len (str, iter, end - iter);
+              break;
+            }
+
+          g_string_append_len (str, iter, nl - iter + 1);
+          iter = nl + 1;
+          line++;
+        }
+    }
+
+  if (in_range &&
+      self->trailing_newline &&
+      i == self->n_pieces &&
+      line <= end_line &&
+      line == self->n_lines)
+    g_string_append_c (str, '\n');
+
+  if (length != NULL)
+    *length = str->len;
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,57 @@
+/* ide-buffer-snapshot.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#if !defined (IDE_CODE_INSIDE) && !defined (IDE_CODE_COMPILATION)
+# error "Only <libide-code.h> can be included directly."
+#endif
+
+#include <libide-core.h>
+
+#include "ide-code-types.h"
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_BUFFER_SNAPSHOT (ide_buffer_snapshot_get_type())
+
+IDE_AVAILABLE_IN_47
+GType              ide_buffer_snapshot_get_type     (void) G_GNUC_CONST;
+IDE_AVAILABLE_IN_47
+IdeBufferSnapshot *ide_buffer_snapshot_ref          (IdeBufferSnapshot *self);
+IDE_AVAILABLE_IN_47
+void               ide_buffer_snapshot_unref        (IdeBufferSnapshot *self);
+IDE_AVAILABLE_IN_47
+guint              ide_buffer_snapshot_get_sequence (IdeBufferSnapshot *self);
+IDE_AVAILABLE_IN_47
+gsize              ide_buffer_snapshot_get_length   (IdeBufferSnapshot *self);
+IDE_AVAILABLE_IN_47
+guint              ide_buffer_snapshot_get_n_lines  (IdeBufferSnapshot *self);
+IDE_AVAILABLE_IN_47
+GBytes            *ide_buffer_snapshot_dup_content  (IdeBufferSnapshot *self);
+IDE_AVAILABLE_IN_47
+char              *ide_buffer_snapshot_dup_lines    (IdeBufferSnapshot *self,
+                                                     guint              begin_line,
+                                                     guint              end_line,
+                                                     gsize             *length);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeBufferSnapshot, ide_buffer_snapshot_unref)
+
+G_END_DECLS
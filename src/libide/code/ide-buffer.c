@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include <libide-io.h>
 #include <libide-plugins.h>
@@ -35,10 +36,13 @@
 #include "ide-buffer-addin-private.h"
 #include "ide-buffer-manager.h"
 #include "ide-buffer-private.h"
+#include "ide-buffer-snapshot.h"
+#include "ide-buffer-snapshot-private.h"
 #include "ide-code-action-provider.h"
 #include "ide-code-enums.h"
 #include "ide-diagnostic.h"
 #include "ide-diagnostics.h"
+#include "ide-diagnostics-private.h"
 #include "ide-file-settings.h"
 #include "ide-formatter.h"
 #include "ide-formatter-options.h"
@@ -49,6 +53,7 @@
 #include "ide-source-iter.h"
 #include "ide-source-style-scheme.h"
 #include "ide-symbol-resolver.h"
+#include "ide-unsaved-file-private.h"
 #include "ide-unsaved-files.h"
 
 #define SETTLING_DELAY_MSEC  333
@@ -62,6 +67,11 @@
 #define TAG_DEFINITION       "-Builder:hover-definition"
 #define TAG_CURRENT_BKPT     "-Builder:current-breakpoint"
 
+#define LARGE_FILE_CHUNK_SIZE (256 * 1024)
+#define LARGE_FILE_CHUNK_USEC  (G_USEC_PER_SEC / 250)
+
+#define MAX_DIAGNOSTICS_EDITS 256
+
 #define DEPRECATED_COLOR     "#babdb6"
 #define UNUSED_COLOR         "#c17d11"
 #define ERROR_COLOR          "#ff0000"
@@ -85,6 +95,8 @@ struct _IdeBuffer
   IdeBufferManager       *buffer_manager;
   IdeBufferChangeMonitor *change_monitor;
   GBytes                 *content;
+  IdeBufferSnapshot      *snapshot;
+  IdePieceTable          *piece_table;
   IdeDiagnostics         *diagnostics;
   GError                 *failure;
   IdeFileSettings        *file_settings;
@@ -99,12 +111,17 @@ struct _IdeBuffer
 
   guint                   change_count;
   guint                   settling_source;
+  guint                   visible_begin_line;
+  guint                   visible_end_line;
   int                     hold;
   guint                   release_in_idle;
 
   GArray                 *commit_funcs;
   guint                   next_commit_handler;
 
+  /* Line edits since diagnostics were last styled, see DiagnosticsEdit */
+  GArray                 *diagnostics_edits;
+
   /* Bit-fields */
   IdeBufferState          state : 3;
   guint                   can_restore_cursor : 1;
@@ -114,6 +131,9 @@ struct _IdeBuffer
   guint                   read_only : 1;
   guint                   has_encoding_error : 1;
   guint                   highlight_diagnostics : 1;
+  guint                   diagnostics_edits_overflow : 1;
+  guint                   has_visible_range : 1;
+  guint                   large_file : 1;
   GtkSourceNewlineType    newline_type : 2;
 };
 
@@ -128,18 +148,43 @@ typedef struct
   guint handler_id;
 } CommitHooks;
 
+/*
+ * Records how an edit moved lines around so that the lines of previously
+ * styled diagnostics can be mapped to where their tags are now. Lines
+ * after @line + @old_lines move by @new_lines - @old_lines.
+ */
+typedef struct
+{
+  guint line;
+  guint old_lines;
+  guint new_lines;
+} DiagnosticsEdit;
+
 typedef struct
 {
   IdeNotification *notif;
   GFile           *file;
+  GMappedFile     *mapped;
+  gsize            pos;
+  gsize            length;
+  gint64           begin_time;
   guint            highlight_syntax : 1;
+  guint            withdraw_notif : 1;
 } LoadState;
 
+typedef struct
+{
+  GMappedFile          *mapped;
+  GtkSourceNewlineType  newline_type;
+  guint                 is_utf8 : 1;
+} MappedText;
+
 typedef struct
 {
   GFile           *file;
   IdeNotification *notif;
   GtkSourceFile   *source_file;
+  gint64           begin_time;
 } SaveState;
 
 typedef struct
@@ -184,6 +229,7 @@ enum {
   LINE_FLAGS_CHANGED,
   LOADED,
   REQUEST_SCROLL_TO_INSERT,
+  VISIBLE_RANGE_CHANGED,
   N_SIGNALS
 };
 
@@ -221,6 +267,9 @@ static void     ide_buffer_notify_language         (IdeBuffer              *self
 static void     ide_buffer_notify_style_scheme     (IdeBuffer              *self,
                                                     GParamSpec             *pspec,
                                                     gpointer                unused);
+static void     ide_buffer_notify_trailing_newline (IdeBuffer              *self,
+                                                    GParamSpec             *pspec,
+                                                    gpointer                user_data);
 static void     ide_buffer_reload_file_settings    (IdeBuffer              *self);
 static void     ide_buffer_set_file_settings       (IdeBuffer              *self,
                                                     IdeFileSettings        *file_settings);
@@ -232,10 +281,18 @@ static void     ide_buffer_insert_text             (GtkTextBuffer          *buff
                                                     GtkTextIter            *location,
                                                     const gchar            *text,
                                                     gint                    len);
+static void     ide_buffer_insert_paintable        (GtkTextBuffer          *buffer,
+                                                    GtkTextIter            *location,
+                                                    GdkPaintable           *paintable);
+static void     ide_buffer_insert_child_anchor     (GtkTextBuffer          *buffer,
+                                                    GtkTextIter            *location,
+                                                    GtkTextChildAnchor     *anchor);
 static void     ide_buffer_delay_settling          (IdeBuffer              *self);
 static gboolean ide_buffer_settled_cb              (gpointer                user_data);
 static void     ide_buffer_apply_diagnostics       (IdeBuffer              *self);
 static void     ide_buffer_clear_diagnostics       (IdeBuffer              *self);
+static void     ide_buffer_update_diagnostics      (IdeBuffer              *self,
+                                                    IdeDiagnostics         *old_diagnostics);
 static void     ide_buffer_apply_diagnostic        (IdeBuffer              *self,
                                                     IdeDiagnostic          *diagnostics);
 static void     ide_buffer_init_tags               (IdeBuffer              *self);
@@ -254,8 +311,6 @@ static void     ide_buffer_symbol_resolver_added   (IdeExtensionSetAdapter *adap
                                                     PeasPluginInfo         *plugin_info,
                                                     GObject          *extension,
                                                     gpointer                user_data);
-static gboolean ide_buffer_can_do_newline_hack     (IdeBuffer              *self,
-                                                    guint                   len);
 static void     ide_buffer_guess_language          (IdeBuffer              *self);
 static void     ide_buffer_real_loaded             (IdeBuffer              *self);
 static void     _ide_buffer_set_has_encoding_error (IdeBuffer              *self,
@@ -268,6 +323,13 @@ static gboolean settle_finish                      (IdeBuffer              *self
                                                     GAsyncResult           *result,
                                                     GError                **error);
 
+static void
+mapped_text_free (MappedText *text)
+{
+  g_clear_pointer (&text->mapped, g_mapped_file_unref);
+  g_slice_free (MappedText, text);
+}
+
 static void
 load_state_free (LoadState *state)
 {
@@ -276,6 +338,7 @@ load_state_free (LoadState *state)
 
   g_clear_object (&state->notif);
   g_clear_object (&state->file);
+  g_clear_pointer (&state->mapped, g_mapped_file_unref);
   g_slice_free (LoadState, state);
 }
 
@@ -315,20 +378,46 @@ IdeBuffer *
 _ide_buffer_new (IdeBufferManager *buffer_manager,
                  GFile            *file,
                  gboolean          enable_addins,
-                 gboolean          is_temporary)
+                 gboolean          is_temporary,
+                 gboolean          large_file)
 {
+  IdeBuffer *self;
+
   g_return_val_if_fail (IDE_IS_MAIN_THREAD (), NULL);
   g_return_val_if_fail (IDE_IS_BUFFER_MANAGER (buffer_manager), NULL);
   g_return_val_if_fail (G_IS_FILE (file), NULL);
 
-  return g_object_new (IDE_TYPE_BUFFER,
+  self = g_object_new (IDE_TYPE_BUFFER,
                        "buffer-manager", buffer_manager,
                        "file", file,
-                       "enable-addins", enable_addins,
+                       "enable-addins", enable_addins && !large_file,
                        "is-temporary", is_temporary,
                        "implicit-trailing-newline", FALSE,
                        "style-scheme-name", "Adwaita",
                        NULL);
+
+  self->large_file = !!large_file;
+
+  return self;
+}
+
+/*
+ * Sets whether @self is in large-file mode. This must be called before
+ * _ide_buffer_attach() as it determines whether addins are loaded.
+ */
+void
+_ide_buffer_set_large_file (IdeBuffer *self,
+                            gboolean   large_file)
+{
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (IDE_IS_BUFFER (self));
+  g_return_if_fail (self->addins == NULL);
+  g_return_if_fail (self->highlight_engine == NULL);
+
+  self->large_file = !!large_file;
+
+  if (large_file)
+    self->enable_addins = FALSE;
 }
 
 void
@@ -573,6 +662,7 @@ ide_buffer_dispose (GObject *object)
   g_signal_group_set_target (self->file_settings_signals, NULL);
 
   g_clear_pointer (&self->commit_funcs, g_array_unref);
+  g_clear_pointer (&self->diagnostics_edits, g_array_unref);
 
   g_clear_object (&self->diagnostics);
   g_clear_object (&self->buffer_manager);
@@ -583,6 +673,7 @@ ide_buffer_dispose (GObject *object)
     ide_object_destroy (IDE_OBJECT (box));
 
   g_clear_pointer (&self->content, g_bytes_unref);
+  g_clear_pointer (&self->snapshot, ide_buffer_snapshot_unref);
 
   G_OBJECT_CLASS (ide_buffer_parent_class)->dispose (object);
 }
@@ -596,6 +687,7 @@ ide_buffer_finalize (GObject *object)
   g_clear_object (&self->source_file);
   g_clear_object (&self->readlink_file);
   g_clear_pointer (&self->failure, g_error_free);
+  g_clear_pointer (&self->piece_table, _ide_piece_table_free);
 
   G_OBJECT_CLASS (ide_buffer_parent_class)->finalize (object);
 }
@@ -773,6 +865,8 @@ ide_buffer_class_init (IdeBufferClass *klass)
   buffer_class->changed = ide_buffer_changed;
   buffer_class->delete_range = ide_buffer_delete_range;
   buffer_class->insert_text = ide_buffer_insert_text;
+  buffer_class->insert_paintable = ide_buffer_insert_paintable;
+  buffer_class->insert_child_anchor = ide_buffer_insert_child_anchor;
 
   /**
    * IdeBuffer:buffer-manager:
@@ -1141,6 +1235,28 @@ ide_buffer_class_init (IdeBufferClass *klass)
   g_signal_set_va_marshaller (signals [REQUEST_SCROLL_TO_INSERT],
                               G_TYPE_FROM_CLASS (klass),
                               ide_marshal_VOID__VOIDv);
+
+  /**
+   * IdeBuffer::visible-range-changed:
+   *
+   * The "visible-range-changed" signal is emitted when a view displaying
+   * the buffer has scrolled or been resized.
+   *
+   * Use ide_buffer_get_visible_range() to get the new range.
+   *
+   * Since: 47
+   */
+  signals [VISIBLE_RANGE_CHANGED] =
+    g_signal_new_class_handler ("visible-range-changed",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST,
+                                NULL,
+                                NULL, NULL,
+                                ide_marshal_VOID__VOID,
+                                G_TYPE_NONE, 0);
+  g_signal_set_va_marshaller (signals [VISIBLE_RANGE_CHANGED],
+                              G_TYPE_FROM_CLASS (klass),
+                              ide_marshal_VOID__VOIDv);
 }
 
 static void
@@ -1156,6 +1272,7 @@ ide_buffer_init (IdeBuffer *self)
   self->newline_type = GTK_SOURCE_NEWLINE_TYPE_DEFAULT;
 
   self->file_settings_signals = g_signal_group_new (IDE_TYPE_FILE_SETTINGS);
+  self->piece_table = _ide_piece_table_new ();
 
   g_signal_group_connect_object (self->file_settings_signals,
                                  "notify::newline-type",
@@ -1166,6 +1283,8 @@ ide_buffer_init (IdeBuffer *self)
   self->commit_funcs = g_array_new (FALSE, FALSE, sizeof (CommitHooks));
   g_array_set_clear_func (self->commit_funcs, clear_commit_func);
 
+  self->diagnostics_edits = g_array_new (FALSE, FALSE, sizeof (DiagnosticsEdit));
+
   g_signal_connect (self,
                     "notify::language",
                     G_CALLBACK (ide_buffer_notify_language),
@@ -1175,6 +1294,11 @@ ide_buffer_init (IdeBuffer *self)
                     "notify::style-scheme",
                     G_CALLBACK (ide_buffer_notify_style_scheme),
                     NULL);
+
+  g_signal_connect (self,
+                    "notify::implicit-trailing-newline",
+                    G_CALLBACK (ide_buffer_notify_trailing_newline),
+                    NULL);
 }
 
 static void
@@ -1301,23 +1425,29 @@ _ide_buffer_attach (IdeBuffer *self,
   /* Setup the semantic highlight engine */
   self->highlight_engine = ide_highlight_engine_new (self);
 
-  /* Load buffer addins */
-  self->addins = ide_extension_set_adapter_new (parent,
-                                                peas_engine_get_default (),
-                                                IDE_TYPE_BUFFER_ADDIN,
-                                                "Buffer-Addin-Languages",
-                                                language_id);
-  g_signal_connect (self->addins,
-                    "extension-added",
-                    G_CALLBACK (_ide_buffer_addin_load_cb),
-                    self);
-  g_signal_connect (self->addins,
-                    "extension-removed",
-                    G_CALLBACK (_ide_buffer_addin_unload_cb),
-                    self);
-  ide_extension_set_adapter_foreach (self->addins,
-                                     _ide_buffer_addin_load_cb,
-                                     self);
+  /* Load buffer addins. Large files skip them entirely as things like
+   * spellcheck, diagnostics, and change monitors would each need to
+   * process the whole file.
+   */
+  if (!self->large_file)
+    {
+      self->addins = ide_extension_set_adapter_new (parent,
+                                                    peas_engine_get_default (),
+                                                    IDE_TYPE_BUFFER_ADDIN,
+                                                    "Buffer-Addin-Languages",
+                                                    language_id);
+      g_signal_connect (self->addins,
+                        "extension-added",
+                        G_CALLBACK (_ide_buffer_addin_load_cb),
+                        self);
+      g_signal_connect (self->addins,
+                        "extension-removed",
+                        G_CALLBACK (_ide_buffer_addin_unload_cb),
+                        self);
+      ide_extension_set_adapter_foreach (self->addins,
+                                         _ide_buffer_addin_load_cb,
+                                         self);
+    }
 
   /* Setup our rename provider, if any */
   self->rename_provider = ide_extension_adapter_new (parent,
@@ -1495,6 +1625,68 @@ should_ignore_load_error (IdeBuffer    *self,
   return FALSE;
 }
 
+static void
+ide_buffer_load_file_complete (IdeBuffer *self,
+                               IdeTask   *task)
+{
+  LoadState *state;
+  GtkTextIter iter;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (IDE_IS_TASK (task));
+
+  state = ide_task_get_task_data (task);
+
+  /* First move the insert cursor back to 0:0, plugins might move it
+   * but we certainly don't want to leave it at the end.
+   */
+  gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), &iter);
+  gtk_text_buffer_select_range (GTK_TEXT_BUFFER (self), &iter, &iter);
+
+  /* Assume we are at newest state at end of file-load operation */
+  gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (self), FALSE);
+  _ide_buffer_set_changed_on_volume (self, FALSE);
+
+  ide_highlight_engine_unpause (self->highlight_engine);
+  ide_buffer_set_state (self, IDE_BUFFER_STATE_READY);
+  ide_notification_set_progress (state->notif, 1.0);
+
+  if (state->withdraw_notif)
+    ide_notification_withdraw (state->notif);
+
+  ide_trace_end_mark (state->begin_time, "Buffers", "Load", "%s (%d characters)",
+                      g_file_peek_path (state->file),
+                      gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (self)));
+
+  ide_task_return_boolean (task, TRUE);
+}
+
+static void
+ide_buffer_load_file_failed (IdeBuffer *self,
+                             IdeTask   *task,
+                             GError    *error)
+{
+  LoadState *state;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (IDE_IS_TASK (task));
+  g_assert (error != NULL);
+
+  state = ide_task_get_task_data (task);
+
+  g_debug ("Failure loading file: %s", error->message);
+
+  ide_buffer_set_state (self, IDE_BUFFER_STATE_FAILED);
+  ide_notification_set_progress (state->notif, 0.0);
+
+  if (state->withdraw_notif)
+    ide_notification_withdraw (state->notif);
+
+  ide_task_return_error (task, error);
+}
+
 static void
 ide_buffer_load_file_cb (GObject      *object,
                          GAsyncResult *result,
@@ -1503,7 +1695,6 @@ ide_buffer_load_file_cb (GObject      *object,
   GtkSourceFileLoader *loader = (GtkSourceFileLoader *)object;
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
-  GtkTextIter iter;
   LoadState *state;
   IdeBuffer *self;
 
@@ -1526,34 +1717,336 @@ ide_buffer_load_file_cb (GObject      *object,
     {
       if (!should_ignore_load_error (self, error))
         {
-          g_debug ("Failure loading file: %s", error->message);
-          ide_buffer_set_state (self, IDE_BUFFER_STATE_FAILED);
-          ide_notification_set_progress (state->notif, 0.0);
-          ide_task_return_error (task, g_steal_pointer (&error));
+          ide_buffer_load_file_failed (self, task, g_steal_pointer (&error));
           IDE_EXIT;
         }
 
       g_clear_error (&error);
     }
 
-  /* First move the insert cursor back to 0:0, plugins might move it
-   * but we certainly don't want to leave it at the end.
+  ide_buffer_load_file_complete (self, task);
+
+  IDE_EXIT;
+}
+
+static gboolean
+ide_buffer_load_chunk_cb (gpointer user_data)
+{
+  IdeTask *task = user_data;
+  g_autoptr(GError) error = NULL;
+  const char *contents;
+  LoadState *state;
+  IdeBuffer *self;
+  gint64 deadline;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TASK (task));
+
+  self = ide_task_get_source_object (task);
+  state = ide_task_get_task_data (task);
+
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (state != NULL);
+  g_assert (state->mapped != NULL);
+
+  if (g_cancellable_set_error_if_cancelled (ide_task_get_cancellable (task), &error))
+    {
+      ide_buffer_load_file_failed (self, task, g_steal_pointer (&error));
+      return G_SOURCE_REMOVE;
+    }
+
+  contents = g_mapped_file_get_contents (state->mapped);
+  deadline = g_get_monotonic_time () + LARGE_FILE_CHUNK_USEC;
+
+  gtk_text_buffer_begin_irreversible_action (GTK_TEXT_BUFFER (self));
+
+  while (state->pos < state->length)
+    {
+      const char *chunk = &contents[state->pos];
+      gsize len = MIN (LARGE_FILE_CHUNK_SIZE, state->length - state->pos);
+      GtkTextIter iter;
+
+      /* Break on a line if we can, otherwise on a character boundary */
+      if (state->pos + len < state->length)
+        {
+          const char *eol = g_strrstr_len (chunk, len, "\n");
+          const char *prev;
+
+          if (eol != NULL)
+            len = eol - chunk + 1;
+          else if ((prev = g_utf8_find_prev_char (chunk, chunk + len)) && prev > chunk)
+            len = prev - chunk;
+        }
+
+      /* The whole file was validated as UTF-8 before streaming */
+      gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self), &iter);
+      gtk_text_buffer_insert (GTK_TEXT_BUFFER (self), &iter, chunk, len);
+
+      state->pos += len;
+
+      if (g_get_monotonic_time () >= deadline)
+        break;
+    }
+
+  gtk_text_buffer_end_irreversible_action (GTK_TEXT_BUFFER (self));
+
+  if (state->pos < state->length)
+    {
+      ide_notification_set_progress (state->notif, (double)state->pos / (double)state->length);
+      return G_SOURCE_CONTINUE;
+    }
+
+  ide_buffer_load_file_complete (self, task);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * _ide_buffer_sniff_text:
+ * @contents: the file contents
+ * @length: the length of @contents in bytes
+ * @newline_type: (out): location for the newline type
+ *
+ * Checks whether @contents can be inserted into the buffer as-is and
+ * which newline type it uses, based on the first line ending. If there
+ * are no line endings, @newline_type is set to
+ * %GTK_SOURCE_NEWLINE_TYPE_DEFAULT.
+ *
+ * Returns: %TRUE if @contents is valid UTF-8
+ */
+gboolean
+_ide_buffer_sniff_text (const char           *contents,
+                        gsize                 length,
+                        GtkSourceNewlineType *newline_type)
+{
+  const char *lf;
+  const char *cr;
+
+  g_return_val_if_fail (contents != NULL || length == 0, FALSE);
+  g_return_val_if_fail (newline_type != NULL, FALSE);
+
+  lf = memchr (contents, '\n', length);
+  cr = memchr (contents, '\r', lf ? (gsize)(lf - contents) : length);
+
+  if (cr != NULL && cr + 1 == lf)
+    *newline_type = GTK_SOURCE_NEWLINE_TYPE_CR_LF;
+  else if (cr != NULL)
+    *newline_type = GTK_SOURCE_NEWLINE_TYPE_CR;
+  else if (lf != NULL)
+    *newline_type = GTK_SOURCE_NEWLINE_TYPE_LF;
+  else
+    *newline_type = GTK_SOURCE_NEWLINE_TYPE_DEFAULT;
+
+  return g_utf8_validate_len (contents, length, NULL);
+}
+
+static void
+ide_buffer_map_file_worker (IdeTask      *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  const char *path = task_data;
+  MappedText *text;
+  GMappedFile *mapped;
+  GError *error = NULL;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (IDE_IS_BUFFER (source_object));
+  g_assert (path != NULL);
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, &error)))
+    {
+      ide_task_return_error (task, error);
+      return;
+    }
+
+  text = g_slice_new0 (MappedText);
+  text->mapped = mapped;
+  text->is_utf8 = _ide_buffer_sniff_text (g_mapped_file_get_contents (mapped),
+                                          g_mapped_file_get_length (mapped),
+                                          &text->newline_type);
+
+  ide_task_return_pointer (task, text, mapped_text_free);
+}
+
+static void ide_buffer_load_with_loader (IdeBuffer *self,
+                                         IdeTask   *task);
+
+static void
+ide_buffer_map_file_cb (GObject      *object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+  IdeBuffer *self = (IdeBuffer *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+  MappedText *text;
+  const char *contents;
+  LoadState *state;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (IDE_IS_TASK (result));
+  g_assert (IDE_IS_TASK (task));
+
+  state = ide_task_get_task_data (task);
+
+  if (!(text = ide_task_propagate_pointer (IDE_TASK (result), &error)))
+    {
+      ide_buffer_load_file_failed (self, task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  /* Streaming only works for UTF-8. Anything else needs charset
+   * detection and conversion so that saving writes back the same
+   * encoding, which GtkSourceFileLoader already does.
    */
-  gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), &iter);
-  gtk_text_buffer_select_range (GTK_TEXT_BUFFER (self), &iter, &iter);
+  if (!text->is_utf8)
+    {
+      g_debug ("\"%s\" is not UTF-8, loading without streaming",
+               g_file_peek_path (state->file));
+      mapped_text_free (text);
+      ide_buffer_load_with_loader (self, g_steal_pointer (&task));
+      IDE_EXIT;
+    }
 
-  /* Assume we are at newest state at end of file-load operation */
-  gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (self), FALSE);
-  _ide_buffer_set_changed_on_volume (self, FALSE);
+  /* Keep the line endings when the file is saved */
+  if (text->newline_type != GTK_SOURCE_NEWLINE_TYPE_DEFAULT)
+    ide_buffer_set_newline_type (self, text->newline_type);
 
-  ide_highlight_engine_unpause (self->highlight_engine);
-  ide_buffer_set_state (self, IDE_BUFFER_STATE_READY);
-  ide_notification_set_progress (state->notif, 1.0);
-  ide_task_return_boolean (task, TRUE);
+  state->mapped = g_steal_pointer (&text->mapped);
+  mapped_text_free (text);
+
+  contents = g_mapped_file_get_contents (state->mapped);
+  state->length = g_mapped_file_get_length (state->mapped);
+
+  /* Like GtkSourceFileLoader, drop the trailing newline if it is implied */
+  if (state->length > 0 &&
+      gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self)))
+    {
+      if (state->length > 1 &&
+          contents[state->length - 2] == '\r' &&
+          contents[state->length - 1] == '\n')
+        state->length -= 2;
+      else if (contents[state->length - 1] == '\n' ||
+               contents[state->length - 1] == '\r')
+        state->length--;
+    }
+
+  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
+  gtk_text_buffer_begin_irreversible_action (GTK_TEXT_BUFFER (self));
+  gtk_text_buffer_delete (GTK_TEXT_BUFFER (self), &begin, &end);
+  gtk_text_buffer_end_irreversible_action (GTK_TEXT_BUFFER (self));
+
+  /* Insert the contents a chunk at a time at low priority so that
+   * frames may still be drawn while the file is loading.
+   */
+  g_idle_add_full (G_PRIORITY_LOW,
+                   ide_buffer_load_chunk_cb,
+                   g_steal_pointer (&task),
+                   g_object_unref);
+
+  IDE_EXIT;
+}
+
+static void
+ide_buffer_attach_load_notification (IdeBuffer *self,
+                                     LoadState *state)
+{
+  g_autoptr(IdeContext) context = NULL;
+  g_autofree char *title = NULL;
+  g_autofree char *name = NULL;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (state != NULL);
+
+  if (!(context = ide_buffer_ref_context (self)))
+    return;
+
+  name = ide_buffer_dup_title (self);
+  /* translators: %s is replaced with the name of the file being opened */
+  title = g_strdup_printf (_("Opening %s"), name);
+
+  ide_notification_set_title (state->notif, title);
+  ide_notification_set_icon_name (state->notif, "document-open-symbolic");
+  ide_notification_set_has_progress (state->notif, TRUE);
+  ide_notification_attach (state->notif, IDE_OBJECT (context));
+  state->withdraw_notif = TRUE;
+}
+
+static void
+ide_buffer_load_large_file (IdeBuffer *self,
+                            IdeTask   *task,
+                            char      *path)
+{
+  g_autoptr(IdeTask) map_task = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (IDE_IS_TASK (task));
+  g_assert (path != NULL);
+
+  map_task = ide_task_new (self,
+                           ide_task_get_cancellable (task),
+                           ide_buffer_map_file_cb,
+                           g_object_ref (task));
+  ide_task_set_source_tag (map_task, ide_buffer_load_large_file);
+  ide_task_set_kind (map_task, IDE_TASK_KIND_IO);
+  ide_task_set_task_data (map_task, path, g_free);
+  ide_task_run_in_thread (map_task, ide_buffer_map_file_worker);
 
   IDE_EXIT;
 }
 
+static void
+ide_buffer_load_with_loader (IdeBuffer *self,
+                             IdeTask   *task)
+{
+  g_autoptr(GtkSourceFileLoader) loader = NULL;
+  LoadState *state;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (IDE_IS_TASK (task));
+
+  state = ide_task_get_task_data (task);
+
+  /* Create our loader, inheriting some values like encoding from the
+   * source_file if previously set.
+   */
+  loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (self), self->source_file);
+
+  /* If the user specified an encoding, make sure that we apply
+   * that when reloading the file.
+   */
+  if (self->encoding != NULL)
+    {
+      g_autofree char *uri = g_file_get_uri (state->file);
+      GSList list = { (gpointer)self->encoding, NULL };
+
+      gtk_source_file_loader_set_candidate_encodings (loader, &list);
+      g_debug ("Using user-selected encoding of %s while loading '%s'",
+               gtk_source_encoding_get_charset (self->encoding), uri);
+    }
+
+  gtk_source_file_loader_load_async (loader,
+                                     G_PRIORITY_DEFAULT,
+                                     ide_task_get_cancellable (task),
+                                     ide_buffer_progress_cb,
+                                     g_object_ref (state->notif),
+                                     g_object_unref,
+                                     ide_buffer_load_file_cb,
+                                     task);
+}
+
 void
 _ide_buffer_load_file_async (IdeBuffer            *self,
                              IdeNotification      *notif,
@@ -1561,8 +2054,8 @@ _ide_buffer_load_file_async (IdeBuffer            *self,
                              GAsyncReadyCallback   callback,
                              gpointer              user_data)
 {
-  g_autoptr(GtkSourceFileLoader) loader = NULL;
   g_autoptr(IdeTask) task = NULL;
+  g_autofree char *path = NULL;
   LoadState *state;
 
   IDE_ENTRY;
@@ -1589,6 +2082,7 @@ _ide_buffer_load_file_async (IdeBuffer            *self,
   state->file = g_object_ref (ide_buffer_get_file (self));
   state->notif = notif ? g_object_ref (notif) : ide_notification_new ();
   state->highlight_syntax = gtk_source_buffer_get_highlight_syntax (GTK_SOURCE_BUFFER (self));
+  state->begin_time = ide_trace_begin_mark ();
   ide_task_set_task_data (task, state, load_state_free);
 
   ide_buffer_set_state (self, IDE_BUFFER_STATE_LOADING);
@@ -1598,32 +2092,27 @@ _ide_buffer_load_file_async (IdeBuffer            *self,
   gtk_source_buffer_set_highlight_syntax (GTK_SOURCE_BUFFER (self), FALSE);
   ide_highlight_engine_pause (self->highlight_engine);
 
-  /* Create our loader, inheriting some values like encoding from the
-   * source_file if previously set.
-   */
-  loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (self), self->source_file);
-
-  /* If the user specified an encoding, make sure that we apply
-   * that when reloading the file.
+  /* Large local files are mapped and inserted progressively rather
+   * than through GtkSourceFileLoader, unless the user asked for a
+   * specific encoding which we'd have to convert from.
    */
-  if (self->encoding != NULL)
+  if (self->large_file &&
+      (self->encoding == NULL ||
+       self->encoding == gtk_source_encoding_get_utf8 ()) &&
+      (path = g_file_get_path (state->file)))
     {
-      g_autofree char *uri = g_file_get_uri (state->file);
-      GSList list = { (gpointer)self->encoding, NULL };
+      /* Show progress with the other notifications unless the caller
+       * is already displaying its own.
+       */
+      if (notif == NULL)
+        ide_buffer_attach_load_notification (self, state);
 
-      gtk_source_file_loader_set_candidate_encodings (loader, &list);
-      g_debug ("Using user-selected encoding of %s while loading '%s'",
-               gtk_source_encoding_get_charset (self->encoding), uri);
+      ide_buffer_load_large_file (self, task, g_steal_pointer (&path));
+      ide_buffer_reload_file_settings (self);
+      IDE_EXIT;
     }
 
-  gtk_source_file_loader_load_async (loader,
-                                     G_PRIORITY_DEFAULT,
-                                     cancellable,
-                                     ide_buffer_progress_cb,
-                                     g_object_ref (state->notif),
-                                     g_object_unref,
-                                     ide_buffer_load_file_cb,
-                                     g_steal_pointer (&task));
+  ide_buffer_load_with_loader (self, g_steal_pointer (&task));
 
   /* Load file settings immediately so that we can increase the chance
    * they are settled by the the load operation is finished. The modelines
@@ -1664,13 +2153,16 @@ _ide_buffer_load_file_finish (IdeBuffer     *self,
   if (!ide_task_propagate_boolean (IDE_TASK (result), error))
     return FALSE;
 
-  /* Restore various buffer features we disabled while loading */
+  /* Restore various buffer features we disabled while loading. Large
+   * files are left without a language so that neither syntax nor
+   * semantic highlighting need to process the whole buffer.
+   */
   state = ide_task_get_task_data (IDE_TASK (result));
-  if (state->highlight_syntax)
+  if (state->highlight_syntax && !self->large_file)
     gtk_source_buffer_set_highlight_syntax (GTK_SOURCE_BUFFER (self), TRUE);
 
   /* Guess the syntax language now if necessary */
-  if (!gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (self)))
+  if (!self->large_file && !gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (self)))
     ide_buffer_guess_language (self);
 
   /* Let consumers know they can access the buffer now */
@@ -1744,6 +2236,9 @@ ide_buffer_save_file_cb (GObject      *object,
   else
     g_critical ("Attempt to save buffer without access to buffer-manager");
 
+  ide_trace_end_mark (state->begin_time, "Buffers", "Save", "%s",
+                      g_file_peek_path (state->file));
+
   ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
@@ -1874,6 +2369,7 @@ ide_buffer_save_file_async (IdeBuffer            *self,
   state = g_slice_new0 (SaveState);
   state->file = g_object_ref (file);
   state->notif = g_object_ref (local_notif);
+  state->begin_time = ide_trace_begin_mark ();
 
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_buffer_save_file_async);
@@ -2136,7 +2632,16 @@ ide_buffer_get_loading (IdeBuffer *self)
   g_return_val_if_fail (IDE_IS_MAIN_THREAD (), FALSE);
   g_return_val_if_fail (IDE_IS_BUFFER (self), FALSE);
 
-  return ide_buffer_get_state (self) == IDE_BUFFER_STATE_LOADING;
+  return ide_buffer_get_state (self) == IDE_BUFFER_STATE_LOADING;
+}
+
+static void
+ide_buffer_clear_snapshot (IdeBuffer *self)
+{
+  g_assert (IDE_IS_BUFFER (self));
+
+  g_clear_pointer (&self->content, g_bytes_unref);
+  g_clear_pointer (&self->snapshot, ide_buffer_snapshot_unref);
 }
 
 static void
@@ -2152,10 +2657,88 @@ ide_buffer_changed (GtkTextBuffer *buffer)
   self->in_flight_symbol_at_location_pos = -1;
 
   self->change_count++;
-  g_clear_pointer (&self->content, g_bytes_unref);
+  ide_buffer_clear_snapshot (self);
   ide_buffer_delay_settling (self);
 }
 
+static void
+ide_buffer_reset_diagnostics_edits (IdeBuffer *self)
+{
+  g_assert (IDE_IS_BUFFER (self));
+
+  if (self->diagnostics_edits != NULL)
+    g_array_set_size (self->diagnostics_edits, 0);
+  self->diagnostics_edits_overflow = FALSE;
+}
+
+static void
+ide_buffer_record_diagnostics_edit (IdeBuffer *self,
+                                    guint      line,
+                                    guint      old_lines,
+                                    guint      new_lines)
+{
+  DiagnosticsEdit edit = { line, old_lines, new_lines };
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  /* Nothing is styled, so there is nothing to move */
+  if (self->diagnostics == NULL ||
+      !self->highlight_diagnostics ||
+      self->diagnostics_edits == NULL ||
+      self->diagnostics_edits_overflow)
+    return;
+
+  /* Typing within a single line repeats the same edit */
+  if (old_lines == 0 && new_lines == 0 && self->diagnostics_edits->len > 0)
+    {
+      const DiagnosticsEdit *last = &g_array_index (self->diagnostics_edits,
+                                                    DiagnosticsEdit,
+                                                    self->diagnostics_edits->len - 1);
+
+      if (last->line == line && last->old_lines == 0 && last->new_lines == 0)
+        return;
+    }
+
+  /* Past this point it is cheaper to restyle everything */
+  if (self->diagnostics_edits->len >= MAX_DIAGNOSTICS_EDITS)
+    {
+      g_array_set_size (self->diagnostics_edits, 0);
+      self->diagnostics_edits_overflow = TRUE;
+      return;
+    }
+
+  g_array_append_val (self->diagnostics_edits, edit);
+}
+
+static guint
+ide_buffer_shift_diagnostics_line_from (IdeBuffer *self,
+                                        guint      first_edit,
+                                        guint      line)
+{
+  g_assert (IDE_IS_BUFFER (self));
+
+  for (guint i = first_edit; i < self->diagnostics_edits->len; i++)
+    {
+      const DiagnosticsEdit *edit = &g_array_index (self->diagnostics_edits, DiagnosticsEdit, i);
+
+      if (line <= edit->line)
+        continue;
+      else if (line <= edit->line + edit->old_lines)
+        line = edit->line;
+      else
+        line = line - edit->old_lines + edit->new_lines;
+    }
+
+  return line;
+}
+
+static guint
+ide_buffer_shift_diagnostics_line (guint    line,
+                                   gpointer user_data)
+{
+  return ide_buffer_shift_diagnostics_line_from (user_data, 0, line);
+}
+
 static void
 ide_buffer_delete_range (GtkTextBuffer *buffer,
                          GtkTextIter   *begin,
@@ -2191,6 +2774,11 @@ ide_buffer_delete_range (GtkTextBuffer *buffer,
   position = gtk_text_iter_get_offset (begin);
   length = gtk_text_iter_get_offset (end) - position;
 
+  ide_buffer_record_diagnostics_edit (self,
+                                      gtk_text_iter_get_line (begin),
+                                      gtk_text_iter_get_line (end) - gtk_text_iter_get_line (begin),
+                                      0);
+
   for (guint i = 0; i < self->commit_funcs->len; i++)
     {
       const CommitHooks *hooks = &g_array_index (self->commit_funcs, CommitHooks, i);
@@ -2199,6 +2787,13 @@ ide_buffer_delete_range (GtkTextBuffer *buffer,
         hooks->before_delete_range (self, position, length, hooks->user_data);
     }
 
+  /* Update the piece table first so that handlers of ::changed, which is
+   * emitted while chaining up, cannot snapshot the previous text.
+   */
+  if (self->piece_table != NULL)
+    _ide_piece_table_delete (self->piece_table, position, length);
+  ide_buffer_clear_snapshot (self);
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->delete_range (buffer, begin, end);
 
   for (guint i = 0; i < self->commit_funcs->len; i++)
@@ -2222,6 +2817,7 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
   gboolean recheck_language = FALSE;
   guint position;
   guint length;
+  guint line;
 
   IDE_ENTRY;
 
@@ -2242,6 +2838,7 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
 
   position = gtk_text_iter_get_offset (location);
   length = g_utf8_strlen (text, len);
+  line = gtk_text_iter_get_line (location);
 
   for (guint i = 0; i < self->commit_funcs->len; i++)
     {
@@ -2251,8 +2848,15 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
         hooks->before_insert_text (self, position, length, hooks->user_data);
     }
 
+  if (self->piece_table != NULL)
+    _ide_piece_table_insert (self->piece_table, position, text, len < 0 ? strlen (text) : len);
+  ide_buffer_clear_snapshot (self);
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_text (buffer, location, text, len);
 
+  /* @location has been revalidated to the end of the inserted text */
+  ide_buffer_record_diagnostics_edit (self, line, 0, gtk_text_iter_get_line (location) - line);
+
   for (guint i = 0; i < self->commit_funcs->len; i++)
     {
       const CommitHooks *hooks = &g_array_index (self->commit_funcs, CommitHooks, i);
@@ -2267,6 +2871,56 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
   IDE_EXIT;
 }
 
+static void
+ide_buffer_drop_piece_table (IdeBuffer *self)
+{
+  g_assert (IDE_IS_BUFFER (self));
+
+  /* Embedded objects take up a character in the GtkTextBuffer but are not
+   * part of the text, so the piece table can no longer mirror character
+   * offsets. Fallback to copying the buffer text for snapshots.
+   */
+  g_clear_pointer (&self->piece_table, _ide_piece_table_free);
+}
+
+static void
+ide_buffer_insert_paintable (GtkTextBuffer *buffer,
+                             GtkTextIter   *location,
+                             GdkPaintable  *paintable)
+{
+  IdeBuffer *self = (IdeBuffer *)buffer;
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  ide_buffer_drop_piece_table (self);
+
+  GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_paintable (buffer, location, paintable);
+}
+
+static void
+ide_buffer_insert_child_anchor (GtkTextBuffer      *buffer,
+                                GtkTextIter        *location,
+                                GtkTextChildAnchor *anchor)
+{
+  IdeBuffer *self = (IdeBuffer *)buffer;
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  ide_buffer_drop_piece_table (self);
+
+  GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_child_anchor (buffer, location, anchor);
+}
+
+static void
+ide_buffer_notify_trailing_newline (IdeBuffer  *self,
+                                    GParamSpec *pspec,
+                                    gpointer    user_data)
+{
+  g_assert (IDE_IS_BUFFER (self));
+
+  ide_buffer_clear_snapshot (self);
+}
+
 /**
  * ide_buffer_get_changed_on_volume:
  * @self: an #IdeBuffer
@@ -2611,13 +3265,24 @@ ide_buffer_set_diagnostics (IdeBuffer      *self,
   if (diagnostics == self->diagnostics)
     return;
 
-  if (self->diagnostics)
+  if (self->diagnostics && diagnostics)
+    {
+      g_autoptr(IdeDiagnostics) old_diagnostics = g_steal_pointer (&self->diagnostics);
+      IdeCodeActionProvider *code_action_provider;
+
+      /* Only touch the lines which changed since the last set */
+      self->diagnostics = g_object_ref (diagnostics);
+      code_action_provider = ide_extension_adapter_get_extension (self->code_action_provider);
+      if (code_action_provider)
+        ide_code_action_provider_set_diagnostics (IDE_CODE_ACTION_PROVIDER (code_action_provider), self->diagnostics);
+      ide_buffer_update_diagnostics (self, old_diagnostics);
+    }
+  else if (self->diagnostics)
     {
       ide_buffer_clear_diagnostics (self);
       g_clear_object (&self->diagnostics);
     }
-
-  if (diagnostics)
+  else if (diagnostics)
     {
       IdeCodeActionProvider *code_action_provider;
       self->diagnostics = g_object_ref (diagnostics);
@@ -2671,37 +3336,50 @@ ide_buffer_has_diagnostics (IdeBuffer *self)
 }
 
 static void
-ide_buffer_clear_diagnostics (IdeBuffer *self)
+ide_buffer_clear_diagnostics_in_range (IdeBuffer         *self,
+                                       const GtkTextIter *begin,
+                                       const GtkTextIter *end)
 {
   GtkTextTagTable *table;
   GtkTextTag *tag;
-  GtkTextIter begin;
-  GtkTextIter end;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (IDE_IS_BUFFER (self));
-
-  if (!self->highlight_diagnostics)
-    return;
-
-  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
 
   table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (self));
 
   if (NULL != (tag = gtk_text_tag_table_lookup (table, TAG_NOTE)))
-    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, &begin, &end);
+    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, begin, end);
 
   if (NULL != (tag = gtk_text_tag_table_lookup (table, TAG_WARNING)))
-    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, &begin, &end);
+    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, begin, end);
 
   if (NULL != (tag = gtk_text_tag_table_lookup (table, TAG_DEPRECATED)))
-    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, &begin, &end);
+    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, begin, end);
 
   if (NULL != (tag = gtk_text_tag_table_lookup (table, TAG_UNUSED)))
-    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, &begin, &end);
+    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, begin, end);
 
   if (NULL != (tag = gtk_text_tag_table_lookup (table, TAG_ERROR)))
-    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, &begin, &end);
+    gtk_text_buffer_remove_tag (GTK_TEXT_BUFFER (self), tag, begin, end);
+}
+
+static void
+ide_buffer_clear_diagnostics (IdeBuffer *self)
+{
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+
+  if (!self->highlight_diagnostics)
+    return;
+
+  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
+  ide_buffer_clear_diagnostics_in_range (self, &begin, &end);
 }
 
 static void
@@ -2825,6 +3503,8 @@ ide_buffer_apply_diagnostics (IdeBuffer *self)
   if (self->diagnostics == NULL)
     return;
 
+  ide_buffer_reset_diagnostics_edits (self);
+
   n_items = g_list_model_get_n_items (G_LIST_MODEL (self->diagnostics));
 
   for (guint i = 0; i < n_items; i++)
@@ -2836,6 +3516,88 @@ ide_buffer_apply_diagnostics (IdeBuffer *self)
     }
 }
 
+static void
+ide_buffer_reapply_diagnostic_cb (IdeDiagnostic *diagnostic,
+                                  gpointer       user_data)
+{
+  ide_buffer_apply_diagnostic (user_data, diagnostic);
+}
+
+static void
+ide_buffer_diagnostics_changed_cb (guint    begin_line,
+                                   guint    end_line,
+                                   gpointer user_data)
+{
+  IdeBuffer *self = user_data;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_BUFFER (self));
+
+  /* Include the newline before the span as diagnostics at the end of a
+   * line are drawn by moving back one character.
+   */
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), &begin, begin_line);
+  gtk_text_iter_backward_char (&begin);
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), &end, end_line);
+  if (!gtk_text_iter_ends_line (&end))
+    gtk_text_iter_forward_to_line_end (&end);
+
+  ide_buffer_clear_diagnostics_in_range (self, &begin, &end);
+
+  /* Anything else touching these lines lost its tag too */
+  _ide_diagnostics_foreach_in_range (self->diagnostics,
+                                     ide_buffer_get_file (self),
+                                     begin_line ? begin_line - 1 : 0,
+                                     end_line,
+                                     ide_buffer_reapply_diagnostic_cb,
+                                     self);
+}
+
+static void
+ide_buffer_update_diagnostics (IdeBuffer      *self,
+                               IdeDiagnostics *old_diagnostics)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (IDE_IS_DIAGNOSTICS (old_diagnostics));
+  g_assert (IDE_IS_DIAGNOSTICS (self->diagnostics));
+
+  if (!self->highlight_diagnostics)
+    return;
+
+  if (self->diagnostics_edits_overflow)
+    {
+      ide_buffer_clear_diagnostics (self);
+      ide_buffer_apply_diagnostics (self);
+      return;
+    }
+
+  /* The tags we applied have moved along with any edits since, so move
+   * the old diagnostics the same way before comparing them.
+   */
+  _ide_diagnostics_foreach_changed (old_diagnostics,
+                                    self->diagnostics,
+                                    ide_buffer_get_file (self),
+                                    self->diagnostics_edits->len ? ide_buffer_shift_diagnostics_line : NULL,
+                                    ide_buffer_diagnostics_changed_cb,
+                                    self);
+
+  /* Tags on the edited lines themselves may have been split or
+   * stretched by the edit, so restyle those lines too.
+   */
+  for (guint i = 0; i < self->diagnostics_edits->len; i++)
+    {
+      const DiagnosticsEdit *edit = &g_array_index (self->diagnostics_edits, DiagnosticsEdit, i);
+      guint begin_line = ide_buffer_shift_diagnostics_line_from (self, i + 1, edit->line);
+      guint end_line = ide_buffer_shift_diagnostics_line_from (self, i + 1, edit->line + edit->new_lines);
+
+      ide_buffer_diagnostics_changed_cb (begin_line, end_line, self);
+    }
+
+  ide_buffer_reset_diagnostics_edits (self);
+}
+
 /**
  * ide_buffer_get_iter_at_location:
  * @self: an #IdeBuffer
@@ -2923,38 +3685,6 @@ ide_buffer_set_change_monitor (IdeBuffer              *self,
     }
 }
 
-static gboolean
-ide_buffer_can_do_newline_hack (IdeBuffer *self,
-                                guint      len)
-{
-  guint next_pow2;
-
-  g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (IDE_IS_BUFFER (self));
-
-  /*
-   * If adding two bytes to our length (one for \n and one for \0) is still
-   * under the next power of two, then we can avoid making a copy of the buffer
-   * when saving the buffer to our drafts.
-   *
-   * HACK: This relies on the fact that GtkTextBuffer returns a GString
-   *       allocated string which grows the string in powers of two.
-   */
-
-  if ((len == 0) || (len & (len - 1)) == 0)
-    return FALSE;
-
-  next_pow2 = len;
-  next_pow2 |= next_pow2 >> 1;
-  next_pow2 |= next_pow2 >> 2;
-  next_pow2 |= next_pow2 >> 4;
-  next_pow2 |= next_pow2 >> 8;
-  next_pow2 |= next_pow2 >> 16;
-  next_pow2++;
-
-  return ((len + 2) < next_pow2);
-}
-
 /**
  * ide_buffer_dup_content:
  * @self: an #IdeBuffer.
@@ -2978,61 +3708,84 @@ ide_buffer_dup_content (IdeBuffer *self)
 
   if (self->content == NULL)
     {
-      g_autoptr(IdeContext) context = NULL;
-      IdeUnsavedFiles *unsaved_files;
-      GtkTextIter begin;
-      GtkTextIter end;
-      GFile *file;
-      gchar *text;
-      gsize len;
-
-      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
-      text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self), &begin, &end, TRUE);
+      g_autoptr(IdeBufferSnapshot) snapshot = ide_buffer_ref_snapshot (self);
 
       /*
-       * If implicit newline is set, add a \n in place of the \0 and avoid
-       * duplicating the buffer. Make sure to track length beforehand, since we
-       * would overwrite afterwards. Since conversion to \r\n is dealth with
-       * during save operations, this should be fine for both. The unsaved
-       * files will restore to a buffer, for which \n is acceptable.
+       * The snapshot contains the implicit trailing newline (if any) and
+       * a trailing \0 past the length of the bytes. This way, compilers
+       * that don't want to see the trailing \0 can ignore that data, but
+       * compilers that rely on valid C strings can also rely on the
+       * buffer to be valid.
        */
-      len = strlen (text);
-      if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self)))
-        {
-          if (!ide_buffer_can_do_newline_hack (self, len))
-            {
-              gchar *copy;
+      self->content = ide_buffer_snapshot_dup_content (snapshot);
+    }
 
-              copy = g_malloc (len + 2);
-              memcpy (copy, text, len);
-              g_free (text);
-              text = copy;
-            }
+  return g_bytes_ref (self->content);
+}
 
-          text [len] = '\n';
-          text [++len] = '\0';
-        }
+/**
+ * ide_buffer_ref_snapshot:
+ * @self: an #IdeBuffer
+ *
+ * Gets an immutable snapshot of the buffer contents.
+ *
+ * Creating a snapshot does not copy the buffer text. The snapshot may be
+ * passed to another thread, where the text can be serialized with
+ * ide_buffer_snapshot_dup_content() or read by line range with
+ * ide_buffer_snapshot_dup_lines().
+ *
+ * The same snapshot is returned until the buffer is next modified. New
+ * snapshots are also published to #IdeUnsavedFiles, which serializes them
+ * only when the content is needed.
+ *
+ * Returns: (transfer full): an #IdeBufferSnapshot
+ *
+ * Since: 47
+ */
+IdeBufferSnapshot *
+ide_buffer_ref_snapshot (IdeBuffer *self)
+{
+  g_return_val_if_fail (IDE_IS_MAIN_THREAD (), NULL);
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
 
-      /*
-       * We pass a buffer that is longer than the length we tell GBytes about.
-       * This way, compilers that don't want to see the trailing \0 can ignore
-       * that data, but compilers that rely on valid C strings can also rely
-       * on the buffer to be valid.
-       */
-      self->content = g_bytes_new_take (g_steal_pointer (&text), len);
+  if (self->snapshot == NULL)
+    {
+      gboolean trailing_newline = gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self));
+
+      if (self->piece_table != NULL)
+        {
+          self->snapshot = _ide_piece_table_snapshot (self->piece_table,
+                                                      self->change_count,
+                                                      trailing_newline);
+        }
+      else
+        {
+          g_autofree char *text = NULL;
+          GtkTextIter begin;
+          GtkTextIter end;
+
+          gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
+          text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self), &begin, &end, TRUE);
+          self->snapshot = _ide_buffer_snapshot_new_for_text (text,
+                                                              strlen (text),
+                                                              self->change_count,
+                                                              trailing_newline);
+        }
 
       /* Only persist if we have access to the object tree */
       if (self->buffer_manager != NULL &&
           !ide_object_in_destruction (IDE_OBJECT (self->buffer_manager)))
         {
-          file = ide_buffer_get_file (self);
-          context = ide_buffer_ref_context (IDE_BUFFER (self));
-          unsaved_files = ide_unsaved_files_from_context (context);
-          ide_unsaved_files_update (unsaved_files, file, self->content);
+          g_autoptr(IdeContext) context = ide_buffer_ref_context (self);
+          IdeUnsavedFiles *unsaved_files = ide_unsaved_files_from_context (context);
+
+          _ide_unsaved_files_update_snapshot (unsaved_files,
+                                              ide_buffer_get_file (self),
+                                              self->snapshot);
         }
     }
 
-  return g_bytes_ref (self->content);
+  return ide_buffer_snapshot_ref (self->snapshot);
 }
 
 static void
@@ -3940,6 +4693,95 @@ ide_buffer_get_selection_bounds (IdeBuffer   *self,
     }
 }
 
+/**
+ * ide_buffer_get_visible_range:
+ * @self: an #IdeBuffer
+ * @begin: (out) (optional): a #GtkTextIter
+ * @end: (out) (optional): a #GtkTextIter
+ *
+ * Gets the range of the buffer most recently reported as visible by a view
+ * displaying @self. Background work such as highlighting or spellchecking
+ * can use this to process what the user is looking at first.
+ *
+ * If no view has reported a visible range, @begin and @end are both set
+ * to the start of the buffer.
+ *
+ * Returns: %TRUE if a visible range is known; otherwise %FALSE
+ *
+ * Since: 47
+ */
+gboolean
+ide_buffer_get_visible_range (IdeBuffer   *self,
+                              GtkTextIter *begin,
+                              GtkTextIter *end)
+{
+  GtkTextIter iter;
+
+  g_return_val_if_fail (IDE_IS_MAIN_THREAD (), FALSE);
+  g_return_val_if_fail (IDE_IS_BUFFER (self), FALSE);
+
+  if (!self->has_visible_range)
+    {
+      gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (self), &iter);
+
+      if (begin != NULL)
+        *begin = iter;
+
+      if (end != NULL)
+        *end = iter;
+
+      return FALSE;
+    }
+
+  if (begin != NULL)
+    gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), begin, self->visible_begin_line);
+
+  if (end != NULL)
+    {
+      gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (self), end, self->visible_end_line);
+
+      if (!gtk_text_iter_ends_line (end))
+        gtk_text_iter_forward_to_line_end (end);
+    }
+
+  return TRUE;
+}
+
+/**
+ * ide_buffer_set_visible_lines:
+ * @self: an #IdeBuffer
+ * @begin_line: the first visible line, starting from 0
+ * @end_line: the last visible line, starting from 0
+ *
+ * Views displaying @self should call this when the lines they display
+ * change, such as after scrolling. When multiple views display the same
+ * buffer, the most recent call wins.
+ *
+ * Since: 47
+ */
+void
+ide_buffer_set_visible_lines (IdeBuffer *self,
+                              guint      begin_line,
+                              guint      end_line)
+{
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (IDE_IS_BUFFER (self));
+
+  if (end_line < begin_line)
+    end_line = begin_line;
+
+  if (self->has_visible_range &&
+      self->visible_begin_line == begin_line &&
+      self->visible_end_line == end_line)
+    return;
+
+  self->has_visible_range = TRUE;
+  self->visible_begin_line = begin_line;
+  self->visible_end_line = end_line;
+
+  g_signal_emit (self, signals [VISIBLE_RANGE_CHANGED], 0);
+}
+
 static void
 ide_buffer_get_symbol_resolvers_cb (IdeExtensionSetAdapter *set,
                                     PeasPluginInfo         *plugin_info,
@@ -4551,3 +5393,24 @@ ide_buffer_has_encoding_error (IdeBuffer *self)
 
   return self->has_encoding_error;
 }
+
+/**
+ * ide_buffer_is_large_file:
+ * @self: a #IdeBuffer
+ *
+ * Checks if the buffer was opened in large-file mode.
+ *
+ * Large files are loaded progressively and do not load buffer addins,
+ * syntax highlighting, or semantic highlighting.
+ *
+ * Returns: %TRUE if @self was opened as a large file
+ *
+ * Since: 47
+ */
+gboolean
+ide_buffer_is_large_file (IdeBuffer *self)
+{
+  g_return_val_if_fail (IDE_IS_BUFFER (self), FALSE);
+
+  return self->large_file;
+}
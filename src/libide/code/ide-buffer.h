@@ -59,6 +59,8 @@ G_DECLARE_FINAL_TYPE (IdeBuffer, ide_buffer, IDE, BUFFER, GtkSourceBuffer)
 
 IDE_AVAILABLE_IN_ALL
 GBytes                 *ide_buffer_dup_content                   (IdeBuffer               *self);
+IDE_AVAILABLE_IN_47
+IdeBufferSnapshot      *ide_buffer_ref_snapshot                  (IdeBuffer               *self);
 IDE_AVAILABLE_IN_ALL
 gchar                  *ide_buffer_dup_title                     (IdeBuffer               *self);
 IDE_AVAILABLE_IN_ALL
@@ -134,6 +136,14 @@ IDE_AVAILABLE_IN_ALL
 void                    ide_buffer_get_selection_bounds          (IdeBuffer               *self,
                                                                   GtkTextIter             *insert,
                                                                   GtkTextIter             *selection);
+IDE_AVAILABLE_IN_47
+gboolean                ide_buffer_get_visible_range             (IdeBuffer               *self,
+                                                                  GtkTextIter             *begin,
+                                                                  GtkTextIter             *end);
+IDE_AVAILABLE_IN_47
+void                    ide_buffer_set_visible_lines             (IdeBuffer               *self,
+                                                                  guint                    begin_line,
+                                                                  guint                    end_line);
 IDE_AVAILABLE_IN_ALL
 IdeRange               *ide_buffer_get_selection_range           (IdeBuffer               *self);
 IDE_AVAILABLE_IN_ALL
@@ -215,5 +225,7 @@ void                    ide_buffer_set_newline_type              (IdeBuffer
                                                                   GtkSourceNewlineType     newline_type);
 IDE_AVAILABLE_IN_44
 gboolean                ide_buffer_has_encoding_error            (IdeBuffer               *self);
+IDE_AVAILABLE_IN_47
+gboolean                ide_buffer_is_large_file                 (IdeBuffer               *self);
 
 G_END_DECLS
@@ -35,6 +35,7 @@ typedef struct _IdeCodeIndexEntries IdeCodeIndexEntries;
 typedef struct _IdeCodeIndexEntry IdeCodeIndexEntry;
 typedef struct _IdeCodeIndexer IdeCodeIndexer;
 typedef struct _IdeBufferManager IdeBufferManager;
+typedef struct _IdeBufferSnapshot IdeBufferSnapshot;
 typedef struct _IdeDiagnostic IdeDiagnostic;
 typedef struct _IdeDiagnosticProvider IdeDiagnosticProvider;
 typedef struct _IdeDiagnostics IdeDiagnostics;
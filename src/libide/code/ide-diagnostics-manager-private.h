@@ -35,7 +35,9 @@ void _ide_diagnostics_manager_language_changed (IdeDiagnosticsManager *self,
                                                 const gchar           *lang_id);
 void _ide_diagnostics_manager_file_changed     (IdeDiagnosticsManager *self,
                                                 GFile                 *file,
-                                                GBytes                *contents,
+                                                IdeBufferSnapshot     *snapshot,
                                                 const gchar           *lang_id);
+void _ide_diagnostics_manager_file_visible     (IdeDiagnosticsManager *self,
+                                                GFile                 *file);
 
 G_END_DECLS
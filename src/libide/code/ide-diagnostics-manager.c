@@ -31,9 +31,11 @@
 #include "ide-buffer.h"
 #include "ide-buffer-manager.h"
 #include "ide-buffer-private.h"
+#include "ide-buffer-snapshot.h"
 #include "ide-diagnostic.h"
 #include "ide-diagnostic-provider.h"
 #include "ide-diagnostics.h"
+#include "ide-diagnostics-private.h"
 #include "ide-diagnostics-manager.h"
 #include "ide-diagnostics-manager-private.h"
 
@@ -72,7 +74,11 @@ typedef struct
    */
   IdeExtensionSetAdapter *adapter;
 
-  /* The most recent bytes we received for a future diagnosis. */
+  /*
+   * The most recent buffer snapshot we received for a future diagnosis,
+   * and the bytes it was serialized to once a diagnosis began.
+   */
+  IdeBufferSnapshot *snapshot;
   GBytes *contents;
 
   /* The last language id we were notified about */
@@ -90,6 +96,15 @@ typedef struct
    */
   guint in_diagnose;
 
+  /* When the current diagnosis pass began, for profiler marks. */
+  gint64 diagnose_begin_time;
+
+  /*
+   * When a view last reported showing this file. Groups that were
+   * visible most recently are diagnosed first.
+   */
+  gint64 visible_at;
+
   /*
    * If we need a diagnose this bit will be set. If we complete a
    * diagnosis and this bit is set, then we will automatically queue
@@ -183,6 +198,7 @@ ide_diagnostics_group_finalize (IdeDiagnosticsGroup *group)
   group->magic = 0;
 
   g_clear_pointer (&group->diagnostics_by_provider, g_hash_table_unref);
+  g_clear_pointer (&group->snapshot, ide_buffer_snapshot_unref);
   g_clear_pointer (&group->contents, g_bytes_unref);
   ide_clear_and_destroy_object (&group->adapter);
   g_clear_object (&group->file);
@@ -291,6 +307,78 @@ ide_diagnostics_group_add (IdeDiagnosticsGroup   *group,
   group->sequence++;
 }
 
+static void
+ide_diagnostics_group_changed_cb (guint    begin_line,
+                                  guint    end_line,
+                                  gpointer user_data)
+{
+  gboolean *changed = user_data;
+
+  *changed = TRUE;
+}
+
+/*
+ * Checks if @diagnostics from @provider are the same as what we already
+ * have for @group so that we can avoid replacing them and causing every
+ * consumer to refresh. Only the common case of a provider reporting just
+ * for the file of its group is handled.
+ */
+static gboolean
+ide_diagnostics_group_is_unchanged (IdeDiagnosticsManager *self,
+                                    IdeDiagnosticsGroup   *group,
+                                    IdeDiagnosticProvider *provider,
+                                    IdeDiagnostics        *diagnostics)
+{
+  IdeDiagnostics *old_diagnostics;
+  GHashTableIter iter;
+  gpointer value;
+  gboolean changed = FALSE;
+  guint length;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_assert (IS_DIAGNOSTICS_GROUP (group));
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+
+  if (diagnostics == NULL ||
+      !(old_diagnostics = g_hash_table_lookup (group->diagnostics_by_provider, provider)))
+    return FALSE;
+
+  length = diagnostics_get_size (diagnostics);
+
+  if (length != diagnostics_get_size (old_diagnostics))
+    return FALSE;
+
+  for (guint i = 0; i < length; i++)
+    {
+      g_autoptr(IdeDiagnostic) diagnostic = g_list_model_get_item (G_LIST_MODEL (diagnostics), i);
+      GFile *file = ide_diagnostic_get_file (diagnostic);
+
+      if (file == NULL || !g_file_equal (file, group->file))
+        return FALSE;
+    }
+
+  g_hash_table_iter_init (&iter, self->groups_by_file);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      IdeDiagnosticsGroup *other = value;
+
+      if (other != group &&
+          g_hash_table_contains (other->diagnostics_by_provider, provider))
+        return FALSE;
+    }
+
+  _ide_diagnostics_foreach_changed (old_diagnostics,
+                                    diagnostics,
+                                    group->file,
+                                    NULL,
+                                    ide_diagnostics_group_changed_cb,
+                                    &changed);
+
+  return !changed;
+}
+
 static void
 ide_diagnostics_group_diagnose_cb (GObject      *object,
                                    GAsyncResult *result,
@@ -301,7 +389,8 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
   g_autoptr(IdeDiagnostics) diagnostics = NULL;
   g_autoptr(GError) error = NULL;
   IdeDiagnosticsGroup *group;
-  gboolean changed;
+  gboolean unchanged;
+  gboolean changed = FALSE;
 
   IDE_ENTRY;
 
@@ -340,10 +429,17 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
 
   g_assert (IS_DIAGNOSTICS_GROUP (group));
 
+  /*
+   * Keep what we have if nothing changed so that buffers and the gutter
+   * do not need to refresh after every keystroke.
+   */
+  unchanged = ide_diagnostics_group_is_unchanged (self, group, provider, diagnostics);
+
   /*
    * Clear all of our old diagnostics no matter where they ended up.
    */
-  changed = ide_diagnostics_manager_clear_by_provider (self, provider);
+  if (!unchanged)
+    changed = ide_diagnostics_manager_clear_by_provider (self, provider);
 
   /*
    * The following adds diagnostics to the appropriate group, but tries the
@@ -351,7 +447,7 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
    * the case, except when a diagnostic came up for a header or something
    * while parsing a given file.
    */
-  if (diagnostics != NULL)
+  if (diagnostics != NULL && !unchanged)
     {
       guint length = diagnostics_get_size (diagnostics);
 
@@ -375,12 +471,20 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
 
   group->in_diagnose--;
 
+  if (group->in_diagnose == 0)
+    {
+      ide_trace_end_mark (group->diagnose_begin_time, "Diagnostics", "Pass", "%s",
+                          g_file_peek_path (group->file));
+      group->diagnose_begin_time = 0;
+    }
+
   /*
    * Ensure we increment our sequence number even when no diagnostics were
    * reported. This ensures that the gutter gets cleared and line-flags
    * cache updated.
    */
-  group->sequence++;
+  if (!unchanged)
+    group->sequence++;
 
   /*
    * Since the individual groups have sequence numbers associated with changes,
@@ -470,6 +574,17 @@ ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
 
   group->needs_diagnose = FALSE;
   group->has_diagnostics = FALSE;
+  group->diagnose_begin_time = ide_trace_begin_mark ();
+
+  /* Only serialize the snapshot now that a diagnosis is really starting,
+   * rather than every time the buffer settles.
+   */
+  if (group->snapshot != NULL)
+    {
+      g_clear_pointer (&group->contents, g_bytes_unref);
+      group->contents = ide_buffer_snapshot_dup_content (group->snapshot);
+      g_clear_pointer (&group->snapshot, ide_buffer_snapshot_unref);
+    }
 
   if (group->contents == NULL)
     group->contents = g_bytes_new ("", 0);
@@ -483,10 +598,26 @@ ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
   IDE_EXIT;
 }
 
+static int
+ide_diagnostics_group_compare_visible (gconstpointer a,
+                                       gconstpointer b)
+{
+  const IdeDiagnosticsGroup *group_a = *(const IdeDiagnosticsGroup * const *)a;
+  const IdeDiagnosticsGroup *group_b = *(const IdeDiagnosticsGroup * const *)b;
+
+  if (group_a->visible_at > group_b->visible_at)
+    return -1;
+  else if (group_a->visible_at < group_b->visible_at)
+    return 1;
+  else
+    return 0;
+}
+
 static gboolean
 ide_diagnostics_manager_begin_diagnose (gpointer data)
 {
   IdeDiagnosticsManager *self = data;
+  g_autoptr(GPtrArray) ready = NULL;
   GHashTableIter iter;
   gpointer value;
 
@@ -496,6 +627,8 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
 
   self->queued_diagnose_source = 0;
 
+  ready = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_diagnostics_group_unref);
+
   g_hash_table_iter_init (&iter, self->groups_by_file);
 
   while (g_hash_table_iter_next (&iter, NULL, &value))
@@ -506,9 +639,19 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
       g_assert (IS_DIAGNOSTICS_GROUP (group));
 
       if (group->needs_diagnose && group->adapter != NULL && group->in_diagnose == 0)
-        ide_diagnostics_group_diagnose (group, self);
+        g_ptr_array_add (ready, ide_diagnostics_group_ref (group));
     }
 
+  /*
+   * Providers generally process requests in the order they are received
+   * (such as language servers), so dispatch the files the user is looking
+   * at before those in background tabs.
+   */
+  g_ptr_array_sort (ready, ide_diagnostics_group_compare_visible);
+
+  for (guint i = 0; i < ready->len; i++)
+    ide_diagnostics_group_diagnose (g_ptr_array_index (ready, i), self);
+
   IDE_RETURN (G_SOURCE_REMOVE);
 }
 
@@ -798,6 +941,7 @@ ide_diagnostics_manager_clear_by_provider (IdeDiagnosticsManager *self,
       if (g_hash_table_contains (group->diagnostics_by_provider, provider))
         {
           g_hash_table_remove (group->diagnostics_by_provider, provider);
+          group->sequence++;
 
           /*
            * TODO: If this provider is not part of this group, we can possibly
@@ -1046,6 +1190,7 @@ _ide_diagnostics_manager_file_closed (IdeDiagnosticsManager *self,
   g_assert (IS_DIAGNOSTICS_GROUP (group));
 
   /* Clear some state we've been tracking */
+  g_clear_pointer (&group->snapshot, ide_buffer_snapshot_unref);
   g_clear_pointer (&group->contents, g_bytes_unref);
   group->lang_id = NULL;
   group->needs_diagnose = FALSE;
@@ -1074,7 +1219,7 @@ _ide_diagnostics_manager_file_closed (IdeDiagnosticsManager *self,
 void
 _ide_diagnostics_manager_file_changed (IdeDiagnosticsManager *self,
                                        GFile                 *file,
-                                       GBytes                *contents,
+                                       IdeBufferSnapshot     *snapshot,
                                        const gchar           *lang_id)
 {
   IdeDiagnosticsGroup *group;
@@ -1088,14 +1233,29 @@ _ide_diagnostics_manager_file_changed (IdeDiagnosticsManager *self,
   g_assert (group != NULL);
   g_assert (IS_DIAGNOSTICS_GROUP (group));
 
+  g_clear_pointer (&group->snapshot, ide_buffer_snapshot_unref);
   g_clear_pointer (&group->contents, g_bytes_unref);
 
   group->lang_id = g_intern_string (lang_id);
-  group->contents = contents ? g_bytes_ref (contents) : NULL;
+  group->snapshot = snapshot ? ide_buffer_snapshot_ref (snapshot) : NULL;
 
   ide_diagnostics_group_queue_diagnose (group, self);
 }
 
+void
+_ide_diagnostics_manager_file_visible (IdeDiagnosticsManager *self,
+                                       GFile                 *file)
+{
+  IdeDiagnosticsGroup *group;
+
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_return_if_fail (G_IS_FILE (file));
+
+  if ((group = g_hash_table_lookup (self->groups_by_file, file)))
+    group->visible_at = g_get_monotonic_time ();
+}
+
 void
 _ide_diagnostics_manager_language_changed (IdeDiagnosticsManager *self,
                                            GFile                 *file,
@@ -0,0 +1,48 @@
+/* ide-diagnostics-private.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "ide-diagnostics.h"
+
+G_BEGIN_DECLS
+
+typedef void (*IdeDiagnosticsForeachFunc) (IdeDiagnostic *diagnostic,
+                                           gpointer       user_data);
+typedef void (*IdeDiagnosticsChangedFunc) (guint          begin_line,
+                                           guint          end_line,
+                                           gpointer       user_data);
+typedef guint (*IdeDiagnosticsShiftFunc)  (guint          line,
+                                           gpointer       user_data);
+
+void _ide_diagnostics_foreach_in_range (IdeDiagnostics            *self,
+                                        GFile                     *file,
+                                        guint                      begin_line,
+                                        guint                      end_line,
+                                        IdeDiagnosticsForeachFunc  func,
+                                        gpointer                   user_data);
+void _ide_diagnostics_foreach_changed  (IdeDiagnostics            *old_diagnostics,
+                                        IdeDiagnostics            *new_diagnostics,
+                                        GFile                     *file,
+                                        IdeDiagnosticsShiftFunc    shift_func,
+                                        IdeDiagnosticsChangedFunc  func,
+                                        gpointer                   user_data);
+
+G_END_DECLS
@@ -24,7 +24,21 @@
 
 #include "ide-diagnostic.h"
 #include "ide-diagnostics.h"
+#include "ide-diagnostics-private.h"
 #include "ide-location.h"
+#include "ide-range.h"
+
+/*
+ * The per-file caches are sorted by the first line a diagnostic touches
+ * and are laid out as an implicit interval tree (see "cgranges" by Heng
+ * Li). Every node at level k sits at an index whose lowest k bits are set,
+ * and max_end holds the largest end_line within its subtree. That lets us
+ * skip whole subtrees when looking for the diagnostics within a range of
+ * visible lines without any allocations beyond the array itself.
+ *
+ * Adding a diagnostic only marks the cache for its file as needing to be
+ * sorted again, which happens lazily upon the next query.
+ */
 
 typedef struct
 {
@@ -36,21 +50,28 @@ typedef struct
 
 typedef struct
 {
-  gint                  line : 28;
-  IdeDiagnosticSeverity severity : 4;
+  IdeDiagnostic         *diagnostic;
+  guint                  begin_line;
+  guint                  end_line;
+  guint                  max_end;
+  guint                  line : 28;
+  IdeDiagnosticSeverity  severity : 4;
 } IdeDiagnosticsCacheLine;
 
 typedef struct
 {
   GFile  *file;
   GArray *lines;
+  guint   root_level;
+  guint   needs_index : 1;
 } IdeDiagnosticsCache;
 
 typedef struct
 {
-  guint begin;
-  guint end;
-} LookupKey;
+  gsize x;
+  guint level;
+  guint visited_left : 1;
+} IndexStack;
 
 enum {
   PROP_0,
@@ -69,6 +90,9 @@ G_DEFINE_TYPE_WITH_CODE (IdeDiagnostics, ide_diagnostics, IDE_TYPE_OBJECT,
 
 static GParamSpec *properties [N_PROPS];
 
+static void ide_diagnostics_cache_insert (GHashTable    *caches,
+                                          IdeDiagnostic *diag);
+
 static void
 ide_diagnostics_cache_free (gpointer data)
 {
@@ -198,6 +222,9 @@ ide_diagnostics_take (IdeDiagnostics *self,
 
   severity = ide_diagnostic_get_severity (diagnostic);
 
+  if (priv->caches != NULL)
+    ide_diagnostics_cache_insert (priv->caches, diagnostic);
+
   position = priv->items->len;
   g_ptr_array_add (priv->items, g_steal_pointer (&diagnostic));
   g_list_model_items_changed (G_LIST_MODEL (self), position, 0, 1);
@@ -232,20 +259,15 @@ ide_diagnostics_merge (IdeDiagnostics *self,
 {
   IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
   IdeDiagnosticsPrivate *other_priv = ide_diagnostics_get_instance_private (other);
-  guint position;
 
   g_return_if_fail (IDE_IS_DIAGNOSTICS (self));
   g_return_if_fail (IDE_IS_DIAGNOSTICS (other));
 
-  position = priv->items->len;
-
   for (guint i = 0; i < other_priv->items->len; i++)
     {
       IdeDiagnostic *diagnostic = g_ptr_array_index (other_priv->items, i);
       ide_diagnostics_take (self, g_object_ref (diagnostic));
     }
-
-  g_list_model_items_changed (G_LIST_MODEL (self), position, 0, other_priv->items->len);
 }
 
 gboolean
@@ -335,58 +357,274 @@ compare_lines (gconstpointer a,
   const IdeDiagnosticsCacheLine *line_a = a;
   const IdeDiagnosticsCacheLine *line_b = b;
 
-  return line_a->line - line_b->line;
+  if (line_a->begin_line < line_b->begin_line)
+    return -1;
+  else if (line_a->begin_line > line_b->begin_line)
+    return 1;
+  else if (line_a->end_line < line_b->end_line)
+    return -1;
+  else if (line_a->end_line > line_b->end_line)
+    return 1;
+  else
+    return 0;
+}
+
+static guint
+index_prepare (IdeDiagnosticsCacheLine *lines,
+               gsize                    n_lines)
+{
+  gsize last_i = 0;
+  guint last = 0;
+  guint k;
+
+  if (n_lines == 0)
+    return 0;
+
+  for (gsize i = 0; i < n_lines; i += 2)
+    {
+      last_i = i;
+      last = lines[i].max_end = lines[i].end_line;
+    }
+
+  for (k = 1; ((gsize)1 << k) <= n_lines; k++)
+    {
+      gsize x = (gsize)1 << (k - 1);
+      gsize i0 = (x << 1) - 1;
+      gsize step = x << 2;
+
+      for (gsize i = i0; i < n_lines; i += step)
+        {
+          guint el = lines[i - x].max_end;
+          guint er = i + x < n_lines ? lines[i + x].max_end : last;
+          guint e = lines[i].end_line;
+
+          e = MAX (e, el);
+          e = MAX (e, er);
+
+          lines[i].max_end = e;
+        }
+
+      last_i = ((last_i >> k) & 1) ? last_i - x : last_i + x;
+
+      if (last_i < n_lines && lines[last_i].max_end > last)
+        last = lines[last_i].max_end;
+    }
+
+  return k - 1;
 }
 
 static void
-ide_diagnostics_build_caches (IdeDiagnostics *self)
+ide_diagnostics_cache_ensure_index (IdeDiagnosticsCache *cache)
 {
-  IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
-  g_autoptr(GHashTable) caches = NULL;
+  g_assert (cache != NULL);
+
+  if (cache->needs_index)
+    {
+      cache->needs_index = FALSE;
+      g_array_sort (cache->lines, compare_lines);
+      cache->root_level = index_prepare ((IdeDiagnosticsCacheLine *)(gpointer)cache->lines->data,
+                                         cache->lines->len);
+    }
+}
+
+typedef void (*IndexFunc) (const IdeDiagnosticsCacheLine *line,
+                           gpointer                       user_data);
+
+static void
+ide_diagnostics_cache_query (IdeDiagnosticsCache *cache,
+                             guint                begin_line,
+                             guint                end_line,
+                             IndexFunc            func,
+                             gpointer             user_data)
+{
+  const IdeDiagnosticsCacheLine *lines;
+  IndexStack stack[64];
+  gsize n_lines;
+  guint t = 0;
+
+  g_assert (cache != NULL);
+  g_assert (func != NULL);
+
+  ide_diagnostics_cache_ensure_index (cache);
+
+  if (cache->lines->len == 0 || begin_line > end_line)
+    return;
+
+  lines = (const IdeDiagnosticsCacheLine *)(gconstpointer)cache->lines->data;
+  n_lines = cache->lines->len;
+
+  stack[t].x = ((gsize)1 << cache->root_level) - 1;
+  stack[t].level = cache->root_level;
+  stack[t++].visited_left = FALSE;
+
+  /* Nodes are visited in order so the results are sorted by begin_line */
+  while (t > 0)
+    {
+      IndexStack z = stack[--t];
+
+      if (z.level <= 3)
+        {
+          /* Small subtree, just scan it */
+          gsize i0 = z.x >> z.level << z.level;
+          gsize i1 = MIN (i0 + ((gsize)1 << (z.level + 1)) - 1, n_lines);
+
+          for (gsize i = i0; i < i1 && lines[i].begin_line <= end_line; i++)
+            {
+              if (begin_line <= lines[i].end_line)
+                func (&lines[i], user_data);
+            }
+        }
+      else if (!z.visited_left)
+        {
+          gsize y = z.x - ((gsize)1 << (z.level - 1));
+
+          stack[t].x = z.x;
+          stack[t].level = z.level;
+          stack[t++].visited_left = TRUE;
+
+          /* Left child may be past the end of the array */
+          if (y >= n_lines || lines[y].max_end >= begin_line)
+            {
+              stack[t].x = y;
+              stack[t].level = z.level - 1;
+              stack[t++].visited_left = FALSE;
+            }
+        }
+      else if (z.x < n_lines && lines[z.x].begin_line <= end_line)
+        {
+          if (begin_line <= lines[z.x].end_line)
+            func (&lines[z.x], user_data);
+
+          stack[t].x = z.x + ((gsize)1 << (z.level - 1));
+          stack[t].level = z.level - 1;
+          stack[t++].visited_left = FALSE;
+        }
+    }
+}
+
+static gboolean
+ide_diagnostics_cache_line_init (IdeDiagnosticsCacheLine *line,
+                                 IdeDiagnostic           *diag)
+{
+  IdeLocation *location;
+  GFile *file;
+  guint n_ranges;
+
+  g_assert (line != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC (diag));
+
+  if (!(file = ide_diagnostic_get_file (diag)))
+    return FALSE;
+
+  if (!(location = ide_diagnostic_get_location (diag)))
+    return FALSE;
+
+  line->diagnostic = diag;
+  line->severity = ide_diagnostic_get_severity (diag);
+  line->line = ide_location_get_line (location);
+  line->begin_line = line->line;
+  line->end_line = line->line;
+  line->max_end = line->line;
+
+  /* Extend the span to any ranges within the same file */
+  n_ranges = ide_diagnostic_get_n_ranges (diag);
+
+  for (guint i = 0; i < n_ranges; i++)
+    {
+      IdeRange *range = ide_diagnostic_get_range (diag, i);
+      IdeLocation *begin = ide_range_get_begin (range);
+      IdeLocation *end = ide_range_get_end (range);
+      GFile *range_file = ide_location_get_file (begin);
+
+      if (range_file != NULL && !g_file_equal (range_file, file))
+        continue;
+
+      line->begin_line = MIN (line->begin_line, (guint)ide_location_get_line (begin));
+      line->end_line = MAX (line->end_line, (guint)ide_location_get_line (end));
+    }
+
+  return TRUE;
+}
+
+static void
+ide_diagnostics_cache_insert (GHashTable    *caches,
+                              IdeDiagnostic *diag)
+{
+  IdeDiagnosticsCacheLine val;
   IdeDiagnosticsCache *cache;
-  GHashTableIter iter;
   GFile *file;
 
+  g_assert (caches != NULL);
+  g_assert (IDE_IS_DIAGNOSTIC (diag));
+
+  if (!ide_diagnostics_cache_line_init (&val, diag))
+    return;
+
+  file = ide_diagnostic_get_file (diag);
+
+  if (!(cache = g_hash_table_lookup (caches, file)))
+    {
+      cache = g_slice_new0 (IdeDiagnosticsCache);
+      cache->file = g_object_ref (file);
+      cache->lines = g_array_new (FALSE, FALSE, sizeof (IdeDiagnosticsCacheLine));
+      g_hash_table_insert (caches, g_object_ref (file), cache);
+    }
+
+  g_array_append_val (cache->lines, val);
+  cache->needs_index = TRUE;
+}
+
+static void
+ide_diagnostics_build_caches (IdeDiagnostics *self)
+{
+  IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
+
   g_assert (IDE_IS_DIAGNOSTICS (self));
   g_assert (priv->caches == NULL);
 
-  caches = g_hash_table_new_full (g_file_hash,
-                                  (GEqualFunc)g_file_equal,
-                                  g_object_unref,
-                                  ide_diagnostics_cache_free);
+  priv->caches = g_hash_table_new_full (g_file_hash,
+                                        (GEqualFunc)g_file_equal,
+                                        g_object_unref,
+                                        ide_diagnostics_cache_free);
 
   for (guint i = 0; i < priv->items->len; i++)
-    {
-      IdeDiagnostic *diag = g_ptr_array_index (priv->items, i);
-      IdeDiagnosticsCacheLine val;
-      IdeLocation *location;
+    ide_diagnostics_cache_insert (priv->caches, g_ptr_array_index (priv->items, i));
+}
 
-      if (!(file = ide_diagnostic_get_file (diag)))
-        continue;
+static IdeDiagnosticsCache *
+ide_diagnostics_get_cache (IdeDiagnostics *self,
+                           GFile          *file)
+{
+  IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
 
-      if (!(location = ide_diagnostic_get_location (diag)))
-        continue;
+  g_assert (IDE_IS_DIAGNOSTICS (self));
+  g_assert (G_IS_FILE (file));
 
-      if (!(cache = g_hash_table_lookup (caches, file)))
-        {
-          cache = g_slice_new0 (IdeDiagnosticsCache);
-          cache->file = g_object_ref (file);
-          cache->lines = g_array_new (FALSE, FALSE, sizeof (IdeDiagnosticsCacheLine));
-          g_hash_table_insert (caches, g_object_ref (file), cache);
-        }
+  if (priv->items->len == 0)
+    return NULL;
 
-      val.severity = ide_diagnostic_get_severity (diag);
-      val.line = ide_location_get_line (location);
+  if (priv->caches == NULL)
+    ide_diagnostics_build_caches (self);
 
-      g_array_append_val (cache->lines, val);
-    }
+  return g_hash_table_lookup (priv->caches, file);
+}
 
-  g_hash_table_iter_init (&iter, caches);
+typedef struct
+{
+  guint                      begin_line;
+  guint                      end_line;
+  IdeDiagnosticsLineCallback callback;
+  gpointer                   user_data;
+} ForeachLine;
 
-  while (g_hash_table_iter_next (&iter, (gpointer *)&file, (gpointer *)&cache))
-    g_array_sort (cache->lines, compare_lines);
+static void
+foreach_line_cb (const IdeDiagnosticsCacheLine *line,
+                 gpointer                       user_data)
+{
+  ForeachLine *state = user_data;
 
-  priv->caches = g_steal_pointer (&caches);
+  if (line->line >= state->begin_line && line->line <= state->end_line)
+    state->callback (line->line, line->severity, state->user_data);
 }
 
 /**
@@ -410,33 +648,39 @@ ide_diagnostics_foreach_line_in_range (IdeDiagnostics             *self,
                                        IdeDiagnosticsLineCallback  callback,
                                        gpointer                    user_data)
 {
-  IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
-  const IdeDiagnosticsCache *cache;
+  ForeachLine state = { begin_line, end_line, callback, user_data };
+  IdeDiagnosticsCache *cache;
 
   g_return_if_fail (IDE_IS_DIAGNOSTICS (self));
   g_return_if_fail (G_IS_FILE (file));
 
-  if (priv->items->len == 0)
+  if (!(cache = ide_diagnostics_get_cache (self, file)))
     return;
 
-  if (priv->caches == NULL)
-    ide_diagnostics_build_caches (self);
+  ide_diagnostics_cache_query (cache, begin_line, end_line, foreach_line_cb, &state);
+}
 
-  if (!(cache = g_hash_table_lookup (priv->caches, file)))
-    return;
+typedef struct
+{
+  guint          line;
+  IdeDiagnostic *first;
+  GPtrArray     *all;
+} AtLine;
 
-  for (guint i = 0; i < cache->lines->len; i++)
-    {
-      const IdeDiagnosticsCacheLine *line = &g_array_index (cache->lines, IdeDiagnosticsCacheLine, i);
+static void
+at_line_cb (const IdeDiagnosticsCacheLine *line,
+            gpointer                       user_data)
+{
+  AtLine *state = user_data;
 
-      if (line->line < begin_line)
-        continue;
+  if (line->line != state->line)
+    return;
 
-      if (line->line > end_line)
-        break;
+  if (state->first == NULL)
+    state->first = line->diagnostic;
 
-      callback (line->line, line->severity, user_data);
-    }
+  if (state->all != NULL)
+    g_ptr_array_add (state->all, g_object_ref (line->diagnostic));
 }
 
 /**
@@ -454,29 +698,18 @@ ide_diagnostics_get_diagnostic_at_line (IdeDiagnostics *self,
                                         GFile          *file,
                                         guint           line)
 {
-  IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
+  AtLine state = { line, NULL, NULL };
+  IdeDiagnosticsCache *cache;
 
   g_return_val_if_fail (IDE_IS_DIAGNOSTICS (self), NULL);
   g_return_val_if_fail (G_IS_FILE (file), NULL);
 
-  for (guint i = 0; i < priv->items->len; i++)
-    {
-      IdeDiagnostic *diag = g_ptr_array_index (priv->items, i);
-      IdeLocation *loc = ide_diagnostic_get_location (diag);
-      GFile *loc_file;
-      guint loc_line;
+  if (!(cache = ide_diagnostics_get_cache (self, file)))
+    return NULL;
 
-      if (loc == NULL)
-        continue;
-
-      loc_file = ide_location_get_file (loc);
-      loc_line = ide_location_get_line (loc);
-
-      if (loc_line == line && g_file_equal (file, loc_file))
-        return diag;
-    }
+  ide_diagnostics_cache_query (cache, line, line, at_line_cb, &state);
 
-  return NULL;
+  return state.first;
 }
 
 /**
@@ -494,35 +727,261 @@ ide_diagnostics_get_diagnostics_at_line (IdeDiagnostics *self,
                                          GFile          *file,
                                          guint           line)
 {
-  IdeDiagnosticsPrivate *priv = ide_diagnostics_get_instance_private (self);
   g_autoptr(GPtrArray) valid_diag = NULL;
+  IdeDiagnosticsCache *cache;
+  AtLine state;
 
   g_return_val_if_fail (IDE_IS_DIAGNOSTICS (self), NULL);
   g_return_val_if_fail (G_IS_FILE (file), NULL);
 
+  if (!(cache = ide_diagnostics_get_cache (self, file)))
+    return NULL;
+
   valid_diag = g_ptr_array_new_with_free_func (g_object_unref);
 
-  for (guint i = 0; i < priv->items->len; i++)
+  state.line = line;
+  state.first = NULL;
+  state.all = valid_diag;
+
+  ide_diagnostics_cache_query (cache, line, line, at_line_cb, &state);
+
+  if (valid_diag->len != 0)
+    return IDE_PTR_ARRAY_STEAL_FULL (&valid_diag);
+
+  return NULL;
+}
+
+typedef struct
+{
+  IdeDiagnosticsForeachFunc func;
+  gpointer                  user_data;
+} ForeachInRange;
+
+static void
+foreach_in_range_cb (const IdeDiagnosticsCacheLine *line,
+                     gpointer                       user_data)
+{
+  ForeachInRange *state = user_data;
+
+  state->func (line->diagnostic, state->user_data);
+}
+
+/**
+ * _ide_diagnostics_foreach_in_range:
+ * @self: a #IdeDiagnostics
+ * @file: the target file
+ * @begin_line: the first line
+ * @end_line: the last line, inclusive
+ * @func: (scope call): a function to call for each diagnostic
+ * @user_data: closure data for @func
+ *
+ * Calls @func for every diagnostic in @file whose location or ranges
+ * touch any line between @begin_line and @end_line.
+ */
+void
+_ide_diagnostics_foreach_in_range (IdeDiagnostics            *self,
+                                   GFile                     *file,
+                                   guint                      begin_line,
+                                   guint                      end_line,
+                                   IdeDiagnosticsForeachFunc  func,
+                                   gpointer                   user_data)
+{
+  ForeachInRange state = { func, user_data };
+  IdeDiagnosticsCache *cache;
+
+  g_return_if_fail (IDE_IS_DIAGNOSTICS (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (func != NULL);
+
+  if (!(cache = ide_diagnostics_get_cache (self, file)))
+    return;
+
+  ide_diagnostics_cache_query (cache, begin_line, end_line, foreach_in_range_cb, &state);
+}
+
+static gboolean
+cache_line_equal (const IdeDiagnosticsCacheLine *a,
+                  const IdeDiagnosticsCacheLine *b)
+{
+  return a->begin_line == b->begin_line &&
+         a->end_line == b->end_line &&
+         a->severity == b->severity &&
+         (a->diagnostic == b->diagnostic ||
+          ide_diagnostic_equal (a->diagnostic, b->diagnostic));
+}
+
+/*
+ * Like cache_line_equal() but for lines which have been shifted through
+ * buffer edits. The diagnostic locations no longer match, so compare
+ * everything except the line, which is already known to match.
+ */
+static gboolean
+cache_line_equal_shifted (const IdeDiagnosticsCacheLine *a,
+                          const IdeDiagnosticsCacheLine *b)
+{
+  IdeLocation *a_loc;
+  IdeLocation *b_loc;
+
+  if (a->begin_line != b->begin_line ||
+      a->end_line != b->end_line ||
+      a->line != b->line ||
+      a->severity != b->severity)
+    return FALSE;
+
+  if (a->diagnostic == b->diagnostic)
+    return TRUE;
+
+  if (G_OBJECT_TYPE (a->diagnostic) != G_OBJECT_TYPE (b->diagnostic) ||
+      ide_diagnostic_get_n_ranges (a->diagnostic) != ide_diagnostic_get_n_ranges (b->diagnostic) ||
+      g_strcmp0 (ide_diagnostic_get_text (a->diagnostic),
+                 ide_diagnostic_get_text (b->diagnostic)) != 0)
+    return FALSE;
+
+  a_loc = ide_diagnostic_get_location (a->diagnostic);
+  b_loc = ide_diagnostic_get_location (b->diagnostic);
+
+  return ide_location_get_line_offset (a_loc) == ide_location_get_line_offset (b_loc);
+}
+
+static void
+report_unmatched (const IdeDiagnosticsCacheLine *lines,
+                  guint                          begin,
+                  guint                          end,
+                  const IdeDiagnosticsCacheLine *other,
+                  guint                          other_begin,
+                  guint                          other_end,
+                  gboolean                       shifted,
+                  IdeDiagnosticsChangedFunc      func,
+                  gpointer                       user_data)
+{
+  for (guint i = begin; i < end; i++)
     {
-      IdeDiagnostic *diag = g_ptr_array_index (priv->items, i);
-      IdeLocation *loc = ide_diagnostic_get_location (diag);
-      GFile *loc_file;
-      guint loc_line;
+      gboolean found = FALSE;
 
-      if (loc == NULL)
-        continue;
+      for (guint j = other_begin; j < other_end; j++)
+        {
+          if (shifted)
+            found = cache_line_equal_shifted (&lines[i], &other[j]);
+          else
+            found = cache_line_equal (&lines[i], &other[j]);
+
+          if (found)
+            break;
+        }
+
+      if (!found)
+        func (lines[i].begin_line, lines[i].end_line, user_data);
+    }
+}
+
+/**
+ * _ide_diagnostics_foreach_changed:
+ * @old_diagnostics: (nullable): the previous #IdeDiagnostics
+ * @new_diagnostics: (nullable): the replacement #IdeDiagnostics
+ * @file: the file to compare
+ * @shift_func: (nullable) (scope call): a function to map lines from
+ *   @old_diagnostics to where they are now, or %NULL
+ * @func: (scope call): a function to call for each changed span
+ * @user_data: closure data for @shift_func and @func
+ *
+ * Calls @func with the span of lines for each diagnostic in @file that
+ * was added or removed between @old_diagnostics and @new_diagnostics.
+ *
+ * If the file has been edited since @old_diagnostics was produced, use
+ * @shift_func to move the old diagnostics through those edits so that
+ * diagnostics which merely moved are not reported. Spans are always
+ * reported in the coordinates of @new_diagnostics.
+ *
+ * Spans may overlap and may be reported more than once.
+ */
+void
+_ide_diagnostics_foreach_changed (IdeDiagnostics            *old_diagnostics,
+                                  IdeDiagnostics            *new_diagnostics,
+                                  GFile                     *file,
+                                  IdeDiagnosticsShiftFunc    shift_func,
+                                  IdeDiagnosticsChangedFunc  func,
+                                  gpointer                   user_data)
+{
+  static const IdeDiagnosticsCacheLine empty[1];
+  g_autoptr(GArray) shifted = NULL;
+  const IdeDiagnosticsCacheLine *a = empty;
+  const IdeDiagnosticsCacheLine *b = empty;
+  IdeDiagnosticsCache *old_cache = NULL;
+  IdeDiagnosticsCache *new_cache = NULL;
+  guint n_a = 0;
+  guint n_b = 0;
+  guint i = 0;
+  guint j = 0;
+
+  g_return_if_fail (!old_diagnostics || IDE_IS_DIAGNOSTICS (old_diagnostics));
+  g_return_if_fail (!new_diagnostics || IDE_IS_DIAGNOSTICS (new_diagnostics));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (func != NULL);
 
-      loc_file = ide_location_get_file (loc);
-      loc_line = ide_location_get_line (loc);
+  if (old_diagnostics != NULL &&
+      (old_cache = ide_diagnostics_get_cache (old_diagnostics, file)))
+    {
+      ide_diagnostics_cache_ensure_index (old_cache);
+      a = (const IdeDiagnosticsCacheLine *)(gconstpointer)old_cache->lines->data;
+      n_a = old_cache->lines->len;
+
+      if (shift_func != NULL && n_a > 0)
+        {
+          shifted = g_array_sized_new (FALSE, FALSE, sizeof (IdeDiagnosticsCacheLine), n_a);
+          g_array_append_vals (shifted, a, n_a);
+
+          for (guint k = 0; k < n_a; k++)
+            {
+              IdeDiagnosticsCacheLine *line = &g_array_index (shifted, IdeDiagnosticsCacheLine, k);
 
-      if (loc_line == line && g_file_equal (file, loc_file))
-        g_ptr_array_add (valid_diag, g_object_ref(diag));
+              line->begin_line = shift_func (line->begin_line, user_data);
+              line->end_line = shift_func (line->end_line, user_data);
+              line->line = shift_func (line->line, user_data);
+            }
+
+          g_array_sort (shifted, compare_lines);
+          a = (const IdeDiagnosticsCacheLine *)(gconstpointer)shifted->data;
+        }
     }
 
-  if (valid_diag->len != 0)
-    return IDE_PTR_ARRAY_STEAL_FULL (&valid_diag);
+  if (new_diagnostics != NULL &&
+      (new_cache = ide_diagnostics_get_cache (new_diagnostics, file)))
+    {
+      ide_diagnostics_cache_ensure_index (new_cache);
+      b = (const IdeDiagnosticsCacheLine *)(gconstpointer)new_cache->lines->data;
+      n_b = new_cache->lines->len;
+    }
 
-  return NULL;
+  /* Both are sorted by span, so walk them together comparing the groups
+   * of diagnostics which share the same span.
+   */
+  while (i < n_a || j < n_b)
+    {
+      guint a_end = i;
+      guint b_end = j;
+      gint cmp;
+
+      if (i >= n_a)
+        cmp = 1;
+      else if (j >= n_b)
+        cmp = -1;
+      else
+        cmp = compare_lines (&a[i], &b[j]);
+
+      if (cmp <= 0)
+        while (a_end < n_a && compare_lines (&a[i], &a[a_end]) == 0)
+          a_end++;
+
+      if (cmp >= 0)
+        while (b_end < n_b && compare_lines (&b[j], &b[b_end]) == 0)
+          b_end++;
+
+      report_unmatched (a, i, a_end, b, j, b_end, shifted != NULL, func, user_data);
+      report_unmatched (b, j, b_end, a, i, a_end, shifted != NULL, func, user_data);
+
+      i = a_end;
+      j = b_end;
+    }
 }
 
 /**
@@ -264,51 +264,32 @@ ide_highlight_engine_apply_style (const GtkTextIter *begin,
   return IDE_HIGHLIGHT_CONTINUE;
 }
 
-typedef struct
-{
-  gsize offset;
-  gsize length;
-} GetUncheckedRange;
-
-static inline gboolean
-get_unchecked_start_cb (gsize                   offset,
-                        const CjhTextRegionRun *run,
-                        gpointer                user_data)
-{
-  GetUncheckedRange *range = user_data;
-
-  g_assert (run != NULL);
-  g_assert (run->length > 0);
-
-  if (range->offset == G_MAXSIZE && run->data == RUN_CHECKED)
-    return FALSE;
-
-  if (run->data == RUN_UNCHECKED)
-    {
-      if (range->offset == G_MAXSIZE)
-        range->offset = offset;
-      range->length += run->length;
-      return FALSE;
-    }
-
-  return TRUE;
-}
-
 static gboolean
 get_next_range (CjhTextRegion *region,
                 GtkTextBuffer *buffer,
                 GtkTextIter   *begin,
                 GtkTextIter   *end)
 {
-  GetUncheckedRange range = {G_MAXSIZE, 0};
-
-  _cjh_text_region_foreach (region, get_unchecked_start_cb, &range);
+  GtkTextIter visible_begin;
+  GtkTextIter visible_end;
+  gsize offset;
+  gsize length;
 
-  if (range.length == 0 || range.offset == G_MAXSIZE)
+  /* Highlight what the user can see first and then work outward from
+   * there so that opening a large file does not start at the top.
+   */
+  ide_buffer_get_visible_range (IDE_BUFFER (buffer), &visible_begin, &visible_end);
+
+  if (!_cjh_text_region_find_nearest (region,
+                                      RUN_UNCHECKED,
+                                      gtk_text_iter_get_offset (&visible_begin),
+                                      gtk_text_iter_get_offset (&visible_end),
+                                      &offset,
+                                      &length))
     return FALSE;
 
-  gtk_text_buffer_get_iter_at_offset (buffer, begin, range.offset);
-  gtk_text_buffer_get_iter_at_offset (buffer, end, range.offset + range.length);
+  gtk_text_buffer_get_iter_at_offset (buffer, begin, offset);
+  gtk_text_buffer_get_iter_at_offset (buffer, end, offset + length);
 
   return !gtk_text_iter_equal (begin, end);
 }
@@ -394,7 +375,15 @@ ide_highlight_engine_worker (gint64   deadline,
 
   if (self->enabled)
     {
-      if (ide_highlight_engine_tick (self, deadline))
+      gint64 begin_time = ide_trace_begin_mark ();
+      gboolean ret;
+
+      ret = ide_highlight_engine_tick (self, deadline);
+
+      ide_trace_end_mark (begin_time, "Highlighting", "Tick", "%s",
+                          G_OBJECT_TYPE_NAME (self->highlighter));
+
+      if (ret)
         return G_SOURCE_CONTINUE;
     }
 
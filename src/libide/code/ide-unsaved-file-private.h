@@ -20,13 +20,19 @@
 
 #pragma once
 
+#include "ide-buffer-snapshot.h"
 #include "ide-unsaved-file.h"
+#include "ide-unsaved-files.h"
 
 G_BEGIN_DECLS
 
-IdeUnsavedFile *_ide_unsaved_file_new (GFile       *file,
-                                       GBytes      *content,
-                                       const gchar *temp_path,
-                                       gint64       sequence);
+IdeUnsavedFile *_ide_unsaved_file_new              (GFile             *file,
+                                                    GBytes            *content,
+                                                    IdeBufferSnapshot *snapshot,
+                                                    const gchar       *temp_path,
+                                                    gint64             sequence);
+void            _ide_unsaved_files_update_snapshot (IdeUnsavedFiles   *self,
+                                                    GFile             *file,
+                                                    IdeBufferSnapshot *snapshot);
 
 G_END_DECLS
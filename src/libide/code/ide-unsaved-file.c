@@ -31,6 +31,9 @@
  * This type is meant to be created and then immutable after that.
  * So you can create it from the main thread, and then pass it to
  * any other thread to do the work.
+ *
+ * When created from a buffer snapshot, the content is serialized the
+ * first time it is requested, which may happen on any thread.
  */
 
 G_DEFINE_BOXED_TYPE (IdeUnsavedFile, ide_unsaved_file, ide_unsaved_file_ref, ide_unsaved_file_unref)
@@ -38,28 +41,31 @@ G_DEFINE_BOXED_TYPE (IdeUnsavedFile, ide_unsaved_file, ide_unsaved_file_ref, ide
 struct _IdeUnsavedFile
 {
   volatile gint  ref_count;
-  GBytes        *content;
-  GFile         *file;
+  GBytes            *content;
+  IdeBufferSnapshot *snapshot;
+  GFile             *file;
   gchar         *temp_path;
   gint64         sequence;
 };
 
 IdeUnsavedFile *
-_ide_unsaved_file_new (GFile       *file,
-                       GBytes      *content,
-                       const gchar *temp_path,
-                       gint64       sequence)
+_ide_unsaved_file_new (GFile             *file,
+                       GBytes            *content,
+                       IdeBufferSnapshot *snapshot,
+                       const gchar       *temp_path,
+                       gint64             sequence)
 {
   IdeUnsavedFile *ret;
 
   g_return_val_if_fail (IDE_IS_MAIN_THREAD (), NULL);
   g_return_val_if_fail (G_IS_FILE (file), NULL);
-  g_return_val_if_fail (content, NULL);
+  g_return_val_if_fail (content != NULL || snapshot != NULL, NULL);
 
   ret = g_slice_new0 (IdeUnsavedFile);
   ret->ref_count = 1;
   ret->file = g_object_ref (file);
-  ret->content = g_bytes_ref (content);
+  ret->content = content ? g_bytes_ref (content) : NULL;
+  ret->snapshot = snapshot ? ide_buffer_snapshot_ref (snapshot) : NULL;
   ret->sequence = sequence;
   ret->temp_path = g_strdup (temp_path);
 
@@ -81,6 +87,7 @@ ide_unsaved_file_persist (IdeUnsavedFile  *self,
                           GError         **error)
 {
   g_autoptr(GFile) file = NULL;
+  GBytes *content;
   gboolean ret;
 
   IDE_ENTRY;
@@ -91,10 +98,11 @@ ide_unsaved_file_persist (IdeUnsavedFile  *self,
 
   IDE_TRACE_MSG ("Saving draft to \"%s\"", self->temp_path);
 
+  content = ide_unsaved_file_get_content (self);
   file = g_file_new_for_path (self->temp_path);
   ret = g_file_replace_contents (file,
-                                 g_bytes_get_data (self->content, NULL),
-                                 g_bytes_get_size (self->content),
+                                 g_bytes_get_data (content, NULL),
+                                 g_bytes_get_size (content),
                                  NULL,
                                  FALSE,
                                  G_FILE_CREATE_REPLACE_DESTINATION,
@@ -135,6 +143,7 @@ ide_unsaved_file_unref (IdeUnsavedFile *self)
     {
       g_clear_pointer (&self->temp_path, g_free);
       g_clear_pointer (&self->content, g_bytes_unref);
+      g_clear_pointer (&self->snapshot, ide_buffer_snapshot_unref);
       g_clear_object (&self->file);
       g_slice_free (IdeUnsavedFile, self);
     }
@@ -154,6 +163,14 @@ ide_unsaved_file_get_content (IdeUnsavedFile *self)
   g_return_val_if_fail (self != NULL, NULL);
   g_return_val_if_fail (self->ref_count > 0, NULL);
 
+  if (g_atomic_pointer_get (&self->content) == NULL)
+    {
+      GBytes *content = ide_buffer_snapshot_dup_content (self->snapshot);
+
+      if (!g_atomic_pointer_compare_and_exchange (&self->content, NULL, content))
+        g_bytes_unref (content);
+    }
+
   return self->content;
 }
 
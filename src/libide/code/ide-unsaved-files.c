@@ -31,6 +31,7 @@
 #include <libide-io.h>
 #include <libide-threading.h>
 
+#include "ide-buffer-snapshot.h"
 #include "ide-unsaved-file.h"
 #include "ide-unsaved-file-private.h"
 #include "ide-unsaved-files.h"
@@ -38,9 +39,11 @@
 typedef struct
 {
   gint64           sequence;
-  GFile           *file;
-  GBytes          *content;
-  gchar           *temp_path;
+  gint64           saved_sequence;
+  GFile             *file;
+  GBytes            *content;
+  IdeBufferSnapshot *snapshot;
+  gchar             *temp_path;
   gint             temp_fd;
   IdeUnsavedFiles *backptr;
 } UnsavedFile;
@@ -52,11 +55,13 @@ struct _IdeUnsavedFiles
   GPtrArray *unsaved_files;
   gint64     sequence;
   gchar     *project_id;
+  guint      manifest_dirty : 1;
 };
 
 typedef struct
 {
   GPtrArray *unsaved_files;
+  GString   *manifest;
   gchar     *drafts_directory;
 } AsyncState;
 
@@ -70,9 +75,10 @@ enum {
 
 static GParamSpec *properties [N_PROPS];
 
-static void ide_unsaved_files_update_locked (IdeUnsavedFiles *self,
-                                             GFile           *file,
-                                             GBytes          *content);
+static void ide_unsaved_files_update_locked (IdeUnsavedFiles   *self,
+                                             GFile             *file,
+                                             GBytes            *content,
+                                             IdeBufferSnapshot *snapshot);
 
 static gchar *
 get_drafts_directory (IdeUnsavedFiles *self)
@@ -96,6 +102,8 @@ async_state_free (gpointer data)
     {
       g_clear_pointer (&state->drafts_directory, g_free);
       g_clear_pointer (&state->unsaved_files, g_ptr_array_unref);
+      if (state->manifest != NULL)
+        g_string_free (g_steal_pointer (&state->manifest), TRUE);
       g_slice_free (AsyncState, state);
     }
 }
@@ -111,6 +119,7 @@ unsaved_file_free (gpointer data)
     {
       g_clear_object (&uf->file);
       g_clear_pointer (&uf->content, g_bytes_unref);
+      g_clear_pointer (&uf->snapshot, ide_buffer_snapshot_unref);
 
       if (uf->temp_path != NULL)
         {
@@ -138,7 +147,10 @@ unsaved_file_copy (const UnsavedFile *uf)
 
   copy = g_slice_new0 (UnsavedFile);
   copy->file = g_file_dup (uf->file);
-  copy->content = g_bytes_ref (uf->content);
+  copy->content = uf->content ? g_bytes_ref (uf->content) : NULL;
+  copy->snapshot = uf->snapshot ? ide_buffer_snapshot_ref (uf->snapshot) : NULL;
+  copy->sequence = uf->sequence;
+  copy->temp_fd = -1;
 
   return copy;
 }
@@ -149,11 +161,18 @@ unsaved_file_save (UnsavedFile  *uf,
                    GError      **error)
 {
   g_autoptr(GFile) file = NULL;
+  g_autoptr(GBytes) content = NULL;
 
   g_assert (uf != NULL);
-  g_assert (uf->content != NULL);
+  g_assert (uf->content != NULL || uf->snapshot != NULL);
   g_assert (path != NULL);
 
+  /* Snapshots from buffers are serialized here, off the main thread */
+  if (uf->content != NULL)
+    content = g_bytes_ref (uf->content);
+  else
+    content = ide_buffer_snapshot_dup_content (uf->snapshot);
+
   /*
    * These files can be accessed by third-party programs. So we need to ensure
    * those programs see either the old version of the file or the new version
@@ -164,8 +183,8 @@ unsaved_file_save (UnsavedFile  *uf,
   file = g_file_new_for_path (path);
 
   return g_file_replace_contents (file,
-                                  g_bytes_get_data (uf->content, NULL),
-                                  g_bytes_get_size (uf->content),
+                                  g_bytes_get_data (content, NULL),
+                                  g_bytes_get_size (content),
                                   NULL,
                                   FALSE,
                                   G_FILE_CREATE_REPLACE_DESTINATION,
@@ -198,21 +217,45 @@ get_buffers_dir (IdeContext *context)
   return ide_context_cache_filename (context, "buffers", NULL);
 }
 
+static void
+ide_unsaved_files_mark_saved (IdeUnsavedFiles *self,
+                              GFile           *file,
+                              gint64           sequence)
+{
+  g_assert (IDE_IS_UNSAVED_FILES (self));
+  g_assert (G_IS_FILE (file));
+
+  g_mutex_lock (&self->mutex);
+
+  for (guint i = 0; i < self->unsaved_files->len; i++)
+    {
+      UnsavedFile *uf = g_ptr_array_index (self->unsaved_files, i);
+
+      if (g_file_equal (uf->file, file))
+        {
+          /* The file may have been updated while we were writing */
+          uf->saved_sequence = MAX (uf->saved_sequence, sequence);
+          break;
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+}
+
 static void
 ide_unsaved_files_save_worker (IdeTask      *task,
                                gpointer      source_object,
                                gpointer      task_data,
                                GCancellable *cancellable)
 {
-  g_autofree gchar *manifest_path = NULL;
-  g_autoptr(GString) manifest = NULL;
+  IdeUnsavedFiles *self = source_object;
   g_autoptr(GError) write_error = NULL;
   AsyncState *state = task_data;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_TASK (task));
-  g_assert (IDE_IS_UNSAVED_FILES (source_object));
+  g_assert (IDE_IS_UNSAVED_FILES (self));
   g_assert (state != NULL);
   g_assert (state->drafts_directory != NULL);
   g_assert (state->unsaved_files != NULL);
@@ -220,6 +263,10 @@ ide_unsaved_files_save_worker (IdeTask      *task,
   /* ensure that the directory exists */
   if (g_mkdir_with_parents (state->drafts_directory, 0700) != 0)
     {
+      g_mutex_lock (&self->mutex);
+      self->manifest_dirty |= state->manifest != NULL;
+      g_mutex_unlock (&self->mutex);
+
       ide_task_return_new_error (task,
                                  G_IO_ERROR,
                                  g_io_error_from_errno (errno),
@@ -227,9 +274,10 @@ ide_unsaved_files_save_worker (IdeTask      *task,
       IDE_EXIT;
     }
 
-  manifest = g_string_new (NULL);
-  manifest_path = g_build_filename (state->drafts_directory, "manifest", NULL);
-
+  /* Only drafts which changed since they were last written are in
+   * @unsaved_files, so the amount of I/O here follows the amount of
+   * editing rather than the number of modified buffers.
+   */
   for (guint i = 0; i < state->unsaved_files->len; i++)
     {
       UnsavedFile *uf = g_ptr_array_index (state->unsaved_files, i);
@@ -242,8 +290,6 @@ ide_unsaved_files_save_worker (IdeTask      *task,
 
       IDE_TRACE_MSG ("saving draft for unsaved file \"%s\"", uri);
 
-      g_string_append_printf (manifest, "%s\n", uri);
-
       hash = hash_uri (uri);
       path = g_build_filename (state->drafts_directory, hash, NULL);
 
@@ -252,12 +298,26 @@ ide_unsaved_files_save_worker (IdeTask      *task,
                             /* translators: %s is replaced with the error message */
                             _("Failed to save draft: %s"),
                             error->message);
+      else
+        ide_unsaved_files_mark_saved (self, uf->file, uf->sequence);
     }
 
-  if (!g_file_set_contents (manifest_path, manifest->str, manifest->len, &write_error))
-    ide_task_return_error (task, g_steal_pointer (&write_error));
-  else
-    ide_task_return_boolean (task, TRUE);
+  if (state->manifest != NULL)
+    {
+      g_autofree gchar *manifest_path = g_build_filename (state->drafts_directory, "manifest", NULL);
+
+      if (!g_file_set_contents (manifest_path, state->manifest->str, state->manifest->len, &write_error))
+        {
+          g_mutex_lock (&self->mutex);
+          self->manifest_dirty = TRUE;
+          g_mutex_unlock (&self->mutex);
+
+          ide_task_return_error (task, g_steal_pointer (&write_error));
+          IDE_EXIT;
+        }
+    }
+
+  ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
 }
@@ -303,9 +363,25 @@ ide_unsaved_files_save_async (IdeUnsavedFiles     *self,
   for (guint i = 0; i < self->unsaved_files->len; i++)
     {
       UnsavedFile *uf = g_ptr_array_index (self->unsaved_files, i);
-      UnsavedFile *uf_copy = unsaved_file_copy (uf);
 
-      g_ptr_array_add (state->unsaved_files, uf_copy);
+      if (uf->sequence > uf->saved_sequence)
+        g_ptr_array_add (state->unsaved_files, unsaved_file_copy (uf));
+    }
+
+  /* The manifest only changes when drafts are added or removed */
+  if (self->manifest_dirty)
+    {
+      state->manifest = g_string_new (NULL);
+
+      for (guint i = 0; i < self->unsaved_files->len; i++)
+        {
+          UnsavedFile *uf = g_ptr_array_index (self->unsaved_files, i);
+          g_autofree gchar *uri = g_file_get_uri (uf->file);
+
+          g_string_append_printf (state->manifest, "%s\n", uri);
+        }
+
+      self->manifest_dirty = FALSE;
     }
 
   g_mutex_unlock (&self->mutex);
@@ -314,7 +390,11 @@ ide_unsaved_files_save_async (IdeUnsavedFiles     *self,
   ide_task_set_source_tag (task, ide_unsaved_files_save_async);
   ide_task_set_priority (task, G_PRIORITY_LOW);
   ide_task_set_task_data (task, state, async_state_free);
-  ide_task_run_in_thread (task, ide_unsaved_files_save_worker);
+
+  if (state->unsaved_files->len == 0 && state->manifest == NULL)
+    ide_task_return_boolean (task, TRUE);
+  else
+    ide_task_run_in_thread (task, ide_unsaved_files_save_worker);
 
   IDE_EXIT;
 }
@@ -421,6 +501,7 @@ ide_unsaved_files_restore_worker (IdeTask      *task,
       unsaved = g_slice_new0 (UnsavedFile);
       unsaved->file = g_file_dup (file);
       unsaved->content = g_bytes_new_take (g_steal_pointer (&contents), data_len);
+      unsaved->temp_fd = -1;
 
       g_ptr_array_add (state->unsaved_files, g_steal_pointer (&unsaved));
     }
@@ -472,7 +553,14 @@ ide_unsaved_files_restore_finish (IdeUnsavedFiles  *self,
   for (guint i = 0; i < state->unsaved_files->len; i++)
     {
       const UnsavedFile *uf = g_ptr_array_index (state->unsaved_files, i);
-      ide_unsaved_files_update_locked (self, uf->file, uf->content);
+      UnsavedFile *restored;
+
+      ide_unsaved_files_update_locked (self, uf->file, uf->content, NULL);
+
+      /* The draft on disk already matches, no need to write it again */
+      restored = g_ptr_array_index (self->unsaved_files, self->unsaved_files->len - 1);
+      if (g_file_equal (restored->file, uf->file))
+        restored->saved_sequence = restored->sequence;
     }
 
   g_mutex_unlock (&self->mutex);
@@ -552,6 +640,7 @@ ide_unsaved_files_remove (IdeUnsavedFiles *self,
         {
           ide_unsaved_files_remove_draft_locked (self, file);
           g_ptr_array_remove_index_fast (self->unsaved_files, i);
+          self->manifest_dirty = TRUE;
           break;
         }
     }
@@ -611,9 +700,10 @@ setup_tempfile (IdeContext  *context,
 }
 
 static void
-ide_unsaved_files_update_locked (IdeUnsavedFiles *self,
-                                 GFile           *file,
-                                 GBytes          *content)
+ide_unsaved_files_update_locked (IdeUnsavedFiles   *self,
+                                 GFile             *file,
+                                 GBytes            *content,
+                                 IdeBufferSnapshot *snapshot)
 {
   UnsavedFile *unsaved;
   IdeContext *context;
@@ -622,7 +712,7 @@ ide_unsaved_files_update_locked (IdeUnsavedFiles *self,
   g_return_if_fail (IDE_IS_UNSAVED_FILES (self));
   g_return_if_fail (G_IS_FILE (file));
 
-  if (content == NULL)
+  if (content == NULL && snapshot == NULL)
     {
       ide_unsaved_files_remove (self, file);
       return;
@@ -638,10 +728,12 @@ ide_unsaved_files_update_locked (IdeUnsavedFiles *self,
 
       if (g_file_equal (file, unsaved->file))
         {
-          if (content != unsaved->content)
+          if (content != unsaved->content || snapshot != unsaved->snapshot)
             {
               g_clear_pointer (&unsaved->content, g_bytes_unref);
-              unsaved->content = g_bytes_ref (content);
+              g_clear_pointer (&unsaved->snapshot, ide_buffer_snapshot_unref);
+              unsaved->content = content ? g_bytes_ref (content) : NULL;
+              unsaved->snapshot = snapshot ? ide_buffer_snapshot_ref (snapshot) : NULL;
               unsaved->sequence = self->sequence;
             }
 
@@ -660,11 +752,14 @@ ide_unsaved_files_update_locked (IdeUnsavedFiles *self,
 
   unsaved = g_slice_new0 (UnsavedFile);
   unsaved->file = g_file_dup (file);
-  unsaved->content = g_bytes_ref (content);
+  unsaved->content = content ? g_bytes_ref (content) : NULL;
+  unsaved->snapshot = snapshot ? ide_buffer_snapshot_ref (snapshot) : NULL;
   unsaved->sequence = self->sequence;
   setup_tempfile (context, file, &unsaved->temp_fd, &unsaved->temp_path);
 
   g_ptr_array_add (self->unsaved_files, unsaved);
+
+  self->manifest_dirty = TRUE;
 }
 
 void
@@ -676,7 +771,26 @@ ide_unsaved_files_update (IdeUnsavedFiles *self,
   g_assert (G_IS_FILE (file));
 
   g_mutex_lock (&self->mutex);
-  ide_unsaved_files_update_locked (self, file, content);
+  ide_unsaved_files_update_locked (self, file, content, NULL);
+  g_mutex_unlock (&self->mutex);
+}
+
+/*
+ * Like ide_unsaved_files_update() but takes an immutable snapshot of a
+ * buffer. The snapshot is only serialized when the content is needed,
+ * such as when persisting drafts or by ide_unsaved_file_get_content().
+ */
+void
+_ide_unsaved_files_update_snapshot (IdeUnsavedFiles   *self,
+                                    GFile             *file,
+                                    IdeBufferSnapshot *snapshot)
+{
+  g_assert (IDE_IS_UNSAVED_FILES (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (snapshot != NULL);
+
+  g_mutex_lock (&self->mutex);
+  ide_unsaved_files_update_locked (self, file, NULL, snapshot);
   g_mutex_unlock (&self->mutex);
 }
 
@@ -715,6 +829,7 @@ ide_unsaved_files_to_array (IdeUnsavedFiles *self)
 
       item = _ide_unsaved_file_new (uf->file,
                                     uf->content,
+                                    uf->snapshot,
                                     uf->temp_path,
                                     uf->sequence);
       g_ptr_array_add (ar, g_steal_pointer (&item));
@@ -789,7 +904,7 @@ ide_unsaved_files_get_unsaved_file (IdeUnsavedFiles *self,
 
       if (g_file_equal (uf->file, file))
         {
-          ret = _ide_unsaved_file_new (uf->file, uf->content, uf->temp_path, uf->sequence);
+          ret = _ide_unsaved_file_new (uf->file, uf->content, uf->snapshot, uf->temp_path, uf->sequence);
           break;
         }
     }
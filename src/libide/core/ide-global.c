@@ -242,6 +242,7 @@ ide_gettext (const gchar *message)
 }
 
 static IdeTraceVTable trace_vtable;
+static gboolean trace_marks_enabled;
 
 void
 _ide_trace_init (IdeTraceVTable *vtable)
@@ -249,16 +250,147 @@ _ide_trace_init (IdeTraceVTable *vtable)
   trace_vtable = *vtable;
   if (trace_vtable.load)
     trace_vtable.load ();
+
+  /* Marks are only useful when something is collecting them, which for
+   * sysprof means we were spawned with SYSPROF_TRACE_FD. Checking once
+   * here keeps the disabled case down to a single branch for callers.
+   */
+  trace_marks_enabled = trace_vtable.mark != NULL &&
+                        g_getenv ("SYSPROF_TRACE_FD") != NULL;
 }
 
 void
 _ide_trace_shutdown (void)
 {
+  trace_marks_enabled = FALSE;
   if (trace_vtable.unload)
     trace_vtable.unload ();
   memset (&trace_vtable, 0, sizeof trace_vtable);
 }
 
+/**
+ * ide_trace_is_enabled:
+ *
+ * Checks if marks and counters are being collected by a profiler.
+ *
+ * This is available in release builds and is enabled at runtime when
+ * Builder is started under sysprof.
+ *
+ * Returns: %TRUE if marks are being recorded
+ *
+ * Since: 47
+ */
+gboolean
+ide_trace_is_enabled (void)
+{
+  return trace_marks_enabled;
+}
+
+/**
+ * ide_trace_begin_mark:
+ *
+ * Gets the time to use as the beginning of a mark to be completed
+ * with ide_trace_end_mark().
+ *
+ * Returns: the current monotonic time, or 0 if tracing is disabled
+ *
+ * Since: 47
+ */
+gint64
+ide_trace_begin_mark (void)
+{
+  if G_LIKELY (!trace_marks_enabled)
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+/**
+ * ide_trace_end_mark:
+ * @begin_time_usec: the time from ide_trace_begin_mark()
+ * @group: the group for the mark, such as "Buffers"
+ * @name: the name of the mark
+ * @message_format: (nullable): a printf-style message format
+ * @...: arguments for @message_format
+ *
+ * Records a mark spanning from @begin_time_usec until now.
+ *
+ * Nothing is recorded if @begin_time_usec is 0, which is what
+ * ide_trace_begin_mark() returns when tracing is disabled.
+ *
+ * Since: 47
+ */
+void
+ide_trace_end_mark (gint64       begin_time_usec,
+                    const gchar *group,
+                    const gchar *name,
+                    const gchar *message_format,
+                    ...)
+{
+  g_autofree gchar *message = NULL;
+  gint64 end_time_usec;
+  va_list args;
+
+  if G_LIKELY (!trace_marks_enabled || begin_time_usec == 0)
+    return;
+
+  end_time_usec = g_get_monotonic_time ();
+
+  if (message_format != NULL)
+    {
+      va_start (args, message_format);
+      message = g_strdup_vprintf (message_format, args);
+      va_end (args);
+    }
+
+  trace_vtable.mark (begin_time_usec, end_time_usec, group, name, message ? message : "");
+}
+
+/**
+ * ide_trace_define_counter:
+ * @category: the category for the counter
+ * @name: the name of the counter
+ * @description: a description of the counter
+ *
+ * Defines a new counter which may be updated with ide_trace_set_counter().
+ *
+ * Returns: the counter identifier, or 0 if tracing is disabled
+ *
+ * Since: 47
+ */
+guint
+ide_trace_define_counter (const gchar *category,
+                          const gchar *name,
+                          const gchar *description)
+{
+  g_return_val_if_fail (category != NULL, 0);
+  g_return_val_if_fail (name != NULL, 0);
+
+  if G_LIKELY (!trace_marks_enabled || trace_vtable.define_counter == NULL)
+    return 0;
+
+  return trace_vtable.define_counter (category, name, description ? description : "");
+}
+
+/**
+ * ide_trace_set_counter:
+ * @counter_id: a counter from ide_trace_define_counter()
+ * @value: the new value for the counter
+ *
+ * Records a new value for @counter_id.
+ *
+ * Since: 47
+ */
+void
+ide_trace_set_counter (guint  counter_id,
+                       gint64 value)
+{
+  if G_LIKELY (counter_id == 0 || trace_vtable.set_counter == NULL)
+    return;
+
+  trace_vtable.set_counter (counter_id, value);
+}
+
 #ifdef IDE_ENABLE_TRACE
 void
 ide_trace_function (const gchar *strfunc,
@@ -34,6 +34,16 @@ typedef struct
   void (*log)      (GLogLevelFlags  log_level,
                     const gchar    *domain,
                     const gchar    *message);
+  void (*mark)     (gint64          begin_time_usec,
+                    gint64          end_time_usec,
+                    const gchar    *group,
+                    const gchar    *name,
+                    const gchar    *message);
+  guint (*define_counter) (const gchar *category,
+                           const gchar *name,
+                           const gchar *description);
+  void (*set_counter)     (guint        counter_id,
+                           gint64       value);
 } IdeTraceVTable;
 
 void                 _ide_trace_init     (IdeTraceVTable *vtable);
@@ -43,14 +43,17 @@ typedef struct
 
 } IdeDebuggerAddressMapEntry;
 
-IdeDebuggerAddressMap            *ide_debugger_address_map_new    (void);
-void                              ide_debugger_address_map_insert (IdeDebuggerAddressMap            *self,
-                                                                   const IdeDebuggerAddressMapEntry *entry);
-gboolean                          ide_debugger_address_map_remove (IdeDebuggerAddressMap            *self,
-                                                                   IdeDebuggerAddress                address);
-const IdeDebuggerAddressMapEntry *ide_debugger_address_map_lookup (const IdeDebuggerAddressMap      *self,
-                                                                   IdeDebuggerAddress                address);
-void                              ide_debugger_address_map_free   (IdeDebuggerAddressMap            *self);
+IdeDebuggerAddressMap            *ide_debugger_address_map_new         (void);
+void                              ide_debugger_address_map_insert      (IdeDebuggerAddressMap            *self,
+                                                                        const IdeDebuggerAddressMapEntry *entry);
+void                              ide_debugger_address_map_insert_many (IdeDebuggerAddressMap            *self,
+                                                                        const IdeDebuggerAddressMapEntry *entries,
+                                                                        guint                             n_entries);
+gboolean                          ide_debugger_address_map_remove      (IdeDebuggerAddressMap            *self,
+                                                                        IdeDebuggerAddress                address);
+const IdeDebuggerAddressMapEntry *ide_debugger_address_map_lookup      (const IdeDebuggerAddressMap      *self,
+                                                                        IdeDebuggerAddress                address);
+void                              ide_debugger_address_map_free        (IdeDebuggerAddressMap            *self);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeDebuggerAddressMap, ide_debugger_address_map_free)
 
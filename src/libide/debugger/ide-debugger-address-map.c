@@ -24,61 +24,93 @@
 
 #include "ide-debugger-address-map-private.h"
 
+/*
+ * The entries are kept in a GArray sorted by their start address so that
+ * lookups are a binary search over contiguous memory and never allocate.
+ * Mapped regions within a process do not overlap (just like the lines of
+ * /proc/pid/maps), so the entry containing an address is always the last
+ * one starting at or before it.
+ *
+ * Inserting a single entry costs a memmove() of the tail of the array, so
+ * when many entries arrive at once (such as all the ranges of a library)
+ * use ide_debugger_address_map_insert_many() which sorts only once.
+ */
+
 struct _IdeDebuggerAddressMap
 {
-  GSequence    *seq;
+  GArray       *entries;
   GStringChunk *chunk;
 };
 
-static inline gint
-uint64cmp (guint64 a,
-           guint64 b)
+static gint
+ide_debugger_address_map_entry_compare (gconstpointer a,
+                                        gconstpointer b)
 {
-  if (a < b)
+  const IdeDebuggerAddressMapEntry *entry_a = a;
+  const IdeDebuggerAddressMapEntry *entry_b = b;
+
+  if (entry_a->start < entry_b->start)
     return -1;
-  else if (a > b)
+  else if (entry_a->start > entry_b->start)
     return 1;
   else
     return 0;
 }
 
-static gint
-ide_debugger_address_map_entry_compare (gconstpointer a,
-                                        gconstpointer b,
-                                        gpointer      user_data)
+/*
+ * Returns the index of the first entry with a start address greater than
+ * @address, which is where a new entry starting at @address belongs.
+ */
+static guint
+ide_debugger_address_map_upper_bound (const IdeDebuggerAddressMap *self,
+                                      IdeDebuggerAddress           address)
 {
-  const IdeDebuggerAddressMapEntry *entry_a = a;
-  const IdeDebuggerAddressMapEntry *entry_b = b;
+  const IdeDebuggerAddressMapEntry *entries;
+  guint lo = 0;
+  guint hi;
 
-  return uint64cmp (entry_a->start, entry_b->start);
-}
+  g_assert (self != NULL);
 
-static gint
-ide_debugger_address_map_entry_compare_in_range (gconstpointer a,
-                                                 gconstpointer b,
-                                                 gpointer      user_data)
-{
-  const IdeDebuggerAddressMapEntry *entry_a = a;
-  const IdeDebuggerAddressMapEntry *entry_b = b;
+  entries = (const IdeDebuggerAddressMapEntry *)(gpointer)self->entries->data;
+  hi = self->entries->len;
 
-  /*
-   * entry_b is the needle for the search.
-   * Only entry_b->start is set.
-   */
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
 
-  if ((entry_b->start >= entry_a->start) && (entry_b->start < entry_a->end))
-    return 0;
+      if (entries[mid].start <= address)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
 
-  return uint64cmp (entry_a->start, entry_b->start);
+  return lo;
 }
 
-static void
-ide_debugger_address_map_entry_free (gpointer data)
+static gboolean
+ide_debugger_address_map_find (const IdeDebuggerAddressMap *self,
+                               IdeDebuggerAddress           address,
+                               guint                       *position)
 {
-  IdeDebuggerAddressMapEntry *entry = data;
+  const IdeDebuggerAddressMapEntry *entry;
+  guint pos;
+
+  g_assert (self != NULL);
+  g_assert (position != NULL);
+
+  pos = ide_debugger_address_map_upper_bound (self, address);
+
+  if (pos == 0)
+    return FALSE;
 
-  if (entry != NULL)
-    g_slice_free (IdeDebuggerAddressMapEntry, entry);
+  entry = &g_array_index (self->entries, IdeDebuggerAddressMapEntry, pos - 1);
+
+  if (address < entry->start || address >= entry->end)
+    return FALSE;
+
+  *position = pos - 1;
+
+  return TRUE;
 }
 
 /**
@@ -100,7 +132,7 @@ ide_debugger_address_map_new (void)
   IdeDebuggerAddressMap *ret;
 
   ret = g_slice_new0 (IdeDebuggerAddressMap);
-  ret->seq = g_sequence_new (ide_debugger_address_map_entry_free);
+  ret->entries = g_array_new (FALSE, FALSE, sizeof (IdeDebuggerAddressMapEntry));
   ret->chunk = g_string_chunk_new (4096);
 
   return ret;
@@ -117,7 +149,7 @@ ide_debugger_address_map_free (IdeDebuggerAddressMap *self)
 {
   if (self != NULL)
     {
-      g_sequence_free (self->seq);
+      g_array_unref (self->entries);
       g_string_chunk_free (self->chunk);
       g_slice_free (IdeDebuggerAddressMap, self);
     }
@@ -140,6 +172,7 @@ ide_debugger_address_map_insert (IdeDebuggerAddressMap            *self,
                                  const IdeDebuggerAddressMapEntry *entry)
 {
   IdeDebuggerAddressMapEntry real = { 0 };
+  guint pos;
 
   g_return_if_fail (self != NULL);
   g_return_if_fail (entry != NULL);
@@ -149,10 +182,61 @@ ide_debugger_address_map_insert (IdeDebuggerAddressMap            *self,
   real.end = entry->end;
   real.offset = entry->offset;
 
-  g_sequence_insert_sorted (self->seq,
-                            g_slice_dup (IdeDebuggerAddressMapEntry, &real),
-                            ide_debugger_address_map_entry_compare,
-                            NULL);
+  pos = ide_debugger_address_map_upper_bound (self, real.start);
+  g_array_insert_val (self->entries, pos, real);
+}
+
+/**
+ * ide_debugger_address_map_insert_many:
+ * @self: a #IdeDebuggerAddressMap
+ * @entries: (array length=n_entries): the map entries to insert
+ * @n_entries: the number of elements in @entries
+ *
+ * Inserts all of @entries, which do not need to be sorted.
+ *
+ * This is equivalent to calling ide_debugger_address_map_insert() for
+ * each entry but only sorts the map once, which is considerably faster
+ * when loading the mappings of a whole process.
+ */
+void
+ide_debugger_address_map_insert_many (IdeDebuggerAddressMap            *self,
+                                      const IdeDebuggerAddressMapEntry *entries,
+                                      guint                             n_entries)
+{
+  IdeDebuggerAddressMapEntry last = { 0 };
+  gboolean needs_sort = FALSE;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (entries != NULL || n_entries == 0);
+
+  if (n_entries == 0)
+    return;
+
+  if (self->entries->len > 0)
+    last = g_array_index (self->entries, IdeDebuggerAddressMapEntry, self->entries->len - 1);
+
+  g_array_set_size (self->entries, self->entries->len + n_entries);
+
+  for (guint i = 0; i < n_entries; i++)
+    {
+      IdeDebuggerAddressMapEntry *real;
+
+      real = &g_array_index (self->entries,
+                             IdeDebuggerAddressMapEntry,
+                             self->entries->len - n_entries + i);
+      real->filename = g_string_chunk_insert_const (self->chunk, entries[i].filename);
+      real->start = entries[i].start;
+      real->end = entries[i].end;
+      real->offset = entries[i].offset;
+
+      /* Usually the entries arrive in order and we can skip sorting */
+      if (real->start < last.start)
+        needs_sort = TRUE;
+      last = *real;
+    }
+
+  if (needs_sort)
+    g_array_sort (self->entries, ide_debugger_address_map_entry_compare);
 }
 
 /**
@@ -170,20 +254,14 @@ const IdeDebuggerAddressMapEntry *
 ide_debugger_address_map_lookup (const IdeDebuggerAddressMap *self,
                                  guint64                      address)
 {
-  IdeDebuggerAddressMapEntry entry = { NULL, 0, address, 0 };
-  GSequenceIter *iter;
+  guint pos;
 
   g_return_val_if_fail (self != NULL, NULL);
 
-  iter = g_sequence_lookup (self->seq,
-                            &entry,
-                            ide_debugger_address_map_entry_compare_in_range,
-                            NULL);
-
-  if (iter == NULL || g_sequence_iter_is_end (iter))
+  if (!ide_debugger_address_map_find (self, address, &pos))
     return NULL;
 
-  return g_sequence_get (iter);
+  return &g_array_index (self->entries, IdeDebuggerAddressMapEntry, pos);
 }
 
 /**
@@ -197,20 +275,14 @@ gboolean
 ide_debugger_address_map_remove (IdeDebuggerAddressMap *self,
                                  IdeDebuggerAddress     address)
 {
-  IdeDebuggerAddressMapEntry entry = { NULL, 0, address, 0 };
-  GSequenceIter *iter;
+  guint pos;
 
   g_return_val_if_fail (self != NULL, FALSE);
 
-  iter = g_sequence_lookup (self->seq,
-                            &entry,
-                            ide_debugger_address_map_entry_compare_in_range,
-                            NULL);
-
-  if (iter == NULL || g_sequence_iter_is_end (iter))
+  if (!ide_debugger_address_map_find (self, address, &pos))
     return FALSE;
 
-  g_sequence_remove (iter);
+  g_array_remove_index (self->entries, pos);
 
   return TRUE;
 }
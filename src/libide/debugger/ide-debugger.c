@@ -359,30 +359,38 @@ ide_debugger_real_library_loaded (IdeDebugger        *self,
                                   IdeDebuggerLibrary *library)
 {
   IdeDebuggerPrivate *priv = ide_debugger_get_instance_private (self);
-  IdeDebuggerAddressMapEntry entry = { 0 };
+  g_autoptr(GArray) entries = NULL;
+  const gchar *filename;
   GPtrArray *ranges;
 
   g_assert (IDE_IS_DEBUGGER (self));
   g_assert (IDE_IS_DEBUGGER_LIBRARY (library));
 
-  /* We don't yet have this information */
-  entry.offset = 0;
-  entry.filename = ide_debugger_library_get_target_name (library);
-
   ranges = ide_debugger_library_get_ranges (library);
 
-  if (ranges != NULL)
+  if (ranges == NULL || ranges->len == 0)
+    return;
+
+  filename = ide_debugger_library_get_target_name (library);
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (IdeDebuggerAddressMapEntry), ranges->len);
+
+  for (guint i = 0; i < ranges->len; i++)
     {
-      for (guint i = 0; i < ranges->len; i++)
-        {
-          const IdeDebuggerAddressRange *range = g_ptr_array_index (ranges, i);
+      const IdeDebuggerAddressRange *range = g_ptr_array_index (ranges, i);
+      IdeDebuggerAddressMapEntry entry = { 0 };
 
-          entry.start = range->from;
-          entry.end = range->to;
+      /* We don't yet have the offset information */
+      entry.filename = filename;
+      entry.offset = 0;
+      entry.start = range->from;
+      entry.end = range->to;
 
-          ide_debugger_address_map_insert (priv->map, &entry);
-        }
+      g_array_append_val (entries, entry);
     }
+
+  ide_debugger_address_map_insert_many (priv->map,
+                                        (const IdeDebuggerAddressMapEntry *)(gpointer)entries->data,
+                                        entries->len);
 }
 
 static void
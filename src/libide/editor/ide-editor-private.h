@@ -20,10 +20,12 @@
 
 #pragma once
 
-#include <glib.h>
+#include <libide-gui.h>
 
 G_BEGIN_DECLS
 
-void _ide_editor_init (void);
+void     _ide_editor_init             (void);
+void     _ide_editor_mark_placeholder (IdePage *page);
+gboolean _ide_editor_is_placeholder   (IdePage *page);
 
 G_END_DECLS
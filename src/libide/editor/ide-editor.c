@@ -26,6 +26,7 @@
 
 #include "ide-editor.h"
 #include "ide-editor-page.h"
+#include "ide-editor-private.h"
 
 typedef struct _Focus
 {
@@ -96,11 +97,52 @@ focus_free (Focus *focus)
   g_atomic_rc_box_release_full (focus, focus_finalize);
 }
 
+/**
+ * _ide_editor_mark_placeholder:
+ * @page: an #IdePage
+ *
+ * Marks @page as standing in for an editor page of the file returned by
+ * ide_page_get_file_or_directory() which has not been loaded yet, such as
+ * pages restored from the session.
+ *
+ * Focusing that file replaces @page instead of opening another page.
+ */
+void
+_ide_editor_mark_placeholder (IdePage *page)
+{
+  g_return_if_fail (IDE_IS_PAGE (page));
+
+  g_object_set_data (G_OBJECT (page), "IDE_EDITOR_PLACEHOLDER", GINT_TO_POINTER (TRUE));
+}
+
+gboolean
+_ide_editor_is_placeholder (IdePage *page)
+{
+  g_return_val_if_fail (IDE_IS_PAGE (page), FALSE);
+
+  return GPOINTER_TO_INT (g_object_get_data (G_OBJECT (page), "IDE_EDITOR_PLACEHOLDER"));
+}
+
+static gboolean
+is_placeholder_for_file (PanelWidget *widget,
+                         GFile       *file)
+{
+  g_autoptr(GFile) page_file = NULL;
+
+  if (!IDE_IS_PAGE (widget) || !_ide_editor_is_placeholder (IDE_PAGE (widget)))
+    return FALSE;
+
+  page_file = ide_page_get_file_or_directory (IDE_PAGE (widget));
+
+  return page_file != NULL && g_file_equal (page_file, file);
+}
+
 static void
 focus_complete (Focus        *focus,
                 const GError *error)
 {
   IdeEditorPage *page = NULL;
+  IdePage *placeholder = NULL;
   PanelFrame *frame;
 
   IDE_ENTRY;
@@ -144,12 +186,27 @@ focus_complete (Focus        *focus,
                   break;
                 }
             }
+          else if (placeholder == NULL && is_placeholder_for_file (child, focus->file))
+            {
+              placeholder = IDE_PAGE (child);
+            }
         }
     }
 
   g_assert (!page || IDE_IS_EDITOR_PAGE (page));
 
-  if (page == NULL)
+  if (page == NULL && placeholder != NULL)
+    {
+      g_autoptr(PanelPosition) position = ide_page_get_position (placeholder);
+
+      /* Load the page in place of the placeholder rather than next to it */
+      page = IDE_EDITOR_PAGE (ide_editor_page_new (focus->buffer));
+      ide_workspace_add_page (focus->workspace,
+                              IDE_PAGE (page),
+                              position ? position : focus->position);
+      ide_page_destroy (placeholder);
+    }
+  else if (page == NULL)
     {
       page = IDE_EDITOR_PAGE (ide_editor_page_new (focus->buffer));
       ide_workspace_add_page (focus->workspace, IDE_PAGE (page), focus->position);
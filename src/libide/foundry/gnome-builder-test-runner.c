@@ -0,0 +1,153 @@
+/* gnome-builder-test-runner.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Runs a unit test and reports the peak resident set size of the test
+ * once it has been reaped. The test is usually started through wrappers
+ * (shells, "env", container tools), so the usage returned by wait4() is
+ * used which includes every descendant that was waited for, rather than
+ * just the process we spawned.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+static GPid child_pid;
+static int opt_stats_fd = -1;
+static char **opt_argv;
+static GOptionEntry options[] = {
+  { "stats-fd", 0, 0, G_OPTION_ARG_INT, &opt_stats_fd, "FD to write the peak RSS (in KiB) of the test to" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &opt_argv, NULL, "COMMAND" },
+  { NULL }
+};
+static const int proxied_signals[] = {
+  SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGUSR1, SIGUSR2,
+};
+
+static void
+proxy_signal (int signum)
+{
+  /* Only async-signal-safe calls are allowed here */
+  if (child_pid > 0)
+    kill (child_pid, signum);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  struct sigaction sa;
+  struct rusage usage;
+  GPid parent_pid;
+  int status;
+
+  context = g_option_context_new ("-- COMMAND");
+  g_option_context_add_main_entries (context, options, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_argv == NULL || opt_argv[0] == NULL)
+    {
+      g_printerr ("No command to run\n");
+      return EXIT_FAILURE;
+    }
+
+  parent_pid = getpid ();
+
+  if ((child_pid = fork ()) == -1)
+    {
+      g_printerr ("Failed to fork: %s\n", g_strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  if (child_pid == 0)
+    {
+      /* Don't leave the test running if we are killed when the run is
+       * cancelled, which is done with SIGKILL.
+       */
+      prctl (PR_SET_PDEATHSIG, SIGKILL);
+      if (getppid () != parent_pid)
+        _exit (EXIT_FAILURE);
+
+      if (opt_stats_fd > STDERR_FILENO)
+        close (opt_stats_fd);
+
+      execvp (opt_argv[0], opt_argv);
+      g_printerr ("Failed to execute %s: %s\n", opt_argv[0], g_strerror (errno));
+      _exit (127);
+    }
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = proxy_signal;
+  sigemptyset (&sa.sa_mask);
+
+  for (guint i = 0; i < G_N_ELEMENTS (proxied_signals); i++)
+    sigaction (proxied_signals[i], &sa, NULL);
+
+  memset (&usage, 0, sizeof usage);
+
+  while (wait4 (child_pid, &status, 0, &usage) == -1)
+    {
+      if (errno != EINTR)
+        {
+          g_printerr ("Failed to wait for %s: %s\n", opt_argv[0], g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (opt_stats_fd > STDERR_FILENO)
+    {
+      char str[32];
+      int len;
+
+      /* ru_maxrss is in KiB on Linux */
+      len = g_snprintf (str, sizeof str, "%ld\n", usage.ru_maxrss);
+      if (write (opt_stats_fd, str, len) != len)
+        g_printerr ("Failed to write stats: %s\n", g_strerror (errno));
+      close (opt_stats_fd);
+    }
+
+  if (WIFSIGNALED (status))
+    {
+      /* Exit the same way so that the caller sees the signal */
+      signal (WTERMSIG (status), SIG_DFL);
+      raise (WTERMSIG (status));
+      return 128 + WTERMSIG (status);
+    }
+
+  return WEXITSTATUS (status);
+}
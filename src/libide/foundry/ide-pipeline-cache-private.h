@@ -0,0 +1,44 @@
+/* ide-pipeline-cache-private.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdePipelineCache IdePipelineCache;
+
+IdePipelineCache *ide_pipeline_cache_new    (const char       *path);
+void              ide_pipeline_cache_free   (IdePipelineCache *self);
+gboolean          ide_pipeline_cache_lookup (IdePipelineCache *self,
+                                             const char       *key,
+                                             GHashTable       *fingerprint,
+                                             char            **reason);
+void              ide_pipeline_cache_store  (IdePipelineCache *self,
+                                             const char       *key,
+                                             GHashTable       *fingerprint);
+void              ide_pipeline_cache_forget (IdePipelineCache *self,
+                                             const char       *key);
+void              ide_pipeline_cache_clear  (IdePipelineCache *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdePipelineCache, ide_pipeline_cache_free)
+
+G_END_DECLS
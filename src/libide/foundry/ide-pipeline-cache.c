@@ -0,0 +1,233 @@
+/* ide-pipeline-cache.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-pipeline-cache"
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "ide-pipeline-cache-private.h"
+
+/*
+ * IdePipelineCache persists the fingerprint of each stage after it has
+ * completed successfully. A fingerprint is a set of named digests (such
+ * as the command line, environment or the contents of an input file) so
+ * that when a stage must be run again we can tell which of them changed.
+ *
+ * The cache is a GKeyFile stored in the project cache directory with a
+ * group per stage. It is loaded lazily and written back after every
+ * change since that only happens when a stage completes.
+ */
+
+struct _IdePipelineCache
+{
+  char     *path;
+  GKeyFile *key_file;
+};
+
+IdePipelineCache *
+ide_pipeline_cache_new (const char *path)
+{
+  IdePipelineCache *self;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  self = g_slice_new0 (IdePipelineCache);
+  self->path = g_strdup (path);
+
+  return self;
+}
+
+void
+ide_pipeline_cache_free (IdePipelineCache *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->path, g_free);
+      g_clear_pointer (&self->key_file, g_key_file_unref);
+      g_slice_free (IdePipelineCache, self);
+    }
+}
+
+static GKeyFile *
+ide_pipeline_cache_load (IdePipelineCache *self)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_assert (self != NULL);
+
+  if (self->key_file != NULL)
+    return self->key_file;
+
+  self->key_file = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (self->key_file, self->path, G_KEY_FILE_NONE, &error) &&
+      !g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+    g_debug ("Ignoring pipeline cache %s: %s", self->path, error->message);
+
+  return self->key_file;
+}
+
+static void
+ide_pipeline_cache_save (IdePipelineCache *self)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *dir = NULL;
+
+  g_assert (self != NULL);
+  g_assert (self->key_file != NULL);
+
+  dir = g_path_get_dirname (self->path);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0)
+    {
+      int errsv = errno;
+      g_debug ("Failed to create %s: %s", dir, g_strerror (errsv));
+      return;
+    }
+
+  if (!g_key_file_save_to_file (self->key_file, self->path, &error))
+    g_debug ("Failed to save pipeline cache %s: %s", self->path, error->message);
+}
+
+/**
+ * ide_pipeline_cache_lookup:
+ * @self: a #IdePipelineCache
+ * @key: the key for the stage
+ * @fingerprint: (element-type utf8 utf8): the current fingerprint
+ * @reason: (out) (optional): a location for why the fingerprint differs
+ *
+ * Checks if @fingerprint matches what was stored for @key.
+ *
+ * Returns: %TRUE if the fingerprint is unchanged; otherwise %FALSE and
+ *   @reason is set to a description of what changed.
+ */
+gboolean
+ide_pipeline_cache_lookup (IdePipelineCache  *self,
+                           const char        *key,
+                           GHashTable        *fingerprint,
+                           char             **reason)
+{
+  g_autoptr(GString) changed = NULL;
+  g_auto(GStrv) stored = NULL;
+  GHashTableIter iter;
+  const char *name;
+  const char *digest;
+  GKeyFile *key_file;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+  g_return_val_if_fail (fingerprint != NULL, FALSE);
+
+  if (reason != NULL)
+    *reason = NULL;
+
+  key_file = ide_pipeline_cache_load (self);
+
+  if (!g_key_file_has_group (key_file, key))
+    {
+      if (reason != NULL)
+        *reason = g_strdup ("it has not completed before");
+      return FALSE;
+    }
+
+  changed = g_string_new (NULL);
+
+  g_hash_table_iter_init (&iter, fingerprint);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, (gpointer *)&digest))
+    {
+      g_autofree char *previous = g_key_file_get_string (key_file, key, name, NULL);
+
+      if (g_strcmp0 (previous, digest) != 0)
+        g_string_append_printf (changed, "%s%s", changed->len ? ", " : "", name);
+    }
+
+  if ((stored = g_key_file_get_keys (key_file, key, NULL, NULL)))
+    {
+      for (guint i = 0; stored[i]; i++)
+        {
+          if (!g_hash_table_contains (fingerprint, stored[i]))
+            g_string_append_printf (changed, "%s%s", changed->len ? ", " : "", stored[i]);
+        }
+    }
+
+  if (changed->len == 0)
+    return TRUE;
+
+  if (reason != NULL)
+    *reason = g_strdup_printf ("%s changed", changed->str);
+
+  return FALSE;
+}
+
+void
+ide_pipeline_cache_store (IdePipelineCache *self,
+                          const char       *key,
+                          GHashTable       *fingerprint)
+{
+  GHashTableIter iter;
+  const char *name;
+  const char *digest;
+  GKeyFile *key_file;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (fingerprint != NULL);
+
+  key_file = ide_pipeline_cache_load (self);
+
+  g_key_file_remove_group (key_file, key, NULL);
+
+  g_hash_table_iter_init (&iter, fingerprint);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, (gpointer *)&digest))
+    g_key_file_set_string (key_file, key, name, digest);
+
+  ide_pipeline_cache_save (self);
+}
+
+void
+ide_pipeline_cache_forget (IdePipelineCache *self,
+                           const char       *key)
+{
+  GKeyFile *key_file;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (key != NULL);
+
+  key_file = ide_pipeline_cache_load (self);
+
+  if (g_key_file_remove_group (key_file, key, NULL))
+    ide_pipeline_cache_save (self);
+}
+
+void
+ide_pipeline_cache_clear (IdePipelineCache *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_clear_pointer (&self->key_file, g_key_file_unref);
+  self->key_file = g_key_file_new ();
+
+  if (g_unlink (self->path) != 0 && errno != ENOENT)
+    g_debug ("Failed to remove pipeline cache %s: %s",
+             self->path, g_strerror (errno));
+}
@@ -27,7 +27,16 @@ G_BEGIN_DECLS
 
 void         _ide_pipeline_attach_pty_to_run_context (IdePipeline      *self,
                                                       IdeRunContext    *run_context);
+gboolean     _ide_pipeline_may_use_pty               (IdePipeline      *self,
+                                                      IdePipelineStage *stage);
 const guint *_ide_pipeline_addin_get_stages          (IdePipelineAddin *self,
                                                       guint            *n_stages);
+gboolean     _ide_pipeline_check_fingerprint         (IdePipeline      *self,
+                                                      IdePipelineStage *stage,
+                                                      GHashTable       *fingerprint,
+                                                      char            **reason);
+void         _ide_pipeline_store_fingerprint         (IdePipeline      *self,
+                                                      IdePipelineStage *stage,
+                                                      GHashTable       *fingerprint);
 
 G_END_DECLS
@@ -102,6 +102,7 @@ ide_pipeline_stage_command_build_async (IdePipelineStage    *stage,
   g_autoptr(IdeRunContext) run_context = NULL;
   g_autoptr(IdeTask) task = NULL;
   g_autoptr(GError) error = NULL;
+  gboolean use_pty;
 
   IDE_ENTRY;
 
@@ -124,7 +125,10 @@ ide_pipeline_stage_command_build_async (IdePipelineStage    *stage,
   if (run_context == NULL)
     run_context = ide_pipeline_create_run_context (pipeline, priv->build_command);
 
-  if (priv->stdout_path == NULL)
+  use_pty = priv->stdout_path == NULL &&
+            _ide_pipeline_may_use_pty (pipeline, IDE_PIPELINE_STAGE (self));
+
+  if (use_pty)
     _ide_pipeline_attach_pty_to_run_context (pipeline, run_context);
 
   if (!(launcher = ide_run_context_end (run_context, &error)))
@@ -132,10 +136,18 @@ ide_pipeline_stage_command_build_async (IdePipelineStage    *stage,
 
   if (priv->stdout_path != NULL)
     ide_subprocess_launcher_set_stdout_file_path (launcher, priv->stdout_path);
+  else if (!use_pty)
+    ide_subprocess_launcher_set_flags (launcher,
+                                       G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                       G_SUBPROCESS_FLAGS_STDERR_PIPE);
 
   if (!(subprocess = ide_subprocess_launcher_spawn (launcher, NULL, &error)))
     IDE_GOTO (handle_error);
 
+  /* A concurrent sibling owns the Pty, so log through the pipes instead */
+  if (priv->stdout_path == NULL && !use_pty)
+    ide_pipeline_stage_log_subprocess (IDE_PIPELINE_STAGE (self), subprocess);
+
   ide_subprocess_send_signal_upon_cancel (subprocess, cancellable, SIGKILL);
 
   ide_subprocess_wait_check_async (subprocess,
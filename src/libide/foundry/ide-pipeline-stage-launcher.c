@@ -27,7 +27,7 @@
 #include "ide-subprocess-launcher-private.h"
 
 #include "ide-build-log.h"
-#include "ide-pipeline.h"
+#include "ide-pipeline-private.h"
 #include "ide-pipeline-stage-launcher.h"
 
 typedef struct
@@ -185,11 +185,12 @@ ide_pipeline_stage_launcher_run (IdePipelineStage      *stage,
                                  gpointer               user_data)
 {
   IdePipelineStageLauncher *self = (IdePipelineStageLauncher *)stage;
-  G_GNUC_UNUSED IdePipelineStageLauncherPrivate *priv = ide_pipeline_stage_launcher_get_instance_private (self);
+  IdePipelineStageLauncherPrivate *priv = ide_pipeline_stage_launcher_get_instance_private (self);
   g_autoptr(IdeTask) task = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(IdeSubprocess) subprocess = NULL;
   GSubprocessFlags flags;
+  gboolean use_pty;
 
   IDE_ENTRY;
 
@@ -215,7 +216,10 @@ ide_pipeline_stage_launcher_run (IdePipelineStage      *stage,
       IDE_EXIT;
     }
 
-  if (priv->use_pty)
+  /* A concurrent sibling may own the Pty, in which case we use pipes */
+  use_pty = priv->use_pty && _ide_pipeline_may_use_pty (pipeline, stage);
+
+  if (use_pty)
     {
       ide_pipeline_attach_pty (pipeline, launcher);
     }
@@ -244,7 +248,7 @@ ide_pipeline_stage_launcher_run (IdePipelineStage      *stage,
       ide_subprocess_launcher_set_flags (launcher, flags);
     }
 
-  if (priv->use_pty)
+  if (use_pty)
     {
       g_autofree gchar *command = pretty_print_args (launcher);
 
@@ -262,7 +266,7 @@ ide_pipeline_stage_launcher_run (IdePipelineStage      *stage,
       IDE_EXIT;
     }
 
-  if (!priv->use_pty)
+  if (!use_pty)
     ide_pipeline_stage_log_subprocess (IDE_PIPELINE_STAGE (self), subprocess);
 
   IDE_TRACE_MSG ("Waiting for process %s to complete, %s exit status",
@@ -28,9 +28,15 @@
 
 #include "ide-marshal.h"
 
+#include "ide-config.h"
 #include "ide-pipeline.h"
+#include "ide-pipeline-private.h"
 #include "ide-pipeline-stage.h"
+#include "ide-pipeline-stage-command.h"
 #include "ide-pipeline-stage-private.h"
+#include "ide-run-command.h"
+#include "ide-runtime.h"
+#include "ide-toolchain.h"
 
 typedef struct
 {
@@ -41,6 +47,9 @@ typedef struct
   IdeTask             *queued_build;
   gchar               *stdout_path;
   GOutputStream       *stdout_stream;
+  GPtrArray           *inputs;
+  GPtrArray           *outputs;
+  GHashTable          *fingerprint;
   gint                 n_pause;
   IdePipelinePhase     phase;
   guint                completed : 1;
@@ -48,6 +57,7 @@ typedef struct
   guint                transient : 1;
   guint                check_stdout : 1;
   guint                active : 1;
+  guint                concurrent : 1;
 } IdePipelineStagePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (IdePipelineStage, ide_pipeline_stage, IDE_TYPE_OBJECT)
@@ -57,6 +67,7 @@ enum {
   PROP_ACTIVE,
   PROP_CHECK_STDOUT,
   PROP_COMPLETED,
+  PROP_CONCURRENT,
   PROP_DISABLED,
   PROP_NAME,
   PROP_STDOUT_PATH,
@@ -262,6 +273,9 @@ ide_pipeline_stage_finalize (GObject *object)
   g_clear_pointer (&priv->stdout_path, g_free);
   g_clear_object (&priv->queued_build);
   g_clear_object (&priv->stdout_stream);
+  g_clear_pointer (&priv->inputs, g_ptr_array_unref);
+  g_clear_pointer (&priv->outputs, g_ptr_array_unref);
+  g_clear_pointer (&priv->fingerprint, g_hash_table_unref);
 
   G_OBJECT_CLASS (ide_pipeline_stage_parent_class)->finalize (object);
 }
@@ -288,6 +302,10 @@ ide_pipeline_stage_get_property (GObject    *object,
       g_value_set_boolean (value, ide_pipeline_stage_get_completed (self));
       break;
 
+    case PROP_CONCURRENT:
+      g_value_set_boolean (value, ide_pipeline_stage_get_concurrent (self));
+      break;
+
     case PROP_DISABLED:
       g_value_set_boolean (value, ide_pipeline_stage_get_disabled (self));
       break;
@@ -331,6 +349,10 @@ ide_pipeline_stage_set_property (GObject      *object,
       ide_pipeline_stage_set_completed (self, g_value_get_boolean (value));
       break;
 
+    case PROP_CONCURRENT:
+      ide_pipeline_stage_set_concurrent (self, g_value_get_boolean (value));
+      break;
+
     case PROP_DISABLED:
       ide_pipeline_stage_set_disabled (self, g_value_get_boolean (value));
       break;
@@ -412,6 +434,31 @@ ide_pipeline_stage_class_init (IdePipelineStageClass *klass)
                           FALSE,
                           (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * IdePipelineStage:concurrent:
+   *
+   * If the stage may run alongside other concurrent stages of the
+   * same phase.
+   *
+   * Set this for stages which neither consume the results of, nor
+   * produce anything needed by, their siblings within the phase such
+   * as fetching sources. The pipeline will start such stages together,
+   * limited by the configured parallelism. Stages which are not
+   * concurrent wait for all previous stages to complete and run by
+   * themselves.
+   *
+   * No stage is concurrent by default, as only the code attaching a
+   * stage knows what else shares its phase.
+   *
+   * Since: 47
+   */
+  properties [PROP_CONCURRENT] =
+    g_param_spec_boolean ("concurrent",
+                          "Concurrent",
+                          "If the stage may run alongside other stages of the phase",
+                          FALSE,
+                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   /**
    * IdePipelineStage:disabled:
    *
@@ -895,6 +942,8 @@ ide_pipeline_stage_unpause_build_cb (GObject      *object,
                                      gpointer      user_data)
 {
   IdePipelineStage *self = (IdePipelineStage *)object;
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+  g_autoptr(GHashTable) fingerprint = g_steal_pointer (&priv->fingerprint);
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
 
@@ -902,9 +951,206 @@ ide_pipeline_stage_unpause_build_cb (GObject      *object,
   g_assert (IDE_IS_TASK (task));
 
   if (!ide_pipeline_stage_build_finish (self, result, &error))
-    ide_task_return_error (task, g_steal_pointer (&error));
-  else
-    ide_task_return_boolean (task, TRUE);
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  /* Remember what we built from so the next run may be skipped */
+  if (fingerprint != NULL)
+    _ide_pipeline_store_fingerprint (ide_task_get_task_data (task), self, fingerprint);
+
+  ide_task_return_boolean (task, TRUE);
+}
+
+static const char *
+ide_pipeline_stage_get_display_name (IdePipelineStage *self)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  if (!ide_str_empty0 (priv->name))
+    return priv->name;
+
+  return G_OBJECT_TYPE_NAME (self);
+}
+
+static void
+fingerprint_take (GHashTable *fingerprint,
+                  char       *name,
+                  GChecksum  *checksum)
+{
+  g_hash_table_insert (fingerprint, name, g_strdup (g_checksum_get_string (checksum)));
+  g_checksum_free (checksum);
+}
+
+static void
+checksum_update_strv (GChecksum          *checksum,
+                      const char * const *strv)
+{
+  if (strv == NULL)
+    return;
+
+  /* Include the terminating \0 so that ["a","b"] differs from ["ab"] */
+  for (guint i = 0; strv[i]; i++)
+    g_checksum_update (checksum, (const guchar *)strv[i], strlen (strv[i]) + 1);
+}
+
+static char *
+fingerprint_input_name (const char *path)
+{
+  char *name = g_strdup_printf ("input:%s", path);
+
+  /* Keep the name usable as a GKeyFile key */
+  for (char *c = name; *c; c++)
+    {
+      if (*c == '=' || *c == '[' || *c == ']' || *c == '\n')
+        *c = '_';
+    }
+
+  return name;
+}
+
+/*
+ * Creates the fingerprint of the stage, which is a set of digests
+ * for everything that may affect the result of the stage. This is
+ * only done when the stage has declared input files as otherwise
+ * we cannot know what it depends on.
+ *
+ * Input files are expected to be small (manifests, project files)
+ * since they are hashed from the main thread.
+ */
+static GHashTable *
+ide_pipeline_stage_dup_fingerprint (IdePipelineStage *self,
+                                    IdePipeline      *pipeline)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+  g_autoptr(GHashTable) fingerprint = NULL;
+  IdeToolchain *toolchain;
+  IdeRuntime *runtime;
+  IdeConfig *config;
+  GChecksum *checksum;
+
+  g_assert (IDE_IS_PIPELINE_STAGE (self));
+  g_assert (IDE_IS_PIPELINE (pipeline));
+
+  if (priv->inputs == NULL || priv->inputs->len == 0)
+    return NULL;
+
+  fingerprint = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  if ((runtime = ide_pipeline_get_runtime (pipeline)))
+    g_checksum_update (checksum, (const guchar *)ide_runtime_get_id (runtime), -1);
+  g_checksum_update (checksum, (const guchar *)"", 1);
+  if ((toolchain = ide_pipeline_get_toolchain (pipeline)))
+    g_checksum_update (checksum, (const guchar *)ide_toolchain_get_id (toolchain), -1);
+  fingerprint_take (fingerprint, g_strdup ("runtime"), checksum);
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  if ((config = ide_pipeline_get_config (pipeline)))
+    {
+      g_auto(GStrv) environ = ide_config_get_environ (config);
+      checksum_update_strv (checksum, (const char * const *)environ);
+    }
+  fingerprint_take (fingerprint, g_strdup ("environment"), checksum);
+
+  if (IDE_IS_PIPELINE_STAGE_COMMAND (self))
+    {
+      g_autoptr(IdeRunCommand) command = NULL;
+
+      g_object_get (self, "build-command", &command, NULL);
+
+      checksum = g_checksum_new (G_CHECKSUM_SHA256);
+      if (command != NULL)
+        {
+          checksum_update_strv (checksum, ide_run_command_get_argv (command));
+          g_checksum_update (checksum, (const guchar *)"", 1);
+          checksum_update_strv (checksum, ide_run_command_get_environ (command));
+          g_checksum_update (checksum, (const guchar *)"", 1);
+          if (ide_run_command_get_cwd (command))
+            g_checksum_update (checksum, (const guchar *)ide_run_command_get_cwd (command), -1);
+        }
+      fingerprint_take (fingerprint, g_strdup ("command"), checksum);
+    }
+
+  for (guint i = 0; i < priv->inputs->len; i++)
+    {
+      const char *path = g_ptr_array_index (priv->inputs, i);
+      g_autofree char *contents = NULL;
+      gsize len;
+
+      checksum = g_checksum_new (G_CHECKSUM_SHA256);
+      if (g_file_get_contents (path, &contents, &len, NULL))
+        g_checksum_update (checksum, (const guchar *)contents, len);
+      else
+        g_checksum_update (checksum, (const guchar *)"missing", -1);
+      fingerprint_take (fingerprint, fingerprint_input_name (path), checksum);
+    }
+
+  return g_steal_pointer (&fingerprint);
+}
+
+static const char *
+ide_pipeline_stage_find_missing_output (IdePipelineStage *self)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  if (priv->outputs == NULL)
+    return NULL;
+
+  for (guint i = 0; i < priv->outputs->len; i++)
+    {
+      const char *path = g_ptr_array_index (priv->outputs, i);
+
+      if (!g_file_test (path, G_FILE_TEST_EXISTS))
+        return path;
+    }
+
+  return NULL;
+}
+
+/*
+ * Checks the fingerprint of the stage against the pipeline cache,
+ * logging why the stage must run when it cannot be skipped.
+ *
+ * Returns: %TRUE if the stage may be skipped.
+ */
+static gboolean
+ide_pipeline_stage_check_fingerprint (IdePipelineStage *self,
+                                      IdePipeline      *pipeline)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+  g_autoptr(GHashTable) fingerprint = NULL;
+  g_autofree char *reason = NULL;
+  g_autofree char *message = NULL;
+  const char *missing;
+
+  g_assert (IDE_IS_PIPELINE_STAGE (self));
+  g_assert (IDE_IS_PIPELINE (pipeline));
+
+  g_clear_pointer (&priv->fingerprint, g_hash_table_unref);
+
+  if (!(fingerprint = ide_pipeline_stage_dup_fingerprint (self, pipeline)))
+    return FALSE;
+
+  if ((missing = ide_pipeline_stage_find_missing_output (self)))
+    reason = g_strdup_printf ("“%s” does not exist", missing);
+  else if (_ide_pipeline_check_fingerprint (pipeline, self, fingerprint, &reason))
+    {
+      message = g_strdup_printf ("Skipping “%s” as its inputs are unchanged",
+                                 ide_pipeline_stage_get_display_name (self));
+      ide_pipeline_stage_log (self, IDE_BUILD_LOG_STDOUT, message, -1);
+      return TRUE;
+    }
+
+  message = g_strdup_printf ("Running “%s” because %s",
+                             ide_pipeline_stage_get_display_name (self),
+                             reason ? reason : "it has not completed before");
+  ide_pipeline_stage_log (self, IDE_BUILD_LOG_STDOUT, message, -1);
+
+  priv->fingerprint = g_steal_pointer (&fingerprint);
+
+  return FALSE;
 }
 
 void
@@ -931,6 +1177,13 @@ ide_pipeline_stage_unpause (IdePipelineStage *self)
           return;
         }
 
+      if (ide_pipeline_stage_check_fingerprint (self, pipeline))
+        {
+          ide_pipeline_stage_set_completed (self, TRUE);
+          ide_task_return_boolean (task, TRUE);
+          return;
+        }
+
       ide_pipeline_stage_build_async (self,
                                       pipeline,
                                       cancellable,
@@ -1125,6 +1378,113 @@ ide_pipeline_stage_set_disabled (IdePipelineStage *self,
     }
 }
 
+/**
+ * ide_pipeline_stage_add_input_file:
+ * @self: a #IdePipelineStage
+ * @path: the path to a file the stage reads
+ *
+ * Declares that the result of the stage depends on the contents of @path.
+ *
+ * Once a stage has declared inputs, the pipeline records a fingerprint of
+ * the inputs, command line, environment and runtime after the stage
+ * completes. When the stage would otherwise need to run again, such as
+ * after restarting Builder, it is skipped if the fingerprint is unchanged
+ * and all outputs declared with ide_pipeline_stage_add_output_file() exist.
+ *
+ * The contents of @path are hashed from the main thread, so this should
+ * only be used for small files like project manifests.
+ *
+ * Since: 47
+ */
+void
+ide_pipeline_stage_add_input_file (IdePipelineStage *self,
+                                   const char       *path)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (self));
+  g_return_if_fail (path != NULL);
+
+  if (priv->inputs == NULL)
+    priv->inputs = g_ptr_array_new_with_free_func (g_free);
+
+  g_ptr_array_add (priv->inputs, g_strdup (path));
+}
+
+/**
+ * ide_pipeline_stage_add_output_file:
+ * @self: a #IdePipelineStage
+ * @path: the path to a file or directory the stage creates
+ *
+ * Declares that the stage creates @path. A stage will not be skipped
+ * based on its fingerprint unless all of its outputs exist.
+ *
+ * See ide_pipeline_stage_add_input_file().
+ *
+ * Since: 47
+ */
+void
+ide_pipeline_stage_add_output_file (IdePipelineStage *self,
+                                    const char       *path)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (self));
+  g_return_if_fail (path != NULL);
+
+  if (priv->outputs == NULL)
+    priv->outputs = g_ptr_array_new_with_free_func (g_free);
+
+  g_ptr_array_add (priv->outputs, g_strdup (path));
+}
+
+/**
+ * ide_pipeline_stage_get_concurrent:
+ * @self: a #IdePipelineStage
+ *
+ * Gets the #IdePipelineStage:concurrent property.
+ *
+ * Returns: %TRUE if the stage may run alongside other stages
+ *   of the same phase.
+ *
+ * Since: 47
+ */
+gboolean
+ide_pipeline_stage_get_concurrent (IdePipelineStage *self)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_PIPELINE_STAGE (self), FALSE);
+
+  return priv->concurrent;
+}
+
+/**
+ * ide_pipeline_stage_set_concurrent:
+ * @self: a #IdePipelineStage
+ * @concurrent: if the stage may run concurrently
+ *
+ * Sets the #IdePipelineStage:concurrent property.
+ *
+ * Since: 47
+ */
+void
+ide_pipeline_stage_set_concurrent (IdePipelineStage *self,
+                                   gboolean          concurrent)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (self));
+
+  concurrent = !!concurrent;
+
+  if (concurrent != priv->concurrent)
+    {
+      priv->concurrent = concurrent;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_CONCURRENT]);
+    }
+}
+
 gboolean
 ide_pipeline_stage_get_check_stdout (IdePipelineStage *self)
 {
@@ -163,6 +163,17 @@ gboolean     ide_pipeline_stage_get_check_stdout (IdePipelineStage     *self);
 IDE_AVAILABLE_IN_ALL
 void         ide_pipeline_stage_set_check_stdout (IdePipelineStage     *self,
                                                   gboolean              check_stdout);
+IDE_AVAILABLE_IN_47
+void         ide_pipeline_stage_add_input_file   (IdePipelineStage     *self,
+                                                  const char           *path);
+IDE_AVAILABLE_IN_47
+void         ide_pipeline_stage_add_output_file  (IdePipelineStage     *self,
+                                                  const char           *path);
+IDE_AVAILABLE_IN_47
+gboolean     ide_pipeline_stage_get_concurrent   (IdePipelineStage     *self);
+IDE_AVAILABLE_IN_47
+void         ide_pipeline_stage_set_concurrent   (IdePipelineStage     *self,
+                                                  gboolean              concurrent);
 IDE_AVAILABLE_IN_ALL
 gboolean     ide_pipeline_stage_get_transient    (IdePipelineStage     *self);
 IDE_AVAILABLE_IN_ALL
@@ -39,6 +39,7 @@
 #include "ide-marshal.h"
 
 #include "ide-build-log-private.h"
+#include "ide-pipeline-cache-private.h"
 #include "ide-config.h"
 #include "ide-deploy-strategy.h"
 #include "ide-pipeline-addin.h"
@@ -105,6 +106,14 @@ G_DEFINE_QUARK (ide_build_error, ide_build_error)
  * ide_pipeline_stage_set_transient(). This may be useful to perform operations
  * such as an "export tarball" stage which should only run once as determined
  * by the user requesting a "make dist" style operation.
+ *
+ * Stages which do not depend on their siblings within a phase, such as
+ * those fetching sources, may be marked with
+ * ide_pipeline_stage_set_concurrent(). Consecutive concurrent stages of the
+ * same phase are started together, up to the parallelism of the
+ * configuration, while any other stage waits for them to complete. Only
+ * one of them writes to the Pty, the others are logged through pipes
+ * with their lines prefixed by the stage name.
  */
 
 typedef struct
@@ -127,6 +136,38 @@ typedef struct
   GRegex *regex;
 } ErrorFormat;
 
+typedef struct
+{
+  gchar *current_dir;
+  gchar *top_dir;
+} ErrfmtDirs;
+
+typedef struct
+{
+  IdePipelineStage *stage;
+  IdeTask          *task;
+  gint64            begin_time;
+
+  /*
+   * Directory tracking for diagnostics found in this stage's log, so
+   * that "Entering directory" lines from a concurrent sibling do not
+   * change how our relative paths are resolved.
+   */
+  ErrfmtDirs        errfmt_dirs;
+
+  /*
+   * Only one running stage may write to the Pty at a time, the others
+   * log through pipes so their output can be told apart.
+   */
+  guint             owns_pty : 1;
+} StageRun;
+
+typedef struct
+{
+  IdePipeline      *self;
+  IdePipelineStage *stage;
+} LogObserver;
+
 struct _IdePipeline
 {
   IdeObject parent_instance;
@@ -197,6 +238,13 @@ struct _IdePipeline
    */
   IdeBuildLog *log;
 
+  /*
+   * The fingerprints of stages which declared their inputs, so that they
+   * may be skipped when nothing changed since they last completed. This
+   * is stored in the builddir and created lazily.
+   */
+  IdePipelineCache *cache;
+
   /*
    * These are our builddir/srcdir paths. Useful for building paths
    * by addins. We try to create a new builddir that will be unique
@@ -224,10 +272,9 @@ struct _IdePipeline
    * languages can also register these so they show up in the build
    * errors panel.
    */
-  GArray *errfmts;
-  gchar  *errfmt_current_dir;
-  gchar  *errfmt_top_dir;
-  guint   errfmt_seqnum;
+  GArray     *errfmts;
+  ErrfmtDirs  errfmt_dirs;
+  guint       errfmt_seqnum;
 
   /*
    * The VtePty is used to connect to a VteTerminal. It's basically just a
@@ -251,10 +298,22 @@ struct _IdePipeline
 
   /*
    * No reference to the current stage. It is only available during
-   * the asynchronous execution of the stage.
+   * the asynchronous execution of the stage. When stages run
+   * concurrently, this is the one which owns the Pty.
    */
   IdePipelineStage *current_stage;
 
+  /*
+   * The StageRun of every stage which is currently executing. They all
+   * belong to @running_phase and the pipeline will not advance past that
+   * phase (or start a non-concurrent stage) until they have completed.
+   * The first error from any of them is kept in @running_error so that
+   * it can be propagated once the rest have finished.
+   */
+  GPtrArray *running;
+  IdePipelinePhase running_phase;
+  GError *running_error;
+
   /*
    * The index of our current PipelineEntry. This should start at -1
    * to indicate that no stage is currently active.
@@ -545,6 +604,7 @@ parse_severity (const gchar *str)
 
 static IdeDiagnostic *
 create_diagnostic (IdePipeline *self,
+                   ErrfmtDirs  *dirs,
                    GMatchInfo  *match_info)
 {
   g_autofree gchar *filename = NULL;
@@ -562,6 +622,7 @@ create_diagnostic (IdePipeline *self,
   } parsed = { 0 };
 
   g_assert (IDE_IS_PIPELINE (self));
+  g_assert (dirs != NULL);
   g_assert (match_info != NULL);
 
   message = g_match_info_fetch_named (match_info, "message");
@@ -609,13 +670,13 @@ create_diagnostic (IdePipeline *self,
     {
       gchar *path;
 
-      if (self->errfmt_current_dir != NULL)
+      if (dirs->current_dir != NULL)
         {
-          const gchar *basedir = self->errfmt_current_dir;
+          const gchar *basedir = dirs->current_dir;
 
-          if (g_str_has_prefix (basedir, self->errfmt_top_dir))
+          if (g_str_has_prefix (basedir, dirs->top_dir))
             {
-              basedir += strlen (self->errfmt_top_dir);
+              basedir += strlen (dirs->top_dir);
               if (*basedir == G_DIR_SEPARATOR)
                 basedir++;
             }
@@ -655,14 +716,14 @@ create_diagnostic (IdePipeline *self,
 }
 
 static gboolean
-extract_directory_change (IdePipeline  *self,
+extract_directory_change (ErrfmtDirs   *dirs,
                           const guint8 *data,
                           gsize         len)
 {
   g_autofree gchar *dir = NULL;
   const guint8 *begin;
 
-  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (dirs != NULL);
 
   if (len == 0)
     return FALSE;
@@ -684,15 +745,15 @@ extract_directory_change (IdePipeline  *self,
 
   if (g_utf8_validate (dir, len, NULL))
     {
-      g_free (self->errfmt_current_dir);
+      g_free (dirs->current_dir);
 
       if (len == 0)
-        self->errfmt_current_dir = g_strdup (self->errfmt_top_dir);
+        dirs->current_dir = g_strdup (dirs->top_dir);
       else
-        self->errfmt_current_dir = g_strndup (dir, len);
+        dirs->current_dir = g_strndup (dir, len);
 
-      if (self->errfmt_top_dir == NULL)
-        self->errfmt_top_dir = g_strdup (self->errfmt_current_dir);
+      if (dirs->top_dir == NULL)
+        dirs->top_dir = g_strdup (dirs->current_dir);
 
       return TRUE;
     }
@@ -705,6 +766,7 @@ extract_directory_change (IdePipeline  *self,
 
 static void
 extract_diagnostics (IdePipeline  *self,
+                     ErrfmtDirs   *dirs,
                      const guint8 *data,
                      gsize         len)
 {
@@ -714,6 +776,7 @@ extract_diagnostics (IdePipeline  *self,
   gsize line_len;
 
   g_assert (IDE_IS_PIPELINE (self));
+  g_assert (dirs != NULL);
   g_assert (data != NULL);
 
   if (len == 0 || self->errfmts->len == 0)
@@ -736,7 +799,7 @@ extract_diagnostics (IdePipeline  *self,
 
   while (NULL != (line = ide_line_reader_next (&reader, &line_len)))
     {
-      if (extract_directory_change (self, (const guint8 *)line, line_len))
+      if (extract_directory_change (dirs, (const guint8 *)line, line_len))
         continue;
 
       for (guint i = 0; i < self->errfmts->len; i++)
@@ -746,7 +809,7 @@ extract_diagnostics (IdePipeline  *self,
 
           if (g_regex_match_full (errfmt->regex, line, line_len, 0, 0, &match_info, NULL))
             {
-              g_autoptr(IdeDiagnostic) diagnostic = create_diagnostic (self, match_info);
+              g_autoptr(IdeDiagnostic) diagnostic = create_diagnostic (self, dirs, match_info);
 
               if (diagnostic != NULL)
                 {
@@ -758,13 +821,64 @@ extract_diagnostics (IdePipeline  *self,
     }
 }
 
+static void
+errfmt_dirs_clear (ErrfmtDirs *dirs)
+{
+  g_clear_pointer (&dirs->current_dir, g_free);
+  g_clear_pointer (&dirs->top_dir, g_free);
+}
+
+static StageRun *
+stage_run_new (IdePipelineStage *stage,
+               IdeTask          *task)
+{
+  StageRun *run;
+
+  run = g_slice_new0 (StageRun);
+  run->stage = g_object_ref (stage);
+  run->task = g_object_ref (task);
+  run->begin_time = ide_trace_begin_mark ();
+
+  return run;
+}
+
+static void
+stage_run_free (StageRun *run)
+{
+  errfmt_dirs_clear (&run->errfmt_dirs);
+  g_clear_object (&run->task);
+  g_clear_object (&run->stage);
+  g_slice_free (StageRun, run);
+}
+
+static StageRun *
+ide_pipeline_find_run (IdePipeline      *self,
+                       IdePipelineStage *stage)
+{
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_PIPELINE_STAGE (stage));
+
+  for (guint i = 0; i < self->running->len; i++)
+    {
+      StageRun *run = g_ptr_array_index (self->running, i);
+
+      if (run->stage == stage)
+        return run;
+    }
+
+  return NULL;
+}
+
 static void
 ide_pipeline_log_observer (IdeBuildLogStream  stream,
                            const gchar       *message,
                            gssize             message_len,
                            gpointer           user_data)
 {
-  IdePipeline *self = user_data;
+  LogObserver *observer = user_data;
+  IdePipeline *self = observer->self;
+  ErrfmtDirs *dirs = &self->errfmt_dirs;
+  g_autofree gchar *prefixed = NULL;
 
   g_assert (stream == IDE_BUILD_LOG_STDOUT || stream == IDE_BUILD_LOG_STDERR);
   g_assert (IDE_IS_PIPELINE (self));
@@ -773,10 +887,38 @@ ide_pipeline_log_observer (IdeBuildLogStream  stream,
   if (message_len < 0)
     message_len = strlen (message);
 
+  /* Stages may log from a thread, the run state is only safe to touch
+   * from the main thread.
+   */
+  if (IDE_IS_MAIN_THREAD () && self->running != NULL)
+    {
+      StageRun *run = ide_pipeline_find_run (self, observer->stage);
+
+      /* The Pty owner shares the directory tracking with the Pty */
+      if (run != NULL && !run->owns_pty)
+        dirs = &run->errfmt_dirs;
+
+      /* Prefix lines while stages run together so the log stays readable */
+      if (run != NULL && self->running->len > 1)
+        {
+          const gchar *name = ide_pipeline_stage_get_name (observer->stage);
+
+          if (ide_str_empty0 (name))
+            name = G_OBJECT_TYPE_NAME (observer->stage);
+
+          prefixed = g_strdup_printf ("[%s] %.*s", name, (int)message_len, message);
+        }
+    }
+
   if (self->log != NULL)
-    ide_build_log_observer (stream, message, message_len, self->log);
+    {
+      if (prefixed != NULL)
+        ide_build_log_observer (stream, prefixed, -1, self->log);
+      else
+        ide_build_log_observer (stream, message, message_len, self->log);
+    }
 
-  extract_diagnostics (self, (const guint8 *)message, message_len);
+  extract_diagnostics (self, dirs, (const guint8 *)message, message_len);
 }
 
 static void
@@ -794,7 +936,7 @@ ide_pipeline_intercept_pty_consumer_cb (const IdePtyIntercept     *intercept,
   g_assert (len > 0);
   g_assert (IDE_IS_PIPELINE (self));
 
-  extract_diagnostics (self, data, len);
+  extract_diagnostics (self, &self->errfmt_dirs, data, len);
 }
 
 static void
@@ -1051,6 +1193,103 @@ ide_pipeline_extension_removed (IdeExtensionSetAdapter *set,
   IDE_EXIT;
 }
 
+static IdePipelineCache *
+ide_pipeline_get_cache (IdePipeline *self)
+{
+  g_assert (IDE_IS_PIPELINE (self));
+
+  if (self->cache == NULL)
+    {
+      IdeContext *context = ide_object_get_context (IDE_OBJECT (self));
+      g_autofree char *checksum = NULL;
+      g_autofree char *name = NULL;
+      g_autofree char *path = NULL;
+
+      /* Keep the cache out of the build directory, which is the source
+       * directory for in-tree builds. There is one per build directory
+       * since that is where the outputs of the stages live.
+       */
+      checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, self->builddir, -1);
+      name = g_strdup_printf ("%s.ini", checksum);
+      path = ide_context_cache_filename (context, "pipeline", name, NULL);
+
+      self->cache = ide_pipeline_cache_new (path);
+    }
+
+  return self->cache;
+}
+
+static char *
+ide_pipeline_get_fingerprint_key (IdePipeline      *self,
+                                  IdePipelineStage *stage)
+{
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_PIPELINE_STAGE (stage));
+
+  /* Stage ids are not stable across sessions, so identify the stage
+   * by what it is and where it is attached instead.
+   */
+  for (guint i = 0; i < self->pipeline->len; i++)
+    {
+      const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, i);
+
+      if (entry->stage == stage)
+        return g_strdup_printf ("%s:%x:%d:%s",
+                                G_OBJECT_TYPE_NAME (stage),
+                                entry->phase,
+                                entry->priority,
+                                ide_pipeline_stage_get_name (stage) ?: "");
+    }
+
+  return NULL;
+}
+
+gboolean
+_ide_pipeline_check_fingerprint (IdePipeline       *self,
+                                 IdePipelineStage  *stage,
+                                 GHashTable        *fingerprint,
+                                 char             **reason)
+{
+  g_autofree char *key = NULL;
+
+  g_return_val_if_fail (IDE_IS_PIPELINE (self), FALSE);
+  g_return_val_if_fail (IDE_IS_PIPELINE_STAGE (stage), FALSE);
+  g_return_val_if_fail (fingerprint != NULL, FALSE);
+
+  if (!(key = ide_pipeline_get_fingerprint_key (self, stage)))
+    return FALSE;
+
+  return ide_pipeline_cache_lookup (ide_pipeline_get_cache (self), key, fingerprint, reason);
+}
+
+void
+_ide_pipeline_store_fingerprint (IdePipeline      *self,
+                                 IdePipelineStage *stage,
+                                 GHashTable       *fingerprint)
+{
+  g_autofree char *key = NULL;
+
+  g_return_if_fail (IDE_IS_PIPELINE (self));
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (stage));
+  g_return_if_fail (fingerprint != NULL);
+
+  if ((key = ide_pipeline_get_fingerprint_key (self, stage)))
+    ide_pipeline_cache_store (ide_pipeline_get_cache (self), key, fingerprint);
+}
+
+static void
+ide_pipeline_forget_fingerprint (IdePipeline      *self,
+                                 IdePipelineStage *stage)
+{
+  g_autofree char *key = NULL;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_PIPELINE_STAGE (stage));
+
+  if ((key = ide_pipeline_get_fingerprint_key (self, stage)))
+    ide_pipeline_cache_forget (ide_pipeline_get_cache (self), key);
+}
+
 static void
 ide_pipeline_always_incomplete (IdePipelineStage *stage,
                                 IdePipeline      *pipeline,
@@ -1504,9 +1743,11 @@ ide_pipeline_finalize (GObject *object)
   g_clear_pointer (&self->srcdir, g_free);
   g_clear_pointer (&self->builddir, g_free);
   g_clear_pointer (&self->errfmts, g_array_unref);
-  g_clear_pointer (&self->errfmt_top_dir, g_free);
-  g_clear_pointer (&self->errfmt_current_dir, g_free);
+  errfmt_dirs_clear (&self->errfmt_dirs);
   g_clear_pointer (&self->chained_bindings, g_ptr_array_unref);
+  g_clear_pointer (&self->running, g_ptr_array_unref);
+  g_clear_pointer (&self->cache, ide_pipeline_cache_free);
+  g_clear_error (&self->running_error);
   g_clear_pointer (&self->host_triplet, ide_triplet_unref);
 
   G_OBJECT_CLASS (ide_pipeline_parent_class)->finalize (object);
@@ -1900,18 +2141,41 @@ ide_pipeline_init (IdePipeline *self)
 
   self->chained_bindings = g_ptr_array_new_with_free_func ((GDestroyNotify)chained_binding_clear);
 
+  self->running = g_ptr_array_new_with_free_func ((GDestroyNotify)stage_run_free);
+
   self->log = ide_build_log_new ();
 }
 
+static guint
+ide_pipeline_get_max_concurrent (IdePipeline *self)
+{
+  int parallel;
+
+  g_assert (IDE_IS_PIPELINE (self));
+
+  /* Concurrent stages share the same job budget as the build tool. They
+   * never overlap with the non-concurrent stage running the build tool
+   * so that the budget is not exceeded.
+   */
+  parallel = self->config ? ide_config_get_parallelism (self->config) : -1;
+
+  if (parallel <= 0)
+    parallel = g_get_num_processors ();
+
+  return MAX (1, parallel);
+}
+
 static void
 ide_pipeline_stage_build_cb (GObject      *object,
                              GAsyncResult *result,
                              gpointer      user_data)
 {
   IdePipelineStage *stage = (IdePipelineStage *)object;
-  IdePipeline *self;
-  g_autoptr(IdeTask) task = user_data;
+  StageRun *run = user_data;
+  g_autoptr(IdeTask) task = g_steal_pointer (&run->task);
   g_autoptr(GError) error = NULL;
+  IdePipeline *self;
+  gboolean success;
 
   IDE_ENTRY;
 
@@ -1922,21 +2186,38 @@ ide_pipeline_stage_build_cb (GObject      *object,
   self = ide_task_get_source_object (task);
   g_assert (IDE_IS_PIPELINE (self));
 
-  if (!_ide_pipeline_stage_build_with_query_finish (stage, result, &error))
+  ide_trace_end_mark (run->begin_time, "Pipeline", "Stage", "%s: %s",
+                      build_phase_nick (ide_pipeline_get_phase (self)),
+                      G_OBJECT_TYPE_NAME (stage));
+
+  if (!(success = _ide_pipeline_stage_build_with_query_finish (stage, result, &error)))
     {
       g_debug ("stage of type %s failed: %s",
                G_OBJECT_TYPE_NAME (stage),
                error->message);
       self->failed = TRUE;
-      ide_task_return_error (task, g_steal_pointer (&error));
+      if (self->running_error == NULL)
+        self->running_error = g_steal_pointer (&error);
     }
 
-  ide_pipeline_stage_set_completed (stage, !self->failed);
+  ide_pipeline_stage_set_completed (stage, success);
 
   g_clear_pointer (&self->chained_bindings, g_ptr_array_unref);
   self->chained_bindings = g_ptr_array_new_with_free_func (g_object_unref);
 
-  if (self->failed == FALSE)
+  if (self->current_stage == stage)
+    self->current_stage = NULL;
+
+  /* Concurrent siblings still hold a reference to @task, so let the last
+   * one to complete continue (or fail) the pipeline.
+   */
+  g_ptr_array_remove (self->running, run);
+  if (self->running->len > 0 && self->failed)
+    IDE_EXIT;
+
+  if (self->running_error != NULL)
+    ide_task_return_error (task, g_steal_pointer (&self->running_error));
+  else
     ide_pipeline_tick_build (self, task);
 
   IDE_EXIT;
@@ -2038,8 +2319,6 @@ ide_pipeline_tick_build (IdePipeline *self,
   g_assert (IDE_IS_PIPELINE (self));
   g_assert (IDE_IS_TASK (task));
 
-  self->current_stage = NULL;
-
   td = ide_task_get_task_data (task);
   cancellable = ide_task_get_cancellable (task);
 
@@ -2049,21 +2328,26 @@ ide_pipeline_tick_build (IdePipeline *self,
   g_assert (td->phase != IDE_PIPELINE_PHASE_NONE);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  /* Clear any message from the previous stage */
-  _ide_pipeline_set_message (self, NULL);
+  /* Nothing is running, so no stage owns the Pty */
+  if (self->running->len == 0)
+    self->current_stage = NULL;
 
-  /* Clear cached directory enter/leave tracking */
-  g_clear_pointer (&self->errfmt_current_dir, g_free);
-  g_clear_pointer (&self->errfmt_top_dir, g_free);
-
-  /* Short circuit now if the task was cancelled */
-  if (ide_task_return_error_if_cancelled (task))
-    IDE_EXIT;
+  /* Short circuit now if the task was cancelled, but wait for any
+   * concurrent stages to complete first. They will fail with the
+   * cancellation too and continue from ide_pipeline_stage_build_cb().
+   */
+  if (g_cancellable_is_cancelled (cancellable))
+    {
+      if (self->running->len == 0)
+        ide_task_return_error_if_cancelled (task);
+      IDE_EXIT;
+    }
 
   /* If we can skip walking the pipeline, go ahead and do so now. */
   if (!ide_pipeline_request_phase (self, td->phase))
     {
-      ide_task_return_boolean (task, TRUE);
+      if (self->running->len == 0)
+        ide_task_return_boolean (task, TRUE);
       IDE_EXIT;
     }
 
@@ -2073,14 +2357,36 @@ ide_pipeline_tick_build (IdePipeline *self,
    * delaying pipeline execution. _ide_pipeline_stage_build_with_query_async()
    * will handle all of that for us, in cause they call ide_pipeline_stage_pause()
    * during the ::query callback.
+   *
+   * Stages marked as concurrent are started together as long as they share
+   * the same phase and we have not exhausted the job budget. Anything else
+   * waits for the running stages to drain before it is started.
    */
-  for (self->position++; (guint)self->position < self->pipeline->len; self->position++)
+  while ((guint)(self->position + 1) < self->pipeline->len)
     {
-      const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, self->position);
+      const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, self->position + 1);
+      g_autoptr(IdePipelineStage) stage = NULL;
+      GPtrArray *targets = NULL;
+      gboolean concurrent;
+      StageRun *run;
 
       g_assert (entry->stage != NULL);
       g_assert (IDE_IS_PIPELINE_STAGE (entry->stage));
 
+      concurrent = ide_pipeline_stage_get_concurrent (entry->stage);
+
+      if (self->running->len > 0)
+        {
+          if (entry->phase != self->running_phase)
+            IDE_EXIT;
+
+          if (!ide_pipeline_stage_get_disabled (entry->stage) &&
+              (!concurrent || self->running->len >= ide_pipeline_get_max_concurrent (self)))
+            IDE_EXIT;
+        }
+
+      self->position++;
+
       /* Complete any tasks that are waiting for this to complete */
       complete_queued_before_phase (self, entry->phase);
 
@@ -2088,38 +2394,71 @@ ide_pipeline_tick_build (IdePipeline *self,
       if (ide_pipeline_stage_get_disabled (entry->stage))
         continue;
 
-      if ((entry->phase & IDE_PIPELINE_PHASE_MASK) & self->requested_mask)
-        {
-          GPtrArray *targets = NULL;
-
-          self->current_stage = entry->stage;
+      if (((entry->phase & IDE_PIPELINE_PHASE_MASK) & self->requested_mask) == 0)
+        continue;
 
-          if (td->type == TASK_BUILD)
-            targets = td->build.targets;
-          else if (td->type == TASK_REBUILD)
-            targets = td->rebuild.targets;
+      if (td->type == TASK_BUILD)
+        targets = td->build.targets;
+      else if (td->type == TASK_REBUILD)
+        targets = td->rebuild.targets;
 
+      if (!concurrent)
+        {
           /*
            * We might be able to chain upcoming stages to this stage and avoid
            * duplicate work. This will also advance self->position based on
            * how many stages were chained.
            */
           ide_pipeline_try_chain (self, entry->stage, self->position + 1);
+        }
 
-          _ide_pipeline_stage_build_with_query_async (entry->stage,
-                                                      self,
-                                                      targets,
-                                                      cancellable,
-                                                      ide_pipeline_stage_build_cb,
-                                                      g_object_ref (task));
+      IDE_TRACE_MSG ("Starting %sstage %s",
+                     concurrent ? "concurrent " : "",
+                     G_OBJECT_TYPE_NAME (entry->stage));
 
-          g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_MESSAGE]);
-          g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PHASE]);
+      stage = g_object_ref (entry->stage);
+      run = stage_run_new (stage, task);
 
-          IDE_EXIT;
+      /* Hand the Pty to this stage if no running sibling has it */
+      if (self->current_stage == NULL)
+        {
+          run->owns_pty = TRUE;
+          self->current_stage = stage;
+
+          /* Clear any message and directory tracking from the previous owner */
+          _ide_pipeline_set_message (self, NULL);
+          errfmt_dirs_clear (&self->errfmt_dirs);
         }
+
+      self->running_phase = entry->phase;
+      g_ptr_array_add (self->running, run);
+
+      _ide_pipeline_stage_build_with_query_async (stage,
+                                                  self,
+                                                  targets,
+                                                  cancellable,
+                                                  ide_pipeline_stage_build_cb,
+                                                  run);
+
+      /* @entry may be invalid if the stage modified the pipeline */
+      if (concurrent)
+        continue;
+
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_MESSAGE]);
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PHASE]);
+
+      IDE_EXIT;
+    }
+
+  if (self->running->len > 0)
+    {
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_MESSAGE]);
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PHASE]);
+      IDE_EXIT;
     }
 
+  self->position = self->pipeline->len;
+
   ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
@@ -2452,6 +2791,7 @@ ide_pipeline_do_flush (gpointer data)
   self->busy = TRUE;
   self->failed = FALSE;
   self->position = -1;
+  g_clear_error (&self->running_error);
   self->in_clean = (task_data->type == TASK_CLEAN);
 
   /* Clear any lingering message */
@@ -2579,6 +2919,7 @@ ide_pipeline_attach (IdePipeline      *self,
       if ((phase & IDE_PIPELINE_PHASE_MASK) == value->value)
         {
           PipelineEntry entry = { 0 };
+          LogObserver *observer;
 
           _ide_pipeline_stage_set_phase (stage, phase);
 
@@ -2595,10 +2936,15 @@ ide_pipeline_attach (IdePipeline      *self,
 
           ret = entry.id;
 
+          observer = g_new0 (LogObserver, 1);
+          observer->self = self;
+          observer->stage = stage;
+
+          /* The observer is cleared with the entry, before @self is gone */
           ide_pipeline_stage_set_log_observer (stage,
-                                            ide_pipeline_log_observer,
-                                            self,
-                                            NULL);
+                                               ide_pipeline_log_observer,
+                                               observer,
+                                               g_free);
 
           /*
            * We need to emit items-changed for the newly added entry, but we relied
@@ -2962,7 +3308,10 @@ ide_pipeline_invalidate_phase (IdePipeline      *self,
       const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, i);
 
       if ((entry->phase & IDE_PIPELINE_PHASE_MASK) & phases)
-        ide_pipeline_stage_set_completed (entry->stage, FALSE);
+        {
+          ide_pipeline_stage_set_completed (entry->stage, FALSE);
+          ide_pipeline_forget_fingerprint (self, entry->stage);
+        }
     }
 }
 
@@ -3123,6 +3472,29 @@ _ide_pipeline_attach_pty_to_run_context (IdePipeline   *self,
   IDE_EXIT;
 }
 
+/*
+ * Output of concurrent stages would be interleaved on the Pty, and the
+ * directory tracking used to resolve diagnostics would mix up their
+ * "Entering directory" lines. So only one running stage owns the Pty
+ * while the others log through pipes, which the log observer tracks
+ * per stage.
+ */
+gboolean
+_ide_pipeline_may_use_pty (IdePipeline      *self,
+                           IdePipelineStage *stage)
+{
+  StageRun *run;
+
+  g_return_val_if_fail (IDE_IS_PIPELINE (self), FALSE);
+  g_return_val_if_fail (IDE_IS_PIPELINE_STAGE (stage), FALSE);
+
+  /* Stages run outside of a build, such as cleaning, run alone */
+  if (!(run = ide_pipeline_find_run (self, stage)))
+    return TRUE;
+
+  return run->owns_pty;
+}
+
 /**
  * ide_pipeline_attach_pty:
  * @self: an #IdePipeline
@@ -3341,6 +3713,27 @@ ide_pipeline_get_message (IdePipeline *self)
 
   g_return_val_if_fail (IDE_IS_PIPELINE (self), NULL);
 
+  /* Name every stage while several are running together */
+  if (self->busy && self->running->len > 1)
+    {
+      g_autoptr(GPtrArray) names = g_ptr_array_new ();
+
+      for (guint i = 0; i < self->running->len; i++)
+        {
+          const StageRun *run = g_ptr_array_index (self->running, i);
+          const gchar *name = ide_pipeline_stage_get_name (run->stage);
+
+          if (!ide_str_empty0 (name))
+            g_ptr_array_add (names, (gchar *)name);
+        }
+
+      if (names->len > 0)
+        {
+          g_ptr_array_add (names, NULL);
+          return g_strjoinv (", ", (gchar **)names->pdata);
+        }
+    }
+
   /* Use any message the Pty has given us while building. */
   if (self->busy && self->message != NULL)
     return g_strdup (self->message);
@@ -3490,6 +3883,8 @@ ide_pipeline_clean_cb (GObject      *object,
       IDE_EXIT;
     }
 
+  ide_pipeline_forget_fingerprint (self, stage);
+
   g_ptr_array_remove_index (stages, stages->len - 1);
 
   ide_pipeline_tick_clean (self, task);
@@ -3825,6 +4220,9 @@ ide_pipeline_tick_rebuild (IdePipeline *self,
       ide_pipeline_stage_set_completed (entry->stage, FALSE);
     }
 
+  /* Nothing may be skipped after a rebuild, even for in-tree builds */
+  ide_pipeline_cache_clear (ide_pipeline_get_cache (self));
+
   cancellable = ide_task_get_cancellable (task);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
@@ -4154,6 +4552,7 @@ _ide_pipeline_set_runtime (IdePipeline *self,
       build_system = ide_build_system_from_context (context);
 
       g_clear_pointer (&self->builddir, g_free);
+      g_clear_pointer (&self->cache, ide_pipeline_cache_free);
       self->builddir = ide_build_system_get_builddir (build_system, self);
     }
 }
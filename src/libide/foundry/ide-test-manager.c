@@ -22,6 +22,8 @@
 
 #include "config.h"
 
+#include <errno.h>
+
 #include <libpeas.h>
 
 #include <libide-core.h>
@@ -31,6 +33,7 @@
 #include "ide-marshal.h"
 
 #include "ide-build-manager.h"
+#include "ide-config.h"
 #include "ide-foundry-compat.h"
 #include "ide-pipeline.h"
 #include "ide-pty.h"
@@ -41,8 +44,6 @@
 #include "ide-test-manager.h"
 #include "ide-test-private.h"
 
-#define MAX_UNIT_TESTS 4
-
 /**
  * SECTION:ide-test-manager
  * @title: IdeTestManager
@@ -54,6 +55,12 @@
  *
  * You can access the test manager using ide_context_get_text_manager()
  * using the #IdeContext for the loaded project.
+ *
+ * When running all tests, as many tests are run concurrently as the build
+ * configuration allows for parallelism. The duration, peak memory usage,
+ * and result of each test is saved in the project cache so that the next
+ * run can start the longest tests first (and optionally, the tests which
+ * failed previously).
  */
 
 struct _IdeTestManager
@@ -66,6 +73,9 @@ struct _IdeTestManager
   IdePtyIntercept     intercept;
   int                 pty_producer;
   guint               n_active;
+
+  /* Test id to TestHistory, loaded lazily from the cache directory */
+  GHashTable         *history;
 };
 
 typedef struct
@@ -76,6 +86,19 @@ typedef struct
   guint        n_active;
 } RunAll;
 
+typedef struct
+{
+  gint64   duration;
+  guint64  peak_rss;
+  gboolean failed;
+} TestHistory;
+
+typedef struct
+{
+  IdeTest     *test;
+  TestHistory *history;
+} Scheduled;
+
 static void ide_test_manager_actions_cancel   (IdeTestManager *self,
                                                GVariant       *param);
 static void ide_test_manager_actions_test     (IdeTestManager *self,
@@ -132,6 +155,164 @@ run_all_free (RunAll *state)
   g_slice_free (RunAll, state);
 }
 
+static char *
+get_history_path (IdeTestManager *self)
+{
+  IdeContext *context = ide_object_get_context (IDE_OBJECT (self));
+
+  return ide_context_cache_filename (context, "tests", "history.ini", NULL);
+}
+
+static void
+ide_test_manager_load_history (IdeTestManager *self)
+{
+  g_autoptr(GKeyFile) key_file = NULL;
+  g_autofree char *path = NULL;
+  g_auto(GStrv) groups = NULL;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TEST_MANAGER (self));
+
+  if (self->history != NULL)
+    return;
+
+  self->history = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  path = get_history_path (self);
+  key_file = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL))
+    return;
+
+  groups = g_key_file_get_groups (key_file, NULL);
+
+  for (guint i = 0; groups[i]; i++)
+    {
+      TestHistory *history = g_new0 (TestHistory, 1);
+
+      history->duration = g_key_file_get_int64 (key_file, groups[i], "duration", NULL);
+      history->peak_rss = g_key_file_get_uint64 (key_file, groups[i], "peak-rss", NULL);
+      history->failed = g_key_file_get_boolean (key_file, groups[i], "failed", NULL);
+
+      g_hash_table_insert (self->history, g_strdup (groups[i]), history);
+    }
+}
+
+static void
+ide_test_manager_save_history (IdeTestManager *self)
+{
+  g_autoptr(GKeyFile) key_file = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *dir = NULL;
+  g_autofree char *data = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  gsize len;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TEST_MANAGER (self));
+
+  if (self->history == NULL || ide_object_in_destruction (IDE_OBJECT (self)))
+    return;
+
+  key_file = g_key_file_new ();
+
+  g_hash_table_iter_init (&iter, self->history);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const TestHistory *history = value;
+
+      g_key_file_set_int64 (key_file, key, "duration", history->duration);
+      g_key_file_set_uint64 (key_file, key, "peak-rss", history->peak_rss);
+      g_key_file_set_boolean (key_file, key, "failed", history->failed);
+    }
+
+  path = get_history_path (self);
+  dir = g_path_get_dirname (path);
+  data = g_key_file_to_data (key_file, &len, NULL);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0 ||
+      !g_file_set_contents (path, data, len, &error))
+    g_debug ("Failed to save test history: %s",
+             error ? error->message : g_strerror (errno));
+}
+
+static void
+ide_test_manager_record (IdeTestManager *self,
+                         IdeTest        *test,
+                         gboolean        failed)
+{
+  TestHistory *history;
+  const char *id;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TEST_MANAGER (self));
+  g_assert (IDE_IS_TEST (test));
+
+  if (!(id = ide_test_get_id (test)))
+    return;
+
+  ide_test_manager_load_history (self);
+
+  if (!(history = g_hash_table_lookup (self->history, id)))
+    {
+      history = g_new0 (TestHistory, 1);
+      g_hash_table_insert (self->history, g_strdup (id), history);
+    }
+
+  history->duration = ide_test_get_duration (test);
+  history->peak_rss = ide_test_get_peak_rss (test);
+  history->failed = failed;
+}
+
+static guint
+get_max_parallel (IdePipeline *pipeline)
+{
+  IdeConfig *config = ide_pipeline_get_config (pipeline);
+  int parallel = config ? ide_config_get_parallelism (config) : -1;
+
+  /* -1 is a sensible default and 0 is number of CPUs, both of which
+   * are the number of CPUs for unit tests.
+   */
+  if (parallel <= 0)
+    parallel = g_get_num_processors ();
+
+  return MAX (1, parallel);
+}
+
+static int
+compare_scheduled (gconstpointer a,
+                   gconstpointer b,
+                   gpointer      user_data)
+{
+  const Scheduled *sa = a;
+  const Scheduled *sb = b;
+  gboolean failed_first = GPOINTER_TO_INT (user_data);
+  gint64 da;
+  gint64 db;
+
+  if (failed_first)
+    {
+      gboolean fa = sa->history && sa->history->failed;
+      gboolean fb = sb->history && sb->history->failed;
+
+      if (fa != fb)
+        return fa ? -1 : 1;
+    }
+
+  /* Tests we haven't seen yet might be long, so start them early */
+  da = sa->history ? sa->history->duration : G_MAXINT64;
+  db = sb->history ? sb->history->duration : G_MAXINT64;
+
+  if (da > db)
+    return -1;
+  else if (da < db)
+    return 1;
+
+  return 0;
+}
+
 static GCancellable *
 get_cancellable (IdeTestManager *self)
 {
@@ -209,11 +390,26 @@ map_run_command_to_test (gpointer item,
                          gpointer user_data)
 {
   g_autoptr(IdeRunCommand) run_command = item;
+  IdeTestManager *self = user_data;
+  const TestHistory *history;
+  IdeTest *test;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (IDE_IS_RUN_COMMAND (run_command));
+  g_assert (IDE_IS_TEST_MANAGER (self));
+
+  test = ide_test_new (run_command);
+
+  if (ide_object_in_destruction (IDE_OBJECT (self)))
+    return test;
 
-  return ide_test_new (run_command);
+  /* Show the stats from the previous session until the test is run */
+  ide_test_manager_load_history (self);
+  if (ide_test_get_id (test) != NULL &&
+      (history = g_hash_table_lookup (self->history, ide_test_get_id (test))))
+    _ide_test_set_stats (test, history->duration, history->peak_rss);
+
+  return test;
 }
 
 static void
@@ -225,6 +421,7 @@ ide_test_manager_destroy (IdeObject *object)
   g_clear_object (&self->cancellable);
   g_clear_object (&self->filtered);
   g_clear_object (&self->tests);
+  g_clear_pointer (&self->history, g_hash_table_unref);
 
   g_clear_object (&self->pty);
   fd = pty_fd_steal (&self->pty_producer);
@@ -327,7 +524,7 @@ ide_test_manager_init (IdeTestManager *self)
   self->filtered = gtk_filter_list_model_new (NULL, GTK_FILTER (filter));
   map = gtk_map_list_model_new (g_object_ref (G_LIST_MODEL (self->filtered)),
                                 map_run_command_to_test,
-                                NULL, NULL);
+                                self, NULL);
   self->tests = ide_cached_list_model_new (G_LIST_MODEL (map));
 }
 
@@ -394,7 +591,12 @@ ide_test_manager_emit_end_test_all (IdeTestManager *self)
  * @callback: a callback to execute upon completion
  * @user_data: user data for @callback
  *
- * Executes all tests in an undefined order.
+ * Executes all tests, running as many concurrently as the parallelism of
+ * the build configuration allows.
+ *
+ * Tests which took the longest during their previous run are started
+ * first. If the "unit-test-failed-first" setting is enabled, tests which
+ * failed during their previous run are started before all others.
  *
  * Upon completion, @callback will be executed which must call
  * ide_test_manager_run_all_finish() to get the result.
@@ -410,11 +612,15 @@ ide_test_manager_run_all_async (IdeTestManager      *self,
 {
   g_autoptr(IdeTask) task = NULL;
   g_autoptr(GPtrArray) ar = NULL;
+  g_autoptr(GArray) scheduled = NULL;
+  g_autoptr(IdeSettings) settings = NULL;
   IdeBuildManager *build_manager;
   IdePipeline *pipeline;
   GListModel *tests;
   IdeContext *context;
   RunAll *state;
+  gboolean failed_first;
+  guint max_parallel;
   guint n_items;
 
   IDE_ENTRY;
@@ -450,9 +656,32 @@ ide_test_manager_run_all_async (IdeTestManager      *self,
   tests = ide_test_manager_list_tests (self);
   n_items = g_list_model_get_n_items (tests);
 
+  settings = ide_context_ref_settings (context, "org.gnome.builder.project");
+  failed_first = ide_settings_get_boolean (settings, "unit-test-failed-first");
+
+  ide_test_manager_load_history (self);
+
+  scheduled = g_array_sized_new (FALSE, FALSE, sizeof (Scheduled), n_items);
+  for (guint i = 0; i < n_items; i++)
+    {
+      Scheduled item;
+      const char *id;
+
+      item.test = g_list_model_get_item (tests, i);
+      item.history = NULL;
+
+      if ((id = ide_test_get_id (item.test)))
+        item.history = g_hash_table_lookup (self->history, id);
+
+      g_array_append_val (scheduled, item);
+    }
+
+  g_array_sort_with_data (scheduled, compare_scheduled, GINT_TO_POINTER (failed_first));
+
+  /* Tests are taken from the end of the array */
   ar = g_ptr_array_new_with_free_func (g_object_unref);
-  for (guint i = n_items; i > 0; i--)
-    g_ptr_array_add (ar, g_list_model_get_item (tests, i-1));
+  for (guint i = scheduled->len; i > 0; i--)
+    g_ptr_array_add (ar, g_array_index (scheduled, Scheduled, i-1).test);
 
   state = g_slice_new0 (RunAll);
   state->tests = g_ptr_array_ref (ar);
@@ -460,7 +689,9 @@ ide_test_manager_run_all_async (IdeTestManager      *self,
   state->n_active = 0;
   ide_task_set_task_data (task, state, run_all_free);
 
-  for (guint i = 0; i < MAX_UNIT_TESTS && ar->len > 0; i++)
+  max_parallel = get_max_parallel (pipeline);
+
+  for (guint i = 0; i < max_parallel && ar->len > 0; i++)
     {
       g_autoptr(IdeTest) test = g_ptr_array_steal_index (state->tests, ar->len-1);
 
@@ -520,6 +751,7 @@ ide_test_manager_run_cb (GObject      *object,
   IdeTest *test = (IdeTest *)object;
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
+  IdeTestManager *self;
 
   IDE_ENTRY;
 
@@ -528,10 +760,19 @@ ide_test_manager_run_cb (GObject      *object,
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
+  self = ide_task_get_source_object (task);
+
   if (!ide_test_run_finish (test, result, &error))
-    ide_task_return_error (task, g_steal_pointer (&error));
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        ide_test_manager_record (self, test, TRUE);
+      ide_task_return_error (task, g_steal_pointer (&error));
+    }
   else
-    ide_task_return_boolean (task, TRUE);
+    {
+      ide_test_manager_record (self, test, FALSE);
+      ide_task_return_boolean (task, TRUE);
+    }
 
   IDE_EXIT;
 }
@@ -548,7 +789,10 @@ ide_test_manager_test_notify_completed_cb (IdeTestManager *self,
   self->n_active--;
 
   if (self->n_active == 0)
-    ide_test_manager_set_action_enabled (self, "cancel", FALSE);
+    {
+      ide_test_manager_set_action_enabled (self, "cancel", FALSE);
+      ide_test_manager_save_history (self);
+    }
 }
 
 /**
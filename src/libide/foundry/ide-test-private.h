@@ -24,6 +24,9 @@
 
 G_BEGIN_DECLS
 
+void     _ide_test_set_stats (IdeTest              *self,
+                              gint64                duration,
+                              guint64               peak_rss);
 void     ide_test_run_async  (IdeTest              *self,
                               IdePipeline          *pipeline,
                               int                   pty_fd,
@@ -22,6 +22,8 @@
 
 #include "config.h"
 
+#include <glib-unix.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <libide-io.h>
@@ -39,12 +41,22 @@ struct _IdeTest
   GObject        parent_instance;
   IdeRunCommand *run_command;
   IdeTestStatus  status;
+  gint64         duration;
+  guint64        peak_rss;
 };
 
+typedef struct
+{
+  gint64 begin_time;
+  int    stats_fd;
+} Run;
+
 enum {
   PROP_0,
+  PROP_DURATION,
   PROP_ICON_NAME,
   PROP_ID,
+  PROP_PEAK_RSS,
   PROP_RUN_COMMAND,
   PROP_STATUS,
   PROP_TITLE,
@@ -70,6 +82,33 @@ ide_test_set_status (IdeTest       *self,
     }
 }
 
+static void
+run_free (Run *run)
+{
+  g_clear_fd (&run->stats_fd, NULL);
+  g_slice_free (Run, run);
+}
+
+void
+_ide_test_set_stats (IdeTest *self,
+                     gint64   duration,
+                     guint64  peak_rss)
+{
+  g_return_if_fail (IDE_IS_TEST (self));
+
+  if (duration != self->duration)
+    {
+      self->duration = duration;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_DURATION]);
+    }
+
+  if (peak_rss != self->peak_rss)
+    {
+      self->peak_rss = peak_rss;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PEAK_RSS]);
+    }
+}
+
 static void
 ide_test_dispose (GObject *object)
 {
@@ -90,6 +129,10 @@ ide_test_get_property (GObject    *object,
 
   switch (prop_id)
     {
+    case PROP_DURATION:
+      g_value_set_int64 (value, ide_test_get_duration (self));
+      break;
+
     case PROP_ICON_NAME:
       g_value_set_string (value, ide_test_get_icon_name (self));
       break;
@@ -98,6 +141,10 @@ ide_test_get_property (GObject    *object,
       g_value_set_string (value, ide_test_get_id (self));
       break;
 
+    case PROP_PEAK_RSS:
+      g_value_set_uint64 (value, ide_test_get_peak_rss (self));
+      break;
+
     case PROP_RUN_COMMAND:
       g_value_set_object (value, ide_test_get_run_command (self));
       break;
@@ -143,10 +190,36 @@ ide_test_class_init (IdeTestClass *klass)
   object_class->get_property = ide_test_get_property;
   object_class->set_property = ide_test_set_property;
 
+  /**
+   * IdeTest:duration:
+   *
+   * The wall-clock time of the most recent run of the test, in
+   * microseconds, or zero if the test has not been run.
+   *
+   * Since: 47
+   */
+  properties [PROP_DURATION] =
+    g_param_spec_int64 ("duration", NULL, NULL,
+                        0, G_MAXINT64, 0,
+                        (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   properties [PROP_ICON_NAME] =
     g_param_spec_string ("icon-name", NULL, NULL, NULL,
                          (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * IdeTest:peak-rss:
+   *
+   * The peak resident set size of the most recent run of the test, in
+   * bytes, or zero if it could not be determined.
+   *
+   * Since: 47
+   */
+  properties [PROP_PEAK_RSS] =
+    g_param_spec_uint64 ("peak-rss", NULL, NULL,
+                         0, G_MAXUINT64, 0,
+                         (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   properties [PROP_ID] =
     g_param_spec_string ("id", NULL, NULL, NULL,
                          (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
@@ -234,6 +307,42 @@ ide_test_get_icon_name (IdeTest *self)
     }
 }
 
+/**
+ * ide_test_get_duration:
+ * @self: a #IdeTest
+ *
+ * Gets the wall-clock time of the most recent run of the test.
+ *
+ * Returns: the duration in microseconds, or 0 if unknown
+ *
+ * Since: 47
+ */
+gint64
+ide_test_get_duration (IdeTest *self)
+{
+  g_return_val_if_fail (IDE_IS_TEST (self), 0);
+
+  return self->duration;
+}
+
+/**
+ * ide_test_get_peak_rss:
+ * @self: a #IdeTest
+ *
+ * Gets the peak resident set size of the most recent run of the test.
+ *
+ * Returns: the size in bytes, or 0 if unknown
+ *
+ * Since: 47
+ */
+guint64
+ide_test_get_peak_rss (IdeTest *self)
+{
+  g_return_val_if_fail (IDE_IS_TEST (self), 0);
+
+  return self->peak_rss;
+}
+
 /**
  * ide_test_get_run_command:
  * @self: a #IdeTest
@@ -250,6 +359,69 @@ ide_test_get_run_command (IdeTest *self)
   return self->run_command;
 }
 
+static gboolean
+ide_test_runner_handler (IdeRunContext       *run_context,
+                         const char * const  *argv,
+                         const char * const  *env,
+                         const char          *cwd,
+                         IdeUnixFDMap        *unix_fd_map,
+                         gpointer             user_data,
+                         GError             **error)
+{
+  int stats_fd = GPOINTER_TO_INT (user_data);
+  int dest_fd;
+
+  g_assert (IDE_IS_RUN_CONTEXT (run_context));
+  g_assert (argv != NULL);
+  g_assert (env != NULL);
+  g_assert (IDE_IS_UNIX_FD_MAP (unix_fd_map));
+
+  if (cwd != NULL)
+    ide_run_context_set_cwd (run_context, cwd);
+
+  ide_run_context_add_environ (run_context, env);
+
+  dest_fd = MAX (STDERR_FILENO, ide_unix_fd_map_get_max_dest_fd (unix_fd_map)) + 1;
+  if (!ide_run_context_merge_unix_fd_map (run_context, unix_fd_map, error))
+    return FALSE;
+
+  ide_run_context_take_fd (run_context, dup (stats_fd), dest_fd);
+
+  ide_run_context_append_argv (run_context, PACKAGE_LIBEXECDIR"/gnome-builder-test-runner");
+  ide_run_context_append_formatted (run_context, "--stats-fd=%d", dest_fd);
+  ide_run_context_append_argv (run_context, "--");
+  ide_run_context_append_args (run_context, argv);
+
+  return TRUE;
+}
+
+static void
+ide_test_close_fd (gpointer data)
+{
+  int fd = GPOINTER_TO_INT (data);
+  g_clear_fd (&fd, NULL);
+}
+
+static guint64
+ide_test_read_peak_rss (Run *run)
+{
+  char buf[32];
+  gssize len;
+
+  g_assert (run != NULL);
+
+  /* The runner writes the peak RSS in KiB right before exiting. The FD
+   * is non-blocking in case the runner failed before writing anything.
+   */
+  if (run->stats_fd == -1 ||
+      (len = read (run->stats_fd, buf, sizeof buf - 1)) <= 0)
+    return 0;
+
+  buf[len] = 0;
+
+  return g_ascii_strtoull (buf, NULL, 10) * 1024;
+}
+
 static void
 ide_test_wait_check_cb (GObject      *object,
                         GAsyncResult *result,
@@ -259,6 +431,7 @@ ide_test_wait_check_cb (GObject      *object,
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
   IdeTest *self;
+  Run *run;
 
   IDE_ENTRY;
 
@@ -268,6 +441,11 @@ ide_test_wait_check_cb (GObject      *object,
   g_assert (IDE_IS_TASK (task));
 
   self = ide_task_get_source_object (task);
+  run = ide_task_get_task_data (task);
+
+  _ide_test_set_stats (self,
+                       g_get_monotonic_time () - run->begin_time,
+                       ide_test_read_peak_rss (run));
 
   if (!ide_subprocess_wait_check_finish (subprocess, result, &error))
     {
@@ -299,6 +477,8 @@ ide_test_run_async (IdeTest             *self,
   g_autofree char *locality = NULL;
   IdeContext *context;
   IdeRuntime *runtime;
+  int stats_fds[2] = { -1, -1 };
+  Run *run;
 
   IDE_ENTRY;
 
@@ -337,6 +517,25 @@ ide_test_run_async (IdeTest             *self,
       ide_run_context_setenv (run_context, "TERM", "xterm-256color");
     }
 
+  /* Wrap everything with our runner which reports the peak RSS of the
+   * reaped test, including any wrappers it was started through. That
+   * is only possible when the test is a descendant of ours, which is
+   * not the case when spawned on the host from Flatpak.
+   */
+  if (!ide_is_flatpak () &&
+      g_unix_open_pipe (stats_fds, FD_CLOEXEC, NULL) &&
+      g_unix_set_fd_nonblocking (stats_fds[0], TRUE, NULL))
+    ide_run_context_push_at_base (run_context,
+                                  ide_test_runner_handler,
+                                  GINT_TO_POINTER (g_steal_fd (&stats_fds[1])),
+                                  ide_test_close_fd);
+
+  run = g_slice_new0 (Run);
+  run->stats_fd = g_steal_fd (&stats_fds[0]);
+  ide_task_set_task_data (task, run, run_free);
+
+  g_clear_fd (&stats_fds[1], NULL);
+
   if (!(subprocess = ide_run_context_spawn (run_context, &error)))
     {
       ide_test_set_status (self, IDE_TEST_STATUS_FAILED);
@@ -345,6 +544,8 @@ ide_test_run_async (IdeTest             *self,
     }
   else
     {
+      run->begin_time = g_get_monotonic_time ();
+
       ide_subprocess_send_signal_upon_cancel (subprocess, cancellable, SIGKILL);
       ide_test_set_status (self, IDE_TEST_STATUS_RUNNING);
       ide_subprocess_wait_check_async (subprocess,
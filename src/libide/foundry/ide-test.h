@@ -57,5 +57,9 @@ IDE_AVAILABLE_IN_ALL
 const char    *ide_test_get_icon_name   (IdeTest              *self);
 IDE_AVAILABLE_IN_ALL
 IdeRunCommand *ide_test_get_run_command (IdeTest              *self);
+IDE_AVAILABLE_IN_47
+gint64         ide_test_get_duration    (IdeTest              *self);
+IDE_AVAILABLE_IN_47
+guint64        ide_test_get_peak_rss    (IdeTest              *self);
 
 G_END_DECLS
@@ -1398,6 +1398,7 @@ ide_workbench_action_dump_tasks (gpointer    instance,
   g_assert (IDE_IS_WORKBENCH (self));
 
   _ide_dump_tasks ();
+  _ide_thread_pool_dump_stats ();
 }
 
 static void
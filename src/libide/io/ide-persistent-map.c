@@ -318,6 +318,47 @@ ide_persistent_map_builder_get_metadata_int64 (IdePersistentMap *self,
   return value;
 }
 
+/**
+ * ide_persistent_map_foreach:
+ * @self: An #IdePersistentMap instance.
+ * @func: (scope call): a function to call for each key/value pair
+ * @user_data: closure data for @func
+ *
+ * Calls @func for every key/value pair in the map, in key order.
+ *
+ * This is useful when merging multiple maps into a new
+ * #IdePersistentMapBuilder.
+ *
+ * Since: 47
+ */
+void
+ide_persistent_map_foreach (IdePersistentMap            *self,
+                            IdePersistentMapForeachFunc  func,
+                            gpointer                     user_data)
+{
+  g_return_if_fail (IDE_IS_PERSISTENT_MAP (self));
+  g_return_if_fail (self->loaded);
+  g_return_if_fail (func != NULL);
+
+  if (self->kvpairs == NULL || self->keys == NULL || self->values == NULL)
+    return;
+
+  for (gsize i = 0; i < self->n_kvpairs; i++)
+    {
+      g_autoptr(GVariant) value = g_variant_get_child_value (self->values, self->kvpairs[i].value);
+
+      if (self->byte_order != G_BYTE_ORDER)
+        {
+          g_autoptr(GVariant) swapped = g_variant_byteswap (value);
+          func (&self->keys[self->kvpairs[i].key], swapped, user_data);
+        }
+      else
+        {
+          func (&self->keys[self->kvpairs[i].key], value, user_data);
+        }
+    }
+}
+
 static void
 ide_persistent_map_finalize (GObject *object)
 {
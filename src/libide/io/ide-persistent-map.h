@@ -28,6 +28,10 @@
 IDE_AVAILABLE_IN_ALL
 G_DECLARE_FINAL_TYPE (IdePersistentMap, ide_persistent_map, IDE, PERSISTENT_MAP, GObject)
 
+typedef void (*IdePersistentMapForeachFunc) (const char *key,
+                                             GVariant   *value,
+                                             gpointer    user_data);
+
 IDE_AVAILABLE_IN_ALL
 IdePersistentMap *ide_persistent_map_new                        (void);
 IDE_AVAILABLE_IN_ALL
@@ -51,3 +55,7 @@ GVariant         *ide_persistent_map_lookup_value               (IdePersistentMa
 IDE_AVAILABLE_IN_ALL
 gint64            ide_persistent_map_builder_get_metadata_int64 (IdePersistentMap     *self,
                                                                  const gchar          *key);
+IDE_AVAILABLE_IN_47
+void              ide_persistent_map_foreach                    (IdePersistentMap     *self,
+                                                                 IdePersistentMapForeachFunc func,
+                                                                 gpointer              user_data);
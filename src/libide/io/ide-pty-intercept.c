@@ -38,25 +38,39 @@
 #include "ide-pty-intercept.h"
 
 /*
- * We really don't need all that much. A PTY on Linux has a some amount of
- * kernel memory that is non-pageable and therefore small in size. 4k is what
- * it appears to be. Anything more than that is really just an opportunity for
- * us to break some deadlock scenarios.
+ * All of the shuffling of bytes between the two sides happens on a
+ * dedicated I/O thread so that a busy main thread cannot slow down the
+ * inferior (and a chatty inferior cannot saturate the main thread).
+ *
+ * Each read lands in a single GBytes. The unwritten remainder for the
+ * other side is queued as a slice of it, and observers (see
+ * ide_pty_intercept_set_callback()) get another reference which is
+ * dispatched in batches on the main context the intercept was created
+ * with. Neither path copies the data again.
+ *
+ * Writes to the other side may queue up to MAX_QUEUED_BYTES before we stop
+ * reading, which is far more than the kernel buffers for a PTY and lets a
+ * slow terminal fall behind without blocking the child. Observers must see
+ * every byte (the build pipeline parses them for the log and diagnostics),
+ * so once MAX_OBSERVED_BYTES are waiting to be dispatched we stop reading
+ * from that side until the main context has caught up.
  */
-#define CHANNEL_BUFFER_SIZE (4096 * 4)
+#define READ_BUFFER_SIZE      (4096 * 4)
+#define MAX_QUEUED_BYTES      (1024 * 1024)
+#define MAX_OBSERVED_BYTES    (4 * 1024 * 1024)
 #define SLAVE_READ_PRIORITY   G_PRIORITY_HIGH
 #define SLAVE_WRITE_PRIORITY  G_PRIORITY_DEFAULT_IDLE
 #define MASTER_READ_PRIORITY  G_PRIORITY_DEFAULT_IDLE
 #define MASTER_WRITE_PRIORITY G_PRIORITY_HIGH
 
-static void     _ide_pty_intercept_side_close (IdePtyInterceptSide *side);
-static gboolean _ide_pty_intercept_in_cb      (GIOChannel          *channel,
+static void     _ide_pty_intercept_side_close (IdePtyIntercept     *self,
+                                               IdePtyInterceptSide *side);
+static gboolean _ide_pty_intercept_in_cb      (gint                 fd,
                                                GIOCondition         condition,
                                                gpointer             user_data);
-static gboolean _ide_pty_intercept_out_cb     (GIOChannel          *channel,
+static gboolean _ide_pty_intercept_out_cb     (gint                 fd,
                                                GIOCondition         condition,
                                                gpointer             user_data);
-static void     clear_source                  (guint               *source_id);
 
 static gboolean
 _ide_pty_intercept_set_raw (IdePtyFd fd)
@@ -206,96 +220,297 @@ ide_pty_intercept_create_consumer (void)
 }
 
 static void
-clear_source (guint *source_id)
+clear_source (GSource **source)
+{
+  GSource *s = *source;
+  *source = NULL;
+  if (s != NULL)
+    {
+      g_source_destroy (s);
+      g_source_unref (s);
+    }
+}
+
+static inline IdePtyInterceptSide *
+_ide_pty_intercept_get_peer (IdePtyIntercept     *self,
+                             IdePtyInterceptSide *side)
+{
+  return side == &self->consumer ? &self->producer : &self->consumer;
+}
+
+static void
+_ide_pty_intercept_watch (IdePtyIntercept     *self,
+                          IdePtyInterceptSide *side,
+                          GIOCondition         condition)
 {
-  guint id = *source_id;
-  *source_id = 0;
-  if (id != 0)
-    g_source_remove (id);
+  GSource **sourceptr;
+  GSourceFunc func;
+  gint priority;
+
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
+  g_assert (side->fd != IDE_PTY_FD_INVALID);
+
+  if (condition & G_IO_IN)
+    {
+      sourceptr = &side->in_source;
+      func = (GSourceFunc)_ide_pty_intercept_in_cb;
+      priority = side->read_prio;
+    }
+  else
+    {
+      sourceptr = &side->out_source;
+      func = (GSourceFunc)_ide_pty_intercept_out_cb;
+      priority = side->write_prio;
+    }
+
+  if (*sourceptr != NULL)
+    return;
+
+  *sourceptr = g_unix_fd_source_new (side->fd, condition | G_IO_ERR | G_IO_HUP);
+  g_source_set_priority (*sourceptr, priority);
+  g_source_set_static_name (*sourceptr, "[ide-pty-intercept]");
+  g_source_set_callback (*sourceptr, func, self, NULL);
+  g_source_attach (*sourceptr, self->io_context);
 }
 
 static void
-_ide_pty_intercept_side_close (IdePtyInterceptSide *side)
+_ide_pty_intercept_side_close (IdePtyIntercept     *self,
+                               IdePtyInterceptSide *side)
 {
+  IdePtyFd fd;
+
   g_assert (side != NULL);
 
-  clear_source (&side->in_watch);
-  clear_source (&side->out_watch);
-  g_clear_pointer (&side->channel, g_io_channel_unref);
-  g_clear_pointer (&side->out_bytes, g_bytes_unref);
+  clear_source (&side->in_source);
+  clear_source (&side->out_source);
+
+  g_queue_clear_full (&side->out_queue, (GDestroyNotify)g_bytes_unref);
+  side->out_queued = 0;
+
+  g_mutex_lock (&self->mutex);
+  fd = pty_fd_steal (&side->fd);
+  g_mutex_unlock (&self->mutex);
+
+  pty_fd_clear (&fd);
 }
 
+/*
+ * Runs on the I/O thread after observers have drained their queue to
+ * start reading again from sides paused in _ide_pty_intercept_observe().
+ */
 static gboolean
-_ide_pty_intercept_out_cb (GIOChannel   *channel,
-                           GIOCondition  condition,
-                           gpointer      user_data)
+_ide_pty_intercept_resume_cb (gpointer user_data)
 {
   IdePtyIntercept *self = user_data;
-  IdePtyInterceptSide *us, *them;
-  GIOStatus status;
-  const gchar *wrbuf;
-  gsize n_written = 0;
-  gsize len = 0;
+  IdePtyInterceptSide *sides[] = { &self->consumer, &self->producer };
 
-  g_assert (channel != NULL);
-  g_assert (condition & (G_IO_ERR | G_IO_HUP | G_IO_OUT));
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
+
+  g_mutex_lock (&self->mutex);
+  g_clear_pointer (&self->resume_source, g_source_unref);
+  g_mutex_unlock (&self->mutex);
 
-  if (channel == self->consumer.channel)
+  for (guint i = 0; i < G_N_ELEMENTS (sides); i++)
     {
-      us = &self->consumer;
-      them = &self->producer;
+      IdePtyInterceptSide *us = sides[i];
+      IdePtyInterceptSide *them = _ide_pty_intercept_get_peer (self, us);
+      gboolean paused;
+
+      g_mutex_lock (&self->mutex);
+      paused = us->observe_paused;
+      g_mutex_unlock (&self->mutex);
+
+      if (!paused &&
+          us->in_source == NULL &&
+          us->fd != IDE_PTY_FD_INVALID &&
+          them->fd != IDE_PTY_FD_INVALID &&
+          them->out_queued < MAX_QUEUED_BYTES)
+        _ide_pty_intercept_watch (self, us, G_IO_IN);
     }
-  else
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_ide_pty_intercept_observe_cb (gpointer user_data)
+{
+  IdePtyIntercept *self = user_data;
+  IdePtyInterceptSide *sides[] = { &self->consumer, &self->producer };
+  GQueue observed[G_N_ELEMENTS (sides)];
+  gboolean resume = FALSE;
+
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
+
+  g_mutex_lock (&self->mutex);
+  for (guint i = 0; i < G_N_ELEMENTS (sides); i++)
     {
-      us = &self->producer;
-      them = &self->consumer;
+      observed[i] = sides[i]->observed;
+      g_queue_init (&sides[i]->observed);
+      sides[i]->observed_len = 0;
+      resume |= sides[i]->observe_paused;
+      sides[i]->observe_paused = FALSE;
     }
+  g_clear_pointer (&self->observe_source, g_source_unref);
 
-  if ((condition & G_IO_OUT) == 0 ||
-      us->out_bytes == NULL ||
-      us->channel == NULL ||
-      them->channel == NULL)
-    goto close_and_cleanup;
+  if (resume && self->resume_source == NULL)
+    {
+      self->resume_source = g_idle_source_new ();
+      g_source_set_priority (self->resume_source, G_PRIORITY_HIGH);
+      g_source_set_static_name (self->resume_source, "[ide-pty-intercept-resume]");
+      g_source_set_callback (self->resume_source, _ide_pty_intercept_resume_cb, self, NULL);
+      g_source_attach (self->resume_source, self->io_context);
+    }
+  g_mutex_unlock (&self->mutex);
 
-  wrbuf = g_bytes_get_data (us->out_bytes, &len);
-  status = g_io_channel_write_chars (us->channel, wrbuf, len, &n_written, NULL);
-  if (status != G_IO_STATUS_NORMAL)
-    goto close_and_cleanup;
+  for (guint i = 0; i < G_N_ELEMENTS (sides); i++)
+    {
+      GBytes *bytes;
 
-  g_assert (n_written > 0);
-  g_assert (them->in_watch == 0);
+      while ((bytes = g_queue_pop_head (&observed[i])))
+        {
+          gsize len;
+          const guint8 *data = g_bytes_get_data (bytes, &len);
 
-  /*
-   * If we didn't write all of our data, wait until another G_IO_OUT
-   * condition to write more data.
-   */
-  if (n_written < len)
+          if (sides[i]->callback != NULL)
+            sides[i]->callback (self, sides[i], data, len, sides[i]->callback_data);
+
+          g_bytes_unref (bytes);
+        }
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Queues @bytes for the observer of @side.
+ *
+ * Returns: %TRUE if the observer has fallen behind and reading from @side
+ *   must pause until it has caught up.
+ */
+static gboolean
+_ide_pty_intercept_observe (IdePtyIntercept     *self,
+                            IdePtyInterceptSide *side,
+                            GBytes              *bytes)
+{
+  gboolean pause = FALSE;
+
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
+
+  g_mutex_lock (&self->mutex);
+
+  if (side->callback == NULL)
+    goto unlock;
+
+  g_queue_push_tail (&side->observed, g_bytes_ref (bytes));
+  side->observed_len += g_bytes_get_size (bytes);
+
+  if (side->observed_len >= MAX_OBSERVED_BYTES)
+    pause = side->observe_paused = TRUE;
+
+  if (self->observe_source == NULL)
     {
-      g_autoptr(GBytes) bytes = g_steal_pointer (&us->out_bytes);
-      us->out_bytes = g_bytes_new_from_bytes (bytes, n_written, len - n_written);
-      return G_SOURCE_CONTINUE;
+      self->observe_source = g_idle_source_new ();
+      g_source_set_static_name (self->observe_source, "[ide-pty-intercept-observe]");
+      g_source_set_callback (self->observe_source, _ide_pty_intercept_observe_cb, self, NULL);
+      g_source_attach (self->observe_source, self->main_context);
+    }
+
+unlock:
+  g_mutex_unlock (&self->mutex);
+
+  return pause;
+}
+
+/*
+ * Writes as much of the out_queue of @side as possible without blocking.
+ *
+ * Returns: %FALSE if the side failed and should be closed.
+ */
+static gboolean
+_ide_pty_intercept_flush (IdePtyIntercept     *self,
+                          IdePtyInterceptSide *side)
+{
+  GBytes *bytes;
+
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
+
+  while ((bytes = g_queue_peek_head (&side->out_queue)))
+    {
+      gsize len;
+      const guint8 *data = g_bytes_get_data (bytes, &len);
+      gssize n_written;
+
+      n_written = write (side->fd, data, len);
+
+      if (n_written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (errno == EAGAIN)
+            break;
+
+          return FALSE;
+        }
+
+      side->out_queued -= n_written;
+      g_queue_pop_head (&side->out_queue);
+
+      /* Keep the remainder as a slice of the same buffer */
+      if ((gsize)n_written < len)
+        g_queue_push_head (&side->out_queue,
+                           g_bytes_new_from_bytes (bytes, n_written, len - n_written));
+
+      g_bytes_unref (bytes);
     }
 
-  g_clear_pointer (&us->out_bytes, g_bytes_unref);
+  return TRUE;
+}
+
+static gboolean
+_ide_pty_intercept_out_cb (gint          fd,
+                           GIOCondition  condition,
+                           gpointer      user_data)
+{
+  IdePtyIntercept *self = user_data;
+  IdePtyInterceptSide *us, *them;
+
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
+  g_assert (condition & (G_IO_ERR | G_IO_HUP | G_IO_OUT));
+
+  us = fd == self->consumer.fd ? &self->consumer : &self->producer;
+  them = _ide_pty_intercept_get_peer (self, us);
+
+  if ((condition & G_IO_OUT) == 0 ||
+      them->fd == IDE_PTY_FD_INVALID ||
+      !_ide_pty_intercept_flush (self, us))
+    goto close_and_cleanup;
 
-  /*
-   * We wrote all the data to this side, so now we can wait for more
-   * data from the input peer.
+  /* Resume reading from the peer once we're back under the limit, unless
+   * it is also waiting on its observer.
    */
-  us->out_watch = 0;
-  them->in_watch =
-    g_io_add_watch_full (them->channel,
-                         them->read_prio,
-                         G_IO_IN | G_IO_ERR | G_IO_HUP,
-                         _ide_pty_intercept_in_cb,
-                         self, NULL);
+  if (us->out_queued < MAX_QUEUED_BYTES && them->in_source == NULL)
+    {
+      gboolean paused;
+
+      g_mutex_lock (&self->mutex);
+      paused = them->observe_paused;
+      g_mutex_unlock (&self->mutex);
+
+      if (!paused)
+        _ide_pty_intercept_watch (self, them, G_IO_IN);
+    }
+
+  if (us->out_queue.length > 0)
+    return G_SOURCE_CONTINUE;
+
+  g_clear_pointer (&us->out_source, g_source_unref);
 
   return G_SOURCE_REMOVE;
 
 close_and_cleanup:
-
-  _ide_pty_intercept_side_close (us);
-  _ide_pty_intercept_side_close (them);
+  _ide_pty_intercept_side_close (self, us);
+  _ide_pty_intercept_side_close (self, them);
 
   return G_SOURCE_REMOVE;
 }
@@ -303,103 +518,77 @@ close_and_cleanup:
 /*
  * _ide_pty_intercept_in_cb:
  *
- * This function is called when we have received a condition that specifies
- * the channel has data to read. We read that data and then setup a watch
- * onto the other other side so that we can write that data.
- *
- * If the other-side of the of the connection can write, then we write
- * that data immediately.
+ * This function is called on the I/O thread when the side has data to
+ * read. We read that data and then write it to the other side. Anything
+ * that cannot be written immediately is queued until the other side is
+ * writable again.
  *
- * The in watch is disabled until we have completed the write.
+ * Reading is paused while the other side has MAX_QUEUED_BYTES waiting or
+ * while the observer of this side has MAX_OBSERVED_BYTES to dispatch.
  */
 static gboolean
-_ide_pty_intercept_in_cb (GIOChannel   *channel,
+_ide_pty_intercept_in_cb (gint          fd,
                           GIOCondition  condition,
                           gpointer      user_data)
 {
   IdePtyIntercept *self = user_data;
   IdePtyInterceptSide *us, *them;
-  GIOStatus status = G_IO_STATUS_AGAIN;
-  gchar buf[4096];
-  gchar *wrbuf = buf;
-  gsize n_read;
+  g_autoptr(GBytes) bytes = NULL;
+  gboolean observer_full;
+  gchar *buf;
+  gssize n_read;
 
-  g_assert (channel != NULL);
-  g_assert (condition & (G_IO_ERR | G_IO_HUP | G_IO_IN));
   g_assert (IDE_IS_PTY_INTERCEPT (self));
+  g_assert (condition & (G_IO_ERR | G_IO_HUP | G_IO_IN));
 
-  if (channel == self->consumer.channel)
-    {
-      us = &self->consumer;
-      them = &self->producer;
-    }
-  else
-    {
-      us = &self->producer;
-      them = &self->consumer;
-    }
-
-  g_assert (us->in_watch != 0);
-  g_assert (them->out_watch == 0);
+  us = fd == self->consumer.fd ? &self->consumer : &self->producer;
+  them = _ide_pty_intercept_get_peer (self, us);
 
-  if (condition & (G_IO_ERR | G_IO_HUP) || us->channel == NULL || them->channel == NULL)
+  if (condition & (G_IO_ERR | G_IO_HUP) || them->fd == IDE_PTY_FD_INVALID)
     goto close_and_cleanup;
 
-  g_assert (condition & G_IO_IN);
+  buf = g_malloc (READ_BUFFER_SIZE);
 
-  while (status == G_IO_STATUS_AGAIN)
+  do
+    n_read = read (us->fd, buf, READ_BUFFER_SIZE);
+  while (n_read < 0 && errno == EINTR);
+
+  if (n_read < 0 && errno == EAGAIN)
     {
-      n_read = 0;
-      status = g_io_channel_read_chars (us->channel, buf, sizeof buf, &n_read, NULL);
+      g_free (buf);
+      return G_SOURCE_CONTINUE;
     }
 
-  if (status == G_IO_STATUS_EOF)
-    goto close_and_cleanup;
-
-  if (n_read > 0 && us->callback != NULL)
-    us->callback (self, us, (const guint8 *)buf, n_read, us->callback_data);
-
-  while (n_read > 0)
+  if (n_read <= 0)
     {
-      gsize n_written = 0;
+      g_free (buf);
+      goto close_and_cleanup;
+    }
 
-      status = g_io_channel_write_chars (them->channel, buf, n_read, &n_written, NULL);
+  bytes = g_bytes_new_take (g_realloc (buf, n_read), n_read);
 
-      wrbuf += n_written;
-      n_read -= n_written;
+  observer_full = _ide_pty_intercept_observe (self, us, bytes);
 
-      if (n_read > 0 && status == G_IO_STATUS_AGAIN)
-        {
-          /* If we get G_IO_STATUS_AGAIN here, then we are in a situation where
-           * the other side is not in a position to handle the data. We need to
-           * setup a G_IO_OUT watch on the FD to wait until things are writeable.
-           *
-           * We'll cancel our G_IO_IN condition, and wait for the out condition
-           * to make forward progress.
-           */
-          them->out_bytes = g_bytes_new (wrbuf, n_read);
-          them->out_watch = g_io_add_watch_full (them->channel,
-                                                 them->write_prio,
-                                                 G_IO_OUT | G_IO_ERR | G_IO_HUP,
-                                                 _ide_pty_intercept_out_cb,
-                                                 self, NULL);
-          us->in_watch = 0;
-
-          return G_SOURCE_REMOVE;
-        }
+  g_queue_push_tail (&them->out_queue, g_bytes_ref (bytes));
+  them->out_queued += n_read;
+
+  if (them->out_source == NULL && !_ide_pty_intercept_flush (self, them))
+    goto close_and_cleanup;
 
-      if (status != G_IO_STATUS_NORMAL)
-        goto close_and_cleanup;
+  if (them->out_queue.length > 0)
+    _ide_pty_intercept_watch (self, them, G_IO_OUT);
 
-      g_io_channel_flush (them->channel, NULL);
+  if (them->out_queued >= MAX_QUEUED_BYTES || observer_full)
+    {
+      g_clear_pointer (&us->in_source, g_source_unref);
+      return G_SOURCE_REMOVE;
     }
 
   return G_SOURCE_CONTINUE;
 
 close_and_cleanup:
-
-  _ide_pty_intercept_side_close (us);
-  _ide_pty_intercept_side_close (them);
+  _ide_pty_intercept_side_close (self, us);
+  _ide_pty_intercept_side_close (self, them);
 
   return G_SOURCE_REMOVE;
 }
@@ -420,47 +609,42 @@ ide_pty_intercept_set_size (IdePtyIntercept *self,
                             guint            rows,
                             guint            columns)
 {
+  gboolean ret = FALSE;
 
   g_return_val_if_fail (IDE_IS_PTY_INTERCEPT (self), FALSE);
 
-  if (self->consumer.channel != NULL)
+  g_mutex_lock (&self->mutex);
+
+  if (self->consumer.fd != IDE_PTY_FD_INVALID)
     {
-      IdePtyFd fd = g_io_channel_unix_get_fd (self->consumer.channel);
       struct winsize ws = {0};
 
       ws.ws_col = columns;
       ws.ws_row = rows;
 
-      return ioctl (fd, TIOCSWINSZ, &ws) == 0;
+      ret = ioctl (self->consumer.fd, TIOCSWINSZ, &ws) == 0;
     }
 
-  return FALSE;
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
 }
 
-static guint
-_g_io_add_watch_full_with_context (GMainContext   *main_context,
-                                   GIOChannel     *channel,
-                                   gint            priority,
-                                   GIOCondition    condition,
-                                   GIOFunc         func,
-                                   gpointer        user_data,
-                                   GDestroyNotify  notify)
+static gpointer
+_ide_pty_intercept_io_thread (gpointer data)
 {
-  GSource *source;
-  guint id;
+  IdePtyIntercept *self = data;
 
-  g_return_val_if_fail (channel != NULL, 0);
+  g_assert (IDE_IS_PTY_INTERCEPT (self));
 
-  source = g_io_create_watch (channel, condition);
+  g_main_context_push_thread_default (self->io_context);
 
-  if (priority != G_PRIORITY_DEFAULT)
-    g_source_set_priority (source, priority);
-  g_source_set_callback (source, (GSourceFunc)func, user_data, notify);
+  while (!g_atomic_int_get (&self->io_quit))
+    g_main_context_iteration (self->io_context, TRUE);
 
-  id = g_source_attach (source, main_context);
-  g_source_unref (source);
+  g_main_context_pop_thread_default (self->io_context);
 
-  return id;
+  return NULL;
 }
 
 /**
@@ -476,6 +660,10 @@ _g_io_add_watch_full_with_context (GMainContext   *main_context,
  * with another side, and will pass that information to @fd after
  * extracting any necessary information.
  *
+ * Data is forwarded between the two on a dedicated thread. Callbacks
+ * registered with ide_pty_intercept_set_callback() are dispatched
+ * on @main_context.
+ *
  * Returns: %TRUE if successful; otherwise %FALSE
  */
 gboolean
@@ -492,6 +680,9 @@ ide_pty_intercept_init (IdePtyIntercept *self,
 
   memset (self, 0, sizeof *self);
   self->magic = IDE_PTY_INTERCEPT_MAGIC;
+  self->consumer.fd = IDE_PTY_FD_INVALID;
+  self->producer.fd = IDE_PTY_FD_INVALID;
+  g_mutex_init (&self->mutex);
 
   producer_fd = ide_pty_intercept_create_producer (fd, FALSE);
   if (producer_fd == IDE_PTY_FD_INVALID)
@@ -513,40 +704,24 @@ ide_pty_intercept_init (IdePtyIntercept *self,
     ioctl (consumer_fd, TIOCSWINSZ, &ws);
 
   if (main_context == NULL)
-    main_context = g_main_context_get_thread_default ();
+    self->main_context = g_main_context_ref_thread_default ();
+  else
+    self->main_context = g_main_context_ref (main_context);
+
+  self->io_context = g_main_context_new ();
 
   self->consumer.read_prio = MASTER_READ_PRIORITY;
   self->consumer.write_prio = MASTER_WRITE_PRIORITY;
   self->producer.read_prio = SLAVE_READ_PRIORITY;
   self->producer.write_prio = SLAVE_WRITE_PRIORITY;
 
-  self->consumer.channel = g_io_channel_unix_new (pty_fd_steal (&consumer_fd));
-  self->producer.channel = g_io_channel_unix_new (pty_fd_steal (&producer_fd));
-
-  g_io_channel_set_close_on_unref (self->consumer.channel, TRUE);
-  g_io_channel_set_close_on_unref (self->producer.channel, TRUE);
-
-  g_io_channel_set_encoding (self->consumer.channel, NULL, NULL);
-  g_io_channel_set_encoding (self->producer.channel, NULL, NULL);
+  self->consumer.fd = pty_fd_steal (&consumer_fd);
+  self->producer.fd = pty_fd_steal (&producer_fd);
 
-  g_io_channel_set_buffer_size (self->consumer.channel, CHANNEL_BUFFER_SIZE);
-  g_io_channel_set_buffer_size (self->producer.channel, CHANNEL_BUFFER_SIZE);
+  _ide_pty_intercept_watch (self, &self->consumer, G_IO_IN);
+  _ide_pty_intercept_watch (self, &self->producer, G_IO_IN);
 
-  self->consumer.in_watch =
-    _g_io_add_watch_full_with_context (main_context,
-                                       self->consumer.channel,
-                                       self->consumer.read_prio,
-                                       G_IO_IN | G_IO_ERR | G_IO_HUP,
-                                       _ide_pty_intercept_in_cb,
-                                       self, NULL);
-
-  self->producer.in_watch =
-    _g_io_add_watch_full_with_context (main_context,
-                                       self->producer.channel,
-                                       self->producer.read_prio,
-                                       G_IO_IN | G_IO_ERR | G_IO_HUP,
-                                       _ide_pty_intercept_in_cb,
-                                       self, NULL);
+  self->io_thread = g_thread_new ("[ide-pty-intercept]", _ide_pty_intercept_io_thread, self);
 
   return TRUE;
 }
@@ -558,25 +733,37 @@ ide_pty_intercept_init (IdePtyIntercept *self,
  * Cleans up a #IdePtyIntercept previously initialized with
  * ide_pty_intercept_init().
  *
- * This diconnects any #GIOChannel that have been attached and
- * releases any allocated memory.
+ * This stops the I/O thread, closes the PTYs that were created and
+ * releases any allocated memory. Data that has not yet been delivered
+ * to callbacks is discarded.
  *
  * It is invalid to use @self after calling this function.
  */
 void
 ide_pty_intercept_clear (IdePtyIntercept *self)
 {
+  IdePtyInterceptSide *sides[] = { &self->consumer, &self->producer };
+
   g_return_if_fail (IDE_IS_PTY_INTERCEPT (self));
 
-  clear_source (&self->producer.in_watch);
-  clear_source (&self->producer.out_watch);
-  g_clear_pointer (&self->producer.channel, g_io_channel_unref);
-  g_clear_pointer (&self->producer.out_bytes, g_bytes_unref);
+  if (self->io_thread != NULL)
+    {
+      g_atomic_int_set (&self->io_quit, TRUE);
+      g_main_context_wakeup (self->io_context);
+      g_thread_join (g_steal_pointer (&self->io_thread));
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (sides); i++)
+    {
+      _ide_pty_intercept_side_close (self, sides[i]);
+      g_queue_clear_full (&sides[i]->observed, (GDestroyNotify)g_bytes_unref);
+    }
 
-  clear_source (&self->consumer.in_watch);
-  clear_source (&self->consumer.out_watch);
-  g_clear_pointer (&self->consumer.channel, g_io_channel_unref);
-  g_clear_pointer (&self->consumer.out_bytes, g_bytes_unref);
+  clear_source (&self->observe_source);
+  clear_source (&self->resume_source);
+  g_clear_pointer (&self->io_context, g_main_context_unref);
+  g_clear_pointer (&self->main_context, g_main_context_unref);
+  g_mutex_clear (&self->mutex);
 
   memset (self, 0, sizeof *self);
 }
@@ -593,10 +780,17 @@ ide_pty_intercept_clear (IdePtyIntercept *self)
 IdePtyFd
 ide_pty_intercept_get_fd (IdePtyIntercept *self)
 {
+  IdePtyFd ret;
+
   g_return_val_if_fail (IDE_IS_PTY_INTERCEPT (self), IDE_PTY_FD_INVALID);
-  g_return_val_if_fail (self->consumer.channel != NULL, IDE_PTY_FD_INVALID);
 
-  return g_io_channel_unix_get_fd (self->consumer.channel);
+  g_mutex_lock (&self->mutex);
+  ret = self->consumer.fd;
+  g_mutex_unlock (&self->mutex);
+
+  g_return_val_if_fail (ret != IDE_PTY_FD_INVALID, IDE_PTY_FD_INVALID);
+
+  return ret;
 }
 
 /**
@@ -609,6 +803,12 @@ ide_pty_intercept_get_fd (IdePtyIntercept *self)
  * This sets the callback to execute every time data is received
  * from a particular side of the intercept.
  *
+ * The callback is called from the main context provided to
+ * ide_pty_intercept_init(), possibly some time after the data was
+ * forwarded. The data must not be modified. Every byte is delivered
+ * in order; if the callback cannot keep up, reading from @side is
+ * paused until it has caught up.
+ *
  * You may only set one per side.
  */
 void
@@ -620,6 +820,8 @@ ide_pty_intercept_set_callback (IdePtyIntercept         *self,
   g_return_if_fail (IDE_IS_PTY_INTERCEPT (self));
   g_return_if_fail (side == &self->consumer || side == &self->producer);
 
+  g_mutex_lock (&self->mutex);
   side->callback = callback;
   side->callback_data = callback_data;
+  g_mutex_unlock (&self->mutex);
 }
@@ -44,21 +44,32 @@ typedef void (*IdePtyInterceptCallback) (const IdePtyIntercept     *intercept,
 
 struct _IdePtyInterceptSide
 {
-  GIOChannel              *channel;
-  guint                    in_watch;
-  guint                    out_watch;
+  IdePtyFd                 fd;
+  GSource                 *in_source;
+  GSource                 *out_source;
   gint                     read_prio;
   gint                     write_prio;
-  GBytes                  *out_bytes;
+  GQueue                   out_queue;
+  gsize                    out_queued;
   IdePtyInterceptCallback  callback;
   gpointer                 callback_data;
+  GQueue                   observed;
+  gsize                    observed_len;
+  gboolean                 observe_paused;
 };
 
 struct _IdePtyIntercept
 {
-  gsize               magic;
-  IdePtyInterceptSide consumer;
-  IdePtyInterceptSide producer;
+  gsize                magic;
+  IdePtyInterceptSide  consumer;
+  IdePtyInterceptSide  producer;
+  GMutex               mutex;
+  GMainContext        *main_context;
+  GMainContext        *io_context;
+  GThread             *io_thread;
+  GSource             *observe_source;
+  GSource             *resume_source;
+  gint                 io_quit;
 };
 
 static inline IdePtyFd
@@ -31,6 +31,9 @@ typedef struct
   gpointer      key;
   gpointer      value;
   gint64        evict_at;
+  GList         lru_link;
+  gsize         cost;
+  guint         hits;
 } CacheItem;
 
 typedef struct
@@ -73,8 +76,36 @@ struct _IdeTaskCache
   guint                 evict_source_id;
 
   gint64                time_to_live_usec;
+
+  /* Items ordered from most to least recently used */
+  GQueue                lru;
+  GList                 caches_link;
+
+  IdeTaskCacheCostFunc  cost_func;
+  gpointer              cost_func_data;
+  GDestroyNotify        cost_func_data_destroy;
+  gsize                 cost;
+
+  guint64               n_hits;
+  guint64               n_misses;
+  guint64               n_evictions;
 };
 
+/* When choosing a victim to stay within the global budget, this many
+ * least-recently-used items of each cache are sampled and the one with
+ * the fewest hits is evicted. That keeps frequently used items alive even
+ * when a burst of one-off lookups pushes them towards the LRU tail.
+ */
+#define LFU_SAMPLE_SIZE 4
+#define DEFAULT_GLOBAL_BUDGET (256 * 1024 * 1024)
+
+/* Caches with a cost function share a single budget. IdeTaskCache is
+ * only used from the main thread, so these need no locking.
+ */
+static GQueue costed_caches;
+static gsize global_cost;
+static gsize global_budget = DEFAULT_GLOBAL_BUDGET;
+
 G_DEFINE_FINAL_TYPE (IdeTaskCache, ide_task_cache, G_TYPE_OBJECT)
 
 enum {
@@ -170,6 +201,11 @@ static void
 cache_item_free (gpointer data)
 {
   CacheItem *item = data;
+  IdeTaskCache *self = item->self;
+
+  g_queue_unlink (&self->lru, &item->lru_link);
+  self->cost -= item->cost;
+  global_cost -= item->cost;
 
   g_clear_pointer (&item->key, item->self->key_destroy_func);
   g_clear_pointer (&item->value, item->self->value_destroy_func);
@@ -216,8 +252,15 @@ cache_item_new (IdeTaskCache  *self,
   ret->self = self;
   ret->key = self->key_copy_func ((gpointer)key);
   ret->value = self->value_copy_func ((gpointer)value);
+  ret->lru_link.data = ret;
   if (self->time_to_live_usec > 0)
     ret->evict_at = g_get_monotonic_time () + self->time_to_live_usec;
+  if (self->cost_func != NULL)
+    ret->cost = self->cost_func (ret->value, self->cost_func_data);
+
+  g_queue_push_head_link (&self->lru, &ret->lru_link);
+  self->cost += ret->cost;
+  global_cost += ret->cost;
 
   return ret;
 }
@@ -291,6 +334,8 @@ ide_task_cache_evict_full (IdeTaskCache  *self,
 
       g_hash_table_remove (self->cache, key);
 
+      self->n_evictions++;
+
       g_debug ("Evicted 1 item from %s", self->name ?: "unnamed cache");
 
       if (self->evict_source != NULL)
@@ -322,6 +367,7 @@ ide_task_cache_evict_all (IdeTaskCache *self)
       ide_heap_extract_index (self->evict_heap, self->evict_heap->len - 1, &item);
     }
 
+  self->n_evictions += g_hash_table_size (self->cache);
   g_hash_table_remove_all (self->cache);
 
   if (self->evict_source != NULL)
@@ -352,11 +398,60 @@ ide_task_cache_peek (IdeTaskCache  *self,
   g_return_val_if_fail (IDE_IS_TASK_CACHE (self), NULL);
 
   if (NULL != (item = g_hash_table_lookup (self->cache, key)))
-    return item->value;
+    {
+      /* Move to the front of the LRU */
+      g_queue_unlink (&self->lru, &item->lru_link);
+      g_queue_push_head_link (&self->lru, &item->lru_link);
+      item->hits++;
+
+      return item->value;
+    }
 
   return NULL;
 }
 
+static CacheItem *
+ide_task_cache_find_victim (void)
+{
+  CacheItem *victim = NULL;
+
+  for (const GList *c = costed_caches.head; c; c = c->next)
+    {
+      IdeTaskCache *cache = c->data;
+      guint sampled = 0;
+
+      for (const GList *l = cache->lru.tail; l && sampled < LFU_SAMPLE_SIZE; l = l->prev, sampled++)
+        {
+          CacheItem *item = l->data;
+
+          if (item->cost == 0)
+            continue;
+
+          if (victim == NULL || item->hits < victim->hits)
+            victim = item;
+        }
+    }
+
+  return victim;
+}
+
+static void
+ide_task_cache_enforce_budget (void)
+{
+  while (global_budget > 0 && global_cost > global_budget)
+    {
+      CacheItem *victim;
+
+      if (!(victim = ide_task_cache_find_victim ()))
+        break;
+
+      g_debug ("Evicting item from %s to remain within budget of %"G_GSIZE_FORMAT" bytes",
+               victim->self->name ?: "unnamed cache", global_budget);
+
+      ide_task_cache_evict_full (victim->self, victim->key, TRUE);
+    }
+}
+
 static void
 ide_task_cache_propagate_error (IdeTaskCache  *self,
                                 gconstpointer  key,
@@ -403,6 +498,9 @@ ide_task_cache_populate (IdeTaskCache  *self,
 
   if (self->evict_source != NULL)
     evict_source_rearm (self->evict_source);
+
+  if (item->cost > 0)
+    ide_task_cache_enforce_budget ();
 }
 
 static void
@@ -578,12 +676,15 @@ ide_task_cache_get_async (IdeTaskCache        *self,
    */
   if (!force_update && (ret = ide_task_cache_peek (self, key)))
     {
+      self->n_hits++;
       g_task_return_pointer (task,
                              self->value_copy_func (ret),
                              self->value_destroy_func);
       return;
     }
 
+  self->n_misses++;
+
   /*
    * Always queue the request. If we need to dispatch the worker to
    * fetch the result, that will happen with another task.
@@ -777,6 +878,12 @@ ide_task_cache_dispose (GObject *object)
 
   g_clear_pointer (&self->evict_heap, ide_heap_unref);
 
+  if (self->caches_link.data != NULL)
+    {
+      g_queue_unlink (&costed_caches, &self->caches_link);
+      self->caches_link.data = NULL;
+    }
+
   if (self->cache != NULL)
     {
       gint64 count;
@@ -800,6 +907,10 @@ ide_task_cache_dispose (GObject *object)
         self->populate_callback_data_destroy (self->populate_callback_data);
     }
 
+  if (self->cost_func_data_destroy)
+    g_clear_pointer (&self->cost_func_data, self->cost_func_data_destroy);
+  self->cost_func = NULL;
+
   G_OBJECT_CLASS (ide_task_cache_parent_class)->dispose (object);
 }
 
@@ -1040,3 +1151,115 @@ ide_task_cache_set_name (IdeTaskCache *self,
       g_source_set_name (self->evict_source, full_name);
     }
 }
+
+/**
+ * ide_task_cache_set_cost_func:
+ * @self: an #IdeTaskCache
+ * @cost_func: (nullable) (scope notified): a function to determine the cost of a value
+ * @user_data: closure data for @cost_func
+ * @user_data_destroy: (nullable): a #GDestroyNotify for @user_data
+ *
+ * Sets a function used to determine the approximate number of bytes
+ * retained by a cached value.
+ *
+ * Caches with a cost function share a global budget which may be set
+ * with ide_task_cache_set_global_budget(). When the budget is exceeded,
+ * items are evicted from the least recently used end of those caches,
+ * preferring items that have been used the least.
+ *
+ * This must be called before items are added to the cache.
+ *
+ * Since: 47
+ */
+void
+ide_task_cache_set_cost_func (IdeTaskCache         *self,
+                              IdeTaskCacheCostFunc  cost_func,
+                              gpointer              user_data,
+                              GDestroyNotify        user_data_destroy)
+{
+  g_return_if_fail (IDE_IS_TASK_CACHE (self));
+  g_return_if_fail (self->cache == NULL || g_hash_table_size (self->cache) == 0);
+
+  if (self->cost_func_data_destroy)
+    g_clear_pointer (&self->cost_func_data, self->cost_func_data_destroy);
+
+  self->cost_func = cost_func;
+  self->cost_func_data = user_data;
+  self->cost_func_data_destroy = user_data_destroy;
+
+  if (cost_func != NULL && self->caches_link.data == NULL)
+    {
+      self->caches_link.data = self;
+      g_queue_push_tail_link (&costed_caches, &self->caches_link);
+    }
+  else if (cost_func == NULL && self->caches_link.data != NULL)
+    {
+      g_queue_unlink (&costed_caches, &self->caches_link);
+      self->caches_link.data = NULL;
+    }
+}
+
+/**
+ * ide_task_cache_set_global_budget:
+ * @budget: the number of bytes, or 0 for unlimited
+ *
+ * Sets the number of bytes that may be retained by all caches which
+ * have a cost function set with ide_task_cache_set_cost_func().
+ *
+ * Since: 47
+ */
+void
+ide_task_cache_set_global_budget (gsize budget)
+{
+  global_budget = budget;
+  ide_task_cache_enforce_budget ();
+}
+
+/**
+ * ide_task_cache_get_global_budget:
+ *
+ * Gets the budget set with ide_task_cache_set_global_budget().
+ *
+ * Returns: the number of bytes, or 0 for unlimited
+ *
+ * Since: 47
+ */
+gsize
+ide_task_cache_get_global_budget (void)
+{
+  return global_budget;
+}
+
+/**
+ * ide_task_cache_get_stats:
+ * @self: an #IdeTaskCache
+ * @n_hits: (out) (optional): the number of requests served from the cache
+ * @n_misses: (out) (optional): the number of requests requiring a populate
+ * @n_evictions: (out) (optional): the number of items evicted
+ * @cost: (out) (optional): the cost of the items currently cached
+ *
+ * Gets statistics about the cache since it was created.
+ *
+ * Since: 47
+ */
+void
+ide_task_cache_get_stats (IdeTaskCache *self,
+                          guint64      *n_hits,
+                          guint64      *n_misses,
+                          guint64      *n_evictions,
+                          gsize        *cost)
+{
+  g_return_if_fail (IDE_IS_TASK_CACHE (self));
+
+  if (n_hits != NULL)
+    *n_hits = self->n_hits;
+
+  if (n_misses != NULL)
+    *n_misses = self->n_misses;
+
+  if (n_evictions != NULL)
+    *n_evictions = self->n_evictions;
+
+  if (cost != NULL)
+    *cost = self->cost;
+}
@@ -53,6 +53,20 @@ typedef void (*IdeTaskCacheCallback) (IdeTaskCache  *self,
                                       GTask         *task,
                                       gpointer       user_data);
 
+/**
+ * IdeTaskCacheCostFunc:
+ * @value: the value being cached
+ * @user_data: closure data for the function
+ *
+ * Determines the approximate number of bytes retained by @value.
+ *
+ * Returns: the cost of @value in bytes
+ *
+ * Since: 47
+ */
+typedef gsize (*IdeTaskCacheCostFunc) (gconstpointer value,
+                                       gpointer      user_data);
+
 IDE_AVAILABLE_IN_ALL
 IdeTaskCache *ide_task_cache_new        (GHashFunc              key_hash_func,
                                          GEqualFunc             key_equal_func,
@@ -88,5 +102,20 @@ gpointer      ide_task_cache_peek       (IdeTaskCache          *self,
                                          gconstpointer          key);
 IDE_AVAILABLE_IN_ALL
 GPtrArray    *ide_task_cache_get_values (IdeTaskCache          *self);
+IDE_AVAILABLE_IN_47
+void          ide_task_cache_set_cost_func     (IdeTaskCache         *self,
+                                                IdeTaskCacheCostFunc  cost_func,
+                                                gpointer              user_data,
+                                                GDestroyNotify        user_data_destroy);
+IDE_AVAILABLE_IN_47
+void          ide_task_cache_get_stats         (IdeTaskCache         *self,
+                                                guint64              *n_hits,
+                                                guint64              *n_misses,
+                                                guint64              *n_evictions,
+                                                gsize                *cost);
+IDE_AVAILABLE_IN_47
+void          ide_task_cache_set_global_budget (gsize                 budget);
+IDE_AVAILABLE_IN_47
+gsize         ide_task_cache_get_global_budget (void);
 
 G_END_DECLS
@@ -53,6 +53,12 @@ typedef struct
   GCancellable *cancellable;
 } PendingMessage;
 
+typedef struct
+{
+  gchar  *method;
+  gint64  begin_time;
+} CallMark;
+
 typedef struct
 {
   GSignalGroup   *buffer_manager_signals;
@@ -152,6 +158,15 @@ async_call_unref (gpointer data)
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (AsyncCall, async_call_unref);
 
+static void
+call_mark_free (gpointer data)
+{
+  CallMark *mark = data;
+
+  g_clear_pointer (&mark->method, g_free);
+  g_slice_free (CallMark, mark);
+}
+
 static void
 pending_message_fail (PendingMessage *message)
 {
@@ -248,6 +263,7 @@ ide_lsp_client_buffer_saved (IdeLspClient     *self,
                              IdeBuffer        *buffer,
                              IdeBufferManager *buffer_manager)
 {
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
   g_autoptr(GVariant) params = NULL;
   g_autoptr(GBytes) content = NULL;
   g_autofree gchar *uri = NULL;
@@ -264,7 +280,8 @@ ide_lsp_client_buffer_saved (IdeLspClient     *self,
     IDE_EXIT;
 
   uri = ide_buffer_dup_uri (buffer);
-  content = ide_buffer_dup_content (buffer);
+  snapshot = ide_buffer_ref_snapshot (buffer);
+  content = ide_buffer_snapshot_dup_content (snapshot);
   text = (const gchar *)g_bytes_get_data (content, NULL);
 
   params = JSONRPC_MESSAGE_NEW (
@@ -376,11 +393,9 @@ ide_lsp_client_buffer_after_insert_text (IdeLspClient *self,
 
   if (priv->text_document_sync == TEXT_DOCUMENT_SYNC_FULL)
     {
-      g_autoptr(GBytes) content = NULL;
-      const char *text;
-
-      content = ide_buffer_dup_content (buffer);
-      text = (const char *)g_bytes_get_data (content, NULL);
+      g_autoptr(IdeBufferSnapshot) snapshot = ide_buffer_ref_snapshot (buffer);
+      g_autoptr(GBytes) content = ide_buffer_snapshot_dup_content (snapshot);
+      const char *text = (const char *)g_bytes_get_data (content, NULL);
 
       params = JSONRPC_MESSAGE_NEW (
         "textDocument", "{",
@@ -498,6 +513,7 @@ ide_lsp_client_buffer_after_delete_range (IdeLspClient *self,
 
   if (priv->text_document_sync == TEXT_DOCUMENT_SYNC_FULL)
     {
+      g_autoptr(IdeBufferSnapshot) snapshot = NULL;
       g_autofree char *uri = NULL;
       g_autoptr(GBytes) content = NULL;
       g_autoptr(GVariant) params = NULL;
@@ -505,9 +521,10 @@ ide_lsp_client_buffer_after_delete_range (IdeLspClient *self,
       gint64 version;
 
       uri = ide_buffer_dup_uri (buffer);
-      version = (gint)ide_buffer_get_change_count (buffer);
+      snapshot = ide_buffer_ref_snapshot (buffer);
+      version = (gint64)ide_buffer_snapshot_get_sequence (snapshot);
 
-      content = ide_buffer_dup_content (buffer);
+      content = ide_buffer_snapshot_dup_content (snapshot);
       text = (const gchar *)g_bytes_get_data (content, NULL);
 
       params = JSONRPC_MESSAGE_NEW (
@@ -537,11 +554,11 @@ ide_lsp_client_buffer_loaded (IdeLspClient     *self,
 {
   g_autoptr(GVariant) params = NULL;
   g_autofree gchar *uri = NULL;
-  g_autofree gchar *text = NULL;
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autoptr(GBytes) content = NULL;
   GtkSourceLanguage *language;
   const gchar *language_id;
-  GtkTextIter begin;
-  GtkTextIter end;
+  const gchar *text;
   gint64 version;
 
   IDE_ENTRY;
@@ -579,10 +596,12 @@ ide_lsp_client_buffer_loaded (IdeLspClient     *self,
                            G_CONNECT_AFTER | G_CONNECT_SWAPPED);
 
   uri = ide_buffer_dup_uri (buffer);
-  version = (gint64)ide_buffer_get_change_count (buffer);
+  snapshot = ide_buffer_ref_snapshot (buffer);
+  version = (gint64)ide_buffer_snapshot_get_sequence (snapshot);
 
-  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &begin, &end);
-  text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &begin, &end, TRUE);
+  /* Copied from the piece table rather than walking the text btree */
+  content = ide_buffer_snapshot_dup_content (snapshot);
+  text = (const gchar *)g_bytes_get_data (content, NULL);
 
   language = gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (buffer));
   if (language != NULL)
@@ -2072,6 +2091,7 @@ ide_lsp_client_call_cb (GObject      *object,
   g_autoptr(GVariant) reply = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(IdeTask) task = user_data;
+  CallMark *mark;
 
   IDE_ENTRY;
 
@@ -2080,6 +2100,9 @@ ide_lsp_client_call_cb (GObject      *object,
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
+  if ((mark = ide_task_get_task_data (task)))
+    ide_trace_end_mark (mark->begin_time, "LSP", "Call", "%s", mark->method);
+
   if (!jsonrpc_client_call_finish (client, result, &reply, &error))
     ide_task_return_error (task, g_steal_pointer (&error));
   else
@@ -2157,6 +2180,15 @@ ide_lsp_client_call_async (IdeLspClient        *self,
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_lsp_client_call_async);
 
+  /* Round-trips include time spent queued waiting for initialization */
+  if (ide_trace_is_enabled ())
+    {
+      CallMark *mark = g_slice_new0 (CallMark);
+      mark->method = g_strdup (method);
+      mark->begin_time = ide_trace_begin_mark ();
+      ide_task_set_task_data (task, mark, call_mark_free);
+    }
+
   if (priv->rpc_client == NULL)
     {
       ide_task_return_new_error (task,
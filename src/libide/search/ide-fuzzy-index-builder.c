@@ -283,7 +283,10 @@ ide_fuzzy_index_builder_insert (IdeFuzzyIndexBuilder *self,
   /* move the priority bits into the proper area */
   priority = (priority & 0xFF) << 24;
 
-  if (self->keys->len > MAX_KEY_ENTRIES)
+  /* Both the key_id and the position of the pair within the lookaside
+   * share their 32 bits with the priority, so neither may exceed 24 bits.
+   */
+  if (self->keys->len > MAX_KEY_ENTRIES || self->kv_pairs->len > MAX_KEY_ENTRIES)
     {
       g_warning ("Index is full, cannot add more entries");
       return 0L;
@@ -439,6 +439,74 @@ ide_fuzzy_index_get_metadata_string (IdeFuzzyIndex *self,
   return NULL;
 }
 
+/**
+ * ide_fuzzy_index_foreach:
+ * @self: A #IdeFuzzyIndex
+ * @func: (scope call): a function to call for each key/document pair
+ * @user_data: closure data for @func
+ *
+ * Calls @func for every key/document pair that was inserted into the
+ * index, along with the priority the key was inserted with.
+ *
+ * This can be used to merge the contents of multiple indexes into a
+ * new #IdeFuzzyIndexBuilder.
+ *
+ * Since: 47
+ */
+void
+ide_fuzzy_index_foreach (IdeFuzzyIndex            *self,
+                         IdeFuzzyIndexForeachFunc  func,
+                         gpointer                  user_data)
+{
+  gsize n_keys;
+  gsize n_documents;
+
+  g_return_if_fail (IDE_IS_FUZZY_INDEX (self));
+  g_return_if_fail (func != NULL);
+
+  if (self->keys == NULL || self->documents == NULL || self->lookaside_raw == NULL)
+    return;
+
+  n_keys = g_variant_n_children (self->keys);
+  n_documents = g_variant_n_children (self->documents);
+
+  for (gsize i = 0; i < self->lookaside_len; i++)
+    {
+      const LookasideEntry *entry = &self->lookaside_raw[i];
+      g_autoptr(GVariant) document = NULL;
+      const char *key = NULL;
+      guint key_id = entry->key_id & 0x00FFFFFF;
+      guint priority = (entry->key_id & 0xFF000000) >> 24;
+
+      if G_UNLIKELY (key_id >= n_keys || entry->document_id >= n_documents)
+        continue;
+
+      g_variant_get_child (self->keys, key_id, "&s", &key);
+      document = g_variant_get_child_value (self->documents, entry->document_id);
+
+      func (key, document, priority, user_data);
+    }
+}
+
+/**
+ * ide_fuzzy_index_get_n_entries:
+ * @self: A #IdeFuzzyIndex
+ *
+ * Gets the number of key/document pairs within the index, which is the
+ * number of times ide_fuzzy_index_foreach() will call its function.
+ *
+ * Returns: the number of entries in the index
+ *
+ * Since: 47
+ */
+gsize
+ide_fuzzy_index_get_n_entries (IdeFuzzyIndex *self)
+{
+  g_return_val_if_fail (IDE_IS_FUZZY_INDEX (self), 0);
+
+  return self->lookaside_len;
+}
+
 /**
  * _ide_fuzzy_index_lookup_document:
  * @self: A #IdeFuzzyIndex
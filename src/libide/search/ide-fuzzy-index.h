@@ -27,6 +27,11 @@ G_BEGIN_DECLS
 IDE_AVAILABLE_IN_ALL
 G_DECLARE_FINAL_TYPE (IdeFuzzyIndex, ide_fuzzy_index, IDE, FUZZY_INDEX, GObject)
 
+typedef void (*IdeFuzzyIndexForeachFunc) (const char *key,
+                                          GVariant   *document,
+                                          guint       priority,
+                                          gpointer    user_data);
+
 IDE_AVAILABLE_IN_ALL
 IdeFuzzyIndex  *ide_fuzzy_index_new                 (void);
 IDE_AVAILABLE_IN_ALL
@@ -67,5 +72,11 @@ guint64         ide_fuzzy_index_get_metadata_uint64 (IdeFuzzyIndex        *self,
 IDE_AVAILABLE_IN_ALL
 const gchar    *ide_fuzzy_index_get_metadata_string (IdeFuzzyIndex        *self,
                                                      const gchar          *key);
+IDE_AVAILABLE_IN_47
+void            ide_fuzzy_index_foreach             (IdeFuzzyIndex        *self,
+                                                     IdeFuzzyIndexForeachFunc func,
+                                                     gpointer              user_data);
+IDE_AVAILABLE_IN_47
+gsize           ide_fuzzy_index_get_n_entries       (IdeFuzzyIndex        *self);
 
 G_END_DECLS
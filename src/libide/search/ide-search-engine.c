@@ -47,6 +47,7 @@ typedef struct
 {
   IdeSearchProvider *provider;
   GListModel        *results;
+  gint64             begin_time;
   guint              truncated : 1;
 } SortInfo;
 
@@ -307,6 +308,10 @@ ide_search_engine_search_cb (GObject      *object,
 
       info->truncated = info->results != NULL && truncated;
 
+      ide_trace_end_mark (info->begin_time, "Search", "Provider", "%s: %s (%u results)",
+                          G_OBJECT_TYPE_NAME (provider), r->query,
+                          info->results ? g_list_model_get_n_items (info->results) : 0);
+
 #ifdef IDE_ENABLE_TRACE
       if (info->results != NULL)
         IDE_TRACE_MSG ("%s: %d results%s",
@@ -360,6 +365,7 @@ _provider_search_async (IdeSearchProvider *provider,
 
   sort_info.provider = g_object_ref (provider);
   sort_info.results = NULL;
+  sort_info.begin_time = ide_trace_begin_mark ();
   g_array_append_val (r->sorted, sort_info);
 
   ide_search_provider_search_async (provider,
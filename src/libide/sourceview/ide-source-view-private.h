@@ -72,6 +72,12 @@ struct _IdeSourceView
   /* GSource used to update bottom margin */
   guint overscroll_source;
 
+  /* Tracks scrolling so that the buffer knows which lines are
+   * visible and can prioritize background work accordingly.
+   */
+  GSignalGroup *vadjustment_signals;
+  guint visible_range_source;
+
   /* Mouse click position */
   double click_x;
   double click_y;
@@ -603,6 +603,41 @@ ide_source_view_buffer_paste_done_cb (IdeSourceView *self,
   IDE_EXIT;
 }
 
+static gboolean
+ide_source_view_update_visible_range (gpointer user_data)
+{
+  IdeSourceView *self = user_data;
+  GdkRectangle visible_rect;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (IDE_IS_SOURCE_VIEW (self));
+
+  self->visible_range_source = 0;
+
+  if (self->buffer == NULL || !gtk_widget_get_mapped (GTK_WIDGET (self)))
+    return G_SOURCE_REMOVE;
+
+  gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (self), &visible_rect);
+  gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (self), &begin, visible_rect.y, NULL);
+  gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (self), &end, visible_rect.y + visible_rect.height, NULL);
+
+  ide_buffer_set_visible_lines (self->buffer,
+                                gtk_text_iter_get_line (&begin),
+                                gtk_text_iter_get_line (&end));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_source_view_queue_update_visible_range (IdeSourceView *self)
+{
+  g_assert (IDE_IS_SOURCE_VIEW (self));
+
+  if (self->visible_range_source == 0)
+    self->visible_range_source = g_idle_add (ide_source_view_update_visible_range, self);
+}
+
 static void
 ide_source_view_connect_buffer (IdeSourceView *self,
                                 IdeBuffer     *buffer)
@@ -685,6 +720,8 @@ ide_source_view_connect_buffer (IdeSourceView *self,
   /* Load addins immediately */
   language = gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (buffer));
   _ide_source_view_addins_init (self, language);
+
+  ide_source_view_queue_update_visible_range (self);
 }
 
 static void
@@ -881,6 +918,8 @@ ide_source_view_size_allocate (GtkWidget *widget,
 
   if (self->overscroll_source == 0)
     self->overscroll_source = g_idle_add (ide_source_view_update_overscroll, self);
+
+  ide_source_view_queue_update_visible_range (self);
 }
 
 static void
@@ -1280,9 +1319,12 @@ ide_source_view_dispose (GObject *object)
 
   g_clear_handle_id (&self->overscroll_source, g_source_remove);
   g_clear_handle_id (&self->pending_scroll_source, g_source_remove);
+  g_clear_handle_id (&self->visible_range_source, g_source_remove);
 
   ide_source_view_disconnect_buffer (self);
 
+  g_clear_object (&self->vadjustment_signals);
+
   g_clear_object (&self->search_context);
   g_clear_object (&self->joined_menu);
   g_clear_object (&self->css_provider);
@@ -1508,6 +1550,17 @@ ide_source_view_init (IdeSourceView *self)
                     G_CALLBACK (ide_source_view_notify_buffer_cb),
                     NULL);
 
+  /* Let the buffer know which lines are visible as we scroll */
+  self->vadjustment_signals = g_signal_group_new (GTK_TYPE_ADJUSTMENT);
+  g_signal_group_connect_object (self->vadjustment_signals,
+                                 "value-changed",
+                                 G_CALLBACK (ide_source_view_queue_update_visible_range),
+                                 self,
+                                 G_CONNECT_SWAPPED);
+  g_object_bind_property (self, "vadjustment",
+                          self->vadjustment_signals, "target",
+                          G_BINDING_SYNC_CREATE);
+
   /* Setup our extra menu so that consumers can use
    * ide_source_view_append_menu() or similar to update menus.
    */
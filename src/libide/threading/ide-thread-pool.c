@@ -27,10 +27,32 @@
 #include "ide-thread-pool.h"
 #include "ide-thread-private.h"
 
+/* Each pool has a shared injection queue and a deque per worker thread.
+ *
+ * Work pushed from outside the pool lands in the injection queue, which is
+ * ordered by a deadline of the enqueue time plus a penalty derived from
+ * the priority. Since every item ages at the same rate, this is equivalent
+ * to boosting queued items over time, and lets background work eventually
+ * run without the scheduler having to revisit queued items.
+ *
+ * Work pushed from a worker of the same pool (such as a task spawning
+ * sub-tasks) goes to that worker's own deque, which it drains LIFO for
+ * cache locality. Idle workers steal the oldest item from the longest
+ * sibling deque so that bursts of sub-tasks are spread across the pool.
+ */
+
+#define AGING_USEC_PER_PRIORITY (G_USEC_PER_SEC / 100)
+#define WORKER_IDLE_TIMEOUT     (G_USEC_PER_SEC * 15)
+
+typedef struct _Worker Worker;
+
 typedef struct
 {
-  int type;
-  int priority;
+  int     type;
+  int     priority;
+  gint64  queued_at;
+  gint64  deadline;
+  guint64 seq;
   union {
     struct {
       GTask           *task;
@@ -43,36 +65,203 @@ typedef struct
   };
 } WorkItem;
 
+struct _Worker
+{
+  IdeThreadPool *pool;
+  GList          link;
+  GQueue         local;
+};
+
 struct _IdeThreadPool
 {
-  GThreadPool       *pool;
+  GMutex             mutex;
+  GCond              cond;
+  GSequence         *queue;
+  GQueue             workers;
   IdeThreadPoolKind  kind;
+  const char        *name;
   guint              max_threads;
-  guint              worker_max_threads;
-  gboolean           exclusive;
+  guint              n_threads;
+  guint              n_idle;
+  guint              n_signalled;
+  guint64            seq;
+  guint              depth_counter;
+
+  /* Statistics, protected by mutex */
+  guint              depth;
+  guint              max_depth;
+  guint64            n_completed;
+  guint64            n_stolen;
+  gint64             total_wait;
+  gint64             max_wait;
+  gint64             total_run;
 };
 
 static IdeThreadPool thread_pools[] = {
-  { NULL, IDE_THREAD_POOL_DEFAULT, 10, 1, FALSE },
-  { NULL, IDE_THREAD_POOL_COMPILER, 8, 8, FALSE },
-  { NULL, IDE_THREAD_POOL_INDEXER,  1, 1, FALSE },
-  { NULL, IDE_THREAD_POOL_IO,       8, 1, FALSE },
-  { NULL, IDE_THREAD_POOL_LAST,     0, 0, FALSE }
+  { .kind = IDE_THREAD_POOL_DEFAULT,  .name = "default" },
+  { .kind = IDE_THREAD_POOL_COMPILER, .name = "compiler" },
+  { .kind = IDE_THREAD_POOL_INDEXER,  .name = "indexer" },
+  { .kind = IDE_THREAD_POOL_IO,       .name = "io" },
+  { .kind = IDE_THREAD_POOL_LAST },
 };
 
+static GPrivate current_worker;
+
 enum {
   TYPE_TASK,
   TYPE_FUNC,
 };
 
-static inline GThreadPool *
+static gpointer ide_thread_pool_worker (gpointer data);
+
+static inline IdeThreadPool *
 ide_thread_pool_get_pool (IdeThreadPoolKind kind)
 {
   /* Fallback to allow using without IdeApplication */
-  if G_UNLIKELY (thread_pools [kind].pool == NULL)
+  if G_UNLIKELY (thread_pools [kind].queue == NULL)
     _ide_thread_pool_init (TRUE);
 
-  return thread_pools [kind].pool;
+  return &thread_pools [kind];
+}
+
+static gint
+work_item_compare (gconstpointer a,
+                   gconstpointer b,
+                   gpointer      user_data)
+{
+  const WorkItem *a_item = a;
+  const WorkItem *b_item = b;
+
+  if (a_item->deadline < b_item->deadline)
+    return -1;
+  else if (a_item->deadline > b_item->deadline)
+    return 1;
+
+  return a_item->seq < b_item->seq ? -1 : a_item->seq > b_item->seq;
+}
+
+static void
+ide_thread_pool_spawn_locked (IdeThreadPool *pool)
+{
+  g_autoptr(GError) error = NULL;
+  GThread *thread;
+  Worker *worker;
+
+  g_assert (pool != NULL);
+
+  worker = g_slice_new0 (Worker);
+  worker->pool = pool;
+  worker->link.data = worker;
+
+  g_queue_push_tail_link (&pool->workers, &worker->link);
+  pool->n_threads++;
+
+  if (!(thread = g_thread_try_new (pool->name, ide_thread_pool_worker, worker, &error)))
+    {
+      g_warning ("Failed to spawn %s thread pool worker: %s",
+                 pool->name, error->message);
+      g_queue_unlink (&pool->workers, &worker->link);
+      pool->n_threads--;
+      g_slice_free (Worker, worker);
+      return;
+    }
+
+  g_thread_unref (thread);
+}
+
+static void
+ide_thread_pool_push_item (IdeThreadPool *pool,
+                           WorkItem      *work_item)
+{
+  Worker *worker = g_private_get (&current_worker);
+
+  g_assert (pool != NULL);
+  g_assert (work_item != NULL);
+
+  work_item->queued_at = g_get_monotonic_time ();
+  work_item->deadline = work_item->queued_at + (gint64)work_item->priority * AGING_USEC_PER_PRIORITY;
+
+  g_mutex_lock (&pool->mutex);
+
+  work_item->seq = pool->seq++;
+
+  if (worker != NULL && worker->pool == pool)
+    g_queue_push_tail (&worker->local, work_item);
+  else
+    g_sequence_insert_sorted (pool->queue, work_item, work_item_compare, NULL);
+
+  pool->depth++;
+  pool->max_depth = MAX (pool->max_depth, pool->depth);
+  ide_trace_set_counter (pool->depth_counter, pool->depth);
+
+  /* Only wake idle workers that do not already have a wakeup pending,
+   * otherwise a burst of pushes would keep signalling the same worker
+   * while the remaining items wait for it.
+   */
+  if (pool->n_idle > pool->n_signalled)
+    {
+      pool->n_signalled++;
+      g_cond_signal (&pool->cond);
+    }
+  else if (pool->n_threads < pool->max_threads)
+    ide_thread_pool_spawn_locked (pool);
+
+  g_mutex_unlock (&pool->mutex);
+}
+
+static WorkItem *
+ide_thread_pool_pop_locked (IdeThreadPool *pool,
+                            Worker        *worker)
+{
+  GSequenceIter *iter;
+  WorkItem *global = NULL;
+  WorkItem *local;
+  WorkItem *ret = NULL;
+
+  g_assert (pool != NULL);
+  g_assert (worker != NULL);
+
+  iter = g_sequence_get_begin_iter (pool->queue);
+  if (!g_sequence_iter_is_end (iter))
+    global = g_sequence_get (iter);
+  local = g_queue_peek_tail (&worker->local);
+
+  if (local != NULL && (global == NULL || local->deadline <= global->deadline))
+    {
+      ret = g_queue_pop_tail (&worker->local);
+    }
+  else if (global != NULL)
+    {
+      ret = global;
+      g_sequence_remove (iter);
+    }
+  else
+    {
+      Worker *victim = NULL;
+
+      for (const GList *l = pool->workers.head; l; l = l->next)
+        {
+          Worker *sibling = l->data;
+
+          if (sibling != worker &&
+              sibling->local.length > (victim ? victim->local.length : 0))
+            victim = sibling;
+        }
+
+      if (victim != NULL)
+        {
+          ret = g_queue_pop_head (&victim->local);
+          pool->n_stolen++;
+        }
+    }
+
+  if (ret != NULL)
+    {
+      pool->depth--;
+      ide_trace_set_counter (pool->depth_counter, pool->depth);
+    }
+
+  return ret;
 }
 
 /**
@@ -89,7 +278,8 @@ ide_thread_pool_push_task (IdeThreadPoolKind  kind,
                            GTask             *task,
                            GTaskThreadFunc    func)
 {
-  GThreadPool *pool;
+  IdeThreadPool *pool;
+  WorkItem *work_item;
 
   IDE_ENTRY;
 
@@ -100,22 +290,13 @@ ide_thread_pool_push_task (IdeThreadPoolKind  kind,
 
   pool = ide_thread_pool_get_pool (kind);
 
-  if (pool != NULL)
-    {
-      WorkItem *work_item;
+  work_item = g_slice_new0 (WorkItem);
+  work_item->type = TYPE_TASK;
+  work_item->priority = g_task_get_priority (task);
+  work_item->task.task = g_object_ref (task);
+  work_item->task.func = func;
 
-      work_item = g_slice_new0 (WorkItem);
-      work_item->type = TYPE_TASK;
-      work_item->priority = g_task_get_priority (task);
-      work_item->task.task = g_object_ref (task);
-      work_item->task.func = func;
-
-      g_thread_pool_push (pool, work_item, NULL);
-    }
-  else
-    {
-      g_task_run_in_thread (task, func);
-    }
+  ide_thread_pool_push_item (pool, work_item);
 
   IDE_EXIT;
 }
@@ -144,6 +325,10 @@ ide_thread_pool_push (IdeThreadPoolKind kind,
  * @func_data: user data for @func.
  *
  * Runs the callback on the thread pool thread.
+ *
+ * Lower values of @priority run first, but queued work is aged so that
+ * low priority work is not starved by a steady stream of higher priority
+ * work.
  */
 void
 ide_thread_pool_push_with_priority (IdeThreadPoolKind kind,
@@ -151,7 +336,8 @@ ide_thread_pool_push_with_priority (IdeThreadPoolKind kind,
                                     IdeThreadFunc     func,
                                     gpointer          func_data)
 {
-  GThreadPool *pool;
+  IdeThreadPool *pool;
+  WorkItem *work_item;
 
   IDE_ENTRY;
 
@@ -161,32 +347,51 @@ ide_thread_pool_push_with_priority (IdeThreadPoolKind kind,
 
   pool = ide_thread_pool_get_pool (kind);
 
-  if (pool != NULL)
-    {
-      WorkItem *work_item;
+  work_item = g_slice_new0 (WorkItem);
+  work_item->type = TYPE_FUNC;
+  work_item->priority = priority;
+  work_item->func.callback = func;
+  work_item->func.data = func_data;
 
-      work_item = g_slice_new0 (WorkItem);
-      work_item->type = TYPE_FUNC;
-      work_item->priority = priority;
-      work_item->func.callback = func;
-      work_item->func.data = func_data;
-
-      g_thread_pool_push (pool, work_item, NULL);
-    }
-  else
-    {
-      g_critical ("No such thread pool %02x", kind);
-    }
+  ide_thread_pool_push_item (pool, work_item);
 
   IDE_EXIT;
 }
 
-static void
-ide_thread_pool_worker (gpointer data,
-                        gpointer user_data)
+/**
+ * ide_thread_pool_get_max_threads:
+ * @kind: the threadpool kind
+ *
+ * Gets the number of threads the pool for @kind may use.
+ *
+ * This is useful for work which happens outside of the pool (such as in a
+ * subprocess) but should respect the same concurrency budget.
+ *
+ * Returns: the maximum number of threads for the pool
+ *
+ * Since: 47
+ */
+guint
+ide_thread_pool_get_max_threads (IdeThreadPoolKind kind)
 {
-  WorkItem *work_item = data;
+  IdeThreadPool *pool;
+  guint ret;
+
+  g_return_val_if_fail (kind >= 0, 1);
+  g_return_val_if_fail (kind < IDE_THREAD_POOL_LAST, 1);
+
+  pool = ide_thread_pool_get_pool (kind);
+
+  g_mutex_lock (&pool->mutex);
+  ret = pool->max_threads;
+  g_mutex_unlock (&pool->mutex);
 
+  return ret;
+}
+
+static void
+ide_thread_pool_run (WorkItem *work_item)
+{
   g_assert (work_item != NULL);
 
   if (work_item->type == TYPE_TASK)
@@ -208,15 +413,118 @@ ide_thread_pool_worker (gpointer data,
   g_slice_free (WorkItem, work_item);
 }
 
-static gint
-thread_pool_sort_func (gconstpointer a,
-                       gconstpointer b,
-                       gpointer      user_data)
+static gpointer
+ide_thread_pool_worker (gpointer data)
 {
-  const WorkItem *a_item = a;
-  const WorkItem *b_item = b;
+  Worker *worker = data;
+  IdeThreadPool *pool = worker->pool;
+
+  g_assert (worker != NULL);
+  g_assert (pool != NULL);
+
+  g_private_set (&current_worker, worker);
+
+  g_mutex_lock (&pool->mutex);
+
+  for (;;)
+    {
+      WorkItem *work_item;
+      gint64 begin;
+      gint64 wait;
 
-  return a_item->priority - b_item->priority;
+      if (!(work_item = ide_thread_pool_pop_locked (pool, worker)))
+        {
+          gint64 end_time = g_get_monotonic_time () + WORKER_IDLE_TIMEOUT;
+          gboolean signaled;
+
+          pool->n_idle++;
+          while (pool->n_signalled == 0)
+            {
+              if (!g_cond_wait_until (&pool->cond, &pool->mutex, end_time))
+                break;
+            }
+          if ((signaled = pool->n_signalled > 0))
+            pool->n_signalled--;
+          pool->n_idle--;
+
+          if (signaled)
+            continue;
+
+          /* Exit the thread after being idle for a while */
+          if (!(work_item = ide_thread_pool_pop_locked (pool, worker)))
+            break;
+        }
+
+      g_mutex_unlock (&pool->mutex);
+
+      begin = g_get_monotonic_time ();
+      wait = begin - work_item->queued_at;
+      ide_thread_pool_run (work_item);
+
+      g_mutex_lock (&pool->mutex);
+
+      pool->n_completed++;
+      pool->total_wait += wait;
+      pool->max_wait = MAX (pool->max_wait, wait);
+      pool->total_run += g_get_monotonic_time () - begin;
+    }
+
+  g_assert (worker->local.length == 0);
+
+  g_queue_unlink (&pool->workers, &worker->link);
+  pool->n_threads--;
+
+  g_mutex_unlock (&pool->mutex);
+
+  g_private_set (&current_worker, NULL);
+  g_slice_free (Worker, worker);
+
+  return NULL;
+}
+
+static guint
+ide_thread_pool_compute_max_threads (IdeThreadPool *pool,
+                                     gboolean       is_worker)
+{
+  g_autofree char *env_name = NULL;
+  g_autofree char *upper = NULL;
+  guint n_cpu = MAX (1, g_get_num_processors ());
+  const char *env;
+
+  g_assert (pool != NULL);
+
+  /* Allow overriding the pool size, such as IDE_THREAD_POOL_INDEXER=4 */
+  upper = g_ascii_strup (pool->name, -1);
+  env_name = g_strdup_printf ("IDE_THREAD_POOL_%s", upper);
+
+  if ((env = g_getenv (env_name)))
+    {
+      guint64 n = g_ascii_strtoull (env, NULL, 10);
+
+      if (n > 0)
+        return MIN (n, 256);
+    }
+
+  switch (pool->kind)
+    {
+    case IDE_THREAD_POOL_DEFAULT:
+      return is_worker ? 1 : CLAMP (n_cpu, 4, 16);
+
+    case IDE_THREAD_POOL_COMPILER:
+      return n_cpu;
+
+    case IDE_THREAD_POOL_INDEXER:
+      return is_worker ? 1 : CLAMP (n_cpu / 4, 1, 4);
+
+    case IDE_THREAD_POOL_IO:
+      return is_worker ? 1 : CLAMP (n_cpu / 2, 2, 8);
+
+    case IDE_THREAD_POOL_LAST:
+    default:
+      break;
+    }
+
+  g_return_val_if_reached (1);
 }
 
 void
@@ -231,20 +539,42 @@ _ide_thread_pool_init (gboolean is_worker)
            kind++)
         {
           IdeThreadPool *p = &thread_pools[kind];
-          g_autoptr(GError) error = NULL;
-
-          p->pool = g_thread_pool_new (ide_thread_pool_worker,
-                                       NULL,
-                                       is_worker ? p->worker_max_threads : p->max_threads,
-                                       p->exclusive,
-                                       &error);
-          g_thread_pool_set_sort_function (p->pool, thread_pool_sort_func, NULL);
-
-          if (error != NULL)
-            g_error ("Failed to initialize thread pool %u: %s",
-                     p->kind, error->message);
+
+          g_mutex_init (&p->mutex);
+          g_cond_init (&p->cond);
+          p->max_threads = ide_thread_pool_compute_max_threads (p, is_worker);
+          p->queue = g_sequence_new (NULL);
+          p->depth_counter = ide_trace_define_counter ("Thread Pools", p->name,
+                                                       "Number of queued work items");
         }
 
       g_once_init_leave (&initialized, TRUE);
     }
 }
+
+void
+_ide_thread_pool_dump_stats (void)
+{
+  for (IdeThreadPoolKind kind = IDE_THREAD_POOL_DEFAULT;
+       kind < IDE_THREAD_POOL_LAST;
+       kind++)
+    {
+      IdeThreadPool *p = &thread_pools[kind];
+      guint64 n;
+
+      if (p->queue == NULL)
+        continue;
+
+      g_mutex_lock (&p->mutex);
+      n = MAX (1, p->n_completed);
+      g_printerr ("%-8s threads=%u/%u idle=%u queued=%u max-queued=%u "
+                  "completed=%"G_GUINT64_FORMAT" stolen=%"G_GUINT64_FORMAT" "
+                  "wait=%.3lfms max-wait=%.3lfms run=%.3lfms\n",
+                  p->name, p->n_threads, p->max_threads, p->n_idle,
+                  p->depth, p->max_depth, p->n_completed, p->n_stolen,
+                  p->total_wait / (double)n / 1000.0,
+                  p->max_wait / 1000.0,
+                  p->total_run / (double)n / 1000.0);
+      g_mutex_unlock (&p->mutex);
+    }
+}
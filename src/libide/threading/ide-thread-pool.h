@@ -61,5 +61,7 @@ IDE_AVAILABLE_IN_ALL
 void ide_thread_pool_push_task          (IdeThreadPoolKind  kind,
                                          GTask             *task,
                                          GTaskThreadFunc    func);
+IDE_AVAILABLE_IN_47
+guint ide_thread_pool_get_max_threads   (IdeThreadPoolKind  kind);
 
 G_END_DECLS
@@ -24,7 +24,8 @@
 
 G_BEGIN_DECLS
 
-void _ide_thread_pool_init (gboolean is_worker);
-void _ide_dump_tasks       (void);
+void _ide_thread_pool_init       (gboolean is_worker);
+void _ide_thread_pool_dump_stats (void);
+void _ide_dump_tasks             (void);
 
 G_END_DECLS
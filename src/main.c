@@ -98,11 +98,57 @@ trace_log (GLogLevelFlags  log_level,
   sysprof_collector_log (log_level, domain, message);
 }
 
+static void
+trace_mark (gint64       begin_time_usec,
+            gint64       end_time_usec,
+            const gchar *group,
+            const gchar *name,
+            const gchar *message)
+{
+  sysprof_collector_mark (begin_time_usec * 1000L,
+                          (end_time_usec - begin_time_usec) * 1000L,
+                          group,
+                          name,
+                          message);
+}
+
+static guint
+trace_define_counter (const gchar *category,
+                      const gchar *name,
+                      const gchar *description)
+{
+  SysprofCaptureCounter counter = {{0}};
+
+  counter.id = sysprof_collector_request_counters (1);
+  counter.type = SYSPROF_CAPTURE_COUNTER_INT64;
+  counter.value.v64 = 0;
+  g_strlcpy (counter.category, category, sizeof counter.category);
+  g_strlcpy (counter.name, name, sizeof counter.name);
+  g_strlcpy (counter.description, description, sizeof counter.description);
+
+  sysprof_collector_define_counters (&counter, 1);
+
+  return counter.id;
+}
+
+static void
+trace_set_counter (guint  counter_id,
+                   gint64 value)
+{
+  SysprofCaptureCounterValue counter_value;
+
+  counter_value.v64 = value;
+  sysprof_collector_set_counters (&counter_id, &counter_value, 1);
+}
+
 static IdeTraceVTable trace_vtable = {
   trace_load,
   trace_unload,
   trace_function,
   trace_log,
+  trace_mark,
+  trace_define_counter,
+  trace_set_counter,
 };
 #endif
 
@@ -45,18 +45,44 @@
 #define FAKE_VALAC   "__LIBIDE_FAKE_VALAC__"
 #define PRINT_VARS   "include Makefile\nprint-%: ; @echo $* = $($*)\n"
 
+/*
+ * Rather than searching the make database for every file we are asked
+ * about, it is scanned once when the makecache is loaded to build an index
+ * from file basename to the targets depending on it. The index is saved
+ * next to the makecache (see INDEX_TYPE) along with the mtime and size of
+ * the makecache it was built from, so it is only rebuilt when make -p
+ * produced a new database.
+ *
+ * Flags can only be discovered by asking make how it would build a target,
+ * so those are still resolved lazily. Once resolved they are stored per
+ * target in the flags file next to the makecache, tagged with the same
+ * generation, so that reopening the project does not need to run make
+ * again for every file.
+ */
+#define INDEX_VERSION 1
+#define INDEX_TYPE    "(uxta{sa(ss)})"
+#define INDEX_SUFFIX  ".index"
+#define FLAGS_SUFFIX  ".flags"
+
 struct _IdeMakecache
 {
   IdeObject     parent_instance;
 
   GFile        *parent;
+  gchar        *cache_path;
   GMappedFile  *mapped;
+  GHashTable   *index;
   IdeTaskCache *file_targets_cache;
   IdeTaskCache *file_flags_cache;
   GPtrArray    *build_targets;
   IdeRuntime   *runtime;
   IdePipeline  *pipeline;
   const gchar  *make_name;
+
+  /* Target flags resolved with make, see FLAGS_SUFFIX */
+  GMutex        flags_mutex;
+  GKeyFile     *flags;
+  gchar        *generation;
 };
 
 typedef struct
@@ -69,8 +95,8 @@ typedef struct
 
 typedef struct
 {
-  GMappedFile *mapped;
-  gchar       *path;
+  GHashTable *index;
+  gchar      *path;
 } FileTargetsLookup;
 
 typedef struct
@@ -115,7 +141,7 @@ file_targets_lookup_free (gpointer data)
   FileTargetsLookup *lookup = data;
 
   g_clear_pointer (&lookup->path, g_free);
-  g_clear_pointer (&lookup->mapped, g_mapped_file_unref);
+  g_clear_pointer (&lookup->index, g_hash_table_unref);
   g_slice_free (FileTargetsLookup, lookup);
 }
 
@@ -164,22 +190,47 @@ is_target_interesting (const gchar *target)
            g_str_has_suffix (target, ".o")));
 }
 
-/**
- * ide_makecache_get_file_targets_searched:
+static void
+ide_makecache_index_add (GHashTable         *index,
+                         const gchar        *name,
+                         gsize               name_len,
+                         IdeMakecacheTarget *target)
+{
+  g_autofree gchar *key = g_strndup (name, name_len);
+  GPtrArray *targets;
+
+  g_assert (index != NULL);
+  g_assert (target != NULL);
+
+  if (!(targets = g_hash_table_lookup (index, key)))
+    {
+      targets = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_makecache_target_unref);
+      g_hash_table_insert (index, g_steal_pointer (&key), targets);
+    }
+
+  for (guint i = 0; i < targets->len; i++)
+    {
+      if (ide_makecache_target_equal (g_ptr_array_index (targets, i), target))
+        return;
+    }
+
+  g_ptr_array_add (targets, ide_makecache_target_ref (target));
+}
+
+/*
+ * Scans the make database once, looking for rules like "foo.lo: ... foo.c"
+ * and adding the target to the index for the basename of every file it
+ * depends on.
  *
- * Returns: (transfer container): a #GPtrArray of #IdeMakecacheTarget.
+ * We can end up with the same filename in multiple subdirectories. We should
+ * be careful about that later when we extract flags to choose the best match
+ * first.
  */
-static GPtrArray *
-ide_makecache_get_file_targets_searched (GMappedFile *mapped,
-                                         const gchar *path)
+static GHashTable *
+ide_makecache_build_index (GMappedFile *mapped)
 {
-  g_autofree gchar *escaped = NULL;
-  g_autofree gchar *name = NULL;
-  g_autofree gchar *regexstr = NULL;
+  g_autoptr(GHashTable) index = NULL;
   g_autofree gchar *subdir = NULL;
-  g_autoptr(GHashTable) found = NULL;
-  g_autoptr(GPtrArray) targets = NULL;
-  g_autoptr(GRegex) regex = NULL;
   const gchar *content;
   const gchar *line;
   IdeLineReader rl;
@@ -188,46 +239,25 @@ ide_makecache_get_file_targets_searched (GMappedFile *mapped,
 
   IDE_ENTRY;
 
-  g_assert (path);
-
-  /*
-   * TODO:
-   *
-   * We can end up with the same filename in multiple subdirectories. We should be careful about
-   * that later when we extract flags to choose the best match first.
-   */
-  name = g_path_get_basename (path);
-  escaped = g_regex_escape_string (name, -1);
-  regexstr = g_strdup_printf ("^([^:\n ]+):.*\\b(%s)\\b", escaped);
-
-  regex = g_regex_new (regexstr, 0, 0, NULL);
-  if (!regex)
-    IDE_RETURN (NULL);
+  g_assert (mapped != NULL);
 
   content = g_mapped_file_get_contents (mapped);
   len = g_mapped_file_get_length (mapped);
 
-  targets = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_makecache_target_unref);
-  found = g_hash_table_new (ide_makecache_target_hash, ide_makecache_target_equal);
-
-#ifdef IDE_ENABLE_TRACE
-  {
-    gchar *fmtsize;
-
-    fmtsize = g_format_size (len);
-    IDE_TRACE_MSG ("Beginning regex lookup across %s of UTF-8 text", fmtsize);
-    g_free (fmtsize);
-  }
-#endif
+  index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
 
   if (len > G_MAXSSIZE)
-    IDE_RETURN (NULL);
+    IDE_RETURN (g_steal_pointer (&index));
 
   ide_line_reader_init (&rl, (gchar *)content, len);
 
   while ((line = ide_line_reader_next (&rl, &line_len)))
     {
-      g_autoptr(GMatchInfo) match_info = NULL;
+      g_autoptr(IdeMakecacheTarget) target = NULL;
+      g_autofree gchar *targetstr = NULL;
+      const gchar *colon;
+      const gchar *end = line + line_len;
+      const gchar *iter;
 
       /*
        * Keep track of "subdir = <dir>" changes so we know what directory
@@ -240,72 +270,322 @@ ide_makecache_get_file_targets_searched (GMappedFile *mapped,
           continue;
         }
 
-      if (g_regex_match_full (regex, line, line_len, 0, 0, &match_info, NULL))
+      if (!(colon = memchr (line, ':', line_len)) ||
+          colon == line ||
+          memchr (line, ' ', colon - line) != NULL)
+        continue;
+
+      targetstr = g_strndup (line, colon - line);
+
+      if (!is_target_interesting (targetstr))
+        continue;
+
+      target = ide_makecache_target_new (subdir, targetstr);
+
+      for (iter = colon + 1; iter < end;)
         {
-          while (g_match_info_matches (match_info))
+          const gchar *word;
+          const gchar *base;
+
+          while (iter < end && g_ascii_isspace (*iter))
+            iter++;
+
+          word = base = iter;
+
+          while (iter < end && !g_ascii_isspace (*iter))
             {
-              g_autofree gchar *targetstr = NULL;
+              if (*iter == G_DIR_SEPARATOR)
+                base = iter + 1;
+              iter++;
+            }
 
-              targetstr = g_match_info_fetch (match_info, 1);
+          if (iter > base && *word != '|')
+            ide_makecache_index_add (index, base, iter - base, target);
+        }
+    }
 
-              if (is_target_interesting (targetstr))
-                {
-                  g_autoptr(IdeMakecacheTarget) target = NULL;
+  IDE_TRACE_MSG ("Indexed %u files from makecache", g_hash_table_size (index));
 
-                  target = ide_makecache_target_new (subdir, targetstr);
+  IDE_RETURN (g_steal_pointer (&index));
+}
 
-                  if (!g_hash_table_contains (found, target))
-                    {
-                      g_hash_table_insert (found, target, NULL);
-                      g_ptr_array_add (targets, g_steal_pointer (&target));
-                    }
-                }
+static GVariant *
+ide_makecache_serialize_index (GHashTable *index,
+                               gint64      mtime,
+                               guint64     size)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *name;
+  GPtrArray *targets;
 
-              g_match_info_next (match_info, NULL);
-            }
+  g_assert (index != NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (INDEX_TYPE));
+  g_variant_builder_add (&builder, "u", INDEX_VERSION);
+  g_variant_builder_add (&builder, "x", mtime);
+  g_variant_builder_add (&builder, "t", size);
+  g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sa(ss)}"));
+
+  g_hash_table_iter_init (&iter, index);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, (gpointer *)&targets))
+    {
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa(ss)}"));
+      g_variant_builder_add (&builder, "s", name);
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(ss)"));
+      for (guint i = 0; i < targets->len; i++)
+        {
+          IdeMakecacheTarget *target = g_ptr_array_index (targets, i);
+
+          g_variant_builder_add (&builder, "(ss)",
+                                 ide_makecache_target_get_subdir (target) ?: "",
+                                 ide_makecache_target_get_target (target));
         }
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
     }
 
-  IDE_TRACE_MSG ("Regex scan complete");
+  g_variant_builder_close (&builder);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static GHashTable *
+ide_makecache_load_index (const gchar *path,
+                          gint64       mtime,
+                          guint64      size)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GHashTable) index = NULL;
+  g_autoptr(GVariantIter) files = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  GVariantIter *pairs;
+  const gchar *name;
+  guint64 cached_size = 0;
+  gint64 cached_mtime = 0;
+  guint version = 0;
+
+  g_assert (path != NULL);
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  variant = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (INDEX_TYPE), bytes, FALSE));
+
+  g_variant_get (variant, "(uxta{sa(ss)})", &version, &cached_mtime, &cached_size, &files);
+
+  if (version != INDEX_VERSION || cached_mtime != mtime || cached_size != size)
+    return NULL;
+
+  index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
 
-  if (targets->len > 0)
+  while (g_variant_iter_next (files, "{&sa(ss)}", &name, &pairs))
     {
-#ifdef IDE_ENABLE_TRACE
-      {
-        GString *str;
-        gsize i;
+      GPtrArray *targets = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_makecache_target_unref);
+      const gchar *subdir;
+      const gchar *target;
 
-        str = g_string_new (NULL);
+      while (g_variant_iter_next (pairs, "(&s&s)", &subdir, &target))
+        g_ptr_array_add (targets, ide_makecache_target_new (subdir[0] ? subdir : NULL, target));
 
-        for (i = 0; i < targets->len; i++)
-          {
-            const gchar *target_subdir;
-            const gchar *target;
-            IdeMakecacheTarget *cur;
+      g_hash_table_insert (index, g_strdup (name), targets);
+      g_variant_iter_free (pairs);
+    }
 
-            cur = g_ptr_array_index (targets, i);
+  return g_steal_pointer (&index);
+}
 
-            target_subdir = ide_makecache_target_get_subdir (cur);
-            target = ide_makecache_target_get_target (cur);
+/*
+ * Loads the index for the makecache from disk if it is still valid, or
+ * builds and saves a new one.
+ */
+static GHashTable *
+ide_makecache_ensure_index (IdeMakecache *self)
+{
+  g_autofree gchar *index_path = NULL;
+  g_autoptr(GVariant) serialized = NULL;
+  g_autoptr(GError) error = NULL;
+  GHashTable *index;
+  GStatBuf st;
 
-            if (target_subdir != NULL)
-              g_string_append_printf (str, " (%s of subdir %s)", target, target_subdir);
-            else
-              g_string_append_printf (str, " %s", target);
-          }
+  IDE_ENTRY;
 
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (self->cache_path != NULL);
+  g_assert (self->mapped != NULL);
 
-        IDE_TRACE_MSG ("File \"%s\" found in targets: %s", path, str->str);
-        g_string_free (str, TRUE);
-      }
-#endif
+  if (g_stat (self->cache_path, &st) != 0)
+    IDE_RETURN (ide_makecache_build_index (self->mapped));
 
-      g_ptr_array_ref (targets);
+  self->generation = g_strdup_printf ("%"G_GINT64_FORMAT":%"G_GUINT64_FORMAT,
+                                      (gint64)st.st_mtime, (guint64)st.st_size);
 
-      IDE_RETURN (targets);
+  index_path = g_strconcat (self->cache_path, INDEX_SUFFIX, NULL);
+
+  if ((index = ide_makecache_load_index (index_path, st.st_mtime, st.st_size)))
+    {
+      g_debug ("Using makecache index from %s", index_path);
+      IDE_RETURN (index);
     }
 
-  IDE_RETURN (NULL);
+  index = ide_makecache_build_index (self->mapped);
+  serialized = ide_makecache_serialize_index (index, st.st_mtime, st.st_size);
+
+  if (!g_file_set_contents (index_path,
+                            g_variant_get_data (serialized),
+                            g_variant_get_size (serialized),
+                            &error))
+    g_debug ("Failed to save makecache index: %s", error->message);
+
+  IDE_RETURN (index);
+}
+
+static void
+ide_makecache_load_flags (IdeMakecache *self)
+{
+  g_autofree gchar *flags_path = NULL;
+  g_autofree gchar *generation = NULL;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (self->cache_path != NULL);
+
+  self->flags = g_key_file_new ();
+
+  if (self->generation == NULL)
+    return;
+
+  flags_path = g_strconcat (self->cache_path, FLAGS_SUFFIX, NULL);
+
+  if (!g_key_file_load_from_file (self->flags, flags_path, G_KEY_FILE_NONE, NULL) ||
+      !(generation = g_key_file_get_string (self->flags, "makecache", "generation", NULL)) ||
+      !g_str_equal (generation, self->generation))
+    {
+      g_clear_pointer (&self->flags, g_key_file_unref);
+      self->flags = g_key_file_new ();
+      g_key_file_set_string (self->flags, "makecache", "generation", self->generation);
+    }
+}
+
+static gchar *
+ide_makecache_target_key (IdeMakecacheTarget *target)
+{
+  const gchar *subdir = ide_makecache_target_get_subdir (target);
+
+  return g_build_filename (subdir ?: ".", ide_makecache_target_get_target (target), NULL);
+}
+
+static gchar **
+ide_makecache_lookup_flags (IdeMakecache       *self,
+                            IdeMakecacheTarget *target)
+{
+  g_autofree gchar *key = NULL;
+  gchar **ret;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (target != NULL);
+
+  key = ide_makecache_target_key (target);
+
+  g_mutex_lock (&self->flags_mutex);
+  ret = g_key_file_get_string_list (self->flags, "flags", key, NULL, NULL);
+  g_mutex_unlock (&self->flags_mutex);
+
+  return ret;
+}
+
+static void
+ide_makecache_store_flags (IdeMakecache        *self,
+                           IdeMakecacheTarget  *target,
+                           const gchar * const *flags)
+{
+  g_autofree gchar *flags_path = NULL;
+  g_autofree gchar *key = NULL;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_MAKECACHE (self));
+  g_assert (target != NULL);
+  g_assert (flags != NULL);
+
+  if (self->generation == NULL)
+    return;
+
+  key = ide_makecache_target_key (target);
+  flags_path = g_strconcat (self->cache_path, FLAGS_SUFFIX, NULL);
+
+  g_mutex_lock (&self->flags_mutex);
+  g_key_file_set_string_list (self->flags, "flags", key, flags, g_strv_length ((gchar **)flags));
+  if (!g_key_file_save_to_file (self->flags, flags_path, &error))
+    g_debug ("Failed to save makecache flags: %s", error->message);
+  g_mutex_unlock (&self->flags_mutex);
+}
+
+/**
+ * ide_makecache_get_file_targets_indexed:
+ *
+ * Returns: (transfer container): a #GPtrArray of #IdeMakecacheTarget.
+ */
+static GPtrArray *
+ide_makecache_get_file_targets_indexed (GHashTable  *index,
+                                        const gchar *path)
+{
+  g_autofree gchar *name = NULL;
+  GPtrArray *found;
+  GPtrArray *targets;
+
+  IDE_ENTRY;
+
+  g_assert (index != NULL);
+  g_assert (path != NULL);
+
+  name = g_path_get_basename (path);
+
+  if (!(found = g_hash_table_lookup (index, name)) || found->len == 0)
+    IDE_RETURN (NULL);
+
+  /* Copy the targets since the caller may alter them */
+  targets = g_ptr_array_new_full (found->len, (GDestroyNotify)ide_makecache_target_unref);
+
+  for (guint i = 0; i < found->len; i++)
+    {
+      IdeMakecacheTarget *target = g_ptr_array_index (found, i);
+
+      g_ptr_array_add (targets,
+                       ide_makecache_target_new (ide_makecache_target_get_subdir (target),
+                                                 ide_makecache_target_get_target (target)));
+    }
+
+#ifdef IDE_ENABLE_TRACE
+  {
+    GString *str;
+    gsize i;
+
+    str = g_string_new (NULL);
+
+    for (i = 0; i < targets->len; i++)
+      {
+        const gchar *target_subdir;
+        const gchar *target;
+        IdeMakecacheTarget *cur;
+
+        cur = g_ptr_array_index (targets, i);
+
+        target_subdir = ide_makecache_target_get_subdir (cur);
+        target = ide_makecache_target_get_target (cur);
+
+        if (target_subdir != NULL)
+          g_string_append_printf (str, " (%s of subdir %s)", target, target_subdir);
+        else
+          g_string_append_printf (str, " %s", target);
+      }
+
+    IDE_TRACE_MSG ("File \"%s\" found in targets: %s", path, str->str);
+    g_string_free (str, TRUE);
+  }
+#endif
+
+  IDE_RETURN (targets);
 }
 
 static gboolean
@@ -670,6 +950,12 @@ ide_makecache_get_file_flags_worker (GTask        *task,
 
       target = g_ptr_array_index (lookup->targets, j);
 
+      if ((ret = ide_makecache_lookup_flags (lookup->self, target)))
+        {
+          g_task_return_pointer (task, ret, (GDestroyNotify)g_strfreev);
+          IDE_EXIT;
+        }
+
       subdir = ide_makecache_target_get_subdir (target);
       targetstr = ide_makecache_target_get_target (target);
 
@@ -771,6 +1057,8 @@ ide_makecache_get_file_flags_worker (GTask        *task,
       if (ret == NULL)
         continue;
 
+      ide_makecache_store_flags (lookup->self, target, (const gchar * const *)ret);
+
       g_task_return_pointer (task, ret, (GDestroyNotify)g_strfreev);
 
       IDE_EXIT;
@@ -829,7 +1117,7 @@ ide_makecache_get_file_targets_worker (GTask        *task,
   g_assert (IDE_IS_TASK_CACHE (source_object));
   g_assert (G_IS_TASK (task));
   g_assert (lookup != NULL);
-  g_assert (lookup->mapped != NULL);
+  g_assert (lookup->index != NULL);
   g_assert (lookup->path != NULL);
 
   path = lookup->path;
@@ -841,7 +1129,7 @@ ide_makecache_get_file_targets_worker (GTask        *task,
   base = g_path_get_basename (path);
 
   /* we use an empty GPtrArray to get negative cache hits. a bit heavy handed? sure. */
-  if (!(ret = ide_makecache_get_file_targets_searched (lookup->mapped, path)))
+  if (!(ret = ide_makecache_get_file_targets_indexed (lookup->index, path)))
     ret = g_ptr_array_new ();
 
   /* If we had a vala file, we might need to translate the target */
@@ -913,7 +1201,7 @@ ide_makecache_get_file_targets_dispatch (IdeTaskCache  *cache,
   g_assert (G_IS_TASK (task));
 
   lookup = g_slice_new0 (FileTargetsLookup);
-  lookup->mapped = g_mapped_file_ref (self->mapped);
+  lookup->index = g_hash_table_ref (self->index);
 
   if (!(lookup->path = ide_makecache_get_relative_path (self, file)) &&
       !(lookup->path = g_file_get_path (file)) &&
@@ -1045,7 +1333,12 @@ ide_makecache_finalize (GObject *object)
   g_clear_object (&self->parent);
 
   g_clear_pointer (&self->mapped, g_mapped_file_unref);
+  g_clear_pointer (&self->index, g_hash_table_unref);
   g_clear_pointer (&self->build_targets, g_ptr_array_unref);
+  g_clear_pointer (&self->cache_path, g_free);
+  g_clear_pointer (&self->flags, g_key_file_unref);
+  g_clear_pointer (&self->generation, g_free);
+  g_mutex_clear (&self->flags_mutex);
 
   G_OBJECT_CLASS (ide_makecache_parent_class)->finalize (object);
 }
@@ -1058,11 +1351,26 @@ ide_makecache_class_init (IdeMakecacheClass *klass)
   object_class->finalize = ide_makecache_finalize;
 }
 
+static gsize
+ide_makecache_strv_cost (gconstpointer value,
+                         gpointer      user_data)
+{
+  const gchar * const *strv = value;
+  gsize cost = sizeof (gchar *);
+
+  for (guint i = 0; strv[i]; i++)
+    cost += sizeof (gchar *) + strlen (strv[i]) + 1;
+
+  return cost;
+}
+
 static void
 ide_makecache_init (IdeMakecache *self)
 {
   self->make_name = "make";
 
+  g_mutex_init (&self->flags_mutex);
+
   self->file_targets_cache = ide_task_cache_new ((GHashFunc)g_file_hash,
                                                  (GEqualFunc)g_file_equal,
                                                  g_object_ref,
@@ -1088,6 +1396,7 @@ ide_makecache_init (IdeMakecache *self)
                                                NULL);
 
   ide_task_cache_set_name (self->file_flags_cache, "makecache: file-flags-cache");
+  ide_task_cache_set_cost_func (self->file_flags_cache, ide_makecache_strv_cost, NULL, NULL);
 }
 
 static void
@@ -1105,9 +1414,16 @@ ide_makecache_validate_worker (GTask        *task,
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   if (!ide_makecache_validate_mapped_file (self->mapped, &error))
-    g_task_return_error (task, g_steal_pointer (&error));
-  else
-    g_task_return_pointer (task, g_object_ref (self), g_object_unref);
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  /* Nothing else touches these until the makecache is returned */
+  self->index = ide_makecache_ensure_index (self);
+  ide_makecache_load_flags (self);
+
+  g_task_return_pointer (task, g_object_ref (self), g_object_unref);
 
   IDE_EXIT;
 }
@@ -1179,6 +1495,7 @@ ide_makecache_new_for_cache_file_async (IdeRuntime          *runtime,
     }
 
   self->parent = g_steal_pointer (&parent);
+  self->cache_path = g_steal_pointer (&cache_path);
   self->mapped = g_steal_pointer (&mapped);
   self->runtime = g_object_ref (runtime);
   self->pipeline = g_object_ref (pipeline);
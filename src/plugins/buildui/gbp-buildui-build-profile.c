@@ -0,0 +1,888 @@
+/* gbp-buildui-build-profile.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-buildui-build-profile"
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include <libide-io.h>
+
+#include "gbp-buildui-build-profile.h"
+
+/*
+ * GbpBuilduiBuildProfile summarizes a single ninja build from files that
+ * ninja and the compiler leave in the build directory.
+ *
+ * .ninja_log gets a line per output when its command completes, with the
+ * start and end time in milliseconds relative to when ninja started. We
+ * remember the size of the log when the build starts (see
+ * gbp_buildui_build_profile_mark()) and only look at what was appended
+ * after that. If ninja recompacted the log in the mean time (it is
+ * replaced, so the inode changes) we cannot tell which lines are new.
+ *
+ * The log has no dependency information, so the critical path is found
+ * by reading the build statements from build.ninja and following the
+ * inputs of every output that was rebuilt.
+ *
+ * If the project was compiled with clang's -ftime-trace, the JSON trace
+ * next to the object file is used to split the slowest targets into
+ * frontend and backend time along with the most expensive include.
+ *
+ * History is a plain text file with a line per build so that the compile
+ * times of targets can be compared with a build of another commit.
+ */
+
+#define MAX_SLOWEST        25
+#define MAX_HISTORY        500
+#define REGRESSION_MIN_MS  250
+#define COMPARABLE_PERCENT 20
+
+typedef struct
+{
+  guint      duration_ms;
+  gint64     critical_ms;
+  GPtrArray *inputs;
+} Node;
+
+static void
+node_free (gpointer data)
+{
+  Node *node = data;
+
+  g_clear_pointer (&node->inputs, g_ptr_array_unref);
+  g_slice_free (Node, node);
+}
+
+static void
+clear_target (gpointer data)
+{
+  GbpBuilduiBuildProfileTarget *target = data;
+
+  g_clear_pointer (&target->output, g_free);
+  g_clear_pointer (&target->heaviest_include, g_free);
+}
+
+void
+gbp_buildui_build_profile_free (GbpBuilduiBuildProfile *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->slowest, g_array_unref);
+      g_clear_pointer (&self->baseline_commit, g_free);
+      g_slice_free (GbpBuilduiBuildProfile, self);
+    }
+}
+
+/**
+ * gbp_buildui_build_profile_mark:
+ * @builddir: the build directory
+ * @mark: (out): location for the mark
+ *
+ * Records the current position of .ninja_log so that the profile of the
+ * next build only contains what it appended.
+ */
+void
+gbp_buildui_build_profile_mark (const char                 *builddir,
+                                GbpBuilduiBuildProfileMark *mark)
+{
+  g_autofree char *path = NULL;
+  GStatBuf st;
+
+  g_return_if_fail (builddir != NULL);
+  g_return_if_fail (mark != NULL);
+
+  mark->inode = 0;
+  mark->size = 0;
+
+  path = g_build_filename (builddir, ".ninja_log", NULL);
+
+  if (g_stat (path, &st) == 0)
+    {
+      mark->inode = st.st_ino;
+      mark->size = st.st_size;
+    }
+}
+
+/*
+ * Splits a build statement into tokens, handling ninja's $-escapes. The
+ * index of the first token after the unescaped ':' is stored in @colon.
+ */
+static GPtrArray *
+tokenize_build_statement (const char *line,
+                          guint      *colon)
+{
+  g_autoptr(GString) token = g_string_new (NULL);
+  GPtrArray *tokens = g_ptr_array_new_with_free_func (g_free);
+
+  *colon = G_MAXUINT;
+
+  for (const char *c = line; *c; c++)
+    {
+      if (*c == '$' && c[1] != 0)
+        {
+          c++;
+          g_string_append_c (token, *c);
+          continue;
+        }
+
+      if (*c == ' ' || (*c == ':' && *colon == G_MAXUINT))
+        {
+          if (token->len > 0)
+            {
+              g_ptr_array_add (tokens, g_strndup (token->str, token->len));
+              g_string_truncate (token, 0);
+            }
+
+          if (*c == ':')
+            *colon = tokens->len;
+
+          continue;
+        }
+
+      g_string_append_c (token, *c);
+    }
+
+  if (token->len > 0)
+    g_ptr_array_add (tokens, g_strndup (token->str, token->len));
+
+  return tokens;
+}
+
+static void
+add_build_statement (GHashTable *nodes,
+                     const char *line)
+{
+  g_autoptr(GPtrArray) tokens = NULL;
+  g_autoptr(GPtrArray) inputs = NULL;
+  guint colon;
+
+  g_assert (nodes != NULL);
+  g_assert (line != NULL);
+
+  tokens = tokenize_build_statement (line, &colon);
+
+  /* Skip the rule name after the colon */
+  if (colon == G_MAXUINT || colon + 1 > tokens->len)
+    return;
+
+  inputs = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = colon + 1; i < tokens->len; i++)
+    {
+      const char *input = g_ptr_array_index (tokens, i);
+
+      /* Validations are not dependencies */
+      if (g_str_equal (input, "|@"))
+        break;
+
+      if (!g_str_equal (input, "|") && !g_str_equal (input, "||"))
+        g_ptr_array_add (inputs, g_strdup (input));
+    }
+
+  for (guint i = 0; i < colon; i++)
+    {
+      const char *output = g_ptr_array_index (tokens, i);
+      Node *node = g_hash_table_lookup (nodes, output);
+
+      if (node != NULL && node->inputs == NULL)
+        node->inputs = g_ptr_array_ref (inputs);
+    }
+}
+
+static void
+load_build_graph (const char *builddir,
+                  GHashTable *nodes)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GString) statement = NULL;
+  g_autofree char *path = NULL;
+  IdeLineReader reader;
+  const char *line;
+  gsize line_len;
+
+  g_assert (builddir != NULL);
+  g_assert (nodes != NULL);
+
+  path = g_build_filename (builddir, "build.ninja", NULL);
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return;
+
+  statement = g_string_new (NULL);
+
+  ide_line_reader_init (&reader,
+                        g_mapped_file_get_contents (mapped),
+                        g_mapped_file_get_length (mapped));
+
+  while ((line = ide_line_reader_next (&reader, &line_len)))
+    {
+      gsize n_dollar = 0;
+
+      while (n_dollar < line_len && line[line_len - n_dollar - 1] == '$')
+        n_dollar++;
+
+      /* An odd number of trailing $ continues the line */
+      if (n_dollar % 2 == 1)
+        {
+          if (statement->len > 0 || g_str_has_prefix (line, "build "))
+            {
+              g_string_append_len (statement, line, line_len - 1);
+              g_string_append_c (statement, ' ');
+            }
+          continue;
+        }
+
+      if (statement->len > 0)
+        {
+          while (line_len > 0 && *line == ' ')
+            line++, line_len--;
+          g_string_append_len (statement, line, line_len);
+        }
+      else if (line_len > 6 && memcmp (line, "build ", 6) == 0)
+        g_string_append_len (statement, line, line_len);
+      else
+        continue;
+
+      add_build_statement (nodes, statement->str + strlen ("build "));
+      g_string_truncate (statement, 0);
+    }
+}
+
+static gint64
+compute_critical_path (GHashTable *nodes,
+                       Node       *node)
+{
+  gint64 longest = 0;
+
+  if (node->critical_ms >= 0)
+    return node->critical_ms;
+
+  /* Cycle, which ninja would have refused to build anyway */
+  if (node->critical_ms == -2)
+    return 0;
+
+  node->critical_ms = -2;
+
+  if (node->inputs != NULL)
+    {
+      for (guint i = 0; i < node->inputs->len; i++)
+        {
+          Node *input = g_hash_table_lookup (nodes, g_ptr_array_index (node->inputs, i));
+
+          if (input != NULL)
+            longest = MAX (longest, compute_critical_path (nodes, input));
+        }
+    }
+
+  node->critical_ms = node->duration_ms + longest;
+
+  return node->critical_ms;
+}
+
+static char *
+get_time_trace_path (const char *builddir,
+                     const char *output)
+{
+  const char *dot = strrchr (output, '.');
+  g_autofree char *base = NULL;
+  g_autofree char *name = NULL;
+
+  /* clang replaces the object extension with .json */
+  if (dot == NULL || (strcmp (dot, ".o") != 0 && strcmp (dot, ".obj") != 0))
+    return NULL;
+
+  base = g_strndup (output, dot - output);
+  name = g_strconcat (base, ".json", NULL);
+
+  return g_build_filename (builddir, name, NULL);
+}
+
+static const char *
+get_string_member (JsonObject *object,
+                   const char *member)
+{
+  JsonNode *node;
+
+  if (object == NULL ||
+      !(node = json_object_get_member (object, member)) ||
+      !JSON_NODE_HOLDS_VALUE (node) ||
+      json_node_get_value_type (node) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string (node);
+}
+
+static void
+load_time_trace (const char                   *builddir,
+                 GbpBuilduiBuildProfileTarget *target)
+{
+  g_autoptr(JsonParser) parser = NULL;
+  g_autofree char *path = NULL;
+  JsonObject *obj;
+  JsonArray *events;
+  JsonNode *member;
+  JsonNode *root;
+  guint length;
+
+  g_assert (builddir != NULL);
+  g_assert (target != NULL);
+
+  if (!(path = get_time_trace_path (builddir, target->output)) ||
+      !g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    return;
+
+  parser = json_parser_new ();
+
+  if (!json_parser_load_from_mapped_file (parser, path, NULL) ||
+      !(root = json_parser_get_root (parser)) ||
+      !JSON_NODE_HOLDS_OBJECT (root) ||
+      !(obj = json_node_get_object (root)) ||
+      !(member = json_object_get_member (obj, "traceEvents")) ||
+      !JSON_NODE_HOLDS_ARRAY (member) ||
+      !(events = json_node_get_array (member)))
+    return;
+
+  length = json_array_get_length (events);
+
+  for (guint i = 0; i < length; i++)
+    {
+      JsonNode *element = json_array_get_element (events, i);
+      JsonObject *event;
+      JsonNode *dur;
+      const char *name;
+      guint dur_ms;
+
+      if (!JSON_NODE_HOLDS_OBJECT (element) ||
+          !(event = json_node_get_object (element)) ||
+          !(name = get_string_member (event, "name")) ||
+          !(dur = json_object_get_member (event, "dur")) ||
+          !JSON_NODE_HOLDS_VALUE (dur))
+        continue;
+
+      /* Durations are in microseconds */
+      dur_ms = json_node_get_int (dur) / 1000;
+
+      if (g_str_equal (name, "Total Frontend"))
+        {
+          target->frontend_ms = dur_ms;
+        }
+      else if (g_str_equal (name, "Total Backend"))
+        {
+          target->backend_ms = dur_ms;
+        }
+      else if (g_str_equal (name, "Source") && dur_ms > target->heaviest_include_ms)
+        {
+          JsonNode *args = json_object_get_member (event, "args");
+          const char *detail;
+
+          if (args != NULL &&
+              JSON_NODE_HOLDS_OBJECT (args) &&
+              (detail = get_string_member (json_node_get_object (args), "detail")))
+            {
+              g_free (target->heaviest_include);
+              target->heaviest_include = g_strdup (detail);
+              target->heaviest_include_ms = dur_ms;
+            }
+        }
+    }
+}
+
+static gint
+compare_by_duration (gconstpointer a,
+                     gconstpointer b)
+{
+  const GbpBuilduiBuildProfileTarget *target_a = a;
+  const GbpBuilduiBuildProfileTarget *target_b = b;
+
+  if (target_a->duration_ms > target_b->duration_ms)
+    return -1;
+  else if (target_a->duration_ms < target_b->duration_ms)
+    return 1;
+  else
+    return g_strcmp0 (target_a->output, target_b->output);
+}
+
+/**
+ * gbp_buildui_build_profile_new:
+ * @builddir: the build directory
+ * @mark: the mark taken when the build started
+ * @error: a location for a #GError
+ *
+ * Reads the profile of the build which started at @mark. This does I/O
+ * and should be called from a thread.
+ *
+ * Returns: (transfer full): a #GbpBuilduiBuildProfile or %NULL
+ */
+GbpBuilduiBuildProfile *
+gbp_buildui_build_profile_new (const char                        *builddir,
+                               const GbpBuilduiBuildProfileMark  *mark,
+                               GError                           **error)
+{
+  g_autoptr(GbpBuilduiBuildProfile) self = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GHashTable) nodes = NULL;
+  g_autoptr(GHashTable) edges = NULL;
+  g_autofree char *path = NULL;
+  GHashTableIter iter;
+  IdeLineReader reader;
+  const char *contents;
+  const char *output;
+  const char *line;
+  gsize line_len;
+  gsize len;
+  gint64 first_start = G_MAXINT64;
+  gint64 last_end = 0;
+  Node *node;
+  GStatBuf st;
+
+  g_return_val_if_fail (builddir != NULL, NULL);
+  g_return_val_if_fail (mark != NULL, NULL);
+
+  path = g_build_filename (builddir, ".ninja_log", NULL);
+
+  if (g_stat (path, &st) != 0)
+    {
+      int errsv = errno;
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errsv),
+                   "%s", g_strerror (errsv));
+      return NULL;
+    }
+
+  if ((mark->inode != 0 && mark->inode != (guint64)st.st_ino) ||
+      (goffset)st.st_size < mark->size)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_PARTIAL_INPUT,
+                           "ninja log was recompacted during the build");
+      return NULL;
+    }
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, error)))
+    return NULL;
+
+  contents = g_mapped_file_get_contents (mapped);
+  len = g_mapped_file_get_length (mapped);
+
+  if (len < strlen ("# ninja log v5") || !g_str_has_prefix (contents, "# ninja log v"))
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Unsupported ninja log format");
+      return NULL;
+    }
+
+  if (atoi (contents + strlen ("# ninja log v")) < 5)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_NOT_SUPPORTED,
+                           "ninja log is too old");
+      return NULL;
+    }
+
+  self = g_slice_new0 (GbpBuilduiBuildProfile);
+  self->slowest = g_array_new (FALSE, TRUE, sizeof (GbpBuilduiBuildProfileTarget));
+  g_array_set_clear_func (self->slowest, clear_target);
+
+  nodes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, node_free);
+  edges = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Lines are "start\tend\tmtime\toutput\tcommand-hash" */
+  ide_line_reader_init (&reader, (char *)contents + mark->size, len - mark->size);
+
+  while ((line = ide_line_reader_next (&reader, &line_len)))
+    {
+      g_autofree char *copy = NULL;
+      g_auto(GStrv) parts = NULL;
+      gint64 start;
+      gint64 end;
+      char *edge;
+
+      if (line_len == 0 || line[0] == '#')
+        continue;
+
+      copy = g_strndup (line, line_len);
+      parts = g_strsplit (copy, "\t", 5);
+
+      if (g_strv_length (parts) != 5)
+        continue;
+
+      start = g_ascii_strtoll (parts[0], NULL, 10);
+      end = g_ascii_strtoll (parts[1], NULL, 10);
+
+      if (end < start)
+        continue;
+
+      node = g_slice_new0 (Node);
+      node->duration_ms = end - start;
+      node->critical_ms = -1;
+      g_hash_table_replace (nodes, g_strdup (parts[3]), node);
+
+      /* Outputs of the same edge share start, end and command hash */
+      edge = g_strdup_printf ("%s:%s:%s", parts[0], parts[1], parts[4]);
+      if (g_hash_table_add (edges, edge))
+        {
+          self->cpu_ms += end - start;
+          self->n_targets++;
+        }
+
+      first_start = MIN (first_start, start);
+      last_end = MAX (last_end, end);
+    }
+
+  if (self->n_targets == 0)
+    return g_steal_pointer (&self);
+
+  self->wall_ms = last_end - first_start;
+
+  load_build_graph (builddir, nodes);
+
+  g_hash_table_iter_init (&iter, nodes);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&output, (gpointer *)&node))
+    {
+      GbpBuilduiBuildProfileTarget target = {0};
+      gint64 critical_ms = compute_critical_path (nodes, node);
+
+      self->critical_path_ms = MAX (self->critical_path_ms, critical_ms);
+
+      target.output = g_strdup (output);
+      target.duration_ms = node->duration_ms;
+      target.frontend_ms = -1;
+      target.backend_ms = -1;
+      g_array_append_val (self->slowest, target);
+    }
+
+  g_array_sort (self->slowest, compare_by_duration);
+
+  if (self->slowest->len > MAX_SLOWEST)
+    g_array_set_size (self->slowest, MAX_SLOWEST);
+
+  for (guint i = 0; i < self->slowest->len; i++)
+    load_time_trace (builddir, &g_array_index (self->slowest, GbpBuilduiBuildProfileTarget, i));
+
+  return g_steal_pointer (&self);
+}
+
+double
+gbp_buildui_build_profile_get_parallelism (const GbpBuilduiBuildProfile *self)
+{
+  g_return_val_if_fail (self != NULL, 0.0);
+
+  if (self->wall_ms == 0)
+    return self->n_targets > 0 ? 1.0 : 0.0;
+
+  return (double)self->cpu_ms / (double)self->wall_ms;
+}
+
+/**
+ * gbp_buildui_build_profile_is_comparable:
+ * @self: a #GbpBuilduiBuildProfile
+ *
+ * Checks if the baseline rebuilt about as many targets as @self. The wall
+ * time of two builds only says something about the commits when they did
+ * a similar amount of work, otherwise only the targets can be compared.
+ *
+ * Returns: %TRUE if the wall time can be compared with the baseline
+ */
+gboolean
+gbp_buildui_build_profile_is_comparable (const GbpBuilduiBuildProfile *self)
+{
+  guint fewer;
+  guint more;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  if (self->baseline_commit == NULL ||
+      self->baseline_wall_ms == 0 ||
+      self->baseline_n_targets == 0 ||
+      self->n_targets == 0)
+    return FALSE;
+
+  fewer = MIN (self->n_targets, self->baseline_n_targets);
+  more = MAX (self->n_targets, self->baseline_n_targets);
+
+  return (guint64)more * 100 <= (guint64)fewer * (100 + COMPARABLE_PERCENT);
+}
+
+/**
+ * gbp_buildui_build_profile_load_baseline:
+ * @self: a #GbpBuilduiBuildProfile
+ * @history_path: the history file
+ * @commit: the commit that was built
+ *
+ * Finds the most recent build of a commit other than @commit in the
+ * history and records it as the baseline. The duration of each of the
+ * slowest targets in that build is stored in their previous_ms field.
+ */
+void
+gbp_buildui_build_profile_load_baseline (GbpBuilduiBuildProfile *self,
+                                         const char             *history_path,
+                                         const char             *commit)
+{
+  g_autofree char *contents = NULL;
+  g_auto(GStrv) lines = NULL;
+  gsize len;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (history_path != NULL);
+  g_return_if_fail (commit != NULL);
+
+  if (!g_file_get_contents (history_path, &contents, &len, NULL))
+    return;
+
+  lines = g_strsplit (contents, "\n", 0);
+
+  /* Lines are "time\tcommit\twall\tcpu\tcritical\tn_targets\tms:output..."
+   * but n_targets is missing from lines written by older versions.
+   */
+  for (guint i = g_strv_length (lines); i > 0; i--)
+    {
+      g_auto(GStrv) fields = g_strsplit (lines[i - 1], "\t", 0);
+      g_autoptr(GHashTable) previous = NULL;
+      guint first_target = 5;
+
+      if (g_strv_length (fields) < 5 || g_str_equal (fields[1], commit))
+        continue;
+
+      self->baseline_commit = g_strdup (fields[1]);
+      self->baseline_wall_ms = g_ascii_strtoull (fields[2], NULL, 10);
+
+      if (fields[5] != NULL && strchr (fields[5], ':') == NULL)
+        {
+          self->baseline_n_targets = g_ascii_strtoull (fields[5], NULL, 10);
+          first_target = 6;
+        }
+
+      previous = g_hash_table_new (g_str_hash, g_str_equal);
+
+      for (guint j = first_target; fields[j]; j++)
+        {
+          char *colon = strchr (fields[j], ':');
+
+          if (colon != NULL)
+            g_hash_table_insert (previous, colon + 1, fields[j]);
+        }
+
+      for (guint j = 0; j < self->slowest->len; j++)
+        {
+          GbpBuilduiBuildProfileTarget *target = &g_array_index (self->slowest, GbpBuilduiBuildProfileTarget, j);
+          const char *ms = g_hash_table_lookup (previous, target->output);
+
+          if (ms != NULL)
+            target->previous_ms = g_ascii_strtoull (ms, NULL, 10);
+        }
+
+      break;
+    }
+}
+
+/**
+ * gbp_buildui_build_profile_save_history:
+ * @self: a #GbpBuilduiBuildProfile
+ * @history_path: the history file
+ * @commit: the commit that was built
+ * @error: a location for a #GError
+ *
+ * Appends the build to the history, keeping the most recent builds.
+ *
+ * Returns: %TRUE if successful
+ */
+gboolean
+gbp_buildui_build_profile_save_history (const GbpBuilduiBuildProfile  *self,
+                                        const char                    *history_path,
+                                        const char                    *commit,
+                                        GError                       **error)
+{
+  g_autoptr(GString) str = NULL;
+  g_autofree char *contents = NULL;
+  g_autofree char *dir = NULL;
+  g_auto(GStrv) lines = NULL;
+  guint n_lines;
+  guint first = 0;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (history_path != NULL, FALSE);
+  g_return_val_if_fail (commit != NULL, FALSE);
+
+  /* Nothing was rebuilt, not worth remembering */
+  if (self->n_targets == 0)
+    return TRUE;
+
+  dir = g_path_get_dirname (history_path);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0)
+    {
+      int errsv = errno;
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errsv),
+                   "%s", g_strerror (errsv));
+      return FALSE;
+    }
+
+  str = g_string_new (NULL);
+
+  if (g_file_get_contents (history_path, &contents, NULL, NULL))
+    {
+      lines = g_strsplit (contents, "\n", 0);
+      n_lines = g_strv_length (lines);
+
+      if (n_lines >= MAX_HISTORY)
+        first = n_lines - MAX_HISTORY + 1;
+
+      for (guint i = first; i < n_lines; i++)
+        {
+          if (lines[i][0] != 0)
+            g_string_append_printf (str, "%s\n", lines[i]);
+        }
+    }
+
+  g_string_append_printf (str, "%"G_GINT64_FORMAT"\t%s\t%u\t%u\t%u\t%u",
+                          g_get_real_time () / G_USEC_PER_SEC,
+                          commit,
+                          self->wall_ms,
+                          self->cpu_ms,
+                          self->critical_path_ms,
+                          self->n_targets);
+
+  for (guint i = 0; i < self->slowest->len; i++)
+    {
+      const GbpBuilduiBuildProfileTarget *target = &g_array_index (self->slowest, GbpBuilduiBuildProfileTarget, i);
+
+      /* Only worth tracking if it could show up as a regression */
+      if (target->duration_ms >= REGRESSION_MIN_MS)
+        g_string_append_printf (str, "\t%u:%s", target->duration_ms, target->output);
+    }
+
+  g_string_append_c (str, '\n');
+
+  return g_file_set_contents (history_path, str->str, str->len, error);
+}
+
+/**
+ * gbp_buildui_build_profile_read_commit:
+ * @workdir: the directory containing the .git directory
+ *
+ * Reads the commit checked out in @workdir from the files in .git,
+ * following the indirection used by submodules and linked worktrees.
+ *
+ * Returns: (transfer full) (nullable): the commit id or %NULL
+ */
+char *
+gbp_buildui_build_profile_read_commit (const char *workdir)
+{
+  g_autofree char *gitdir = NULL;
+  g_autofree char *commondir = NULL;
+  g_autofree char *commondir_path = NULL;
+  g_autofree char *head = NULL;
+  g_autofree char *ref_path = NULL;
+  g_autofree char *ref = NULL;
+  g_autofree char *packed_path = NULL;
+  g_autofree char *packed = NULL;
+  g_autofree char *contents = NULL;
+  const char *refname;
+
+  g_return_val_if_fail (workdir != NULL, NULL);
+
+  gitdir = g_build_filename (workdir, ".git", NULL);
+
+  /* Worktrees and submodules have a file pointing at the real gitdir */
+  if (g_file_test (gitdir, G_FILE_TEST_IS_REGULAR) &&
+      g_file_get_contents (gitdir, &contents, NULL, NULL) &&
+      g_str_has_prefix (contents, "gitdir: "))
+    {
+      char *path = g_strstrip (contents + strlen ("gitdir: "));
+
+      g_free (gitdir);
+
+      if (g_path_is_absolute (path))
+        gitdir = g_strdup (path);
+      else
+        gitdir = g_build_filename (workdir, path, NULL);
+    }
+
+  g_clear_pointer (&contents, g_free);
+
+  /* Linked worktrees keep HEAD in their own gitdir but share refs and
+   * packed-refs with the main repository through commondir.
+   */
+  commondir_path = g_build_filename (gitdir, "commondir", NULL);
+
+  if (g_file_get_contents (commondir_path, &contents, NULL, NULL))
+    {
+      char *path = g_strstrip (contents);
+
+      if (g_path_is_absolute (path))
+        commondir = g_strdup (path);
+      else
+        commondir = g_build_filename (gitdir, path, NULL);
+    }
+  else
+    {
+      commondir = g_strdup (gitdir);
+    }
+
+  g_clear_pointer (&contents, g_free);
+
+  head = g_build_filename (gitdir, "HEAD", NULL);
+
+  if (!g_file_get_contents (head, &contents, NULL, NULL))
+    return NULL;
+
+  g_strstrip (contents);
+
+  /* Detached HEAD */
+  if (!g_str_has_prefix (contents, "ref: "))
+    return g_steal_pointer (&contents);
+
+  refname = contents + strlen ("ref: ");
+  ref_path = g_build_filename (commondir, refname, NULL);
+
+  if (g_file_get_contents (ref_path, &ref, NULL, NULL))
+    return g_strdup (g_strstrip (ref));
+
+  packed_path = g_build_filename (commondir, "packed-refs", NULL);
+
+  if (g_file_get_contents (packed_path, &packed, NULL, NULL))
+    {
+      g_auto(GStrv) lines = g_strsplit (packed, "\n", 0);
+
+      for (guint i = 0; lines[i]; i++)
+        {
+          char *space = strchr (lines[i], ' ');
+
+          if (space != NULL && g_str_equal (space + 1, refname))
+            return g_strndup (lines[i], space - lines[i]);
+        }
+    }
+
+  return NULL;
+}
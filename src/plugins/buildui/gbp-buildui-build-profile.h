@@ -0,0 +1,86 @@
+/* gbp-buildui-build-profile.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  /* Position of .ninja_log when the build started */
+  guint64 inode;
+  goffset size;
+} GbpBuilduiBuildProfileMark;
+
+typedef struct
+{
+  char  *output;
+  guint  duration_ms;
+
+  /* Duration of the same output in the baseline build, or 0 */
+  guint  previous_ms;
+
+  /* From clang -ftime-trace, or -1 if there was no trace */
+  gint   frontend_ms;
+  gint   backend_ms;
+  char  *heaviest_include;
+  guint  heaviest_include_ms;
+} GbpBuilduiBuildProfileTarget;
+
+typedef struct
+{
+  guint   n_targets;
+  guint   wall_ms;
+  guint   cpu_ms;
+  guint   critical_path_ms;
+
+  /* GbpBuilduiBuildProfileTarget sorted by duration, slowest first */
+  GArray *slowest;
+
+  /* The most recent build of a different commit from the history */
+  char   *baseline_commit;
+  guint   baseline_wall_ms;
+
+  /* Number of targets the baseline rebuilt, or 0 if unknown */
+  guint   baseline_n_targets;
+} GbpBuilduiBuildProfile;
+
+void                    gbp_buildui_build_profile_mark            (const char                       *builddir,
+                                                                   GbpBuilduiBuildProfileMark       *mark);
+GbpBuilduiBuildProfile *gbp_buildui_build_profile_new             (const char                       *builddir,
+                                                                   const GbpBuilduiBuildProfileMark *mark,
+                                                                   GError                          **error);
+void                    gbp_buildui_build_profile_free            (GbpBuilduiBuildProfile           *self);
+double                  gbp_buildui_build_profile_get_parallelism (const GbpBuilduiBuildProfile     *self);
+gboolean                gbp_buildui_build_profile_is_comparable   (const GbpBuilduiBuildProfile     *self);
+void                    gbp_buildui_build_profile_load_baseline   (GbpBuilduiBuildProfile           *self,
+                                                                   const char                       *history_path,
+                                                                   const char                       *commit);
+gboolean                gbp_buildui_build_profile_save_history    (const GbpBuilduiBuildProfile     *self,
+                                                                   const char                       *history_path,
+                                                                   const char                       *commit,
+                                                                   GError                          **error);
+char                   *gbp_buildui_build_profile_read_commit     (const char                       *workdir);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GbpBuilduiBuildProfile, gbp_buildui_build_profile_free)
+
+G_END_DECLS
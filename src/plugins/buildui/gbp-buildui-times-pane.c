@@ -0,0 +1,408 @@
+/* gbp-buildui-times-pane.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-buildui-times-pane"
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <libide-threading.h>
+#include <libide-vcs.h>
+
+#include "gbp-buildui-build-profile.h"
+#include "gbp-buildui-times-pane.h"
+
+/* Don't highlight noise between two builds as a regression */
+#define REGRESSION_MIN_MS      250
+#define REGRESSION_MIN_PERCENT 10
+
+struct _GbpBuilduiTimesPane
+{
+  IdePane                     parent_instance;
+
+  GCancellable               *cancellable;
+  char                       *builddir;
+  GbpBuilduiBuildProfileMark  mark;
+
+  /* Template widgets */
+  GtkLabel                   *message_label;
+  GtkGrid                    *summary;
+  GtkLabel                   *wall_label;
+  GtkLabel                   *cpu_label;
+  GtkLabel                   *parallelism_label;
+  GtkLabel                   *critical_label;
+  GtkLabel                   *baseline_label;
+  GtkListBox                 *list_box;
+};
+
+typedef struct
+{
+  char                       *builddir;
+  char                       *history_path;
+  char                       *workdir;
+  GbpBuilduiBuildProfileMark  mark;
+} Profile;
+
+G_DEFINE_FINAL_TYPE (GbpBuilduiTimesPane, gbp_buildui_times_pane, IDE_TYPE_PANE)
+
+static void
+profile_free (Profile *profile)
+{
+  g_clear_pointer (&profile->builddir, g_free);
+  g_clear_pointer (&profile->history_path, g_free);
+  g_clear_pointer (&profile->workdir, g_free);
+  g_slice_free (Profile, profile);
+}
+
+static char *
+format_duration (guint duration_ms)
+{
+  if (duration_ms < 1000)
+    /* translators: %u is the number of milliseconds */
+    return g_strdup_printf (_("%u ms"), duration_ms);
+  else if (duration_ms < 60 * 1000)
+    /* translators: %.1lf is the number of seconds */
+    return g_strdup_printf (_("%.1lf s"), duration_ms / 1000.0);
+  else
+    /* translators: %u is minutes and %02u seconds */
+    return g_strdup_printf (_("%u:%02u min"), duration_ms / 60000, (duration_ms / 1000) % 60);
+}
+
+static gboolean
+is_regression (guint duration_ms,
+               guint previous_ms)
+{
+  return previous_ms > 0 &&
+         duration_ms >= previous_ms + REGRESSION_MIN_MS &&
+         duration_ms * 100 >= previous_ms * (100 + REGRESSION_MIN_PERCENT);
+}
+
+static GtkWidget *
+create_row (const GbpBuilduiBuildProfileTarget *target)
+{
+  g_autofree char *duration = format_duration (target->duration_ms);
+  g_autoptr(GString) subtitle = g_string_new (NULL);
+  AdwActionRow *row;
+  GtkWidget *label;
+
+  g_assert (target != NULL);
+
+  if (target->frontend_ms >= 0 && target->backend_ms >= 0)
+    {
+      g_autofree char *frontend = format_duration (target->frontend_ms);
+      g_autofree char *backend = format_duration (target->backend_ms);
+
+      /* translators: the first %s is the parsing time and the second %s is code generation time */
+      g_string_append_printf (subtitle, _("Frontend %s, backend %s"), frontend, backend);
+    }
+
+  if (target->heaviest_include != NULL)
+    {
+      g_autofree char *include = format_duration (target->heaviest_include_ms);
+      g_autofree char *name = g_path_get_basename (target->heaviest_include);
+
+      if (subtitle->len > 0)
+        g_string_append (subtitle, " · ");
+
+      /* translators: the first %s is a header file and the second %s is the time to parse it */
+      g_string_append_printf (subtitle, _("%s took %s"), name, include);
+    }
+
+  row = g_object_new (ADW_TYPE_ACTION_ROW,
+                      "title", target->output,
+                      "title-lines", 1,
+                      "subtitle", subtitle->str,
+                      "tooltip-text", target->heaviest_include,
+                      "use-markup", FALSE,
+                      NULL);
+
+  if (is_regression (target->duration_ms, target->previous_ms))
+    {
+      g_autofree char *previous = format_duration (target->previous_ms);
+      g_autofree char *tooltip = NULL;
+      g_autofree char *delta = NULL;
+
+      /* translators: %u is the percentage the target got slower */
+      delta = g_strdup_printf (_("+%u%%"), (target->duration_ms - target->previous_ms) * 100 / target->previous_ms);
+      /* translators: %s is the time it took in the previous build */
+      tooltip = g_strdup_printf (_("Previously %s"), previous);
+
+      adw_action_row_add_suffix (row,
+                                 g_object_new (GTK_TYPE_LABEL,
+                                               "label", delta,
+                                               "tooltip-text", tooltip,
+                                               "css-classes", IDE_STRV_INIT ("error", "numeric"),
+                                               "valign", GTK_ALIGN_CENTER,
+                                               NULL));
+    }
+
+  label = g_object_new (GTK_TYPE_LABEL,
+                        "label", duration,
+                        "css-classes", IDE_STRV_INIT ("dim-label", "numeric"),
+                        "valign", GTK_ALIGN_CENTER,
+                        NULL);
+  adw_action_row_add_suffix (row, label);
+
+  return GTK_WIDGET (row);
+}
+
+static void
+gbp_buildui_times_pane_show_message (GbpBuilduiTimesPane *self,
+                                     const char          *message)
+{
+  g_assert (GBP_IS_BUILDUI_TIMES_PANE (self));
+
+  gtk_label_set_label (self->message_label, message);
+  gtk_widget_set_visible (GTK_WIDGET (self->message_label), TRUE);
+  gtk_widget_set_visible (GTK_WIDGET (self->summary), FALSE);
+  gtk_widget_set_visible (GTK_WIDGET (self->list_box), FALSE);
+}
+
+static void
+gbp_buildui_times_pane_set_profile (GbpBuilduiTimesPane          *self,
+                                    const GbpBuilduiBuildProfile *profile)
+{
+  g_autofree char *wall = NULL;
+  g_autofree char *cpu = NULL;
+  g_autofree char *critical = NULL;
+  g_autofree char *parallelism = NULL;
+  g_autofree char *baseline = NULL;
+  gboolean needs_attention = FALSE;
+  GtkWidget *child;
+
+  g_assert (GBP_IS_BUILDUI_TIMES_PANE (self));
+  g_assert (profile != NULL);
+
+  while ((child = gtk_widget_get_first_child (GTK_WIDGET (self->list_box))))
+    gtk_list_box_remove (self->list_box, child);
+
+  if (profile->n_targets == 0)
+    {
+      gbp_buildui_times_pane_show_message (self, _("Nothing was rebuilt"));
+      return;
+    }
+
+  wall = format_duration (profile->wall_ms);
+  cpu = format_duration (profile->cpu_ms);
+  critical = format_duration (profile->critical_path_ms);
+  /* translators: %.1lf is the average number of commands running at once */
+  parallelism = g_strdup_printf (_("%.1lf×"), gbp_buildui_build_profile_get_parallelism (profile));
+
+  if (profile->baseline_commit != NULL)
+    {
+      g_autofree char *previous = format_duration (profile->baseline_wall_ms);
+      g_autofree char *short_id = g_strndup (profile->baseline_commit, 10);
+
+      /* translators: the first %s is a duration and the second %s is a commit id */
+      baseline = g_strdup_printf (_("%s at %s"), previous, short_id);
+    }
+
+  gtk_label_set_label (self->wall_label, wall);
+  gtk_label_set_label (self->cpu_label, cpu);
+  gtk_label_set_label (self->critical_label, critical);
+  gtk_label_set_label (self->parallelism_label, parallelism);
+  gtk_label_set_label (self->baseline_label, baseline ? baseline : _("No earlier build"));
+
+  for (guint i = 0; i < profile->slowest->len; i++)
+    gtk_list_box_append (self->list_box,
+                         create_row (&g_array_index (profile->slowest, GbpBuilduiBuildProfileTarget, i)));
+
+  gtk_widget_set_visible (GTK_WIDGET (self->message_label), FALSE);
+  gtk_widget_set_visible (GTK_WIDGET (self->summary), TRUE);
+  gtk_widget_set_visible (GTK_WIDGET (self->list_box), TRUE);
+
+  /* The wall time of builds that rebuilt different amounts of the
+   * project says nothing about the commits, only the targets do.
+   */
+  if (gbp_buildui_build_profile_is_comparable (profile))
+    needs_attention = is_regression (profile->wall_ms, profile->baseline_wall_ms);
+
+  for (guint i = 0; !needs_attention && i < profile->slowest->len; i++)
+    {
+      const GbpBuilduiBuildProfileTarget *target = &g_array_index (profile->slowest, GbpBuilduiBuildProfileTarget, i);
+
+      needs_attention = is_regression (target->duration_ms, target->previous_ms);
+    }
+
+  if (needs_attention)
+    panel_widget_set_needs_attention (PANEL_WIDGET (self), TRUE);
+}
+
+static void
+gbp_buildui_times_pane_profile_worker (IdeTask      *task,
+                                       gpointer      source_object,
+                                       gpointer      task_data,
+                                       GCancellable *cancellable)
+{
+  g_autoptr(GbpBuilduiBuildProfile) profile = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *commit = NULL;
+  Profile *state = task_data;
+
+  g_assert (!IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TASK (task));
+  g_assert (state != NULL);
+
+  if (!(profile = gbp_buildui_build_profile_new (state->builddir, &state->mark, &error)))
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  if (state->workdir != NULL &&
+      (commit = gbp_buildui_build_profile_read_commit (state->workdir)))
+    {
+      gbp_buildui_build_profile_load_baseline (profile, state->history_path, commit);
+
+      if (!gbp_buildui_build_profile_save_history (profile, state->history_path, commit, &error))
+        g_debug ("Failed to save build times to %s: %s",
+                 state->history_path, error->message);
+    }
+
+  ide_task_return_pointer (task,
+                           g_steal_pointer (&profile),
+                           gbp_buildui_build_profile_free);
+}
+
+static void
+gbp_buildui_times_pane_profile_cb (GObject      *object,
+                                   GAsyncResult *result,
+                                   gpointer      user_data)
+{
+  GbpBuilduiTimesPane *self = (GbpBuilduiTimesPane *)object;
+  g_autoptr(GbpBuilduiBuildProfile) profile = NULL;
+  g_autoptr(GError) error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (GBP_IS_BUILDUI_TIMES_PANE (self));
+  g_assert (IDE_IS_TASK (result));
+
+  if (!(profile = ide_task_propagate_pointer (IDE_TASK (result), &error)))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        gbp_buildui_times_pane_show_message (self, _("Build times are only available for projects built with Ninja"));
+      else if (!ide_error_ignore (error))
+        gbp_buildui_times_pane_show_message (self, error->message);
+      IDE_EXIT;
+    }
+
+  gbp_buildui_times_pane_set_profile (self, profile);
+
+  IDE_EXIT;
+}
+
+void
+gbp_buildui_times_pane_build_started (GbpBuilduiTimesPane *self,
+                                      IdePipeline         *pipeline)
+{
+  const char *builddir;
+
+  g_return_if_fail (GBP_IS_BUILDUI_TIMES_PANE (self));
+  g_return_if_fail (IDE_IS_PIPELINE (pipeline));
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+
+  builddir = ide_pipeline_get_builddir (pipeline);
+
+  g_set_str (&self->builddir, builddir);
+  gbp_buildui_build_profile_mark (builddir, &self->mark);
+}
+
+void
+gbp_buildui_times_pane_build_finished (GbpBuilduiTimesPane *self,
+                                       IdePipeline         *pipeline)
+{
+  g_autoptr(IdeTask) task = NULL;
+  g_autofree char *name = NULL;
+  IdeContext *context;
+  IdeConfig *config;
+  GFile *workdir;
+  Profile *state;
+
+  g_return_if_fail (GBP_IS_BUILDUI_TIMES_PANE (self));
+  g_return_if_fail (IDE_IS_PIPELINE (pipeline));
+
+  IDE_ENTRY;
+
+  /* The pipeline changed while building, the mark is meaningless */
+  if (self->builddir == NULL ||
+      g_strcmp0 (self->builddir, ide_pipeline_get_builddir (pipeline)) != 0)
+    IDE_EXIT;
+
+  context = ide_object_get_context (IDE_OBJECT (pipeline));
+  config = ide_pipeline_get_config (pipeline);
+  workdir = ide_vcs_get_workdir (ide_vcs_from_context (context));
+  name = g_strdup_printf ("build-times-%s.txt", ide_config_get_id (config));
+
+  state = g_slice_new0 (Profile);
+  state->builddir = g_steal_pointer (&self->builddir);
+  state->history_path = ide_context_cache_filename (context, "buildui", name, NULL);
+  state->workdir = workdir && g_file_is_native (workdir) ? g_file_get_path (workdir) : NULL;
+  state->mark = self->mark;
+
+  self->cancellable = g_cancellable_new ();
+
+  task = ide_task_new (self, self->cancellable, gbp_buildui_times_pane_profile_cb, NULL);
+  ide_task_set_source_tag (task, gbp_buildui_times_pane_build_finished);
+  ide_task_set_task_data (task, state, profile_free);
+  ide_task_run_in_thread (task, gbp_buildui_times_pane_profile_worker);
+
+  IDE_EXIT;
+}
+
+static void
+gbp_buildui_times_pane_dispose (GObject *object)
+{
+  GbpBuilduiTimesPane *self = (GbpBuilduiTimesPane *)object;
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+  g_clear_pointer (&self->builddir, g_free);
+
+  G_OBJECT_CLASS (gbp_buildui_times_pane_parent_class)->dispose (object);
+}
+
+static void
+gbp_buildui_times_pane_class_init (GbpBuilduiTimesPaneClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = gbp_buildui_times_pane_dispose;
+
+  gtk_widget_class_set_template_from_resource (widget_class, "/plugins/buildui/gbp-buildui-times-pane.ui");
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, baseline_label);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, cpu_label);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, critical_label);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, list_box);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, message_label);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, parallelism_label);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, summary);
+  gtk_widget_class_bind_template_child (widget_class, GbpBuilduiTimesPane, wall_label);
+}
+
+static void
+gbp_buildui_times_pane_init (GbpBuilduiTimesPane *self)
+{
+  gtk_widget_init_template (GTK_WIDGET (self));
+}
@@ -0,0 +1,37 @@
+/* gbp-buildui-times-pane.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <libide-foundry.h>
+#include <libide-gui.h>
+
+G_BEGIN_DECLS
+
+#define GBP_TYPE_BUILDUI_TIMES_PANE (gbp_buildui_times_pane_get_type())
+
+G_DECLARE_FINAL_TYPE (GbpBuilduiTimesPane, gbp_buildui_times_pane, GBP, BUILDUI_TIMES_PANE, IdePane)
+
+void gbp_buildui_times_pane_build_started  (GbpBuilduiTimesPane *self,
+                                            IdePipeline         *pipeline);
+void gbp_buildui_times_pane_build_finished (GbpBuilduiTimesPane *self,
+                                            IdePipeline         *pipeline);
+
+G_END_DECLS
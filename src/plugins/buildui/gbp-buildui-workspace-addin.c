@@ -34,6 +34,7 @@
 #include "gbp-buildui-status-indicator.h"
 #include "gbp-buildui-status-popover.h"
 #include "gbp-buildui-targets-dialog.h"
+#include "gbp-buildui-times-pane.h"
 #include "gbp-buildui-workspace-addin.h"
 
 struct _GbpBuilduiWorkspaceAddin
@@ -45,6 +46,7 @@ struct _GbpBuilduiWorkspaceAddin
   GbpBuilduiOmniBarSection  *omni_bar_section;
   GbpBuilduiLogPane         *log_pane;
   GbpBuilduiPane            *pane;
+  GbpBuilduiTimesPane       *times_pane;
   GtkBox                    *diag_box;
   GtkImage                  *error_image;
   GtkLabel                  *error_label;
@@ -248,6 +250,8 @@ gbp_buildui_workspace_addin_build_started (GbpBuilduiWorkspaceAddin *self,
   if (g_settings_get_boolean (settings, "clear-build-log-pane"))
       gbp_buildui_log_pane_clear (self->log_pane);
 
+  gbp_buildui_times_pane_build_started (self->times_pane, pipeline);
+
   if (phase > IDE_PIPELINE_PHASE_CONFIGURE &&
       g_settings_get_boolean (settings, "show-log-for-build"))
     panel_widget_raise (PANEL_WIDGET (self->log_pane));
@@ -255,6 +259,23 @@ gbp_buildui_workspace_addin_build_started (GbpBuilduiWorkspaceAddin *self,
   IDE_EXIT;
 }
 
+static void
+gbp_buildui_workspace_addin_build_finished (GbpBuilduiWorkspaceAddin *self,
+                                            IdePipeline              *pipeline,
+                                            IdeBuildManager          *build_manager)
+{
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_BUILDUI_WORKSPACE_ADDIN (self));
+  g_assert (IDE_IS_PIPELINE (pipeline));
+  g_assert (IDE_IS_BUILD_MANAGER (build_manager));
+
+  gbp_buildui_times_pane_build_finished (self->times_pane, pipeline);
+
+  IDE_EXIT;
+}
+
 static void
 gbp_buildui_workspace_addin_load (IdeWorkspaceAddin *addin,
                                   IdeWorkspace      *workspace)
@@ -262,6 +283,7 @@ gbp_buildui_workspace_addin_load (IdeWorkspaceAddin *addin,
   GbpBuilduiWorkspaceAddin *self = (GbpBuilduiWorkspaceAddin *)addin;
   g_autoptr(PanelPosition) pane_position = NULL;
   g_autoptr(PanelPosition) log_position = NULL;
+  g_autoptr(PanelPosition) times_position = NULL;
   PangoAttrList *small_attrs = NULL;
   IdeBuildManager *build_manager;
   PanelStatusbar *statusbar;
@@ -356,6 +378,13 @@ gbp_buildui_workspace_addin_load (IdeWorkspaceAddin *addin,
   self->log_pane = g_object_new (GBP_TYPE_BUILDUI_LOG_PANE, NULL);
   ide_workspace_add_pane (workspace, IDE_PANE (self->log_pane), log_position);
 
+  times_position = panel_position_new ();
+  panel_position_set_area (times_position, PANEL_AREA_BOTTOM);
+  panel_position_set_depth (times_position, 3);
+
+  self->times_pane = g_object_new (GBP_TYPE_BUILDUI_TIMES_PANE, NULL);
+  ide_workspace_add_pane (workspace, IDE_PANE (self->times_pane), times_position);
+
   pane_position = panel_position_new ();
   panel_position_set_area (pane_position, PANEL_AREA_START);
   panel_position_set_depth (pane_position, 1);
@@ -394,6 +423,11 @@ gbp_buildui_workspace_addin_load (IdeWorkspaceAddin *addin,
                                    G_CALLBACK (gbp_buildui_workspace_addin_build_started),
                                    self,
                                    G_CONNECT_SWAPPED);
+  g_signal_group_connect_object (self->build_manager_signals,
+                                   "build-finished",
+                                   G_CALLBACK (gbp_buildui_workspace_addin_build_finished),
+                                   self,
+                                   G_CONNECT_SWAPPED);
   g_signal_group_set_target (self->build_manager_signals, build_manager);
 }
 
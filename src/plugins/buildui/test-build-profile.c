@@ -0,0 +1,345 @@
+/* test-build-profile.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "gbp-buildui-build-profile.h"
+
+#define HEAD_COMMIT "0123456789abcdef0123456789abcdef01234567"
+
+static void
+set_file (const char *dir,
+          const char *name,
+          const char *contents)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *path = g_build_filename (dir, name, NULL);
+  g_autofree char *parent = g_path_get_dirname (path);
+
+  g_assert_cmpint (g_mkdir_with_parents (parent, 0750), ==, 0);
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+}
+
+static char *
+get_testdata (const char *name)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *path = g_test_build_filename (G_TEST_DIST, "testdata", name, NULL);
+  char *contents = NULL;
+
+  g_file_get_contents (path, &contents, NULL, &error);
+  g_assert_no_error (error);
+
+  return contents;
+}
+
+static void
+remove_tree (const char *path)
+{
+  g_autoptr(GDir) dir = NULL;
+  const char *name;
+
+  if ((dir = g_dir_open (path, 0, NULL)))
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          g_autofree char *child = g_build_filename (path, name, NULL);
+          remove_tree (child);
+        }
+    }
+
+  g_remove (path);
+}
+
+/*
+ * Creates a build directory where ninja-log-before was left by an earlier
+ * build and ninja-log-after was appended by the build being profiled.
+ */
+static char *
+create_builddir (GbpBuilduiBuildProfileMark *mark)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *before = get_testdata ("ninja-log-before");
+  g_autofree char *after = get_testdata ("ninja-log-after");
+  g_autofree char *build_ninja = get_testdata ("build.ninja");
+  g_autofree char *log_path = NULL;
+  char *builddir;
+  FILE *fp;
+
+  builddir = g_dir_make_tmp ("test-build-profile-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  set_file (builddir, "build.ninja", build_ninja);
+  set_file (builddir, ".ninja_log", before);
+
+  gbp_buildui_build_profile_mark (builddir, mark);
+  g_assert_cmpint (mark->size, ==, strlen (before));
+
+  /* Append rather than replace so the inode is unchanged */
+  log_path = g_build_filename (builddir, ".ninja_log", NULL);
+  fp = fopen (log_path, "a");
+  g_assert_nonnull (fp);
+  g_assert_cmpint (fwrite (after, 1, strlen (after), fp), ==, strlen (after));
+  fclose (fp);
+
+  return builddir;
+}
+
+static const GbpBuilduiBuildProfileTarget *
+find_target (const GbpBuilduiBuildProfile *profile,
+             const char                   *output)
+{
+  for (guint i = 0; i < profile->slowest->len; i++)
+    {
+      const GbpBuilduiBuildProfileTarget *target = &g_array_index (profile->slowest, GbpBuilduiBuildProfileTarget, i);
+
+      if (g_str_equal (target->output, output))
+        return target;
+    }
+
+  return NULL;
+}
+
+static void
+test_build_profile_log (void)
+{
+  g_autoptr(GbpBuilduiBuildProfile) profile = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *builddir = NULL;
+  GbpBuilduiBuildProfileMark mark;
+  const GbpBuilduiBuildProfileTarget *target;
+
+  builddir = create_builddir (&mark);
+  profile = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (profile);
+
+  /* stale.o is from before the mark and app.map shares an edge with app */
+  g_assert_cmpint (profile->n_targets, ==, 5);
+  g_assert_cmpint (profile->cpu_ms, ==, 1200);
+  g_assert_cmpint (profile->wall_ms, ==, 500);
+  g_assert_null (find_target (profile, "stale.o"));
+
+  /* Slowest first, ties by name */
+  g_assert_cmpint (profile->slowest->len, ==, 6);
+  target = &g_array_index (profile->slowest, GbpBuilduiBuildProfileTarget, 0);
+  g_assert_cmpstr (target->output, ==, "lint");
+  g_assert_cmpint (target->duration_ms, ==, 450);
+  g_assert_cmpint (target->frontend_ms, ==, -1);
+  target = &g_array_index (profile->slowest, GbpBuilduiBuildProfileTarget, 3);
+  g_assert_cmpstr (target->output, ==, "app");
+  target = &g_array_index (profile->slowest, GbpBuilduiBuildProfileTarget, 4);
+  g_assert_cmpstr (target->output, ==, "app.map");
+
+  g_assert_cmpfloat (gbp_buildui_build_profile_get_parallelism (profile), ==, 2.4);
+
+  remove_tree (builddir);
+}
+
+static void
+test_build_profile_critical_path (void)
+{
+  g_autoptr(GbpBuilduiBuildProfile) profile = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *builddir = NULL;
+  GbpBuilduiBuildProfileMark mark;
+
+  builddir = create_builddir (&mark);
+  profile = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+
+  /* gen.h -> a.o -> app. The escaped "b c.o" must be a single input of
+   * the continued app statement and the lint validation must not count.
+   */
+  g_assert_nonnull (find_target (profile, "b c.o"));
+  g_assert_cmpint (profile->critical_path_ms, ==, 500);
+
+  remove_tree (builddir);
+}
+
+static void
+test_build_profile_recompacted (void)
+{
+  g_autoptr(GbpBuilduiBuildProfile) profile = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *builddir = NULL;
+  g_autofree char *after = get_testdata ("ninja-log-after");
+  GbpBuilduiBuildProfileMark mark;
+
+  builddir = create_builddir (&mark);
+
+  /* Replacing the log gives it a new inode */
+  set_file (builddir, ".ninja_log", after);
+
+  profile = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT);
+  g_assert_null (profile);
+
+  remove_tree (builddir);
+}
+
+static void
+test_build_profile_history (void)
+{
+  g_autoptr(GbpBuilduiBuildProfile) first = NULL;
+  g_autoptr(GbpBuilduiBuildProfile) second = NULL;
+  g_autoptr(GbpBuilduiBuildProfile) same = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *builddir = NULL;
+  g_autofree char *history = NULL;
+  GbpBuilduiBuildProfileMark mark;
+  gboolean r;
+
+  builddir = create_builddir (&mark);
+  history = g_build_filename (builddir, "history", "times", NULL);
+
+  first = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+  r = gbp_buildui_build_profile_save_history (first, history, "aaaa", &error);
+  g_assert_no_error (error);
+  g_assert_true (r);
+
+  /* Builds of the same commit are never a baseline */
+  same = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+  gbp_buildui_build_profile_load_baseline (same, history, "aaaa");
+  g_assert_null (same->baseline_commit);
+
+  second = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+  gbp_buildui_build_profile_load_baseline (second, history, "bbbb");
+  g_assert_cmpstr (second->baseline_commit, ==, "aaaa");
+  g_assert_cmpint (second->baseline_wall_ms, ==, 500);
+  g_assert_cmpint (second->baseline_n_targets, ==, 5);
+  g_assert_true (gbp_buildui_build_profile_is_comparable (second));
+
+  /* Only targets which could be a regression are remembered */
+  g_assert_cmpint (find_target (second, "lint")->previous_ms, ==, 450);
+  g_assert_cmpint (find_target (second, "b c.o")->previous_ms, ==, 250);
+  g_assert_cmpint (find_target (second, "gen.h")->previous_ms, ==, 0);
+
+  remove_tree (builddir);
+}
+
+static void
+test_build_profile_history_compat (void)
+{
+  g_autoptr(GbpBuilduiBuildProfile) profile = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *builddir = NULL;
+  g_autofree char *history = NULL;
+  GbpBuilduiBuildProfileMark mark;
+
+  builddir = create_builddir (&mark);
+  history = g_build_filename (builddir, "times", NULL);
+
+  /* Written before the number of targets was recorded */
+  set_file (builddir, "times",
+            "1700000000\tcccc\t900\t1000\t800\t300:a.o\n"
+            "1700000100\tdddd\t100\t100\t100\t20\n");
+
+  profile = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+
+  /* dddd rebuilt far fewer targets, so only its targets compare */
+  gbp_buildui_build_profile_load_baseline (profile, history, "dddd");
+  g_assert_cmpstr (profile->baseline_commit, ==, "cccc");
+  g_assert_cmpint (profile->baseline_n_targets, ==, 0);
+  g_assert_cmpint (find_target (profile, "a.o")->previous_ms, ==, 300);
+  g_assert_false (gbp_buildui_build_profile_is_comparable (profile));
+
+  g_clear_pointer (&profile, gbp_buildui_build_profile_free);
+  profile = gbp_buildui_build_profile_new (builddir, &mark, &error);
+  g_assert_no_error (error);
+
+  gbp_buildui_build_profile_load_baseline (profile, history, "cccc");
+  g_assert_cmpstr (profile->baseline_commit, ==, "dddd");
+  g_assert_cmpint (profile->baseline_n_targets, ==, 20);
+  g_assert_false (gbp_buildui_build_profile_is_comparable (profile));
+
+  remove_tree (builddir);
+}
+
+static void
+test_build_profile_read_commit (void)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *main_dir = NULL;
+  g_autofree char *worktree = NULL;
+  g_autofree char *commit = NULL;
+
+  tmpdir = g_dir_make_tmp ("test-build-profile-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  main_dir = g_build_filename (tmpdir, "main", NULL);
+  worktree = g_build_filename (tmpdir, "worktree", NULL);
+
+  /* Detached HEAD */
+  set_file (main_dir, ".git/HEAD", HEAD_COMMIT "\n");
+  commit = gbp_buildui_build_profile_read_commit (main_dir);
+  g_assert_cmpstr (commit, ==, HEAD_COMMIT);
+  g_clear_pointer (&commit, g_free);
+
+  /* Loose ref */
+  set_file (main_dir, ".git/HEAD", "ref: refs/heads/main\n");
+  set_file (main_dir, ".git/refs/heads/main", HEAD_COMMIT "\n");
+  commit = gbp_buildui_build_profile_read_commit (main_dir);
+  g_assert_cmpstr (commit, ==, HEAD_COMMIT);
+  g_clear_pointer (&commit, g_free);
+
+  /* Linked worktree on a branch that only exists in packed-refs */
+  set_file (main_dir, ".git/packed-refs",
+            "# pack-refs with: peeled fully-peeled sorted\n"
+            "fedcba9876543210fedcba9876543210fedcba98 refs/heads/topic\n");
+  set_file (main_dir, ".git/worktrees/worktree/HEAD", "ref: refs/heads/topic\n");
+  set_file (main_dir, ".git/worktrees/worktree/commondir", "../..\n");
+  set_file (worktree, ".git", "gitdir: ../main/.git/worktrees/worktree\n");
+  commit = gbp_buildui_build_profile_read_commit (worktree);
+  g_assert_cmpstr (commit, ==, "fedcba9876543210fedcba9876543210fedcba98");
+  g_clear_pointer (&commit, g_free);
+
+  /* Linked worktree on a branch with a loose ref */
+  set_file (main_dir, ".git/worktrees/worktree/HEAD", "ref: refs/heads/main\n");
+  commit = gbp_buildui_build_profile_read_commit (worktree);
+  g_assert_cmpstr (commit, ==, HEAD_COMMIT);
+
+  remove_tree (tmpdir);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Buildui/BuildProfile/log", test_build_profile_log);
+  g_test_add_func ("/Buildui/BuildProfile/critical-path", test_build_profile_critical_path);
+  g_test_add_func ("/Buildui/BuildProfile/recompacted", test_build_profile_recompacted);
+  g_test_add_func ("/Buildui/BuildProfile/history", test_build_profile_history);
+  g_test_add_func ("/Buildui/BuildProfile/history-compat", test_build_profile_history_compat);
+  g_test_add_func ("/Buildui/BuildProfile/read-commit", test_build_profile_read_commit);
+  return g_test_run ();
+}
@@ -39,6 +39,7 @@
 #include "ide-clang-symbol-node.h"
 #include "ide-clang-symbol-resolver.h"
 #include "ide-clang-symbol-tree.h"
+#include "gbp-clang-pipeline-addin.h"
 #include "gbp-clang-tweaks-addin.h"
 
 _IDE_EXTERN void
@@ -59,6 +60,9 @@ _ide_clang_register_types (PeasObjectModule *module)
   peas_object_module_register_extension_type (module,
                                               GTK_SOURCE_TYPE_COMPLETION_PROVIDER,
                                               IDE_TYPE_CLANG_COMPLETION_PROVIDER);
+  peas_object_module_register_extension_type (module,
+                                              IDE_TYPE_PIPELINE_ADDIN,
+                                              GBP_TYPE_CLANG_PIPELINE_ADDIN);
   peas_object_module_register_extension_type (module,
                                               IDE_TYPE_RENAME_PROVIDER,
                                               IDE_TYPE_CLANG_RENAME_PROVIDER);
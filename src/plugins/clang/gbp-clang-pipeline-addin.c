@@ -0,0 +1,72 @@
+/* gbp-clang-pipeline-addin.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-clang-pipeline-addin"
+
+#include "config.h"
+
+#include "gbp-clang-pipeline-addin.h"
+#include "gbp-clang-prewarm-stage.h"
+
+struct _GbpClangPipelineAddin
+{
+  IdeObject parent_instance;
+};
+
+static void
+gbp_clang_pipeline_addin_load (IdePipelineAddin *addin,
+                               IdePipeline      *pipeline)
+{
+  g_autoptr(GbpClangPrewarmStage) stage = NULL;
+  guint stage_id;
+
+  g_assert (GBP_IS_CLANG_PIPELINE_ADDIN (addin));
+  g_assert (IDE_IS_PIPELINE (pipeline));
+
+  /* Parse recently used and modified files as soon as we have build
+   * flags for them so that the first request in each file is warm.
+   */
+  stage = gbp_clang_prewarm_stage_new ();
+  stage_id = ide_pipeline_attach (pipeline,
+                                  IDE_PIPELINE_PHASE_CONFIGURE | IDE_PIPELINE_PHASE_AFTER,
+                                  1000,
+                                  IDE_PIPELINE_STAGE (stage));
+  ide_pipeline_addin_track (addin, stage_id);
+}
+
+static void
+pipeline_addin_iface_init (IdePipelineAddinInterface *iface)
+{
+  iface->load = gbp_clang_pipeline_addin_load;
+}
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (GbpClangPipelineAddin, gbp_clang_pipeline_addin, IDE_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (IDE_TYPE_PIPELINE_ADDIN,
+                                                      pipeline_addin_iface_init))
+
+static void
+gbp_clang_pipeline_addin_class_init (GbpClangPipelineAddinClass *klass)
+{
+}
+
+static void
+gbp_clang_pipeline_addin_init (GbpClangPipelineAddin *self)
+{
+}
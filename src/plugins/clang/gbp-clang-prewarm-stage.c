@@ -0,0 +1,444 @@
+/* gbp-clang-prewarm-stage.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-clang-prewarm-stage"
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <libide-code.h>
+#include <libide-threading.h>
+#include <libide-vcs.h>
+
+#include "ide-clang-client.h"
+
+#include "gbp-clang-prewarm-stage.h"
+
+/*
+ * GbpClangPrewarmStage runs right after the configure phase and asks the
+ * clang daemon to parse the files the user is most likely to touch next:
+ * the buffers restored from the session (newest first) followed by the
+ * files changed in the working tree. The daemon keeps each translation
+ * unit keyed by file and flags, so the first completion or diagnostic for
+ * one of those files only has to reparse it against the cached preamble.
+ *
+ * The stage completes immediately and the parsing continues in the
+ * background, never running more files at once than the indexer thread
+ * pool is allowed to use.
+ */
+
+/* Keep in sync with MAX_CACHED_UNITS in ide-clang.c, warming more files
+ * than the daemon keeps would only evict the ones we warmed first.
+ */
+#define MAX_FILES 8
+
+struct _GbpClangPrewarmStage
+{
+  IdePipelineStage  parent_instance;
+  GCancellable     *cancellable;
+};
+
+typedef struct
+{
+  IdeBuildSystem       *build_system;
+  IdeClangClient       *client;
+  GCancellable         *cancellable;
+  GQueue                files;
+  GHashTable           *seen;
+  guint                 n_active;
+  guint                 max_active;
+} Prewarm;
+
+G_DEFINE_FINAL_TYPE (GbpClangPrewarmStage, gbp_clang_prewarm_stage, IDE_TYPE_PIPELINE_STAGE)
+
+static const char *languages[] = { "c", "chdr", "cpp", "cpphdr", "objc" };
+static const char *suffixes[] = { ".c", ".cc", ".cpp", ".cxx", ".h", ".hh", ".hpp", ".hxx", ".m" };
+
+static void prewarm_pump (Prewarm *prewarm);
+
+static void
+prewarm_finalize (gpointer data)
+{
+  Prewarm *prewarm = data;
+
+  g_queue_clear_full (&prewarm->files, g_object_unref);
+  g_clear_pointer (&prewarm->seen, g_hash_table_unref);
+  g_clear_object (&prewarm->cancellable);
+  g_clear_object (&prewarm->client);
+  g_clear_object (&prewarm->build_system);
+}
+
+static Prewarm *
+prewarm_ref (Prewarm *prewarm)
+{
+  return g_rc_box_acquire (prewarm);
+}
+
+static void
+prewarm_unref (Prewarm *prewarm)
+{
+  g_rc_box_release_full (prewarm, prewarm_finalize);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (Prewarm, prewarm_unref)
+
+static void
+prewarm_add_file (Prewarm *prewarm,
+                  GFile   *file)
+{
+  g_assert (prewarm != NULL);
+  g_assert (G_IS_FILE (file));
+
+  if (g_hash_table_size (prewarm->seen) >= MAX_FILES ||
+      g_hash_table_contains (prewarm->seen, file))
+    return;
+
+  g_hash_table_add (prewarm->seen, g_object_ref (file));
+  g_queue_push_tail (&prewarm->files, g_object_ref (file));
+}
+
+static gboolean
+is_clang_language (const char *lang_id)
+{
+  if (lang_id == NULL)
+    return FALSE;
+
+  for (guint i = 0; i < G_N_ELEMENTS (languages); i++)
+    {
+      if (g_str_equal (lang_id, languages[i]))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+is_clang_file (GFile *file)
+{
+  g_autofree char *name = g_file_get_basename (file);
+
+  for (guint i = 0; i < G_N_ELEMENTS (suffixes); i++)
+    {
+      if (g_str_has_suffix (name, suffixes[i]))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+prewarm_parse_cb (GObject      *object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  IdeClangClient *client = (IdeClangClient *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_CLANG_CLIENT (client));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
+
+  if (!ide_clang_client_prewarm_finish (client, result, &error))
+    ide_task_return_error (task, g_steal_pointer (&error));
+  else
+    ide_task_return_boolean (task, TRUE);
+}
+
+static void
+prewarm_get_build_flags_cb (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  IdeBuildSystem *build_system = (IdeBuildSystem *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+  g_auto(GStrv) flags = NULL;
+  Prewarm *prewarm;
+  GFile *file;
+
+  g_assert (IDE_IS_BUILD_SYSTEM (build_system));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
+
+  prewarm = ide_task_get_task_data (task);
+  file = ide_task_get_source_object (task);
+
+  g_assert (prewarm != NULL);
+  g_assert (G_IS_FILE (file));
+
+  /* Without flags a parse does not tell us anything useful */
+  if (!(flags = ide_build_system_get_build_flags_finish (build_system, result, &error)) ||
+      flags[0] == NULL)
+    {
+      if (error != NULL)
+        ide_task_return_error (task, g_steal_pointer (&error));
+      else
+        ide_task_return_boolean (task, FALSE);
+      return;
+    }
+
+  /* The flags must match what the buffer addins will send later, since
+   * the daemon only reuses a translation unit parsed with the same flags.
+   */
+  ide_clang_client_prewarm_async (prewarm->client,
+                                  file,
+                                  (const char * const *)flags,
+                                  prewarm->cancellable,
+                                  prewarm_parse_cb,
+                                  g_steal_pointer (&task));
+}
+
+static void
+prewarm_file_cb (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+  GFile *file = (GFile *)object;
+  g_autoptr(Prewarm) prewarm = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (IDE_IS_TASK (result));
+  g_assert (prewarm != NULL);
+  g_assert (prewarm->n_active > 0);
+
+  if (!ide_task_propagate_boolean (IDE_TASK (result), &error) && error != NULL)
+    g_debug ("Failed to prewarm %s: %s", g_file_peek_path (file), error->message);
+
+  prewarm->n_active--;
+
+  prewarm_pump (prewarm);
+}
+
+static void
+prewarm_pump (Prewarm *prewarm)
+{
+  g_assert (prewarm != NULL);
+
+  if (g_cancellable_is_cancelled (prewarm->cancellable))
+    return;
+
+  while (prewarm->n_active < prewarm->max_active &&
+         prewarm->files.length > 0)
+    {
+      g_autoptr(GFile) file = g_queue_pop_head (&prewarm->files);
+      g_autoptr(IdeTask) task = NULL;
+
+      g_debug ("Prewarming %s", g_file_peek_path (file));
+
+      prewarm->n_active++;
+
+      /* Use the file as the source object so that the task does not
+       * keep the stage alive if the pipeline is torn down.
+       */
+      task = ide_task_new (file, prewarm->cancellable, prewarm_file_cb, prewarm_ref (prewarm));
+      ide_task_set_source_tag (task, prewarm_pump);
+      ide_task_set_kind (task, IDE_TASK_KIND_INDEXER);
+      ide_task_set_priority (task, G_PRIORITY_LOW);
+      ide_task_set_task_data (task, prewarm_ref (prewarm), prewarm_unref);
+
+      ide_build_system_get_build_flags_async (prewarm->build_system,
+                                              file,
+                                              prewarm->cancellable,
+                                              prewarm_get_build_flags_cb,
+                                              g_steal_pointer (&task));
+    }
+}
+
+static void
+prewarm_list_status_cb (GObject      *object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+  IdeVcs *vcs = (IdeVcs *)object;
+  g_autoptr(Prewarm) prewarm = user_data;
+  g_autoptr(GListModel) model = NULL;
+  g_autoptr(GError) error = NULL;
+  guint n_items;
+
+  g_assert (IDE_IS_VCS (vcs));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (prewarm != NULL);
+
+  if (!(model = ide_vcs_list_status_finish (vcs, result, &error)))
+    {
+      g_debug ("Cannot prewarm modified files: %s", error->message);
+      return;
+    }
+
+  n_items = g_list_model_get_n_items (model);
+
+  for (guint i = 0; i < n_items; i++)
+    {
+      g_autoptr(IdeVcsFileInfo) info = g_list_model_get_item (model, i);
+      GFile *file = ide_vcs_file_info_get_file (info);
+
+      switch (ide_vcs_file_info_get_status (info))
+        {
+        case IDE_VCS_FILE_STATUS_ADDED:
+        case IDE_VCS_FILE_STATUS_CHANGED:
+        case IDE_VCS_FILE_STATUS_RENAMED:
+        case IDE_VCS_FILE_STATUS_UNTRACKED:
+          if (file != NULL && is_clang_file (file))
+            prewarm_add_file (prewarm, file);
+          break;
+
+        case IDE_VCS_FILE_STATUS_IGNORED:
+        case IDE_VCS_FILE_STATUS_UNCHANGED:
+        case IDE_VCS_FILE_STATUS_DELETED:
+        default:
+          break;
+        }
+    }
+
+  prewarm_pump (prewarm);
+}
+
+static void
+gbp_clang_prewarm_stage_build_async (IdePipelineStage    *stage,
+                                     IdePipeline         *pipeline,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+  GbpClangPrewarmStage *self = (GbpClangPrewarmStage *)stage;
+  g_autoptr(Prewarm) prewarm = NULL;
+  g_autoptr(IdeTask) task = NULL;
+  g_autoptr(GFile) workdir = NULL;
+  IdeBufferManager *buffer_manager;
+  IdeBuildSystem *build_system;
+  IdeContext *context;
+  IdeVcs *vcs;
+  guint n_items;
+
+  IDE_ENTRY;
+
+  g_assert (GBP_IS_CLANG_PREWARM_STAGE (self));
+  g_assert (IDE_IS_PIPELINE (pipeline));
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, gbp_clang_prewarm_stage_build_async);
+
+  /* Stop anything left over from a previous configure */
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  build_system = ide_build_system_from_context (context);
+
+  if (build_system == NULL)
+    {
+      ide_task_return_boolean (task, TRUE);
+      IDE_EXIT;
+    }
+
+  self->cancellable = g_cancellable_new ();
+
+  prewarm = g_rc_box_new0 (Prewarm);
+  prewarm->build_system = g_object_ref (build_system);
+  prewarm->client = ide_object_ensure_child_typed (IDE_OBJECT (context), IDE_TYPE_CLANG_CLIENT);
+  prewarm->cancellable = g_object_ref (self->cancellable);
+  prewarm->seen = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
+  prewarm->max_active = MAX (1, ide_thread_pool_get_max_threads (IDE_THREAD_POOL_INDEXER));
+  g_queue_init (&prewarm->files);
+
+  /* Buffers are appended as they are loaded, so walk them backwards to
+   * start with the most recently opened ones.
+   */
+  buffer_manager = ide_buffer_manager_from_context (context);
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (buffer_manager));
+
+  for (guint i = n_items; i > 0; i--)
+    {
+      g_autoptr(IdeBuffer) buffer = g_list_model_get_item (G_LIST_MODEL (buffer_manager), i - 1);
+
+      if (!ide_buffer_get_is_temporary (buffer) &&
+          is_clang_language (ide_buffer_get_language_id (buffer)))
+        prewarm_add_file (prewarm, ide_buffer_get_file (buffer));
+    }
+
+  prewarm_pump (prewarm);
+
+  vcs = ide_vcs_from_context (context);
+  workdir = ide_context_ref_workdir (context);
+
+  if (vcs != NULL)
+    ide_vcs_list_status_async (vcs,
+                               workdir,
+                               TRUE,
+                               G_PRIORITY_LOW,
+                               prewarm->cancellable,
+                               prewarm_list_status_cb,
+                               prewarm_ref (prewarm));
+
+  /* Don't hold up the pipeline, this is purely opportunistic */
+  ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+static gboolean
+gbp_clang_prewarm_stage_build_finish (IdePipelineStage  *stage,
+                                      GAsyncResult      *result,
+                                      GError           **error)
+{
+  g_assert (GBP_IS_CLANG_PREWARM_STAGE (stage));
+  g_assert (IDE_IS_TASK (result));
+
+  return ide_task_propagate_boolean (IDE_TASK (result), error);
+}
+
+static void
+gbp_clang_prewarm_stage_destroy (IdeObject *object)
+{
+  GbpClangPrewarmStage *self = (GbpClangPrewarmStage *)object;
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+
+  IDE_OBJECT_CLASS (gbp_clang_prewarm_stage_parent_class)->destroy (object);
+}
+
+static void
+gbp_clang_prewarm_stage_class_init (GbpClangPrewarmStageClass *klass)
+{
+  IdeObjectClass *i_object_class = IDE_OBJECT_CLASS (klass);
+  IdePipelineStageClass *stage_class = IDE_PIPELINE_STAGE_CLASS (klass);
+
+  i_object_class->destroy = gbp_clang_prewarm_stage_destroy;
+
+  stage_class->build_async = gbp_clang_prewarm_stage_build_async;
+  stage_class->build_finish = gbp_clang_prewarm_stage_build_finish;
+}
+
+static void
+gbp_clang_prewarm_stage_init (GbpClangPrewarmStage *self)
+{
+  ide_pipeline_stage_set_name (IDE_PIPELINE_STAGE (self), _("Prepare code insight"));
+}
+
+GbpClangPrewarmStage *
+gbp_clang_prewarm_stage_new (void)
+{
+  return g_object_new (GBP_TYPE_CLANG_PREWARM_STAGE, NULL);
+}
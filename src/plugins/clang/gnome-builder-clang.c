@@ -484,6 +484,62 @@ handle_diagnose (JsonrpcServer *server,
                             client_op_ref (op));
 }
 
+/* Prewarm Handler {{{1 */
+
+static void
+handle_prewarm_cb (IdeClang     *clang,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  g_autoptr(ClientOp) op = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_CLANG (clang));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (op != NULL);
+
+  if (!ide_clang_prewarm_finish (clang, result, &error))
+    client_op_error (op, error);
+  else
+    client_op_reply (op, g_variant_new_boolean (TRUE));
+}
+
+static void
+handle_prewarm (JsonrpcServer *server,
+                JsonrpcClient *client,
+                const gchar   *method,
+                GVariant      *id,
+                GVariant      *params,
+                IdeClang      *clang)
+{
+  g_autoptr(ClientOp) op = NULL;
+  g_auto(GStrv) flags = NULL;
+  const gchar *path = NULL;
+
+  g_assert (JSONRPC_IS_SERVER (server));
+  g_assert (JSONRPC_IS_CLIENT (client));
+  g_assert (g_str_equal (method, "clang/prewarm"));
+  g_assert (id != NULL);
+  g_assert (IDE_IS_CLANG (clang));
+
+  op = client_op_new (client, id);
+
+  if (!JSONRPC_MESSAGE_PARSE (params, "path", JSONRPC_MESSAGE_GET_STRING (&path)))
+    {
+      client_op_bad_params (op);
+      return;
+    }
+
+  JSONRPC_MESSAGE_PARSE (params, "flags", JSONRPC_MESSAGE_GET_STRV (&flags));
+
+  ide_clang_prewarm_async (clang,
+                           path,
+                           (const gchar * const *)flags,
+                           op->cancellable,
+                           (GAsyncReadyCallback)handle_prewarm_cb,
+                           client_op_ref (op));
+}
+
 /* Locate Symbol {{{1 */
 
 static void
@@ -940,6 +996,7 @@ main (gint argc,
   ADD_HANDLER ("clang/getSymbolTree", handle_get_symbol_tree);
   ADD_HANDLER ("clang/indexFile", handle_index_file);
   ADD_HANDLER ("clang/locateSymbol", handle_locate_symbol);
+  ADD_HANDLER ("clang/prewarm", handle_prewarm);
   ADD_HANDLER ("clang/getHighlightIndex", handle_get_highlight_index);
   ADD_HANDLER ("clang/setBuffer", handle_set_buffer);
   ADD_HANDLER ("$/cancelRequest", handle_cancel_request);
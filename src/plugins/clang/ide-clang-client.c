@@ -1175,6 +1175,90 @@ ide_clang_client_diagnose_finish (IdeClangClient  *self,
   return ide_task_propagate_pointer (IDE_TASK (result), error);
 }
 
+static void
+ide_clang_client_prewarm_cb (GObject      *object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  IdeClangClient *self = (IdeClangClient *)object;
+  g_autoptr(GVariant) reply = NULL;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_CLANG_CLIENT (self));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
+
+  if (!ide_clang_client_call_finish (self, result, &reply, &error))
+    ide_task_return_error (task, g_steal_pointer (&error));
+  else
+    ide_task_return_boolean (task, TRUE);
+}
+
+/**
+ * ide_clang_client_prewarm_async:
+ *
+ * Asks the daemon to parse @file ahead of time and keep the translation
+ * unit, so that the next request for @file with the same @flags only
+ * needs to reparse it.
+ */
+void
+ide_clang_client_prewarm_async (IdeClangClient      *self,
+                                GFile               *file,
+                                const gchar * const *flags,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+  g_autoptr(IdeTask) task = NULL;
+  g_autoptr(GVariant) params = NULL;
+  g_autofree gchar *path = NULL;
+
+  g_return_if_fail (IDE_IS_CLANG_CLIENT (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, ide_clang_client_prewarm_async);
+  ide_task_set_kind (task, IDE_TASK_KIND_INDEXER);
+
+  if (!g_file_is_native (file))
+    {
+      ide_task_return_new_error (task,
+                                 G_IO_ERROR,
+                                 G_IO_ERROR_NOT_SUPPORTED,
+                                 "File must be a local file");
+      return;
+    }
+
+  ide_clang_client_sync_buffers (self);
+
+  path = g_file_get_path (file);
+
+  params = JSONRPC_MESSAGE_NEW (
+    "path", JSONRPC_MESSAGE_PUT_STRING (path),
+    "flags", JSONRPC_MESSAGE_PUT_STRV (flags)
+  );
+
+  ide_clang_client_call_async (self,
+                               "clang/prewarm",
+                               params,
+                               cancellable,
+                               ide_clang_client_prewarm_cb,
+                               g_steal_pointer (&task));
+}
+
+gboolean
+ide_clang_client_prewarm_finish (IdeClangClient  *self,
+                                 GAsyncResult    *result,
+                                 GError         **error)
+{
+  g_return_val_if_fail (IDE_IS_CLANG_CLIENT (self), FALSE);
+  g_return_val_if_fail (IDE_IS_TASK (result), FALSE);
+
+  return ide_task_propagate_boolean (IDE_TASK (result), error);
+}
+
 static void
 ide_clang_client_get_highlight_index_cb (GObject      *object,
                                          GAsyncResult *result,
@@ -39,6 +39,10 @@
 #define PRIORITY_FIND_SCOPE   (100)
 #define PRIORITY_INDEX_FILE   (500)
 #define PRIORITY_HIGHLIGHT    (300)
+#define PRIORITY_PREWARM      (1000)
+
+/* Each unit holds an AST and a precompiled preamble, which can be large */
+#define MAX_CACHED_UNITS 8
 
 #if 0
 # define PROBE G_STMT_START { g_printerr ("PROBE: %s\n", G_STRFUNC); } G_STMT_END
@@ -51,6 +55,7 @@ struct _IdeClang
   GObject     parent;
   GFile      *workdir;
   GHashTable *unsaved_files;
+  GHashTable *units;
   CXIndex     index;
 };
 
@@ -62,6 +67,23 @@ typedef struct
   guint                 len;
 } UnsavedFiles;
 
+/*
+ * Translation units are kept after a request, keyed by the file and the
+ * flags it was parsed with, so that the next request for the file only
+ * needs to reparse. Reparsing reuses the precompiled preamble, which is
+ * most of the work for a typical file. The table is only used from the
+ * main thread while workers lock the individual unit they operate on.
+ */
+typedef struct
+{
+  GMutex             mutex;
+  char              *path;
+  CXTranslationUnit  unit;
+  gint64             last_used;
+} CachedUnit;
+
+typedef CachedUnit CachedUnitLock;
+
 G_DEFINE_FINAL_TYPE (IdeClang, ide_clang, G_TYPE_OBJECT)
 
 static GHashTable *unsupported_by_clang;
@@ -76,6 +98,163 @@ unsaved_files_free (UnsavedFiles *uf)
   g_slice_free (UnsavedFiles, uf);
 }
 
+static void
+cached_unit_finalize (gpointer data)
+{
+  CachedUnit *cu = data;
+
+  g_clear_pointer (&cu->unit, clang_disposeTranslationUnit);
+  g_clear_pointer (&cu->path, g_free);
+  g_mutex_clear (&cu->mutex);
+}
+
+static CachedUnit *
+cached_unit_ref (CachedUnit *cu)
+{
+  return g_atomic_rc_box_acquire (cu);
+}
+
+static void
+cached_unit_unref (CachedUnit *cu)
+{
+  g_atomic_rc_box_release_full (cu, cached_unit_finalize);
+}
+
+static unsigned
+cached_unit_get_options (void)
+{
+  return clang_defaultEditingTranslationUnitOptions ()
+#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 43)
+       | CXTranslationUnit_CreatePreambleOnFirstParse
+#endif
+#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 35)
+       | CXTranslationUnit_KeepGoing
+#endif
+       | CXTranslationUnit_DetailedPreprocessingRecord;
+}
+
+/*
+ * Brings @cu up to date with @ufs, reparsing if it was parsed before.
+ * On success @cu is returned locked and must be released with
+ * cached_unit_unlock(), which g_autoptr(CachedUnitLock) does.
+ */
+static CachedUnitLock *
+cached_unit_lock (CachedUnit          *cu,
+                  CXIndex              index,
+                  const char * const  *argv,
+                  int                  argc,
+                  UnsavedFiles        *ufs,
+                  enum CXErrorCode    *code)
+{
+  g_assert (cu != NULL);
+  g_assert (ufs != NULL);
+  g_assert (code != NULL);
+
+  g_mutex_lock (&cu->mutex);
+
+  if (cu->unit != NULL)
+    {
+      *code = clang_reparseTranslationUnit (cu->unit,
+                                            ufs->len,
+                                            ufs->files,
+                                            clang_defaultReparseOptions (cu->unit));
+
+      if (*code == CXError_Success)
+        return cu;
+
+      /* The unit may not be used again after a failed reparse */
+      g_clear_pointer (&cu->unit, clang_disposeTranslationUnit);
+    }
+
+  *code = clang_parseTranslationUnit2 (index,
+                                       cu->path,
+                                       argv,
+                                       argc,
+                                       ufs->files,
+                                       ufs->len,
+                                       cached_unit_get_options (),
+                                       &cu->unit);
+
+  if (*code == CXError_Success)
+    return cu;
+
+  cu->unit = NULL;
+  g_mutex_unlock (&cu->mutex);
+
+  return NULL;
+}
+
+static void
+cached_unit_unlock (CachedUnitLock *cu)
+{
+  g_mutex_unlock (&cu->mutex);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CachedUnitLock, cached_unit_unlock)
+
+static CachedUnit *
+ide_clang_ref_unit (IdeClang            *self,
+                    const char          *path,
+                    const char * const  *argv)
+{
+  g_autoptr(GString) key = NULL;
+  CachedUnit *cu;
+
+  g_assert (IDE_IS_CLANG (self));
+  g_assert (path != NULL);
+
+  key = g_string_new (path);
+  for (guint i = 0; argv != NULL && argv[i]; i++)
+    {
+      g_string_append_c (key, '\n');
+      g_string_append (key, argv[i]);
+    }
+
+  if (!(cu = g_hash_table_lookup (self->units, key->str)))
+    {
+      GHashTableIter iter;
+      CachedUnit *other;
+      const char *oldest_key = NULL;
+      const char *other_key;
+      gint64 oldest = G_MAXINT64;
+
+      /* The flags for the file changed, so the old unit is stale */
+      g_hash_table_iter_init (&iter, self->units);
+      while (g_hash_table_iter_next (&iter, (gpointer *)&other_key, (gpointer *)&other))
+        {
+          if (g_str_equal (other->path, path))
+            g_hash_table_iter_remove (&iter);
+        }
+
+      if (g_hash_table_size (self->units) >= MAX_CACHED_UNITS)
+        {
+          g_hash_table_iter_init (&iter, self->units);
+          while (g_hash_table_iter_next (&iter, (gpointer *)&other_key, (gpointer *)&other))
+            {
+              if (other->last_used < oldest)
+                {
+                  oldest = other->last_used;
+                  oldest_key = other_key;
+                }
+            }
+
+          /* Workers still using the unit keep it alive until they finish */
+          if (oldest_key != NULL)
+            g_hash_table_remove (self->units, oldest_key);
+        }
+
+      cu = g_atomic_rc_box_new0 (CachedUnit);
+      g_mutex_init (&cu->mutex);
+      cu->path = g_strdup (path);
+
+      g_hash_table_insert (self->units, g_string_free (g_steal_pointer (&key), FALSE), cu);
+    }
+
+  cu->last_used = g_get_monotonic_time ();
+
+  return cached_unit_ref (cu);
+}
+
 static const gchar *
 ide_clang_get_llvm_flags (void)
 {
@@ -525,6 +704,7 @@ ide_clang_finalize (GObject *object)
 
   g_clear_object (&self->workdir);
   g_clear_pointer (&self->unsaved_files, g_hash_table_unref);
+  g_clear_pointer (&self->units, g_hash_table_unref);
   g_clear_pointer (&self->index, clang_disposeIndex);
 
   G_OBJECT_CLASS (ide_clang_parent_class)->finalize (object);
@@ -556,6 +736,8 @@ ide_clang_init (IdeClang *self)
   self->index = clang_createIndex (0, 0);
   self->unsaved_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
                                                (GDestroyNotify)g_bytes_unref);
+  self->units = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify)cached_unit_unref);
 }
 
 IdeClang *
@@ -957,6 +1139,7 @@ ide_clang_index_file_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex       index;
+  CachedUnit   *unit;
   UnsavedFiles *ufs;
   GPtrArray    *diagnostics;
   GFile        *workdir;
@@ -970,6 +1153,7 @@ diagnose_free (gpointer data)
 {
   Diagnose *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_pointer (&state->path, g_free);
   g_clear_pointer (&state->argv, g_strfreev);
@@ -1150,9 +1334,9 @@ ide_clang_diagnose_worker (IdeTask      *task,
 {
   Diagnose *state = task_data;
   g_autoptr(GFile) file = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  CXTranslationUnit unit;
   enum CXErrorCode code;
-  unsigned options;
   guint n_diags;
 
   g_assert (IDE_IS_CLANG (source_object));
@@ -1161,20 +1345,12 @@ ide_clang_diagnose_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (state->diagnostics != NULL);
 
-  options = clang_defaultEditingTranslationUnitOptions ()
-#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 35)
-          | CXTranslationUnit_KeepGoing
-#endif
-          | CXTranslationUnit_DetailedPreprocessingRecord;
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -1186,6 +1362,8 @@ ide_clang_diagnose_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   n_diags = clang_getNumDiagnostics (unit);
   file = g_file_new_for_path (state->path);
 
@@ -1252,6 +1430,8 @@ ide_clang_diagnose_async (IdeClang            *self,
 
   IDE_PTR_ARRAY_SET_FREE_FUNC (state->diagnostics, ide_object_unref_and_destroy);
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_clang_diagnose_async);
   ide_task_set_kind (task, IDE_TASK_KIND_COMPILER);
@@ -1288,6 +1468,7 @@ ide_clang_diagnose_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex        index;
+  CachedUnit    *unit;
   UnsavedFiles  *ufs;
   gchar         *path;
   gchar        **argv;
@@ -1301,6 +1482,7 @@ complete_free (gpointer data)
 {
   Complete *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_pointer (&state->path, g_free);
   g_clear_pointer (&state->argv, g_strfreev);
@@ -1392,27 +1574,23 @@ ide_clang_complete_worker (IdeTask      *task,
                            GCancellable *cancellable)
 {
   Complete *state = task_data;
+  g_autoptr(CachedUnitLock) locked = NULL;
   g_autoptr(CXCodeCompleteResults) results = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  CXTranslationUnit unit;
   GVariantBuilder builder;
   enum CXErrorCode code;
-  unsigned options;
 
   g_assert (IDE_IS_TASK (task));
   g_assert (IDE_IS_CLANG (source_object));
   g_assert (state != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  options = clang_defaultEditingTranslationUnitOptions ();
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -1424,6 +1602,8 @@ ide_clang_complete_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   results = clang_codeCompleteAt (unit,
                                   state->path,
                                   state->line,
@@ -1488,6 +1668,8 @@ ide_clang_complete_async (IdeClang            *self,
   state->line = line;
   state->column = column;
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_check_cancellable (task, FALSE);
   ide_task_set_source_tag (task, ide_clang_complete_async);
@@ -1513,6 +1695,7 @@ ide_clang_complete_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex        index;
+  CachedUnit    *unit;
   UnsavedFiles  *ufs;
   gchar         *path;
   gchar        **argv;
@@ -1526,6 +1709,7 @@ find_nearest_scope_free (gpointer data)
 {
   FindNearestScope *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_pointer (&state->path, g_free);
   g_clear_pointer (&state->argv, g_strfreev);
@@ -1540,7 +1724,8 @@ ide_clang_find_nearest_scope_worker (IdeTask      *task,
 {
   FindNearestScope *state = task_data;
   g_autoptr(IdeSymbol) ret = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  CXTranslationUnit unit;
   g_autoptr(GError) error = NULL;
   enum CXCursorKind kind;
   enum CXErrorCode code;
@@ -1553,14 +1738,12 @@ ide_clang_find_nearest_scope_worker (IdeTask      *task,
   g_assert (state != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      clang_defaultEditingTranslationUnitOptions (),
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -1572,6 +1755,8 @@ ide_clang_find_nearest_scope_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   file = clang_getFile (unit, state->path);
   loc = clang_getLocation (unit, file, state->line, state->column);
   cursor = clang_getCursor (unit, loc);
@@ -1641,6 +1826,8 @@ ide_clang_find_nearest_scope_async (IdeClang            *self,
   state->line = line;
   state->column = column;
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_clang_find_nearest_scope_async);
   ide_task_set_kind (task, IDE_TASK_KIND_COMPILER);
@@ -1665,6 +1852,7 @@ ide_clang_find_nearest_scope_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex        index;
+  CachedUnit    *unit;
   UnsavedFiles  *ufs;
   GFile         *workdir;
   gchar         *path;
@@ -1679,6 +1867,7 @@ locate_symbol_free (gpointer data)
 {
   LocateSymbol *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_object (&state->workdir);
   g_clear_pointer (&state->path, g_free);
@@ -1696,7 +1885,8 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
   g_autoptr(IdeLocation) declaration = NULL;
   g_autoptr(IdeLocation) definition = NULL;
   g_autoptr(IdeSymbol) ret = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  CXTranslationUnit unit;
   g_auto(CXString) cxstr = {0};
   CXSourceLocation cxlocation;
   enum CXErrorCode code;
@@ -1705,7 +1895,6 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
   CXCursor cursor;
   CXCursor tmpcursor;
   CXFile cxfile;
-  unsigned options;
 
   g_assert (IDE_IS_TASK (task));
   g_assert (IDE_IS_CLANG (source_object));
@@ -1713,17 +1902,12 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  options = clang_defaultEditingTranslationUnitOptions ()
-          | CXTranslationUnit_DetailedPreprocessingRecord;
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -1735,6 +1919,8 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   cxfile = clang_getFile (unit, state->path);
   cxlocation = clang_getLocation (unit, cxfile, state->line, state->column);
   cursor = clang_getCursor (unit, cxlocation);
@@ -1832,6 +2018,8 @@ ide_clang_locate_symbol_async (IdeClang            *self,
   else
     state->workdir = g_file_new_for_path ((parent = g_path_get_dirname (path)));
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_clang_locate_symbol_async);
   ide_task_set_kind (task, IDE_TASK_KIND_COMPILER);
@@ -1856,6 +2044,7 @@ ide_clang_locate_symbol_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex          index;
+  CachedUnit      *unit;
   UnsavedFiles    *ufs;
   GFile           *workdir;
   gchar           *path;
@@ -1869,6 +2058,7 @@ get_symbol_tree_free (gpointer data)
 {
   GetSymbolTree *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_object (&state->workdir);
   g_clear_pointer (&state->path, g_free);
@@ -1965,7 +2155,8 @@ ide_clang_get_symbol_tree_worker (IdeTask      *task,
 {
   GetSymbolTree *state = task_data;
   g_autoptr(GVariant) ret = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  CXTranslationUnit unit;
   GVariantBuilder builder;
   enum CXErrorCode code;
   CXCursor cursor;
@@ -1976,14 +2167,12 @@ ide_clang_get_symbol_tree_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      clang_defaultEditingTranslationUnitOptions (),
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -1994,6 +2183,8 @@ ide_clang_get_symbol_tree_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   state->current = &builder;
 
   cursor = clang_getTranslationUnitCursor (unit);
@@ -2035,6 +2226,8 @@ ide_clang_get_symbol_tree_async (IdeClang            *self,
   else
     state->workdir = g_file_new_for_path ((parent = g_path_get_dirname (path)));
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_clang_get_symbol_tree_async);
   ide_task_set_kind (task, IDE_TASK_KIND_COMPILER);
@@ -2059,6 +2252,7 @@ ide_clang_get_symbol_tree_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex        index;
+  CachedUnit    *unit;
   UnsavedFiles  *ufs;
   GFile         *workdir;
   gchar         *path;
@@ -2071,6 +2265,7 @@ get_highlight_index_free (gpointer data)
 {
   GetHighlightIndex *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_object (&state->workdir);
   g_clear_pointer (&state->path, g_free);
@@ -2143,9 +2338,9 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
   static const gchar *common_defines[] = { "NULL", "MIN", "MAX", "__LINE__", "__FILE__" };
   GetHighlightIndex *state = task_data;
   g_autoptr(IdeHighlightIndex) highlight = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  CXTranslationUnit unit;
   enum CXErrorCode code;
-  unsigned options;
   CXCursor cursor;
 
   g_assert (IDE_IS_TASK (task));
@@ -2154,20 +2349,12 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  options = clang_defaultEditingTranslationUnitOptions ()
-#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 35)
-          | CXTranslationUnit_KeepGoing
-#endif
-          | CXTranslationUnit_DetailedPreprocessingRecord;
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -2178,6 +2365,8 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   highlight = ide_highlight_index_new ();
 
   for (guint i = 0; i < G_N_ELEMENTS (common_defines); i++)
@@ -2229,6 +2418,8 @@ ide_clang_get_highlight_index_async (IdeClang            *self,
   else
     state->workdir = g_file_new_for_path ((parent = g_path_get_dirname (path)));
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_clang_get_highlight_index_async);
   ide_task_set_kind (task, IDE_TASK_KIND_COMPILER);
@@ -2253,6 +2444,7 @@ ide_clang_get_highlight_index_finish (IdeClang      *self,
 typedef struct
 {
   CXIndex        index;
+  CachedUnit    *unit;
   UnsavedFiles  *ufs;
   gchar         *path;
   gchar        **argv;
@@ -2266,6 +2458,7 @@ get_index_key_free (gpointer data)
 {
   GetIndexKey *state = data;
 
+  g_clear_pointer (&state->unit, cached_unit_unref);
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_pointer (&state->path, g_free);
   g_clear_pointer (&state->argv, g_strfreev);
@@ -2279,7 +2472,8 @@ ide_clang_get_index_key_worker (IdeTask      *task,
                                 GCancellable *cancellable)
 {
   GetIndexKey *state = task_data;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  CXTranslationUnit unit;
   g_auto(CXString) cxusr = {0};
   const gchar *usr = NULL;
   enum CXErrorCode code;
@@ -2295,14 +2489,12 @@ ide_clang_get_index_key_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      clang_defaultEditingTranslationUnitOptions (),
-                                      &unit);
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
 
   if (code != CXError_Success)
     {
@@ -2313,6 +2505,8 @@ ide_clang_get_index_key_worker (IdeTask      *task,
       return;
     }
 
+  unit = locked->unit;
+
   file = clang_getFile (unit, state->path);
   loc = clang_getLocation (unit, file, state->line, state->column);
   cursor = clang_getCursor (unit, loc);
@@ -2358,6 +2552,8 @@ ide_clang_get_index_key_async (IdeClang            *self,
   state->line = line;
   state->column = column;
 
+  state->unit = ide_clang_ref_unit (self, state->path, (const char * const *)state->argv);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_clang_get_index_key_async);
   ide_task_set_kind (task, IDE_TASK_KIND_INDEXER);
@@ -2386,6 +2582,110 @@ ide_clang_get_index_key_finish (IdeClang      *self,
   return ide_task_propagate_pointer (IDE_TASK (result), error);
 }
 
+/* Prewarm {{{1 */
+
+typedef struct
+{
+  CXIndex        index;
+  CachedUnit    *unit;
+  UnsavedFiles  *ufs;
+  gchar        **argv;
+  gint           argc;
+} Prewarm;
+
+static void
+prewarm_free (gpointer data)
+{
+  Prewarm *state = data;
+
+  g_clear_pointer (&state->unit, cached_unit_unref);
+  g_clear_pointer (&state->ufs, unsaved_files_free);
+  g_clear_pointer (&state->argv, g_strfreev);
+  g_slice_free (Prewarm, state);
+}
+
+static void
+ide_clang_prewarm_worker (IdeTask      *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+  Prewarm *state = task_data;
+  g_autoptr(CachedUnitLock) locked = NULL;
+  enum CXErrorCode code;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (IDE_IS_CLANG (source_object));
+  g_assert (state != NULL);
+  g_assert (state->unit != NULL);
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  locked = cached_unit_lock (state->unit,
+                             state->index,
+                             (const char * const *)state->argv,
+                             state->argc,
+                             state->ufs,
+                             &code);
+
+  if (code != CXError_Success)
+    ide_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_FAILED,
+                               "Failed to parse file \"%s\", exited with code %d",
+                               state->unit->path, code);
+  else
+    ide_task_return_boolean (task, TRUE);
+}
+
+/**
+ * ide_clang_prewarm_async:
+ *
+ * Parses @path into the translation unit cache so that a later request
+ * for the file with the same flags only needs to reparse.
+ */
+void
+ide_clang_prewarm_async (IdeClang            *self,
+                         const gchar         *path,
+                         const gchar * const *argv,
+                         GCancellable        *cancellable,
+                         GAsyncReadyCallback  callback,
+                         gpointer             user_data)
+{
+  g_autoptr(IdeTask) task = NULL;
+  Prewarm *state;
+
+  PROBE;
+
+  g_return_if_fail (IDE_IS_CLANG (self));
+  g_return_if_fail (path != NULL);
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  state = g_slice_new0 (Prewarm);
+  state->index = self->index;
+  state->ufs = ide_clang_get_unsaved_files (self);
+  state->argv = ide_clang_cook_flags (path, argv);
+  state->argc = state->argv ? g_strv_length (state->argv) : 0;
+  state->unit = ide_clang_ref_unit (self, path, (const char * const *)state->argv);
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, ide_clang_prewarm_async);
+  ide_task_set_kind (task, IDE_TASK_KIND_INDEXER);
+  ide_task_set_task_data (task, state, prewarm_free);
+  ide_task_set_priority (task, PRIORITY_PREWARM);
+  ide_task_run_in_thread (task, ide_clang_prewarm_worker);
+}
+
+gboolean
+ide_clang_prewarm_finish (IdeClang      *self,
+                          GAsyncResult  *result,
+                          GError       **error)
+{
+  g_return_val_if_fail (IDE_IS_CLANG (self), FALSE);
+  g_return_val_if_fail (IDE_IS_TASK (result), FALSE);
+
+  return ide_task_propagate_boolean (IDE_TASK (result), error);
+}
+
 /* Set Unsaved File {{{1 */
 
 void
@@ -111,6 +111,15 @@ void               ide_clang_get_highlight_index_async  (IdeClang             *s
 IdeHighlightIndex *ide_clang_get_highlight_index_finish (IdeClang             *self,
                                                          GAsyncResult         *result,
                                                          GError              **error);
+void               ide_clang_prewarm_async              (IdeClang             *self,
+                                                         const gchar          *path,
+                                                         const gchar * const  *argv,
+                                                         GCancellable         *cancellable,
+                                                         GAsyncReadyCallback   callback,
+                                                         gpointer              user_data);
+gboolean           ide_clang_prewarm_finish             (IdeClang             *self,
+                                                         GAsyncResult         *result,
+                                                         GError              **error);
 void               ide_clang_set_unsaved_file           (IdeClang             *self,
                                                          GFile                *file,
                                                          GBytes               *bytes);
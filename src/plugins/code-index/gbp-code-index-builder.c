@@ -41,6 +41,7 @@ struct _GbpCodeIndexBuilder
   IdePersistentMapBuilder *map;
   IdeFuzzyIndexBuilder    *fuzzy;
   guint                    next_file_id;
+  gint64                   begin_time;
   guint                    has_run : 1;
 };
 
@@ -592,6 +593,7 @@ gbp_code_index_builder_run_async (GbpCodeIndexBuilder *self,
   ide_task_set_source_tag (task, gbp_code_index_builder_run_async);
 
   self->has_run = TRUE;
+  self->begin_time = ide_trace_begin_mark ();
 
   gbp_code_index_builder_aggregate_async (self,
                                           cancellable,
@@ -616,6 +618,10 @@ gbp_code_index_builder_run_finish (GbpCodeIndexBuilder  *self,
 
   ret = ide_task_propagate_boolean (IDE_TASK (result), error);
 
+  ide_trace_end_mark (self->begin_time, "Code Index", "Batch", "%s (%u files)",
+                      self->source_dir ? g_file_peek_path (self->source_dir) : "",
+                      self->next_file_id);
+
   /* Drop extraneous resources immediately */
   g_clear_object (&self->source_dir);
   g_clear_object (&self->index_dir);
@@ -59,6 +59,7 @@ typedef struct
   IdeCodeIndexIndex *index;
   GFile *workdir;
   GFile *indexdir;
+  GFile *segmentsdir;
 } LoadIndexes;
 
 enum {
@@ -85,6 +86,7 @@ load_indexes_free (LoadIndexes *state)
 {
   g_clear_object (&state->index);
   g_clear_object (&state->indexdir);
+  g_clear_object (&state->segmentsdir);
   g_clear_object (&state->workdir);
   g_slice_free (LoadIndexes, state);
 }
@@ -705,6 +707,53 @@ gbp_code_index_service_load_indexes_cb (GFile     *directory,
                              NULL);
 }
 
+static void
+gbp_code_index_service_load_segments (LoadIndexes  *state,
+                                      GCancellable *cancellable)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  gpointer infoptr;
+
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->segmentsdir));
+
+  enumerator = g_file_enumerate_children (state->segmentsdir,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          cancellable,
+                                          NULL);
+
+  if (enumerator == NULL)
+    return;
+
+  while ((infoptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
+    {
+      g_autoptr(GFileInfo) info = infoptr;
+      g_autoptr(GFile) directory = NULL;
+      g_autoptr(GError) error = NULL;
+
+      if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)
+        continue;
+
+      directory = g_file_enumerator_get_child (enumerator, info);
+
+      if (!ide_code_index_index_load_segment (state->index, directory, cancellable, &error) &&
+          !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_autoptr(GFile) keys_file = g_file_get_child (directory, "SymbolKeys");
+          g_autoptr(GFile) names_file = g_file_get_child (directory, "SymbolNames");
+
+          /* Segments are just a cache of the shards, so drop anything stale */
+          g_debug ("Removing code index segment: %s", error->message);
+
+          g_file_delete (keys_file, NULL, NULL);
+          g_file_delete (names_file, NULL, NULL);
+          g_file_delete (directory, NULL, NULL);
+        }
+    }
+}
+
 static void
 gbp_code_index_service_load_indexes (IdeTask      *task,
                                      gpointer      source_object,
@@ -712,6 +761,7 @@ gbp_code_index_service_load_indexes (IdeTask      *task,
                                      GCancellable *cancellable)
 {
   LoadIndexes *state = task_data;
+  g_autoptr(GError) error = NULL;
 
   g_assert (IDE_IS_TASK (task));
   g_assert (GBP_IS_CODE_INDEX_SERVICE (source_object));
@@ -719,6 +769,12 @@ gbp_code_index_service_load_indexes (IdeTask      *task,
   g_assert (IDE_IS_CODE_INDEX_INDEX (state->index));
   g_assert (G_IS_FILE (state->workdir));
   g_assert (G_IS_FILE (state->indexdir));
+  g_assert (G_IS_FILE (state->segmentsdir));
+
+  /* Segments must be loaded first so that the shards they contain are
+   * skipped while walking the index directory.
+   */
+  gbp_code_index_service_load_segments (state, cancellable);
 
   ide_g_file_walk (state->indexdir,
                    NULL,
@@ -726,6 +782,13 @@ gbp_code_index_service_load_indexes (IdeTask      *task,
                    gbp_code_index_service_load_indexes_cb,
                    state);
 
+  /* Now that everything is loaded, merge small shards into larger segments
+   * so that global search only needs to query a few indexes. This happens
+   * after every indexing pass as part of reloading the indexes.
+   */
+  if (!ide_code_index_index_compact (state->index, state->segmentsdir, cancellable, &error))
+    g_warning ("Failed to compact code index: %s", error->message);
+
   ide_task_return_boolean (task, TRUE);
 }
 
@@ -746,9 +809,12 @@ gbp_code_index_service_reload_indexes (GbpCodeIndexService *self)
   state->index = g_object_ref (self->index);
   state->workdir = ide_context_ref_workdir (context);
   state->indexdir = ide_context_cache_file (context, "code-index", NULL);
+  state->segmentsdir = ide_context_cache_file (context, "code-index-segments", NULL);
 
   task = ide_task_new (self, NULL, NULL, NULL);
   ide_task_set_source_tag (task, gbp_code_index_service_reload_indexes);
+  ide_task_set_kind (task, IDE_TASK_KIND_INDEXER);
+  ide_task_set_priority (task, G_PRIORITY_LOW);
   ide_task_set_task_data (task, state, load_indexes_free);
   ide_task_run_in_thread (task, gbp_code_index_service_load_indexes);
 }
@@ -29,17 +29,60 @@
 /*
  * This class will store index of all directories and will have a map of
  * directory and Indexes (IdeFuzzyIndex & IdePersistentMap)
+ *
+ * Every indexed directory gets its own small index (a "shard") written by
+ * GbpCodeIndexBuilder. Since querying thousands of tiny indexes is slow, the
+ * shards are periodically merged into a few larger "segments" by
+ * ide_code_index_index_compact(). A segment remembers which shards it was
+ * built from (and their mtime) so that when a shard is re-indexed, the
+ * segment can simply mask the file-ids belonging to that shard while the new
+ * shard takes over. Heavily masked segments are merged again on the next
+ * compaction, much like an LSM tree.
+ *
+ * Shards store a single "(uuuu)" declaration per key in SymbolKeys. Multiple
+ * shards may declare the same key though (think of a header included from a
+ * few directories), so segments store every one of them as "a(uuuu)".
  */
 
+/* Don't bother compacting until we have at least this many loose shards */
+#define COMPACT_MIN_SHARDS        32
+/* Upper bound on the number of files stored within a single segment */
+#define COMPACT_MAX_SEGMENT_FILES 20000
+/* Re-compact segments once 1/N of their files have been masked */
+#define COMPACT_MASKED_RATIO      4
+/* IdeFuzzyIndexBuilder can only address 24 bits worth of entries */
+#define COMPACT_MAX_SEGMENT_NAMES 0x00FFFFFF
+
 struct _IdeCodeIndexIndex
 {
   IdeObject   parent_instance;
 
   GMutex      mutex;
+
+  /* Path of a shard directory to the DirectoryIndex serving it, which may
+   * either be the shard itself or a segment it was compacted into.
+   */
   GHashTable *directories;
+
+  /* Every loaded DirectoryIndex, both shards and segments */
   GPtrArray  *indexes;
 };
 
+typedef struct
+{
+  char    *path;
+  guint64  mtime;
+  guint    first_file_id;
+  guint    n_files;
+  guint    masked : 1;
+} SegmentMember;
+
+typedef struct
+{
+  guint first_file_id;
+  guint n_files;
+} MaskedRange;
+
 typedef struct
 {
   GFile            *directory;
@@ -47,14 +90,24 @@ typedef struct
   IdeFuzzyIndex    *symbol_names;
   IdePersistentMap *symbol_keys;
   guint64           mtime;
+  guint             n_files;
+
+  /* The following are only set for compacted segments. @members maps the
+   * path of the shard directory to a SegmentMember and @masked contains
+   * the file-id ranges of shards which have since been re-indexed.
+   */
+  GHashTable       *members;
+  GArray           *masked;
+  guint             n_masked_files;
 } DirectoryIndex;
 
 typedef struct
 {
-  gchar   *query;
-  IdeHeap *fuzzy_matches;
-  guint    curr_index;
-  gsize    max_results;
+  gchar     *query;
+  IdeHeap   *fuzzy_matches;
+  GPtrArray *indexes;
+  guint      curr_index;
+  gsize      max_results;
 } PopulateTaskData;
 
 /*
@@ -63,17 +116,51 @@ typedef struct
  */
 typedef struct
 {
-  IdeFuzzyIndex      *index;
+  DirectoryIndex     *index;
   GListModel         *list;
   IdeFuzzyIndexMatch *match;
   guint               match_num;
 } FuzzyMatch;
 
+/*
+ * Snapshot of one input to compaction, along with the members which were
+ * still being served by it when the snapshot was taken.
+ */
+typedef struct
+{
+  DirectoryIndex *index;
+  GPtrArray      *members;
+} CompactSource;
+
+/* A single declaration of a key as stored in SymbolKeys */
+typedef struct
+{
+  guint32 file_id;
+  guint32 line;
+  guint32 line_offset;
+  guint32 flags;
+} KeyEntry;
+
+typedef struct
+{
+  IdeFuzzyIndexBuilder    *fuzzy;
+  GPtrArray               *sources;
+  GPtrArray               *members;
+  GArray                  *remap;
+
+  /* Key to GArray of KeyEntry, written as "a(uuuu)" */
+  GHashTable              *keys;
+
+  guint                    n_files;
+  guint                    n_keys;
+  gsize                    n_names;
+} SegmentWriter;
+
 G_DEFINE_FINAL_TYPE (IdeCodeIndexIndex, ide_code_index_index, IDE_TYPE_OBJECT)
 
-static void directory_index_free (DirectoryIndex *data);
+static void directory_index_unref (DirectoryIndex *data);
 
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (DirectoryIndex, directory_index_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (DirectoryIndex, directory_index_unref)
 
 static guint64
 newest_mtime (GFile        *a,
@@ -97,20 +184,221 @@ newest_mtime (GFile        *a,
   return aval > bval ? aval : bval;
 }
 
+static guint64
+shard_mtime (GFile        *directory,
+             GCancellable *cancellable)
+{
+  g_autoptr(GFile) keys_file = g_file_get_child (directory, "SymbolKeys");
+  g_autoptr(GFile) names_file = g_file_get_child (directory, "SymbolNames");
+
+  return newest_mtime (keys_file, names_file, cancellable);
+}
+
+static void
+segment_member_free (SegmentMember *member)
+{
+  g_clear_pointer (&member->path, g_free);
+  g_slice_free (SegmentMember, member);
+}
+
+static SegmentMember *
+segment_member_copy (const SegmentMember *member)
+{
+  SegmentMember *copy = g_slice_dup (SegmentMember, member);
+  copy->path = g_strdup (member->path);
+  return copy;
+}
+
+static void
+directory_index_finalize (gpointer data)
+{
+  DirectoryIndex *dir_index = data;
+
+  g_clear_object (&dir_index->symbol_names);
+  g_clear_object (&dir_index->symbol_keys);
+  g_clear_object (&dir_index->directory);
+  g_clear_object (&dir_index->source_directory);
+  g_clear_pointer (&dir_index->members, g_hash_table_unref);
+  g_clear_pointer (&dir_index->masked, g_array_unref);
+}
+
+static DirectoryIndex *
+directory_index_ref (DirectoryIndex *data)
+{
+  return g_atomic_rc_box_acquire (data);
+}
+
+static void
+directory_index_unref (DirectoryIndex *data)
+{
+  g_atomic_rc_box_release_full (data, directory_index_finalize);
+}
+
+static void
+directory_index_mask_member (DirectoryIndex *segment,
+                             SegmentMember  *member)
+{
+  MaskedRange range;
+
+  g_assert (segment != NULL);
+  g_assert (segment->members != NULL);
+  g_assert (member != NULL);
+
+  if (member->masked)
+    return;
+
+  member->masked = TRUE;
+
+  range.first_file_id = member->first_file_id;
+  range.n_files = member->n_files;
+  g_array_append_val (segment->masked, range);
+
+  segment->n_masked_files += member->n_files;
+}
+
+static gboolean
+directory_index_is_masked (const DirectoryIndex *dir_index,
+                           guint                 file_id)
+{
+  if (dir_index->masked == NULL)
+    return FALSE;
+
+  for (guint i = 0; i < dir_index->masked->len; i++)
+    {
+      const MaskedRange *range = &g_array_index (dir_index->masked, MaskedRange, i);
+
+      if (file_id >= range->first_file_id &&
+          file_id - range->first_file_id < range->n_files)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+directory_index_match_is_masked (const DirectoryIndex *dir_index,
+                                 IdeFuzzyIndexMatch   *match)
+{
+  GVariant *document;
+  guint file_id = 0;
+
+  if (dir_index->n_masked_files == 0)
+    return FALSE;
+
+  document = ide_fuzzy_index_match_get_document (match);
+  g_variant_get_child (document, 0, "u", &file_id);
+
+  return directory_index_is_masked (dir_index, file_id);
+}
+
+/*
+ * Finds the declaration of @key within @dir_index which is not masked,
+ * preferring the definition when there are many.
+ */
+static gboolean
+directory_index_lookup_key (const DirectoryIndex *dir_index,
+                            const char           *key,
+                            KeyEntry             *entry)
+{
+  g_autoptr(GVariant) variant = NULL;
+  GVariantIter iter;
+  KeyEntry local;
+  gboolean found = FALSE;
+
+  if (!(variant = ide_persistent_map_lookup_value (dir_index->symbol_keys, key)))
+    return FALSE;
+
+  if (g_variant_is_of_type (variant, G_VARIANT_TYPE ("(uuuu)")))
+    {
+      g_variant_get (variant, "(uuuu)", &local.file_id, &local.line, &local.line_offset, &local.flags);
+
+      if (directory_index_is_masked (dir_index, local.file_id))
+        return FALSE;
+
+      *entry = local;
+      return TRUE;
+    }
+
+  if (!g_variant_is_of_type (variant, G_VARIANT_TYPE ("a(uuuu)")))
+    return FALSE;
+
+  g_variant_iter_init (&iter, variant);
+  while (g_variant_iter_next (&iter, "(uuuu)", &local.file_id, &local.line, &local.line_offset, &local.flags))
+    {
+      /* Skip entries from shards that have been re-indexed since compaction */
+      if (directory_index_is_masked (dir_index, local.file_id))
+        continue;
+
+      *entry = local;
+      found = TRUE;
+
+      if (local.flags & IDE_SYMBOL_FLAGS_IS_DEFINITION)
+        break;
+    }
+
+  return found;
+}
+
 static void
-directory_index_free (DirectoryIndex *data)
+compact_source_free (CompactSource *source)
+{
+  g_clear_pointer (&source->index, directory_index_unref);
+  g_clear_pointer (&source->members, g_ptr_array_unref);
+  g_slice_free (CompactSource, source);
+}
+
+static gint
+segment_member_compare (gconstpointer a,
+                        gconstpointer b)
+{
+  const SegmentMember *member_a = *(const SegmentMember * const *)a;
+  const SegmentMember *member_b = *(const SegmentMember * const *)b;
+
+  return g_strcmp0 (member_a->path, member_b->path);
+}
+
+static gint
+compact_source_compare (gconstpointer a,
+                        gconstpointer b)
 {
-  g_clear_object (&data->symbol_names);
-  g_clear_object (&data->symbol_keys);
-  g_clear_object (&data->directory);
-  g_clear_object (&data->source_directory);
-  g_slice_free (DirectoryIndex, data);
+  const CompactSource *source_a = *(const CompactSource * const *)a;
+  const CompactSource *source_b = *(const CompactSource * const *)b;
+  const SegmentMember *member_a = g_ptr_array_index (source_a->members, 0);
+  const SegmentMember *member_b = g_ptr_array_index (source_b->members, 0);
+
+  return g_strcmp0 (member_a->path, member_b->path);
+}
+
+/*
+ * Advances @fuzzy_match to the next match at or after match_num which is
+ * not masked by a re-indexed shard. Returns %FALSE when exhausted.
+ */
+static gboolean
+fuzzy_match_next (FuzzyMatch *fuzzy_match)
+{
+  guint n_items = g_list_model_get_n_items (fuzzy_match->list);
+
+  g_clear_object (&fuzzy_match->match);
+
+  for (; fuzzy_match->match_num < n_items; fuzzy_match->match_num++)
+    {
+      g_autoptr(IdeFuzzyIndexMatch) match = g_list_model_get_item (fuzzy_match->list, fuzzy_match->match_num);
+
+      if (!directory_index_match_is_masked (fuzzy_match->index, match))
+        {
+          fuzzy_match->match = g_steal_pointer (&match);
+          return TRUE;
+        }
+    }
+
+  return FALSE;
 }
 
 static void
 populate_task_data_free (PopulateTaskData *data)
 {
   g_clear_pointer (&data->query, g_free);
+  g_clear_pointer (&data->indexes, g_ptr_array_unref);
 
   for (guint i = 0; i < data->fuzzy_matches->len; i++)
     {
@@ -154,6 +442,7 @@ directory_index_new (GFile         *directory,
   g_autoptr(DirectoryIndex) dir_index = NULL;
 
   g_assert (G_IS_FILE (directory));
+  g_assert (!source_directory || G_IS_FILE (source_directory));
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   symbol_keys = ide_persistent_map_new ();
@@ -168,24 +457,81 @@ directory_index_new (GFile         *directory,
   if (!ide_fuzzy_index_load_file (symbol_names, names_file, cancellable, error))
     return NULL;
 
-  dir_index = g_slice_new0 (DirectoryIndex);
+  dir_index = g_atomic_rc_box_new0 (DirectoryIndex);
+  dir_index->n_files = ide_fuzzy_index_get_metadata_uint32 (symbol_names, "n_files");
   dir_index->symbol_keys = g_steal_pointer (&symbol_keys);
   dir_index->symbol_names = g_steal_pointer (&symbol_names);
   dir_index->directory = g_file_dup (directory);
-  dir_index->source_directory = g_file_dup (source_directory);
+  dir_index->source_directory = source_directory ? g_file_dup (source_directory) : NULL;
   dir_index->mtime = newest_mtime (keys_file, names_file, cancellable);
 
   return g_steal_pointer (&dir_index);
 }
 
+/* Loads a compacted segment along with the list of shards it contains */
+static DirectoryIndex *
+segment_index_new (GFile         *directory,
+                   GCancellable  *cancellable,
+                   GError       **error)
+{
+  g_autoptr(DirectoryIndex) segment = NULL;
+  g_autoptr(GVariant) members = NULL;
+  GVariantIter iter;
+  const char *path;
+  guint64 mtime;
+  guint first_file_id;
+  guint n_files;
+
+  g_assert (G_IS_FILE (directory));
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  if (!(segment = directory_index_new (directory, NULL, cancellable, error)))
+    return NULL;
+
+  members = ide_fuzzy_index_get_metadata (segment->symbol_names, "segment-members");
+
+  if (members == NULL ||
+      !g_variant_is_of_type (members, G_VARIANT_TYPE ("a{s(tuu)}")))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "%s is not a code-index segment",
+                   g_file_peek_path (directory));
+      return NULL;
+    }
+
+  segment->members = g_hash_table_new_full (g_str_hash,
+                                            g_str_equal,
+                                            NULL,
+                                            (GDestroyNotify)segment_member_free);
+  segment->masked = g_array_new (FALSE, FALSE, sizeof (MaskedRange));
+
+  g_variant_iter_init (&iter, members);
+
+  while (g_variant_iter_next (&iter, "{&s(tuu)}", &path, &mtime, &first_file_id, &n_files))
+    {
+      SegmentMember *member = g_slice_new0 (SegmentMember);
+
+      member->path = g_strdup (path);
+      member->mtime = mtime;
+      member->first_file_id = first_file_id;
+      member->n_files = n_files;
+
+      g_hash_table_insert (segment->members, member->path, member);
+    }
+
+  return g_steal_pointer (&segment);
+}
+
 static gboolean
 can_ignore_reload (IdeCodeIndexIndex *self,
                    GFile             *directory,
                    GCancellable      *cancellable)
 {
   g_autofree gchar *dir_name = NULL;
+  DirectoryIndex *info;
   gboolean ret = FALSE;
-  gpointer value;
 
   g_assert (IDE_IS_CODE_INDEX_INDEX (self));
   g_assert (G_IS_FILE (directory));
@@ -195,18 +541,20 @@ can_ignore_reload (IdeCodeIndexIndex *self,
 
   g_mutex_lock (&self->mutex);
 
-  if (g_hash_table_lookup_extended (self->directories, dir_name, NULL, &value))
+  if ((info = g_hash_table_lookup (self->directories, dir_name)))
     {
-      g_autoptr(GFile) keys_file = g_file_get_child (directory, "SymbolKeys");
-      g_autoptr(GFile) names_file = g_file_get_child (directory, "SymbolNames");
-      guint i = GPOINTER_TO_UINT (value);
-      DirectoryIndex *info = g_ptr_array_index (self->indexes, i);
-      guint64 mtime = newest_mtime (keys_file, names_file, cancellable);
+      guint64 mtime = shard_mtime (directory, cancellable);
 
-      g_assert (i < self->indexes->len);
-      g_assert (self->indexes->len > 0);
+      if (info->members != NULL)
+        {
+          const SegmentMember *member = g_hash_table_lookup (info->members, dir_name);
 
-      ret = mtime <= info->mtime;
+          ret = member != NULL && !member->masked && mtime <= member->mtime;
+        }
+      else
+        {
+          ret = mtime <= info->mtime;
+        }
     }
 
   g_mutex_unlock (&self->mutex);
@@ -239,7 +587,7 @@ ide_code_index_index_load (IdeCodeIndexIndex   *self,
 {
   g_autoptr(DirectoryIndex) dir_index = NULL;
   g_autofree gchar *dir_name = NULL;
-  gpointer value;
+  DirectoryIndex *old_index;
 
   g_return_val_if_fail (IDE_IS_CODE_INDEX_INDEX (self), FALSE);
   g_return_val_if_fail (G_IS_FILE (directory), FALSE);
@@ -256,28 +604,590 @@ ide_code_index_index_load (IdeCodeIndexIndex   *self,
 
   g_mutex_lock (&self->mutex);
 
-  if (g_hash_table_lookup_extended (self->directories, dir_name, NULL, &value))
+  if ((old_index = g_hash_table_lookup (self->directories, dir_name)))
+    {
+      if (old_index->members != NULL)
+        {
+          SegmentMember *member = g_hash_table_lookup (old_index->members, dir_name);
+
+          /* The segment keeps serving the rest of its shards, but must
+           * ignore everything that came from this directory from now on.
+           */
+          if (member != NULL)
+            directory_index_mask_member (old_index, member);
+        }
+      else
+        {
+          g_ptr_array_remove_fast (self->indexes, old_index);
+        }
+    }
+
+  g_hash_table_insert (self->directories, g_steal_pointer (&dir_name), dir_index);
+  g_ptr_array_add (self->indexes, g_steal_pointer (&dir_index));
+
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
+
+/**
+ * ide_code_index_index_load_segment:
+ * @self: a #IdeCodeIndexIndex
+ * @directory: a #GFile of the segment directory to load
+ * @cancellable: a #GCancellable or %NULL
+ * @error: a #GError or %NULL
+ *
+ * Loads a segment previously created by ide_code_index_index_compact().
+ *
+ * Shards which have been re-indexed since the segment was written are
+ * masked within the segment so that they may be loaded individually with
+ * ide_code_index_index_load(). Segments should therefore be loaded before
+ * any of the shards they may contain.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set. If the
+ *   segment is invalid or no longer contains any valid shards,
+ *   %G_IO_ERROR_INVALID_DATA is set and the caller may delete the segment.
+ *
+ * Thread safety: you may call this function from a thread so long as the
+ *   thread has a reference to @self.
+ */
+gboolean
+ide_code_index_index_load_segment (IdeCodeIndexIndex  *self,
+                                   GFile              *directory,
+                                   GCancellable       *cancellable,
+                                   GError            **error)
+{
+  g_autoptr(DirectoryIndex) segment = NULL;
+  GHashTableIter iter;
+  SegmentMember *member;
+
+  g_return_val_if_fail (IDE_IS_CODE_INDEX_INDEX (self), FALSE);
+  g_return_val_if_fail (G_IS_FILE (directory), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  g_mutex_lock (&self->mutex);
+  for (guint i = 0; i < self->indexes->len; i++)
+    {
+      const DirectoryIndex *dir_index = g_ptr_array_index (self->indexes, i);
+
+      if (dir_index->members != NULL && g_file_equal (dir_index->directory, directory))
+        {
+          g_mutex_unlock (&self->mutex);
+          return TRUE;
+        }
+    }
+  g_mutex_unlock (&self->mutex);
+
+  g_debug ("Loading code index segment from %s", g_file_peek_path (directory));
+
+  if (!(segment = segment_index_new (directory, cancellable, error)))
+    return FALSE;
+
+  /* Mask any shard which has been re-indexed after we were compacted */
+  g_hash_table_iter_init (&iter, segment->members);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&member))
+    {
+      g_autoptr(GFile) shard = g_file_new_for_path (member->path);
+
+      if (shard_mtime (shard, cancellable) != member->mtime)
+        directory_index_mask_member (segment, member);
+    }
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, segment->members);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&member))
     {
-      guint i = GPOINTER_TO_UINT (value);
+      if (member->masked)
+        continue;
 
-      g_assert (i < self->indexes->len);
-      g_assert (self->indexes->len > 0);
+      /* Something else already provides this shard, so let it win */
+      if (g_hash_table_contains (self->directories, member->path))
+        directory_index_mask_member (segment, member);
+    }
+
+  if (segment->n_masked_files >= segment->n_files)
+    {
+      g_mutex_unlock (&self->mutex);
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Segment %s contains no valid shards",
+                   g_file_peek_path (directory));
+      return FALSE;
+    }
 
-      /* update current directory index by clearing old one */
-      directory_index_free (g_ptr_array_index (self->indexes, i));
-      g_ptr_array_index (self->indexes, i) = g_steal_pointer (&dir_index);
+  g_hash_table_iter_init (&iter, segment->members);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&member))
+    {
+      if (!member->masked)
+        g_hash_table_insert (self->directories, g_strdup (member->path), segment);
     }
+
+  g_ptr_array_add (self->indexes, g_steal_pointer (&segment));
+
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
+
+static void
+segment_writer_free (SegmentWriter *writer)
+{
+  g_clear_object (&writer->fuzzy);
+  g_clear_pointer (&writer->sources, g_ptr_array_unref);
+  g_clear_pointer (&writer->members, g_ptr_array_unref);
+  g_clear_pointer (&writer->remap, g_array_unref);
+  g_clear_pointer (&writer->keys, g_hash_table_unref);
+  g_slice_free (SegmentWriter, writer);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SegmentWriter, segment_writer_free)
+
+static SegmentWriter *
+segment_writer_new (void)
+{
+  SegmentWriter *writer = g_slice_new0 (SegmentWriter);
+
+  writer->fuzzy = ide_fuzzy_index_builder_new ();
+  writer->sources = g_ptr_array_new ();
+  writer->members = g_ptr_array_new_with_free_func ((GDestroyNotify)segment_member_free);
+  writer->remap = g_array_new (FALSE, FALSE, sizeof (guint));
+  writer->keys = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify)g_array_unref);
+
+  return writer;
+}
+
+static inline guint
+segment_writer_remap (SegmentWriter *writer,
+                      guint          file_id)
+{
+  if (file_id >= writer->remap->len)
+    return G_MAXUINT;
+  return g_array_index (writer->remap, guint, file_id);
+}
+
+static void
+segment_writer_add_name (const char *key,
+                         GVariant   *document,
+                         guint       priority,
+                         gpointer    user_data)
+{
+  SegmentWriter *writer = user_data;
+  guint file_id, line, line_offset, flags, kind;
+
+  if (!g_variant_is_of_type (document, G_VARIANT_TYPE ("(uuuuu)")))
+    return;
+
+  g_variant_get (document, "(uuuuu)", &file_id, &line, &line_offset, &flags, &kind);
+
+  if ((file_id = segment_writer_remap (writer, file_id)) == G_MAXUINT)
+    return;
+
+  ide_fuzzy_index_builder_insert (writer->fuzzy,
+                                  key,
+                                  g_variant_new ("(uuuuu)", file_id, line, line_offset, flags, kind),
+                                  priority);
+  writer->n_names++;
+}
+
+static void
+segment_writer_add_entry (SegmentWriter *writer,
+                          const char    *key,
+                          KeyEntry      *entry)
+{
+  GArray *entries;
+
+  if ((entry->file_id = segment_writer_remap (writer, entry->file_id)) == G_MAXUINT)
+    return;
+
+  if (!(entries = g_hash_table_lookup (writer->keys, key)))
+    {
+      entries = g_array_new (FALSE, FALSE, sizeof (KeyEntry));
+      g_hash_table_insert (writer->keys, g_strdup (key), entries);
+    }
+
+  /* Keep the definition up front so lookups can stop there */
+  if (entry->flags & IDE_SYMBOL_FLAGS_IS_DEFINITION)
+    g_array_prepend_val (entries, *entry);
   else
+    g_array_append_val (entries, *entry);
+
+  writer->n_keys++;
+}
+
+static void
+segment_writer_add_key (const char *key,
+                        GVariant   *value,
+                        gpointer    user_data)
+{
+  SegmentWriter *writer = user_data;
+  KeyEntry entry;
+
+  /* Shards have a single entry while segments may have many */
+  if (g_variant_is_of_type (value, G_VARIANT_TYPE ("(uuuu)")))
+    {
+      g_variant_get (value, "(uuuu)", &entry.file_id, &entry.line, &entry.line_offset, &entry.flags);
+      segment_writer_add_entry (writer, key, &entry);
+    }
+  else if (g_variant_is_of_type (value, G_VARIANT_TYPE ("a(uuuu)")))
+    {
+      GVariantIter iter;
+
+      g_variant_iter_init (&iter, value);
+      while (g_variant_iter_next (&iter, "(uuuu)", &entry.file_id, &entry.line, &entry.line_offset, &entry.flags))
+        segment_writer_add_entry (writer, key, &entry);
+    }
+}
+
+static void
+segment_writer_add (SegmentWriter *writer,
+                    CompactSource *source)
+{
+  DirectoryIndex *dir_index = source->index;
+
+  g_assert (writer != NULL);
+  g_assert (source != NULL);
+
+  g_array_set_size (writer->remap, 0);
+
+  for (guint i = 0; i < dir_index->n_files; i++)
+    {
+      guint invalid = G_MAXUINT;
+      g_array_append_val (writer->remap, invalid);
+    }
+
+  for (guint i = 0; i < source->members->len; i++)
     {
-      g_hash_table_insert (self->directories,
-                           g_steal_pointer (&dir_name),
-                           GUINT_TO_POINTER (self->indexes->len));
+      const SegmentMember *member = g_ptr_array_index (source->members, i);
+      SegmentMember *copy = segment_member_copy (member);
+
+      copy->first_file_id = writer->n_files;
+
+      for (guint j = 0; j < member->n_files; j++)
+        {
+          guint old_id = member->first_file_id + j;
+          guint new_id = writer->n_files + j;
+          const char *path;
+          char num[16];
+
+          if (old_id >= writer->remap->len)
+            break;
+
+          g_array_index (writer->remap, guint, old_id) = new_id;
 
-      g_ptr_array_add (self->indexes, g_steal_pointer (&dir_index));
+          g_snprintf (num, sizeof num, "%u", old_id);
+          if (!(path = ide_fuzzy_index_get_metadata_string (dir_index->symbol_names, num)))
+            continue;
+
+          g_snprintf (num, sizeof num, "%u", new_id);
+          ide_fuzzy_index_builder_set_metadata_uint32 (writer->fuzzy, path, new_id);
+          ide_fuzzy_index_builder_set_metadata_string (writer->fuzzy, num, path);
+        }
+
+      writer->n_files += member->n_files;
+      g_ptr_array_add (writer->members, copy);
     }
 
+  ide_fuzzy_index_foreach (dir_index->symbol_names, segment_writer_add_name, writer);
+  ide_persistent_map_foreach (dir_index->symbol_keys, segment_writer_add_key, writer);
+
+  g_ptr_array_add (writer->sources, source);
+}
+
+static gboolean
+segment_writer_write (SegmentWriter  *writer,
+                      GFile          *directory,
+                      GCancellable   *cancellable,
+                      GError        **error)
+{
+  g_autoptr(IdePersistentMapBuilder) map = NULL;
+  g_autoptr(GFile) keys_file = NULL;
+  g_autoptr(GFile) names_file = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const char *key;
+  GArray *entries;
+
+  g_assert (writer != NULL);
+  g_assert (G_IS_FILE (directory));
+
+  map = ide_persistent_map_builder_new ();
+
+  g_hash_table_iter_init (&iter, writer->keys);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&entries))
+    {
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uuuu)"));
+
+      for (guint i = 0; i < entries->len; i++)
+        {
+          const KeyEntry *entry = &g_array_index (entries, KeyEntry, i);
+
+          g_variant_builder_add (&builder, "(uuuu)",
+                                 entry->file_id,
+                                 entry->line,
+                                 entry->line_offset,
+                                 entry->flags);
+        }
+
+      ide_persistent_map_builder_insert (map, key, g_variant_builder_end (&builder), FALSE);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(tuu)}"));
+  for (guint i = 0; i < writer->members->len; i++)
+    {
+      const SegmentMember *member = g_ptr_array_index (writer->members, i);
+
+      g_variant_builder_add (&builder, "{s(tuu)}",
+                             member->path,
+                             member->mtime,
+                             member->first_file_id,
+                             member->n_files);
+    }
+
+  ide_fuzzy_index_builder_set_metadata (writer->fuzzy,
+                                        "segment-members",
+                                        g_variant_builder_end (&builder));
+  ide_fuzzy_index_builder_set_metadata_uint32 (writer->fuzzy, "n_files", writer->n_files);
+
+  if (!g_file_make_directory_with_parents (directory, cancellable, error))
+    return FALSE;
+
+  keys_file = g_file_get_child (directory, "SymbolKeys");
+  names_file = g_file_get_child (directory, "SymbolNames");
+
+  return ide_persistent_map_builder_write (map, keys_file, G_PRIORITY_LOW, cancellable, error) &&
+         ide_fuzzy_index_builder_write (writer->fuzzy, names_file, G_PRIORITY_LOW, cancellable, error);
+}
+
+static void
+delete_segment_directory (GFile *directory)
+{
+  g_autoptr(GFile) keys_file = g_file_get_child (directory, "SymbolKeys");
+  g_autoptr(GFile) names_file = g_file_get_child (directory, "SymbolNames");
+
+  g_file_delete (keys_file, NULL, NULL);
+  g_file_delete (names_file, NULL, NULL);
+  g_file_delete (directory, NULL, NULL);
+}
+
+/* Swaps a freshly written segment in place of the indexes it was built from */
+static void
+ide_code_index_index_install_segment (IdeCodeIndexIndex *self,
+                                      SegmentWriter     *writer,
+                                      GFile             *directory)
+{
+  g_autoptr(DirectoryIndex) segment = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) stale = NULL;
+
+  g_assert (IDE_IS_CODE_INDEX_INDEX (self));
+  g_assert (writer != NULL);
+  g_assert (G_IS_FILE (directory));
+
+  if (!(segment = segment_index_new (directory, NULL, &error)))
+    {
+      g_warning ("Failed to load compacted segment: %s", error->message);
+      delete_segment_directory (directory);
+      return;
+    }
+
+  stale = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_mutex_lock (&self->mutex);
+
+  for (guint i = 0; i < writer->sources->len; i++)
+    {
+      const CompactSource *source = g_ptr_array_index (writer->sources, i);
+
+      for (guint j = 0; j < source->members->len; j++)
+        {
+          const SegmentMember *snapshot = g_ptr_array_index (source->members, j);
+          SegmentMember *member = g_hash_table_lookup (segment->members, snapshot->path);
+
+          if (member == NULL)
+            continue;
+
+          /* If the shard was re-indexed while we were compacting, it is no
+           * longer served by the source and our copy is out of date.
+           */
+          if (g_hash_table_lookup (self->directories, member->path) != source->index)
+            directory_index_mask_member (segment, member);
+          else
+            g_hash_table_insert (self->directories, g_strdup (member->path), segment);
+        }
+
+      if (source->index->members != NULL)
+        g_ptr_array_add (stale, g_object_ref (source->index->directory));
+
+      g_ptr_array_remove_fast (self->indexes, source->index);
+    }
+
+  g_ptr_array_add (self->indexes, g_steal_pointer (&segment));
+
   g_mutex_unlock (&self->mutex);
 
+  /* Nothing may load these anymore since our segment replaces them. Any
+   * query in flight still holds the mapped contents, which is fine.
+   */
+  for (guint i = 0; i < stale->len; i++)
+    delete_segment_directory (g_ptr_array_index (stale, i));
+}
+
+/**
+ * ide_code_index_index_compact:
+ * @self: a #IdeCodeIndexIndex
+ * @segments_dir: a #GFile of the directory to store segments within
+ * @cancellable: a #GCancellable or %NULL
+ * @error: a #GError or %NULL
+ *
+ * Merges loose directory shards and heavily-masked segments into a few
+ * large segments so that queries only need to visit a handful of indexes.
+ *
+ * This does nothing if there is not enough to compact.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ *
+ * Thread safety: this function performs blocking I/O and should be called
+ *   from a thread so long as the thread has a reference to @self.
+ */
+gboolean
+ide_code_index_index_compact (IdeCodeIndexIndex  *self,
+                              GFile              *segments_dir,
+                              GCancellable       *cancellable,
+                              GError            **error)
+{
+  g_autoptr(GPtrArray) sources = NULL;
+  g_autoptr(GPtrArray) empty = NULL;
+  guint n_shards = 0;
+  guint n_segments = 0;
+  guint pos = 0;
+
+  g_return_val_if_fail (IDE_IS_CODE_INDEX_INDEX (self), FALSE);
+  g_return_val_if_fail (G_IS_FILE (segments_dir), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  sources = g_ptr_array_new_with_free_func ((GDestroyNotify)compact_source_free);
+  empty = g_ptr_array_new_with_free_func ((GDestroyNotify)directory_index_unref);
+
+  g_mutex_lock (&self->mutex);
+
+  for (guint i = 0; i < self->indexes->len; i++)
+    {
+      DirectoryIndex *dir_index = g_ptr_array_index (self->indexes, i);
+      CompactSource *source;
+
+      if (dir_index->members == NULL)
+        {
+          SegmentMember member = {0};
+
+          member.path = g_file_get_path (dir_index->directory);
+          member.mtime = dir_index->mtime;
+          member.first_file_id = 0;
+          member.n_files = dir_index->n_files;
+
+          source = g_slice_new0 (CompactSource);
+          source->index = directory_index_ref (dir_index);
+          source->members = g_ptr_array_new_with_free_func ((GDestroyNotify)segment_member_free);
+          g_ptr_array_add (source->members, segment_member_copy (&member));
+          g_ptr_array_add (sources, source);
+
+          g_free (member.path);
+
+          n_shards++;
+        }
+      else if (dir_index->n_masked_files * COMPACT_MASKED_RATIO >= dir_index->n_files)
+        {
+          GHashTableIter iter;
+          SegmentMember *member;
+
+          source = g_slice_new0 (CompactSource);
+          source->index = directory_index_ref (dir_index);
+          source->members = g_ptr_array_new_with_free_func ((GDestroyNotify)segment_member_free);
+
+          g_hash_table_iter_init (&iter, dir_index->members);
+          while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&member))
+            {
+              if (!member->masked)
+                g_ptr_array_add (source->members, segment_member_copy (member));
+            }
+
+          /* Every shard has been re-indexed, nothing left to serve */
+          if (source->members->len == 0)
+            {
+              g_ptr_array_add (empty, directory_index_ref (dir_index));
+              compact_source_free (source);
+              continue;
+            }
+
+          g_ptr_array_sort (source->members, segment_member_compare);
+          g_ptr_array_add (sources, source);
+
+          n_segments++;
+        }
+    }
+
+  for (guint i = 0; i < empty->len; i++)
+    g_ptr_array_remove_fast (self->indexes, g_ptr_array_index (empty, i));
+
+  g_mutex_unlock (&self->mutex);
+
+  for (guint i = 0; i < empty->len; i++)
+    {
+      const DirectoryIndex *dir_index = g_ptr_array_index (empty, i);
+      delete_segment_directory (dir_index->directory);
+    }
+
+  if (n_segments == 0 && n_shards < COMPACT_MIN_SHARDS)
+    return TRUE;
+
+  g_debug ("Compacting %u shards and %u segments", n_shards, n_segments);
+
+  g_ptr_array_sort (sources, compact_source_compare);
+
+  while (pos < sources->len)
+    {
+      g_autoptr(SegmentWriter) writer = segment_writer_new ();
+      g_autoptr(GFile) directory = NULL;
+      g_autofree char *name = NULL;
+      g_autoptr(GError) local_error = NULL;
+
+      while (pos < sources->len)
+        {
+          CompactSource *source = g_ptr_array_index (sources, pos);
+
+          if (writer->n_files > 0 &&
+              (writer->n_files + source->index->n_files > COMPACT_MAX_SEGMENT_FILES ||
+               writer->n_names + ide_fuzzy_index_get_n_entries (source->index->symbol_names) > COMPACT_MAX_SEGMENT_NAMES))
+            break;
+
+          segment_writer_add (writer, source);
+          pos++;
+        }
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      /* Nothing to write (such as only masked entries), leave as-is */
+      if (writer->n_keys == 0)
+        continue;
+
+      name = g_strdup_printf ("%"G_GINT64_FORMAT"-%u", g_get_real_time (), pos);
+      directory = g_file_get_child (segments_dir, name);
+
+      if (!segment_writer_write (writer, directory, cancellable, &local_error))
+        {
+          delete_segment_directory (directory);
+          g_propagate_error (error, g_steal_pointer (&local_error));
+          return FALSE;
+        }
+
+      ide_code_index_index_install_segment (self, writer, directory);
+    }
+
   return TRUE;
 }
 
@@ -317,7 +1227,7 @@ ide_code_index_index_create_search_result (IdeContext       *context,
 
   g_snprintf (num, sizeof num, "%u", file_id);
 
-  path = ide_fuzzy_index_get_metadata_string (fuzzy_match->index, num);
+  path = ide_fuzzy_index_get_metadata_string (fuzzy_match->index->symbol_names, num);
 
   file = g_file_new_for_path (path);
   location = ide_location_new (file, line - 1, line_offset - 1);
@@ -348,7 +1258,7 @@ ide_code_index_index_query_cb (GObject      *object,
                                GAsyncResult *result,
                                gpointer      user_data)
 {
-  IdeFuzzyIndex *index = (IdeFuzzyIndex *)object;
+  IdeFuzzyIndex *symbol_names = (IdeFuzzyIndex *)object;
   g_autoptr(IdeTask) task = (IdeTask *)user_data;
   g_autoptr(GListModel) list = NULL;
   g_autoptr(GMutexLocker) locker = NULL;
@@ -357,7 +1267,7 @@ ide_code_index_index_query_cb (GObject      *object,
   PopulateTaskData *data;
 
   g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (IDE_IS_FUZZY_INDEX (index));
+  g_assert (IDE_IS_FUZZY_INDEX (symbol_names));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
@@ -369,22 +1279,23 @@ ide_code_index_index_query_cb (GObject      *object,
   data = ide_task_get_task_data (task);
   g_assert (data != NULL);
 
-  list = ide_fuzzy_index_query_finish (index, result, &error);
+  list = ide_fuzzy_index_query_finish (symbol_names, result, &error);
   g_assert (!list || G_IS_LIST_MODEL (list));
 
   if (list != NULL)
     {
-      if (g_list_model_get_n_items (list))
-        {
-          FuzzyMatch fuzzy_match = {0};
+      FuzzyMatch fuzzy_match = {0};
 
-          fuzzy_match.index = index;
-          fuzzy_match.match = g_list_model_get_item (list, 0);
-          fuzzy_match.list = g_steal_pointer (&list);
-          fuzzy_match.match_num = 0;
+      fuzzy_match.index = g_ptr_array_index (data->indexes, data->curr_index);
+      fuzzy_match.list = g_steal_pointer (&list);
+      fuzzy_match.match_num = 0;
 
-          ide_heap_insert_val (data->fuzzy_matches, fuzzy_match);
-        }
+      g_assert (fuzzy_match.index->symbol_names == symbol_names);
+
+      if (fuzzy_match_next (&fuzzy_match))
+        ide_heap_insert_val (data->fuzzy_matches, fuzzy_match);
+      else
+        g_clear_object (&fuzzy_match.list);
     }
   else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
@@ -393,12 +1304,12 @@ ide_code_index_index_query_cb (GObject      *object,
 
   data->curr_index++;
 
-  if (data->curr_index < self->indexes->len)
+  if (data->curr_index < data->indexes->len)
     {
       DirectoryIndex *dir_index;
       GCancellable *cancellable;
 
-      dir_index = g_ptr_array_index (self->indexes, data->curr_index);
+      dir_index = g_ptr_array_index (data->indexes, data->curr_index);
       cancellable = ide_task_get_cancellable (task);
 
       ide_fuzzy_index_query_async (dir_index->symbol_names,
@@ -430,19 +1341,12 @@ ide_code_index_index_query_cb (GObject      *object,
 
           data->max_results--;
 
-          g_clear_object (&fuzzy_match.match);
-
           fuzzy_match.match_num++;
 
-          if (fuzzy_match.match_num < g_list_model_get_n_items (fuzzy_match.list))
-            {
-              fuzzy_match.match = g_list_model_get_item (fuzzy_match.list, fuzzy_match.match_num);
-              ide_heap_insert_val (data->fuzzy_matches, fuzzy_match);
-            }
+          if (fuzzy_match_next (&fuzzy_match))
+            ide_heap_insert_val (data->fuzzy_matches, fuzzy_match);
           else
-            {
-              g_clear_object (&fuzzy_match.list);
-            }
+            g_clear_object (&fuzzy_match.list);
         }
 
       if (data->max_results == 0 && data->fuzzy_matches->len > 0)
@@ -518,9 +1422,16 @@ ide_code_index_index_populate_async (IdeCodeIndexIndex   *self,
 
   locker = g_mutex_locker_new (&self->mutex);
 
-  if (data->curr_index < self->indexes->len)
+  /* Snapshot the indexes so that loading or compaction while we are
+   * querying cannot cause us to skip or revisit an index.
+   */
+  data->indexes = g_ptr_array_new_full (self->indexes->len, (GDestroyNotify)directory_index_unref);
+  for (guint i = 0; i < self->indexes->len; i++)
+    g_ptr_array_add (data->indexes, directory_index_ref (g_ptr_array_index (self->indexes, i)));
+
+  if (data->curr_index < data->indexes->len)
     {
-      DirectoryIndex *dir_index = g_ptr_array_index (self->indexes, data->curr_index);
+      DirectoryIndex *dir_index = g_ptr_array_index (data->indexes, data->curr_index);
 
       ide_fuzzy_index_query_async (dir_index->symbol_names,
                                    data->query,
@@ -582,22 +1493,24 @@ ide_code_index_index_lookup_symbol (IdeCodeIndexIndex *self,
 
   for (guint i = 0; i < self->indexes->len; i++)
     {
-      g_autoptr(GVariant) variant = NULL;
+      KeyEntry entry;
 
       dir_index = g_ptr_array_index (self->indexes, i);
 
-      if (!(variant = ide_persistent_map_lookup_value (dir_index->symbol_keys, key)))
+      if (!directory_index_lookup_key (dir_index, key, &entry))
         continue;
 
       symbol_names = dir_index->symbol_names;
-
-      g_variant_get (variant, "(uuuu)", &file_id, &line, &line_offset, &flags);
+      file_id = entry.file_id;
+      line = entry.line;
+      line_offset = entry.line_offset;
+      flags = entry.flags;
 
       if (flags & IDE_SYMBOL_FLAGS_IS_DEFINITION)
         break;
     }
 
-  if (file_id == 0)
+  if (symbol_names == NULL)
     {
       g_debug ("symbol location not found");
       return NULL;
@@ -633,7 +1546,7 @@ static void
 ide_code_index_index_init (IdeCodeIndexIndex *self)
 {
   self->directories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  self->indexes = g_ptr_array_new_with_free_func ((GDestroyNotify)directory_index_free);
+  self->indexes = g_ptr_array_new_with_free_func ((GDestroyNotify)directory_index_unref);
 
   g_mutex_init (&self->mutex);
 }
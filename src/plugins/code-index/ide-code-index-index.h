@@ -34,6 +34,14 @@ gboolean           ide_code_index_index_load            (IdeCodeIndexIndex    *s
                                                          GFile                *source_directory,
                                                          GCancellable         *cancellable,
                                                          GError              **error);
+gboolean           ide_code_index_index_load_segment    (IdeCodeIndexIndex    *self,
+                                                         GFile                *directory,
+                                                         GCancellable         *cancellable,
+                                                         GError              **error);
+gboolean           ide_code_index_index_compact         (IdeCodeIndexIndex    *self,
+                                                         GFile                *segments_dir,
+                                                         GCancellable         *cancellable,
+                                                         GError              **error);
 IdeSymbol         *ide_code_index_index_lookup_symbol   (IdeCodeIndexIndex    *self,
                                                          const gchar          *key);
 void               ide_code_index_index_populate_async  (IdeCodeIndexIndex    *self,
@@ -0,0 +1,203 @@
+/* test-code-index-index.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include <libide-search.h>
+
+#include "ide-code-index-index.h"
+
+/* Must be at least COMPACT_MIN_SHARDS for compaction to happen */
+#define N_SHARDS   32
+#define SHARED_KEY "c:@F@shared"
+
+static void
+remove_tree (const char *path)
+{
+  g_autoptr(GDir) dir = NULL;
+  const char *name;
+
+  if ((dir = g_dir_open (path, 0, NULL)))
+    {
+      while ((name = g_dir_read_name (dir)))
+        {
+          g_autofree char *child = g_build_filename (path, name, NULL);
+          remove_tree (child);
+        }
+    }
+
+  g_remove (path);
+}
+
+/*
+ * Writes a shard the same way GbpCodeIndexBuilder does, containing a single
+ * file which declares @key at @line.
+ */
+static GFile *
+write_shard (const char *tmpdir,
+             guint       n,
+             const char *source,
+             const char *key,
+             guint       line)
+{
+  g_autoptr(IdePersistentMapBuilder) map = ide_persistent_map_builder_new ();
+  g_autoptr(IdeFuzzyIndexBuilder) fuzzy = ide_fuzzy_index_builder_new ();
+  g_autoptr(GFile) keys_file = NULL;
+  g_autoptr(GFile) names_file = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *name = g_strdup_printf ("shard-%02u", n);
+  g_autofree char *path = g_build_filename (tmpdir, "shards", name, NULL);
+  g_autofree char *filename = g_build_filename (tmpdir, "src", source, NULL);
+  GFile *directory = g_file_new_for_path (path);
+
+  g_assert_cmpint (g_mkdir_with_parents (path, 0750), ==, 0);
+
+  ide_fuzzy_index_builder_set_metadata_uint32 (fuzzy, filename, 0);
+  ide_fuzzy_index_builder_set_metadata_string (fuzzy, "0", filename);
+  ide_fuzzy_index_builder_set_metadata_uint32 (fuzzy, "n_files", 1);
+  ide_fuzzy_index_builder_insert (fuzzy,
+                                  key,
+                                  g_variant_new ("(uuuuu)", 0, line, 1, 0, IDE_SYMBOL_KIND_FUNCTION),
+                                  0);
+  ide_persistent_map_builder_insert (map,
+                                     key,
+                                     g_variant_new ("(uuuu)", 0, line, 1, 0),
+                                     FALSE);
+
+  keys_file = g_file_get_child (directory, "SymbolKeys");
+  names_file = g_file_get_child (directory, "SymbolNames");
+
+  ide_persistent_map_builder_write (map, keys_file, G_PRIORITY_DEFAULT, NULL, &error);
+  g_assert_no_error (error);
+
+  ide_fuzzy_index_builder_write (fuzzy, names_file, G_PRIORITY_DEFAULT, NULL, &error);
+  g_assert_no_error (error);
+
+  return directory;
+}
+
+static void
+touch_later (GFile *directory)
+{
+  g_autoptr(GFile) keys_file = g_file_get_child (directory, "SymbolKeys");
+  g_autoptr(GFileInfo) info = NULL;
+  g_autoptr(GError) error = NULL;
+  guint64 mtime;
+
+  info = g_file_query_info (keys_file, G_FILE_ATTRIBUTE_TIME_MODIFIED, 0, NULL, &error);
+  g_assert_no_error (error);
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  g_file_set_attribute_uint64 (keys_file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime + 10, 0, NULL, &error);
+  g_assert_no_error (error);
+}
+
+static guint
+count_children (const char *path)
+{
+  g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+  guint count = 0;
+
+  g_assert_nonnull (dir);
+
+  while (g_dir_read_name (dir))
+    count++;
+
+  return count;
+}
+
+static void
+test_compact_shared_key (void)
+{
+  g_autoptr(IdeCodeIndexIndex) index = ide_code_index_index_new (NULL);
+  g_autoptr(GPtrArray) shards = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr(IdeSymbol) symbol = NULL;
+  g_autoptr(GFile) segments_dir = NULL;
+  g_autoptr(GFile) reindexed = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *segments = NULL;
+  g_autofree char *basename = NULL;
+  IdeLocation *declaration;
+
+  tmpdir = g_dir_make_tmp ("test-code-index-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  /* Two shards declare the same key, such as a header used by both */
+  g_ptr_array_add (shards, write_shard (tmpdir, 0, "a.h", SHARED_KEY, 10));
+  g_ptr_array_add (shards, write_shard (tmpdir, 1, "b.h", SHARED_KEY, 20));
+
+  for (guint i = 2; i < N_SHARDS; i++)
+    {
+      g_autofree char *source = g_strdup_printf ("file%u.c", i);
+      g_autofree char *key = g_strdup_printf ("c:@F@other%u", i);
+
+      g_ptr_array_add (shards, write_shard (tmpdir, i, source, key, i));
+    }
+
+  for (guint i = 0; i < shards->len; i++)
+    {
+      ide_code_index_index_load (index, g_ptr_array_index (shards, i), NULL, NULL, &error);
+      g_assert_no_error (error);
+    }
+
+  segments = g_build_filename (tmpdir, "segments", NULL);
+  segments_dir = g_file_new_for_path (segments);
+
+  ide_code_index_index_compact (index, segments_dir, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (count_children (segments), ==, 1);
+
+  symbol = ide_code_index_index_lookup_symbol (index, SHARED_KEY);
+  g_assert_nonnull (symbol);
+  g_assert_nonnull (ide_symbol_get_declaration (symbol));
+  g_clear_object (&symbol);
+
+  /* Re-index the first shard without the key. The segment must still
+   * know about the declaration which came from the second shard.
+   */
+  reindexed = write_shard (tmpdir, 0, "a.h", "c:@F@replaced", 10);
+  touch_later (reindexed);
+  ide_code_index_index_load (index, reindexed, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  symbol = ide_code_index_index_lookup_symbol (index, SHARED_KEY);
+  g_assert_nonnull (symbol);
+
+  declaration = ide_symbol_get_declaration (symbol);
+  g_assert_nonnull (declaration);
+  g_assert_cmpint (ide_location_get_line (declaration), ==, 19);
+
+  basename = g_file_get_basename (ide_location_get_file (declaration));
+  g_assert_cmpstr (basename, ==, "b.h");
+
+  remove_tree (tmpdir);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Plugins/CodeIndex/Index/compact_shared_key", test_compact_shared_key);
+  return g_test_run ();
+}
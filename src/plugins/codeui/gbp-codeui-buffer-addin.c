@@ -40,13 +40,14 @@ struct _GbpCodeuiBufferAddin
   IdeDiagnosticsManager *diagnostics_manager;
   IdeBuffer             *buffer;
   GFile                 *file;
+  guint                  sequence;
 };
 
 static void
 gbp_codeui_buffer_addin_queue_diagnose (GbpCodeuiBufferAddin *self,
                                         IdeBuffer            *buffer)
 {
-  g_autoptr(GBytes) contents = NULL;
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
   const gchar *lang_id;
   GFile *file;
 
@@ -57,9 +58,9 @@ gbp_codeui_buffer_addin_queue_diagnose (GbpCodeuiBufferAddin *self,
 
   file = ide_buffer_get_file (buffer);
   lang_id = ide_buffer_get_language_id (buffer);
-  contents = ide_buffer_dup_content (buffer);
+  snapshot = ide_buffer_ref_snapshot (buffer);
 
-  _ide_diagnostics_manager_file_changed (self->diagnostics_manager, file, contents, lang_id);
+  _ide_diagnostics_manager_file_changed (self->diagnostics_manager, file, snapshot, lang_id);
 }
 
 static void
@@ -88,7 +89,8 @@ gbp_codeui_buffer_addin_file_loaded (IdeBufferAddin *addin,
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (G_IS_FILE (file));
 
-  g_set_object (&self->file, file);
+  if (g_set_object (&self->file, file))
+    self->sequence = 0;
 
   lang_id = ide_buffer_get_language_id (buffer);
 
@@ -107,7 +109,8 @@ gbp_codeui_buffer_addin_file_saved (IdeBufferAddin *addin,
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (G_IS_FILE (file));
 
-  g_set_object (&self->file, file);
+  if (g_set_object (&self->file, file))
+    self->sequence = 0;
 
   gbp_codeui_buffer_addin_queue_diagnose (self, buffer);
 }
@@ -123,6 +126,16 @@ gbp_codeui_buffer_addin_changed_cb (GbpCodeuiBufferAddin  *self,
   if (self->file != NULL)
     {
       g_autoptr(IdeDiagnostics) diagnostics = NULL;
+      guint sequence;
+
+      /* The manager emits ::changed for every file, skip it unless
+       * the diagnostics for our file have actually changed.
+       */
+      sequence = ide_diagnostics_manager_get_sequence_for_file (manager, self->file);
+      if (sequence != 0 && sequence == self->sequence)
+        return;
+
+      self->sequence = sequence;
 
       diagnostics = ide_diagnostics_manager_get_diagnostics_for_file (manager, self->file);
       ide_buffer_set_diagnostics (self->buffer, diagnostics);
@@ -149,6 +162,19 @@ gbp_codeui_buffer_addin_language_set (IdeBufferAddin *addin,
   _ide_diagnostics_manager_language_changed (self->diagnostics_manager, file, language_id);
 }
 
+static void
+gbp_codeui_buffer_addin_visible_range_changed_cb (GbpCodeuiBufferAddin *self,
+                                                  IdeBuffer            *buffer)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_CODEUI_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (self->diagnostics_manager != NULL)
+    _ide_diagnostics_manager_file_visible (self->diagnostics_manager,
+                                           ide_buffer_get_file (buffer));
+}
+
 static void
 gbp_codeui_buffer_addin_load (IdeBufferAddin *addin,
                               IdeBuffer      *buffer)
@@ -172,6 +198,12 @@ gbp_codeui_buffer_addin_load (IdeBufferAddin *addin,
                            G_CALLBACK (gbp_codeui_buffer_addin_changed_cb),
                            self,
                            G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (buffer,
+                           "visible-range-changed",
+                           G_CALLBACK (gbp_codeui_buffer_addin_visible_range_changed_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
 }
 
 static void
@@ -190,6 +222,9 @@ gbp_codeui_buffer_addin_unload (IdeBufferAddin *addin,
   g_signal_handlers_disconnect_by_func (self->diagnostics_manager,
                                         G_CALLBACK (gbp_codeui_buffer_addin_changed_cb),
                                         self);
+  g_signal_handlers_disconnect_by_func (buffer,
+                                        G_CALLBACK (gbp_codeui_buffer_addin_visible_range_changed_cb),
+                                        self);
 
   _ide_diagnostics_manager_file_closed (self->diagnostics_manager, file);
 
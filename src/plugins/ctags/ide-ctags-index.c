@@ -28,22 +28,71 @@
 
 /* This object is meant to be immutable after loading so that
  * it can be used from threads safely.
+ *
+ * Parsing large tags files is expensive, so after the first parse we write
+ * a compiled version next to our other caches. The compiled index is a
+ * GVariant (like IdePersistentMap) containing:
+ *
+ *  - "strings": a pool of interned, \0-terminated strings
+ *  - "entries": entries sorted by name, referencing the string pool
+ *  - "buckets": the first entry for every leading byte of a name, so that
+ *               prefix lookups only need to bsearch() a small block
+ *  - "paths":   sorted paths with a range into "postings"
+ *  - "postings": entry indexes grouped by path
+ *
+ * Loading it only requires mmap() and fixing up string pointers, and the
+ * strings themselves live in the page cache rather than our heap.
  */
 
+#define COMPILED_VERSION 1
+#define N_BUCKETS        257
+#define NO_STRING        G_MAXUINT32
+
+typedef struct
+{
+  guint32 name;
+  guint32 path;
+  guint32 pattern;
+  guint32 keyval;
+  guint32 kind;
+} CompiledEntry;
+
+typedef struct
+{
+  guint32 path;
+  guint32 first_posting;
+  guint32 n_postings;
+} CompiledPath;
+
+G_STATIC_ASSERT (sizeof (CompiledEntry) == 20);
+G_STATIC_ASSERT (sizeof (CompiledPath) == 12);
+
 struct _IdeCtagsIndex
 {
-  IdeObject  parent_instance;
+  IdeObject           parent_instance;
+
+  GArray             *index;
+  GBytes             *buffer;
+  GFile              *file;
+  GFile              *compiled_file;
+  gchar              *path_root;
+
+  /* Only available when loaded from the compiled index */
+  GMappedFile        *mapped_file;
+  GVariant           *compiled;
+  const CompiledPath *paths;
+  gsize               n_paths;
+  const guint32      *postings;
+  gsize               n_postings;
 
-  GArray    *index;
-  GBytes    *buffer;
-  GFile     *file;
-  gchar     *path_root;
+  guint32             buckets[N_BUCKETS];
 
-  guint64    mtime;
+  guint64             mtime;
 };
 
 enum {
   PROP_0,
+  PROP_COMPILED_FILE,
   PROP_FILE,
   PROP_MTIME,
   PROP_PATH_ROOT,
@@ -183,6 +232,321 @@ ide_ctags_index_parse_line (gchar              *line,
   return TRUE;
 }
 
+static void
+ide_ctags_index_build_buckets (IdeCtagsIndex *self)
+{
+  guint pos = 0;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (self->index != NULL);
+
+  /* buckets[b] is the first entry with a name starting at or after byte b
+   * so that [buckets[b], buckets[b+1]) contains all names starting with b.
+   */
+  for (guint b = 0; b < N_BUCKETS - 1; b++)
+    {
+      while (pos < self->index->len &&
+             (guint8)g_array_index (self->index, IdeCtagsIndexEntry, pos).name[0] < b)
+        pos++;
+      self->buckets[b] = pos;
+    }
+
+  self->buckets[N_BUCKETS - 1] = self->index->len;
+}
+
+static guint32
+intern_string (GHashTable  *interned,
+               GByteArray  *pool,
+               const gchar *str)
+{
+  gpointer offset;
+
+  if (str == NULL)
+    return NO_STRING;
+
+  if (!g_hash_table_lookup_extended (interned, str, NULL, &offset))
+    {
+      offset = GUINT_TO_POINTER (pool->len);
+      g_byte_array_append (pool, (const guint8 *)str, strlen (str) + 1);
+      g_hash_table_insert (interned, (gpointer)str, offset);
+    }
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static gint
+compare_path_postings (gconstpointer a,
+                       gconstpointer b,
+                       gpointer      user_data)
+{
+  const GArray *index = user_data;
+  guint32 ia = *(const guint32 *)a;
+  guint32 ib = *(const guint32 *)b;
+  gint ret;
+
+  if (!(ret = g_strcmp0 (g_array_index (index, IdeCtagsIndexEntry, ia).path,
+                         g_array_index (index, IdeCtagsIndexEntry, ib).path)))
+    ret = ia < ib ? -1 : ia > ib;
+
+  return ret;
+}
+
+static gboolean
+ide_ctags_index_write_compiled (IdeCtagsIndex  *self,
+                                guint64         source_size,
+                                guint64         source_mtime,
+                                GCancellable   *cancellable,
+                                GError        **error)
+{
+  g_autoptr(GHashTable) interned = NULL;
+  g_autoptr(GByteArray) pool = NULL;
+  g_autoptr(GArray) entries = NULL;
+  g_autoptr(GArray) paths = NULL;
+  g_autoptr(GArray) postings = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GFile) parent = NULL;
+  GVariantDict dict;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (G_IS_FILE (self->compiled_file));
+  g_assert (self->index != NULL);
+
+  if (self->index->len >= NO_STRING)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "Too many entries to compile tags index");
+      return FALSE;
+    }
+
+  interned = g_hash_table_new (g_str_hash, g_str_equal);
+  pool = g_byte_array_new ();
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (CompiledEntry), self->index->len);
+  paths = g_array_new (FALSE, FALSE, sizeof (CompiledPath));
+  postings = g_array_sized_new (FALSE, FALSE, sizeof (guint32), self->index->len);
+
+  for (guint i = 0; i < self->index->len; i++)
+    {
+      const IdeCtagsIndexEntry *entry = &g_array_index (self->index, IdeCtagsIndexEntry, i);
+      CompiledEntry compiled;
+
+      compiled.name = intern_string (interned, pool, entry->name);
+      compiled.path = intern_string (interned, pool, entry->path);
+      compiled.pattern = intern_string (interned, pool, entry->pattern);
+      compiled.keyval = intern_string (interned, pool, entry->keyval);
+      compiled.kind = entry->kind;
+
+      g_array_append_val (entries, compiled);
+      g_array_append_val (postings, i);
+    }
+
+  if (pool->len >= NO_STRING)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "String pool too large to compile tags index");
+      return FALSE;
+    }
+
+  /* Group entry indexes by path and record the range for each path */
+  g_array_sort_with_data (postings, compare_path_postings, self->index);
+
+  for (guint i = 0; i < postings->len; i++)
+    {
+      guint32 entry_id = g_array_index (postings, guint32, i);
+      const CompiledEntry *compiled = &g_array_index (entries, CompiledEntry, entry_id);
+
+      if (paths->len == 0 ||
+          g_array_index (paths, CompiledPath, paths->len - 1).path != compiled->path)
+        {
+          CompiledPath path = { compiled->path, i, 0 };
+          g_array_append_val (paths, path);
+        }
+
+      g_array_index (paths, CompiledPath, paths->len - 1).n_postings++;
+    }
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, "version", "i", COMPILED_VERSION);
+  g_variant_dict_insert (&dict, "byte-order", "i", G_BYTE_ORDER);
+  g_variant_dict_insert (&dict, "source-size", "t", source_size);
+  g_variant_dict_insert (&dict, "source-mtime", "t", source_mtime);
+  g_variant_dict_insert_value (&dict, "strings",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                          pool->data, pool->len,
+                                                          sizeof (guint8)));
+  g_variant_dict_insert_value (&dict, "entries",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE ("(uuuuu)"),
+                                                          entries->data, entries->len,
+                                                          sizeof (CompiledEntry)));
+  g_variant_dict_insert_value (&dict, "buckets",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                          self->buckets, N_BUCKETS,
+                                                          sizeof (guint32)));
+  g_variant_dict_insert_value (&dict, "paths",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE ("(uuu)"),
+                                                          paths->data, paths->len,
+                                                          sizeof (CompiledPath)));
+  g_variant_dict_insert_value (&dict, "postings",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                                          postings->data, postings->len,
+                                                          sizeof (guint32)));
+  variant = g_variant_take_ref (g_variant_dict_end (&dict));
+
+  if ((parent = g_file_get_parent (self->compiled_file)))
+    g_file_make_directory_with_parents (parent, cancellable, NULL);
+
+  return g_file_replace_contents (self->compiled_file,
+                                  g_variant_get_data (variant),
+                                  g_variant_get_size (variant),
+                                  NULL,
+                                  FALSE,
+                                  G_FILE_CREATE_REPLACE_DESTINATION,
+                                  NULL,
+                                  cancellable,
+                                  error);
+}
+
+static gboolean
+ide_ctags_index_load_compiled (IdeCtagsIndex  *self,
+                               guint64         source_size,
+                               guint64         source_mtime,
+                               GError        **error)
+{
+  g_autoptr(GMappedFile) mapped_file = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) strings_v = NULL;
+  g_autoptr(GVariant) entries_v = NULL;
+  g_autoptr(GVariant) buckets_v = NULL;
+  g_autoptr(GVariant) paths_v = NULL;
+  g_autoptr(GVariant) postings_v = NULL;
+  g_autoptr(GArray) index = NULL;
+  g_autofree gchar *path = NULL;
+  const CompiledEntry *entries;
+  const CompiledPath *paths;
+  const guint32 *postings;
+  const guint32 *buckets;
+  const gchar *strings;
+  gsize n_strings;
+  gsize n_entries;
+  gsize n_buckets;
+  gsize n_paths;
+  gsize n_postings;
+  GVariantDict dict;
+  guint64 size = 0;
+  guint64 mtime = 0;
+  gint32 byte_order = 0;
+  gint32 version = 0;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (G_IS_FILE (self->compiled_file));
+
+  if (!(path = g_file_get_path (self->compiled_file)) ||
+      !(mapped_file = g_mapped_file_new (path, FALSE, error)))
+    return FALSE;
+
+  variant = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                                     g_mapped_file_get_contents (mapped_file),
+                                     g_mapped_file_get_length (mapped_file),
+                                     FALSE, NULL, NULL);
+  g_variant_take_ref (variant);
+
+  g_variant_dict_init (&dict, variant);
+  g_variant_dict_lookup (&dict, "version", "i", &version);
+  g_variant_dict_lookup (&dict, "byte-order", "i", &byte_order);
+  g_variant_dict_lookup (&dict, "source-size", "t", &size);
+  g_variant_dict_lookup (&dict, "source-mtime", "t", &mtime);
+  strings_v = g_variant_dict_lookup_value (&dict, "strings", G_VARIANT_TYPE_BYTESTRING);
+  entries_v = g_variant_dict_lookup_value (&dict, "entries", G_VARIANT_TYPE ("a(uuuuu)"));
+  buckets_v = g_variant_dict_lookup_value (&dict, "buckets", G_VARIANT_TYPE ("au"));
+  paths_v = g_variant_dict_lookup_value (&dict, "paths", G_VARIANT_TYPE ("a(uuu)"));
+  postings_v = g_variant_dict_lookup_value (&dict, "postings", G_VARIANT_TYPE ("au"));
+  g_variant_dict_clear (&dict);
+
+  if (version != COMPILED_VERSION || byte_order != G_BYTE_ORDER)
+    goto invalid;
+
+  if (size != source_size || mtime != source_mtime)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Compiled tags index is out of date");
+      return FALSE;
+    }
+
+  if (!strings_v || !entries_v || !buckets_v || !paths_v || !postings_v)
+    goto invalid;
+
+  strings = g_variant_get_fixed_array (strings_v, &n_strings, sizeof (guint8));
+  entries = g_variant_get_fixed_array (entries_v, &n_entries, sizeof (CompiledEntry));
+  buckets = g_variant_get_fixed_array (buckets_v, &n_buckets, sizeof (guint32));
+  paths = g_variant_get_fixed_array (paths_v, &n_paths, sizeof (CompiledPath));
+  postings = g_variant_get_fixed_array (postings_v, &n_postings, sizeof (guint32));
+
+  if (n_buckets != N_BUCKETS || n_postings != n_entries ||
+      (n_strings > 0 && strings[n_strings - 1] != 0))
+    goto invalid;
+
+#define CHECK_STRING(off) ((off) == NO_STRING || (off) < n_strings)
+  index = g_array_sized_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry), n_entries);
+
+  for (gsize i = 0; i < n_entries; i++)
+    {
+      const CompiledEntry *compiled = &entries[i];
+      IdeCtagsIndexEntry entry = {0};
+
+      if (compiled->name >= n_strings || compiled->path >= n_strings ||
+          compiled->pattern >= n_strings || !CHECK_STRING (compiled->keyval))
+        goto invalid;
+
+      entry.name = &strings[compiled->name];
+      entry.path = &strings[compiled->path];
+      entry.pattern = &strings[compiled->pattern];
+      entry.keyval = compiled->keyval == NO_STRING ? NULL : &strings[compiled->keyval];
+      entry.kind = compiled->kind;
+
+      g_array_append_val (index, entry);
+    }
+
+  for (gsize i = 0; i < n_paths; i++)
+    {
+      if (paths[i].path >= n_strings || paths[i].n_postings == 0 ||
+          paths[i].first_posting > n_postings ||
+          paths[i].n_postings > n_postings - paths[i].first_posting)
+        goto invalid;
+    }
+
+  for (gsize i = 0; i < n_postings; i++)
+    {
+      if (postings[i] >= n_entries)
+        goto invalid;
+    }
+#undef CHECK_STRING
+
+  for (guint i = 0; i < N_BUCKETS; i++)
+    self->buckets[i] = MIN (buckets[i], n_entries);
+
+  self->index = g_steal_pointer (&index);
+  self->paths = paths;
+  self->n_paths = n_paths;
+  self->postings = postings;
+  self->n_postings = n_postings;
+  self->compiled = g_steal_pointer (&variant);
+  self->mapped_file = g_steal_pointer (&mapped_file);
+
+  return TRUE;
+
+invalid:
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "Invalid compiled tags index");
+  return FALSE;
+}
+
 static void
 ide_ctags_index_build_index (IdeTask      *task,
                              gpointer      source_object,
@@ -190,6 +554,7 @@ ide_ctags_index_build_index (IdeTask      *task,
                              GCancellable *cancellable)
 {
   IdeCtagsIndex *self = source_object;
+  g_autoptr(GFileInfo) info = NULL;
   g_autoptr(GError) error = NULL;
   IdeLineReader reader;
   GArray *index = NULL;
@@ -197,6 +562,8 @@ ide_ctags_index_build_index (IdeTask      *task,
   gchar *line;
   gsize length = 0;
   gsize line_length;
+  guint64 source_size = 0;
+  guint64 source_mtime = 0;
 
   IDE_ENTRY;
 
@@ -204,6 +571,32 @@ ide_ctags_index_build_index (IdeTask      *task,
   g_assert (IDE_IS_CTAGS_INDEX (self));
   g_assert (G_IS_FILE (self->file));
 
+  if ((info = g_file_query_info (self->file,
+                                 G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                 G_FILE_QUERY_INFO_NONE,
+                                 cancellable,
+                                 NULL)))
+    {
+      source_size = g_file_info_get_size (info);
+      source_mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+                   + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    }
+
+  if (info != NULL && self->compiled_file != NULL)
+    {
+      g_autoptr(GError) compiled_error = NULL;
+
+      if (ide_ctags_index_load_compiled (self, source_size, source_mtime, &compiled_error))
+        {
+          ide_task_return_boolean (task, TRUE);
+          IDE_EXIT;
+        }
+
+      g_debug ("Parsing tags file: %s", compiled_error->message);
+    }
+
   if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
     IDE_GOTO (failure);
 
@@ -242,6 +635,29 @@ ide_ctags_index_build_index (IdeTask      *task,
   self->index = index;
   self->buffer = g_bytes_new_take (contents, length);
 
+  ide_ctags_index_build_buckets (self);
+
+  /* Compile the index so that next time we can just mmap() it. If that
+   * succeeds, swap to the compiled index to release the parsed buffer.
+   */
+  if (info != NULL && self->compiled_file != NULL)
+    {
+      g_autoptr(GError) compiled_error = NULL;
+
+      if (ide_ctags_index_write_compiled (self, source_size, source_mtime, cancellable, &compiled_error))
+        {
+          g_autoptr(GArray) parsed = g_steal_pointer (&self->index);
+
+          if (ide_ctags_index_load_compiled (self, source_size, source_mtime, &compiled_error))
+            g_clear_pointer (&self->buffer, g_bytes_unref);
+          else
+            self->index = g_steal_pointer (&parsed);
+        }
+
+      if (compiled_error != NULL)
+        g_debug ("Failed to compile tags index: %s", compiled_error->message);
+    }
+
   ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
@@ -302,6 +718,10 @@ ide_ctags_index_get_property (GObject    *object,
 
   switch (prop_id)
     {
+    case PROP_COMPILED_FILE:
+      g_value_set_object (value, self->compiled_file);
+      break;
+
     case PROP_FILE:
       g_value_set_object (value, ide_ctags_index_get_file (self));
       break;
@@ -329,6 +749,10 @@ ide_ctags_index_set_property (GObject      *object,
 
   switch (prop_id)
     {
+    case PROP_COMPILED_FILE:
+      g_set_object (&self->compiled_file, g_value_get_object (value));
+      break;
+
     case PROP_FILE:
       ide_ctags_index_set_file (self, g_value_get_object (value));
       break;
@@ -351,9 +775,15 @@ ide_ctags_index_finalize (GObject *object)
 {
   IdeCtagsIndex *self = (IdeCtagsIndex *)object;
 
+  self->paths = NULL;
+  self->postings = NULL;
+
   g_clear_object (&self->file);
+  g_clear_object (&self->compiled_file);
   g_clear_pointer (&self->index, g_array_unref);
   g_clear_pointer (&self->buffer, g_bytes_unref);
+  g_clear_pointer (&self->compiled, g_variant_unref);
+  g_clear_pointer (&self->mapped_file, g_mapped_file_unref);
   g_clear_pointer (&self->path_root, g_free);
 
   G_OBJECT_CLASS (ide_ctags_index_parent_class)->finalize (object);
@@ -368,6 +798,13 @@ ide_ctags_index_class_init (IdeCtagsIndexClass *klass)
   object_class->get_property = ide_ctags_index_get_property;
   object_class->set_property = ide_ctags_index_set_property;
 
+  properties [PROP_COMPILED_FILE] =
+    g_param_spec_object ("compiled-file",
+                         "Compiled File",
+                         "Where to store the compiled version of the ctags data.",
+                         G_TYPE_FILE,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
   properties [PROP_FILE] =
     g_param_spec_object ("file",
                          "File",
@@ -450,7 +887,11 @@ ide_ctags_index_new (GFile       *file,
                      guint64      mtime)
 {
   g_autoptr(GFile) parent = NULL;
+  g_autoptr(GFile) compiled_file = NULL;
   g_autofree gchar *real_path_root = NULL;
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *uri = NULL;
+  g_autofree gchar *name = NULL;
 
   g_return_val_if_fail (G_IS_FILE (file), NULL);
 
@@ -460,7 +901,20 @@ ide_ctags_index_new (GFile       *file,
         path_root = real_path_root = g_file_get_path (parent);
     }
 
+  /* Tags files may live in read-only locations, so keep compiled indexes
+   * in the user cache keyed by the location of the tags file.
+   */
+  uri = g_file_get_uri (file);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
+  name = g_strdup_printf ("%s.tagsidx", checksum);
+  compiled_file = g_file_new_build_filename (g_get_user_cache_dir (),
+                                             ide_get_program_name (),
+                                             "ctags",
+                                             name,
+                                             NULL);
+
   return g_object_new (IDE_TYPE_CTAGS_INDEX,
+                       "compiled-file", compiled_file,
                        "file", file,
                        "path-root", path_root,
                        "mtime", mtime,
@@ -494,6 +948,9 @@ ide_ctags_index_lookup_full (IdeCtagsIndex *self,
 {
   IdeCtagsIndexEntry key = { 0 };
   IdeCtagsIndexEntry *ret;
+  guint8 first;
+  guint begin;
+  guint end;
 
   g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
   g_return_val_if_fail (keyword != NULL, NULL);
@@ -506,9 +963,26 @@ ide_ctags_index_lookup_full (IdeCtagsIndex *self,
 
   key.name = keyword;
 
+  /* Narrow the search to the block of names sharing our first byte. An
+   * empty prefix matches everything so search the whole index.
+   */
+  if ((first = (guint8)keyword[0]))
+    {
+      begin = self->buckets[first];
+      end = self->buckets[first + 1];
+    }
+  else
+    {
+      begin = 0;
+      end = self->index->len;
+    }
+
+  if (begin >= end)
+    return NULL;
+
   ret = bsearch (&key,
-                 self->index->data,
-                 self->index->len,
+                 &g_array_index (self->index, IdeCtagsIndexEntry, begin),
+                 end - begin,
                  sizeof (IdeCtagsIndexEntry),
                  compare_func);
 
@@ -618,8 +1092,9 @@ ide_ctags_index_get_mtime (IdeCtagsIndex *self)
  * The container is owned by the caller and should be freed by the
  * caller with g_ptr_array_unref().
  *
- * Note that this function is not indexed, and therefore is O(n)
- * running time with `n` is the number of items in the index.
+ * When the index was loaded from its compiled form, this uses the
+ * per-path posting list. Otherwise it is O(n) running time where `n` is
+ * the number of items in the index.
  *
  * Returns: (transfer container) (element-type Ide.CtagsIndexEntry): An array
  *   of items matching the relative path.
@@ -635,6 +1110,41 @@ ide_ctags_index_find_with_path (IdeCtagsIndex *self,
 
   ar = g_ptr_array_new ();
 
+  if (self->index == NULL)
+    return ar;
+
+  if (self->paths != NULL)
+    {
+      gssize l = 0;
+      gssize r = (gssize)self->n_paths - 1;
+
+      while (l <= r)
+        {
+          gssize m = (l + r) / 2;
+          const CompiledPath *path = &self->paths[m];
+          const IdeCtagsIndexEntry *first;
+          gint cmp;
+
+          first = &g_array_index (self->index, IdeCtagsIndexEntry, self->postings[path->first_posting]);
+          cmp = g_strcmp0 (relative_path, first->path);
+
+          if (cmp < 0)
+            r = m - 1;
+          else if (cmp > 0)
+            l = m + 1;
+          else
+            {
+              for (guint i = 0; i < path->n_postings; i++)
+                g_ptr_array_add (ar, &g_array_index (self->index,
+                                                     IdeCtagsIndexEntry,
+                                                     self->postings[path->first_posting + i]));
+              break;
+            }
+        }
+
+      return ar;
+    }
+
   for (guint i = 0; i < self->index->len; i++)
     {
       IdeCtagsIndexEntry *entry = &g_array_index (self->index, IdeCtagsIndexEntry, i);
@@ -33,6 +33,7 @@ init_cb (GObject      *object,
   IdeCtagsIndex *index = (IdeCtagsIndex *)object;
   const IdeCtagsIndexEntry *entries;
   gsize n_entries = 0xFFFFFFFF;
+  GPtrArray *by_path;
   GError *error = NULL;
   gboolean ret;
   gsize i;
@@ -73,6 +74,19 @@ init_cb (GObject      *object,
       g_assert_true (r);
     }
 
+  by_path = ide_ctags_index_find_with_path (index, "bug-buddy.c");
+  g_assert_cmpint (by_path->len, ==, 3);
+  for (i = 0; i < by_path->len; i++)
+    {
+      const IdeCtagsIndexEntry *entry = g_ptr_array_index (by_path, i);
+      g_assert_cmpstr (entry->path, ==, "bug-buddy.c");
+    }
+  g_ptr_array_unref (by_path);
+
+  by_path = ide_ctags_index_find_with_path (index, "__NOTHING_SHOULD_MATCH_THIS__");
+  g_assert_cmpint (by_path->len, ==, 0);
+  g_ptr_array_unref (by_path);
+
   g_main_loop_quit (main_loop);
 }
 
@@ -88,17 +102,22 @@ test_ctags_basic (void)
   path = g_build_filename (TEST_DATA_DIR, "../../plugins/ctags", "test-tags", NULL);
   test_file = g_file_new_for_path (path);
 
-  index = ide_ctags_index_new (test_file, NULL, 0);
+  /* Run twice, first parsing the tags file and then from the compiled index */
+  for (guint run = 0; run < 2; run++)
+    {
+      index = ide_ctags_index_new (test_file, NULL, 0);
+
+      g_async_initable_init_async (G_ASYNC_INITABLE (index),
+                                   G_PRIORITY_DEFAULT,
+                                   NULL,
+                                   init_cb,
+                                   NULL);
 
-  g_async_initable_init_async (G_ASYNC_INITABLE (index),
-                               G_PRIORITY_DEFAULT,
-                               NULL,
-                               init_cb,
-                               NULL);
+      g_main_loop_run (main_loop);
 
-  g_main_loop_run (main_loop);
+      g_object_unref (index);
+    }
 
-  g_object_unref (index);
   g_free (path);
   g_object_unref (test_file);
 }
@@ -107,7 +126,7 @@ gint
 main (gint   argc,
       gchar *argv[])
 {
-  g_test_init (&argc, &argv, NULL);
+  g_test_init (&argc, &argv, G_TEST_OPTION_ISOLATE_DIRS, NULL);
   g_test_add_func ("/Ide/CTags/basic", test_ctags_basic);
   return g_test_run ();
 }
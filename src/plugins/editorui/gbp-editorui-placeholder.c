@@ -0,0 +1,301 @@
+/* gbp-editorui-placeholder.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-editorui-placeholder"
+
+#include "config.h"
+
+#include "ide-editor-private.h"
+
+#include "gbp-editorui-placeholder.h"
+
+/*
+ * GbpEditoruiPlaceholder stands in for an editor page restored from the
+ * session which is not yet visible. It only knows the file and session
+ * item so that no buffer is loaded until the page is first mapped, at
+ * which point #GbpEditoruiPlaceholder::materialize is emitted so that the
+ * workspace addin may replace it with an #IdeEditorPage.
+ */
+
+struct _GbpEditoruiPlaceholder
+{
+  IdePage         parent_instance;
+  GFile          *file;
+  IdeSessionItem *item;
+  GCancellable   *cancellable;
+  guint           materialized : 1;
+};
+
+enum {
+  PROP_0,
+  PROP_FILE,
+  PROP_ITEM,
+  N_PROPS
+};
+
+enum {
+  MATERIALIZE,
+  N_SIGNALS
+};
+
+G_DEFINE_FINAL_TYPE (GbpEditoruiPlaceholder, gbp_editorui_placeholder, IDE_TYPE_PAGE)
+
+static GParamSpec *properties [N_PROPS];
+static guint signals [N_SIGNALS];
+
+static void
+gbp_editorui_placeholder_query_info_cb (GObject      *object,
+                                        GAsyncResult *result,
+                                        gpointer      user_data)
+{
+  GFile *file = (GFile *)object;
+  g_autoptr(GbpEditoruiPlaceholder) self = user_data;
+  g_autoptr(GFileInfo) info = NULL;
+  const char *content_type;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (GBP_IS_EDITORUI_PLACEHOLDER (self));
+
+  if (!(info = g_file_query_info_finish (file, result, NULL)))
+    return;
+
+  if ((content_type = g_file_info_get_content_type (info)))
+    {
+      g_autoptr(GIcon) icon = g_content_type_get_symbolic_icon (content_type);
+
+      panel_widget_set_icon (PANEL_WIDGET (self), icon);
+    }
+}
+
+static GFile *
+gbp_editorui_placeholder_get_file_or_directory (IdePage *page)
+{
+  return g_object_ref (GBP_EDITORUI_PLACEHOLDER (page)->file);
+}
+
+static void
+gbp_editorui_placeholder_map (GtkWidget *widget)
+{
+  GbpEditoruiPlaceholder *self = (GbpEditoruiPlaceholder *)widget;
+
+  g_assert (GBP_IS_EDITORUI_PLACEHOLDER (self));
+
+  GTK_WIDGET_CLASS (gbp_editorui_placeholder_parent_class)->map (widget);
+
+  /* Only mapped when the page is visible in its frame */
+  if (!self->materialized)
+    {
+      self->materialized = TRUE;
+      g_signal_emit (self, signals [MATERIALIZE], 0);
+    }
+}
+
+static void
+gbp_editorui_placeholder_constructed (GObject *object)
+{
+  GbpEditoruiPlaceholder *self = (GbpEditoruiPlaceholder *)object;
+  g_autofree char *title = NULL;
+
+  G_OBJECT_CLASS (gbp_editorui_placeholder_parent_class)->constructed (object);
+
+  g_return_if_fail (G_IS_FILE (self->file));
+
+  title = g_file_get_basename (self->file);
+  panel_widget_set_title (PANEL_WIDGET (self), title);
+
+  /* Sniff the content-type on the I/O pool for the tab icon. Requests
+   * from each placeholder run concurrently.
+   */
+  g_file_query_info_async (self->file,
+                           G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+                           G_FILE_QUERY_INFO_NONE,
+                           G_PRIORITY_LOW,
+                           self->cancellable,
+                           gbp_editorui_placeholder_query_info_cb,
+                           g_object_ref (self));
+}
+
+static void
+gbp_editorui_placeholder_dispose (GObject *object)
+{
+  GbpEditoruiPlaceholder *self = (GbpEditoruiPlaceholder *)object;
+
+  g_cancellable_cancel (self->cancellable);
+
+  G_OBJECT_CLASS (gbp_editorui_placeholder_parent_class)->dispose (object);
+}
+
+static void
+gbp_editorui_placeholder_finalize (GObject *object)
+{
+  GbpEditoruiPlaceholder *self = (GbpEditoruiPlaceholder *)object;
+
+  g_clear_object (&self->file);
+  g_clear_object (&self->item);
+  g_clear_object (&self->cancellable);
+
+  G_OBJECT_CLASS (gbp_editorui_placeholder_parent_class)->finalize (object);
+}
+
+static void
+gbp_editorui_placeholder_get_property (GObject    *object,
+                                       guint       prop_id,
+                                       GValue     *value,
+                                       GParamSpec *pspec)
+{
+  GbpEditoruiPlaceholder *self = GBP_EDITORUI_PLACEHOLDER (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+
+    case PROP_ITEM:
+      g_value_set_object (value, self->item);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gbp_editorui_placeholder_set_property (GObject      *object,
+                                       guint         prop_id,
+                                       const GValue *value,
+                                       GParamSpec   *pspec)
+{
+  GbpEditoruiPlaceholder *self = GBP_EDITORUI_PLACEHOLDER (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      self->file = g_value_dup_object (value);
+      break;
+
+    case PROP_ITEM:
+      self->item = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+gbp_editorui_placeholder_class_init (GbpEditoruiPlaceholderClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+  IdePageClass *page_class = IDE_PAGE_CLASS (klass);
+
+  object_class->constructed = gbp_editorui_placeholder_constructed;
+  object_class->dispose = gbp_editorui_placeholder_dispose;
+  object_class->finalize = gbp_editorui_placeholder_finalize;
+  object_class->get_property = gbp_editorui_placeholder_get_property;
+  object_class->set_property = gbp_editorui_placeholder_set_property;
+
+  widget_class->map = gbp_editorui_placeholder_map;
+
+  page_class->get_file_or_directory = gbp_editorui_placeholder_get_file_or_directory;
+
+  properties [PROP_FILE] =
+    g_param_spec_object ("file", NULL, NULL,
+                         G_TYPE_FILE,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_ITEM] =
+    g_param_spec_object ("item", NULL, NULL,
+                         IDE_TYPE_SESSION_ITEM,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+
+  /**
+   * GbpEditoruiPlaceholder::materialize:
+   *
+   * The "materialize" signal is emitted the first time the placeholder
+   * is mapped and should be replaced with the real page.
+   */
+  signals [MATERIALIZE] =
+    g_signal_new ("materialize",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+gbp_editorui_placeholder_init (GbpEditoruiPlaceholder *self)
+{
+  self->cancellable = g_cancellable_new ();
+
+  panel_widget_set_icon_name (PANEL_WIDGET (self), "text-x-generic-symbolic");
+
+  /* So that focusing our file replaces us instead of adding another page */
+  _ide_editor_mark_placeholder (IDE_PAGE (self));
+}
+
+GbpEditoruiPlaceholder *
+gbp_editorui_placeholder_new (GFile          *file,
+                              IdeSessionItem *item)
+{
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+  g_return_val_if_fail (IDE_IS_SESSION_ITEM (item), NULL);
+
+  return g_object_new (GBP_TYPE_EDITORUI_PLACEHOLDER,
+                       "file", file,
+                       "item", item,
+                       NULL);
+}
+
+/**
+ * gbp_editorui_placeholder_get_file:
+ * @self: a #GbpEditoruiPlaceholder
+ *
+ * Returns: (transfer none): a #GFile
+ */
+GFile *
+gbp_editorui_placeholder_get_file (GbpEditoruiPlaceholder *self)
+{
+  g_return_val_if_fail (GBP_IS_EDITORUI_PLACEHOLDER (self), NULL);
+
+  return self->file;
+}
+
+/**
+ * gbp_editorui_placeholder_get_item:
+ * @self: a #GbpEditoruiPlaceholder
+ *
+ * Gets the session item the placeholder was restored from.
+ *
+ * Returns: (transfer none): an #IdeSessionItem
+ */
+IdeSessionItem *
+gbp_editorui_placeholder_get_item (GbpEditoruiPlaceholder *self)
+{
+  g_return_val_if_fail (GBP_IS_EDITORUI_PLACEHOLDER (self), NULL);
+
+  return self->item;
+}
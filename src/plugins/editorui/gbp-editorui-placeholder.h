@@ -0,0 +1,36 @@
+/* gbp-editorui-placeholder.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <libide-gui.h>
+
+G_BEGIN_DECLS
+
+#define GBP_TYPE_EDITORUI_PLACEHOLDER (gbp_editorui_placeholder_get_type())
+
+G_DECLARE_FINAL_TYPE (GbpEditoruiPlaceholder, gbp_editorui_placeholder, GBP, EDITORUI_PLACEHOLDER, IdePage)
+
+GbpEditoruiPlaceholder *gbp_editorui_placeholder_new      (GFile                  *file,
+                                                           IdeSessionItem         *item);
+GFile                  *gbp_editorui_placeholder_get_file (GbpEditoruiPlaceholder *self);
+IdeSessionItem         *gbp_editorui_placeholder_get_item (GbpEditoruiPlaceholder *self);
+
+G_END_DECLS
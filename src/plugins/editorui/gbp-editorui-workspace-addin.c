@@ -29,6 +29,7 @@
 
 #include "ide-workspace-private.h"
 
+#include "gbp-editorui-placeholder.h"
 #include "gbp-editorui-position-label.h"
 #include "gbp-editorui-workspace-addin.h"
 
@@ -74,6 +75,7 @@ typedef struct
 {
   IdeWorkspace *workspace;
   PanelPosition *position;
+  IdePage *placeholder;
   char *uri;
   char *language_id;
   guint sel_insert_line;
@@ -103,6 +105,7 @@ restore_page_free (RestorePage *rp)
 {
   g_clear_object (&rp->workspace);
   g_clear_object (&rp->position);
+  g_clear_object (&rp->placeholder);
   g_clear_pointer (&rp->uri, g_free);
   g_clear_pointer (&rp->language_id, g_free);
   g_slice_free (RestorePage, rp);
@@ -720,6 +723,30 @@ gbp_editorui_workspace_addin_save_session_page_cb (IdePage  *page,
       if (page == ide_workspace_get_most_recent_page (workspace))
         ide_session_item_set_metadata (item, "has-focus", "b", TRUE);
 
+      ide_session_append (session, item);
+    }
+  else if (GBP_IS_EDITORUI_PLACEHOLDER (page))
+    {
+      IdeSessionItem *orig = gbp_editorui_placeholder_get_item (GBP_EDITORUI_PLACEHOLDER (page));
+      g_autoptr(PanelPosition) position = ide_page_get_position (page);
+      g_autoptr(IdeSessionItem) item = ide_session_item_new ();
+      IdeWorkspace *workspace = ide_widget_get_workspace (GTK_WIDGET (page));
+      static const char * const keys[] = { "uri", "selection", "language-id" };
+
+      /* The page was never shown, so the restored state is still current */
+      ide_session_item_set_module_name (item, "editorui");
+      ide_session_item_set_type_hint (item, "IdeEditorPage");
+      ide_session_item_set_workspace (item, ide_workspace_get_id (workspace));
+      ide_session_item_set_position (item, position);
+
+      for (guint i = 0; i < G_N_ELEMENTS (keys); i++)
+        {
+          g_autoptr(GVariant) value = ide_session_item_get_metadata_value (orig, keys[i], NULL);
+
+          if (value != NULL)
+            ide_session_item_set_metadata_value (item, keys[i], value);
+        }
+
       ide_session_append (session, item);
     }
 }
@@ -757,7 +784,25 @@ restore_page_cb (GObject      *object,
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (rp != NULL);
 
-  if ((buffer = ide_buffer_manager_load_file_finish (buffer_manager, result, &error)))
+  /* The placeholder was closed or replaced (such as by focusing its file)
+   * while the buffer was loading, so there is nothing left to take over.
+   */
+  if (rp->placeholder != NULL &&
+      gtk_widget_get_parent (GTK_WIDGET (rp->placeholder)) == NULL)
+    IDE_GOTO (cleanup);
+
+  if (!(buffer = ide_buffer_manager_load_file_finish (buffer_manager, result, &error)))
+    {
+      if (rp->placeholder != NULL)
+        {
+          ide_page_set_failed (rp->placeholder, TRUE);
+          ide_page_report_error (rp->placeholder,
+                                 /* translators: %s is replaced with the error message */
+                                 _("Failed to load file: %s"),
+                                 error->message);
+        }
+    }
+  else
     {
       GtkWidget *page = ide_editor_page_new (buffer);
 
@@ -781,6 +826,15 @@ restore_page_cb (GObject      *object,
           gtk_text_buffer_select_range (GTK_TEXT_BUFFER (buffer), &insert, &bounds);
         }
 
+      /* Take the place of the placeholder, wherever it is now */
+      if (rp->placeholder != NULL)
+        {
+          g_autoptr(PanelPosition) position = ide_page_get_position (rp->placeholder);
+
+          if (position != NULL)
+            g_set_object (&rp->position, position);
+        }
+
       ide_workspace_add_page (rp->workspace, IDE_PAGE (page), rp->position);
 
       if (rp->has_focus)
@@ -788,34 +842,28 @@ restore_page_cb (GObject      *object,
           panel_widget_raise (PANEL_WIDGET (page));
           gtk_widget_grab_focus (GTK_WIDGET (page));
         }
+
+      if (rp->placeholder != NULL)
+        ide_page_destroy (rp->placeholder);
     }
 
+cleanup:
   restore_page_free (rp);
 
   IDE_EXIT;
 }
 
-static void
-gbp_editorui_workspace_addin_restore_page (GbpEditoruiWorkspaceAddin *self,
-                                           IdeSessionItem            *item)
+static RestorePage *
+restore_page_new (IdeWorkspace   *workspace,
+                  IdeSessionItem *item)
 {
-  IdeBufferManager *buffer_manager;
-  g_autoptr(IdeNotification) notif = NULL;
-  g_autoptr(GFile) file = NULL;
   RestorePage *rp;
-  IdeContext *context;
-
-  IDE_ENTRY;
 
-  g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (GBP_IS_EDITORUI_WORKSPACE_ADDIN (self));
+  g_assert (IDE_IS_WORKSPACE (workspace));
   g_assert (IDE_IS_SESSION_ITEM (item));
 
-  context = ide_workspace_get_context (self->workspace);
-  buffer_manager = ide_buffer_manager_from_context (context);
-
   rp = g_slice_new0 (RestorePage);
-  g_set_object (&rp->workspace, self->workspace);
+  g_set_object (&rp->workspace, workspace);
   g_set_object (&rp->position, ide_session_item_get_position (item));
 
   if (ide_session_item_has_metadata_with_type (item, "uri", G_VARIANT_TYPE ("s")))
@@ -834,10 +882,23 @@ gbp_editorui_workspace_addin_restore_page (GbpEditoruiWorkspaceAddin *self,
                                    &rp->sel_bounds_line,
                                    &rp->sel_bounds_line_offset);
 
-  if (!(file = g_file_new_for_uri (rp->uri)))
-    IDE_GOTO (failure);
+  return rp;
+}
 
-  notif = ide_notification_new ();
+static void
+restore_page_load (RestorePage     *rp,
+                   GFile           *file,
+                   IdeNotification *notif)
+{
+  IdeBufferManager *buffer_manager;
+  IdeContext *context;
+
+  g_assert (rp != NULL);
+  g_assert (G_IS_FILE (file));
+  g_assert (IDE_IS_NOTIFICATION (notif));
+
+  context = ide_workspace_get_context (rp->workspace);
+  buffer_manager = ide_buffer_manager_from_context (context);
 
   ide_buffer_manager_load_file_async (buffer_manager,
                                       file,
@@ -845,7 +906,83 @@ gbp_editorui_workspace_addin_restore_page (GbpEditoruiWorkspaceAddin *self,
                                       notif,
                                       NULL,
                                       restore_page_cb,
-                                      g_steal_pointer (&rp));
+                                      rp);
+}
+
+static void
+gbp_editorui_workspace_addin_materialize_cb (GbpEditoruiWorkspaceAddin *self,
+                                             GbpEditoruiPlaceholder    *placeholder)
+{
+  g_autoptr(IdeNotification) notif = NULL;
+  RestorePage *rp;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_EDITORUI_WORKSPACE_ADDIN (self));
+  g_assert (GBP_IS_EDITORUI_PLACEHOLDER (placeholder));
+
+  if (self->workspace == NULL)
+    IDE_EXIT;
+
+  rp = restore_page_new (self->workspace, gbp_editorui_placeholder_get_item (placeholder));
+  rp->placeholder = g_object_ref (IDE_PAGE (placeholder));
+
+  /* The placeholder is only mapped when it is visible, so the real page
+   * should be visible too, but only take focus if the placeholder had it.
+   */
+  rp->has_focus = gtk_widget_has_focus (GTK_WIDGET (placeholder)) ||
+                  ide_workspace_get_most_recent_page (self->workspace) == IDE_PAGE (placeholder);
+
+  notif = ide_notification_new ();
+  ide_page_set_progress (IDE_PAGE (placeholder), notif);
+
+  restore_page_load (rp, gbp_editorui_placeholder_get_file (placeholder), notif);
+
+  IDE_EXIT;
+}
+
+static void
+gbp_editorui_workspace_addin_restore_page (GbpEditoruiWorkspaceAddin *self,
+                                           IdeSessionItem            *item)
+{
+  g_autoptr(IdeNotification) notif = NULL;
+  g_autoptr(GFile) file = NULL;
+  RestorePage *rp;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_EDITORUI_WORKSPACE_ADDIN (self));
+  g_assert (IDE_IS_SESSION_ITEM (item));
+
+  rp = restore_page_new (self->workspace, item);
+
+  if (rp->uri == NULL || !(file = g_file_new_for_uri (rp->uri)))
+    IDE_GOTO (failure);
+
+  /* Only the focused page is loaded now. Everything else gets a
+   * placeholder which loads the buffer when it is first shown so that
+   * large sessions do not need to load every buffer (and its addins)
+   * before the workspace is usable.
+   */
+  if (!rp->has_focus)
+    {
+      GbpEditoruiPlaceholder *placeholder = gbp_editorui_placeholder_new (file, item);
+
+      g_signal_connect_object (placeholder,
+                               "materialize",
+                               G_CALLBACK (gbp_editorui_workspace_addin_materialize_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
+      ide_workspace_add_page (self->workspace, IDE_PAGE (placeholder), rp->position);
+      restore_page_free (rp);
+
+      IDE_EXIT;
+    }
+
+  notif = ide_notification_new ();
+  restore_page_load (g_steal_pointer (&rp), file, notif);
 
   IDE_EXIT;
 
@@ -152,9 +152,13 @@ gbp_flatpak_dependency_updater_update_async (IdeDependencyUpdater *updater,
       g_auto(GStrv) sdks = get_sdks (pipeline, GBP_FLATPAK_MANIFEST (config));
       g_autoptr(GbpFlatpakSdkStage) sdk_stage = NULL;
 
-      /* Add a stage to update SDKs */
+      /* Add a stage to update SDKs. Installing SDKs through the flatpak
+       * service does not touch the sources fetched by the download stage,
+       * so both may run at the same time.
+       */
       sdk_stage = gbp_flatpak_sdk_stage_new ((const char * const *)sdks);
       ide_pipeline_stage_set_transient (IDE_PIPELINE_STAGE (sdk_stage), TRUE);
+      ide_pipeline_stage_set_concurrent (IDE_PIPELINE_STAGE (sdk_stage), TRUE);
       ide_pipeline_attach (pipeline, IDE_PIPELINE_PHASE_DOWNLOADS, 0, IDE_PIPELINE_STAGE (sdk_stage));
     }
 
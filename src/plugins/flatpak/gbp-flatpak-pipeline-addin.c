@@ -503,6 +503,12 @@ register_downloads_stage (GbpFlatpakPipelineAddin  *self,
                         "name", _("Downloading dependencies"),
                         "state-dir", self->state_dir,
                         NULL);
+
+  /* Fetching sources only touches the state dir, so it may happen
+   * alongside the SDK update attached by the dependency updater.
+   */
+  ide_pipeline_stage_set_concurrent (stage, TRUE);
+
   stage_id = ide_pipeline_attach (pipeline, IDE_PIPELINE_PHASE_DOWNLOADS, 0, stage);
   ide_pipeline_addin_track (IDE_PIPELINE_ADDIN (self), stage_id);
 
@@ -36,24 +36,86 @@
 
 #define READ_BUFFER_LEN 4096
 
+/*
+ * Reading from gdb and parsing the MI stream happens on a dedicated
+ * thread (see GdbReader). Each record is wrapped in a GdbRecord and the
+ * payload of the replies which can get large (stack frames, variables and
+ * registers) is decoded into plain structs pointing into the MI tree while
+ * still on that thread.
+ *
+ * Records are handed to the main thread in batches so that everything
+ * gdb writes for a single stop is applied in one dispatch. The debugger
+ * objects are only created from the decoded structs once something asks
+ * for them with list_frames(), list_locals() or list_registers().
+ */
+
+typedef struct
+{
+  const gchar        *func;
+  const gchar        *file;
+  const gchar        *fullname;
+  IdeDebuggerAddress  addr;
+  guint               level;
+  guint               line;
+} GdbFrame;
+
+typedef struct
+{
+  const gchar *name;
+  const gchar *type;
+  const gchar *value;
+  gboolean     is_arg;
+} GdbVariable;
+
+typedef struct
+{
+  const gchar *number;
+  const gchar *value;
+} GdbRegister;
+
+typedef struct
+{
+  struct gdbwire_mi_output *output;
+  GArray                   *frames;
+  GArray                   *variables;
+  GArray                   *registers;
+} GdbRecord;
+
+typedef struct
+{
+  GMutex                    mutex;
+  GWeakRef                  self_wr;
+  GMainContext             *main_context;
+  GInputStream             *stream;
+  GCancellable             *cancellable;
+
+  /* Only accessed from the reader thread */
+  struct gdbwire_mi_parser *parser;
+
+  /* Protected by mutex */
+  GPtrArray                *pending;
+  gchar                    *failure;
+  guint                     dispatch_queued : 1;
+  guint                     closed : 1;
+} GdbReader;
+
 struct _GbpGdbDebugger
 {
   IdeDebugger               parent_instance;
 
   GIOStream                *io_stream;
-  gchar                    *read_buffer;
   GCancellable             *read_cancellable;
   GHashTable               *register_names;
   GFile                    *builddir;
   IdeConfig                *current_config;
 
-  struct gdbwire_mi_parser *parser;
-
   GQueue                    writequeue;
   GQueue                    cmdqueue;
   guint                     cmdseq;
 
   guint                     has_connected : 1;
+  guint                     in_batch : 1;
+  guint                     needs_breakpoints : 1;
 };
 
 typedef struct
@@ -66,6 +128,12 @@ typedef struct
 
 G_DEFINE_FINAL_TYPE (GbpGdbDebugger, gbp_gdb_debugger, IDE_TYPE_DEBUGGER)
 
+static GdbRecord *gbp_gdb_debugger_exec_finish_record (GbpGdbDebugger  *self,
+                                                       GAsyncResult    *result,
+                                                       GError         **error);
+static void       gbp_gdb_debugger_dispatch           (GbpGdbDebugger  *self,
+                                                       GdbRecord       *record);
+
 #define DEBUG_LOG(dir,msg)                                 \
   G_STMT_START {                                           \
     IdeLineReader reader;                                  \
@@ -79,6 +147,145 @@ G_DEFINE_FINAL_TYPE (GbpGdbDebugger, gbp_gdb_debugger, IDE_TYPE_DEBUGGER)
       }                                                    \
   } G_STMT_END
 
+static void
+gdb_record_free (GdbRecord *record)
+{
+  g_clear_pointer (&record->output, gdbwire_mi_output_free);
+  g_clear_pointer (&record->frames, g_array_unref);
+  g_clear_pointer (&record->variables, g_array_unref);
+  g_clear_pointer (&record->registers, g_array_unref);
+  g_slice_free (GdbRecord, record);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GdbRecord, gdb_record_free)
+
+static void
+gdb_record_decode_frames (GdbRecord                      *record,
+                          const struct gdbwire_mi_result *res)
+{
+  record->frames = g_array_new (FALSE, FALSE, sizeof (GdbFrame));
+
+  for (const struct gdbwire_mi_result *liter = res->variant.result; liter; liter = liter->next)
+    {
+      GdbFrame frame = { 0 };
+
+      if (liter->kind != GDBWIRE_MI_TUPLE)
+        continue;
+
+      for (const struct gdbwire_mi_result *iter = liter->variant.result; iter; iter = iter->next)
+        {
+          if (iter->kind != GDBWIRE_MI_CSTRING)
+            continue;
+
+          if (g_strcmp0 (iter->variable, "level") == 0)
+            frame.level = g_ascii_strtoll (iter->variant.cstring, NULL, 10);
+          else if (g_strcmp0 (iter->variable, "addr") == 0)
+            frame.addr = ide_debugger_address_parse (iter->variant.cstring);
+          else if (g_strcmp0 (iter->variable, "func") == 0)
+            frame.func = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "file") == 0)
+            frame.file = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "fullname") == 0)
+            frame.fullname = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "line") == 0)
+            frame.line = g_ascii_strtoll (iter->variant.cstring, NULL, 10);
+        }
+
+      g_array_append_val (record->frames, frame);
+    }
+}
+
+static void
+gdb_record_decode_variables (GdbRecord                      *record,
+                             const struct gdbwire_mi_result *res)
+{
+  record->variables = g_array_new (FALSE, FALSE, sizeof (GdbVariable));
+
+  for (const struct gdbwire_mi_result *liter = res->variant.result; liter; liter = liter->next)
+    {
+      GdbVariable var = { 0 };
+
+      if (liter->kind != GDBWIRE_MI_TUPLE)
+        continue;
+
+      for (const struct gdbwire_mi_result *iter = liter->variant.result; iter; iter = iter->next)
+        {
+          if (iter->kind != GDBWIRE_MI_CSTRING)
+            continue;
+
+          if (g_strcmp0 (iter->variable, "name") == 0)
+            var.name = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "type") == 0)
+            var.type = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "value") == 0)
+            var.value = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "arg") == 0)
+            var.is_arg |= g_strcmp0 (iter->variant.cstring, "1") == 0;
+        }
+
+      if (var.name != NULL)
+        g_array_append_val (record->variables, var);
+    }
+}
+
+static void
+gdb_record_decode_registers (GdbRecord                      *record,
+                             const struct gdbwire_mi_result *res)
+{
+  record->registers = g_array_new (FALSE, FALSE, sizeof (GdbRegister));
+
+  for (const struct gdbwire_mi_result *liter = res->variant.result; liter; liter = liter->next)
+    {
+      GdbRegister reg = { 0 };
+
+      if (liter->kind != GDBWIRE_MI_TUPLE)
+        continue;
+
+      for (const struct gdbwire_mi_result *iter = liter->variant.result; iter; iter = iter->next)
+        {
+          if (iter->kind != GDBWIRE_MI_CSTRING)
+            continue;
+
+          if (g_strcmp0 (iter->variable, "number") == 0)
+            reg.number = iter->variant.cstring;
+          else if (g_strcmp0 (iter->variable, "value") == 0)
+            reg.value = iter->variant.cstring;
+        }
+
+      g_array_append_val (record->registers, reg);
+    }
+}
+
+/*
+ * Called from the reader thread. Strings in the decoded structs point into
+ * @output and therefore share its lifetime.
+ */
+static GdbRecord *
+gdb_record_new (struct gdbwire_mi_output *output)
+{
+  const struct gdbwire_mi_result *res;
+  GdbRecord *record;
+
+  record = g_slice_new0 (GdbRecord);
+  record->output = output;
+
+  if (output->kind != GDBWIRE_MI_OUTPUT_RESULT ||
+      output->variant.result_record == NULL ||
+      output->variant.result_record->result_class == GDBWIRE_MI_ERROR ||
+      !(res = output->variant.result_record->result) ||
+      res->kind != GDBWIRE_MI_LIST)
+    return record;
+
+  if (g_strcmp0 (res->variable, "stack") == 0)
+    gdb_record_decode_frames (record, res);
+  else if (g_strcmp0 (res->variable, "variables") == 0)
+    gdb_record_decode_variables (record, res);
+  else if (g_strcmp0 (res->variable, "register-values") == 0)
+    gdb_record_decode_registers (record, res);
+
+  return record;
+}
+
 static void
 gbp_gdb_debugger_parent_set (IdeObject *object,
                              IdeObject *parent)
@@ -302,26 +509,26 @@ gbp_gdb_debugger_cache_register_names (GbpGdbDebugger           *self,
 }
 
 static void
-gbp_gdb_debugger_handle_result (GbpGdbDebugger           *self,
-                                struct gdbwire_mi_output *output)
+gbp_gdb_debugger_handle_result (GbpGdbDebugger *self,
+                                GdbRecord      *record)
 {
   g_autoptr(IdeTask) task = NULL;
 
   g_assert (GBP_IS_GDB_DEBUGGER (self));
-  g_assert (output->kind == GDBWIRE_MI_OUTPUT_RESULT);
-  g_assert (output->line != NULL);
+  g_assert (record->output->kind == GDBWIRE_MI_OUTPUT_RESULT);
+  g_assert (record->output->line != NULL);
 
-  task = gbp_gdb_debugger_find_task (self, output);
+  task = gbp_gdb_debugger_find_task (self, record->output);
 
   if (task != NULL)
     {
-      ide_task_return_pointer (task, output, gdbwire_mi_output_free);
+      ide_task_return_pointer (task, record, gdb_record_free);
       return;
     }
 
-  ide_object_warning (self, "gdb: No reply found for: %s", output->line);
+  ide_object_warning (self, "gdb: No reply found for: %s", record->output->line);
 
-  gdbwire_mi_output_free (output);
+  gdb_record_free (record);
 }
 
 static void
@@ -692,7 +899,13 @@ gbp_gdb_debugger_handle_stopped (GbpGdbDebugger                 *self,
   else
     ide_debugger_breakpoint_set_file (breakpoint, file);
 
-  gbp_gdb_debugger_reload_breakpoints (self);
+  /* Defer until the rest of the batch is applied so that a stop which also
+   * modifies breakpoints only reloads them once.
+   */
+  if (self->in_batch)
+    self->needs_breakpoints = TRUE;
+  else
+    gbp_gdb_debugger_reload_breakpoints (self);
 
   thread = ide_debugger_thread_new (thread_id);
   ide_debugger_thread_set_group (thread, group_id);
@@ -958,42 +1171,45 @@ gbp_gdb_debugger_handle_oob (GbpGdbDebugger           *self,
 }
 
 static void
-gbp_gdb_debugger_output_callback (void                     *context,
-                                  struct gdbwire_mi_output *output)
+gbp_gdb_debugger_dispatch (GbpGdbDebugger *self,
+                           GdbRecord      *record)
 {
-  GbpGdbDebugger *self = context;
+  struct gdbwire_mi_output *output;
 
   g_assert (GBP_IS_GDB_DEBUGGER (self));
-  g_assert (output != NULL);
+  g_assert (record != NULL);
+  g_assert (record->output != NULL);
+
+  output = record->output;
 
   switch (output->kind)
     {
     case GDBWIRE_MI_OUTPUT_PARSE_ERROR:
       ide_object_warning (self, "Failed to parse gdb communication: %s", output->line);
-      gdbwire_mi_output_free (output);
+      gdb_record_free (record);
       gbp_gdb_debugger_panic (self);
       break;
 
     case GDBWIRE_MI_OUTPUT_OOB:
       DEBUG_LOG ("from-gdb (OOB)", output->line);
       gbp_gdb_debugger_handle_oob (self, output);
-      gdbwire_mi_output_free (output);
+      gdb_record_free (record);
       break;
 
     case GDBWIRE_MI_OUTPUT_RESULT:
       DEBUG_LOG ("from-gdb (RES)", output->line);
-      /* handle result steals output pointer */
-      gbp_gdb_debugger_handle_result (self, output);
+      /* handle result steals record pointer */
+      gbp_gdb_debugger_handle_result (self, record);
       break;
 
     case GDBWIRE_MI_OUTPUT_PROMPT:
       /* Ignore prompt for now */
-      gdbwire_mi_output_free (output);
+      gdb_record_free (record);
       break;
 
     default:
       g_warning ("Unhandled output type: %d", output->kind);
-      gdbwire_mi_output_free (output);
+      gdb_record_free (record);
     }
 }
 
@@ -1584,95 +1800,48 @@ gbp_gdb_debugger_list_frames_cb (GObject      *object,
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
   g_autoptr(GPtrArray) ar = NULL;
-  struct gdbwire_mi_output *output;
+  g_autoptr(GdbRecord) record = NULL;
 
   g_assert (GBP_IS_GDB_DEBUGGER (self));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
-  output = gbp_gdb_debugger_exec_finish (self, result, &error);
+  record = gbp_gdb_debugger_exec_finish_record (self, result, &error);
 
-  if (output == NULL || gbp_gdb_debugger_unwrap (output, &error))
+  if (record == NULL || gbp_gdb_debugger_unwrap (record->output, &error))
     {
       ide_task_return_error (task, g_steal_pointer (&error));
-      goto cleanup;
+      return;
     }
 
   ar = g_ptr_array_new_with_free_func (g_object_unref);
 
-  if (output->kind == GDBWIRE_MI_OUTPUT_RESULT &&
-      output->variant.result_record != NULL &&
-      output->variant.result_record->result != NULL)
+  if (record->frames != NULL)
     {
-      const struct gdbwire_mi_result *res = output->variant.result_record->result;
-
-      if (res->kind == GDBWIRE_MI_LIST)
+      for (guint i = 0; i < record->frames->len; i++)
         {
-          const struct gdbwire_mi_result *liter;
+          const GdbFrame *f = &g_array_index (record->frames, GdbFrame, i);
+          g_autoptr(IdeDebuggerFrame) frame = NULL;
+          g_autofree gchar *file = gbp_gdb_debugger_translate_path (self, f->file);
+          g_autofree gchar *fullname = gbp_gdb_debugger_translate_path (self, f->fullname);
 
-          for (liter = res->variant.result; liter != NULL; liter = liter->next)
-            {
-              if (liter->kind == GDBWIRE_MI_TUPLE)
-                {
-                  g_autoptr(IdeDebuggerFrame) frame = NULL;
-                  g_autofree gchar *file = NULL;
-                  g_autofree gchar *fullname = NULL;
-                  G_GNUC_UNUSED const gchar *from = NULL;
-                  const struct gdbwire_mi_result *iter;
-                  const gchar *func = NULL;
-                  IdeDebuggerAddress addr = 0;
-                  guint level = 0;
-                  guint line = 0;
-
-                  for (iter = liter->variant.result; iter; iter = iter->next)
-                    {
-                      if (iter->kind == GDBWIRE_MI_CSTRING)
-                        {
-                          if (g_strcmp0 (iter->variable, "level") == 0)
-                            level = g_ascii_strtoll (iter->variant.cstring, NULL, 10);
-                          else if (g_strcmp0 (iter->variable, "addr") == 0)
-                            addr = ide_debugger_address_parse (iter->variant.cstring);
-                          else if (g_strcmp0 (iter->variable, "func") == 0)
-                            func = iter->variant.cstring;
-                          else if (g_strcmp0 (iter->variable, "file") == 0)
-                            {
-                              g_free (file);
-                              file = gbp_gdb_debugger_translate_path (self, iter->variant.cstring);
-                            }
-                          else if (g_strcmp0 (iter->variable, "fullname") == 0)
-                            {
-                              g_free (fullname);
-                              fullname = gbp_gdb_debugger_translate_path (self, iter->variant.cstring);
-                            }
-                          else if (g_strcmp0 (iter->variable, "line") == 0)
-                            line = g_ascii_strtoll (iter->variant.cstring, NULL, 10);
-                          else if (g_strcmp0 (iter->variable, "from") == 0)
-                            from = iter->variant.cstring;
-                        }
-                    }
+          frame = ide_debugger_frame_new ();
 
-                  frame = ide_debugger_frame_new ();
+          ide_debugger_frame_set_address (frame, f->addr);
+          ide_debugger_frame_set_function (frame, f->func);
+          ide_debugger_frame_set_line (frame, f->line);
+          ide_debugger_frame_set_depth (frame, f->level);
 
-                  ide_debugger_frame_set_address (frame, addr);
-                  ide_debugger_frame_set_function (frame, func);
-                  ide_debugger_frame_set_line (frame, line);
-                  ide_debugger_frame_set_depth (frame, level);
-
-                  if (fullname != NULL && g_file_test (fullname, G_FILE_TEST_EXISTS))
-                    ide_debugger_frame_set_file (frame, fullname);
-                  else
-                    ide_debugger_frame_set_file (frame, file);
+          if (fullname != NULL && g_file_test (fullname, G_FILE_TEST_EXISTS))
+            ide_debugger_frame_set_file (frame, fullname);
+          else
+            ide_debugger_frame_set_file (frame, file);
 
-                  g_ptr_array_add (ar, g_steal_pointer (&frame));
-                }
-            }
+          g_ptr_array_add (ar, g_steal_pointer (&frame));
         }
     }
 
   ide_task_return_pointer (task, g_steal_pointer (&ar), g_ptr_array_unref);
-
-cleanup:
-  g_clear_pointer (&output, gdbwire_mi_output_free);
 }
 
 static void
@@ -1950,78 +2119,45 @@ gbp_gdb_debugger_handle_list_variables (GObject      *object,
   g_autoptr(GError) error = NULL;
   g_autoptr(GPtrArray) ar = NULL;
   g_autoptr(IdeTask) task = user_data;
-  struct gdbwire_mi_output *output;
-  struct gdbwire_mi_result *res;
+  g_autoptr(GdbRecord) record = NULL;
 
   g_assert (GBP_IS_GDB_DEBUGGER (self));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
-  output = gbp_gdb_debugger_exec_finish (self, result, &error);
+  record = gbp_gdb_debugger_exec_finish_record (self, result, &error);
 
-  if (output == NULL || gbp_gdb_debugger_unwrap (output, &error))
+  if (record == NULL || gbp_gdb_debugger_unwrap (record->output, &error))
     {
       ide_task_return_error (task, g_steal_pointer (&error));
-      goto cleanup;
+      return;
     }
 
   ar = g_ptr_array_new_with_free_func (g_object_unref);
 
-  /* Decode variables */
-
-  res = output->variant.result_record->result;
-
-  if (res->kind == GDBWIRE_MI_LIST &&
-      g_strcmp0 (res->variable, "variables") == 0)
+  if (record->variables != NULL)
     {
-      struct gdbwire_mi_result *iter;
-
-      for (iter = res->variant.result; iter; iter = iter->next)
+      for (guint i = 0; i < record->variables->len; i++)
         {
-          if (iter->kind == GDBWIRE_MI_TUPLE)
-            {
-              struct gdbwire_mi_result *titer;
-              g_autoptr(IdeDebuggerVariable) var = NULL;
-              G_GNUC_UNUSED const gchar *value = NULL;
-              const gchar *type = NULL;
-              const gchar *name = NULL;
-              gboolean is_arg = FALSE;
-
-              for (titer = iter->variant.result; titer; titer = titer->next)
-                {
-                  if (titer->kind == GDBWIRE_MI_CSTRING)
-                    {
-                      if (g_strcmp0 (titer->variable, "name") == 0)
-                        name = titer->variant.cstring;
-                      else if (g_strcmp0 (titer->variable, "type") == 0)
-                        type = titer->variant.cstring;
-                      else if (g_strcmp0 (titer->variable, "value") == 0)
-                        value = titer->variant.cstring;
-                      else if (g_strcmp0 (titer->variable, "arg") == 0)
-                        is_arg |= g_strcmp0 (titer->variant.cstring, "1") == 0;
-                    }
-                }
+          const GdbVariable *v = &g_array_index (record->variables, GdbVariable, i);
+          g_autoptr(IdeDebuggerVariable) var = NULL;
 
-              if ((name == NULL) || (arguments != is_arg))
-                continue;
+          if (arguments != v->is_arg)
+            continue;
 
-              var = ide_debugger_variable_new (name);
-              ide_debugger_variable_set_type_name (var, type);
-              ide_debugger_variable_set_value (var, value);
+          var = ide_debugger_variable_new (v->name);
+          ide_debugger_variable_set_type_name (var, v->type);
+          ide_debugger_variable_set_value (var, v->value);
 
-              /* TODO: We really need to create frozen variables for this
-               *       so that we can get the updated value.
-               */
+          /* TODO: We really need to create frozen variables for this
+           *       so that we can get the updated value.
+           */
 
-              g_ptr_array_add (ar, g_steal_pointer (&var));
-            }
+          g_ptr_array_add (ar, g_steal_pointer (&var));
         }
     }
 
   ide_task_return_pointer (task, g_steal_pointer (&ar), g_ptr_array_unref);
-
-cleanup:
-  g_clear_pointer (&output, gdbwire_mi_output_free);
 }
 
 static void
@@ -2149,67 +2285,42 @@ gbp_gdb_debugger_list_registers_cb (GObject      *object,
   g_autoptr(GPtrArray) ar = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(IdeTask) task = user_data;
-  struct gdbwire_mi_output *output;
-  struct gdbwire_mi_result *res;
+  g_autoptr(GdbRecord) record = NULL;
 
   g_assert (GBP_IS_GDB_DEBUGGER (self));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
-  output = gbp_gdb_debugger_exec_finish (self, result, &error);
+  record = gbp_gdb_debugger_exec_finish_record (self, result, &error);
 
-  if (output == NULL || gbp_gdb_debugger_unwrap (output, &error))
+  if (record == NULL || gbp_gdb_debugger_unwrap (record->output, &error))
     {
       ide_task_return_error (task, g_steal_pointer (&error));
-      goto cleanup;
+      return;
     }
 
   ar = g_ptr_array_new_with_free_func (g_object_unref);
 
-  res = output->variant.result_record->result;
-
-  if (res->kind == GDBWIRE_MI_LIST &&
-      g_strcmp0 (res->variable, "register-values") == 0)
+  if (record->registers != NULL)
     {
-      const struct gdbwire_mi_result *liter;
-
-      for (liter = res->variant.result; liter; liter = liter->next)
+      for (guint i = 0; i < record->registers->len; i++)
         {
-          if (liter->kind == GDBWIRE_MI_TUPLE)
-            {
-              g_autoptr(IdeDebuggerRegister) reg = NULL;
-              const struct gdbwire_mi_result *titer;
-              const gchar *name = NULL;
-              const gchar *number = NULL;
-              const gchar *value = NULL;
-
-              for (titer = liter->variant.result; titer; titer = titer->next)
-                {
-                  if (titer->kind == GDBWIRE_MI_CSTRING)
-                    {
-                      if (g_strcmp0 (titer->variable, "number") == 0)
-                        number = titer->variant.cstring;
-                      else if (g_strcmp0 (titer->variable, "value") == 0)
-                        value = titer->variant.cstring;
-                    }
-                }
+          const GdbRegister *r = &g_array_index (record->registers, GdbRegister, i);
+          g_autoptr(IdeDebuggerRegister) reg = NULL;
+          const gchar *name = NULL;
 
-              if (number != NULL && self->register_names != NULL)
-                name = g_hash_table_lookup (self->register_names, number);
+          if (r->number != NULL && self->register_names != NULL)
+            name = g_hash_table_lookup (self->register_names, r->number);
 
-              reg = ide_debugger_register_new (number);
-              ide_debugger_register_set_name (reg, name);
-              ide_debugger_register_set_value (reg, value);
+          reg = ide_debugger_register_new (r->number);
+          ide_debugger_register_set_name (reg, name);
+          ide_debugger_register_set_value (reg, r->value);
 
-              g_ptr_array_add (ar, g_steal_pointer (&reg));
-            }
+          g_ptr_array_add (ar, g_steal_pointer (&reg));
         }
     }
 
   ide_task_return_pointer (task, g_steal_pointer (&ar), g_ptr_array_unref);
-
-cleanup:
-  g_clear_pointer (&output, gdbwire_mi_output_free);
 }
 
 static void
@@ -2638,8 +2749,6 @@ gbp_gdb_debugger_finalize (GObject *object)
 
   g_clear_object (&self->io_stream);
   g_clear_object (&self->read_cancellable);
-  g_clear_pointer (&self->parser, gdbwire_mi_parser_destroy);
-  g_clear_pointer (&self->read_buffer, g_free);
   g_clear_pointer (&self->register_names, g_hash_table_unref);
   g_queue_clear (&self->cmdqueue);
 
@@ -2691,13 +2800,7 @@ gbp_gdb_debugger_class_init (GbpGdbDebuggerClass *klass)
 static void
 gbp_gdb_debugger_init (GbpGdbDebugger *self)
 {
-  struct gdbwire_mi_parser_callbacks callbacks = {
-    self, gbp_gdb_debugger_output_callback
-  };
-
-  self->parser = gdbwire_mi_parser_create (callbacks);
   self->read_cancellable = g_cancellable_new ();
-  self->read_buffer = g_malloc (READ_BUFFER_LEN);
 
   g_queue_init (&self->cmdqueue);
 }
@@ -2708,64 +2811,191 @@ gbp_gdb_debugger_new (void)
   return g_object_new (GBP_TYPE_GDB_DEBUGGER, NULL);
 }
 
+static GdbReader *
+gdb_reader_ref (GdbReader *reader)
+{
+  return g_atomic_rc_box_acquire (reader);
+}
+
 static void
-gbp_gdb_debugger_read_cb (GObject      *object,
-                          GAsyncResult *result,
-                          gpointer      user_data)
+gdb_reader_finalize (gpointer data)
 {
-  g_autoptr(GbpGdbDebugger) self = user_data;
-  GInputStream *stream = (GInputStream *)object;
-  g_autoptr(GError) error = NULL;
-  enum gdbwire_result res;
-  GCancellable *read_cancellable;
-  gchar *read_buffer;
-  gssize n_read;
+  GdbReader *reader = data;
 
-  g_assert (G_IS_INPUT_STREAM (stream));
-  g_assert (G_IS_ASYNC_RESULT (result));
-  g_assert (GBP_IS_GDB_DEBUGGER (self));
+  g_clear_pointer (&reader->parser, gdbwire_mi_parser_destroy);
+  g_clear_pointer (&reader->pending, g_ptr_array_unref);
+  g_clear_pointer (&reader->failure, g_free);
+  g_clear_pointer (&reader->main_context, g_main_context_unref);
+  g_clear_object (&reader->stream);
+  g_clear_object (&reader->cancellable);
+  g_weak_ref_clear (&reader->self_wr);
+  g_mutex_clear (&reader->mutex);
+}
 
-  n_read = g_input_stream_read_finish (stream, result, &error);
+static void
+gdb_reader_unref (GdbReader *reader)
+{
+  g_atomic_rc_box_release_full (reader, gdb_reader_finalize);
+}
 
-  if (error != NULL)
-    {
-      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
-          !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED))
-        ide_object_warning (self, "gdb client read failed: %s", error->message);
-      return;
-    }
+static gboolean
+gdb_reader_dispatch_cb (gpointer data)
+{
+  GdbReader *reader = data;
+  g_autoptr(GbpGdbDebugger) self = NULL;
+  g_autoptr(GPtrArray) records = NULL;
+  g_autofree gchar *failure = NULL;
+  gboolean closed;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
 
-  if (n_read <= 0)
+  g_mutex_lock (&reader->mutex);
+  records = g_steal_pointer (&reader->pending);
+  reader->pending = g_ptr_array_new_with_free_func ((GDestroyNotify)gdb_record_free);
+  failure = g_steal_pointer (&reader->failure);
+  closed = reader->closed;
+  reader->dispatch_queued = FALSE;
+  g_mutex_unlock (&reader->mutex);
+
+  if (!(self = g_weak_ref_get (&reader->self_wr)))
+    return G_SOURCE_REMOVE;
+
+  self->in_batch = TRUE;
+  for (guint i = 0; i < records->len; i++)
+    gbp_gdb_debugger_dispatch (self, g_steal_pointer (&g_ptr_array_index (records, i)));
+  self->in_batch = FALSE;
+
+  if (self->needs_breakpoints)
     {
-      g_message ("empty read from peer, possibly closed?");
-      return;
+      self->needs_breakpoints = FALSE;
+      gbp_gdb_debugger_reload_breakpoints (self);
     }
 
-#if 0
-  self->read_buffer[n_read] = 0;
-  g_printerr (")))%s", self->read_buffer);
-#endif
+  if (failure != NULL)
+    ide_object_warning (self, "%s", failure);
+  else if (closed)
+    g_message ("empty read from peer, possibly closed?");
 
-  res = gdbwire_mi_parser_push_data (self->parser, self->read_buffer, n_read);
+  return G_SOURCE_REMOVE;
+}
 
-  if (res != GDBWIRE_OK)
+static void
+gdb_reader_queue_dispatch_locked (GdbReader *reader)
+{
+  GSource *source;
+
+  if (reader->dispatch_queued)
+    return;
+
+  reader->dispatch_queued = TRUE;
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_static_name (source, "[gdb-mi-dispatch]");
+  g_source_set_callback (source,
+                         gdb_reader_dispatch_cb,
+                         gdb_reader_ref (reader),
+                         (GDestroyNotify)gdb_reader_unref);
+  g_source_attach (source, reader->main_context);
+  g_source_unref (source);
+}
+
+static void
+gdb_reader_output_callback (void                     *context,
+                            struct gdbwire_mi_output *output)
+{
+  GdbReader *reader = context;
+  GdbRecord *record;
+
+  g_assert (reader != NULL);
+  g_assert (output != NULL);
+
+  /* Decode before taking the lock, this is the expensive part */
+  record = gdb_record_new (output);
+
+  g_mutex_lock (&reader->mutex);
+  g_ptr_array_add (reader->pending, record);
+  gdb_reader_queue_dispatch_locked (reader);
+  g_mutex_unlock (&reader->mutex);
+}
+
+static gpointer
+gdb_reader_thread (gpointer data)
+{
+  GdbReader *reader = data;
+  g_autofree gchar *read_buffer = g_malloc (READ_BUFFER_LEN);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *failure = NULL;
+
+  g_assert (reader != NULL);
+
+  for (;;)
     {
-      ide_object_warning (self, "Failed to push data into gdbwire parser: %d", res);
-      return;
+      enum gdbwire_result res;
+      gssize n_read;
+
+      n_read = g_input_stream_read (reader->stream,
+                                    read_buffer,
+                                    READ_BUFFER_LEN,
+                                    reader->cancellable,
+                                    &error);
+
+      if (n_read < 0)
+        {
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+              !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED))
+            failure = g_strdup_printf ("gdb client read failed: %s", error->message);
+          break;
+        }
+
+      if (n_read == 0)
+        break;
+
+      /* Records are delivered to gdb_reader_output_callback() */
+      res = gdbwire_mi_parser_push_data (reader->parser, read_buffer, n_read);
+
+      if (res != GDBWIRE_OK)
+        {
+          failure = g_strdup_printf ("Failed to push data into gdbwire parser: %d", res);
+          break;
+        }
     }
 
-  /* We can't access these inline because we need to steal *
-   * the self pointer for proper ownership management.     */
-  read_buffer = self->read_buffer;
-  read_cancellable = self->read_cancellable;
+  g_mutex_lock (&reader->mutex);
+  reader->closed = TRUE;
+  reader->failure = g_steal_pointer (&failure);
+  if (!g_cancellable_is_cancelled (reader->cancellable))
+    gdb_reader_queue_dispatch_locked (reader);
+  g_mutex_unlock (&reader->mutex);
+
+  gdb_reader_unref (reader);
+
+  return NULL;
+}
+
+static void
+gbp_gdb_debugger_start_reader (GbpGdbDebugger *self,
+                               GInputStream   *stream)
+{
+  struct gdbwire_mi_parser_callbacks callbacks = { NULL, gdb_reader_output_callback };
+  GdbReader *reader;
+
+  g_assert (GBP_IS_GDB_DEBUGGER (self));
+  g_assert (G_IS_INPUT_STREAM (stream));
+
+  reader = g_atomic_rc_box_new0 (GdbReader);
+  g_mutex_init (&reader->mutex);
+  g_weak_ref_init (&reader->self_wr, self);
+  reader->main_context = g_main_context_ref_thread_default ();
+  reader->stream = g_object_ref (stream);
+  reader->cancellable = g_object_ref (self->read_cancellable);
+  reader->pending = g_ptr_array_new_with_free_func ((GDestroyNotify)gdb_record_free);
 
-  g_input_stream_read_async (stream,
-                             read_buffer,
-                             READ_BUFFER_LEN,
-                             G_PRIORITY_LOW,
-                             read_cancellable,
-                             gbp_gdb_debugger_read_cb,
-                             g_steal_pointer (&self));
+  callbacks.context = reader;
+  reader->parser = gdbwire_mi_parser_create (callbacks);
+
+  /* The thread owns the reference to reader */
+  g_thread_unref (g_thread_new ("[gdb-mi-reader]", gdb_reader_thread, reader));
 }
 
 void
@@ -2790,13 +3020,7 @@ gbp_gdb_debugger_connect (GbpGdbDebugger *self,
   g_return_if_fail (stream != NULL);
   g_return_if_fail (G_IS_INPUT_STREAM (stream));
 
-  g_input_stream_read_async (stream,
-                             self->read_buffer,
-                             READ_BUFFER_LEN,
-                             G_PRIORITY_LOW,
-                             self->read_cancellable,
-                             gbp_gdb_debugger_read_cb,
-                             g_object_ref (self));
+  gbp_gdb_debugger_start_reader (self, stream);
 
   gbp_gdb_debugger_exec_async (self, "-gdb-set mi-async on", NULL, NULL, NULL);
   gbp_gdb_debugger_reload_breakpoints (self);
@@ -2987,12 +3211,24 @@ gbp_gdb_debugger_exec_finish (GbpGdbDebugger  *self,
                               GAsyncResult    *result,
                               GError         **error)
 {
-  struct gdbwire_mi_output *ret;
+  g_autoptr(GdbRecord) record = NULL;
 
   g_return_val_if_fail (GBP_IS_GDB_DEBUGGER (self), NULL);
   g_return_val_if_fail (IDE_IS_TASK (result), NULL);
 
-  ret = ide_task_propagate_pointer (IDE_TASK (result), error);
+  if (!(record = ide_task_propagate_pointer (IDE_TASK (result), error)))
+    return NULL;
+
+  return g_steal_pointer (&record->output);
+}
+
+static GdbRecord *
+gbp_gdb_debugger_exec_finish_record (GbpGdbDebugger  *self,
+                                     GAsyncResult    *result,
+                                     GError         **error)
+{
+  g_assert (GBP_IS_GDB_DEBUGGER (self));
+  g_assert (IDE_IS_TASK (result));
 
-  return g_steal_pointer (&ret);
+  return ide_task_propagate_pointer (IDE_TASK (result), error);
 }
@@ -142,6 +142,35 @@ cleanup:
   return g_steal_pointer (&blob);
 }
 
+static void
+ipc_git_change_monitor_impl_return_error (GDBusMethodInvocation *invocation,
+                                          GError                *error)
+{
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+  g_assert (error != NULL);
+
+  if (g_error_matches (error, GGIT_ERROR, GIT_ENOTFOUND))
+    {
+      g_dbus_method_invocation_return_dbus_error (invocation,
+                                                  "org.freedesktop.DBus.Error.FileNotFound",
+                                                  "No such file");
+      g_error_free (error);
+      return;
+    }
+
+  if (error->domain != G_IO_ERROR)
+    {
+      g_autoptr(GError) wrapped = error;
+
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_FAILED,
+                           _("The operation failed. The original error was \"%s\""),
+                           wrapped->message);
+    }
+
+  g_dbus_method_invocation_take_error (invocation, error);
+}
+
 static gboolean
 ipc_git_change_monitor_impl_handle_update_content (IpcGitChangeMonitor   *monitor,
                                                    GDBusMethodInvocation *invocation,
@@ -218,24 +247,12 @@ ipc_git_change_monitor_impl_handle_list_changes (IpcGitChangeMonitor   *monitor,
   for (guint i = 0; i < ranges->len; i++)
     {
       const Range *range = &g_array_index (ranges, Range, i);
-      gint start_line = range->new_start - 1;
-      gint end_line = range->new_start + range->new_lines - 1;
-
-      if (range->old_lines == 0 && range->new_lines > 0)
-        {
-          line_cache_mark_range (cache, start_line, end_line, LINE_MARK_ADDED);
-        }
-      else if (range->new_lines == 0 && range->old_lines > 0)
-        {
-          if (start_line < 0)
-            line_cache_mark_range (cache, 0, 0, LINE_MARK_PREVIOUS_REMOVED);
-          else
-            line_cache_mark_range (cache, start_line + 1, start_line + 1, LINE_MARK_REMOVED);
-        }
-      else
-        {
-          line_cache_mark_range (cache, start_line, end_line, LINE_MARK_CHANGED);
-        }
+
+      line_cache_mark_hunk (cache,
+                            range->old_start,
+                            range->old_lines,
+                            range->new_start,
+                            range->new_lines);
     }
 
   ret = line_cache_to_variant (cache);
@@ -246,29 +263,42 @@ ipc_git_change_monitor_impl_handle_list_changes (IpcGitChangeMonitor   *monitor,
 gerror:
   g_assert (ret != NULL || error != NULL);
 
-  if (g_error_matches (error, GGIT_ERROR, GIT_ENOTFOUND))
+  if (error != NULL)
+    ipc_git_change_monitor_impl_return_error (invocation, g_steal_pointer (&error));
+  else
+    ipc_git_change_monitor_complete_list_changes (monitor, invocation, ret);
+
+  return TRUE;
+}
+
+static gboolean
+ipc_git_change_monitor_impl_handle_load_base (IpcGitChangeMonitor   *monitor,
+                                              GDBusMethodInvocation *invocation)
+{
+  IpcGitChangeMonitorImpl *self = (IpcGitChangeMonitorImpl *)monitor;
+  g_autoptr(GgitObject) blob = NULL;
+  g_autoptr(GError) error = NULL;
+  GVariant *contents;
+  const guint8 *data;
+  gsize len = 0;
+
+  g_assert (IPC_IS_GIT_CHANGE_MONITOR_IMPL (self));
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+
+  if (!(blob = ipc_git_change_monitor_impl_load_blob (self, &error)))
     {
-      g_dbus_method_invocation_return_dbus_error (invocation,
-                                                  "org.freedesktop.DBus.Error.FileNotFound",
-                                                  "No such file");
+      ipc_git_change_monitor_impl_return_error (invocation, g_steal_pointer (&error));
       return TRUE;
     }
 
-  if (error != NULL && error->domain != G_IO_ERROR)
-    {
-      g_autoptr(GError) wrapped = g_steal_pointer (&error);
-
-      g_set_error (&error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_FAILED,
-                   _("The operation failed. The original error was \"%s\""),
-                   wrapped->message);
-    }
+  /* Keep the blob alive for the variant rather than copying it */
+  data = ggit_blob_get_raw_content (GGIT_BLOB (blob), &len);
+  contents = g_variant_new_from_data (G_VARIANT_TYPE_BYTESTRING,
+                                      data, len, TRUE,
+                                      g_object_unref,
+                                      g_steal_pointer (&blob));
 
-  if (error != NULL)
-    g_dbus_method_invocation_return_gerror (invocation, error);
-  else
-    ipc_git_change_monitor_complete_list_changes (monitor, invocation, ret);
+  ipc_git_change_monitor_complete_load_base (monitor, invocation, contents);
 
   return TRUE;
 }
@@ -294,6 +324,7 @@ git_change_monitor_iface_init (IpcGitChangeMonitorIface *iface)
 {
   iface->handle_update_content = ipc_git_change_monitor_impl_handle_update_content;
   iface->handle_list_changes = ipc_git_change_monitor_impl_handle_list_changes;
+  iface->handle_load_base = ipc_git_change_monitor_impl_handle_load_base;
   iface->handle_close = ipc_git_change_monitor_impl_handle_close;
 }
 
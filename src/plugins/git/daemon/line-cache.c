@@ -112,6 +112,39 @@ line_cache_mark_range (LineCache *self,
   while (start_line < end_line);
 }
 
+/* Marks the lines of a hunk, using the same 1-based positions as
+ * git_diff_hunk (where @new_start of a pure deletion is the line
+ * preceding the removed lines).
+ */
+void
+line_cache_mark_hunk (LineCache *self,
+                      gint       old_start,
+                      gint       old_lines,
+                      gint       new_start,
+                      gint       new_lines)
+{
+  gint start_line = new_start - 1;
+  gint end_line = new_start + new_lines - 1;
+
+  g_assert (self != NULL);
+
+  if (old_lines == 0 && new_lines > 0)
+    {
+      line_cache_mark_range (self, start_line, end_line, LINE_MARK_ADDED);
+    }
+  else if (new_lines == 0 && old_lines > 0)
+    {
+      if (start_line < 0)
+        line_cache_mark_range (self, 0, 0, LINE_MARK_PREVIOUS_REMOVED);
+      else
+        line_cache_mark_range (self, start_line + 1, start_line + 1, LINE_MARK_REMOVED);
+    }
+  else
+    {
+      line_cache_mark_range (self, start_line, end_line, LINE_MARK_CHANGED);
+    }
+}
+
 static gint
 compare_by_line (gconstpointer a,
                  gconstpointer b)
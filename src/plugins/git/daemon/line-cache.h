@@ -47,6 +47,11 @@ void       line_cache_mark_range       (LineCache       *self,
                                         gint             start_line,
                                         gint             end_line,
                                         LineMark         mark);
+void       line_cache_mark_hunk        (LineCache       *self,
+                                        gint             old_start,
+                                        gint             old_lines,
+                                        gint             new_start,
+                                        gint             new_lines);
 void       line_cache_foreach_in_range (const LineCache *self,
                                         gint             start_line,
                                         gint             end_line,
@@ -29,6 +29,7 @@
 #include "daemon/line-cache.h"
 
 #include "gbp-git-buffer-change-monitor.h"
+#include "gbp-git-line-diff.h"
 #include "gbp-git-vcs.h"
 
 struct _GbpGitBufferChangeMonitor
@@ -38,8 +39,13 @@ struct _GbpGitBufferChangeMonitor
   GSignalGroup           *buffer_signals;
   GSignalGroup           *vcs_signals;
   LineCache              *cache;
+  GbpGitLineDiff         *diff;
+  GCancellable           *base_cancellable;
   guint                   last_change_count;
   guint                   queued_source;
+  guint                   insert_begin_line;
+  guint                   delete_begin_line;
+  guint                   delete_n_lines;
   guint                   delete_range_requires_recalculation : 1;
   guint                   not_found : 1;
 };
@@ -88,6 +94,127 @@ gbp_git_buffer_change_monitor_queue_update (GbpGitBufferChangeMonitor *self,
                         g_object_unref);
 }
 
+static void
+gbp_git_buffer_change_monitor_load_base_cb (GObject      *object,
+                                            GAsyncResult *result,
+                                            gpointer      user_data)
+{
+  IpcGitChangeMonitor *proxy = (IpcGitChangeMonitor *)object;
+  g_autoptr(GbpGitBufferChangeMonitor) self = user_data;
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autoptr(GVariant) contents = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  const char *data;
+  IdeBuffer *buffer;
+  gboolean trailing_line;
+  gsize len = 0;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IPC_IS_GIT_CHANGE_MONITOR (proxy));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+
+  if (!ipc_git_change_monitor_call_load_base_finish (proxy, &contents, result, &error))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+      /* Untracked files (or an older daemon) diff in the daemon instead */
+      g_debug ("Failed to load base contents: %s", error->message);
+      gbp_git_buffer_change_monitor_queue_update (self, FAST);
+      return;
+    }
+
+  if (ide_object_in_destruction (IDE_OBJECT (self)) ||
+      !(buffer = ide_buffer_change_monitor_get_buffer (IDE_BUFFER_CHANGE_MONITOR (self))))
+    return;
+
+  g_clear_pointer (&self->diff, gbp_git_line_diff_free);
+
+  /* The snapshot has the implicit trailing newline applied, so only
+   * without one does the buffer have an empty line after the last
+   * newline which must be counted for the lines to match.
+   */
+  trailing_line = !gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer));
+
+  snapshot = ide_buffer_ref_snapshot (buffer);
+  bytes = ide_buffer_snapshot_dup_content (snapshot);
+  data = g_variant_get_fixed_array (contents, &len, sizeof (guint8));
+  self->diff = gbp_git_line_diff_new (data, len, trailing_line);
+  gbp_git_line_diff_set_contents (self->diff,
+                                  g_bytes_get_data (bytes, NULL),
+                                  g_bytes_get_size (bytes));
+
+  gbp_git_buffer_change_monitor_queue_update (self, FAST);
+}
+
+static void
+gbp_git_buffer_change_monitor_load_base (GbpGitBufferChangeMonitor *self)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+
+  /* Until the new base arrives, fallback to diffing in the daemon */
+  g_clear_pointer (&self->diff, gbp_git_line_diff_free);
+
+  g_cancellable_cancel (self->base_cancellable);
+  g_clear_object (&self->base_cancellable);
+
+  if (self->proxy == NULL)
+    return;
+
+  self->base_cancellable = g_cancellable_new ();
+
+  ipc_git_change_monitor_call_load_base (self->proxy,
+                                         self->base_cancellable,
+                                         gbp_git_buffer_change_monitor_load_base_cb,
+                                         g_object_ref (self));
+}
+
+static void
+gbp_git_buffer_change_monitor_replace_lines (GbpGitBufferChangeMonitor *self,
+                                             GtkTextBuffer             *buffer,
+                                             guint                      line,
+                                             guint                      n_old_lines,
+                                             guint                      n_new_lines)
+{
+  g_autofree guint *hashes = NULL;
+  GtkTextIter iter;
+
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+  g_assert (self->diff != NULL);
+  g_assert (n_new_lines > 0);
+
+  if (line + n_old_lines > gbp_git_line_diff_get_n_lines (self->diff))
+    {
+      /* We missed an edit somehow, start over */
+      gbp_git_buffer_change_monitor_load_base (self);
+      return;
+    }
+
+  hashes = g_new (guint, n_new_lines);
+  gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
+
+  for (guint i = 0; i < n_new_lines; i++)
+    {
+      g_autofree char *text = NULL;
+      GtkTextIter end = iter;
+
+      if (!gtk_text_iter_ends_line (&end))
+        gtk_text_iter_forward_to_line_end (&end);
+
+      text = gtk_text_iter_get_slice (&iter, &end);
+      hashes[i] = gbp_git_line_diff_hash (text, strlen (text));
+
+      gtk_text_iter_forward_line (&iter);
+    }
+
+  gbp_git_line_diff_replace (self->diff, line, n_old_lines, hashes, n_new_lines);
+  gbp_git_buffer_change_monitor_queue_update (self, FAST);
+}
+
 static void
 gbp_git_buffer_change_monitor_destroy (IdeObject *object)
 {
@@ -111,7 +238,11 @@ gbp_git_buffer_change_monitor_destroy (IdeObject *object)
       g_clear_object (&self->proxy);
     }
 
+  g_cancellable_cancel (self->base_cancellable);
+  g_clear_object (&self->base_cancellable);
+
   g_clear_pointer (&self->cache, line_cache_free);
+  g_clear_pointer (&self->diff, gbp_git_line_diff_free);
   g_clear_handle_id (&self->queued_source, g_source_remove);
 
   IDE_OBJECT_CLASS (gbp_git_buffer_change_monitor_parent_class)->destroy (object);
@@ -136,6 +267,7 @@ gbp_git_buffer_change_monitor_load (IdeBufferChangeMonitor *monitor,
   g_signal_group_set_target (self->buffer_signals, buffer);
 
   gbp_git_buffer_change_monitor_queue_update (self, FAST);
+  gbp_git_buffer_change_monitor_load_base (self);
 }
 
 static void
@@ -149,6 +281,7 @@ gbp_git_buffer_change_monitor_reload (IdeBufferChangeMonitor *monitor)
   g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
 
   gbp_git_buffer_change_monitor_queue_update (self, FAST);
+  gbp_git_buffer_change_monitor_load_base (self);
 
   IDE_EXIT;
 }
@@ -164,6 +297,16 @@ buffer_delete_range_after_cb (GbpGitBufferChangeMonitor *self,
   g_assert (end != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
+  if (self->diff != NULL)
+    {
+      gbp_git_buffer_change_monitor_replace_lines (self,
+                                                   GTK_TEXT_BUFFER (buffer),
+                                                   self->delete_begin_line,
+                                                   self->delete_n_lines,
+                                                   1);
+      return;
+    }
+
   if (self->delete_range_requires_recalculation)
     {
       self->delete_range_requires_recalculation = FALSE;
@@ -186,6 +329,13 @@ buffer_delete_range_cb (GbpGitBufferChangeMonitor *self,
 
   begin_line = gtk_text_iter_get_line (begin);
 
+  if (self->diff != NULL)
+    {
+      self->delete_begin_line = begin_line;
+      self->delete_n_lines = gtk_text_iter_get_line (end) - begin_line + 1;
+      return;
+    }
+
   /*
    * We need to recalculate the diff when text is deleted if:
    *
@@ -215,6 +365,20 @@ recalculate:
   self->delete_range_requires_recalculation = TRUE;
 }
 
+static void
+buffer_insert_text_cb (GbpGitBufferChangeMonitor *self,
+                       GtkTextIter               *location,
+                       gchar                     *text,
+                       gint                       len,
+                       IdeBuffer                 *buffer)
+{
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (location != NULL);
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  self->insert_begin_line = gtk_text_iter_get_line (location);
+}
+
 static void
 buffer_insert_text_after_cb (GbpGitBufferChangeMonitor *self,
                              GtkTextIter               *location,
@@ -229,6 +393,17 @@ buffer_insert_text_after_cb (GbpGitBufferChangeMonitor *self,
   g_assert (text != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
+  /* The line at the insertion point was replaced by the inserted lines */
+  if (self->diff != NULL)
+    {
+      gbp_git_buffer_change_monitor_replace_lines (self,
+                                                   GTK_TEXT_BUFFER (buffer),
+                                                   self->insert_begin_line,
+                                                   1,
+                                                   gtk_text_iter_get_line (location) - self->insert_begin_line + 1);
+      return;
+    }
+
   /*
    * We need to recalculate the diff when text is inserted if:
    *
@@ -352,7 +527,9 @@ vcs_changed_cb (GbpGitBufferChangeMonitor *self,
   g_assert (IDE_IS_BUFFER_CHANGE_MONITOR (self));
   g_assert (IDE_IS_VCS (vcs));
 
+  /* HEAD may have moved, so reload the contents we diff against */
   gbp_git_buffer_change_monitor_queue_update (self, FAST);
+  gbp_git_buffer_change_monitor_load_base (self);
 }
 
 static void
@@ -373,6 +550,11 @@ static void
 gbp_git_buffer_change_monitor_init (GbpGitBufferChangeMonitor *self)
 {
   self->buffer_signals = g_signal_group_new (IDE_TYPE_BUFFER);
+  g_signal_group_connect_object (self->buffer_signals,
+                                 "insert-text",
+                                 G_CALLBACK (buffer_insert_text_cb),
+                                 self,
+                                 G_CONNECT_SWAPPED);
   g_signal_group_connect_object (self->buffer_signals,
                                  "insert-text",
                                  G_CALLBACK (buffer_insert_text_after_cb),
@@ -393,6 +575,11 @@ gbp_git_buffer_change_monitor_init (GbpGitBufferChangeMonitor *self)
                                  G_CALLBACK (buffer_changed_after_cb),
                                  self,
                                  G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+  g_signal_group_connect_object (self->buffer_signals,
+                                 "notify::implicit-trailing-newline",
+                                 G_CALLBACK (gbp_git_buffer_change_monitor_load_base),
+                                 self,
+                                 G_CONNECT_SWAPPED);
 
   self->vcs_signals = g_signal_group_new (IDE_TYPE_VCS);
   g_signal_group_connect_object (self->vcs_signals,
@@ -519,6 +706,19 @@ gbp_git_buffer_change_monitor_wait_async (GbpGitBufferChangeMonitor *self,
   if (ide_task_return_error_if_cancelled (task))
     return;
 
+  /* Edits have already been applied to the diff, so there is nothing to
+   * send to the daemon. Just publish the lines that changed.
+   */
+  if (self->diff != NULL)
+    {
+      g_clear_pointer (&self->cache, line_cache_free);
+      self->not_found = FALSE;
+      self->cache = gbp_git_line_diff_to_cache (self->diff);
+      ide_buffer_change_monitor_emit_changed (IDE_BUFFER_CHANGE_MONITOR (self));
+      ide_task_return_boolean (task, TRUE);
+      return;
+    }
+
   buffer = ide_buffer_change_monitor_get_buffer (IDE_BUFFER_CHANGE_MONITOR (self));
   change_count = ide_buffer_get_change_count (buffer);
 
@@ -527,7 +727,8 @@ gbp_git_buffer_change_monitor_wait_async (GbpGitBufferChangeMonitor *self,
    */
   if (change_count != self->last_change_count)
     {
-      g_autoptr(GBytes) bytes = ide_buffer_dup_content (buffer);
+      g_autoptr(IdeBufferSnapshot) snapshot = ide_buffer_ref_snapshot (buffer);
+      g_autoptr(GBytes) bytes = ide_buffer_snapshot_dup_content (snapshot);
 
       self->last_change_count = change_count;
       ipc_git_change_monitor_call_update_content (self->proxy,
@@ -0,0 +1,468 @@
+/* gbp-git-line-diff.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-git-line-diff"
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gbp-git-line-diff.h"
+
+/*
+ * GbpGitLineDiff diffs the lines of a buffer against the lines of the
+ * file at HEAD using a hash per line.
+ *
+ * The hunks are kept sorted by their position in the buffer. When lines
+ * are replaced, only the hunks touching the edited lines are thrown away
+ * and the diff is recalculated for that window. Lines outside of a hunk
+ * map 1:1 to the base, so the base window can be found by accumulating
+ * the size difference of the hunks that precede it.
+ *
+ * The diff itself is the greedy Myers algorithm after trimming the
+ * common prefix and suffix. If the edit distance grows beyond MAX_COST,
+ * the remaining region is reported as a single changed hunk.
+ */
+
+#define MAX_COST 1024
+
+typedef struct
+{
+  guint old_start;
+  guint old_lines;
+  guint new_start;
+  guint new_lines;
+} Hunk;
+
+struct _GbpGitLineDiff
+{
+  GArray *base;
+  GArray *current;
+  GArray *hunks;
+  guint   trailing_line : 1;
+};
+
+guint
+gbp_git_line_diff_hash (const char *line,
+                        gsize       len)
+{
+  guint hash = 5381;
+
+  /* Ignore the \r of \r\n so that it matches GtkTextBuffer lines */
+  if (len > 0 && line[len - 1] == '\r')
+    len--;
+
+  for (gsize i = 0; i < len; i++)
+    hash = (hash << 5) + hash + (guchar)line[i];
+
+  return hash;
+}
+
+static void
+hash_lines (GArray     *lines,
+            const char *text,
+            gsize       len,
+            gboolean    trailing_line)
+{
+  const char *end = text + len;
+
+  g_array_set_size (lines, 0);
+
+  /* A trailing newline terminates the last line rather than starting an
+   * empty one, so "a\nb\n" and a buffer containing "a\nb" are equal.
+   */
+  while (text < end)
+    {
+      const char *eol = memchr (text, '\n', end - text);
+      guint hash;
+
+      if (eol == NULL)
+        eol = end;
+
+      hash = gbp_git_line_diff_hash (text, eol - text);
+      g_array_append_val (lines, hash);
+
+      text = eol + 1;
+    }
+
+  /* Without an implicit trailing newline, the buffer has an empty line
+   * after the last newline and we need as many lines as the buffer.
+   */
+  if (len == 0 || (trailing_line && end[-1] == '\n'))
+    {
+      guint hash = gbp_git_line_diff_hash ("", 0);
+      g_array_append_val (lines, hash);
+    }
+}
+
+static void
+add_hunk (GArray *hunks,
+          guint   old_start,
+          guint   old_lines,
+          guint   new_start,
+          guint   new_lines)
+{
+  Hunk hunk = { old_start, old_lines, new_start, new_lines };
+
+  if (old_lines > 0 || new_lines > 0)
+    g_array_append_val (hunks, hunk);
+}
+
+static void
+diff_range (const guint *a,
+            guint        a_off,
+            guint        n,
+            const guint *b,
+            guint        b_off,
+            guint        m,
+            GArray      *hunks)
+{
+  g_autofree gboolean *a_changed = NULL;
+  g_autofree gboolean *b_changed = NULL;
+  g_autoptr(GPtrArray) trace = NULL;
+  g_autofree int *v = NULL;
+  guint prefix = 0;
+  guint suffix = 0;
+  guint max_d;
+  guint found = G_MAXUINT;
+  guint i, j;
+  int x, y;
+
+  g_assert (hunks != NULL);
+
+  a += a_off;
+  b += b_off;
+
+  while (prefix < n && prefix < m && a[prefix] == b[prefix])
+    prefix++;
+
+  while (suffix < n - prefix &&
+         suffix < m - prefix &&
+         a[n - suffix - 1] == b[m - suffix - 1])
+    suffix++;
+
+  a += prefix;
+  b += prefix;
+  a_off += prefix;
+  b_off += prefix;
+  n -= prefix + suffix;
+  m -= prefix + suffix;
+
+  if (n == 0 || m == 0)
+    {
+      add_hunk (hunks, a_off, n, b_off, m);
+      return;
+    }
+
+  /* Forward pass, keeping each round of V so that we can backtrack */
+  max_d = MIN (n + m, MAX_COST);
+  v = g_new0 (int, 2 * max_d + 3);
+  trace = g_ptr_array_new_with_free_func (g_free);
+
+#define V(k) v[(int)max_d + 1 + (k)]
+
+  for (guint d = 0; d <= max_d && found == G_MAXUINT; d++)
+    {
+      int *round;
+
+      for (int k = -(int)d; k <= (int)d; k += 2)
+        {
+          if (k == -(int)d || (k != (int)d && V (k - 1) < V (k + 1)))
+            x = V (k + 1);
+          else
+            x = V (k - 1) + 1;
+
+          y = x - k;
+
+          while (x < (int)n && y < (int)m && a[x] == b[y])
+            x++, y++;
+
+          V (k) = x;
+
+          if (x >= (int)n && y >= (int)m)
+            found = d;
+        }
+
+      round = g_memdup2 (&V (-(int)d), sizeof (int) * (2 * d + 1));
+      g_ptr_array_add (trace, round);
+    }
+
+  if (found == G_MAXUINT)
+    {
+      /* Too expensive, just treat the whole region as changed */
+      add_hunk (hunks, a_off, n, b_off, m);
+      return;
+    }
+
+  a_changed = g_new0 (gboolean, n);
+  b_changed = g_new0 (gboolean, m);
+
+  x = n;
+  y = m;
+
+  for (guint d = found; d > 0; d--)
+    {
+      const int *prev = g_ptr_array_index (trace, d - 1);
+      int k = x - y;
+      int prev_k;
+      int prev_x;
+      int prev_y;
+
+#define PREV(k) prev[(k) + (int)(d - 1)]
+
+      if (k == -(int)d || (k != (int)d && PREV (k - 1) < PREV (k + 1)))
+        prev_k = k + 1;
+      else
+        prev_k = k - 1;
+
+#undef PREV
+
+      prev_x = prev[prev_k + (int)(d - 1)];
+      prev_y = prev_x - prev_k;
+
+      if (prev_k == k + 1)
+        b_changed[prev_y] = TRUE;
+      else
+        a_changed[prev_x] = TRUE;
+
+      x = prev_x;
+      y = prev_y;
+    }
+
+#undef V
+
+  /* Matched lines pair up in order, so everything between two matches
+   * becomes a hunk.
+   */
+  i = j = 0;
+
+  while (i < n || j < m)
+    {
+      guint old_start = i;
+      guint new_start = j;
+
+      if (i < n && j < m && !a_changed[i] && !b_changed[j])
+        {
+          i++, j++;
+          continue;
+        }
+
+      while (i < n && a_changed[i])
+        i++;
+
+      while (j < m && b_changed[j])
+        j++;
+
+      add_hunk (hunks, a_off + old_start, i - old_start, b_off + new_start, j - new_start);
+    }
+}
+
+/**
+ * gbp_git_line_diff_new:
+ * @base: the contents of the file at HEAD
+ * @base_len: the length of @base in bytes, which may contain NUL bytes
+ * @trailing_line: if a trailing newline starts an empty line, which is
+ *   the case for buffers without an implicit trailing newline
+ *
+ * Returns: (transfer full): a new #GbpGitLineDiff
+ */
+GbpGitLineDiff *
+gbp_git_line_diff_new (const char *base,
+                       gsize       base_len,
+                       gboolean    trailing_line)
+{
+  GbpGitLineDiff *self;
+
+  g_return_val_if_fail (base != NULL || base_len == 0, NULL);
+
+  self = g_slice_new0 (GbpGitLineDiff);
+  self->base = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->current = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->hunks = g_array_new (FALSE, FALSE, sizeof (Hunk));
+  self->trailing_line = !!trailing_line;
+
+  hash_lines (self->base, base, base_len, self->trailing_line);
+
+  return self;
+}
+
+void
+gbp_git_line_diff_free (GbpGitLineDiff *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->base, g_array_unref);
+      g_clear_pointer (&self->current, g_array_unref);
+      g_clear_pointer (&self->hunks, g_array_unref);
+      g_slice_free (GbpGitLineDiff, self);
+    }
+}
+
+void
+gbp_git_line_diff_set_contents (GbpGitLineDiff *self,
+                                const char     *contents,
+                                gsize           contents_len)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (contents != NULL || contents_len == 0);
+
+  hash_lines (self->current, contents, contents_len, self->trailing_line);
+
+  g_array_set_size (self->hunks, 0);
+  diff_range ((const guint *)(gpointer)self->base->data, 0, self->base->len,
+              (const guint *)(gpointer)self->current->data, 0, self->current->len,
+              self->hunks);
+}
+
+void
+gbp_git_line_diff_replace (GbpGitLineDiff *self,
+                           guint           line,
+                           guint           n_old_lines,
+                           const guint    *hashes,
+                           guint           n_new_lines)
+{
+  g_autoptr(GArray) window = NULL;
+  guint first = G_MAXUINT;
+  guint last = 0;
+  guint new_begin;
+  guint new_end;
+  guint old_begin;
+  guint old_end;
+  gint delta = 0;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (hashes != NULL || n_new_lines == 0);
+  g_return_if_fail (line + n_old_lines <= self->current->len);
+
+  new_begin = line;
+  new_end = line + n_old_lines;
+
+  /* Find the hunks touching the edited lines (in the coordinates from
+   * before the edit) and grow the window to include them.
+   */
+  for (guint i = 0; i < self->hunks->len; i++)
+    {
+      const Hunk *hunk = &g_array_index (self->hunks, Hunk, i);
+
+      if (hunk->new_start + hunk->new_lines < line)
+        {
+          delta += (gint)hunk->old_lines - (gint)hunk->new_lines;
+          continue;
+        }
+
+      if (hunk->new_start > line + n_old_lines)
+        break;
+
+      if (first == G_MAXUINT)
+        first = i;
+      last = i;
+
+      new_begin = MIN (new_begin, hunk->new_start);
+      new_end = MAX (new_end, hunk->new_start + hunk->new_lines);
+    }
+
+  old_begin = new_begin + delta;
+  old_end = new_end + delta;
+
+  if (first != G_MAXUINT)
+    {
+      for (guint i = first; i <= last; i++)
+        {
+          const Hunk *hunk = &g_array_index (self->hunks, Hunk, i);
+          old_end += hunk->old_lines;
+          old_end -= hunk->new_lines;
+        }
+
+      g_array_remove_range (self->hunks, first, last - first + 1);
+    }
+  else
+    {
+      /* Insert position for the new hunks */
+      first = 0;
+      while (first < self->hunks->len &&
+             g_array_index (self->hunks, Hunk, first).new_start < new_begin)
+        first++;
+    }
+
+  g_assert (old_end <= self->base->len);
+
+  /* Apply the edit to our line hashes */
+  g_array_remove_range (self->current, line, n_old_lines);
+  g_array_insert_vals (self->current, line, hashes, n_new_lines);
+
+  /* Shift the hunks after the window */
+  for (guint i = first; i < self->hunks->len; i++)
+    {
+      Hunk *hunk = &g_array_index (self->hunks, Hunk, i);
+      hunk->new_start = hunk->new_start + n_new_lines - n_old_lines;
+    }
+
+  new_end = new_end + n_new_lines - n_old_lines;
+
+  window = g_array_new (FALSE, FALSE, sizeof (Hunk));
+  diff_range ((const guint *)(gpointer)self->base->data, old_begin, old_end - old_begin,
+              (const guint *)(gpointer)self->current->data, new_begin, new_end - new_begin,
+              window);
+
+  if (window->len > 0)
+    g_array_insert_vals (self->hunks, first, window->data, window->len);
+}
+
+guint
+gbp_git_line_diff_get_n_hunks (const GbpGitLineDiff *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->hunks->len;
+}
+
+guint
+gbp_git_line_diff_get_n_lines (const GbpGitLineDiff *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->current->len;
+}
+
+LineCache *
+gbp_git_line_diff_to_cache (const GbpGitLineDiff *self)
+{
+  LineCache *cache;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  cache = line_cache_new ();
+
+  for (guint i = 0; i < self->hunks->len; i++)
+    {
+      const Hunk *hunk = &g_array_index (self->hunks, Hunk, i);
+
+      /* Convert to the 1-based positions used by git, where a
+       * deletion is positioned at the preceding line.
+       */
+      line_cache_mark_hunk (cache,
+                            hunk->old_start + 1,
+                            hunk->old_lines,
+                            hunk->new_lines ? hunk->new_start + 1 : hunk->new_start,
+                            hunk->new_lines);
+    }
+
+  return cache;
+}
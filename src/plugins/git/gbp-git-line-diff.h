@@ -0,0 +1,51 @@
+/* gbp-git-line-diff.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "daemon/line-cache.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GbpGitLineDiff GbpGitLineDiff;
+
+GbpGitLineDiff *gbp_git_line_diff_new          (const char           *base,
+                                                gsize                 base_len,
+                                                gboolean              trailing_line);
+void            gbp_git_line_diff_free         (GbpGitLineDiff       *self);
+void            gbp_git_line_diff_set_contents (GbpGitLineDiff       *self,
+                                                const char           *contents,
+                                                gsize                 contents_len);
+void            gbp_git_line_diff_replace      (GbpGitLineDiff       *self,
+                                                guint                 line,
+                                                guint                 n_old_lines,
+                                                const guint          *hashes,
+                                                guint                 n_new_lines);
+guint           gbp_git_line_diff_get_n_hunks  (const GbpGitLineDiff *self);
+guint           gbp_git_line_diff_get_n_lines  (const GbpGitLineDiff *self);
+LineCache      *gbp_git_line_diff_to_cache     (const GbpGitLineDiff *self);
+guint           gbp_git_line_diff_hash         (const char           *line,
+                                                gsize                 len);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GbpGitLineDiff, gbp_git_line_diff_free)
+
+G_END_DECLS
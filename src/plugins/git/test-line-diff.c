@@ -0,0 +1,145 @@
+/* test-line-diff.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "gbp-git-line-diff.h"
+
+#define BASE "a\nb\nc\nd\ne\n"
+
+static guint
+hash (const char *str)
+{
+  return gbp_git_line_diff_hash (str, strlen (str));
+}
+
+static void
+test_line_diff_basic (void)
+{
+  g_autoptr(GbpGitLineDiff) diff = gbp_git_line_diff_new (BASE, strlen (BASE), FALSE);
+  g_autoptr(LineCache) cache = NULL;
+
+  /* Implicit trailing newline must not produce a change */
+  gbp_git_line_diff_set_contents (diff, "a\nb\nc\nd\ne", 9);
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 5);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 0);
+
+  gbp_git_line_diff_set_contents (diff, "a\nB\nc\nd\ne\nf\n", 12);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 2);
+
+  cache = gbp_git_line_diff_to_cache (diff);
+  g_assert_cmpint (line_cache_get_mark (cache, 0), ==, 0);
+  g_assert_cmpint (line_cache_get_mark (cache, 1), ==, LINE_MARK_CHANGED);
+  g_assert_cmpint (line_cache_get_mark (cache, 5), ==, LINE_MARK_ADDED);
+}
+
+static void
+test_line_diff_replace (void)
+{
+  g_autoptr(GbpGitLineDiff) diff = gbp_git_line_diff_new (BASE, strlen (BASE), FALSE);
+  g_autoptr(LineCache) cache = NULL;
+  guint hashes[3];
+
+  gbp_git_line_diff_set_contents (diff, BASE, strlen (BASE));
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 0);
+
+  /* Change "c" into "x\ny\nc" */
+  hashes[0] = hash ("x");
+  hashes[1] = hash ("y");
+  hashes[2] = hash ("c");
+  gbp_git_line_diff_replace (diff, 2, 1, hashes, 3);
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 7);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 1);
+
+  cache = gbp_git_line_diff_to_cache (diff);
+  g_assert_cmpint (line_cache_get_mark (cache, 1), ==, 0);
+  g_assert_cmpint (line_cache_get_mark (cache, 2), ==, LINE_MARK_ADDED);
+  g_assert_cmpint (line_cache_get_mark (cache, 3), ==, LINE_MARK_ADDED);
+  g_assert_cmpint (line_cache_get_mark (cache, 4), ==, 0);
+  g_clear_pointer (&cache, line_cache_free);
+
+  /* Remove "a", which shifts the existing hunk */
+  hashes[0] = hash ("b");
+  gbp_git_line_diff_replace (diff, 0, 2, hashes, 1);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 2);
+
+  cache = gbp_git_line_diff_to_cache (diff);
+  g_assert_cmpint (line_cache_get_mark (cache, 0), ==, LINE_MARK_PREVIOUS_REMOVED);
+  g_assert_cmpint (line_cache_get_mark (cache, 1), ==, LINE_MARK_ADDED);
+  g_assert_cmpint (line_cache_get_mark (cache, 2), ==, LINE_MARK_ADDED);
+  g_clear_pointer (&cache, line_cache_free);
+
+  /* Undo everything and we should be back to no changes */
+  hashes[0] = hash ("a");
+  hashes[1] = hash ("b");
+  gbp_git_line_diff_replace (diff, 0, 1, hashes, 2);
+  hashes[0] = hash ("c");
+  gbp_git_line_diff_replace (diff, 2, 3, hashes, 1);
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 5);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 0);
+}
+
+static void
+test_line_diff_nul (void)
+{
+  static const char base[] = "a\0b\nc\n";
+  g_autoptr(GbpGitLineDiff) diff = gbp_git_line_diff_new (base, sizeof base - 1, FALSE);
+
+  /* Everything after the NUL must be part of the base too */
+  gbp_git_line_diff_set_contents (diff, base, sizeof base - 1);
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 2);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 0);
+}
+
+static void
+test_line_diff_trailing_line (void)
+{
+  g_autoptr(GbpGitLineDiff) diff = gbp_git_line_diff_new (BASE, strlen (BASE), TRUE);
+  guint hashes[1];
+
+  /* Without an implicit trailing newline the buffer has an empty last
+   * line, which must be counted so that edits to it are in range.
+   */
+  gbp_git_line_diff_set_contents (diff, BASE, strlen (BASE));
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 6);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 0);
+
+  hashes[0] = hash ("f");
+  gbp_git_line_diff_replace (diff, 5, 1, hashes, 1);
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 6);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 1);
+
+  /* Removing the trailing newline is a change too */
+  gbp_git_line_diff_set_contents (diff, BASE, strlen (BASE) - 1);
+  g_assert_cmpint (gbp_git_line_diff_get_n_lines (diff), ==, 5);
+  g_assert_cmpint (gbp_git_line_diff_get_n_hunks (diff), ==, 1);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Git/LineDiff/basic", test_line_diff_basic);
+  g_test_add_func ("/Git/LineDiff/replace", test_line_diff_replace);
+  g_test_add_func ("/Git/LineDiff/nul", test_line_diff_nul);
+  g_test_add_func ("/Git/LineDiff/trailing-line", test_line_diff_trailing_line);
+  return g_test_run ();
+}
@@ -29,16 +29,37 @@
 #include <libide-foundry.h>
 #include <libide-threading.h>
 
-#include "gbp-meson-build-system.h"
+#include "gbp-meson-build-target.h"
 #include "gbp-meson-introspection.h"
 
+/*
+ * Rather than running `meson introspect` after every configure, we read
+ * the intro-*.json files meson writes into meson-info/ from a worker
+ * thread and convert them into a single GVariant. That model is keyed by
+ * the modification time of each file and saved in the build directory so
+ * that reopening a project does not need to parse any JSON at all.
+ *
+ * Run commands, tests and build targets are all produced from the model.
+ */
+
+#define MODEL_VERSION 1
+#define MODEL_TYPE    "(ua{sx}(sss)a(sssasasb)a(sasasass))"
+#define CACHE_NAME    ".gnome-builder-introspection"
+
+static const char *intro_files[] = {
+  "intro-projectinfo.json",
+  "intro-targets.json",
+  "intro-tests.json",
+};
+
 struct _GbpMesonIntrospection
 {
   IdePipelineStage parent_instance;
 
   IdePipeline *pipeline;
 
-  char *etag;
+  /* Compact model of meson-info/intro-*.json, see MODEL_TYPE */
+  GVariant *model;
 
   GListStore *run_commands;
 
@@ -46,7 +67,6 @@ struct _GbpMesonIntrospection
   char *subproject_dir;
   char *version;
 
-  guint loaded : 1;
   guint has_built_once : 1;
 };
 
@@ -182,336 +202,429 @@ get_environ_member (JsonObject   *object,
   return FALSE;
 }
 
-static void
-gbp_meson_introspection_load_buildoptions (GbpMesonIntrospection *self,
-                                           JsonArray             *buildoptions)
+
+static GVariant *
+strv_to_variant (char **strv)
 {
-  IDE_ENTRY;
+  return g_variant_new_strv ((const char * const *)strv, strv ? -1 : 0);
+}
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (buildoptions != NULL);
+static JsonNode *
+load_intro_file (const char *builddir,
+                 const char *name)
+{
+  g_autofree char *path = g_build_filename (builddir, "meson-info", name, NULL);
+  g_autoptr(JsonParser) parser = json_parser_new ();
+  g_autoptr(GError) error = NULL;
+  JsonNode *root;
 
-  IDE_EXIT;
+  if (!json_parser_load_from_mapped_file (parser, path, &error))
+    {
+      g_debug ("Failed to load %s: %s", path, error->message);
+      return NULL;
+    }
+
+  if (!(root = json_parser_get_root (parser)))
+    return NULL;
+
+  return json_node_ref (root);
 }
 
-static void
-gbp_meson_introspection_load_projectinfo (GbpMesonIntrospection *self,
-                                          JsonObject            *projectinfo)
+static GVariant *
+load_projectinfo (const char *builddir)
 {
-  IDE_ENTRY;
-
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (projectinfo != NULL);
+  g_autoptr(JsonNode) root = load_intro_file (builddir, "intro-projectinfo.json");
+  g_autofree char *version = NULL;
+  g_autofree char *descriptive_name = NULL;
+  g_autofree char *subproject_dir = NULL;
+  JsonObject *obj;
 
-  get_string_member (projectinfo, "version", &self->version);
-  get_string_member (projectinfo, "descriptive_name", &self->descriptive_name);
-  get_string_member (projectinfo, "subproject_dir", &self->subproject_dir);
+  if (root != NULL &&
+      JSON_NODE_HOLDS_OBJECT (root) &&
+      (obj = json_node_get_object (root)))
+    {
+      get_string_member (obj, "version", &version);
+      get_string_member (obj, "descriptive_name", &descriptive_name);
+      get_string_member (obj, "subproject_dir", &subproject_dir);
+    }
 
-  IDE_EXIT;
+  return g_variant_new ("(sss)",
+                        version ? version : "",
+                        descriptive_name ? descriptive_name : "",
+                        subproject_dir ? subproject_dir : "");
 }
 
-static void
-gbp_meson_introspection_load_test (GbpMesonIntrospection *self,
-                                   JsonObject            *test)
+static GVariant *
+load_targets (const char *builddir)
 {
-  g_autoptr(IdeRunCommand) run_command = NULL;
-  g_auto(GStrv) cmd = NULL;
-  g_auto(GStrv) env = NULL;
-  g_auto(GStrv) suite = NULL;
-  g_autofree char *name = NULL;
-  g_autofree char *workdir = NULL;
-  g_autofree char *id = NULL;
+  g_autoptr(JsonNode) root = load_intro_file (builddir, "intro-targets.json");
+  GVariantBuilder builder;
+  JsonArray *ar;
 
-  IDE_ENTRY;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sssasasb)"));
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (test != NULL);
+  if (root != NULL &&
+      JSON_NODE_HOLDS_ARRAY (root) &&
+      (ar = json_node_get_array (root)))
+    {
+      guint length = json_array_get_length (ar);
 
-  get_strv_member (test, "cmd", &cmd);
-  get_strv_member (test, "suite", &suite);
-  get_environ_member (test, "env", &env);
-  get_string_member (test, "name", &name);
-  get_string_member (test, "workdir", &workdir);
+      for (guint i = 0; i < length; i++)
+        {
+          JsonNode *node = json_array_get_element (ar, i);
+          g_autofree char *id = NULL;
+          g_autofree char *name = NULL;
+          g_autofree char *type = NULL;
+          g_auto(GStrv) filename = NULL;
+          g_auto(GStrv) install_filename = NULL;
+          gboolean installed = FALSE;
+          JsonObject *obj;
 
-  id = g_strdup_printf ("meson:%s", name);
+          if (!JSON_NODE_HOLDS_OBJECT (node) || !(obj = json_node_get_object (node)))
+            continue;
 
-  run_command = ide_run_command_new ();
-  ide_run_command_set_id (run_command, id);
-  ide_run_command_set_kind (run_command, IDE_RUN_COMMAND_KIND_TEST);
-  ide_run_command_set_display_name (run_command, name);
-  ide_run_command_set_environ (run_command, (const char * const *)env);
-  ide_run_command_set_argv (run_command, (const char * const *)cmd);
-  ide_run_command_set_cwd (run_command, workdir);
-  ide_run_command_set_can_default (run_command, FALSE);
+          get_string_member (obj, "id", &id);
+          get_string_member (obj, "name", &name);
+          get_string_member (obj, "type", &type);
+          get_strv_member (obj, "filename", &filename);
+          get_strv_member (obj, "install_filename", &install_filename);
+          get_bool_member (obj, "installed", &installed);
 
-  g_list_store_append (self->run_commands, run_command);
+          if (name == NULL || type == NULL)
+            continue;
 
-  IDE_EXIT;
+          g_variant_builder_add (&builder, "(sss@as@asb)",
+                                 id ? id : "",
+                                 name,
+                                 type,
+                                 strv_to_variant (filename),
+                                 strv_to_variant (install_filename),
+                                 installed);
+        }
+    }
+
+  return g_variant_builder_end (&builder);
 }
 
-static void
-gbp_meson_introspection_load_tests (GbpMesonIntrospection *self,
-                                    JsonArray             *tests)
+static GVariant *
+load_tests (const char *builddir)
 {
-  guint n_items;
+  g_autoptr(JsonNode) root = load_intro_file (builddir, "intro-tests.json");
+  GVariantBuilder builder;
+  JsonArray *ar;
 
-  IDE_ENTRY;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sasasass)"));
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (tests != NULL);
+  if (root != NULL &&
+      JSON_NODE_HOLDS_ARRAY (root) &&
+      (ar = json_node_get_array (root)))
+    {
+      guint length = json_array_get_length (ar);
+
+      for (guint i = 0; i < length; i++)
+        {
+          JsonNode *node = json_array_get_element (ar, i);
+          g_autofree char *name = NULL;
+          g_autofree char *workdir = NULL;
+          g_auto(GStrv) cmd = NULL;
+          g_auto(GStrv) env = NULL;
+          g_auto(GStrv) suite = NULL;
+          JsonObject *obj;
+
+          if (!JSON_NODE_HOLDS_OBJECT (node) || !(obj = json_node_get_object (node)))
+            continue;
 
-  n_items = json_array_get_length (tests);
+          get_string_member (obj, "name", &name);
+          get_string_member (obj, "workdir", &workdir);
+          get_strv_member (obj, "cmd", &cmd);
+          get_strv_member (obj, "suite", &suite);
+          get_environ_member (obj, "env", &env);
 
-  for (guint i = 0; i < n_items; i++)
-    {
-      JsonNode *node = json_array_get_element (tests, i);
-      JsonObject *obj;
+          if (name == NULL)
+            continue;
 
-      if (node != NULL &&
-          JSON_NODE_HOLDS_OBJECT (node) &&
-          (obj = json_node_get_object (node)))
-        gbp_meson_introspection_load_test (self, obj);
+          g_variant_builder_add (&builder, "(s@as@ass@as)",
+                                 name,
+                                 strv_to_variant (cmd),
+                                 strv_to_variant (env),
+                                 workdir ? workdir : "",
+                                 strv_to_variant (suite));
+        }
     }
 
-  IDE_EXIT;
+  return g_variant_builder_end (&builder);
 }
 
-static void
-gbp_meson_introspection_load_benchmarks (GbpMesonIntrospection *self,
-                                         JsonArray             *benchmarks)
+/*
+ * The key for the model is the modification time of each introspection
+ * file which meson writes when (re)configuring. Missing files are -1.
+ */
+static GVariant *
+get_intro_mtimes (const char *builddir)
 {
-  IDE_ENTRY;
+  GVariantBuilder builder;
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (benchmarks != NULL);
+  g_assert (builddir != NULL);
 
-  IDE_EXIT;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sx}"));
+
+  for (guint i = 0; i < G_N_ELEMENTS (intro_files); i++)
+    {
+      g_autofree char *path = g_build_filename (builddir, "meson-info", intro_files[i], NULL);
+      g_autoptr(GFile) file = g_file_new_for_path (path);
+      g_autoptr(GFileInfo) info = NULL;
+      gint64 mtime = -1;
+
+      if ((info = g_file_query_info (file,
+                                     G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                     G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                     G_FILE_QUERY_INFO_NONE,
+                                     NULL, NULL)))
+        mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+              + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+      g_variant_builder_add (&builder, "{sx}", intro_files[i], mtime);
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static GVariant *
+load_cached_model (const char *path,
+                   GVariant   *mtimes)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GVariant) cached_mtimes = NULL;
+  g_autoptr(GVariant) model = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  guint version = 0;
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  model = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (MODEL_TYPE), bytes, FALSE));
+
+  g_variant_get_child (model, 0, "u", &version);
+  cached_mtimes = g_variant_get_child_value (model, 1);
+
+  if (version != MODEL_VERSION || !g_variant_equal (cached_mtimes, mtimes))
+    return NULL;
+
+  return g_steal_pointer (&model);
 }
 
 static void
-gbp_meson_introspection_load_targets (GbpMesonIntrospection *self,
-                                      JsonArray             *targets)
+gbp_meson_introspection_load_worker (IdeTask      *task,
+                                     gpointer      source_object,
+                                     gpointer      task_data,
+                                     GCancellable *cancellable)
 {
-  guint length;
+  const char *builddir = task_data;
+  g_autoptr(GVariant) mtimes = NULL;
+  g_autoptr(GVariant) model = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *cache_path = NULL;
+  g_autofree char *meson_info = NULL;
 
   IDE_ENTRY;
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (targets != NULL);
+  g_assert (!IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TASK (task));
+  g_assert (GBP_IS_MESON_INTROSPECTION (source_object));
+  g_assert (builddir != NULL);
 
-  length = json_array_get_length (targets);
+  /* Get mtimes before parsing so that a concurrent reconfigure results
+   * in reloading the next time around.
+   */
+  meson_info = g_build_filename (builddir, "meson-info", NULL);
 
-  for (guint i = 0; i < length; i++)
+  if (!g_file_test (meson_info, G_FILE_TEST_IS_DIR))
     {
-      JsonNode *node = json_array_get_element (targets, i);
-      g_autofree char *id = NULL;
-      g_autofree char *name = NULL;
-      g_autofree char *type = NULL;
-      JsonObject *obj;
+      ide_task_return_new_error (task,
+                                 G_IO_ERROR,
+                                 G_IO_ERROR_NOT_FOUND,
+                                 "Project has not been configured");
+      IDE_EXIT;
+    }
 
-      if (!JSON_NODE_HOLDS_OBJECT (node) || !(obj = json_node_get_object (node)))
-        continue;
+  mtimes = get_intro_mtimes (builddir);
+  cache_path = g_build_filename (builddir, CACHE_NAME, NULL);
 
-      get_string_member (obj, "id", &id);
-      get_string_member (obj, "name", &name);
-      get_string_member (obj, "type", &type);
+  if ((model = load_cached_model (cache_path, mtimes)))
+    {
+      ide_task_return_pointer (task, g_steal_pointer (&model), g_variant_unref);
+      IDE_EXIT;
+    }
 
-      if (ide_str_equal0 (type, "executable") || ide_str_equal0 (type, "custom"))
-        {
-          g_auto(GStrv) filename = NULL;
-          gboolean installed = FALSE;
+  model = g_variant_new ("(u@a{sx}@(sss)@a(sssasasb)@a(sasasass))",
+                         MODEL_VERSION,
+                         mtimes,
+                         load_projectinfo (builddir),
+                         load_targets (builddir),
+                         load_tests (builddir));
+  g_variant_ref_sink (model);
 
-          get_strv_member (obj, "filename", &filename);
-          get_bool_member (obj, "installed", &installed);
+  bytes = g_variant_get_data_as_bytes (model);
 
-          if (!ide_str_empty0 (filename))
-            {
-              g_autoptr(IdeRunCommand) run_command = NULL;
-              g_auto(GStrv) install_filename = NULL;
-              g_autofree char *install_dir = NULL;
-
-              if (get_strv_member (obj, "install_filename", &install_filename) &&
-                  install_filename != NULL &&
-                  install_filename[0] != NULL)
-                install_dir = g_path_get_dirname (install_filename[0]);
-
-              /* Ignore custom unless it's installed to somewhere/bin/ */
-              if (ide_str_equal0 (type, "custom") &&
-                  (install_dir == NULL || !g_str_has_suffix (install_dir, "/bin")))
-                continue;
-
-              run_command = ide_run_command_new ();
-
-              /* Setup basics for run command information */
-              ide_run_command_set_kind (run_command, IDE_RUN_COMMAND_KIND_UTILITY);
-              ide_run_command_set_id (run_command, id);
-              ide_run_command_set_display_name (run_command, name);
-
-              /* Only allow automatic discovery if it's installed */
-              ide_run_command_set_can_default (run_command, installed);
-
-              /* Use installed path if it's provided. */
-              if (install_filename != NULL && install_filename[0] != NULL)
-                ide_run_command_set_argv (run_command, IDE_STRV_INIT (install_filename[0]));
-              else
-                ide_run_command_set_argv (run_command, IDE_STRV_INIT (filename[0]));
-
-              /* Lower priority for any executable not installed to somewhere/bin/ */
-              if (install_dir != NULL && g_str_has_suffix (install_dir, "/bin"))
-                ide_run_command_set_priority (run_command, 0);
-              else
-                ide_run_command_set_priority (run_command, 1000);
-
-              g_list_store_append (self->run_commands, run_command);
-            }
-        }
-    }
+  if (!g_file_set_contents (cache_path,
+                            g_bytes_get_data (bytes, NULL),
+                            g_bytes_get_size (bytes),
+                            &error))
+    g_debug ("Failed to cache introspection: %s", error->message);
+
+  ide_task_return_pointer (task, g_steal_pointer (&model), g_variant_unref);
 
   IDE_EXIT;
 }
 
 static void
-gbp_meson_introspection_load_installed (GbpMesonIntrospection *self,
-                                        JsonObject            *installed)
+gbp_meson_introspection_apply (GbpMesonIntrospection *self,
+                               GVariant              *model)
 {
+  g_autoptr(GVariant) targets = NULL;
+  g_autoptr(GVariant) tests = NULL;
+  GVariantIter iter;
+  const char *name;
+  const char *workdir;
+  const char *id;
+  const char *type;
+  g_autofree const char **cmd = NULL;
+  g_autofree const char **env = NULL;
+  g_autofree const char **suite = NULL;
+  g_autofree const char **filename = NULL;
+  g_autofree const char **install_filename = NULL;
+  gboolean installed;
+
   IDE_ENTRY;
 
+  g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (installed != NULL);
+  g_assert (model != NULL);
 
-  IDE_EXIT;
-}
-
-static char *
-get_current_etag (IdePipeline *pipeline)
-{
-  g_autofree char *build_dot_ninja = NULL;
-  g_autoptr(GFileInfo) info = NULL;
-  g_autoptr(GFile) file = NULL;
+  g_clear_pointer (&self->model, g_variant_unref);
+  self->model = g_variant_ref (model);
 
-  g_assert (IDE_IS_PIPELINE (pipeline));
+  g_clear_pointer (&self->version, g_free);
+  g_clear_pointer (&self->descriptive_name, g_free);
+  g_clear_pointer (&self->subproject_dir, g_free);
 
-  build_dot_ninja = ide_pipeline_build_builddir_path (pipeline, "build.ninja", NULL);
-  file = g_file_new_for_path (build_dot_ninja);
-  info = g_file_query_info (file,
-                            G_FILE_ATTRIBUTE_ETAG_VALUE,
-                            G_FILE_QUERY_INFO_NONE,
-                            NULL, NULL);
+  g_variant_get_child (model, 2, "(sss)",
+                       &self->version,
+                       &self->descriptive_name,
+                       &self->subproject_dir);
 
-  if (info == NULL)
-    return NULL;
+  g_list_store_remove_all (self->run_commands);
 
-  return g_strdup (g_file_info_get_etag (info));
-}
+  tests = g_variant_get_child_value (model, 4);
+  g_variant_iter_init (&iter, tests);
+  while (g_variant_iter_next (&iter, "(&s^a&s^a&s&s^a&s)", &name, &cmd, &env, &workdir, &suite))
+    {
+      g_autoptr(IdeRunCommand) run_command = ide_run_command_new ();
+      g_autofree char *test_id = g_strdup_printf ("meson:%s", name);
+
+      ide_run_command_set_id (run_command, test_id);
+      ide_run_command_set_kind (run_command, IDE_RUN_COMMAND_KIND_TEST);
+      ide_run_command_set_display_name (run_command, name);
+      ide_run_command_set_environ (run_command, (const char * const *)env);
+      ide_run_command_set_argv (run_command, (const char * const *)cmd);
+      ide_run_command_set_cwd (run_command, workdir[0] ? workdir : NULL);
+      ide_run_command_set_can_default (run_command, FALSE);
+
+      g_list_store_append (self->run_commands, run_command);
+
+      g_clear_pointer (&cmd, g_free);
+      g_clear_pointer (&env, g_free);
+      g_clear_pointer (&suite, g_free);
+    }
 
-static void
-gbp_meson_introspection_query (IdePipelineStage *stage,
-                               IdePipeline      *pipeline,
-                               GPtrArray        *targets,
-                               GCancellable     *cancellable)
-{
-  GbpMesonIntrospection *self = (GbpMesonIntrospection *)stage;
-  g_autofree char *etag = NULL;
+  targets = g_variant_get_child_value (model, 3);
+  g_variant_iter_init (&iter, targets);
+  while (g_variant_iter_next (&iter, "(&s&s&s^a&s^a&sb)", &id, &name, &type, &filename, &install_filename, &installed))
+    {
+      g_autoptr(IdeRunCommand) run_command = NULL;
+      g_autofree char *install_dir = NULL;
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (IDE_IS_PIPELINE (pipeline));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+      if (!ide_str_equal0 (type, "executable") && !ide_str_equal0 (type, "custom"))
+        goto next;
 
-  etag = get_current_etag (pipeline);
+      if (filename[0] == NULL || filename[0][0] == 0)
+        goto next;
 
-  ide_pipeline_stage_set_completed (stage,
-                                    ide_str_equal0 (etag, self->etag));
-}
+      if (install_filename[0] != NULL)
+        install_dir = g_path_get_dirname (install_filename[0]);
 
-static void
-gbp_meson_introspection_load_json (GbpMesonIntrospection *self,
-                                   JsonObject            *root)
-{
-  JsonNode *member;
+      /* Ignore custom unless it's installed to somewhere/bin/ */
+      if (ide_str_equal0 (type, "custom") &&
+          (install_dir == NULL || !g_str_has_suffix (install_dir, "/bin")))
+        goto next;
 
-  IDE_ENTRY;
+      run_command = ide_run_command_new ();
 
-  g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (root != NULL);
-
-  if (json_object_has_member (root, "buildoptions") &&
-      (member = json_object_get_member (root, "buildoptions")) &&
-      JSON_NODE_HOLDS_ARRAY (member))
-    gbp_meson_introspection_load_buildoptions (self, json_node_get_array (member));
-
-  if (json_object_has_member (root, "projectinfo") &&
-      (member = json_object_get_member (root, "projectinfo")) &&
-      JSON_NODE_HOLDS_OBJECT (member))
-    gbp_meson_introspection_load_projectinfo (self, json_node_get_object (member));
-
-  if (json_object_has_member (root, "tests") &&
-      (member = json_object_get_member (root, "tests")) &&
-      JSON_NODE_HOLDS_ARRAY (member))
-    gbp_meson_introspection_load_tests (self, json_node_get_array (member));
-
-  if (json_object_has_member (root, "benchmarks") &&
-      (member = json_object_get_member (root, "benchmarks")) &&
-      JSON_NODE_HOLDS_ARRAY (member))
-    gbp_meson_introspection_load_benchmarks (self, json_node_get_array (member));
-
-  if (json_object_has_member (root, "installed") &&
-      (member = json_object_get_member (root, "installed")) &&
-      JSON_NODE_HOLDS_OBJECT (member))
-    gbp_meson_introspection_load_installed (self, json_node_get_object (member));
-
-  if (json_object_has_member (root, "targets") &&
-      (member = json_object_get_member (root, "targets")) &&
-      JSON_NODE_HOLDS_ARRAY (member))
-    gbp_meson_introspection_load_targets (self, json_node_get_array (member));
+      /* Setup basics for run command information */
+      ide_run_command_set_kind (run_command, IDE_RUN_COMMAND_KIND_UTILITY);
+      ide_run_command_set_id (run_command, id);
+      ide_run_command_set_display_name (run_command, name);
 
-  IDE_EXIT;
-}
+      /* Only allow automatic discovery if it's installed */
+      ide_run_command_set_can_default (run_command, installed);
 
-static void
-gbp_meson_introspection_load_stream_cb (GObject      *object,
-                                        GAsyncResult *result,
-                                        gpointer      user_data)
-{
-  JsonParser *parser = (JsonParser *)object;
-  GbpMesonIntrospection *self;
-  g_autoptr(IdeTask) task = user_data;
-  g_autoptr(GError) error = NULL;
-  const char *etag;
-  JsonObject *obj;
-  JsonNode *root;
+      /* Use installed path if it's provided. */
+      if (install_filename[0] != NULL)
+        ide_run_command_set_argv (run_command, IDE_STRV_INIT (install_filename[0]));
+      else
+        ide_run_command_set_argv (run_command, IDE_STRV_INIT (filename[0]));
 
-  IDE_ENTRY;
+      /* Lower priority for any executable not installed to somewhere/bin/ */
+      if (install_dir != NULL && g_str_has_suffix (install_dir, "/bin"))
+        ide_run_command_set_priority (run_command, 0);
+      else
+        ide_run_command_set_priority (run_command, 1000);
 
-  g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (JSON_IS_PARSER (parser));
-  g_assert (G_IS_ASYNC_RESULT (result));
-  g_assert (IDE_IS_TASK (task));
+      g_list_store_append (self->run_commands, run_command);
 
-  if (!json_parser_load_from_stream_finish (parser, result, &error))
-    {
-      ide_task_return_error (task, g_steal_pointer (&error));
-      IDE_EXIT;
+    next:
+      g_clear_pointer (&filename, g_free);
+      g_clear_pointer (&install_filename, g_free);
     }
 
-  self = ide_task_get_source_object (task);
-  etag = ide_task_get_task_data (task);
+  IDE_EXIT;
+}
+
+static gboolean
+gbp_meson_introspection_is_current (GbpMesonIntrospection *self,
+                                    IdePipeline           *pipeline)
+{
+  g_autoptr(GVariant) loaded = NULL;
+  g_autoptr(GVariant) mtimes = NULL;
 
   g_assert (GBP_IS_MESON_INTROSPECTION (self));
-  g_assert (etag != NULL);
+  g_assert (IDE_IS_PIPELINE (pipeline));
 
-  /* Clear all of our previously loaded state */
-  g_set_str (&self->etag, etag);
-  g_list_store_remove_all (self->run_commands);
+  if (self->model == NULL)
+    return FALSE;
 
-  if ((root = json_parser_get_root (parser)) &&
-      JSON_NODE_HOLDS_OBJECT (root) &&
-      (obj = json_node_get_object (root)))
-    gbp_meson_introspection_load_json (self, obj);
+  loaded = g_variant_get_child_value (self->model, 1);
+  mtimes = get_intro_mtimes (ide_pipeline_get_builddir (pipeline));
 
-  ide_task_return_boolean (task, TRUE);
+  return g_variant_equal (loaded, mtimes);
+}
 
-  IDE_EXIT;
+static void
+gbp_meson_introspection_query (IdePipelineStage *stage,
+                               IdePipeline      *pipeline,
+                               GPtrArray        *targets,
+                               GCancellable     *cancellable)
+{
+  GbpMesonIntrospection *self = (GbpMesonIntrospection *)stage;
+
+  g_assert (GBP_IS_MESON_INTROSPECTION (self));
+  g_assert (IDE_IS_PIPELINE (pipeline));
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  ide_pipeline_stage_set_completed (stage,
+                                    gbp_meson_introspection_is_current (self, pipeline));
 }
 
 static void
@@ -522,15 +635,7 @@ gbp_meson_introspection_build_async (IdePipelineStage    *stage,
                                      gpointer             user_data)
 {
   GbpMesonIntrospection *self = (GbpMesonIntrospection *)stage;
-  g_autoptr(IdeRunContext) run_context = NULL;
-  g_autoptr(IdeSubprocess) subprocess = NULL;
-  g_autoptr(JsonParser) parser = NULL;
-  g_autoptr(GIOStream) io_stream = NULL;
   g_autoptr(IdeTask) task = NULL;
-  g_autoptr(GError) error = NULL;
-  g_autofree char *meson = NULL;
-  IdeBuildSystem *build_system;
-  IdeContext *context;
 
   IDE_ENTRY;
 
@@ -542,44 +647,8 @@ gbp_meson_introspection_build_async (IdePipelineStage    *stage,
 
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, gbp_meson_introspection_build_async);
-  ide_task_set_task_data (task, get_current_etag (pipeline), g_free);
-
-  context = ide_object_get_context (IDE_OBJECT (self));
-  build_system = ide_build_system_from_context (context);
-  meson = gbp_meson_build_system_locate_meson (GBP_MESON_BUILD_SYSTEM (build_system), pipeline);
-
-  g_assert (IDE_IS_CONTEXT (context));
-  g_assert (GBP_IS_MESON_BUILD_SYSTEM (build_system));
-  g_assert (meson != NULL);
-
-  run_context = ide_run_context_new ();
-  ide_pipeline_prepare_run_context (pipeline, run_context);
-  ide_run_context_append_args (run_context, IDE_STRV_INIT (meson, "introspect", "--all", "--force-object-output"));
-
-  /* Create a stream to communicate with the subprocess and then spawn it */
-  if (!(io_stream = ide_run_context_create_stdio_stream (run_context, &error)) ||
-      !(subprocess = ide_run_context_spawn (run_context, &error)))
-    {
-      ide_task_return_error (task, g_steal_pointer (&error));
-      IDE_EXIT;
-    }
-
-  /* Keep stream alive for duration of operation */
-  g_object_set_data_full (G_OBJECT (task),
-                          "IO_STREAM",
-                          g_object_ref (io_stream),
-                          g_object_unref);
-
-  /* Start parsing our input stream */
-  parser = json_parser_new ();
-  json_parser_load_from_stream_async (parser,
-                                      g_io_stream_get_input_stream (io_stream),
-                                      cancellable,
-                                      gbp_meson_introspection_load_stream_cb,
-                                      g_steal_pointer (&task));
-
-  /* Make sure something watches the child */
-  ide_subprocess_wait_async (subprocess, NULL, NULL, NULL);
+  ide_task_set_task_data (task, g_strdup (ide_pipeline_get_builddir (pipeline)), g_free);
+  ide_task_run_in_thread (task, gbp_meson_introspection_load_worker);
 
   IDE_EXIT;
 }
@@ -589,16 +658,20 @@ gbp_meson_introspection_build_finish (IdePipelineStage  *stage,
                                       GAsyncResult      *result,
                                       GError           **error)
 {
-  gboolean ret;
+  GbpMesonIntrospection *self = (GbpMesonIntrospection *)stage;
+  g_autoptr(GVariant) model = NULL;
 
   IDE_ENTRY;
 
-  g_assert (GBP_IS_MESON_INTROSPECTION (stage));
+  g_assert (GBP_IS_MESON_INTROSPECTION (self));
   g_assert (IDE_IS_TASK (result));
 
-  ret = ide_task_propagate_boolean (IDE_TASK (result), error);
+  if (!(model = ide_task_propagate_pointer (IDE_TASK (result), error)))
+    IDE_RETURN (FALSE);
 
-  IDE_RETURN (ret);
+  gbp_meson_introspection_apply (self, model);
+
+  IDE_RETURN (TRUE);
 }
 
 static void
@@ -611,7 +684,7 @@ gbp_meson_introspection_destroy (IdeObject *object)
   g_clear_pointer (&self->descriptive_name, g_free);
   g_clear_pointer (&self->subproject_dir, g_free);
   g_clear_pointer (&self->version, g_free);
-  g_clear_pointer (&self->etag, g_free);
+  g_clear_pointer (&self->model, g_variant_unref);
 
   g_clear_weak_pointer (&self->pipeline);
 
@@ -654,9 +727,9 @@ gbp_meson_introspection_new (IdePipeline *pipeline)
 }
 
 static void
-gbp_meson_introspection_list_run_commands_cb (GObject      *object,
-                                              GAsyncResult *result,
-                                              gpointer      user_data)
+gbp_meson_introspection_load_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
 {
   g_autoptr(IdeTask) task = user_data;
   GbpMesonIntrospection *self;
@@ -670,16 +743,32 @@ gbp_meson_introspection_list_run_commands_cb (GObject      *object,
   self = ide_task_get_source_object (task);
   g_assert (GBP_IS_MESON_INTROSPECTION (self));
 
-  ide_task_return_pointer (task, g_object_ref (self->run_commands), g_object_unref);
+  if (IDE_IS_PIPELINE_STAGE (object))
+    ide_pipeline_stage_build_finish (IDE_PIPELINE_STAGE (object), result, NULL);
+
+  if (self->model == NULL)
+    ide_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NOT_INITIALIZED,
+                               "Meson introspection is not available");
+  else
+    ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
 }
 
+/**
+ * gbp_meson_introspection_load_async:
+ * @self: a #GbpMesonIntrospection
+ *
+ * Ensures the introspection model has been loaded, configuring the
+ * project first if necessary.
+ */
 void
-gbp_meson_introspection_list_run_commands_async (GbpMesonIntrospection *self,
-                                                 GCancellable          *cancellable,
-                                                 GAsyncReadyCallback    callback,
-                                                 gpointer               user_data)
+gbp_meson_introspection_load_async (GbpMesonIntrospection *self,
+                                    GCancellable          *cancellable,
+                                    GAsyncReadyCallback    callback,
+                                    gpointer               user_data)
 {
   g_autoptr(IdeTask) task = NULL;
 
@@ -690,7 +779,7 @@ gbp_meson_introspection_list_run_commands_async (GbpMesonIntrospection *self,
   g_return_if_fail (IDE_IS_PIPELINE (self->pipeline));
 
   task = ide_task_new (self, cancellable, callback, user_data);
-  ide_task_set_source_tag (task, gbp_meson_introspection_list_run_commands_async);
+  ide_task_set_source_tag (task, gbp_meson_introspection_load_async);
 
   if (!self->has_built_once)
     {
@@ -703,19 +792,83 @@ gbp_meson_introspection_list_run_commands_async (GbpMesonIntrospection *self,
         ide_pipeline_stage_build_async (IDE_PIPELINE_STAGE (self),
                                         self->pipeline,
                                         cancellable,
-                                        gbp_meson_introspection_list_run_commands_cb,
+                                        gbp_meson_introspection_load_cb,
                                         g_steal_pointer (&task));
       else
         ide_pipeline_build_async (self->pipeline,
                                   IDE_PIPELINE_PHASE_CONFIGURE,
                                   cancellable,
-                                  gbp_meson_introspection_list_run_commands_cb,
+                                  gbp_meson_introspection_load_cb,
                                   g_steal_pointer (&task));
 
       IDE_EXIT;
     }
 
-  ide_task_return_pointer (task, g_object_ref (self->run_commands), g_object_unref);
+  ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+gboolean
+gbp_meson_introspection_load_finish (GbpMesonIntrospection  *self,
+                                     GAsyncResult           *result,
+                                     GError                **error)
+{
+  gboolean ret;
+
+  IDE_ENTRY;
+
+  g_return_val_if_fail (GBP_IS_MESON_INTROSPECTION (self), FALSE);
+  g_return_val_if_fail (IDE_IS_TASK (result), FALSE);
+
+  ret = ide_task_propagate_boolean (IDE_TASK (result), error);
+
+  IDE_RETURN (ret);
+}
+
+static void
+gbp_meson_introspection_list_run_commands_cb (GObject      *object,
+                                              GAsyncResult *result,
+                                              gpointer      user_data)
+{
+  GbpMesonIntrospection *self = (GbpMesonIntrospection *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (GBP_IS_MESON_INTROSPECTION (self));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
+
+  if (!gbp_meson_introspection_load_finish (self, result, &error))
+    ide_task_return_error (task, g_steal_pointer (&error));
+  else
+    ide_task_return_pointer (task, g_object_ref (self->run_commands), g_object_unref);
+
+  IDE_EXIT;
+}
+
+void
+gbp_meson_introspection_list_run_commands_async (GbpMesonIntrospection *self,
+                                                 GCancellable          *cancellable,
+                                                 GAsyncReadyCallback    callback,
+                                                 gpointer               user_data)
+{
+  g_autoptr(IdeTask) task = NULL;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (GBP_IS_MESON_INTROSPECTION (self));
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, gbp_meson_introspection_list_run_commands_async);
+
+  gbp_meson_introspection_load_async (self,
+                                      cancellable,
+                                      gbp_meson_introspection_list_run_commands_cb,
+                                      g_steal_pointer (&task));
 
   IDE_EXIT;
 }
@@ -736,3 +889,72 @@ gbp_meson_introspection_list_run_commands_finish (GbpMesonIntrospection  *self,
 
   IDE_RETURN (ret);
 }
+
+/**
+ * gbp_meson_introspection_list_build_targets:
+ * @self: a #GbpMesonIntrospection
+ *
+ * Returns: (transfer full) (element-type IdeBuildTarget): an array of
+ *   #GbpMesonBuildTarget for the targets of the project
+ */
+GPtrArray *
+gbp_meson_introspection_list_build_targets (GbpMesonIntrospection *self)
+{
+  g_autoptr(GVariant) targets = NULL;
+  g_autoptr(GPtrArray) ret = NULL;
+  g_autoptr(GFile) builddir = NULL;
+  IdeContext *context;
+  GVariantIter iter;
+  const char *name;
+  const char *type;
+  g_autofree const char **filename = NULL;
+
+  g_return_val_if_fail (GBP_IS_MESON_INTROSPECTION (self), NULL);
+
+  ret = g_ptr_array_new_with_free_func (g_object_unref);
+
+  if (self->model == NULL || self->pipeline == NULL)
+    return g_steal_pointer (&ret);
+
+  context = ide_object_get_context (IDE_OBJECT (self));
+  builddir = g_file_new_for_path (ide_pipeline_get_builddir (self->pipeline));
+
+  targets = g_variant_get_child_value (self->model, 3);
+  g_variant_iter_init (&iter, targets);
+  while (g_variant_iter_next (&iter, "(&s&s&s^a&s@as@b)", NULL, &name, &type, &filename, NULL, NULL))
+    {
+      g_autoptr(IdeBuildTarget) target = NULL;
+      g_autofree char *base = NULL;
+      g_autofree char *dir_path = NULL;
+      g_autoptr(GFile) file = NULL;
+      g_autoptr(GFile) dir = NULL;
+      IdeArtifactKind kind = 0;
+
+      if (filename[0] == NULL || filename[0][0] == 0)
+        {
+          g_clear_pointer (&filename, g_free);
+          continue;
+        }
+
+      g_debug ("Found target %s", name);
+
+      file = g_file_new_for_path (filename[0]);
+      base = g_file_get_relative_path (builddir, file);
+      dir_path = g_path_get_dirname (filename[0]);
+      dir = g_file_new_for_path (dir_path);
+
+      if (ide_str_equal0 (type, "executable"))
+        kind = IDE_ARTIFACT_KIND_EXECUTABLE;
+      else if (ide_str_equal0 (type, "static library"))
+        kind = IDE_ARTIFACT_KIND_STATIC_LIBRARY;
+      else if (ide_str_equal0 (type, "shared library"))
+        kind = IDE_ARTIFACT_KIND_SHARED_LIBRARY;
+
+      target = gbp_meson_build_target_new (context, dir, base, filename[0], kind);
+      g_ptr_array_add (ret, g_steal_pointer (&target));
+
+      g_clear_pointer (&filename, g_free);
+    }
+
+  return g_steal_pointer (&ret);
+}
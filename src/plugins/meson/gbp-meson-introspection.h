@@ -28,13 +28,21 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (GbpMesonIntrospection, gbp_meson_introspection, GBP, MESON_INTROSPECTION, IdePipelineStage)
 
-GbpMesonIntrospection *gbp_meson_introspection_new                      (IdePipeline            *pipeline);
-void                   gbp_meson_introspection_list_run_commands_async  (GbpMesonIntrospection  *self,
-                                                                         GCancellable           *cancelalble,
-                                                                         GAsyncReadyCallback     callback,
-                                                                         gpointer                user_data);
-GListModel            *gbp_meson_introspection_list_run_commands_finish (GbpMesonIntrospection  *self,
-                                                                         GAsyncResult           *result,
-                                                                         GError                **error);
+GbpMesonIntrospection *gbp_meson_introspection_new                        (IdePipeline            *pipeline);
+void                   gbp_meson_introspection_load_async                 (GbpMesonIntrospection  *self,
+                                                                           GCancellable           *cancellable,
+                                                                           GAsyncReadyCallback     callback,
+                                                                           gpointer                user_data);
+gboolean               gbp_meson_introspection_load_finish                (GbpMesonIntrospection  *self,
+                                                                           GAsyncResult           *result,
+                                                                           GError                **error);
+void                   gbp_meson_introspection_list_run_commands_async    (GbpMesonIntrospection  *self,
+                                                                           GCancellable           *cancelalble,
+                                                                           GAsyncReadyCallback     callback,
+                                                                           gpointer                user_data);
+GListModel            *gbp_meson_introspection_list_run_commands_finish   (GbpMesonIntrospection  *self,
+                                                                           GAsyncResult           *result,
+                                                                           GError                **error);
+GPtrArray             *gbp_meson_introspection_list_build_targets         (GbpMesonIntrospection  *self);
 
 G_END_DECLS
@@ -40,6 +40,7 @@ struct _GbpMesonPipelineAddin
 };
 
 static const gchar *ninja_names[] = { "ninja", "ninja-build", NULL };
+static const gchar *configure_inputs[] = { "meson.build", "meson_options.txt", "meson.options" };
 
 static void
 on_build_stage_query (IdePipelineStage *stage,
@@ -277,6 +278,19 @@ gbp_meson_pipeline_addin_load (IdePipelineAddin *addin,
   if (g_file_test (build_dot_ninja, G_FILE_TEST_EXISTS))
     ide_pipeline_stage_set_completed (stage, TRUE);
 
+  /* Allow the pipeline to skip a reconfigure when nothing meson setup
+   * reads has changed. Changes to nested meson.build files do not need
+   * to be tracked as ninja regenerates build.ninja for those itself.
+   */
+  for (guint i = 0; i < G_N_ELEMENTS (configure_inputs); i++)
+    {
+      g_autofree char *path = g_build_filename (srcdir, configure_inputs[i], NULL);
+      ide_pipeline_stage_add_input_file (stage, path);
+    }
+  if (crossbuild_file != NULL)
+    ide_pipeline_stage_add_input_file (stage, crossbuild_file);
+  ide_pipeline_stage_add_output_file (stage, build_dot_ninja);
+
   /* Setup our Build/Clean stage */
   clean_command = create_run_command (ninja, "clean", NULL);
   build_command = create_run_command (ninja, NULL);
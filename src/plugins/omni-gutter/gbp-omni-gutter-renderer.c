@@ -57,12 +57,35 @@
 #define BREAKPOINT_XPAD (CHANGE_WIDTH + 1)
 #define BREAKPOINT_YPAD 1
 #define BREAKPOINT_CORNER_RADIUS 5
+#define MAX_CACHED_NUMBERS 4096
 
 #define IS_BREAKPOINT(i)  ((i)->is_breakpoint || (i)->is_countpoint || (i)->is_watchpoint)
 #define IS_DIAGNOSTIC(i)  ((i)->is_error || (i)->is_warning || (i)->is_note)
 #define IS_LINE_CHANGE(i) ((i)->is_add || (i)->is_change || \
                            (i)->is_delete || (i)->is_next_delete || (i)->is_prev_delete)
 
+typedef enum
+{
+  NUMBER_STYLE_TEXT,
+  NUMBER_STYLE_CURRENT,
+  NUMBER_STYLE_BREAKPOINT,
+  NUMBER_STYLE_SELECTED,
+} NumberStyle;
+
+enum {
+  DIAGNOSTIC_ERROR,
+  DIAGNOSTIC_WARNING,
+  DIAGNOSTIC_NOTE,
+  N_DIAGNOSTIC_KINDS
+};
+
+enum {
+  BREAKPOINT_BG_ACTIVE,
+  BREAKPOINT_BG_PRELIT,
+  BREAKPOINT_BG_PRELIT_EMPTY,
+  N_BREAKPOINT_BGS
+};
+
 struct _GbpOmniGutterRenderer
 {
   GtkSourceGutterRenderer parent_instance;
@@ -111,6 +134,27 @@ struct _GbpOmniGutterRenderer
    */
   PangoLayout *layout;
 
+  /*
+   * Line numbers are shaped once and kept as render nodes keyed by the
+   * number and its NumberStyle, so scrolling only has to shape numbers
+   * we have not seen before. The nodes are only valid for the font,
+   * width, and scale they were created with, so the cache is dropped
+   * whenever one of those (or the style colors) change.
+   */
+  GHashTable *number_nodes;
+  int cache_width;
+  int cache_scale;
+
+  /*
+   * Marks are the same for every line they are drawn on, so we record
+   * them once at the origin and translate to the line when drawing. The
+   * breakpoint backgrounds depend on the line height which is tracked
+   * separately as it may change with wrapped lines.
+   */
+  GskRenderNode *diagnostic_nodes[N_DIAGNOSTIC_KINDS][2];
+  GskRenderNode *breakpoint_nodes[N_BREAKPOINT_BGS][2];
+  int breakpoint_nodes_height;
+
   /* We stash a copy of how long the line numbers could be. 1000 => 4. */
   guint n_chars;
 
@@ -301,6 +345,39 @@ int_to_string (guint         value,
   return fi.len;
 }
 
+static void
+gbp_omni_gutter_renderer_clear_marks (GbpOmniGutterRenderer *self)
+{
+  g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
+
+  for (guint i = 0; i < N_DIAGNOSTIC_KINDS; i++)
+    {
+      g_clear_pointer (&self->diagnostic_nodes[i][FALSE], gsk_render_node_unref);
+      g_clear_pointer (&self->diagnostic_nodes[i][TRUE], gsk_render_node_unref);
+    }
+
+  for (guint i = 0; i < N_BREAKPOINT_BGS; i++)
+    {
+      g_clear_pointer (&self->breakpoint_nodes[i][FALSE], gsk_render_node_unref);
+      g_clear_pointer (&self->breakpoint_nodes[i][TRUE], gsk_render_node_unref);
+    }
+}
+
+static void
+gbp_omni_gutter_renderer_clear_caches (GbpOmniGutterRenderer *self)
+{
+  g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
+
+  if (self->number_nodes != NULL)
+    g_hash_table_remove_all (self->number_nodes);
+
+  gbp_omni_gutter_renderer_clear_marks (self);
+  g_clear_object (&self->layout);
+
+  self->cache_width = 0;
+  self->cache_scale = 0;
+}
+
 static void
 gbp_omni_gutter_renderer_set_change_monitor (GbpOmniGutterRenderer  *self,
                                              IdeBufferChangeMonitor *change_monitor)
@@ -623,6 +700,9 @@ reload_style_colors (GbpOmniGutterRenderer *self,
     }
   if (!style_get_is_bold (scheme, "-Builder:countpoint", &self->ctpt.bold))
     self->ctpt.bold = FALSE;
+
+  /* Cached nodes have the old colors baked in */
+  gbp_omni_gutter_renderer_clear_caches (self);
 }
 
 static void
@@ -842,6 +922,7 @@ gbp_omni_gutter_renderer_measure (GbpOmniGutterRenderer *self)
   guint line;
   int size = 0;
   int old_width;
+  int old_number_height;
 
   g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
 
@@ -878,9 +959,13 @@ gbp_omni_gutter_renderer_measure (GbpOmniGutterRenderer *self)
    * positioning later. We simply size everything the same and then
    * align to the right to reduce the draw overhead.
    */
+  old_number_height = self->number_height;
   pango_layout_get_pixel_size (layout, &self->number_width, &self->number_height);
   pango_layout_set_attributes (layout, bold_attrs);
 
+  if (old_number_height != self->number_height)
+    gbp_omni_gutter_renderer_clear_caches (self);
+
   /*
    * Calculate the nearest size for diagnostics so they scale somewhat
    * reasonable with the character size.
@@ -923,20 +1008,13 @@ gbp_omni_gutter_renderer_notify_font (GbpOmniGutterRenderer *self,
   g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
   g_assert (IDE_IS_SOURCE_VIEW (view));
 
+  /* Previously shaped numbers are for the old font */
+  gbp_omni_gutter_renderer_clear_caches (self);
+
   gbp_omni_gutter_renderer_measure (self);
   gbp_omni_gutter_renderer_reload_icons (self);
 }
 
-static void
-gbp_omni_gutter_renderer_end (GtkSourceGutterRenderer *renderer)
-{
-  GbpOmniGutterRenderer *self = (GbpOmniGutterRenderer *)renderer;
-
-  g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
-
-  g_clear_object (&self->layout);
-}
-
 static void
 gbp_omni_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
                                 GtkSourceGutterLines    *lines)
@@ -961,7 +1039,8 @@ gbp_omni_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
    * do is collect as much information as we'll need when doing the
    * actual draw. That helps us coalesce similar work together, which is
    * good for the CPU usage. We are *very* sensitive to CPU usage here
-   * as the GtkTextView does not pixel cache the gutter.
+   * as the GtkTextView does not pixel cache the gutter, which is why
+   * line numbers and marks are kept as render nodes between frames.
    */
 
   self->stopped_line = -1;
@@ -1039,10 +1118,21 @@ gbp_omni_gutter_renderer_begin (GtkSourceGutterRenderer *renderer,
   gbp_omni_gutter_renderer_load_basic (self, &begin, self->lines);
   gbp_omni_gutter_renderer_load_breakpoints (self, &begin, &end, self->lines);
 
-  /* Create a new layout for rendering lines to */
-  self->layout = gtk_widget_create_pango_layout (GTK_WIDGET (self), "");
-  pango_layout_set_alignment (self->layout, PANGO_ALIGN_RIGHT);
-  pango_layout_set_width (self->layout, (width - BREAKPOINT_XPAD - RIGHT_MARGIN - 4) * PANGO_SCALE);
+  /* Numbers are right aligned, so cached nodes depend on our width */
+  if (width != self->cache_width ||
+      gtk_widget_get_scale_factor (GTK_WIDGET (self)) != self->cache_scale)
+    gbp_omni_gutter_renderer_clear_caches (self);
+
+  /* Create a new layout for shaping line numbers we haven't seen yet */
+  if (self->layout == NULL)
+    {
+      self->layout = gtk_widget_create_pango_layout (GTK_WIDGET (self), "");
+      pango_layout_set_alignment (self->layout, PANGO_ALIGN_RIGHT);
+      pango_layout_set_width (self->layout, (width - BREAKPOINT_XPAD - RIGHT_MARGIN - 4) * PANGO_SCALE);
+
+      self->cache_width = width;
+      self->cache_scale = gtk_widget_get_scale_factor (GTK_WIDGET (self));
+    }
 }
 
 static gboolean
@@ -1193,31 +1283,66 @@ draw_breakpoint_bg (GbpOmniGutterRenderer *self,
                     gboolean               is_prelit,
                     const LineInfo        *info)
 {
-  GskRoundedRect rounded_rect;
-  GdkRGBA rgba;
+  GskRenderNode **node;
+  guint kind;
 
-  if (info->is_countpoint)
-    rgba = self->ctpt.bg;
+  if (!is_prelit)
+    kind = BREAKPOINT_BG_ACTIVE;
+  else if (IS_BREAKPOINT (info))
+    kind = BREAKPOINT_BG_PRELIT;
   else
-    rgba = self->bkpt.bg;
+    kind = BREAKPOINT_BG_PRELIT_EMPTY;
 
-  if (is_prelit)
+  /* Width changes drop the whole cache, but the height may vary per line */
+  if (height != self->breakpoint_nodes_height)
     {
-      if (IS_BREAKPOINT (info))
-        rgba.alpha *= 0.8;
+      for (guint i = 0; i < N_BREAKPOINT_BGS; i++)
+        {
+          g_clear_pointer (&self->breakpoint_nodes[i][FALSE], gsk_render_node_unref);
+          g_clear_pointer (&self->breakpoint_nodes[i][TRUE], gsk_render_node_unref);
+        }
+
+      self->breakpoint_nodes_height = height;
+    }
+
+  node = &self->breakpoint_nodes[kind][!!info->is_countpoint];
+
+  if (*node == NULL)
+    {
+      GtkSnapshot *bg_snapshot = gtk_snapshot_new ();
+      GskRoundedRect rounded_rect;
+      GdkRGBA rgba;
+
+      if (info->is_countpoint)
+        rgba = self->ctpt.bg;
       else
+        rgba = self->bkpt.bg;
+
+      if (kind == BREAKPOINT_BG_PRELIT)
+        rgba.alpha *= 0.8;
+      else if (kind == BREAKPOINT_BG_PRELIT_EMPTY)
         rgba.alpha *= 0.4;
-    }
 
-  rounded_rect = GSK_ROUNDED_RECT_INIT (0, line_y, width - BREAKPOINT_XPAD, height - BREAKPOINT_YPAD);
-  rounded_rect.corner[1] = GRAPHENE_SIZE_INIT (BREAKPOINT_CORNER_RADIUS, BREAKPOINT_CORNER_RADIUS);
-  rounded_rect.corner[2] = GRAPHENE_SIZE_INIT (BREAKPOINT_CORNER_RADIUS, BREAKPOINT_CORNER_RADIUS);
+      rounded_rect = GSK_ROUNDED_RECT_INIT (0, 0, width - BREAKPOINT_XPAD, height - BREAKPOINT_YPAD);
+      rounded_rect.corner[1] = GRAPHENE_SIZE_INIT (BREAKPOINT_CORNER_RADIUS, BREAKPOINT_CORNER_RADIUS);
+      rounded_rect.corner[2] = GRAPHENE_SIZE_INIT (BREAKPOINT_CORNER_RADIUS, BREAKPOINT_CORNER_RADIUS);
 
-  gtk_snapshot_push_rounded_clip (snapshot, &rounded_rect);
-  gtk_snapshot_append_color (snapshot,
-                             &rgba,
-                             &GRAPHENE_RECT_INIT (0, line_y, width, height));
-  gtk_snapshot_pop (snapshot);
+      gtk_snapshot_push_rounded_clip (bg_snapshot, &rounded_rect);
+      gtk_snapshot_append_color (bg_snapshot,
+                                 &rgba,
+                                 &GRAPHENE_RECT_INIT (0, 0, width, height));
+      gtk_snapshot_pop (bg_snapshot);
+
+      *node = gtk_snapshot_free_to_node (bg_snapshot);
+    }
+
+  if (*node != NULL)
+    {
+      gtk_snapshot_save (snapshot);
+      gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, line_y));
+      gtk_snapshot_append_node (snapshot, *node);
+      gtk_snapshot_restore (snapshot);
+    }
 }
 
 static void
@@ -1261,41 +1386,128 @@ draw_diagnostic (GbpOmniGutterRenderer *self,
                  const LineInfo        *info)
 {
   GdkPaintable *paintable = NULL;
-  GdkRGBA colors[4];
+  GskRenderNode **node;
+  guint kind;
 
   if (info->is_error)
-    paintable = self->error;
+    {
+      paintable = self->error;
+      kind = DIAGNOSTIC_ERROR;
+    }
   else if (info->is_warning)
-    paintable = self->warning;
+    {
+      paintable = self->warning;
+      kind = DIAGNOSTIC_WARNING;
+    }
   else if (info->is_note)
-    paintable = self->note;
-
-  if (IS_BREAKPOINT (info))
     {
-      colors[0] = self->sel.fg;
-      colors[1] = self->sel.bg;
-      colors[2] = self->changes.change;
-      colors[3] = self->changes.remove;
+      paintable = self->note;
+      kind = DIAGNOSTIC_NOTE;
     }
   else
+    return;
+
+  if (paintable == NULL)
+    return;
+
+  node = &self->diagnostic_nodes[kind][IS_BREAKPOINT (info)];
+
+  if (*node == NULL)
     {
-      colors[0] = self->text.fg;
-      colors[1] = self->text.bg;
-      colors[2] = self->changes.change;
-      colors[3] = self->changes.remove;
+      GtkSnapshot *icon_snapshot = gtk_snapshot_new ();
+      GdkRGBA colors[4];
+
+      if (IS_BREAKPOINT (info))
+        {
+          colors[0] = self->sel.fg;
+          colors[1] = self->sel.bg;
+          colors[2] = self->changes.change;
+          colors[3] = self->changes.remove;
+        }
+      else
+        {
+          colors[0] = self->text.fg;
+          colors[1] = self->text.bg;
+          colors[2] = self->changes.change;
+          colors[3] = self->changes.remove;
+        }
+
+      gtk_symbolic_paintable_snapshot_symbolic (GTK_SYMBOLIC_PAINTABLE (paintable), icon_snapshot, self->diag_size, self->diag_size,  colors, G_N_ELEMENTS (colors));
+
+      *node = gtk_snapshot_free_to_node (icon_snapshot);
     }
 
-  if (paintable != NULL)
+  if (*node != NULL)
     {
       gtk_snapshot_save (snapshot);
       gtk_snapshot_translate (snapshot,
                               &GRAPHENE_POINT_INIT (2,
                                                     line_y + ((height - self->diag_size) / 2)));
-      gtk_symbolic_paintable_snapshot_symbolic (GTK_SYMBOLIC_PAINTABLE (paintable), snapshot, self->diag_size, self->diag_size,  colors, G_N_ELEMENTS (colors));
+      gtk_snapshot_append_node (snapshot, *node);
       gtk_snapshot_restore (snapshot);
     }
 }
 
+static GskRenderNode *
+get_number_node (GbpOmniGutterRenderer *self,
+                 guint                  number,
+                 NumberStyle            style)
+{
+  gpointer key = GUINT_TO_POINTER ((number << 2) | style);
+  const GdkRGBA *rgba;
+  GskRenderNode *node;
+  GtkSnapshot *snapshot;
+  const gchar *linestr = NULL;
+  gboolean bold;
+  int len;
+
+  g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
+  g_assert (self->layout != NULL);
+
+  if ((node = g_hash_table_lookup (self->number_nodes, key)))
+    return node;
+
+  /* Just start over rather than tracking usage, it is rare to get here */
+  if (g_hash_table_size (self->number_nodes) >= MAX_CACHED_NUMBERS)
+    g_hash_table_remove_all (self->number_nodes);
+
+  switch (style)
+    {
+    case NUMBER_STYLE_BREAKPOINT:
+      rgba = &self->bkpt.fg;
+      bold = self->bkpt.bold;
+      break;
+
+    case NUMBER_STYLE_CURRENT:
+      rgba = &self->current.fg;
+      bold = self->current.bold;
+      break;
+
+    case NUMBER_STYLE_SELECTED:
+      rgba = &self->view.fg;
+      bold = self->text.bold;
+      break;
+
+    case NUMBER_STYLE_TEXT:
+    default:
+      rgba = &self->text.fg;
+      bold = self->text.bold;
+      break;
+    }
+
+  len = int_to_string (number, &linestr);
+  pango_layout_set_text (self->layout, linestr, len);
+  pango_layout_set_attributes (self->layout, bold ? bold_attrs : NULL);
+
+  snapshot = gtk_snapshot_new ();
+  gtk_snapshot_append_layout (snapshot, self->layout, rgba);
+
+  if ((node = gtk_snapshot_free_to_node (snapshot)))
+    g_hash_table_insert (self->number_nodes, key, node);
+
+  return node;
+}
+
 static void
 gbp_omni_gutter_renderer_snapshot (GtkWidget   *widget,
                                    GtkSnapshot *snapshot)
@@ -1349,7 +1561,6 @@ gbp_omni_gutter_renderer_snapshot_line (GtkSourceGutterRenderer *renderer,
       gboolean is_cursor = gtk_source_gutter_lines_is_cursor (lines, line);
       gboolean is_selected_line = gtk_source_gutter_lines_has_qclass (lines, line, selection_quark);
       gboolean has_breakpoint = FALSE;
-      gboolean bold = FALSE;
 
       /* Fill in gap for what would look like the "highlight-current-line"
        * within the textarea that we are pretending to look like.
@@ -1408,10 +1619,9 @@ gbp_omni_gutter_renderer_snapshot_line (GtkSourceGutterRenderer *renderer,
        */
       if (self->show_line_numbers)
         {
-          const GdkRGBA *rgba;
-          const gchar *linestr = NULL;
+          GskRenderNode *node;
+          NumberStyle style;
           guint shown_line;
-          int len;
 
           if (!self->show_relative_line_numbers || line == self->cursor_line)
             shown_line = line + 1;
@@ -1420,37 +1630,22 @@ gbp_omni_gutter_renderer_snapshot_line (GtkSourceGutterRenderer *renderer,
           else
             shown_line = self->cursor_line - line;
 
-          len = int_to_string (shown_line, &linestr);
-          pango_layout_set_text (self->layout, linestr, len);
-
-
           if (has_breakpoint || (self->breakpoints != NULL && active))
-            {
-              rgba = &self->bkpt.fg;
-              bold = self->bkpt.bold;
-            }
+            style = NUMBER_STYLE_BREAKPOINT;
           else if (!self->selection_is_multi_line && gtk_source_gutter_lines_is_cursor (lines, line))
-            {
-              rgba = &self->current.fg;
-              bold = self->current.bold;
-            }
+            style = NUMBER_STYLE_CURRENT;
           else if (gtk_source_gutter_lines_has_qclass (lines, line, selection_quark))
-            {
-              rgba = &self->view.fg;
-              bold = self->text.bold;
-            }
+            style = NUMBER_STYLE_SELECTED;
           else
+            style = NUMBER_STYLE_TEXT;
+
+          if ((node = get_number_node (self, shown_line, style)))
             {
-              rgba = &self->text.fg;
-              bold = self->text.bold;
+              gtk_snapshot_save (snapshot);
+              gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, line_y + ((line_height - self->number_height) / 2)));
+              gtk_snapshot_append_node (snapshot, node);
+              gtk_snapshot_restore (snapshot);
             }
-
-          pango_layout_set_attributes (self->layout, bold ? bold_attrs : NULL);
-
-          gtk_snapshot_save (snapshot);
-          gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (0, line_y + ((line_height - self->number_height) / 2)));
-          gtk_snapshot_append_layout (snapshot, self->layout, rgba);
-          gtk_snapshot_restore (snapshot);
         }
 
       /* Draw our selection edges which overlap the gutter. This is drawn last since
@@ -1513,6 +1708,8 @@ gbp_omni_gutter_renderer_reload_icons (GbpOmniGutterRenderer *self)
   g_clear_object (&self->warning);
   g_clear_object (&self->error);
 
+  gbp_omni_gutter_renderer_clear_marks (self);
+
   view = gtk_source_gutter_renderer_get_view (GTK_SOURCE_GUTTER_RENDERER (self));
   if (view == NULL)
     return;
@@ -1613,6 +1810,62 @@ gbp_omni_gutter_renderer_buffer_changed (GbpOmniGutterRenderer *self,
                                            g_object_unref);
 }
 
+static void
+gbp_omni_gutter_renderer_notify_diagnostics (GbpOmniGutterRenderer *self,
+                                             GParamSpec            *pspec,
+                                             IdeBuffer             *buffer)
+{
+  g_autoptr(GArray) lines = NULL;
+  IdeDiagnostics *diagnostics;
+  GFile *file;
+  struct {
+    GArray *lines;
+    guint   begin_line;
+    guint   end_line;
+  } state;
+
+  g_assert (GBP_IS_OMNI_GUTTER_RENDERER (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (self->lines->len == 0 || !(file = ide_buffer_get_file (buffer)))
+    {
+      gtk_widget_queue_draw (GTK_WIDGET (self));
+      return;
+    }
+
+  /* Most updates only touch lines out of view, so only redraw if the
+   * diagnostics for the lines we last drew have changed.
+   */
+  lines = g_array_sized_new (FALSE, TRUE, sizeof (LineInfo), self->lines->len);
+  g_array_set_size (lines, self->lines->len);
+
+  state.lines = lines;
+  state.begin_line = self->begin_line;
+  state.end_line = self->begin_line + lines->len;
+
+  if ((diagnostics = ide_buffer_get_diagnostics (buffer)))
+    ide_diagnostics_foreach_line_in_range (diagnostics,
+                                           file,
+                                           state.begin_line,
+                                           state.end_line,
+                                           populate_diagnostics_cb,
+                                           &state);
+
+  for (guint i = 0; i < lines->len; i++)
+    {
+      const LineInfo *a = &g_array_index (self->lines, LineInfo, i);
+      const LineInfo *b = &g_array_index (lines, LineInfo, i);
+
+      if (a->is_error != b->is_error ||
+          a->is_warning != b->is_warning ||
+          a->is_note != b->is_note)
+        {
+          gtk_widget_queue_draw (GTK_WIDGET (self));
+          return;
+        }
+    }
+}
+
 static void
 gbp_omni_gutter_renderer_cursor_moved (GbpOmniGutterRenderer *self,
                                        GtkTextBuffer         *buffer)
@@ -1698,7 +1951,8 @@ gbp_omni_gutter_renderer_dispose (GObject *object)
   g_clear_object (&self->warning);
   g_clear_object (&self->error);
 
-  g_clear_object (&self->layout);
+  gbp_omni_gutter_renderer_clear_caches (self);
+  g_clear_pointer (&self->number_nodes, g_hash_table_unref);
 
   G_OBJECT_CLASS (gbp_omni_gutter_renderer_parent_class)->dispose (object);
 }
@@ -1780,7 +2034,6 @@ gbp_omni_gutter_renderer_class_init (GbpOmniGutterRendererClass *klass)
 
   renderer_class->snapshot_line = gbp_omni_gutter_renderer_snapshot_line;
   renderer_class->begin = gbp_omni_gutter_renderer_begin;
-  renderer_class->end = gbp_omni_gutter_renderer_end;
   renderer_class->query_activatable = gbp_omni_gutter_renderer_query_activatable;
   renderer_class->activate = gbp_omni_gutter_renderer_activate;
   renderer_class->change_buffer = gbp_omni_gutter_renderer_change_buffer;
@@ -1820,6 +2073,8 @@ gbp_omni_gutter_renderer_init (GbpOmniGutterRenderer *self)
   self->show_line_diagnostics = TRUE;
 
   self->lines = g_array_new (FALSE, FALSE, sizeof (LineInfo));
+  self->number_nodes = g_hash_table_new_full (NULL, NULL, NULL,
+                                              (GDestroyNotify)gsk_render_node_unref);
 
   self->buffer_signals = g_signal_group_new (IDE_TYPE_BUFFER);
   g_signal_group_connect_swapped (self->buffer_signals,
@@ -1834,11 +2089,10 @@ gbp_omni_gutter_renderer_init (GbpOmniGutterRenderer *self)
                                     "notify::change-monitor",
                                     G_CALLBACK (gbp_omni_gutter_renderer_reload),
                                     self);
-  g_signal_group_connect_object (self->buffer_signals,
-                                   "notify::diagnostics",
-                                   G_CALLBACK (gtk_widget_queue_draw),
-                                   self,
-                                   G_CONNECT_SWAPPED);
+  g_signal_group_connect_swapped (self->buffer_signals,
+                                    "notify::diagnostics",
+                                    G_CALLBACK (gbp_omni_gutter_renderer_notify_diagnostics),
+                                    self);
   g_signal_group_connect_object (self->buffer_signals,
                                    "notify::has-selection",
                                    G_CALLBACK (gtk_widget_queue_draw),
@@ -93,7 +93,7 @@ static gboolean
 region_iter_next (RegionIter  *self,
                   GtkTextIter *iter)
 {
-  gsize pos = 0, new_pos = 0;
+  gsize pos = 0, new_pos = G_MAXSIZE;
 
   if (self->pos >= (gssize)_cjh_text_region_get_length (self->region))
     {
@@ -112,6 +112,14 @@ region_iter_next (RegionIter  *self,
                                      region_iter_next_cb,
                                      &new_pos);
 
+  /* Nothing left to check past this position */
+  if (new_pos == G_MAXSIZE)
+    {
+      self->pos = _cjh_text_region_get_length (self->region);
+      gtk_text_buffer_get_end_iter (self->buffer, iter);
+      RETURN (FALSE);
+    }
+
   pos = MAX (pos, new_pos);
   gtk_text_buffer_get_iter_at_offset (self->buffer, iter, pos);
   self->pos = pos;
@@ -326,6 +334,18 @@ editor_spell_cursor_free (EditorSpellCursor *self)
   g_rc_box_release (self);
 }
 
+void
+editor_spell_cursor_seek (EditorSpellCursor *self,
+                          const GtkTextIter *iter)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (iter != NULL);
+
+  self->region.pos = gtk_text_iter_get_offset (iter);
+  tag_iter_seek (&self->tag, iter);
+  word_iter_seek (&self->word, iter);
+}
+
 static gboolean
 contains_tag (const GtkTextIter *word_begin,
               const GtkTextIter *word_end,
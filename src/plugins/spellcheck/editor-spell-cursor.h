@@ -32,6 +32,8 @@ EditorSpellCursor *editor_spell_cursor_new               (GtkTextBuffer     *buf
                                                           GtkTextTag        *no_spell_check_tag,
                                                           const char        *extra_word_chars);
 void               editor_spell_cursor_free              (EditorSpellCursor *cursor);
+void               editor_spell_cursor_seek              (EditorSpellCursor *cursor,
+                                                          const GtkTextIter *iter);
 gboolean           editor_spell_cursor_next              (EditorSpellCursor *cursor,
                                                           GtkTextIter       *word_begin,
                                                           GtkTextIter       *word_end);
@@ -171,31 +171,27 @@ editor_text_buffer_spell_adapter_new (GtkTextBuffer      *buffer,
 }
 
 static gboolean
-get_unchecked_start_cb (gsize                   offset,
-                        const CjhTextRegionRun *run,
-                        gpointer                user_data)
+get_unchecked_start (EditorTextBufferSpellAdapter *self,
+                     GtkTextIter                  *iter)
 {
-  gsize *pos = user_data;
-
-  if (run->data == RUN_UNCHECKED)
-    {
-      *pos = offset;
-      return TRUE;
-    }
+  GtkTextIter visible_begin;
+  GtkTextIter visible_end;
+  gsize offset;
+  gsize length;
 
-  return FALSE;
-}
+  /* Check what the user can see first and work outward from there */
+  ide_buffer_get_visible_range (IDE_BUFFER (self->buffer), &visible_begin, &visible_end);
 
-static gboolean
-get_unchecked_start (CjhTextRegion *region,
-                     GtkTextBuffer *buffer,
-                     GtkTextIter   *iter)
-{
-  gsize pos = G_MAXSIZE;
-  _cjh_text_region_foreach (region, get_unchecked_start_cb, &pos);
-  if (pos == G_MAXSIZE)
+  if (!_cjh_text_region_find_nearest (self->region,
+                                      RUN_UNCHECKED,
+                                      gtk_text_iter_get_offset (&visible_begin),
+                                      gtk_text_iter_get_offset (&visible_end),
+                                      &offset,
+                                      &length))
     return FALSE;
-  gtk_text_buffer_get_iter_at_offset (buffer, iter, pos);
+
+  gtk_text_buffer_get_iter_at_offset (self->buffer, iter, offset);
+
   return TRUE;
 }
 
@@ -221,7 +217,7 @@ editor_text_buffer_spell_adapter_update_range (EditorTextBufferSpellAdapter *sel
   /* Get the first unchecked position so that we can remove the tag
    * from it up to the first word match.
    */
-  if (!get_unchecked_start (self->region, self->buffer, &begin))
+  if (!get_unchecked_start (self, &begin))
     {
       _cjh_text_region_replace (self->region,
                                 0,
@@ -230,6 +226,8 @@ editor_text_buffer_spell_adapter_update_range (EditorTextBufferSpellAdapter *sel
       return FALSE;
     }
 
+  editor_spell_cursor_seek (cursor, &begin);
+
   while (editor_spell_cursor_next (cursor, &word_begin, &word_end))
     {
       g_autofree char *word = gtk_text_iter_get_slice (&word_begin, &word_end);
@@ -247,6 +245,10 @@ editor_text_buffer_spell_adapter_update_range (EditorTextBufferSpellAdapter *sel
         }
     }
 
+  /* If the cursor ran out of words, everything past @begin is checked */
+  if (!ret)
+    gtk_text_buffer_get_end_iter (self->buffer, &word_end);
+
   _cjh_text_region_replace (self->region,
                             gtk_text_iter_get_offset (&begin),
                             gtk_text_iter_get_offset (&word_end) - gtk_text_iter_get_offset (&begin),
@@ -256,6 +258,12 @@ editor_text_buffer_spell_adapter_update_range (EditorTextBufferSpellAdapter *sel
   if (get_current_word (self, &word_begin, &word_end))
     gtk_text_buffer_remove_tag (self->buffer, self->tag, &word_begin, &word_end);
 
+  /* We started at the visible range, so there may still be unchecked
+   * text before it to process on the next run.
+   */
+  if (!ret)
+    ret = get_unchecked_start (self, &begin);
+
   return ret;
 }
 
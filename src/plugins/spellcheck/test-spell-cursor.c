@@ -210,6 +210,102 @@ test_cursor_join_words (void)
   _cjh_text_region_free (region);
 }
 
+static void
+test_cursor_seek (void)
+{
+  g_autoptr(GtkTextBuffer) buffer = gtk_text_buffer_new (NULL);
+  CjhTextRegion *region = _cjh_text_region_new (NULL, NULL);
+  g_autoptr(EditorSpellCursor) cursor = editor_spell_cursor_new (buffer, region, NULL, NULL);
+  const char *pos = strstr (test_text, "series");
+  GtkTextIter iter;
+  char *word;
+
+  gtk_text_buffer_set_text (buffer, test_text, -1);
+  _cjh_text_region_insert (region, 0, strlen (test_text), NULL);
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &iter, pos - test_text);
+  editor_spell_cursor_seek (cursor, &iter);
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, "series");
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, "of");
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, "words");
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, NULL);
+
+  _cjh_text_region_free (region);
+}
+
+static void
+test_cursor_stops_at_checked (void)
+{
+  g_autoptr(GtkTextBuffer) buffer = gtk_text_buffer_new (NULL);
+  CjhTextRegion *region = _cjh_text_region_new (NULL, NULL);
+  g_autoptr(EditorSpellCursor) cursor = editor_spell_cursor_new (buffer, region, NULL, NULL);
+  const char *pos = strstr (test_text, " a ");
+  char *word;
+
+  gtk_text_buffer_set_text (buffer, test_text, -1);
+  _cjh_text_region_insert (region, 0, strlen (test_text), NULL);
+  _cjh_text_region_replace (region, pos - test_text, strlen (pos), GINT_TO_POINTER (1));
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, "this");
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, "is");
+
+  word = next_word (cursor);
+  g_assert_cmpstr (word, ==, NULL);
+
+  _cjh_text_region_free (region);
+}
+
+static void
+assert_nearest (CjhTextRegion *region,
+                gsize          begin,
+                gsize          end,
+                gsize          expected_offset,
+                gsize          expected_length)
+{
+  gsize offset = 0;
+  gsize length = 0;
+
+  g_assert_true (_cjh_text_region_find_nearest (region, NULL, begin, end, &offset, &length));
+  g_assert_cmpint (offset, ==, expected_offset);
+  g_assert_cmpint (length, ==, expected_length);
+}
+
+static void
+test_region_find_nearest (void)
+{
+  CjhTextRegion *region = _cjh_text_region_new (NULL, NULL);
+  gsize offset;
+  gsize length;
+
+  _cjh_text_region_insert (region, 0, 100, GINT_TO_POINTER (1));
+  g_assert_false (_cjh_text_region_find_nearest (region, NULL, 0, 0, &offset, &length));
+
+  /* Adjacent runs are treated as a single span */
+  _cjh_text_region_replace (region, 10, 5, NULL);
+  _cjh_text_region_replace (region, 15, 5, NULL);
+  _cjh_text_region_replace (region, 60, 10, NULL);
+
+  assert_nearest (region, 0, 0, 10, 10);
+  assert_nearest (region, 15, 50, 15, 5);
+  assert_nearest (region, 40, 50, 60, 10);
+  assert_nearest (region, 25, 30, 10, 10);
+  assert_nearest (region, 65, 65, 65, 5);
+  assert_nearest (region, 80, 90, 60, 10);
+
+  _cjh_text_region_free (region);
+}
+
 int
 main (int argc,
       char *argv[])
@@ -231,5 +327,8 @@ main (int argc,
 #endif
   g_test_add_func ("/Spelling/Cursor/in_word", test_cursor_in_word);
   g_test_add_func ("/Spelling/Cursor/join_words", test_cursor_join_words);
+  g_test_add_func ("/Spelling/Cursor/seek", test_cursor_seek);
+  g_test_add_func ("/Spelling/Cursor/stops_at_checked", test_cursor_stops_at_checked);
+  g_test_add_func ("/Spelling/Region/find_nearest", test_region_find_nearest);
   return g_test_run ();
 }
@@ -39,6 +39,7 @@ enum {
   PROP_ICON_NAME,
   PROP_EXPANDED_ICON_NAME,
   PROP_INSTANCE,
+  PROP_STATS,
   PROP_TITLE,
   N_PROPS
 };
@@ -89,6 +90,62 @@ gbp_testui_item_get_title (GbpTestuiItem *self)
   return NULL;
 }
 
+static char *
+gbp_testui_item_dup_stats (GbpTestuiItem *self)
+{
+  g_autofree char *rss = NULL;
+  gint64 duration;
+  guint64 peak_rss;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_TESTUI_ITEM (self));
+
+  if (!IDE_IS_TEST (self->instance))
+    return NULL;
+
+  duration = ide_test_get_duration (self->instance);
+  peak_rss = ide_test_get_peak_rss (self->instance);
+
+  if (duration == 0)
+    return NULL;
+
+  if (peak_rss > 0)
+    rss = g_format_size (peak_rss);
+
+  if (duration < G_USEC_PER_SEC)
+    {
+      /* Translators: %u is the number of milliseconds a test ran */
+      g_autofree char *time = g_strdup_printf (_("%u ms"), (guint)(duration / 1000));
+
+      if (rss == NULL)
+        return g_steal_pointer (&time);
+
+      return g_strdup_printf ("%s · %s", time, rss);
+    }
+  else
+    {
+      /* Translators: %.1lf is the number of seconds a test ran */
+      g_autofree char *time = g_strdup_printf (_("%.1lf s"), duration / (double)G_USEC_PER_SEC);
+
+      if (rss == NULL)
+        return g_steal_pointer (&time);
+
+      return g_strdup_printf ("%s · %s", time, rss);
+    }
+}
+
+static void
+gbp_testui_item_notify_stats_cb (GbpTestuiItem *self,
+                                 GParamSpec    *pspec,
+                                 IdeTest       *test)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_TESTUI_ITEM (self));
+  g_assert (IDE_IS_TEST (test));
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_STATS]);
+}
+
 static void
 gbp_testui_item_notify_icon_name_cb (GbpTestuiItem *self,
                                      GParamSpec    *pspec,
@@ -112,11 +169,23 @@ gbp_testui_item_set_instance (GbpTestuiItem *self,
   self->instance = g_object_ref (instance);
 
   if (IDE_IS_TEST (instance))
-    g_signal_connect_object (instance,
-                             "notify::icon-name",
-                             G_CALLBACK (gbp_testui_item_notify_icon_name_cb),
-                             self,
-                             G_CONNECT_SWAPPED);
+    {
+      g_signal_connect_object (instance,
+                               "notify::icon-name",
+                               G_CALLBACK (gbp_testui_item_notify_icon_name_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
+      g_signal_connect_object (instance,
+                               "notify::duration",
+                               G_CALLBACK (gbp_testui_item_notify_stats_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
+      g_signal_connect_object (instance,
+                               "notify::peak-rss",
+                               G_CALLBACK (gbp_testui_item_notify_stats_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
+    }
 }
 
 static void
@@ -151,6 +220,10 @@ gbp_testui_item_get_property (GObject    *object,
       g_value_set_string (value, gbp_testui_item_get_expanded_icon_name (self));
       break;
 
+    case PROP_STATS:
+      g_value_take_string (value, gbp_testui_item_dup_stats (self));
+      break;
+
     case PROP_TITLE:
       g_value_set_string (value, gbp_testui_item_get_title (self));
       break;
@@ -203,6 +276,11 @@ gbp_testui_item_class_init (GbpTestuiItemClass *klass)
                          NULL,
                          (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  properties [PROP_STATS] =
+    g_param_spec_string ("stats", NULL, NULL,
+                         NULL,
+                         (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   properties [PROP_TITLE] =
     g_param_spec_string ("title", NULL, NULL,
                          NULL,
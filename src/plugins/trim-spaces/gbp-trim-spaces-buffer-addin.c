@@ -28,85 +28,291 @@
 
 #include "gbp-trim-spaces-buffer-addin.h"
 
+/*
+ * Rather than asking the change monitor for changed lines when saving,
+ * we track the lines that were touched since the file was loaded (or
+ * last saved) as a sorted set of line ranges. The ranges are updated
+ * from the buffer commit hooks so that they follow inserted and
+ * deleted lines, and the trim at save time only has to look at those
+ * lines regardless of the size of the file.
+ */
+
+typedef struct
+{
+  guint begin;
+  guint end;
+} LineRange;
+
+typedef struct
+{
+  guint line;
+  guint begin_offset;
+  guint end_offset;
+} Trim;
+
 struct _GbpTrimSpacesBufferAddin
 {
-  GObject parent_instance;
+  GObject    parent_instance;
+
+  /* Sorted, non-overlapping LineRange with exclusive end */
+  GArray    *dirty;
+
+  guint      commit_funcs_handler;
+
+  guint      trimming : 1;
 };
 
-static gboolean
-move_to_line_end (GtkTextIter *iter)
+static void
+dirty_normalize (GArray *dirty)
+{
+  guint j = 0;
+
+  for (guint i = 0; i < dirty->len; i++)
+    {
+      const LineRange *range = &g_array_index (dirty, LineRange, i);
+
+      if (range->begin >= range->end)
+        continue;
+
+      if (j > 0 && g_array_index (dirty, LineRange, j - 1).end >= range->begin)
+        {
+          LineRange *prev = &g_array_index (dirty, LineRange, j - 1);
+          prev->end = MAX (prev->end, range->end);
+          continue;
+        }
+
+      g_array_index (dirty, LineRange, j++) = *range;
+    }
+
+  g_array_set_size (dirty, j);
+}
+
+static void
+dirty_add (GArray *dirty,
+           guint   begin,
+           guint   end)
+{
+  LineRange range = { begin, end };
+  guint i;
+
+  for (i = 0; i < dirty->len; i++)
+    {
+      if (g_array_index (dirty, LineRange, i).begin > begin)
+        break;
+    }
+
+  g_array_insert_val (dirty, i, range);
+  dirty_normalize (dirty);
+}
+
+static void
+dirty_insert_lines (GArray *dirty,
+                    guint   line,
+                    guint   n_lines)
+{
+  if (n_lines > 0)
+    {
+      for (guint i = 0; i < dirty->len; i++)
+        {
+          LineRange *range = &g_array_index (dirty, LineRange, i);
+
+          if (range->begin > line)
+            {
+              range->begin += n_lines;
+              range->end += n_lines;
+            }
+          else if (range->end > line)
+            {
+              range->end += n_lines;
+            }
+        }
+    }
+
+  dirty_add (dirty, line, line + n_lines + 1);
+}
+
+static inline guint
+map_deleted_line (guint line,
+                  guint begin,
+                  guint end)
 {
-  GtkTextIter before = *iter;
-  gboolean moved;
+  if (line <= begin)
+    return line;
+  else if (line > end)
+    return line - (end - begin);
+  else
+    return begin;
+}
 
-  moved = gtk_text_iter_forward_to_line_end (iter);
+static void
+dirty_delete_lines (GArray *dirty,
+                    guint   begin,
+                    guint   end)
+{
+  if (end > begin)
+    {
+      for (guint i = 0; i < dirty->len; i++)
+        {
+          LineRange *range = &g_array_index (dirty, LineRange, i);
 
-  if (moved == FALSE)
-    moved = !gtk_text_iter_equal (iter, &before);
+          range->end = map_deleted_line (range->end - 1, begin, end) + 1;
+          range->begin = map_deleted_line (range->begin, begin, end);
+        }
+    }
 
-  return moved;
+  dirty_add (dirty, begin, begin + 1);
+}
+
+static guint
+get_line_at_offset (IdeBuffer *buffer,
+                    guint      offset)
+{
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &iter, offset);
+
+  return gtk_text_iter_get_line (&iter);
+}
+
+static void
+trim_spaces_after_insert_text (IdeBuffer *buffer,
+                               guint      offset,
+                               guint      length,
+                               gpointer   user_data)
+{
+  GbpTrimSpacesBufferAddin *self = user_data;
+  guint begin_line;
+  guint end_line;
+
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
+
+  if (self->trimming)
+    return;
+
+  begin_line = get_line_at_offset (buffer, offset);
+  end_line = get_line_at_offset (buffer, offset + length);
+
+  dirty_insert_lines (self->dirty, begin_line, end_line - begin_line);
 }
 
 static void
-trim_trailing_whitespace (GtkTextBuffer *buffer,
-                          GtkTextIter   *iter)
+trim_spaces_before_delete_range (IdeBuffer *buffer,
+                                 guint      offset,
+                                 guint      length,
+                                 gpointer   user_data)
+{
+  GbpTrimSpacesBufferAddin *self = user_data;
+  guint begin_line;
+  guint end_line;
+
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
+
+  if (self->trimming)
+    return;
+
+  begin_line = get_line_at_offset (buffer, offset);
+  end_line = get_line_at_offset (buffer, offset + length);
+
+  dirty_delete_lines (self->dirty, begin_line, end_line);
+}
+
+static inline gboolean
+is_trimmable (gunichar ch)
 {
   /*
    * Preserve all whitespace that isn't space or tab.
    * This could include line feed, form feed, etc.
    */
-#define TEXT_ITER_IS_SPACE(ptr) \
-    ({  \
-      gunichar ch = gtk_text_iter_get_char (ptr); \
-      (ch == ' ' || ch == '\t'); \
-    })
+  return ch == ' ' || ch == '\t';
+}
 
-  /*
-   * Move to the first character at the end of the line (skipping the newline)
-   * and progress to trip if it is white space.
-   */
-  if (move_to_line_end (iter) &&
-      !gtk_text_iter_starts_line (iter) &&
-      gtk_text_iter_backward_char (iter) &&
-      TEXT_ITER_IS_SPACE (iter))
-    {
-      GtkTextIter begin = *iter;
+static gboolean
+find_trailing_whitespace (GtkTextBuffer *buffer,
+                          guint          line,
+                          Trim          *trim)
+{
+  GtkTextIter begin;
+  GtkTextIter end;
 
-      gtk_text_iter_forward_to_line_end (iter);
+  gtk_text_buffer_get_iter_at_line (buffer, &end, line);
 
-      while (TEXT_ITER_IS_SPACE (&begin))
-        {
-          if (gtk_text_iter_starts_line (&begin))
-            break;
+  if (!gtk_text_iter_ends_line (&end))
+    gtk_text_iter_forward_to_line_end (&end);
 
-          if (!gtk_text_iter_backward_char (&begin))
-            break;
-        }
+  begin = end;
+
+  while (!gtk_text_iter_starts_line (&begin))
+    {
+      GtkTextIter prev = begin;
 
-      if (!TEXT_ITER_IS_SPACE (&begin) && !gtk_text_iter_ends_line (&begin))
-        gtk_text_iter_forward_char (&begin);
+      if (!gtk_text_iter_backward_char (&prev) ||
+          !is_trimmable (gtk_text_iter_get_char (&prev)))
+        break;
 
-      if (!gtk_text_iter_equal (&begin, iter))
-        gtk_text_buffer_delete (buffer, &begin, iter);
+      begin = prev;
     }
+
+  if (gtk_text_iter_equal (&begin, &end))
+    return FALSE;
+
+  trim->line = line;
+  trim->begin_offset = gtk_text_iter_get_line_offset (&begin);
+  trim->end_offset = gtk_text_iter_get_line_offset (&end);
+
+  return TRUE;
 }
 
 static void
-trim_trailing_whitespace_cb (guint               line,
-                             IdeBufferLineChange change,
-                             gpointer            user_data)
+gbp_trim_spaces_buffer_addin_load (IdeBufferAddin *addin,
+                                   IdeBuffer      *buffer)
 {
-  GtkTextBuffer *buffer = user_data;
-  GtkTextIter iter;
+  GbpTrimSpacesBufferAddin *self = (GbpTrimSpacesBufferAddin *)addin;
 
-  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
 
-  if (!(change & (IDE_BUFFER_LINE_CHANGE_ADDED | IDE_BUFFER_LINE_CHANGE_CHANGED)))
-    return;
+  self->commit_funcs_handler =
+    ide_buffer_add_commit_funcs (buffer,
+                                 NULL,
+                                 trim_spaces_after_insert_text,
+                                 trim_spaces_before_delete_range,
+                                 NULL,
+                                 self, NULL);
+}
+
+static void
+gbp_trim_spaces_buffer_addin_unload (IdeBufferAddin *addin,
+                                     IdeBuffer      *buffer)
+{
+  GbpTrimSpacesBufferAddin *self = (GbpTrimSpacesBufferAddin *)addin;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (self->commit_funcs_handler != 0)
+    {
+      ide_buffer_remove_commit_funcs (buffer, self->commit_funcs_handler);
+      self->commit_funcs_handler = 0;
+    }
+
+  g_array_set_size (self->dirty, 0);
+}
 
-  gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
+static void
+gbp_trim_spaces_buffer_addin_file_loaded (IdeBufferAddin *addin,
+                                          IdeBuffer      *buffer,
+                                          GFile          *file)
+{
+  GbpTrimSpacesBufferAddin *self = (GbpTrimSpacesBufferAddin *)addin;
 
-  trim_trailing_whitespace (buffer, &iter);
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
+
+  /* Loading the contents touched every line, none of them are ours */
+  g_array_set_size (self->dirty, 0);
 }
 
 static void
@@ -114,46 +320,105 @@ gbp_trim_spaces_buffer_addin_save_file (IdeBufferAddin *addin,
                                         IdeBuffer      *buffer,
                                         GFile          *file)
 {
+  GbpTrimSpacesBufferAddin *self = (GbpTrimSpacesBufferAddin *)addin;
+  g_autoptr(GArray) trims = NULL;
   IdeFileSettings *file_settings;
-  IdeBufferChangeMonitor *changes;
-  GtkTextIter end;
+  guint n_lines;
 
   g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (addin));
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (G_IS_FILE (file));
 
-  if (!(file_settings = ide_buffer_get_file_settings (buffer)) ||
-      !ide_file_settings_get_trim_trailing_whitespace (file_settings) ||
-      !(changes = ide_buffer_get_change_monitor (buffer)))
+  if (self->dirty->len == 0 ||
+      !(file_settings = ide_buffer_get_file_settings (buffer)) ||
+      !ide_file_settings_get_trim_trailing_whitespace (file_settings))
     return;
 
-  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &end);
+  n_lines = gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer));
+  trims = g_array_new (FALSE, FALSE, sizeof (Trim));
 
-  /* TODO: Fallback when file is untracked */
+  /* Locate everything up front so the edit can be applied in one go */
+  for (guint i = 0; i < self->dirty->len; i++)
+    {
+      const LineRange *range = &g_array_index (self->dirty, LineRange, i);
 
-  ide_buffer_change_monitor_foreach_change (changes,
-                                            0,
-                                            gtk_text_iter_get_line (&end),
-                                            trim_trailing_whitespace_cb,
-                                            buffer);
+      for (guint line = range->begin; line < MIN (range->end, n_lines); line++)
+        {
+          Trim trim;
+
+          if (find_trailing_whitespace (GTK_TEXT_BUFFER (buffer), line, &trim))
+            g_array_append_val (trims, trim);
+        }
+    }
+
+  if (trims->len == 0)
+    return;
+
+  self->trimming = TRUE;
+  gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (buffer));
+
+  /* Work backwards so that each delete leaves the remaining ones valid */
+  for (guint i = trims->len; i > 0; i--)
+    {
+      const Trim *trim = &g_array_index (trims, Trim, i - 1);
+      GtkTextIter begin;
+      GtkTextIter end;
+
+      gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &begin, trim->line, trim->begin_offset);
+      gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &end, trim->line, trim->end_offset);
+      gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &begin, &end);
+    }
+
+  gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (buffer));
+  self->trimming = FALSE;
+}
+
+static void
+gbp_trim_spaces_buffer_addin_file_saved (IdeBufferAddin *addin,
+                                         IdeBuffer      *buffer,
+                                         GFile          *file)
+{
+  GbpTrimSpacesBufferAddin *self = (GbpTrimSpacesBufferAddin *)addin;
+
+  g_assert (GBP_IS_TRIM_SPACES_BUFFER_ADDIN (self));
+
+  g_array_set_size (self->dirty, 0);
 }
 
 static void
 buffer_addin_iface_init (IdeBufferAddinInterface *iface)
 {
+  iface->load = gbp_trim_spaces_buffer_addin_load;
+  iface->unload = gbp_trim_spaces_buffer_addin_unload;
+  iface->file_loaded = gbp_trim_spaces_buffer_addin_file_loaded;
   iface->save_file = gbp_trim_spaces_buffer_addin_save_file;
+  iface->file_saved = gbp_trim_spaces_buffer_addin_file_saved;
 }
 
 G_DEFINE_FINAL_TYPE_WITH_CODE (GbpTrimSpacesBufferAddin, gbp_trim_spaces_buffer_addin, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (IDE_TYPE_BUFFER_ADDIN, buffer_addin_iface_init))
 
+static void
+gbp_trim_spaces_buffer_addin_finalize (GObject *object)
+{
+  GbpTrimSpacesBufferAddin *self = (GbpTrimSpacesBufferAddin *)object;
+
+  g_clear_pointer (&self->dirty, g_array_unref);
+
+  G_OBJECT_CLASS (gbp_trim_spaces_buffer_addin_parent_class)->finalize (object);
+}
+
 static void
 gbp_trim_spaces_buffer_addin_class_init (GbpTrimSpacesBufferAddinClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gbp_trim_spaces_buffer_addin_finalize;
 }
 
 static void
 gbp_trim_spaces_buffer_addin_init (GbpTrimSpacesBufferAddin *self)
 {
+  self->dirty = g_array_new (FALSE, FALSE, sizeof (LineRange));
 }
@@ -0,0 +1,335 @@
+/* gbp-word-buffer-addin.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-word-buffer-addin"
+
+#include "config.h"
+
+#include <libide-code.h>
+
+#include "gbp-word-buffer-addin.h"
+#include "gbp-word-index.h"
+
+/*
+ * Keeps the count of every word within the buffer up to date as the
+ * buffer is edited. Before an edit, the words touching the edited range
+ * are subtracted and afterwards the words touching the resulting range
+ * are added back. Changes in the counts are forwarded to the GbpWordIndex
+ * of the context so that completion can see words from every buffer.
+ *
+ * Nothing is tracked until the index has been activated by completion.
+ */
+
+struct _GbpWordBufferAddin
+{
+  GObject       parent_instance;
+
+  /* Unowned, valid between load and unload */
+  IdeBuffer    *buffer;
+
+  /* Owned word to count, as GUINT_TO_POINTER() */
+  GHashTable   *words;
+
+  GbpWordIndex *index;
+
+  guint         commit_funcs_handler;
+  gulong        activated_handler;
+};
+
+static void
+gbp_word_buffer_addin_adjust (GbpWordBufferAddin *self,
+                              const char         *word,
+                              gsize               len,
+                              int                 delta)
+{
+  g_autofree char *key = g_strndup (word, len);
+  gpointer orig_key;
+  gpointer value;
+  guint count = 0;
+
+  if (g_hash_table_lookup_extended (self->words, key, &orig_key, &value))
+    count = GPOINTER_TO_UINT (value);
+
+  if (delta < 0 && count < (guint)-delta)
+    return;
+
+  count += delta;
+
+  if (count == 0)
+    g_hash_table_remove (self->words, key);
+  else
+    g_hash_table_insert (self->words, g_steal_pointer (&key), GUINT_TO_POINTER (count));
+
+  if (self->index != NULL)
+    gbp_word_index_adjust (self->index, word, len, delta);
+}
+
+static void
+add_word_cb (const char *word,
+             gsize       len,
+             gpointer    user_data)
+{
+  gbp_word_buffer_addin_adjust (user_data, word, len, 1);
+}
+
+static void
+remove_word_cb (const char *word,
+                gsize       len,
+                gpointer    user_data)
+{
+  gbp_word_buffer_addin_adjust (user_data, word, len, -1);
+}
+
+static void
+gbp_word_buffer_addin_scan (GbpWordBufferAddin *self,
+                            IdeBuffer          *buffer,
+                            guint               begin_offset,
+                            guint               end_offset,
+                            GbpWordFunc         func)
+{
+  g_autofree char *text = NULL;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (self->commit_funcs_handler == 0)
+    return;
+
+  /* Expand to the words touching the range, which are all that an edit
+   * of the range can change.
+   */
+  gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &begin, begin_offset);
+  gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, end_offset);
+
+  while (!gtk_text_iter_is_start (&begin))
+    {
+      GtkTextIter prev = begin;
+
+      gtk_text_iter_backward_char (&prev);
+      if (!gbp_word_index_is_word_char (gtk_text_iter_get_char (&prev)))
+        break;
+      begin = prev;
+    }
+
+  while (!gtk_text_iter_is_end (&end) &&
+         gbp_word_index_is_word_char (gtk_text_iter_get_char (&end)))
+    gtk_text_iter_forward_char (&end);
+
+  if (gtk_text_iter_equal (&begin, &end))
+    return;
+
+  text = gtk_text_iter_get_slice (&begin, &end);
+  gbp_word_index_tokenize (text, strlen (text), func, self);
+}
+
+static void
+words_before_insert_text (IdeBuffer *buffer,
+                          guint      offset,
+                          guint      length,
+                          gpointer   user_data)
+{
+  gbp_word_buffer_addin_scan (user_data, buffer, offset, offset, remove_word_cb);
+}
+
+static void
+words_after_insert_text (IdeBuffer *buffer,
+                         guint      offset,
+                         guint      length,
+                         gpointer   user_data)
+{
+  gbp_word_buffer_addin_scan (user_data, buffer, offset, offset + length, add_word_cb);
+}
+
+static void
+words_before_delete_range (IdeBuffer *buffer,
+                           guint      offset,
+                           guint      length,
+                           gpointer   user_data)
+{
+  gbp_word_buffer_addin_scan (user_data, buffer, offset, offset + length, remove_word_cb);
+}
+
+static void
+words_after_delete_range (IdeBuffer *buffer,
+                          guint      offset,
+                          guint      length,
+                          gpointer   user_data)
+{
+  gbp_word_buffer_addin_scan (user_data, buffer, offset, offset, add_word_cb);
+}
+
+static void
+gbp_word_buffer_addin_start (GbpWordBufferAddin *self)
+{
+  GtkTextIter end;
+
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (self->buffer));
+  g_assert (self->commit_funcs_handler == 0);
+
+  self->commit_funcs_handler =
+    ide_buffer_add_commit_funcs (self->buffer,
+                                 words_before_insert_text,
+                                 words_after_insert_text,
+                                 words_before_delete_range,
+                                 words_after_delete_range,
+                                 self, NULL);
+
+  /* Pick up anything already in the buffer */
+  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (self->buffer), &end);
+  gbp_word_buffer_addin_scan (self, self->buffer, 0, gtk_text_iter_get_offset (&end), add_word_cb);
+}
+
+static void
+gbp_word_buffer_addin_index_activated_cb (GbpWordBufferAddin *self,
+                                          GbpWordIndex       *index)
+{
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (GBP_IS_WORD_INDEX (index));
+
+  g_clear_signal_handler (&self->activated_handler, index);
+
+  if (self->buffer != NULL && self->commit_funcs_handler == 0)
+    gbp_word_buffer_addin_start (self);
+}
+
+static void
+gbp_word_buffer_addin_load (IdeBufferAddin *addin,
+                            IdeBuffer      *buffer)
+{
+  GbpWordBufferAddin *self = (GbpWordBufferAddin *)addin;
+  g_autoptr(IdeContext) context = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  self->buffer = buffer;
+
+  if ((context = ide_buffer_ref_context (buffer)) &&
+      !ide_object_in_destruction (IDE_OBJECT (context)))
+    g_set_object (&self->index, gbp_word_index_from_context (context));
+
+  if (self->index != NULL && !gbp_word_index_is_active (self->index))
+    self->activated_handler =
+      g_signal_connect_object (self->index,
+                               "activated",
+                               G_CALLBACK (gbp_word_buffer_addin_index_activated_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
+  else
+    gbp_word_buffer_addin_start (self);
+
+  IDE_EXIT;
+}
+
+static void
+gbp_word_buffer_addin_unload (IdeBufferAddin *addin,
+                              IdeBuffer      *buffer)
+{
+  GbpWordBufferAddin *self = (GbpWordBufferAddin *)addin;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (self->index != NULL)
+    g_clear_signal_handler (&self->activated_handler, self->index);
+
+  if (self->commit_funcs_handler != 0)
+    {
+      ide_buffer_remove_commit_funcs (buffer, self->commit_funcs_handler);
+      self->commit_funcs_handler = 0;
+    }
+
+  /* Withdraw our words from the shared index */
+  if (self->index != NULL)
+    {
+      g_hash_table_iter_init (&iter, self->words);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        gbp_word_index_adjust (self->index, key, strlen (key), -(int)GPOINTER_TO_UINT (value));
+    }
+
+  g_hash_table_remove_all (self->words);
+  g_clear_object (&self->index);
+
+  self->buffer = NULL;
+
+  IDE_EXIT;
+}
+
+static void
+buffer_addin_iface_init (IdeBufferAddinInterface *iface)
+{
+  iface->load = gbp_word_buffer_addin_load;
+  iface->unload = gbp_word_buffer_addin_unload;
+}
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (GbpWordBufferAddin, gbp_word_buffer_addin, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (IDE_TYPE_BUFFER_ADDIN, buffer_addin_iface_init))
+
+static void
+gbp_word_buffer_addin_finalize (GObject *object)
+{
+  GbpWordBufferAddin *self = (GbpWordBufferAddin *)object;
+
+  g_clear_pointer (&self->words, g_hash_table_unref);
+  g_clear_object (&self->index);
+
+  G_OBJECT_CLASS (gbp_word_buffer_addin_parent_class)->finalize (object);
+}
+
+static void
+gbp_word_buffer_addin_class_init (GbpWordBufferAddinClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gbp_word_buffer_addin_finalize;
+}
+
+static void
+gbp_word_buffer_addin_init (GbpWordBufferAddin *self)
+{
+  self->words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+/**
+ * gbp_word_buffer_addin_get_words:
+ * @self: a #GbpWordBufferAddin
+ *
+ * Gets the words within the buffer and how often they occur.
+ *
+ * Returns: (transfer none): a #GHashTable of word to count
+ */
+GHashTable *
+gbp_word_buffer_addin_get_words (GbpWordBufferAddin *self)
+{
+  g_return_val_if_fail (GBP_IS_WORD_BUFFER_ADDIN (self), NULL);
+
+  return self->words;
+}
@@ -0,0 +1,33 @@
+/* gbp-word-buffer-addin.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GBP_TYPE_WORD_BUFFER_ADDIN (gbp_word_buffer_addin_get_type())
+
+G_DECLARE_FINAL_TYPE (GbpWordBufferAddin, gbp_word_buffer_addin, GBP, WORD_BUFFER_ADDIN, GObject)
+
+GHashTable *gbp_word_buffer_addin_get_words (GbpWordBufferAddin *self);
+
+G_END_DECLS
@@ -121,8 +121,8 @@ gbp_word_completion_provider_populate_async (GtkSourceCompletionProvider *provid
     self->proposals = gbp_word_proposals_new ();
 
   /*
-   * Avoid extra processing unless the user requested completion, since
-   * scanning the buffer is rather expensive.
+   * Only provide words when the user requested completion, otherwise
+   * they would crowd out the proposals from more relevant providers.
    */
   activation = gtk_source_completion_context_get_activation (context);
   if (activation != GTK_SOURCE_COMPLETION_ACTIVATION_USER_REQUESTED)
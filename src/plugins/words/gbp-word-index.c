@@ -0,0 +1,483 @@
+/* gbp-word-index.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-word-index"
+
+#include "config.h"
+
+#include <libide-code.h>
+
+#include "gbp-word-index.h"
+
+/*
+ * GbpWordIndex is the merged view of the words found in all of the open
+ * buffers of a context. Each buffer keeps its own word counts (see
+ * GbpWordBufferAddin) and forwards the changes in those counts here.
+ *
+ * Words are stored in a byte-wise trie where each node is an element
+ * of a single array. Children are linked through sibling indexes in
+ * ascending byte order, which keeps the nodes small and lets us find
+ * every word with a given prefix by walking the prefix and then the
+ * subtree below it.
+ *
+ * Nodes are not removed when the count of a word drops to zero. Once
+ * there are more dead words than live words, the trie is rebuilt.
+ *
+ * Buffers do not track their words until the index is activated, which
+ * happens the first time completion is requested. Most sessions never
+ * ask for word completion and should not pay for it on every keystroke.
+ */
+
+#define MIN_WORD_LEN   3
+#define MAX_WORD_LEN   64
+#define MAX_FRONTIER   64
+#define MIN_DEAD_WORDS 4096
+
+typedef struct
+{
+  guint  first_child;
+  guint  next_sibling;
+  guint  count;
+  guint8 ch;
+  guint8 was_word : 1;
+} Node;
+
+typedef struct
+{
+  guint node;
+  char  path[MAX_WORD_LEN + 1];
+} Frontier;
+
+struct _GbpWordIndex
+{
+  IdeObject  parent_instance;
+  GArray    *nodes;
+  guint      n_words;
+  guint      n_dead;
+  guint      active : 1;
+};
+
+enum {
+  ACTIVATED,
+  N_SIGNALS
+};
+
+G_DEFINE_FINAL_TYPE (GbpWordIndex, gbp_word_index, IDE_TYPE_OBJECT)
+
+static guint signals [N_SIGNALS];
+
+static inline Node *
+get_node (GbpWordIndex *self,
+          guint         index)
+{
+  return &g_array_index (self->nodes, Node, index);
+}
+
+static guint
+get_or_create_child (GbpWordIndex *self,
+                     guint         parent,
+                     guint8        ch)
+{
+  Node node = {0};
+  guint prev = 0;
+  guint child;
+
+  for (child = get_node (self, parent)->first_child;
+       child != 0;
+       prev = child, child = get_node (self, child)->next_sibling)
+    {
+      guint8 child_ch = get_node (self, child)->ch;
+
+      if (child_ch == ch)
+        return child;
+
+      if (child_ch > ch)
+        break;
+    }
+
+  node.ch = ch;
+  node.next_sibling = child;
+  g_array_append_val (self->nodes, node);
+
+  /* get_node() results are invalid after appending */
+  if (prev == 0)
+    get_node (self, parent)->first_child = self->nodes->len - 1;
+  else
+    get_node (self, prev)->next_sibling = self->nodes->len - 1;
+
+  return self->nodes->len - 1;
+}
+
+static void
+gbp_word_index_insert (GbpWordIndex *self,
+                       const char   *word,
+                       gsize         len,
+                       int           delta)
+{
+  guint index = 0;
+  Node *node;
+
+  for (gsize i = 0; i < len; i++)
+    index = get_or_create_child (self, index, word[i]);
+
+  node = get_node (self, index);
+
+  if (delta < 0 && node->count < (guint)-delta)
+    {
+      g_critical ("Word count underflow for \"%.*s\"", (int)len, word);
+      delta = -(int)node->count;
+    }
+
+  if (node->count == 0 && delta > 0)
+    {
+      if (node->was_word)
+        self->n_dead--;
+      self->n_words++;
+      node->was_word = TRUE;
+    }
+  else if (node->count > 0 && node->count + delta == 0)
+    {
+      self->n_words--;
+      self->n_dead++;
+    }
+
+  node->count += delta;
+}
+
+static void
+gbp_word_index_collect (GbpWordIndex     *self,
+                        guint             index,
+                        char             *path,
+                        guint             depth,
+                        GbpWordIndexFunc  func,
+                        gpointer          user_data)
+{
+  const Node *node = get_node (self, index);
+
+  if (node->count > 0)
+    {
+      path[depth] = 0;
+      func (path, node->count, user_data);
+    }
+
+  if (depth >= MAX_WORD_LEN)
+    return;
+
+  for (guint child = node->first_child;
+       child != 0;
+       child = get_node (self, child)->next_sibling)
+    {
+      path[depth] = get_node (self, child)->ch;
+      gbp_word_index_collect (self, child, path, depth + 1, func, user_data);
+    }
+}
+
+typedef struct
+{
+  char word[MAX_WORD_LEN + 1];
+  guint count;
+} LiveWord;
+
+static void
+collect_live_word (const char *word,
+                   guint       count,
+                   gpointer    user_data)
+{
+  GArray *live = user_data;
+  LiveWord lw;
+
+  g_strlcpy (lw.word, word, sizeof lw.word);
+  lw.count = count;
+  g_array_append_val (live, lw);
+}
+
+static void
+gbp_word_index_compact (GbpWordIndex *self)
+{
+  g_autoptr(GArray) live = NULL;
+  char path[MAX_WORD_LEN + 1];
+  Node root = {0};
+
+  g_assert (GBP_IS_WORD_INDEX (self));
+
+  live = g_array_sized_new (FALSE, FALSE, sizeof (LiveWord), self->n_words);
+  gbp_word_index_collect (self, 0, path, 0, collect_live_word, live);
+
+  g_array_set_size (self->nodes, 0);
+  g_array_append_val (self->nodes, root);
+  self->n_words = 0;
+  self->n_dead = 0;
+
+  for (guint i = 0; i < live->len; i++)
+    {
+      const LiveWord *lw = &g_array_index (live, LiveWord, i);
+      gbp_word_index_insert (self, lw->word, strlen (lw->word), lw->count);
+    }
+}
+
+static void
+gbp_word_index_finalize (GObject *object)
+{
+  GbpWordIndex *self = (GbpWordIndex *)object;
+
+  g_clear_pointer (&self->nodes, g_array_unref);
+
+  G_OBJECT_CLASS (gbp_word_index_parent_class)->finalize (object);
+}
+
+static void
+gbp_word_index_class_init (GbpWordIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gbp_word_index_finalize;
+
+  /**
+   * GbpWordIndex::activated:
+   *
+   * The "activated" signal is emitted the first time the index is
+   * needed so that buffers may begin tracking their words.
+   */
+  signals [ACTIVATED] =
+    g_signal_new ("activated",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+gbp_word_index_init (GbpWordIndex *self)
+{
+  Node root = {0};
+
+  self->nodes = g_array_new (FALSE, FALSE, sizeof (Node));
+  g_array_append_val (self->nodes, root);
+}
+
+/**
+ * gbp_word_index_from_context:
+ * @context: an #IdeContext
+ *
+ * Gets the word index shared by all buffers of @context.
+ *
+ * Returns: (transfer none): a #GbpWordIndex
+ */
+GbpWordIndex *
+gbp_word_index_from_context (IdeContext *context)
+{
+  GbpWordIndex *ret;
+
+  g_return_val_if_fail (IDE_IS_CONTEXT (context), NULL);
+  g_return_val_if_fail (!ide_object_in_destruction (IDE_OBJECT (context)), NULL);
+
+  if (!(ret = ide_context_peek_child_typed (context, GBP_TYPE_WORD_INDEX)))
+    {
+      g_autoptr(GbpWordIndex) index = NULL;
+
+      index = ide_object_ensure_child_typed (IDE_OBJECT (context), GBP_TYPE_WORD_INDEX);
+      ret = ide_context_peek_child_typed (context, GBP_TYPE_WORD_INDEX);
+    }
+
+  return ret;
+}
+
+/**
+ * gbp_word_index_activate:
+ * @self: a #GbpWordIndex
+ *
+ * Activates the index so that buffers begin tracking their words.
+ *
+ * The first call emits #GbpWordIndex::activated, during which buffers
+ * add their current contents to the index. Further calls do nothing.
+ */
+void
+gbp_word_index_activate (GbpWordIndex *self)
+{
+  g_return_if_fail (GBP_IS_WORD_INDEX (self));
+
+  if (self->active)
+    return;
+
+  self->active = TRUE;
+
+  g_signal_emit (self, signals [ACTIVATED], 0);
+}
+
+/**
+ * gbp_word_index_is_active:
+ * @self: a #GbpWordIndex
+ *
+ * Checks if gbp_word_index_activate() has been called.
+ *
+ * Returns: %TRUE if buffers should track their words
+ */
+gboolean
+gbp_word_index_is_active (GbpWordIndex *self)
+{
+  g_return_val_if_fail (GBP_IS_WORD_INDEX (self), FALSE);
+
+  return self->active;
+}
+
+/**
+ * gbp_word_index_adjust:
+ * @self: a #GbpWordIndex
+ * @word: the word
+ * @len: the length of @word in bytes
+ * @delta: the change in occurrences of @word
+ *
+ * Adds @delta to the number of times @word is found across buffers.
+ */
+void
+gbp_word_index_adjust (GbpWordIndex *self,
+                       const char   *word,
+                       gsize         len,
+                       int           delta)
+{
+  g_return_if_fail (GBP_IS_WORD_INDEX (self));
+  g_return_if_fail (word != NULL);
+
+  if (delta == 0 || len == 0 || len > MAX_WORD_LEN)
+    return;
+
+  gbp_word_index_insert (self, word, len, delta);
+
+  if (self->n_dead > MIN_DEAD_WORDS && self->n_dead > self->n_words)
+    gbp_word_index_compact (self);
+}
+
+/**
+ * gbp_word_index_lookup:
+ * @self: a #GbpWordIndex
+ * @prefix: the prefix to complete
+ * @func: (scope call): a function to call for each word
+ * @user_data: closure data for @func
+ *
+ * Calls @func for every word beginning with @prefix. ASCII characters
+ * within @prefix are matched without regard to case.
+ */
+void
+gbp_word_index_lookup (GbpWordIndex     *self,
+                       const char       *prefix,
+                       GbpWordIndexFunc  func,
+                       gpointer          user_data)
+{
+  g_autoptr(GArray) frontier = NULL;
+  g_autoptr(GArray) next = NULL;
+  GArray *tmp;
+  gsize len;
+
+  g_return_if_fail (GBP_IS_WORD_INDEX (self));
+  g_return_if_fail (prefix != NULL);
+  g_return_if_fail (func != NULL);
+
+  if ((len = strlen (prefix)) > MAX_WORD_LEN)
+    return;
+
+  frontier = g_array_new (FALSE, TRUE, sizeof (Frontier));
+  next = g_array_new (FALSE, TRUE, sizeof (Frontier));
+  g_array_set_size (frontier, 1);
+
+  /* Follow both cases of each character as we walk the prefix */
+  for (gsize i = 0; i < len && frontier->len > 0; i++)
+    {
+      guint8 lower = g_ascii_tolower (prefix[i]);
+      guint8 upper = g_ascii_toupper (prefix[i]);
+
+      g_array_set_size (next, 0);
+
+      for (guint j = 0; j < frontier->len; j++)
+        {
+          const Frontier *f = &g_array_index (frontier, Frontier, j);
+
+          for (guint child = get_node (self, f->node)->first_child;
+               child != 0 && next->len < MAX_FRONTIER;
+               child = get_node (self, child)->next_sibling)
+            {
+              guint8 ch = get_node (self, child)->ch;
+
+              if (ch == lower || ch == upper)
+                {
+                  Frontier n = *f;
+
+                  n.node = child;
+                  n.path[i] = ch;
+                  g_array_append_val (next, n);
+                }
+
+              if (ch > lower && ch > upper)
+                break;
+            }
+        }
+
+      tmp = frontier;
+      frontier = next;
+      next = tmp;
+    }
+
+  for (guint j = 0; j < frontier->len; j++)
+    {
+      Frontier *f = &g_array_index (frontier, Frontier, j);
+      gbp_word_index_collect (self, f->node, f->path, len, func, user_data);
+    }
+}
+
+/**
+ * gbp_word_index_tokenize:
+ * @text: the text to split
+ * @len: the length of @text in bytes
+ * @func: (scope call): a function to call for each word
+ * @user_data: closure data for @func
+ *
+ * Splits @text into the words that are tracked by the index. Words must
+ * not start with a digit and must be at least three characters long.
+ */
+void
+gbp_word_index_tokenize (const char  *text,
+                         gsize        len,
+                         GbpWordFunc  func,
+                         gpointer     user_data)
+{
+  const char *end = text + len;
+
+  g_return_if_fail (text != NULL || len == 0);
+  g_return_if_fail (func != NULL);
+
+  while (text < end)
+    {
+      const char *begin;
+
+      while (text < end && !gbp_word_index_is_word_char ((guchar)*text))
+        text++;
+
+      begin = text;
+
+      while (text < end && gbp_word_index_is_word_char ((guchar)*text))
+        text++;
+
+      if (text - begin >= MIN_WORD_LEN &&
+          text - begin <= MAX_WORD_LEN &&
+          !g_ascii_isdigit (*begin))
+        func (begin, text - begin, user_data);
+    }
+}
@@ -0,0 +1,63 @@
+/* gbp-word-index.h
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <libide-core.h>
+
+G_BEGIN_DECLS
+
+#define GBP_TYPE_WORD_INDEX (gbp_word_index_get_type())
+
+G_DECLARE_FINAL_TYPE (GbpWordIndex, gbp_word_index, GBP, WORD_INDEX, IdeObject)
+
+typedef void (*GbpWordFunc)        (const char *word,
+                                    gsize       len,
+                                    gpointer    user_data);
+typedef void (*GbpWordIndexFunc)   (const char *word,
+                                    guint       count,
+                                    gpointer    user_data);
+
+GbpWordIndex *gbp_word_index_from_context (IdeContext       *context);
+void          gbp_word_index_activate     (GbpWordIndex     *self);
+gboolean      gbp_word_index_is_active    (GbpWordIndex     *self);
+void          gbp_word_index_adjust       (GbpWordIndex     *self,
+                                           const char       *word,
+                                           gsize             len,
+                                           int               delta);
+void          gbp_word_index_lookup       (GbpWordIndex     *self,
+                                           const char       *prefix,
+                                           GbpWordIndexFunc  func,
+                                           gpointer          user_data);
+void          gbp_word_index_tokenize     (const char       *text,
+                                           gsize             len,
+                                           GbpWordFunc       func,
+                                           gpointer          user_data);
+
+/* Bytes of UTF-8 sequences are all >= 0x80, so this works on both bytes
+ * and characters and keeps the tokenizer and buffers in agreement.
+ */
+static inline gboolean
+gbp_word_index_is_word_char (gunichar ch)
+{
+  return g_ascii_isalnum (ch) || ch == '_' || ch >= 0x80;
+}
+
+G_END_DECLS
@@ -25,46 +25,49 @@
 
 #include <libide-sourceview.h>
 
+#include "gbp-word-buffer-addin.h"
+#include "gbp-word-index.h"
 #include "gbp-word-proposal.h"
 #include "gbp-word-proposals.h"
 
+/*
+ * Words within this many lines of the cursor are considered nearby and
+ * ranked above words found elsewhere in the buffer, which in turn are
+ * ranked above words only found in other buffers.
+ */
+#define NEARBY_LINES   50
+#define NEARBY_BONUS   64
+#define BUFFER_BONUS   8
+#define MAX_PROPOSALS  500
+
 struct _GbpWordProposals
 {
   GObject parent_instance;
 
   /*
-   * A list of all of the words that we've found so far. This is filtered
-   * in followup gbp_word_proposals_refilter() requests based on what we
-   * found during our scan.
-   */
-  GPtrArray *unfiltered;
-
-  /*
-   * A filtered list of items (and their priority score from fuzzy matching).
+   * A filtered list of items (and their priority score).
    * This directly relates to the APIs that are exposed via GListModel.
    */
   GArray *items;
 
   /*
    * This is our string chunk so that we can use larger allocations for
-   * words instead of lots of small allocations. We of course have to
-   * create small allocations when we extract from the text btree.
+   * words instead of lots of small allocations.
    */
   GStringChunk *words;
 
   /*
-   * Because GStringChunk doesn't have a "contains" API for it's
-   * g_string_chunk_insert_const() internal hashtable, we have to do
-   * this manually to quickly know if we can ignore a word.
+   * The merged word index for all buffers in the context and the word
+   * counts of the buffer being completed. Both are kept up to date as
+   * buffers are edited, so populating is just a prefix lookup.
    */
-  GHashTable *words_dedup;
+  GbpWordIndex *index;
+  GHashTable *buffer_words;
 
-  /*
-   * The last word that was searched for. If our new word to filter has this
-   * as a prefix, we can skip a rescan of the buffer and instead just filter
-   * our already filtered results. This makes filtering faster with every
-   * key-press rather than slowing down from heavy scanning.
-   */
+  /* Words found near the cursor when populating, word to count */
+  GHashTable *nearby;
+
+  /* The last word that was searched for */
   gchar *last_word;
 };
 
@@ -74,37 +77,22 @@ typedef struct
   guint        priority;
 } Item;
 
-typedef struct
-{
-  GtkTextMark *mark;
-  guint wrapped : 1;
-} State;
-
 static void list_model_iface_init (GListModelInterface *iface);
 
 G_DEFINE_FINAL_TYPE_WITH_CODE (GbpWordProposals, gbp_word_proposals, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, list_model_iface_init))
 
-static void
-state_free (gpointer data)
-{
-  State *state = data;
-
-  gtk_text_buffer_delete_mark (gtk_text_mark_get_buffer (state->mark), state->mark);
-  g_object_unref (state->mark);
-  g_slice_free (State, state);
-}
-
 static void
 gbp_word_proposals_finalize (GObject *object)
 {
   GbpWordProposals *self = (GbpWordProposals *)object;
 
-  g_clear_pointer (&self->unfiltered, g_ptr_array_unref);
   g_clear_pointer (&self->items, g_array_unref);
-  g_clear_pointer (&self->words_dedup, g_hash_table_unref);
   g_clear_pointer (&self->words, g_string_chunk_free);
+  g_clear_pointer (&self->buffer_words, g_hash_table_unref);
+  g_clear_pointer (&self->nearby, g_hash_table_unref);
   g_clear_pointer (&self->last_word, g_free);
+  g_clear_object (&self->index);
 
   G_OBJECT_CLASS (gbp_word_proposals_parent_class)->finalize (object);
 }
@@ -121,9 +109,8 @@ static void
 gbp_word_proposals_init (GbpWordProposals *self)
 {
   self->items = g_array_new (FALSE, FALSE, sizeof (Item));
-  self->unfiltered = g_ptr_array_new ();
   self->words = g_string_chunk_new (4096);
-  self->words_dedup = g_hash_table_new (g_str_hash, g_str_equal);
+  self->nearby = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 GbpWordProposals *
@@ -132,96 +119,88 @@ gbp_word_proposals_new (void)
   return g_object_new (GBP_TYPE_WORD_PROPOSALS, NULL);
 }
 
-static void
-gbp_word_proposals_add (GbpWordProposals *self,
-                        const gchar      *word)
+static gint
+compare_item (gconstpointer a,
+              gconstpointer b)
 {
-  g_assert (GBP_IS_WORD_PROPOSALS (self));
-  g_assert (word != NULL);
+  const Item *ai = a;
+  const Item *bi = b;
 
-  if (g_hash_table_contains (self->words_dedup, word))
-    return;
+  if (ai->priority < bi->priority)
+    return -1;
+  else if (ai->priority > bi->priority)
+    return 1;
+  else
+    return g_strcmp0 (ai->word, bi->word);
+}
 
-  word = g_string_chunk_insert (self->words, word);
-  g_ptr_array_add (self->unfiltered, (gchar *)word);
-  g_hash_table_add (self->words_dedup, (gchar *)word);
+static void
+add_nearby_cb (const char *word,
+               gsize       len,
+               gpointer    user_data)
+{
+  GHashTable *nearby = user_data;
+  g_autofree char *key = g_strndup (word, len);
+  guint count = GPOINTER_TO_UINT (g_hash_table_lookup (nearby, key));
+
+  g_hash_table_insert (nearby, g_steal_pointer (&key), GUINT_TO_POINTER (count + 1));
 }
 
 static void
-gbp_word_proposals_backward_cb (GObject      *object,
-                                GAsyncResult *result,
-                                gpointer      user_data)
+lookup_cb (const char *word,
+           guint       count,
+           gpointer    user_data)
 {
-  GtkSourceSearchContext *search = (GtkSourceSearchContext *)object;
-  g_autoptr(IdeTask) task = user_data;
-  g_autoptr(GError) error = NULL;
-  g_autofree gchar *word = NULL;
-  GbpWordProposals *self;
-  GtkTextBuffer *buffer;
-  GCancellable *cancellable;
-  GtkTextIter begin, end;
-  gboolean wrapped = FALSE;
-  State *state;
+  GbpWordProposals *self = user_data;
+  guint score = count;
+  Item item;
 
-  g_assert (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
-  g_assert (G_IS_ASYNC_RESULT (result));
-  g_assert (IDE_IS_TASK (task));
+  /* Don't suggest the word that is being typed */
+  if (g_ascii_strcasecmp (word, self->last_word) == 0)
+    return;
 
-  buffer = GTK_TEXT_BUFFER (gtk_source_search_context_get_buffer (search));
+  if (self->buffer_words != NULL)
+    score += BUFFER_BONUS * GPOINTER_TO_UINT (g_hash_table_lookup (self->buffer_words, word));
+  score += NEARBY_BONUS * GPOINTER_TO_UINT (g_hash_table_lookup (self->nearby, word));
 
-  if (gtk_source_search_context_backward_finish (search, result, &begin, &end, &wrapped, &error))
-    {
-      guint line;
-      guint line_offset;
+  item.word = g_string_chunk_insert (self->words, word);
+  item.priority = G_MAXUINT - MIN (score, G_MAXUINT - 1);
 
-      line = gtk_text_iter_get_line (&begin);
-      line_offset = gtk_text_iter_get_line_offset (&begin);
-      gtk_text_buffer_get_iter_at_line_offset (buffer, &begin, line, line_offset);
+  g_array_append_val (self->items, item);
+}
 
-      line = gtk_text_iter_get_line (&end);
-      line_offset = gtk_text_iter_get_line_offset (&end);
-      gtk_text_buffer_get_iter_at_line_offset (buffer, &end, line, line_offset);
+static void
+gbp_word_proposals_query (GbpWordProposals *self,
+                          const gchar      *word)
+{
+  guint old_len;
 
-      word = gtk_text_iter_get_slice (&begin, &end);
-    }
-  else
-    {
-      if (error != NULL)
-        ide_task_return_error (task, g_steal_pointer (&error));
-      else
-        ide_task_return_boolean (task, TRUE);
-      return;
-    }
+  g_assert (GBP_IS_WORD_PROPOSALS (self));
 
-  if (ide_task_return_error_if_cancelled (task))
-    return;
+  old_len = self->items->len;
 
-  self = ide_task_get_source_object (task);
-  cancellable = ide_task_get_cancellable (task);
-  state = ide_task_get_task_data (task);
+  if (old_len)
+    g_array_remove_range (self->items, 0, old_len);
+  g_string_chunk_clear (self->words);
 
-  state->wrapped |= wrapped;
+  g_free (self->last_word);
+  self->last_word = g_strdup (word ? word : "");
 
-  if (state->wrapped)
+  /*
+   * We won't do anything if we don't have a word to complete. Otherwise
+   * we'd just create a list of every word we know about.
+   */
+  if (self->index != NULL && self->last_word[0] != 0)
     {
-      GtkTextIter iter;
+      gbp_word_index_lookup (self->index, self->last_word, lookup_cb, self);
+      g_array_sort (self->items, compare_item);
 
-      gtk_text_buffer_get_iter_at_mark (buffer, &iter, state->mark);
-
-      if (gtk_text_iter_compare (&begin, &iter) <= 0)
-        {
-          ide_task_return_boolean (task, TRUE);
-          return;
-        }
+      if (self->items->len > MAX_PROPOSALS)
+        g_array_set_size (self->items, MAX_PROPOSALS);
     }
 
-  gbp_word_proposals_add (self, word);
-
-  gtk_source_search_context_backward_async (search,
-                                            &begin,
-                                            cancellable,
-                                            gbp_word_proposals_backward_cb,
-                                            g_steal_pointer (&task));
+  if (old_len || self->items->len)
+    g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, self->items->len);
 }
 
 void
@@ -232,13 +211,13 @@ gbp_word_proposals_populate_async (GbpWordProposals           *self,
                                    gpointer                    user_data)
 {
   g_autoptr(IdeTask) task = NULL;
-  g_autoptr(GtkSourceSearchContext) search = NULL;
-  g_autoptr(GtkSourceSearchSettings) settings = NULL;
-  g_autofree gchar *search_text = NULL;
-  GtkTextBuffer *buffer;
-  State *state;
+  g_autoptr(IdeContext) ide_context = NULL;
+  g_autofree gchar *word = NULL;
+  g_autofree gchar *nearby = NULL;
+  IdeBufferAddin *addin;
+  GtkSourceBuffer *buffer;
   GtkTextIter begin, end;
-  guint old_len;
+  GtkTextIter near_begin, near_end;
 
   g_assert (GBP_IS_WORD_PROPOSALS (self));
   g_assert (GTK_SOURCE_IS_COMPLETION_CONTEXT (context));
@@ -247,54 +226,46 @@ gbp_word_proposals_populate_async (GbpWordProposals           *self,
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, gbp_word_proposals_populate_async);
 
-  old_len = self->items->len;
+  g_clear_object (&self->index);
+  g_clear_pointer (&self->buffer_words, g_hash_table_unref);
+  g_hash_table_remove_all (self->nearby);
 
-  g_clear_pointer (&self->last_word, g_free);
+  buffer = gtk_source_completion_context_get_buffer (context);
 
-  if (old_len)
+  if (!IDE_IS_BUFFER (buffer) ||
+      !gtk_source_completion_context_get_bounds (context, &begin, &end))
     {
-      g_array_remove_range (self->items, 0, old_len);
-      if (self->unfiltered->len > 0)
-        g_ptr_array_remove_range (self->unfiltered, 0, self->unfiltered->len);
-      g_hash_table_remove_all (self->words_dedup);
-      g_string_chunk_clear (self->words);
-      g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, 0);
+      gbp_word_proposals_query (self, NULL);
+      ide_task_return_boolean (task, TRUE);
+      return;
     }
 
-  /*
-   * We won't do anything if we don't have a word to complete. Otherwise
-   * we'd just create a list of every word in the file. While that might
-   * be interesting, it's more work than we want to do currently.
-   */
-  if (!gtk_source_completion_context_get_bounds (context, &begin, &end))
+  word = gtk_text_iter_get_slice (&begin, &end);
+
+  if ((ide_context = ide_buffer_ref_context (IDE_BUFFER (buffer))) &&
+      !ide_object_in_destruction (IDE_OBJECT (ide_context)))
     {
-      ide_task_return_boolean (task, TRUE);
-      return;
+      self->index = g_object_ref (gbp_word_index_from_context (ide_context));
+
+      /* Buffers start tracking words the first time we are asked */
+      gbp_word_index_activate (self->index);
     }
 
-  self->last_word = gtk_text_iter_get_slice (&begin, &end);
-
-  settings = gtk_source_search_settings_new ();
-  gtk_source_search_settings_set_regex_enabled (settings, TRUE);
-  gtk_source_search_settings_set_at_word_boundaries (settings, TRUE);
-  search_text = g_strconcat (self->last_word, "[a-zA-Z0-9_]*", NULL);
-  gtk_source_search_settings_set_search_text (settings, search_text);
-  gtk_source_search_settings_set_wrap_around (settings, TRUE);
-
-  buffer = GTK_TEXT_BUFFER (gtk_source_completion_context_get_buffer (context));
-  search = gtk_source_search_context_new (GTK_SOURCE_BUFFER (buffer), settings);
-  gtk_source_search_context_set_highlight (search, FALSE);
-
-  state = g_slice_new0 (State);
-  state->mark = gtk_text_buffer_create_mark (buffer, NULL, &begin, TRUE);
-  g_object_ref (state->mark);
-  ide_task_set_task_data (task, state, state_free);
-
-  gtk_source_search_context_backward_async (search,
-                                            &begin,
-                                            NULL,
-                                            gbp_word_proposals_backward_cb,
-                                            g_steal_pointer (&task));
+  if ((addin = ide_buffer_addin_find_by_module_name (IDE_BUFFER (buffer), "words")))
+    self->buffer_words = g_hash_table_ref (gbp_word_buffer_addin_get_words (GBP_WORD_BUFFER_ADDIN (addin)));
+
+  /* Only a bounded window around the cursor is scanned for proximity */
+  near_begin = begin;
+  near_end = end;
+  gtk_text_iter_backward_lines (&near_begin, NEARBY_LINES);
+  gtk_text_iter_set_line_offset (&near_begin, 0);
+  gtk_text_iter_forward_lines (&near_end, NEARBY_LINES);
+  nearby = gtk_text_iter_get_slice (&near_begin, &near_end);
+  gbp_word_index_tokenize (nearby, strlen (nearby), add_nearby_cb, self->nearby);
+
+  gbp_word_proposals_query (self, word);
+
+  ide_task_return_boolean (task, TRUE);
 }
 
 gboolean
@@ -302,51 +273,16 @@ gbp_word_proposals_populate_finish (GbpWordProposals  *self,
                                     GAsyncResult      *result,
                                     GError           **error)
 {
-  const gchar *word;
-  guint old_len;
-
   g_return_val_if_fail (GBP_IS_WORD_PROPOSALS (self), FALSE);
   g_return_val_if_fail (IDE_IS_TASK (result), FALSE);
 
-  if ((old_len = self->items->len))
-    g_array_remove_range (self->items, 0, old_len);
-
-  word = self->last_word ? self->last_word : "";
-
-  for (guint i = 0; i < self->unfiltered->len; i++)
-    {
-      const gchar *element = g_ptr_array_index (self->unfiltered, i);
-      guint priority;
-
-      if (gtk_source_completion_fuzzy_match (element, word, &priority))
-        {
-          Item item = { element, priority };
-          g_array_append_val (self->items, item);
-        }
-    }
-
-  if (old_len || self->items->len)
-    g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, self->items->len);
-
   return ide_task_propagate_boolean (IDE_TASK (result), error);
 }
 
-static gint
-compare_item (gconstpointer a,
-              gconstpointer b)
-{
-  const Item *ai = a;
-  const Item *bi = b;
-
-  return (gint)ai->priority - (gint)bi->priority;
-}
-
 void
 gbp_word_proposals_refilter (GbpWordProposals *self,
                              const gchar      *word)
 {
-  guint old_len = 0;
-
   g_return_if_fail (GBP_IS_WORD_PROPOSALS (self));
 
   if (word == NULL)
@@ -355,41 +291,7 @@ gbp_word_proposals_refilter (GbpWordProposals *self,
   if (g_strcmp0 (self->last_word, word) == 0)
     return;
 
-  old_len = self->items->len;
-
-  if (self->last_word && g_str_has_prefix (word, self->last_word))
-    {
-      for (guint i = self->items->len; i > 0; i--)
-        {
-          Item *item = &g_array_index (self->items, Item, i - 1);
-
-          if (!gtk_source_completion_fuzzy_match (item->word, word, &item->priority))
-            g_array_remove_index_fast (self->items, i - 1);
-        }
-    }
-  else
-    {
-      if (old_len)
-        g_array_remove_range (self->items, 0, old_len);
-
-      for (guint i = 0; i < self->unfiltered->len; i++)
-        {
-          const gchar *element = g_ptr_array_index (self->unfiltered, i);
-          guint priority;
-
-          if (gtk_source_completion_fuzzy_match (element, word, &priority))
-            {
-              Item item = { element, priority };
-              g_array_append_val (self->items, item);
-            }
-        }
-    }
-
-  g_array_sort (self->items, compare_item);
-  g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, self->items->len);
-
-  g_free (self->last_word);
-  self->last_word = g_strdup (word);
+  gbp_word_proposals_query (self, word);
 }
 
 void
@@ -402,13 +304,11 @@ gbp_word_proposals_clear (GbpWordProposals *self)
   if ((old_len = self->items->len))
     g_array_remove_range (self->items, 0, old_len);
 
-  if (self->unfiltered->len)
-    g_ptr_array_remove_range (self->unfiltered, 0, self->unfiltered->len);
-
-  g_hash_table_remove_all (self->words_dedup);
   g_string_chunk_clear (self->words);
-
+  g_hash_table_remove_all (self->nearby);
+  g_clear_pointer (&self->buffer_words, g_hash_table_unref);
   g_clear_pointer (&self->last_word, g_free);
+  g_clear_object (&self->index);
 
   g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, 0);
 }
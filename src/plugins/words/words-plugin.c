@@ -22,13 +22,18 @@
 
 #include <libpeas.h>
 
+#include <libide-code.h>
 #include <libide-sourceview.h>
 
+#include "gbp-word-buffer-addin.h"
 #include "gbp-word-completion-provider.h"
 
 _IDE_EXTERN void
 _gbp_words_register_types (PeasObjectModule *module)
 {
+  peas_object_module_register_extension_type (module,
+                                              IDE_TYPE_BUFFER_ADDIN,
+                                              GBP_TYPE_WORD_BUFFER_ADDIN);
   peas_object_module_register_extension_type (module,
                                               GTK_SOURCE_TYPE_COMPLETION_PROVIDER,
                                               GBP_TYPE_WORD_COMPLETION_PROVIDER);
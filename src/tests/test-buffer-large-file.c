@@ -0,0 +1,287 @@
+/* test-buffer-large-file.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <libide-code.h>
+
+#include "ide-buffer-private.h"
+
+static void
+test_sniff_text (void)
+{
+  static const struct {
+    const char           *contents;
+    gboolean              is_utf8;
+    GtkSourceNewlineType  newline_type;
+  } tests[] = {
+    { "", TRUE, GTK_SOURCE_NEWLINE_TYPE_DEFAULT },
+    { "no line ending", TRUE, GTK_SOURCE_NEWLINE_TYPE_DEFAULT },
+    { "a\nb\r\n", TRUE, GTK_SOURCE_NEWLINE_TYPE_LF },
+    { "a\r\nb\n", TRUE, GTK_SOURCE_NEWLINE_TYPE_CR_LF },
+    { "a\rb\rc", TRUE, GTK_SOURCE_NEWLINE_TYPE_CR },
+    { "caf\xc3\xa9\n", TRUE, GTK_SOURCE_NEWLINE_TYPE_LF },
+    { "caf\xe9\r\n", FALSE, GTK_SOURCE_NEWLINE_TYPE_CR_LF },
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      GtkSourceNewlineType newline_type = -1;
+      gboolean is_utf8;
+
+      is_utf8 = _ide_buffer_sniff_text (tests[i].contents, strlen (tests[i].contents), &newline_type);
+
+      g_assert_cmpint (is_utf8, ==, tests[i].is_utf8);
+      g_assert_cmpint (newline_type, ==, tests[i].newline_type);
+    }
+}
+
+typedef struct
+{
+  GMainLoop *main_loop;
+  IdeBuffer *buffer;
+  GError    *error;
+} Load;
+
+static void
+load_cb (GObject      *object,
+         GAsyncResult *result,
+         gpointer      user_data)
+{
+  Load *load = user_data;
+
+  load->buffer = ide_buffer_manager_load_file_finish (IDE_BUFFER_MANAGER (object), result, &load->error);
+  g_main_loop_quit (load->main_loop);
+}
+
+static IdeBuffer *
+load_file (IdeBufferManager *buffer_manager,
+           const char       *contents,
+           gsize             length,
+           IdeNotification  *notif)
+{
+  g_autoptr(GMainLoop) main_loop = g_main_loop_new (NULL, FALSE);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autofree char *path = NULL;
+  Load load = { main_loop };
+  int fd;
+
+  fd = g_file_open_tmp ("test-buffer-large-file-XXXXXX.txt", &path, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (fd, !=, -1);
+  close (fd);
+
+  g_file_set_contents (path, contents, length, &error);
+  g_assert_no_error (error);
+
+  file = g_file_new_for_path (path);
+
+  ide_buffer_manager_load_file_async (buffer_manager,
+                                      file,
+                                      IDE_BUFFER_OPEN_FLAGS_NONE,
+                                      notif,
+                                      NULL,
+                                      load_cb,
+                                      &load);
+  g_main_loop_run (main_loop);
+
+  g_assert_no_error (load.error);
+  g_assert_true (IDE_IS_BUFFER (load.buffer));
+  g_assert_true (ide_buffer_is_large_file (load.buffer));
+
+  g_unlink (path);
+
+  return load.buffer;
+}
+
+static char *
+get_text (IdeBuffer *buffer)
+{
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &begin, &end);
+
+  return gtk_text_iter_get_slice (&begin, &end);
+}
+
+static IdeBufferManager *
+create_buffer_manager (IdeContext *context)
+{
+  IdeBufferManager *buffer_manager;
+
+  buffer_manager = ide_object_ensure_child_typed (IDE_OBJECT (context), IDE_TYPE_BUFFER_MANAGER);
+  ide_buffer_manager_set_large_file_size (buffer_manager, 1);
+
+  return buffer_manager;
+}
+
+static void
+test_load_utf8 (void)
+{
+  g_autoptr(IdeContext) context = ide_context_new ();
+  g_autoptr(IdeBufferManager) buffer_manager = create_buffer_manager (context);
+  g_autoptr(GString) contents = g_string_new (NULL);
+  g_autoptr(IdeBuffer) buffer = NULL;
+  g_autofree char *text = NULL;
+
+  /* Enough lines to be inserted over several chunks */
+  for (guint i = 0; i < 100000; i++)
+    g_string_append_printf (contents, "line %u caf\xc3\xa9\n", i);
+
+  buffer = load_file (buffer_manager, contents->str, contents->len, NULL);
+  text = get_text (buffer);
+
+  g_assert_cmpstr (text, ==, contents->str);
+  g_assert_false (ide_buffer_has_encoding_error (buffer));
+  g_assert_cmpint (ide_buffer_get_newline_type (buffer), ==, GTK_SOURCE_NEWLINE_TYPE_LF);
+  g_assert_cmpint (ide_buffer_get_state (buffer), ==, IDE_BUFFER_STATE_READY);
+  g_assert_false (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)));
+
+  ide_object_destroy (IDE_OBJECT (context));
+}
+
+static void
+test_load_crlf (void)
+{
+  static const char contents[] = "first\r\nsecond\r\nthird\r\n";
+  g_autoptr(IdeContext) context = ide_context_new ();
+  g_autoptr(IdeBufferManager) buffer_manager = create_buffer_manager (context);
+  g_autoptr(IdeBuffer) buffer = NULL;
+
+  buffer = load_file (buffer_manager, contents, strlen (contents), NULL);
+
+  g_assert_cmpint (ide_buffer_get_newline_type (buffer), ==, GTK_SOURCE_NEWLINE_TYPE_CR_LF);
+  g_assert_cmpint (gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)), ==, 4);
+
+  ide_object_destroy (IDE_OBJECT (context));
+}
+
+static void
+test_load_latin1 (void)
+{
+  static const char contents[] = "caf\xe9\nna\xefve\n";
+  g_autoptr(IdeContext) context = ide_context_new ();
+  g_autoptr(IdeBufferManager) buffer_manager = create_buffer_manager (context);
+  g_autoptr(IdeBuffer) buffer = NULL;
+  g_autofree char *text = NULL;
+
+  buffer = load_file (buffer_manager, contents, strlen (contents), NULL);
+  text = get_text (buffer);
+
+  /* Converted rather than replaced with U+FFFD */
+  g_assert_cmpstr (text, ==, "caf\xc3\xa9\nna\xc3\xafve\n");
+  g_assert_false (ide_buffer_has_encoding_error (buffer));
+
+  ide_object_destroy (IDE_OBJECT (context));
+}
+
+static void
+test_load_with_notification (void)
+{
+  static const char contents[] = "some text\n";
+  g_autoptr(IdeContext) context = ide_context_new ();
+  g_autoptr(IdeBufferManager) buffer_manager = create_buffer_manager (context);
+  g_autoptr(IdeNotification) notif = ide_notification_new ();
+  g_autoptr(IdeObject) parent = NULL;
+  g_autoptr(IdeBuffer) buffer = NULL;
+  g_autofree char *title = NULL;
+
+  ide_notification_set_title (notif, "Restoring session");
+  ide_notification_attach (notif, IDE_OBJECT (context));
+
+  buffer = load_file (buffer_manager, contents, strlen (contents), notif);
+
+  /* The caller's notification is left for the caller to withdraw */
+  title = ide_notification_dup_title (notif);
+  parent = ide_object_ref_parent (IDE_OBJECT (notif));
+  g_assert_cmpstr (title, ==, "Restoring session");
+  g_assert_nonnull (parent);
+
+  ide_notification_withdraw (notif);
+  ide_object_destroy (IDE_OBJECT (context));
+}
+
+static void
+test_load_concurrent (void)
+{
+  static const char contents[] = "some text\n";
+  g_autoptr(IdeContext) context = ide_context_new ();
+  g_autoptr(IdeBufferManager) buffer_manager = create_buffer_manager (context);
+  g_autoptr(GMainLoop) main_loop = g_main_loop_new (NULL, FALSE);
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autofree char *path = NULL;
+  Load first = { main_loop };
+  Load second = { main_loop };
+  int fd;
+
+  fd = g_file_open_tmp ("test-buffer-large-file-XXXXXX.txt", &path, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+
+  file = g_file_new_for_path (path);
+
+  ide_buffer_manager_load_file_async (buffer_manager, file, IDE_BUFFER_OPEN_FLAGS_NONE,
+                                      NULL, NULL, load_cb, &first);
+
+  /* Visible while the size of the file is being queried */
+  g_assert_nonnull (ide_buffer_manager_find_buffer (buffer_manager, file));
+
+  ide_buffer_manager_load_file_async (buffer_manager, file, IDE_BUFFER_OPEN_FLAGS_NONE,
+                                      NULL, NULL, load_cb, &second);
+
+  while (first.buffer == NULL || second.buffer == NULL)
+    g_main_loop_run (main_loop);
+
+  g_assert_no_error (first.error);
+  g_assert_no_error (second.error);
+  g_assert_true (first.buffer == second.buffer);
+  g_assert_cmpint (g_list_model_get_n_items (G_LIST_MODEL (buffer_manager)), ==, 1);
+
+  g_unlink (path);
+  g_clear_object (&first.buffer);
+  g_clear_object (&second.buffer);
+  ide_object_destroy (IDE_OBJECT (context));
+}
+
+gint
+main (gint argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gtk_init ();
+  g_test_add_func ("/Ide/Buffer/LargeFile/sniff", test_sniff_text);
+  g_test_add_func ("/Ide/Buffer/LargeFile/utf8", test_load_utf8);
+  g_test_add_func ("/Ide/Buffer/LargeFile/crlf", test_load_crlf);
+  g_test_add_func ("/Ide/Buffer/LargeFile/latin1", test_load_latin1);
+  g_test_add_func ("/Ide/Buffer/LargeFile/notification", test_load_with_notification);
+  g_test_add_func ("/Ide/Buffer/LargeFile/concurrent", test_load_concurrent);
+  return g_test_run ();
+}
@@ -0,0 +1,352 @@
+/* test-buffer-snapshot.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <libide-code.h>
+
+#include "ide-buffer-snapshot-private.h"
+
+/* The piece table is checked against a plain GString with the same edits */
+
+static void
+model_insert (GString    *model,
+              gsize       char_offset,
+              const char *text)
+{
+  const char *pos = g_utf8_offset_to_pointer (model->str, char_offset);
+
+  g_string_insert (model, pos - model->str, text);
+}
+
+static void
+model_delete (GString *model,
+              gsize    char_offset,
+              gsize    n_chars)
+{
+  const char *begin = g_utf8_offset_to_pointer (model->str, char_offset);
+  const char *end = g_utf8_offset_to_pointer (begin, n_chars);
+
+  g_string_erase (model, begin - model->str, end - begin);
+}
+
+static guint
+model_n_lines (const GString *model)
+{
+  guint n_lines = 1;
+
+  for (gsize i = 0; i < model->len; i++)
+    n_lines += model->str[i] == '\n';
+
+  return n_lines;
+}
+
+static char *
+model_dup_lines (const GString *model,
+                 guint          begin_line,
+                 guint          end_line)
+{
+  const char *begin = model->str;
+  const char *end;
+
+  for (guint i = 0; i < begin_line && begin; i++)
+    if ((begin = strchr (begin, '\n')))
+      begin++;
+
+  if (begin == NULL)
+    return g_strdup ("");
+
+  end = begin;
+  for (guint i = begin_line; i <= end_line && end; i++)
+    if ((end = strchr (end, '\n')))
+      end++;
+
+  if (end == NULL)
+    return g_strdup (begin);
+
+  return g_strndup (begin, end - begin);
+}
+
+static void
+assert_snapshot (IdeBufferSnapshot *snapshot,
+                 const GString     *model)
+{
+  g_autoptr(GBytes) bytes = ide_buffer_snapshot_dup_content (snapshot);
+  guint n_lines = model_n_lines (model);
+  gsize len;
+
+  g_assert_cmpuint (g_bytes_get_size (bytes), ==, model->len);
+  g_assert_cmpmem (g_bytes_get_data (bytes, NULL), model->len, model->str, model->len);
+  g_assert_cmpint (((const char *)g_bytes_get_data (bytes, NULL))[model->len], ==, 0);
+  g_assert_cmpuint (ide_buffer_snapshot_get_length (snapshot), ==, model->len);
+  g_assert_cmpuint (ide_buffer_snapshot_get_n_lines (snapshot), ==, n_lines);
+
+  for (guint i = 0; i < n_lines; i += 1 + i / 4)
+    {
+      guint end_line = i + (i % 3);
+      g_autofree char *lines = ide_buffer_snapshot_dup_lines (snapshot, i, end_line, &len);
+      g_autofree char *expected = model_dup_lines (model, i, end_line);
+
+      g_assert_cmpstr (lines, ==, expected);
+      g_assert_cmpuint (len, ==, strlen (expected));
+    }
+}
+
+static void
+assert_table (IdePieceTable *table,
+              const GString *model)
+{
+  g_autoptr(IdeBufferSnapshot) snapshot = _ide_piece_table_snapshot (table, 0, FALSE);
+
+  assert_snapshot (snapshot, model);
+}
+
+static void
+test_piece_table_split (void)
+{
+  IdePieceTable *table = _ide_piece_table_new ();
+  g_autoptr(GString) model = g_string_new (NULL);
+
+  _ide_piece_table_insert (table, 0, "hello world\n", 12);
+  model_insert (model, 0, "hello world\n");
+  assert_table (table, model);
+
+  /* Split a piece in the middle of a word */
+  _ide_piece_table_insert (table, 5, ",\nbig", 5);
+  model_insert (model, 5, ",\nbig");
+  assert_table (table, model);
+
+  /* Split at a multi-byte character */
+  _ide_piece_table_insert (table, 0, "ñandú\n", strlen ("ñandú\n"));
+  model_insert (model, 0, "ñandú\n");
+  _ide_piece_table_insert (table, 2, "→", strlen ("→"));
+  model_insert (model, 2, "→");
+  assert_table (table, model);
+
+  /* Append to the end, which extends the previous piece */
+  _ide_piece_table_insert (table, g_utf8_strlen (model->str, -1), "tail", 4);
+  model_insert (model, g_utf8_strlen (model->str, -1), "tail");
+  _ide_piece_table_insert (table, g_utf8_strlen (model->str, -1), "\n", 1);
+  model_insert (model, g_utf8_strlen (model->str, -1), "\n");
+  assert_table (table, model);
+
+  _ide_piece_table_free (table);
+}
+
+static void
+test_piece_table_delete (void)
+{
+  IdePieceTable *table = _ide_piece_table_new ();
+  g_autoptr(GString) model = g_string_new (NULL);
+
+  _ide_piece_table_insert (table, 0, "aaaa\nbbbb\n", 10);
+  _ide_piece_table_insert (table, 10, "cccc\ndddd\n", 10);
+  _ide_piece_table_insert (table, 5, "ééé\n", strlen ("ééé\n"));
+  model_insert (model, 0, "aaaa\nbbbb\n");
+  model_insert (model, 10, "cccc\ndddd\n");
+  model_insert (model, 5, "ééé\n");
+  assert_table (table, model);
+
+  /* Within a single piece, splitting it */
+  _ide_piece_table_delete (table, 1, 2);
+  model_delete (model, 1, 2);
+  assert_table (table, model);
+
+  /* Spanning several pieces, including newlines */
+  _ide_piece_table_delete (table, 2, 8);
+  model_delete (model, 2, 8);
+  assert_table (table, model);
+
+  /* Head and tail of the table */
+  _ide_piece_table_delete (table, 0, 1);
+  model_delete (model, 0, 1);
+  _ide_piece_table_delete (table, g_utf8_strlen (model->str, -1) - 1, 1);
+  model_delete (model, g_utf8_strlen (model->str, -1) - 1, 1);
+  assert_table (table, model);
+
+  /* Everything */
+  _ide_piece_table_delete (table, 0, g_utf8_strlen (model->str, -1));
+  g_string_truncate (model, 0);
+  assert_table (table, model);
+
+  _ide_piece_table_insert (table, 0, "again\n", 6);
+  model_insert (model, 0, "again\n");
+  assert_table (table, model);
+
+  _ide_piece_table_free (table);
+}
+
+static void
+test_piece_table_large (void)
+{
+  IdePieceTable *table = _ide_piece_table_new ();
+  g_autoptr(GString) model = g_string_new (NULL);
+  g_autoptr(GString) text = g_string_new (NULL);
+
+  /* Larger than a chunk, with multi-byte characters straddling the
+   * boundaries where the insertion has to be split into pieces.
+   */
+  for (guint i = 0; text->len < 200 * 1024; i++)
+    g_string_append_printf (text, "línea %u — %s\n", i, i % 7 ? "texto" : "");
+
+  _ide_piece_table_insert (table, 0, text->str, text->len);
+  model_insert (model, 0, text->str);
+  assert_table (table, model);
+
+  _ide_piece_table_insert (table, 70000, "inserted\n", 9);
+  model_insert (model, 70000, "inserted\n");
+  assert_table (table, model);
+
+  _ide_piece_table_delete (table, 70000, 9);
+  model_delete (model, 70000, 9);
+  g_assert_cmpstr (model->str, ==, text->str);
+  assert_table (table, model);
+
+  _ide_piece_table_delete (table, 1000, 100000);
+  model_delete (model, 1000, 100000);
+  assert_table (table, model);
+
+  _ide_piece_table_free (table);
+}
+
+static void
+test_piece_table_random (void)
+{
+  static const char *words[] = { "a", "bc", "def\n", "\n", "ü", "日本", "x\ny\nz", "  ", "é\n" };
+  IdePieceTable *table = _ide_piece_table_new ();
+  g_autoptr(GString) model = g_string_new (NULL);
+  GRand *rand = g_rand_new_with_seed (42);
+
+  /* Enough edits to trigger compaction more than once */
+  for (guint i = 0; i < 20000; i++)
+    {
+      gsize n_chars = g_utf8_strlen (model->str, -1);
+
+      if (n_chars > 0 && g_rand_int_range (rand, 0, 3) == 0)
+        {
+          gsize offset = g_rand_int_range (rand, 0, n_chars);
+          gsize count = g_rand_int_range (rand, 1, MIN (n_chars - offset, 20) + 1);
+
+          _ide_piece_table_delete (table, offset, count);
+          model_delete (model, offset, count);
+        }
+      else
+        {
+          const char *word = words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))];
+          gsize offset = g_rand_int_range (rand, 0, n_chars + 1);
+
+          _ide_piece_table_insert (table, offset, word, strlen (word));
+          model_insert (model, offset, word);
+        }
+
+      if (i % 1000 == 0)
+        assert_table (table, model);
+    }
+
+  assert_table (table, model);
+
+  g_rand_free (rand);
+  _ide_piece_table_free (table);
+}
+
+static void
+test_snapshot_immutable (void)
+{
+  IdePieceTable *table = _ide_piece_table_new ();
+  g_autoptr(GString) model = g_string_new ("first\nsecond\n");
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autoptr(GString) expected = NULL;
+
+  _ide_piece_table_insert (table, 0, model->str, model->len);
+  snapshot = _ide_piece_table_snapshot (table, 7, FALSE);
+  expected = g_string_new (model->str);
+
+  /* Changing, and even compacting, the table must not affect the snapshot */
+  for (guint i = 0; i < 10000; i++)
+    {
+      _ide_piece_table_insert (table, 6, "xyz", 3);
+      _ide_piece_table_delete (table, 0, 1);
+    }
+  _ide_piece_table_delete (table, 0, model->len + 2 * 10000);
+
+  g_assert_cmpuint (ide_buffer_snapshot_get_sequence (snapshot), ==, 7);
+  assert_snapshot (snapshot, expected);
+
+  _ide_piece_table_free (table);
+
+  /* The snapshot keeps the chunks alive on its own */
+  assert_snapshot (snapshot, expected);
+}
+
+static void
+test_snapshot_trailing_newline (void)
+{
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autoptr(IdeBufferSnapshot) empty = NULL;
+  g_autoptr(GString) expected = g_string_new ("one\ntwo\n");
+  g_autofree char *last = NULL;
+
+  snapshot = _ide_buffer_snapshot_new_for_text ("one\ntwo", 7, 3, TRUE);
+  g_assert_cmpuint (ide_buffer_snapshot_get_sequence (snapshot), ==, 3);
+  g_assert_cmpuint (ide_buffer_snapshot_get_length (snapshot), ==, 8);
+  g_assert_cmpuint (ide_buffer_snapshot_get_n_lines (snapshot), ==, 2);
+
+  {
+    g_autoptr(GBytes) bytes = ide_buffer_snapshot_dup_content (snapshot);
+    g_autoptr(GBytes) again = ide_buffer_snapshot_dup_content (snapshot);
+
+    g_assert_cmpmem (g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes),
+                     expected->str, expected->len);
+
+    /* Serialized once and shared afterwards */
+    g_assert_true (bytes == again);
+  }
+
+  last = ide_buffer_snapshot_dup_lines (snapshot, 1, 1, NULL);
+  g_assert_cmpstr (last, ==, "two\n");
+  g_clear_pointer (&last, g_free);
+
+  last = ide_buffer_snapshot_dup_lines (snapshot, 0, 0, NULL);
+  g_assert_cmpstr (last, ==, "one\n");
+  g_clear_pointer (&last, g_free);
+
+  last = ide_buffer_snapshot_dup_lines (snapshot, 5, 9, NULL);
+  g_assert_cmpstr (last, ==, "");
+
+  empty = _ide_buffer_snapshot_new_for_text ("", 0, 0, TRUE);
+  g_assert_cmpuint (ide_buffer_snapshot_get_length (empty), ==, 1);
+  g_assert_cmpuint (ide_buffer_snapshot_get_n_lines (empty), ==, 1);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/BufferSnapshot/piece-table/split", test_piece_table_split);
+  g_test_add_func ("/Ide/BufferSnapshot/piece-table/delete", test_piece_table_delete);
+  g_test_add_func ("/Ide/BufferSnapshot/piece-table/large", test_piece_table_large);
+  g_test_add_func ("/Ide/BufferSnapshot/piece-table/random", test_piece_table_random);
+  g_test_add_func ("/Ide/BufferSnapshot/immutable", test_snapshot_immutable);
+  g_test_add_func ("/Ide/BufferSnapshot/trailing-newline", test_snapshot_trailing_newline);
+  return g_test_run ();
+}
@@ -0,0 +1,187 @@
+/* test-debugger-address-map.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <libide-debugger.h>
+
+#include "ide-debugger-address-map-private.h"
+
+#define N_MAPPINGS 1000
+#define N_LOOKUPS  1000000
+
+static void
+test_address_map_basic (void)
+{
+  g_autoptr(IdeDebuggerAddressMap) map = ide_debugger_address_map_new ();
+  IdeDebuggerAddressMapEntry entry;
+  const IdeDebuggerAddressMapEntry *found;
+
+  entry.filename = "libc.so.6";
+  entry.offset = 0;
+  entry.start = 0x7f0000001000;
+  entry.end = 0x7f0000002000;
+  ide_debugger_address_map_insert (map, &entry);
+
+  entry.filename = "a.out";
+  entry.start = 0x400000;
+  entry.end = 0x401000;
+  ide_debugger_address_map_insert (map, &entry);
+
+  g_assert_null (ide_debugger_address_map_lookup (map, 0));
+  g_assert_null (ide_debugger_address_map_lookup (map, 0x3fffff));
+  g_assert_null (ide_debugger_address_map_lookup (map, 0x401000));
+  g_assert_null (ide_debugger_address_map_lookup (map, 0x7f0000002000));
+
+  found = ide_debugger_address_map_lookup (map, 0x400000);
+  g_assert_nonnull (found);
+  g_assert_cmpstr (found->filename, ==, "a.out");
+
+  found = ide_debugger_address_map_lookup (map, 0x400fff);
+  g_assert_nonnull (found);
+  g_assert_cmpstr (found->filename, ==, "a.out");
+
+  found = ide_debugger_address_map_lookup (map, 0x7f0000001800);
+  g_assert_nonnull (found);
+  g_assert_cmpstr (found->filename, ==, "libc.so.6");
+
+  g_assert_false (ide_debugger_address_map_remove (map, 0x500000));
+  g_assert_true (ide_debugger_address_map_remove (map, 0x400800));
+  g_assert_null (ide_debugger_address_map_lookup (map, 0x400800));
+  g_assert_nonnull (ide_debugger_address_map_lookup (map, 0x7f0000001000));
+}
+
+static IdeDebuggerAddressMapEntry *
+create_mappings (guint n_mappings)
+{
+  IdeDebuggerAddressMapEntry *entries = g_new0 (IdeDebuggerAddressMapEntry, n_mappings);
+  IdeDebuggerAddress address = 0x7f0000000000;
+
+  /* Similar to /proc/pid/maps, with small gaps between mappings */
+  for (guint i = 0; i < n_mappings; i++)
+    {
+      entries[i].filename = (i % 2) ? "libfoo.so" : "libbar.so";
+      entries[i].offset = 0;
+      entries[i].start = address;
+      entries[i].end = address + 0x1000 * (1 + i % 7);
+      address = entries[i].end + 0x1000;
+    }
+
+  return entries;
+}
+
+static void
+test_address_map_insert_many (void)
+{
+  g_autoptr(IdeDebuggerAddressMap) map = ide_debugger_address_map_new ();
+  g_autofree IdeDebuggerAddressMapEntry *entries = create_mappings (N_MAPPINGS);
+  g_autofree IdeDebuggerAddressMapEntry *shuffled = g_memdup2 (entries, sizeof *entries * N_MAPPINGS);
+
+  for (guint i = N_MAPPINGS - 1; i > 0; i--)
+    {
+      guint j = g_random_int_range (0, i + 1);
+      IdeDebuggerAddressMapEntry tmp = shuffled[i];
+
+      shuffled[i] = shuffled[j];
+      shuffled[j] = tmp;
+    }
+
+  ide_debugger_address_map_insert_many (map, shuffled, N_MAPPINGS / 2);
+  ide_debugger_address_map_insert_many (map, &shuffled[N_MAPPINGS / 2], N_MAPPINGS - N_MAPPINGS / 2);
+
+  for (guint i = 0; i < N_MAPPINGS; i++)
+    {
+      const IdeDebuggerAddressMapEntry *found;
+
+      found = ide_debugger_address_map_lookup (map, entries[i].start);
+      g_assert_nonnull (found);
+      g_assert_cmpuint (found->start, ==, entries[i].start);
+      g_assert_cmpuint (found->end, ==, entries[i].end);
+      g_assert_cmpstr (found->filename, ==, entries[i].filename);
+
+      found = ide_debugger_address_map_lookup (map, entries[i].end - 1);
+      g_assert_nonnull (found);
+      g_assert_cmpuint (found->start, ==, entries[i].start);
+
+      g_assert_null (ide_debugger_address_map_lookup (map, entries[i].end));
+    }
+}
+
+static void
+test_address_map_perf (void)
+{
+  g_autoptr(IdeDebuggerAddressMap) map = ide_debugger_address_map_new ();
+  g_autofree IdeDebuggerAddressMapEntry *entries = create_mappings (N_MAPPINGS);
+  IdeDebuggerAddress first = entries[0].start;
+  IdeDebuggerAddress last = entries[N_MAPPINGS - 1].end;
+  guint n_found = 0;
+  gint64 begin;
+  gint64 end;
+
+  if (!g_test_perf ())
+    {
+      g_test_skip ("Only run in perf mode");
+      return;
+    }
+
+  begin = g_get_monotonic_time ();
+  for (guint i = 0; i < N_MAPPINGS; i++)
+    ide_debugger_address_map_insert (map, &entries[N_MAPPINGS - i - 1]);
+  end = g_get_monotonic_time ();
+  g_test_minimized_result ((end - begin) / (double)G_USEC_PER_SEC,
+                           "Inserted %u mappings individually in %lf msec",
+                           N_MAPPINGS, (end - begin) / 1000.0);
+
+  g_clear_pointer (&map, ide_debugger_address_map_free);
+  map = ide_debugger_address_map_new ();
+
+  begin = g_get_monotonic_time ();
+  ide_debugger_address_map_insert_many (map, entries, N_MAPPINGS);
+  end = g_get_monotonic_time ();
+  g_test_minimized_result ((end - begin) / (double)G_USEC_PER_SEC,
+                           "Inserted %u mappings in bulk in %lf msec",
+                           N_MAPPINGS, (end - begin) / 1000.0);
+
+  begin = g_get_monotonic_time ();
+  for (guint i = 0; i < N_LOOKUPS; i++)
+    {
+      IdeDebuggerAddress address = first + (i * G_GUINT64_CONSTANT (2654435761)) % (last - first);
+
+      if (ide_debugger_address_map_lookup (map, address) != NULL)
+        n_found++;
+    }
+  end = g_get_monotonic_time ();
+  g_test_minimized_result ((end - begin) / (double)G_USEC_PER_SEC,
+                           "Performed %u lookups (%u hits) in %lf msec",
+                           N_LOOKUPS, n_found, (end - begin) / 1000.0);
+
+  g_assert_cmpuint (n_found, >, 0);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Debugger/AddressMap/basic", test_address_map_basic);
+  g_test_add_func ("/Ide/Debugger/AddressMap/insert_many", test_address_map_insert_many);
+  g_test_add_func ("/Ide/Debugger/AddressMap/perf", test_address_map_perf);
+  return g_test_run ();
+}
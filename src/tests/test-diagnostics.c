@@ -0,0 +1,194 @@
+/* test-diagnostics.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <libide-code.h>
+
+#include "ide-diagnostics-private.h"
+
+static void
+count_line_cb (guint                 line,
+               IdeDiagnosticSeverity severity,
+               gpointer              user_data)
+{
+  guint *count = user_data;
+  (*count)++;
+}
+
+static void
+test_line_in_range (void)
+{
+  g_autoptr(IdeDiagnostics) diagnostics = ide_diagnostics_new ();
+  g_autoptr(GFile) file = g_file_new_for_path ("/tmp/test.c");
+  g_autoptr(GFile) other = g_file_new_for_path ("/tmp/other.c");
+  g_autoptr(GArray) lines = g_array_new (FALSE, FALSE, sizeof (guint));
+  GRand *rand = g_rand_new_with_seed (1234);
+
+  for (guint i = 0; i < 1000; i++)
+    {
+      guint line = g_rand_int_range (rand, 0, 5000);
+      GFile *target = i % 10 ? file : other;
+      g_autoptr(IdeLocation) location = ide_location_new (target, line, 0);
+      g_autoptr(IdeDiagnostic) diag = ide_diagnostic_new (IDE_DIAGNOSTIC_WARNING, "warning", location);
+
+      ide_diagnostics_add (diagnostics, diag);
+
+      if (i % 10)
+        g_array_append_val (lines, line);
+
+      /* Add more after the caches have been built too */
+      if (i == 500)
+        g_assert_nonnull (ide_diagnostics_get_diagnostic_at_line (diagnostics, target, line));
+    }
+
+  for (guint i = 0; i < 200; i++)
+    {
+      guint begin = g_rand_int_range (rand, 0, 5100);
+      guint end = begin + g_rand_int_range (rand, 0, 100);
+      guint expected = 0;
+      guint count = 0;
+
+      for (guint j = 0; j < lines->len; j++)
+        {
+          guint line = g_array_index (lines, guint, j);
+
+          if (line >= begin && line <= end)
+            expected++;
+        }
+
+      ide_diagnostics_foreach_line_in_range (diagnostics, file, begin, end, count_line_cb, &count);
+      g_assert_cmpint (count, ==, expected);
+    }
+
+  for (guint i = 0; i < lines->len; i++)
+    {
+      guint line = g_array_index (lines, guint, i);
+      g_autoptr(GPtrArray) at_line = ide_diagnostics_get_diagnostics_at_line (diagnostics, file, line);
+      guint expected = 0;
+
+      for (guint j = 0; j < lines->len; j++)
+        expected += g_array_index (lines, guint, j) == line;
+
+      g_assert_nonnull (at_line);
+      g_assert_cmpint (at_line->len, ==, expected);
+    }
+
+  g_rand_free (rand);
+}
+
+static void
+test_ranges (void)
+{
+  g_autoptr(IdeDiagnostics) diagnostics = ide_diagnostics_new ();
+  g_autoptr(GFile) file = g_file_new_for_path ("/tmp/test.c");
+  g_autoptr(IdeLocation) location = ide_location_new (file, 10, 0);
+  g_autoptr(IdeLocation) begin = ide_location_new (file, 10, 0);
+  g_autoptr(IdeLocation) end = ide_location_new (file, 20, 0);
+  g_autoptr(IdeRange) range = ide_range_new (begin, end);
+  g_autoptr(IdeDiagnostic) diag = ide_diagnostic_new (IDE_DIAGNOSTIC_ERROR, "error", location);
+  guint count = 0;
+
+  ide_diagnostic_add_range (diag, range);
+  ide_diagnostics_add (diagnostics, diag);
+
+  /* Only the location line is reported for the gutter */
+  ide_diagnostics_foreach_line_in_range (diagnostics, file, 15, 30, count_line_cb, &count);
+  g_assert_cmpint (count, ==, 0);
+
+  ide_diagnostics_foreach_line_in_range (diagnostics, file, 0, 10, count_line_cb, &count);
+  g_assert_cmpint (count, ==, 1);
+
+  g_assert_true (ide_diagnostics_get_diagnostic_at_line (diagnostics, file, 10) == diag);
+  g_assert_null (ide_diagnostics_get_diagnostic_at_line (diagnostics, file, 15));
+}
+
+static IdeDiagnostics *
+diagnostics_at_lines (GFile       *file,
+                      const guint *lines,
+                      guint        n_lines)
+{
+  IdeDiagnostics *diagnostics = ide_diagnostics_new ();
+
+  for (guint i = 0; i < n_lines; i++)
+    {
+      g_autoptr(IdeLocation) location = ide_location_new (file, lines[i], 4);
+      g_autofree char *text = g_strdup_printf ("warning %u", i);
+      g_autoptr(IdeDiagnostic) diag = ide_diagnostic_new (IDE_DIAGNOSTIC_WARNING, text, location);
+
+      ide_diagnostics_add (diagnostics, diag);
+    }
+
+  return diagnostics;
+}
+
+static guint
+shift_after_five_cb (guint    line,
+                     gpointer user_data)
+{
+  /* Two lines were inserted after line 5 */
+  return line > 5 ? line + 2 : line;
+}
+
+static void
+collect_changed_cb (guint    begin_line,
+                    guint    end_line,
+                    gpointer user_data)
+{
+  GArray *changed = user_data;
+
+  g_assert_cmpint (begin_line, ==, end_line);
+  g_array_append_val (changed, begin_line);
+}
+
+static void
+test_foreach_changed_shifted (void)
+{
+  static const guint old_lines[] = { 1, 10, 20 };
+  static const guint new_lines[] = { 1, 12, 30 };
+  g_autoptr(GFile) file = g_file_new_for_path ("/tmp/test.c");
+  g_autoptr(IdeDiagnostics) old_diagnostics = diagnostics_at_lines (file, old_lines, G_N_ELEMENTS (old_lines));
+  g_autoptr(IdeDiagnostics) new_diagnostics = diagnostics_at_lines (file, new_lines, G_N_ELEMENTS (new_lines));
+  g_autoptr(GArray) changed = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  /* Without the edit, everything after line 5 looks changed */
+  _ide_diagnostics_foreach_changed (old_diagnostics, new_diagnostics, file,
+                                    NULL, collect_changed_cb, changed);
+  g_assert_cmpint (changed->len, ==, 4);
+
+  /* Moved diagnostics are unchanged, only the one which moved further
+   * than the edit is reported, at both where it was and where it is.
+   */
+  g_array_set_size (changed, 0);
+  _ide_diagnostics_foreach_changed (old_diagnostics, new_diagnostics, file,
+                                    shift_after_five_cb, collect_changed_cb, changed);
+  g_assert_cmpint (changed->len, ==, 2);
+  g_assert_cmpint (g_array_index (changed, guint, 0), ==, 22);
+  g_assert_cmpint (g_array_index (changed, guint, 1), ==, 30);
+}
+
+gint
+main (gint argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/Diagnostics/line-in-range", test_line_in_range);
+  g_test_add_func ("/Ide/Diagnostics/ranges", test_ranges);
+  g_test_add_func ("/Ide/Diagnostics/foreach-changed-shifted", test_foreach_changed_shifted);
+  return g_test_run ();
+}
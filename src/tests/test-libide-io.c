@@ -37,12 +37,101 @@ test_path_expand (void)
   test_expand ("foo", g_build_filename (g_get_home_dir (), "foo", NULL));
 }
 
+static void
+populate_cb (IdeTaskCache  *cache,
+             gconstpointer  key,
+             GTask         *task,
+             gpointer       user_data)
+{
+  g_task_return_pointer (task, g_strdup_printf ("%u", GPOINTER_TO_UINT (key)), g_free);
+  g_object_unref (task);
+}
+
+static gsize
+cost_cb (gconstpointer value,
+         gpointer      user_data)
+{
+  return 100;
+}
+
+static void
+get_cb (GObject      *object,
+        GAsyncResult *result,
+        gpointer      user_data)
+{
+  g_autofree char *value = NULL;
+  g_autoptr(GError) error = NULL;
+  guint *n_active = user_data;
+
+  value = ide_task_cache_get_finish (IDE_TASK_CACHE (object), result, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (value);
+
+  (*n_active)--;
+}
+
+static void
+cache_get (IdeTaskCache *cache,
+           guint         key)
+{
+  guint n_active = 1;
+
+  ide_task_cache_get_async (cache, GUINT_TO_POINTER (key), FALSE, NULL, get_cb, &n_active);
+
+  while (n_active > 0)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_task_cache_budget (void)
+{
+  g_autoptr(IdeTaskCache) cache = NULL;
+  gsize old_budget = ide_task_cache_get_global_budget ();
+  guint64 n_hits;
+  guint64 n_misses;
+  guint64 n_evictions;
+  gsize cost;
+
+  cache = ide_task_cache_new (g_direct_hash, g_direct_equal, NULL, NULL,
+                              (GBoxedCopyFunc)g_strdup, g_free,
+                              0, populate_cb, NULL, NULL);
+  ide_task_cache_set_cost_func (cache, cost_cb, NULL, NULL);
+  ide_task_cache_set_global_budget (300);
+
+  cache_get (cache, 1);
+  cache_get (cache, 2);
+  cache_get (cache, 3);
+
+  /* Use 1 again so that 2 is the least frequently used */
+  cache_get (cache, 1);
+
+  ide_task_cache_get_stats (cache, &n_hits, &n_misses, &n_evictions, &cost);
+  g_assert_cmpint (n_hits, ==, 1);
+  g_assert_cmpint (n_misses, ==, 3);
+  g_assert_cmpint (n_evictions, ==, 0);
+  g_assert_cmpint (cost, ==, 300);
+
+  cache_get (cache, 4);
+
+  ide_task_cache_get_stats (cache, &n_hits, &n_misses, &n_evictions, &cost);
+  g_assert_cmpint (n_misses, ==, 4);
+  g_assert_cmpint (n_evictions, ==, 1);
+  g_assert_cmpint (cost, ==, 300);
+
+  g_assert_nonnull (ide_task_cache_peek (cache, GUINT_TO_POINTER (1)));
+  g_assert_null (ide_task_cache_peek (cache, GUINT_TO_POINTER (2)));
+  g_assert_nonnull (ide_task_cache_peek (cache, GUINT_TO_POINTER (4)));
+
+  ide_task_cache_set_global_budget (old_budget);
+}
+
 gint
 main (int argc,
       char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/libide-io/path/expand", test_path_expand);
+  g_test_add_func ("/libide-io/task-cache/budget", test_task_cache_budget);
   return g_test_run ();
 }
 
@@ -0,0 +1,196 @@
+/* test-pipeline-cache.c
+ *
+ * Copyright 2024 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include <libide-foundry.h>
+
+#include "ide-pipeline-cache-private.h"
+
+static char *
+create_cache_path (char **tmpdir)
+{
+  g_autoptr(GError) error = NULL;
+
+  *tmpdir = g_dir_make_tmp ("test-pipeline-cache-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (*tmpdir);
+
+  return g_build_filename (*tmpdir, "pipeline.ini", NULL);
+}
+
+static void
+remove_cache_path (const char *tmpdir,
+                   const char *path)
+{
+  g_unlink (path);
+  g_rmdir (tmpdir);
+}
+
+static GHashTable *
+create_fingerprint (const char *command,
+                    const char *input)
+{
+  GHashTable *fingerprint = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  g_hash_table_insert (fingerprint, g_strdup ("command"), g_strdup (command));
+  if (input != NULL)
+    g_hash_table_insert (fingerprint, g_strdup ("input:manifest.json"), g_strdup (input));
+
+  return fingerprint;
+}
+
+static void
+test_pipeline_cache_lookup (void)
+{
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *path = create_cache_path (&tmpdir);
+  g_autoptr(IdePipelineCache) cache = ide_pipeline_cache_new (path);
+  g_autoptr(GHashTable) fingerprint = create_fingerprint ("aaaa", "bbbb");
+  g_autoptr(GHashTable) changed = create_fingerprint ("aaaa", "cccc");
+  g_autoptr(GHashTable) missing = create_fingerprint ("aaaa", NULL);
+  char *reason = NULL;
+
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, &reason));
+  g_assert_cmpstr (reason, ==, "it has not completed before");
+  g_clear_pointer (&reason, g_free);
+
+  ide_pipeline_cache_store (cache, "stage-1", fingerprint);
+
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, &reason));
+  g_assert_null (reason);
+
+  /* Other stages are unaffected */
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-2", fingerprint, NULL));
+
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", changed, &reason));
+  g_assert_cmpstr (reason, ==, "input:manifest.json changed");
+  g_clear_pointer (&reason, g_free);
+
+  /* Dropping an input is a change too */
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", missing, &reason));
+  g_assert_cmpstr (reason, ==, "input:manifest.json changed");
+  g_clear_pointer (&reason, g_free);
+
+  /* Storing replaces the previous fingerprint entirely */
+  ide_pipeline_cache_store (cache, "stage-1", missing);
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-1", missing, NULL));
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+
+  remove_cache_path (tmpdir, path);
+}
+
+static void
+test_pipeline_cache_persist (void)
+{
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *path = create_cache_path (&tmpdir);
+  g_autoptr(IdePipelineCache) cache = ide_pipeline_cache_new (path);
+  g_autoptr(GHashTable) fingerprint = create_fingerprint ("aaaa", "bbbb");
+
+  ide_pipeline_cache_store (cache, "stage-1", fingerprint);
+  ide_pipeline_cache_store (cache, "stage-2", fingerprint);
+  g_assert_true (g_file_test (path, G_FILE_TEST_IS_REGULAR));
+  g_clear_pointer (&cache, ide_pipeline_cache_free);
+
+  /* A new cache, such as after restarting, sees what was stored */
+  cache = ide_pipeline_cache_new (path);
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-2", fingerprint, NULL));
+
+  ide_pipeline_cache_forget (cache, "stage-1");
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+  g_clear_pointer (&cache, ide_pipeline_cache_free);
+
+  cache = ide_pipeline_cache_new (path);
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-2", fingerprint, NULL));
+
+  ide_pipeline_cache_clear (cache);
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-2", fingerprint, NULL));
+  g_clear_pointer (&cache, ide_pipeline_cache_free);
+
+  cache = ide_pipeline_cache_new (path);
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-2", fingerprint, NULL));
+
+  remove_cache_path (tmpdir, path);
+}
+
+static void
+test_pipeline_cache_invalid (void)
+{
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *path = create_cache_path (&tmpdir);
+  g_autoptr(IdePipelineCache) cache = NULL;
+  g_autoptr(GHashTable) fingerprint = create_fingerprint ("aaaa", "bbbb");
+  g_autoptr(GError) error = NULL;
+
+  g_file_set_contents (path, "this is not a key file", -1, &error);
+  g_assert_no_error (error);
+
+  /* A corrupt cache is treated as empty and then replaced */
+  cache = ide_pipeline_cache_new (path);
+  g_assert_false (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+  ide_pipeline_cache_store (cache, "stage-1", fingerprint);
+  g_clear_pointer (&cache, ide_pipeline_cache_free);
+
+  cache = ide_pipeline_cache_new (path);
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+
+  remove_cache_path (tmpdir, path);
+}
+
+static void
+test_pipeline_cache_create_parent (void)
+{
+  g_autofree char *tmpdir = NULL;
+  g_autofree char *path = create_cache_path (&tmpdir);
+  g_autofree char *parent = g_build_filename (tmpdir, "pipeline", NULL);
+  g_autofree char *nested = g_build_filename (parent, "builddir.ini", NULL);
+  g_autoptr(IdePipelineCache) cache = ide_pipeline_cache_new (nested);
+  g_autoptr(GHashTable) fingerprint = create_fingerprint ("aaaa", "bbbb");
+
+  /* The cache lives in the project cache which may not exist yet */
+  ide_pipeline_cache_store (cache, "stage-1", fingerprint);
+  g_assert_true (g_file_test (nested, G_FILE_TEST_IS_REGULAR));
+
+  g_clear_pointer (&cache, ide_pipeline_cache_free);
+  cache = ide_pipeline_cache_new (nested);
+  g_assert_true (ide_pipeline_cache_lookup (cache, "stage-1", fingerprint, NULL));
+
+  g_unlink (nested);
+  g_rmdir (parent);
+  remove_cache_path (tmpdir, path);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/PipelineCache/lookup", test_pipeline_cache_lookup);
+  g_test_add_func ("/Ide/PipelineCache/persist", test_pipeline_cache_persist);
+  g_test_add_func ("/Ide/PipelineCache/invalid", test_pipeline_cache_invalid);
+  g_test_add_func ("/Ide/PipelineCache/create_parent", test_pipeline_cache_create_parent);
+  return g_test_run ();
+}